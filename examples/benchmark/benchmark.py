@@ -0,0 +1,199 @@
+"""End-to-end benchmark of LightGBM on synthetic data.
+
+Generates datasets of the given shapes, then for every dataset and parameter set
+trains from text (saving the binary file), trains again from the binary file and
+predicts the test data, timing each phase from the log of the lightgbm executable.
+Results are written as JSON.
+
+Only the Python standard library is needed, e.g.
+    python benchmark.py --shapes dense,sparse --num-data 100000 \
+        --params "" --params "is_enable_sparse=false" --output result.json
+"""
+import argparse
+import json
+import os
+import platform
+import random
+import re
+import subprocess
+import sys
+import time
+
+SHAPES = ('dense', 'sparse', 'rank', 'multiclass')
+
+# objective and metric of each shape
+OBJECTIVES = {
+    'dense': ['objective=binary', 'metric=binary_logloss'],
+    'sparse': ['objective=binary', 'metric=binary_logloss'],
+    'rank': ['objective=lambdarank', 'metric=ndcg'],
+    'multiclass': ['objective=multiclass', 'metric=multi_logloss', 'num_class=5'],
+}
+
+RE_LOAD = re.compile(r'Finished loading data in ([0-9.]+) seconds')
+RE_BINS = re.compile(r'Finished constructing bins in ([0-9.]+) seconds')
+RE_ITER = re.compile(r'([0-9.]+) seconds elapsed, finished iteration ([0-9]+)')
+RE_PREDICT = re.compile(r'Finished prediction in ([0-9.]+) seconds')
+
+
+def write_dataset(shape, filename, num_data, num_features, sparse_rate, seed):
+    """Write a synthetic dataset, labels are a noisy function of the features"""
+    rng = random.Random(seed)
+    weights = [rng.uniform(-1.0, 1.0) for _ in range(num_features)]
+    queries = []
+    with open(filename, 'w') as out:
+        row = 0
+        while row < num_data:
+            # ranking data is written query by query
+            query_size = min(rng.randint(5, 30), num_data - row) if shape == 'rank' else 1
+            queries.append(query_size)
+            for _ in range(query_size):
+                if shape == 'sparse':
+                    values = [rng.random() if rng.random() >= sparse_rate else 0.0 for _ in range(num_features)]
+                else:
+                    values = [rng.gauss(0.0, 1.0) for _ in range(num_features)]
+                score = sum(w * v for w, v in zip(weights, values)) + rng.gauss(0.0, 0.5)
+                if shape == 'rank':
+                    label = min(4, max(0, int(score + 2.0)))
+                elif shape == 'multiclass':
+                    label = min(4, max(0, int(score + 2.5)))
+                else:
+                    label = 1 if score > 0.0 else 0
+                if shape == 'sparse':
+                    features = ' '.join('%d:%.6g' % (i, v) for i, v in enumerate(values) if v != 0.0)
+                    out.write('%d %s\n' % (label, features))
+                else:
+                    out.write('%d\t%s\n' % (label, '\t'.join('%.6g' % v for v in values)))
+            row += query_size
+    if shape == 'rank':
+        with open(filename + '.query', 'w') as out:
+            out.write('\n'.join(str(q) for q in queries) + '\n')
+
+
+def run(lightgbm, args, log_file):
+    """Run lightgbm with key=value arguments, return its log and the wall time"""
+    start = time.time()
+    with open(log_file, 'w') as log:
+        code = subprocess.call([lightgbm] + args, stdout=log, stderr=subprocess.STDOUT)
+    elapsed = time.time() - start
+    with open(log_file) as log:
+        text = log.read()
+    if code != 0:
+        sys.exit('lightgbm failed, see %s' % log_file)
+    return text, elapsed
+
+
+def first_float(regex, text):
+    match = regex.search(text)
+    return float(match.group(1)) if match else None
+
+
+def iteration_times(text):
+    """Times of iterations, the log has the elapsed time since training started"""
+    times = []
+    last = 0.0
+    for match in RE_ITER.finditer(text):
+        elapsed = float(match.group(1))
+        times.append(round(elapsed - last, 6))
+        last = elapsed
+    return times
+
+
+def benchmark(lightgbm, workdir, name, shape, train_file, test_file, num_test, params, common_params):
+    """Benchmark one parameter set on a dataset, name is the prefix of the model and logs"""
+    model_file = os.path.join(workdir, '%s.model.txt' % name)
+    bin_file = train_file + '.bin'
+    if os.path.exists(bin_file):
+        os.remove(bin_file)
+    train_args = ['task=train', 'data=' + train_file, 'output_model=' + model_file]
+    train_args += OBJECTIVES[shape] + common_params + params
+    # from text, the binary file is saved for the next run
+    log, text_wall = run(lightgbm, train_args + ['is_save_binary_file=true'],
+                         os.path.join(workdir, '%s.train_text.log' % name))
+    result = {
+        'params': params,
+        'load_text_s': first_float(RE_LOAD, log),
+        'construct_bins_s': first_float(RE_BINS, log),
+        'train_from_text_wall_s': text_wall,
+    }
+    times = iteration_times(log)
+    result['num_iterations'] = len(times)
+    result['train_s'] = sum(times)
+    result['iteration_s'] = times
+    # from the binary file
+    result['binary_bytes'] = os.path.getsize(bin_file)
+    log, binary_wall = run(lightgbm, train_args, os.path.join(workdir, '%s.train_binary.log' % name))
+    result['load_binary_s'] = first_float(RE_LOAD, log)
+    result['train_from_binary_wall_s'] = binary_wall
+    os.remove(bin_file)
+    # prediction
+    predict_args = ['task=predict', 'data=' + test_file, 'input_model=' + model_file,
+                    'output_result=' + os.path.join(workdir, '%s.predict.txt' % name)]
+    log, _ = run(lightgbm, predict_args + [p for p in params if p.startswith('num_threads')],
+                 os.path.join(workdir, '%s.predict.log' % name))
+    predict_s = first_float(RE_PREDICT, log)
+    result['predict_s'] = predict_s
+    result['predict_rows_per_s'] = num_test / predict_s if predict_s else None
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description='End-to-end benchmark of LightGBM on synthetic data')
+    parser.add_argument('--lightgbm', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'lightgbm'),
+                        help='path of the lightgbm executable')
+    parser.add_argument('--workdir', default='benchmark_data', help='directory of generated data and logs')
+    parser.add_argument('--shapes', default=','.join(SHAPES), help='comma separated shapes of %s' % ', '.join(SHAPES))
+    parser.add_argument('--num-data', type=int, default=100000, help='number of training rows')
+    parser.add_argument('--num-test', type=int, default=10000, help='number of test rows')
+    parser.add_argument('--num-features', type=int, default=50)
+    parser.add_argument('--sparse-rate', type=float, default=0.9, help='fraction of zeros of the sparse shape')
+    parser.add_argument('--num-iterations', type=int, default=50)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--params', action='append', default=None,
+                        help='space separated key=value parameters of one run, can be repeated to compare')
+    parser.add_argument('--output', default='-', help='JSON output file, - for stdout')
+    args = parser.parse_args()
+
+    lightgbm = os.path.abspath(args.lightgbm)
+    if not os.path.isfile(lightgbm):
+        sys.exit('lightgbm executable not found: %s' % lightgbm)
+    if not os.path.isdir(args.workdir):
+        os.makedirs(args.workdir)
+    common_params = ['num_iterations=%d' % args.num_iterations, 'data_random_seed=%d' % args.seed]
+    param_sets = [p.split() for p in (args.params or [''])]
+    report = {
+        'lightgbm': lightgbm,
+        'host': platform.node(),
+        'platform': platform.platform(),
+        'num_data': args.num_data,
+        'num_test': args.num_test,
+        'num_features': args.num_features,
+        'datasets': [],
+    }
+    for shape in args.shapes.split(','):
+        if shape not in SHAPES:
+            sys.exit('unknown shape %s' % shape)
+        train_file = os.path.abspath(os.path.join(args.workdir, '%s.train' % shape))
+        test_file = os.path.abspath(os.path.join(args.workdir, '%s.test' % shape))
+        start = time.time()
+        write_dataset(shape, train_file, args.num_data, args.num_features, args.sparse_rate, args.seed)
+        write_dataset(shape, test_file, args.num_test, args.num_features, args.sparse_rate, args.seed + 1)
+        dataset = {
+            'shape': shape,
+            'generate_s': time.time() - start,
+            'text_bytes': os.path.getsize(train_file),
+            'runs': [],
+        }
+        for i, params in enumerate(param_sets):
+            dataset['runs'].append(benchmark(lightgbm, args.workdir, '%s_%d' % (shape, i), shape, train_file,
+                                             test_file, args.num_test, params, common_params))
+        report['datasets'].append(dataset)
+    text = json.dumps(report, indent=2, sort_keys=True)
+    if args.output == '-':
+        print(text)
+    else:
+        with open(args.output, 'w') as out:
+            out.write(text + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -3,6 +3,7 @@
 
 #include <LightGBM/meta.h>
 #include <LightGBM/config.h>
+#include <LightGBM/utils/thread_pool.h>
 
 #include <vector>
 #include <memory>
@@ -16,11 +17,14 @@ class ObjectiveFunction;
 class Metric;
 
 /*!
-* \brief The main entrance of LightGBM. this application has two tasks:
-*        Train and Predict.
+* \brief The main entrance of LightGBM. this application has five tasks:
+*        Train, Predict, ConvertModel, RefitTree and Serve.
 *        Train task will train a new model
 *        Predict task will predicting the scores of test data using exsiting model,
 *        and saving the score to disk.
+*        ConvertModel task will convert exsiting model to C++ code
+*        RefitTree task will refit the leaf outputs of exsiting model on the training data
+*        Serve task will predict rows sent over TCP by exsiting model, in micro-batches
 */
 class Application {
 public:
@@ -53,12 +57,24 @@ private:
   /*! \brief Main Training logic */
   void Train();
 
+  /*! \brief Refit the leaf outputs of the input model on the training data */
+  void RefitTree();
+
   /*! \brief Initializations before prediction */
   void InitPredict();
 
+  /*! \brief Set the used models and prediction options of the input model */
+  void SetPredictConfig();
+
   /*! \brief Main predicting logic */
   void Predict();
 
+  /*! \brief Serve predictions of rows sent over TCP, never returns */
+  void Serve();
+
+  /*! \brief Convert the input model to C++ code */
+  void ConvertModel();
+
   /*! \brief All configs */
   OverallConfig config_;
   /*! \brief Training data */
@@ -73,13 +89,25 @@ private:
   std::unique_ptr<Boosting> boosting_;
   /*! \brief Training objective function */
   std::unique_ptr<ObjectiveFunction> objective_fun_;
+  /*! \brief Thread pool of all parallel loops, nullptr means using OpenMP */
+  std::unique_ptr<ThreadPool> thread_pool_;
 };
 
 
 inline void Application::Run() {
+  ThreadPool::Scope thread_pool_scope(thread_pool_.get());
   if (config_.task_type == TaskType::kPredict) {
     InitPredict();
     Predict();
+  } else if (config_.task_type == TaskType::kServe) {
+    InitPredict();
+    Serve();
+  } else if (config_.task_type == TaskType::kConvertModel) {
+    InitPredict();
+    ConvertModel();
+  } else if (config_.task_type == TaskType::kRefitTree) {
+    InitTrain();
+    RefitTree();
   } else {
     InitTrain();
     Train();
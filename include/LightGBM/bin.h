@@ -3,8 +3,13 @@
 
 #include <LightGBM/meta.h>
 
+#include <cstdint>
+#include <cstring>
+
 #include <vector>
+#include <utility>
 #include <functional>
+#include <algorithm>
 
 namespace LightGBM {
 
@@ -40,6 +45,260 @@ public:
       used_size += type_size;
     }
   }
+
+  /*!
+  * \brief Encode histogram bins for network, lossless. If it is smaller, the encoded data is
+  *        a header byte of 1, a bitmap of non-empty bins, then the fields of the non-empty bins without padding.
+  *        Otherwise it is a header byte of 0 followed by the raw bins
+  * \param src Histogram bins
+  * \param len Size in byte of src
+  * \param dst Output, should have len + 1 bytes
+  * \return Size in byte of the encoded data
+  */
+  inline static int Encode(const char *src, int len, char *dst) {
+    const HistogramBinEntry* bins = reinterpret_cast<const HistogramBinEntry*>(src);
+    const int num_bins = len / static_cast<int>(sizeof(HistogramBinEntry));
+    const int bitmap_size = (num_bins + 7) / 8;
+    const int sparse_size = EncodedSize(src, len);
+    if (sparse_size >= 1 + len) {
+      dst[0] = 0;
+      std::memcpy(dst + 1, src, len);
+      return 1 + len;
+    }
+    dst[0] = 1;
+    uint8_t* bitmap = reinterpret_cast<uint8_t*>(dst + 1);
+    std::memset(bitmap, 0, bitmap_size);
+    char* packed = dst + 1 + bitmap_size;
+    for (int i = 0; i < num_bins; ++i) {
+      if (bins[i].IsEmpty()) { continue; }
+      bitmap[i >> 3] |= static_cast<uint8_t>(1 << (i & 7));
+      std::memcpy(packed, &bins[i].sum_gradients, sizeof(double));
+      std::memcpy(packed + sizeof(double), &bins[i].sum_hessians, sizeof(double));
+      std::memcpy(packed + 2 * sizeof(double), &bins[i].cnt, sizeof(data_size_t));
+      packed += kPackedSize;
+    }
+    return sparse_size;
+  }
+
+  /*!
+  * \brief Sum up (reducers) functions for histogram bins encoded by Encode
+  * \param src Encoded histogram bins
+  * \param src_size Size in byte of src
+  * \param dst Histogram bins to add to
+  * \param len Size in byte of dst
+  * \return Size in byte of src that is decoded
+  */
+  inline static int DecodeSumReducer(const char *src, int src_size, char *dst, int len) {
+    if (src[0] == 0) {
+      SumReducer(src + 1, dst, std::min(src_size - 1, len));
+      return 1 + len;
+    }
+    HistogramBinEntry* bins = reinterpret_cast<HistogramBinEntry*>(dst);
+    const int num_bins = len / static_cast<int>(sizeof(HistogramBinEntry));
+    const uint8_t* bitmap = reinterpret_cast<const uint8_t*>(src + 1);
+    const char* packed = src + 1 + (num_bins + 7) / 8;
+    for (int i = 0; i < num_bins; ++i) {
+      if ((bitmap[i >> 3] & (1 << (i & 7))) == 0) { continue; }
+      double sum_gradients, sum_hessians;
+      data_size_t cnt;
+      std::memcpy(&sum_gradients, packed, sizeof(double));
+      std::memcpy(&sum_hessians, packed + sizeof(double), sizeof(double));
+      std::memcpy(&cnt, packed + 2 * sizeof(double), sizeof(data_size_t));
+      bins[i].sum_gradients += sum_gradients;
+      bins[i].sum_hessians += sum_hessians;
+      bins[i].cnt += cnt;
+      packed += kPackedSize;
+    }
+    return static_cast<int>(packed - src);
+  }
+
+  /*!
+  * \brief Size in byte of the sparse form of Encode, Encode uses the raw bins if it is not smaller
+  * \param src Histogram bins
+  * \param len Size in byte of src
+  */
+  inline static int EncodedSize(const char *src, int len) {
+    const HistogramBinEntry* bins = reinterpret_cast<const HistogramBinEntry*>(src);
+    const int num_bins = len / static_cast<int>(sizeof(HistogramBinEntry));
+    int num_non_empty = 0;
+    for (int i = 0; i < num_bins; ++i) {
+      if (!bins[i].IsEmpty()) { ++num_non_empty; }
+    }
+    return 1 + (num_bins + 7) / 8 + num_non_empty * kPackedSize;
+  }
+
+private:
+  /*! \brief Size in byte of one bin in the encoded data */
+  static const int kPackedSize = 2 * sizeof(double) + sizeof(data_size_t);
+
+  inline bool IsEmpty() const {
+    return cnt == 0 && sum_gradients == 0.0 && sum_hessians == 0.0;
+  }
+};
+
+/*!
+* \brief Store data for one histogram bin with quantized gradients and hessians.
+*        Both sums are packed into one integer, sum of gradients in the high 32 bits
+*        and sum of (non-negative) hessians in the low 32 bits, so one add updates both.
+*        Histograms stay in this form through subtraction and network reduce,
+*        they are only scaled to real values when finding splits
+*/
+struct IntHistogramBinEntry {
+public:
+  /*! \brief Packed sum of quantized gradients and hessians on this bin */
+  int64_t sum_gradients_hessians;
+  /*! \brief Number of data on this bin */
+  data_size_t cnt;
+
+  /*! \brief Pack one quantized gradient and hessian */
+  inline static int64_t Pack(int8_t gradient, int8_t hessian) {
+    return static_cast<int64_t>(static_cast<uint64_t>(static_cast<int64_t>(gradient)) << 32)
+      + static_cast<uint8_t>(hessian);
+  }
+  /*! \brief Sum of quantized gradients on this bin */
+  inline int32_t sum_gradients() const {
+    return static_cast<int32_t>(sum_gradients_hessians >> 32);
+  }
+  /*! \brief Sum of quantized hessians on this bin */
+  inline uint32_t sum_hessians() const {
+    return static_cast<uint32_t>(sum_gradients_hessians & 0xffffffff);
+  }
+
+  /*!
+  * \brief Sum up (reducers) functions for histogram bin
+  */
+  inline static void SumReducer(const char *src, char *dst, int len) {
+    const int type_size = sizeof(IntHistogramBinEntry);
+    int used_size = 0;
+    const IntHistogramBinEntry* p1;
+    IntHistogramBinEntry* p2;
+    while (used_size < len) {
+      p1 = reinterpret_cast<const IntHistogramBinEntry*>(src);
+      p2 = reinterpret_cast<IntHistogramBinEntry*>(dst);
+      p2->cnt += p1->cnt;
+      p2->sum_gradients_hessians += p1->sum_gradients_hessians;
+      src += type_size;
+      dst += type_size;
+      used_size += type_size;
+    }
+  }
+
+  /*!
+  * \brief Encode histogram bins for network, the same format as HistogramBinEntry::Encode
+  * \param src Histogram bins
+  * \param len Size in byte of src
+  * \param dst Output, should have len + 1 bytes
+  * \return Size in byte of the encoded data
+  */
+  inline static int Encode(const char *src, int len, char *dst) {
+    const IntHistogramBinEntry* bins = reinterpret_cast<const IntHistogramBinEntry*>(src);
+    const int num_bins = len / static_cast<int>(sizeof(IntHistogramBinEntry));
+    const int bitmap_size = (num_bins + 7) / 8;
+    const int sparse_size = EncodedSize(src, len);
+    if (sparse_size >= 1 + len) {
+      dst[0] = 0;
+      std::memcpy(dst + 1, src, len);
+      return 1 + len;
+    }
+    dst[0] = 1;
+    uint8_t* bitmap = reinterpret_cast<uint8_t*>(dst + 1);
+    std::memset(bitmap, 0, bitmap_size);
+    char* packed = dst + 1 + bitmap_size;
+    for (int i = 0; i < num_bins; ++i) {
+      if (bins[i].cnt == 0) { continue; }
+      bitmap[i >> 3] |= static_cast<uint8_t>(1 << (i & 7));
+      std::memcpy(packed, &bins[i].sum_gradients_hessians, sizeof(int64_t));
+      std::memcpy(packed + sizeof(int64_t), &bins[i].cnt, sizeof(data_size_t));
+      packed += kPackedSize;
+    }
+    return sparse_size;
+  }
+
+  /*!
+  * \brief Sum up (reducers) functions for histogram bins encoded by Encode
+  * \param src Encoded histogram bins
+  * \param src_size Size in byte of src
+  * \param dst Histogram bins to add to
+  * \param len Size in byte of dst
+  * \return Size in byte of src that is decoded
+  */
+  inline static int DecodeSumReducer(const char *src, int src_size, char *dst, int len) {
+    if (src[0] == 0) {
+      SumReducer(src + 1, dst, std::min(src_size - 1, len));
+      return 1 + len;
+    }
+    IntHistogramBinEntry* bins = reinterpret_cast<IntHistogramBinEntry*>(dst);
+    const int num_bins = len / static_cast<int>(sizeof(IntHistogramBinEntry));
+    const uint8_t* bitmap = reinterpret_cast<const uint8_t*>(src + 1);
+    const char* packed = src + 1 + (num_bins + 7) / 8;
+    for (int i = 0; i < num_bins; ++i) {
+      if ((bitmap[i >> 3] & (1 << (i & 7))) == 0) { continue; }
+      int64_t sum_gradients_hessians;
+      data_size_t cnt;
+      std::memcpy(&sum_gradients_hessians, packed, sizeof(int64_t));
+      std::memcpy(&cnt, packed + sizeof(int64_t), sizeof(data_size_t));
+      bins[i].sum_gradients_hessians += sum_gradients_hessians;
+      bins[i].cnt += cnt;
+      packed += kPackedSize;
+    }
+    return static_cast<int>(packed - src);
+  }
+
+  /*!
+  * \brief Size in byte of the sparse form of Encode, bins without data are empty
+  * \param src Histogram bins
+  * \param len Size in byte of src
+  */
+  inline static int EncodedSize(const char *src, int len) {
+    const IntHistogramBinEntry* bins = reinterpret_cast<const IntHistogramBinEntry*>(src);
+    const int num_bins = len / static_cast<int>(sizeof(IntHistogramBinEntry));
+    int num_non_empty = 0;
+    for (int i = 0; i < num_bins; ++i) {
+      if (bins[i].cnt != 0) { ++num_non_empty; }
+    }
+    return 1 + (num_bins + 7) / 8 + num_non_empty * kPackedSize;
+  }
+
+private:
+  /*! \brief Size in byte of one bin in the encoded data */
+  static const int kPackedSize = sizeof(int64_t) + sizeof(data_size_t);
+};
+
+/*!
+* \brief Gradient and hessian of one data in bfloat16, packed into 32 bits with the gradient in the low 16 bits.
+*        A bfloat16 is the high 16 bits of a float, so it keeps the range of float with 8 bits of precision,
+*        and converts back to float by a shift
+*/
+struct BF16GradHess {
+public:
+  /*! \brief Pack one gradient and hessian, rounded to nearest even */
+  inline static uint32_t Pack(float gradient, float hessian) {
+    return static_cast<uint32_t>(FloatToBF16(gradient)) | (static_cast<uint32_t>(FloatToBF16(hessian)) << 16);
+  }
+  /*! \brief Gradient of packed value */
+  inline static float Gradient(uint32_t packed) {
+    return BitsToFloat(packed << 16);
+  }
+  /*! \brief Hessian of packed value */
+  inline static float Hessian(uint32_t packed) {
+    return BitsToFloat(packed & 0xffff0000u);
+  }
+
+private:
+  inline static uint16_t FloatToBF16(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+      // keep NaN quiet, rounding could carry it into infinity
+      return static_cast<uint16_t>((bits >> 16) | 0x40);
+    }
+    return static_cast<uint16_t>((bits + 0x7fffu + ((bits >> 16) & 1)) >> 16);
+  }
+  inline static float BitsToFloat(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
 };
 
 /*! \brief This class used to convert feature values into bin,
@@ -88,6 +347,21 @@ public:
   */
   void FindBin(std::vector<double>* values, size_t total_sample_cnt, int max_bin);
 
+  /*!
+  * \brief Construct feature value to bin mapper according to a summary of feature values
+  * \param summary Sorted distinct values of this feature and their counts, zero values can be left out
+  * \param total_sample_cnt Number of samples, including the zero ones
+  * \param max_bin The maximal number of bin
+  */
+  void FindBin(const std::vector<std::pair<double, int>>& summary, size_t total_sample_cnt, int max_bin);
+
+  /*!
+  * \brief Merge consecutive bins into at most max_bin bins, each new bin has about the same number of old bins.
+  *        Sparse rate is kept, so it is a lower bound of the new one
+  * \param max_bin The maximal number of bin
+  */
+  void Coarsen(int max_bin);
+
   /*!
   * \brief Use specific number of bin to calculate the size of this class
   * \param bin The number of bin
@@ -99,7 +373,7 @@ public:
   * \brief Seirilizing this object to buffer
   * \param buffer The destination
   */
-  void CopyTo(char* buffer);
+  void CopyTo(char* buffer) const;
 
   /*!
   * \brief Deserilizing this object from buffer
@@ -139,13 +413,32 @@ public:
   */
   virtual void Init(const char* used_idices, data_size_t num_leaves) = 0;
 
+  /*!
+  * \brief Cache the used non-zero data selected by the last call of Init,
+  *        so the same used data can be initialized again by InitFromCache without selecting them
+  */
+  virtual void CacheUsedData() = 0;
+
+  /*!
+  * \brief Initialization with the used data cached by CacheUsedData, same result as Init with the same used_indices
+  * \param num_leaves Number of leaves on this iteration
+  */
+  virtual void InitFromCache(int num_leaves) = 0;
+
+  /*! \brief Number of non-zero data of all data */
+  virtual data_size_t NumNonZeros() const = 0;
+
+  /*! \brief Sizes in byte of this object */
+  virtual size_t SizesInByte() const = 0;
+
   /*!
   * \brief Construct histogram by using this bin
   *        Note: Unlike Bin, OrderedBin doesn't use ordered gradients and ordered hessians.
   *        Because it is hard to know the relative index in one leaf for sparse bin, since we skipped zero bins.
   * \param leaf Using which leaf's data to construct
   * \param gradients Gradients, Note:non-oredered by leaf
-  * \param hessians Hessians, Note:non-oredered by leaf
+  * \param hessians Hessians, Note:non-oredered by leaf. nullptr means all hessians are 1,
+  *        then sum_hessians of out are not filled, they are counted from cnt by the histogram
   * \param out Output Result
   */
   virtual void ConstructHistogram(int leaf, const score_t* gradients,
@@ -158,6 +451,15 @@ public:
   * \param left_indices left_indices[i] == true means the i-th data will be on left leaf after split
   */
   virtual void Split(int leaf, int right_leaf, const char* left_indices) = 0;
+
+  /*!
+  * \brief Get non-zero data of one leaf
+  * \param leaf Using which leaf's data
+  * \param out_indices Output data indices of the non-zero data
+  * \param out_bins Output bins of the non-zero data, out_bins[i] is the bin of out_indices[i]
+  */
+  virtual void GetLeafNonZeros(int leaf, std::vector<data_size_t>* out_indices,
+    std::vector<uint32_t>* out_bins) const = 0;
 };
 
 /*! \brief Iterator for one bin column */
@@ -189,6 +491,14 @@ public:
   */
   virtual void Push(int tid, data_size_t idx, uint32_t value) = 0;
 
+  /*!
+  * \brief Add rows of default_bin at the end, e.g. to append new data. The new rows can be pushed then,
+  *        and FinishLoad should be called after them, the old rows are not pushed again
+  * \param num_new_data Number of added rows
+  * \param default_bin Bin of the added rows before they are pushed, the bin of zero
+  */
+  virtual void Append(data_size_t num_new_data, uint32_t default_bin) = 0;
+
   /*!
   * \brief Get bin interator of this bin
   * \param start_idx start index of this 
@@ -202,6 +512,12 @@ public:
   */
   virtual void SaveBinaryToFile(FILE* file) const = 0;
 
+  /*!
+  * \brief Copy binary data to buffer, in the same layout as SaveBinaryToFile
+  * \param buffer The destination, should have SizesInByte() bytes
+  */
+  virtual void CopyTo(char* buffer) const = 0;
+
   /*!
   * \brief Load from memory
   * \param file File want to write
@@ -209,6 +525,14 @@ public:
   virtual void LoadFromMemory(const void* memory,
     const std::vector<data_size_t>& local_used_indices) = 0;
 
+  /*!
+  * \brief Use bin data in memory directly instead of copying it.
+  *        The memory should be kept alive and unchanged while this bin is used.
+  * \param memory Pointer to memory, in the same layout as SaveBinaryToFile
+  * \return False if this bin cannot use the memory directly, then LoadFromMemory should be used
+  */
+  virtual bool ReferenceMemory(const void*) { return false; }
+
   /*!
   * \brief Get sizes in byte of this object
   */
@@ -227,7 +551,8 @@ public:
   * \param data_indices Used data indices in current leaf
   * \param num_data Number of used data
   * \param ordered_gradients Pointer to gradients, the data_indices[i]-th data's gradient is ordered_gradients[i]
-  * \param ordered_hessians Pointer to hessians, the data_indices[i]-th data's hessian is ordered_hessians[i]
+  * \param ordered_hessians Pointer to hessians, the data_indices[i]-th data's hessian is ordered_hessians[i].
+  *        nullptr means all hessians are 1, then sum_hessians of out are not filled, they are counted from cnt by the histogram
   * \param out Output Result
   */
   virtual void ConstructHistogram(
@@ -235,6 +560,42 @@ public:
     const score_t* ordered_gradients, const score_t* ordered_hessians,
     HistogramBinEntry* out) const = 0;
 
+  /*!
+  * \brief Construct histogram of this feature with quantized gradients and hessians
+  * \param data_indices Used data indices in current leaf, nullptr means using all data
+  * \param num_data Number of used data
+  * \param ordered_grad_hess Quantized gradients and hessians, interleaved and ordered like ConstructHistogram,
+  *        the data_indices[i]-th data's gradient is ordered_grad_hess[2 * i] and hessian is ordered_grad_hess[2 * i + 1]
+  * \param out Output Result
+  */
+  virtual void ConstructIntHistogram(
+    const data_size_t* data_indices, data_size_t num_data,
+    const int8_t* ordered_grad_hess, IntHistogramBinEntry* out) const = 0;
+
+  /*!
+  * \brief Construct histogram of this feature with gradients and hessians in bfloat16, sums are still in double
+  * \param data_indices Used data indices in current leaf, nullptr means using all data
+  * \param num_data Number of used data
+  * \param ordered_grad_hess Packed values of BF16GradHess, ordered like ConstructHistogram
+  * \param out Output Result
+  */
+  virtual void ConstructBF16Histogram(
+    const data_size_t* data_indices, data_size_t num_data,
+    const uint32_t* ordered_grad_hess, HistogramBinEntry* out) const = 0;
+
+  /*!
+  * \brief Construct histograms of several leaves by one pass over all data
+  * \param data_slot Histogram slot of each data, data with negative slot are skipped
+  * \param num_data Number of all data
+  * \param gradients Gradients, not ordered, the i-th data's gradient is gradients[i]
+  * \param hessians Hessians, not ordered, the i-th data's hessian is hessians[i], nullptr means all hessians are 1
+  * \param out Output Result, out[slot] is the histogram of the slot
+  */
+  virtual void ConstructHistogramForLeaves(
+    const int8_t* data_slot, data_size_t num_data,
+    const score_t* gradients, const score_t* hessians,
+    HistogramBinEntry** out) const = 0;
+
   /*!
   * \brief Split data according to threshold, if bin <= threshold, will put into left(lte_indices), else put into right(gt_indices)
   * \param threshold The split threshold.
@@ -242,6 +603,8 @@ public:
   * \param num_data Number of used data
   * \param lte_indices After called this function. The less or equal data indices will store on this object.
   * \param gt_indices After called this function. The greater data indices will store on this object.
+  *        Implementations should visit data_indices in order and never write ahead of the read position,
+  *        so lte_indices or gt_indices can be the same as data_indices.
   * \return The number of less than or equal data.
   */
   virtual data_size_t Split(
@@ -278,9 +641,11 @@ public:
   * \param num_data Total number of data
   * \param num_bin Number of bin
   * \param default_bin Default bin for zeros value
+  * \param is_enable_4bit False to store features with at most 16 bins in one byte per row,
+  *        which is the layout of binary files without token
   * \return The bin data object
   */
-  static Bin* CreateDenseBin(data_size_t num_data, int num_bin, int default_bin);
+  static Bin* CreateDenseBin(data_size_t num_data, int num_bin, int default_bin, bool is_enable_4bit = true);
 
   /*!
   * \brief Create object for bin data of one feature, used for sparse feature
@@ -291,6 +656,19 @@ public:
   */
   static Bin* CreateSparseBin(data_size_t num_data,
     int num_bin, int default_bin);
+
+  /*!
+  * \brief Estimate the sizes in byte of the bin data of one feature before it is created
+  * \param num_data Total number of data
+  * \param num_bin Number of bin
+  * \param sparse_rate Sparse rate of this bins( num_bin0/num_data )
+  * \param is_sparse True for sparse bin data
+  * \return Estimated sizes in byte
+  */
+  static size_t EstimateSizesInByte(data_size_t num_data, int num_bin, double sparse_rate, bool is_sparse);
+
+  /*! \brief Max number of bins of each dense bin type, from the most compact one */
+  static std::vector<int> DenseBinTypeMaxNumBins();
 };
 
 inline unsigned int BinMapper::ValueToBin(double value) const {
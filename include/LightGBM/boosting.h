@@ -3,6 +3,7 @@
 
 #include <LightGBM/meta.h>
 #include <LightGBM/config.h>
+#include <LightGBM/utils/memory_usage.h>
 
 #include <vector>
 #include <string>
@@ -53,6 +54,27 @@ public:
   virtual bool TrainOneIter(const score_t* gradient, const score_t* hessian, bool is_eval) = 0;
 
   virtual bool EvalAndCheckEarlyStopping() = 0;
+
+  /*!
+  * \brief Refit the existing trees on the training data, the structures of trees are kept and only the outputs
+  *        of leaves are fitted again, iteration by iteration on the scores of the refitted trees before them.
+  *        New outputs are blended with the old ones by refit_decay_rate
+  * \param leaf_preds Leaf index of each data in each tree, row-major with num_models values per data
+  * \param num_data Number of data, should be the same as the training data
+  * \param num_models Number of trees, should be the same as this model
+  */
+  virtual void RefitTree(const int* leaf_preds, data_size_t num_data, int num_models) = 0;
+
+  /*!
+  * \brief Continue training after rows are appended to the training data by Dataset::Append.
+  *        Scores of the old data are kept and only the new data are predicted by the existing trees,
+  *        which should be trained on this training data, e.g. not loaded from model file
+  * \param object_function Objective function initialized on the appended training data
+  * \param training_metrics Training metrics initialized on the appended training data
+  * \param num_old_data Number of training data before appending
+  */
+  virtual void AppendTrainingData(const ObjectiveFunction* object_function,
+    const std::vector<const Metric*>& training_metrics, data_size_t num_old_data) = 0;
   /*!
   * \brief Get evaluation result at data_idx data
   * \param data_idx 0: training data, 1: 1st validation data
@@ -89,6 +111,78 @@ public:
   */
   virtual std::vector<double> Predict(const double* feature_values) const = 0;
   
+  /*!
+  * \brief Prediction for a block of records, not sigmoid transform.
+  *        Trees are visited in blocks, and all records are pushed through a block of trees before the next one
+  * \param feature_values Feature values of the records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param output Prediction results, row-major with NumberOfClasses() columns
+  */
+  virtual void PredictRawForRows(const double* feature_values, int num_rows, double* output) const = 0;
+
+  /*!
+  * \brief Prediction for a block of records, sigmoid transformation will be used if needed
+  * \param feature_values Feature values of the records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param output Prediction results, row-major with NumberOfClasses() columns
+  */
+  virtual void PredictForRows(const double* feature_values, int num_rows, double* output) const = 0;
+
+  /*!
+  * \brief Staged prediction for a block of records, not sigmoid transform. Trees are walked once per record,
+  *        and the scores after every period iterations are written, the last stage is at the last used iteration.
+  *        Prediction early stopping is not used
+  * \param feature_values Feature values of records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param period Number of iterations between stages
+  * \param output Prediction results, row-major with NumberOfPredictStages(period) * NumberOfClasses() columns,
+  *        the stages of a record are contiguous
+  */
+  virtual void PredictRawStagedForRows(const double* feature_values, int num_rows, int period, double* output) const = 0;
+
+  /*!
+  * \brief Staged prediction for a block of records, sigmoid transformation will be used if needed
+  * \param feature_values Feature values of records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param period Number of iterations between stages
+  * \param output Prediction results, the same layout as PredictRawStagedForRows
+  */
+  virtual void PredictStagedForRows(const double* feature_values, int num_rows, int period, double* output) const = 0;
+
+  /*!
+  * \brief Get number of stages of staged prediction and evaluation
+  * \param period Number of iterations between stages
+  * \return Number of stages in the used iterations
+  */
+  virtual int NumberOfPredictStages(int period) const = 0;
+
+  /*!
+  * \brief Evaluate metrics on data after every period iterations. Scores of data are added tree by tree,
+  *        so each tree is traversed once per record. Trees should have bin thresholds, e.g. not loaded from
+  *        model file, and data should be constructed with the training data as the reference
+  * \param data Data to evaluate on
+  * \param metrics Metrics initialized on data
+  * \param period Number of iterations between stages
+  * \return Results of all metrics at each stage
+  */
+  virtual std::vector<std::vector<double>> EvalStaged(const Dataset* data,
+    const std::vector<const Metric*>& metrics, int period) const = 0;
+
+  /*!
+  * \brief Contributions of features to the raw scores of a block of records by TreeSHAP, the contributions
+  *        and the expected value of a class sum to its raw score. Prediction early stopping is not used
+  * \param feature_values Feature values of records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param output Contributions, row-major with NumberOfClasses() * (MaxFeatureIdx() + 2) columns,
+  *        the contributions of each class are followed by its expected value
+  */
+  virtual void PredictContribForRows(const double* feature_values, int num_rows, double* output) const = 0;
+
+  /*!
+  * \brief Can PredictContribForRows be used, false if the used trees don't have the numbers of data of their nodes
+  */
+  virtual bool CanPredictContrib() const = 0;
+
   /*!
   * \brief Predtion for one record with leaf index
   * \param feature_values Feature value on this record
@@ -105,12 +199,58 @@ public:
   */
   virtual void SaveModelToFile(int num_used_model, bool is_finish, const char* filename) = 0;
 
+  /*!
+  * \brief Save model to C++ source code, trees are compiled into nested if-else.
+  *        The code has PredictRaw, Predict and PredictLeafIndex that give the same results as this model
+  * \param num_used_model Number of iterations that want to save, -1 means save all
+  * \param filename Filename that want to save to
+  */
+  virtual void SaveModelToIfElse(int num_used_model, const char* filename) const = 0;
+
+  /*!
+  * \brief Save model to binary file, which is loaded by copying fixed-layout arrays instead of parsing text.
+  *        The file starts with the name of the boosting and the line binary_model_version=<kBinaryModelVersion>,
+  *        then the header and the trees, each tree is aligned to 8 bytes
+  * \param num_used_model Number of iterations that want to save, -1 means save all
+  * \param filename Filename that want to save to
+  */
+  virtual void SaveModelToBinaryFile(int num_used_model, const char* filename) const = 0;
+
+  /*!
+  * \brief Restore from the memory of a binary model file
+  * \param memory Pointer of the memory, e.g. the memory mapped file
+  * \param size Sizes in byte of the memory
+  */
+  virtual void LoadModelFromBinary(const char* memory, size_t size) = 0;
+
   /*!
   * \brief Restore from a serialized string
   * \param model_str The string of model
   */
   virtual void LoadModelFromString(const std::string& model_str) = 0;
 
+  /*!
+  * \brief Save the state of training to a binary checkpoint, in order to resume training by LoadCheckpoint.
+  *        It has the trees, the scores of all datasets, the states of random generators, the bagging data
+  *        and the early stopping bookkeeping, so training is resumed without replaying trees on datasets.
+  *        The file is written to filename.tmp and then renamed, so the last checkpoint is kept if it's interrupted
+  * \param filename Filename that want to save to
+  */
+  virtual void SaveCheckpoint(const char* filename) = 0;
+
+  /*!
+  * \brief Resume training from a checkpoint of SaveCheckpoint, should be called after Init and AddDataset
+  *        with the same datasets and parameters, the following iterations are the same as the ones without interruption
+  * \param filename Filename of the checkpoint
+  */
+  virtual void LoadCheckpoint(const char* filename) = 0;
+
+  /*!
+  * \brief Get number of finished training iterations
+  * \return Number of finished training iterations
+  */
+  virtual int GetCurrentIteration() const = 0;
+
   /*!
   * \brief Get max feature index of this model
   * \return Max feature index of this model
@@ -139,12 +279,41 @@ public:
   * \brief Set number of used model for prediction
   */
   virtual void SetNumUsedModel(int num_used_model) = 0;
+
+  /*!
+  * \brief Set whether to predict on bins. Records are mapped to bins by the thresholds of the model once,
+  *        then trees are traversed on integer comparisons, the results are the same as on feature values
+  * \param is_predict_on_bins True if predict on bins
+  */
+  virtual void SetPredictOnBins(bool is_predict_on_bins) = 0;
+
+  /*!
+  * \brief Set early stopping of prediction, the scores of one record are checked every round_period iterations,
+  *        and the rest trees are skipped once the margin is larger than margin_threshold.
+  *        The margin is 2 * |raw score| for binary classification, and the gap between the top two classes for multiclass.
+  *        Leaf index prediction is not affected
+  * \param round_period Number of iterations between checks, <= 0 means disable
+  * \param margin_threshold Threshold of the margin
+  */
+  virtual void SetPredictEarlyStop(int round_period, double margin_threshold) = 0;
+
+  /*!
+  * \brief Get memory usage of training, for logs and budgets
+  * \return Bytes of each component
+  */
+  virtual MemoryUsage GetMemoryUsage() const = 0;
   
   /*!
   * \brief Get Type name of this boosting object
   */
   virtual const char* Name() const = 0;
 
+  /*! \brief Version of binary model files */
+  static const int kBinaryModelVersion = 2;
+
+  /*! \brief Version of checkpoint files */
+  static const int kCheckpointVersion = 2;
+
   Boosting() = default;
   /*! \brief Disable copy */
   Boosting& operator=(const Boosting&) = delete;
@@ -26,6 +26,8 @@
 
 typedef void* DatesetHandle;
 typedef void* BoosterHandle;
+typedef void* PredictContextHandle;
+typedef void* RegistryHandle;
 
 #define C_API_DTYPE_FLOAT32 (0)
 #define C_API_DTYPE_FLOAT64 (1)
@@ -35,9 +37,11 @@ typedef void* BoosterHandle;
 #define C_API_PREDICT_NORMAL     (0)
 #define C_API_PREDICT_RAW_SCORE  (1)
 #define C_API_PREDICT_LEAF_INDEX (2)
+/*! \brief contributions of features by TreeSHAP, (num_features + 1) * num_class values per row, see LGBM_BoosterPredictContribSparseForCSR */
+#define C_API_PREDICT_CONTRIB    (3)
 
 /*!
-* \brief get string message of the last error
+* \brief get string message of the last error of the calling thread
 *  all function in this file will return 0 when success
 *  and -1 when an error occured,
 * \return const char* error inforomation
@@ -144,6 +148,81 @@ DllExport int LGBM_CreateDatasetFromMat(const void* data,
   const DatesetHandle* reference,
   DatesetHandle* out);
 
+/*!
+* \brief create an empty dataset with the bin mappers of reference,
+*        rows are pushed by LGBM_DatasetPushRows or LGBM_DatasetPushRowsByCSR in batches, then call LGBM_DatasetFinishLoad
+* \param reference used to align bin mapper, e.g. a dataset created from sampled rows
+* \param num_total_row number of rows of the new dataset
+* \param parameters additional parameters
+* \param out created dataset
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_CreateDatasetByReference(const DatesetHandle reference,
+  int64_t num_total_row,
+  const char* parameters,
+  DatesetHandle* out);
+
+/*!
+* \brief push a batch of rows in dense row major format into dataset, rows of the batch are binned in parallel
+* \param dataset handle of dataset created by LGBM_CreateDatasetByReference
+* \param data pointer to the data space
+* \param data_type
+* \param nrow number of rows in the batch
+* \param ncol number columns
+* \param start_row row index of the first row of the batch in dataset
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_DatasetPushRows(DatesetHandle dataset,
+  const void* data,
+  int data_type,
+  int32_t nrow,
+  int32_t ncol,
+  int32_t start_row);
+
+/*!
+* \brief push a batch of rows in CSR format into dataset, rows of the batch are binned in parallel
+* \param dataset handle of dataset created by LGBM_CreateDatasetByReference
+* \param indptr pointer to row headers
+* \param indptr_type
+* \param indices findex
+* \param data fvalue
+* \param data_type
+* \param nindptr number of rows in the batch + 1
+* \param nelem number of nonzero elements in the batch
+* \param num_col number of columns
+* \param start_row row index of the first row of the batch in dataset
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_DatasetPushRowsByCSR(DatesetHandle dataset,
+  const void* indptr,
+  int indptr_type,
+  const int32_t* indices,
+  const void* data,
+  int data_type,
+  int64_t nindptr,
+  int64_t nelem,
+  int64_t num_col,
+  int64_t start_row);
+
+/*!
+* \brief finish pushing rows into dataset, should be called once after all rows are pushed
+* \param dataset handle of dataset created by LGBM_CreateDatasetByReference
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_DatasetFinishLoad(DatesetHandle dataset);
+
+/*!
+* \brief append rows of other dataset after the rows of dataset, with the bin mappers of dataset.
+*        Labels, weights, queries and initial scores are appended too.
+*        Fails if any booster uses dataset, use LGBM_BoosterAppendTrainingData instead if dataset is the
+*        training data of only one booster
+* \param dataset handle of dataset
+* \param other handle of dataset created with dataset as the reference
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_DatasetAppend(DatesetHandle dataset,
+  const DatesetHandle other);
+
 /*!
 * \brief free space for dataset
 * \return 0 when success, -1 when failure happens
@@ -211,6 +290,12 @@ DllExport int LGBM_DatasetGetNumFeature(DatesetHandle handle,
 
 /*!
 * \brief create an new boosting learner
+*  Boosters only read their training and validation data sets, so several boosters, e.g. of a sweep of
+*  parameters, can share one data set and be trained by different threads at the same time.
+*  Scores, gradients and bagging indices are owned by each booster, and num_threads of a booster
+*  only limits the threads of its own calls.
+*  A data set used by several boosters cannot be appended to, since the others keep pointers to its
+*  labels and bins, see LGBM_BoosterAppendTrainingData
 * \param train_data training data set
 * \param valid_datas validation data sets
 * \param valid_names names of validation data sets
@@ -303,6 +388,53 @@ DllExport int LGBM_BoosterGetPredict(BoosterHandle handle,
   int64_t* out_len,
   float* out_result);
 
+/*!
+* \brief set whether to predict on bins, records are mapped to bins by the thresholds of the model once,
+*        then trees are traversed on integer comparisons, the results are the same
+* \param handle handle
+* \param is_predict_on_bins 1 to predict on bins, 0 to predict on feature values
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterSetPredictOnBins(BoosterHandle handle,
+  int is_predict_on_bins);
+
+/*!
+* \brief set early stopping of prediction, the rest trees of a record are skipped once its margin is larger than
+*        margin_threshold, checked every round_period iterations. The margin is 2 * |raw score| for binary
+*        classification and the gap between the top two classes for multiclass, leaf index prediction is not affected
+* \param handle handle
+* \param round_period number of iterations between checks, <= 0 means disable
+* \param margin_threshold threshold of the margin
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterSetPredictEarlyStop(BoosterHandle handle,
+  int round_period,
+  double margin_threshold);
+
+/*!
+* \brief set the number of threads of training and prediction of a booster, the booster has its own thread pool,
+*        so boosters in the same process don't share threads. Should not be called when the booster is in use
+* \param handle handle
+* \param num_threads number of threads of the thread pool, <= 0 means using OpenMP
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterSetNumThreads(BoosterHandle handle,
+  int num_threads);
+
+/*!
+* \brief get memory usage of training of a booster, in byte.
+*        out_results[i] is the component i,
+*        0: features, 1: metadata, 2: validation data, 3: gradients, 4: scores, 5: histograms,
+*        6: other buffers of tree learners, 7: models
+* \param handle handle
+* \param out_len len of output result, which is 8
+* \param out_results the memory usage, should allocate memory before call this function
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterGetMemoryUsage(BoosterHandle handle,
+  int64_t* out_len,
+  double* out_results);
+
 /*!
 * \brief make prediction for file
 * \param handle handle
@@ -310,6 +442,7 @@ DllExport int LGBM_BoosterGetPredict(BoosterHandle handle,
 *          0:raw score
 *          1:with transform(if needed)
 *          2:leaf index
+*          3:contributions of features, (num_features + 1) * num_class values per row
 * \param n_used_trees number of used tree
 * \param data_has_header data file has header or not
 * \param data_filename filename of data file
@@ -338,6 +471,7 @@ DllExport int LGBM_BoosterPredictForFile(BoosterHandle handle,
 *          0:raw score
 *          1:with transform(if needed)
 *          2:leaf index
+*          3:contributions of features, (num_features + 1) * num_class values per row
 * \param n_used_trees number of used tree
 * \param out_result used to set a pointer to array, should allocate memory before call this function
 * \return 0 when success, -1 when failure happens
@@ -355,6 +489,41 @@ DllExport int LGBM_BoosterPredictForCSR(BoosterHandle handle,
   int64_t n_used_trees,
   double* out_result);
 
+/*!
+* \brief predict contributions of features by TreeSHAP for a sparse data set, and keep only the non-zero ones,
+*        for models with many features. Columns of a row are class * (num_features + 1) + feature, and
+*        class * (num_features + 1) + num_features for the expected value of the class. The contributions and
+*        the expected value of a class sum to its raw score
+* \param handle handle
+* \param indptr pointer to row headers
+* \param indptr_type
+* \param indices findex
+* \param data fvalue
+* \param data_type
+* \param nindptr number of rows in the matrix + 1
+* \param nelem number of nonzero elements in the matrix
+* \param n_used_trees number of used tree
+* \param out_nnz number of non-zero contributions
+* \param out_indptr used to set a pointer to the row headers of the output, with nindptr elements
+* \param out_indices used to set a pointer to the columns of the output
+* \param out_data used to set a pointer to the contributions
+*        the output arrays are owned by the booster, and valid until the next sparse prediction of it
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterPredictContribSparseForCSR(BoosterHandle handle,
+  const void* indptr,
+  int indptr_type,
+  const int32_t* indices,
+  const void* data,
+  int data_type,
+  int64_t nindptr,
+  int64_t nelem,
+  int64_t n_used_trees,
+  int64_t* out_nnz,
+  const int64_t** out_indptr,
+  const int32_t** out_indices,
+  const double** out_data);
+
 /*!
 * \brief make prediction for an new data set
 * \param handle handle
@@ -367,6 +536,7 @@ DllExport int LGBM_BoosterPredictForCSR(BoosterHandle handle,
 *          0:raw score
 *          1:with transform(if needed)
 *          2:leaf index
+*          3:contributions of features, (num_features + 1) * num_class values per row
 * \param n_used_trees number of used tree
 * \param out_result used to set a pointer to array, should allocate memory before call this function
 * \return 0 when success, -1 when failure happens
@@ -381,6 +551,200 @@ DllExport int LGBM_BoosterPredictForMat(BoosterHandle handle,
   int64_t n_used_trees,
   double* out_result);
 
+/*!
+* \brief create a context for single row prediction, it holds the feature buffer of one row and is reused by calls.
+*        Single row prediction doesn't enter OpenMP regions, different contexts can be used by different threads
+*        at the same time. Number of used trees is set to the booster, the same as other prediction functions
+* \param handle handle, should be alive while the context is used
+* \param predict_type
+*          C_API_PREDICT_NORMAL: with transform(if needed)
+*          C_API_PREDICT_RAW_SCORE: raw score
+*          C_API_PREDICT_LEAF_INDEX: leaf index
+* \param n_used_trees number of used tree
+* \param out handle of created context
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterCreatePredictContext(BoosterHandle handle,
+  int predict_type,
+  int64_t n_used_trees,
+  PredictContextHandle* out);
+
+/*!
+* \brief free the context for single row prediction
+* \param handle handle of the context
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_PredictContextFree(PredictContextHandle handle);
+
+/*!
+* \brief make staged prediction for an new data set, the scores after every period iterations are
+*        written in one pass over the trees, instead of predicting once for each number of iterations
+* \param handle handle
+* \param data pointer to the data space
+* \param data_type
+* \param nrow number of rows
+* \param ncol number columns
+* \param is_row_major 1 for row major, 0 for column major
+* \param predict_type
+*          0:with transform(if needed)
+*          1:raw score
+* \param n_used_trees number of used tree
+* \param period number of iterations between stages, the last stage is at the last used iteration
+* \param out_num_stages number of stages, ceil(number of used iterations / period)
+* \param out_result row-major with out_num_stages * num_class values per row, stages of a row are contiguous,
+*          should allocate memory before call this function
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterPredictForMatStaged(BoosterHandle handle,
+  const void* data,
+  int data_type,
+  int32_t nrow,
+  int32_t ncol,
+  int is_row_major,
+  int predict_type,
+  int64_t n_used_trees,
+  int period,
+  int64_t* out_num_stages,
+  double* out_result);
+
+/*!
+* \brief evaluate the metrics of the booster's parameters on a data set after every period iterations,
+*        e.g. to choose num_iterations. Scores are added tree by tree, so each tree is traversed once per row.
+*        The trees should be trained in this process, e.g. not loaded from model file, and data should be
+*        constructed with the training data as the reference
+* \param handle handle
+* \param data data set with labels, and queries for ranking metrics
+* \param n_used_trees number of used tree, -1 means all
+* \param period number of iterations between stages, the last stage is at the last used iteration
+* \param out_num_stages number of stages, ceil(number of used iterations / period)
+* \param out_len total number of results
+* \param out_results row-major with the results of all metrics per stage, in the same order as LGBM_BoosterEval,
+*          should allocate memory before call this function
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterEvalStaged(BoosterHandle handle,
+  const DatesetHandle data,
+  int64_t n_used_trees,
+  int period,
+  int64_t* out_num_stages,
+  int64_t* out_len,
+  double* out_results);
+
+/*!
+* \brief make prediction for one dense row, the same as LGBM_BoosterPredictForMat with nrow = 1
+* \param handle handle of the context, shouldn't be used by other threads at the same time
+* \param data pointer to the feature values of the row
+* \param data_type
+* \param ncol number columns
+* \param out_result used to set a pointer to array, should have number of classes values,
+*        number of used trees values for leaf index, or number of classes * (number of features + 1) for contributions
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterPredictForMatSingleRow(PredictContextHandle handle,
+  const void* data,
+  int data_type,
+  int32_t ncol,
+  double* out_result);
+
+/*!
+* \brief make prediction for one sparse row, the same as LGBM_BoosterPredictForCSR with one row
+* \param handle handle of the context, shouldn't be used by other threads at the same time
+* \param indices findex
+* \param data fvalue
+* \param data_type
+* \param nelem number of nonzero elements in the row
+* \param out_result used to set a pointer to array, should have number of classes values,
+*        number of used trees values for leaf index, or number of classes * (number of features + 1) for contributions
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterPredictForCSRSingleRow(PredictContextHandle handle,
+  const int32_t* indices,
+  const void* data,
+  int data_type,
+  int32_t nelem,
+  double* out_result);
+
+/*!
+* \brief create a model registry. Models in a registry are immutable and shared by all predictions,
+*        a model can be replaced while predictions on its old version are running
+* \param out handle of created registry
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_RegistryCreate(RegistryHandle* out);
+
+/*!
+* \brief free the model registry, models are freed when their predictions and contexts are finished
+* \param handle handle of the registry
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_RegistryFree(RegistryHandle handle);
+
+/*!
+* \brief load a model and publish it under name, replacing the current version atomically,
+*        doesn't wait for predictions on the current version
+* \param handle handle of the registry
+* \param name name of the model
+* \param filename model file, text or binary
+* \param parameters prediction parameters fixed for this version, e.g. num_model_predict, predict_on_bins, pred_early_stop
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_RegistryLoadModel(RegistryHandle handle,
+  const char* name,
+  const char* filename,
+  const char* parameters);
+
+/*!
+* \brief remove a model from the registry, predictions and contexts on it keep it alive until they finish
+* \param handle handle of the registry
+* \param name name of the model
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_RegistryRemoveModel(RegistryHandle handle,
+  const char* name);
+
+/*!
+* \brief create a context for single row prediction on the current version of a model,
+*        the context keeps that version until it is freed by LGBM_PredictContextFree
+* \param handle handle of the registry
+* \param name name of the model
+* \param predict_type
+*          C_API_PREDICT_NORMAL: with transform(if needed)
+*          C_API_PREDICT_RAW_SCORE: raw score
+*          C_API_PREDICT_LEAF_INDEX: leaf index
+* \param out handle of created context
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_RegistryCreatePredictContext(RegistryHandle handle,
+  const char* name,
+  int predict_type,
+  PredictContextHandle* out);
+
+/*!
+* \brief make prediction for an new data set on the current version of a model, can be called by many threads
+* \param handle handle of the registry
+* \param name name of the model
+* \param data pointer to the data space
+* \param data_type
+* \param nrow number rows
+* \param ncol number columns
+* \param is_row_major 1 for row major, 0 for column major
+* \param predict_type
+*          C_API_PREDICT_NORMAL: with transform(if needed)
+*          C_API_PREDICT_RAW_SCORE: raw score
+*          C_API_PREDICT_LEAF_INDEX: leaf index
+* \param out_result used to set a pointer to array, should allocate memory before call this function
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_RegistryPredictForMat(RegistryHandle handle,
+  const char* name,
+  const void* data,
+  int data_type,
+  int32_t nrow,
+  int32_t ncol,
+  int is_row_major,
+  int predict_type,
+  double* out_result);
+
 /*!
 * \brief save model into file
 * \param handle handle
@@ -392,6 +756,120 @@ DllExport int LGBM_BoosterSaveModel(BoosterHandle handle,
   int num_used_model,
   const char* filename);
 
+/*!
+* \brief save model into binary file, LGBM_BoosterLoadFromModelfile loads it by copying arrays instead of parsing
+* \param handle handle
+* \param num_used_model number of iterations that want to save, -1 means save all
+* \param filename file name
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterSaveModelToBinary(BoosterHandle handle,
+  int num_used_model,
+  const char* filename);
+
+/*!
+* \brief refit the leaf outputs of the trees on training data, the structures of trees are kept.
+*        Trees are refitted iteration by iteration, new outputs are blended with the old ones by refit_decay_rate
+* \param handle handle, loaded from model file or created on train_data
+* \param train_data training dataset, a booster created by LGBM_BoosterCreate should use its own training dataset
+* \param parameters parameters of the objective function and refitting, only used for a booster loaded from model file
+* \param leaf_preds leaf index of each data in each tree, row-major, e.g. predicted by C_API_PREDICT_LEAF_INDEX
+* \param nrow number of rows of leaf_preds, should be the number of data of train_data
+* \param ncol number of columns of leaf_preds, should be the number of trees
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterRefit(BoosterHandle handle,
+  const DatesetHandle train_data,
+  const char* parameters,
+  const int32_t* leaf_preds,
+  int32_t nrow,
+  int32_t ncol);
+
+/*!
+* \brief append rows of new_data to the training data of the booster and continue training on all rows,
+*        scores of the old rows are kept and only the new rows are predicted, the data is not binned again.
+*        Fails if the training data is used by any other booster or as validation data
+* \param handle handle, created by LGBM_BoosterCreate
+* \param new_data handle of dataset created with the training data as the reference
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterAppendTrainingData(BoosterHandle handle,
+  const DatesetHandle new_data);
+
+/*!
+* \brief save the state of training into a binary checkpoint, including models, scores of datasets,
+*        random generators, bagging data and early stopping bookkeeping
+* \param handle handle
+* \param filename file name
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterSaveCheckpoint(BoosterHandle handle,
+  const char* filename);
+
+/*!
+* \brief resume training from a checkpoint of LGBM_BoosterSaveCheckpoint,
+*        the booster should be created with the same datasets and parameters, and the validation datasets added
+* \param handle handle
+* \param filename file name
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterLoadCheckpoint(BoosterHandle handle,
+  const char* filename);
+
+/*!
+* \brief save model into C++ code, trees are compiled into nested if-else
+* \param handle handle
+* \param num_used_model number of iterations that want to save, -1 means save all
+* \param filename file name
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_BoosterSaveModelToIfElse(BoosterHandle handle,
+  int num_used_model,
+  const char* filename);
+
+/*!
+* \brief get communication statistics of distributed training since the network is initialized.
+*        out_results[(phase * 3 + collective) * 5 + i] is the statistic i of the collective in the phase,
+*        phase 0: other, 1: histogram, 2: split, 3: global sync,
+*        collective 0: Allreduce, 1: ReduceScatter, 2: Allgather,
+*        statistic 0: calls, 1: sent bytes, 2: received bytes, 3: time in ms, 4: wait time in ms
+* \param out_len len of output result, which is 60
+* \param out_results the statistics, should allocate memory before call this function
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_NetworkGetStats(int64_t* out_len,
+  double* out_results);
+
+/*!
+* \brief get communication statistics with each machine since the network is initialized.
+*        out_results[rank * 5 + i] is the statistic i with the machine of rank, in the same order as LGBM_NetworkGetStats,
+*        calls are the number of sends and receives
+* \param out_len len of output result, which is 5 * number of machines, 0 if the network isn't initialized
+* \param out_results the statistics, should allocate memory before call this function
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_NetworkGetPeerStats(int64_t* out_len,
+  double* out_results);
+
+/*!
+* \brief get training profile since the process started or the last LGBM_ProfilerReset, measured if is_enable_profiler is set.
+*        out_results[phase * 2 + i] is the statistic i of the phase,
+*        phase 0: before train, 1: construct histograms, 2: find best thresholds, 3: split, 4: add score,
+*        5: get gradients, 6: bagging, 7: metric,
+*        statistic 0: calls, 1: time in ms
+* \param out_len len of output result, which is 16
+* \param out_results the statistics, should allocate memory before call this function
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_ProfilerGetStats(int64_t* out_len,
+  double* out_results);
+
+/*!
+* \brief clear training profile
+* \return 0 when success, -1 when failure happens
+*/
+DllExport int LGBM_ProfilerReset();
+
 
 
 // some help functions used to convert data
@@ -416,7 +894,8 @@ SampleFromOneColumn(const std::vector<std::pair<int, double>>& data, const std::
 
 // exception handle and error msg
 
-static std::string& LastErrorMsg() { static std::string err_msg("Everything is fine"); return err_msg; }
+// per thread, so boosters used by different threads don't overwrite errors of each other
+static std::string& LastErrorMsg() { static thread_local std::string err_msg("Everything is fine"); return err_msg; }
 
 inline void LGBM_SetLastError(const char* msg) {
   LastErrorMsg() = msg;
@@ -76,13 +76,13 @@ public:
 
 /*! \brief Types of boosting */
 enum BoostingType {
-  kGBDT, kDART, kUnknow
+  kGBDT, kDART, kGOSS, kUnknow
 };
 
 
 /*! \brief Types of tasks */
 enum TaskType {
-  kTrain, kPredict
+  kTrain, kPredict, kConvertModel, kRefitTree, kServe
 };
 
 /*! \brief Config for input and output files */
@@ -94,18 +94,97 @@ public:
   std::string data_filename = "";
   std::vector<std::string> valid_data_filenames;
   std::string output_model = "LightGBM_model.txt";
+  /*! \brief Also save the model to binary file output_model.bin after training, it is loaded without parsing */
+  bool is_save_binary_model = false;
   std::string output_result = "LightGBM_predict_result.txt";
   std::string input_model = "";
+  /*!
+  * \brief Save checkpoints of training to this file every checkpoint_freq iterations, empty means disable.
+  *        Training is resumed from it if it exists, instead of starting from the first iteration
+  */
+  std::string checkpoint_file = "";
+  /*! \brief Number of iterations between checkpoints */
+  int checkpoint_freq = 10;
+  /*! \brief Filename of C++ code converted from input_model, used by convert_model task */
+  std::string convert_model = "gbdt_prediction.cpp";
   int verbosity = 1;
   int num_model_predict = NO_LIMIT;
   bool is_pre_partition = false;
+  /*!
+  * \brief When data is not pre-partitioned, each machine only reads its own continuous byte range of the data file,
+  *        instead of reading the whole file and keeping random rows. Queries are not split between machines
+  */
+  bool use_byte_range_partition = false;
   bool is_enable_sparse = true;
+  /*!
+  * \brief Bundle sparse features of training data which are (almost) never non-zero at the same time into dense bin columns,
+  *        the bundles are built once with the data and shared by all tree learners of it
+  */
+  bool enable_bundle = false;
+  /*! \brief Max fraction of data on which features in one bundle can be non-zero at the same time */
+  double max_conflict_rate = 0.0f;
+  /*!
+  * \brief Bundles with fewer non-zero data than this fraction of data are not used, their features construct histograms
+  *        by ordered sparse bins. A bundle costs one pass over the leaf, so very sparse ones are slower than ordered bins
+  */
+  double bundle_min_non_zero_rate = 0.1f;
+  /*! \brief Number of latest bundles searched for a feature to join, bounds the time and the memory of conflict marks */
+  int max_search_bundles = 64;
+  /*!
+  * \brief Shard features of training data over NUMA nodes once it is loaded, bin data and histograms of features are
+  *        allocated on their nodes, and threads are pinned to nodes to construct histograms of features on their
+  *        own node first. Only for linux
+  */
+  bool use_numa = false;
+  /*! \brief Number of NUMA nodes features are sharded to, <= 0 means all nodes of the machine */
+  int num_numa_nodes = 0;
+  /*!
+  * \brief Memory budget (unit:MB) of training, bins of training data are merged into more compact bin types
+  *        if they don't fit in it with the buffers of training. < 0 means not limit
+  */
+  double max_memory = NO_LIMIT;
   bool use_two_round_loading = false;
+  /*!
+  * \brief Stream training data from text file into its binary file without holding the text or the bins in memory,
+  *        bins are stored densely. Use it with use_mmap to train on data larger than memory
+  */
+  bool use_streaming_loading = false;
   bool is_save_binary_file = false;
+  /*! \brief Compress sections of features in saved binary files, they are decompressed in parallel when loading */
+  bool is_compress_binary_file = false;
   bool enable_load_from_binary_file = true;
+  /*!
+  * \brief Cache validation data to binary files "filename.cache.bin" when loading them from text, next runs
+  *        load the caches if the bins of training data, the files and their weight and query files are not changed
+  */
+  bool use_valid_cache = false;
+  /*! \brief Map binary data file into memory, dense bins use the mapped memory without copy */
+  bool use_mmap = false;
   int bin_construct_sample_cnt = 50000;
+  /*!
+  * \brief Find bins from quantile sketches filled while parsing the samples, instead of storing and sorting all sample values
+  */
+  bool use_quantile_sketch = false;
+  /*! \brief Number of values kept in a quantile sketch, rank error is about log2(#sample / size) / size */
+  int quantile_sketch_size = 4096;
   bool is_predict_leaf_index = false;
   bool is_predict_raw_score = false;
+  /*! \brief Predict contributions of features to raw scores by TreeSHAP, each class ends with its expected value */
+  bool is_predict_contrib = false;
+  /*! \brief Map records to bins by the thresholds of the model once, then traverse trees on integer comparisons */
+  bool is_predict_on_bins = false;
+  /*! \brief Skip the rest trees of a record once its margin is large enough, only for binary and multiclass */
+  bool is_predict_early_stop = false;
+  /*! \brief Number of iterations between checks of prediction early stopping */
+  int predict_early_stop_freq = 10;
+  /*! \brief Margin threshold of prediction early stopping, 2 * |raw score| for binary, gap of top two classes for multiclass */
+  double predict_early_stop_margin = 10.0f;
+  /*! \brief Port the serve task listens on */
+  int serve_port = 12500;
+  /*! \brief Max number of rows in a micro-batch of the serve task */
+  int serve_batch_size = 256;
+  /*! \brief Max time (unit:ms) the first row of a micro-batch waits for more rows before the batch is predicted */
+  double serve_batch_delay = 1.0f;
 
   bool has_header = false;
   /*! \brief Index or column name of label, default is the first column
@@ -132,6 +211,8 @@ public:
   std::vector<double> label_gain;
   // for lambdarank
   int max_position = 20;
+  // for lambdarank, only pairs with at least one data in the top positions are used, <= 0 means all pairs
+  int lambdarank_truncation_level = 0;
   // for binary
   bool is_unbalance = false;
   // for multiclass
@@ -147,6 +228,11 @@ public:
   double sigmoid = 1.0f;
   std::vector<double> label_gain;
   std::vector<int> eval_at;
+  /*!
+  * \brief Number of score buckets of the approximate AUC, <= 0 means exact AUC by sorting.
+  *        Scores in the same bucket are treated as ties
+  */
+  int auc_num_bins = 0;
   void Set(const std::unordered_map<std::string, std::string>& params) override;
 };
 
@@ -170,13 +256,44 @@ public:
   // And the max leaves will be min(num_leaves, pow(2, max_depth - 1))
   // max_depth < 0 means not limit
   int max_depth = NO_LIMIT;
+  // number of dense features stored row-major together to construct their histograms in one pass.
+  // costs an extra byte per data for each grouped feature. <= 1 means disable
+  int feature_group_size = 0;
+  // number of leaves split at once, histograms of their smaller children are constructed by one pass over data. 1 means disable
+  int leaf_batch_size = 1;
+  // construct histograms of features not grouped or bundled lazily, a feature is skipped at a leaf when its estimated
+  // gain bound cannot beat the best gain found. the bound is an estimate, so trees may differ from the exact ones
+  bool use_lazy_histogram = false;
+  // multiplier of the estimated gain bounds of lazy histograms, larger constructs more histograms
+  double lazy_histogram_slack = 2.0f;
+  // quantize gradients and hessians to small integers before constructing histograms of dense features
+  bool use_quantized_grad = false;
+  // number of levels used to quantize gradients and hessians, should be in [2, 126]
+  int num_grad_quant_bins = 16;
+  // true if use stochastic rounding in gradient quantization, otherwise round to nearest
+  bool stochastic_rounding = true;
+  // random seed for stochastic rounding in gradient quantization
+  int quantization_seed = 5;
+  // store gradients and hessians in bfloat16 for constructing histograms of dense features, sums are still in double.
+  // halves the bytes of gradients read by each histogram pass
+  bool use_bf16_grad = false;
+  // for voting parallel, number of local top features each machine votes for,
+  // histograms of at most 2 * top_k voted features are reduced for each leaf
+  int top_k = 20;
+  // for data parallel, number of blocks the histograms are reduced in, the reduce of a block runs in another thread
+  // while the next blocks are constructed and the reduced blocks are used to find splits. 1 means disable
+  int histogram_pipeline_blocks = 1;
+  // for gpu tree learner, OpenCL platform and device to use, -1 means the default one
+  int gpu_platform_id = -1;
+  int gpu_device_id = -1;
   void Set(const std::unordered_map<std::string, std::string>& params) override;
 };
 
 /*! \brief Types of tree learning algorithms */
 enum TreeLearnerType {
   kSerialTreeLearner, kFeatureParallelTreelearner,
-  kDataParallelTreeLearner
+  kDataParallelTreeLearner, kVotingParallelTreeLearner,
+  kHybridParallelTreeLearner, kGPUTreeLearner
 };
 
 /*! \brief Config for Boosting */
@@ -191,10 +308,51 @@ public:
   double bagging_fraction = 1.0f;
   int bagging_seed = 3;
   int bagging_freq = 0;
+  double top_rate = 0.2f;
+  double other_rate = 0.1f;
   int early_stopping_round = 0;
   int num_class = 1;
   double drop_rate = 0.01;
   int drop_seed = 4;
+  /*!
+  * \brief Store leaf index of each data for DART trees, 1 or 2 bytes per data and tree,
+  *        so dropping and normalizing trees gather leaf outputs instead of traversing trees
+  */
+  bool is_cache_dart_leaf_index = false;
+  /*!
+  * \brief Number of classes whose trees are trained at the same time in multiclass training,
+  *        threads are split evenly between them. Only for the serial tree learner without bagging
+  */
+  int num_concurrent_classes = 1;
+  /*!
+  * \brief Calculate gradients of the next iteration in the same pass of updating training scores,
+  *        for objectives that support it, like regression and binary, without bagging
+  */
+  bool is_fuse_gradients = false;
+  /*!
+  * \brief Evaluate metrics on snapshots of scores in a background thread while the next iteration trains,
+  *        so early stopping is decided one iteration later
+  */
+  bool is_async_metric = false;
+  /*!
+  * \brief Memory budget (unit:MB) of training, histograms of tree learners are cached within what is left
+  *        by the data and the other buffers. < 0 means not limit
+  */
+  double max_memory = NO_LIMIT;
+  /*!
+  * \brief Weight of the old leaf outputs when refitting trees on new data, the new output is
+  *        refit_decay_rate * old_output + (1 - refit_decay_rate) * output fitted on new data
+  */
+  double refit_decay_rate = 0.9f;
+  /*!
+  * \brief Measure calls and time of the hot paths of training, logged after every iteration,
+  *        enabled by default if built with USE_PROFILER
+  */
+#ifdef USE_PROFILER
+  bool is_enable_profiler = true;
+#else
+  bool is_enable_profiler = false;
+#endif
   TreeLearnerType tree_learner_type = TreeLearnerType::kSerialTreeLearner;
   TreeConfig tree_config;
   void Set(const std::unordered_map<std::string, std::string>& params) override;
@@ -210,6 +368,16 @@ public:
   int local_listen_port = 12400;
   int time_out = 120;  // in minutes
   std::string machine_list_filename = "";
+  // number of TCP connections to each linked machine, large messages are split into chunks sent on them in parallel.
+  // should be the same on all machines
+  int num_network_streams = 1;
+  // size of the send and receive buffers of each socket, in bytes
+  int socket_buffer_size = 10 * 1024 * 1024;
+  // number of columns of the machine grid of hybrid tree learner, machine i is in row i / num_grid_columns
+  // and column i % num_grid_columns. Machines in a row hold the same data, machines in a column hold the same features
+  int num_grid_columns = 1;
+  // send data to machines with the same ip by ring buffers in shared memory instead of TCP
+  bool use_shared_memory = true;
   void Set(const std::unordered_map<std::string, std::string>& params) override;
 };
 
@@ -220,6 +388,8 @@ public:
   TaskType task_type = TaskType::kTrain;
   NetworkConfig network_config;
   int num_threads = 0;
+  // run parallel loops by a persistent thread pool with work stealing instead of OpenMP
+  bool is_use_thread_pool = false;
   bool is_parallel = false;
   bool is_parallel_find_bin = false;
   IOConfig io_config;
@@ -307,6 +477,9 @@ struct ParameterAlias {
       { "config", "config_file" },
       { "nthread", "num_threads" },
       { "num_thread", "num_threads" },
+      { "thread_pool", "is_use_thread_pool" },
+      { "memory_budget", "max_memory" },
+      { "use_thread_pool", "is_use_thread_pool" },
       { "boosting", "boosting_type" },
       { "boost", "boosting_type" },
       { "application", "objective" },
@@ -341,13 +514,30 @@ struct ParameterAlias {
       { "sub_row", "bagging_fraction" },
       { "shrinkage_rate", "learning_rate" },
       { "tree", "tree_learner" },
+      { "topk", "top_k" },
       { "num_machine", "num_machines" },
       { "local_port", "local_listen_port" },
       { "two_round_loading", "use_two_round_loading"},
       { "two_round", "use_two_round_loading" },
+      { "streaming_loading", "use_streaming_loading" },
       { "mlist", "machine_list_file" },
       { "is_save_binary", "is_save_binary_file" },
       { "save_binary", "is_save_binary_file" },
+      { "save_binary_model", "is_save_binary_model" },
+      { "checkpoint", "checkpoint_file" },
+      { "checkpoint_period", "checkpoint_freq" },
+      { "cache_dart_leaf_index", "is_cache_dart_leaf_index" },
+      { "dart_leaf_cache", "is_cache_dart_leaf_index" },
+      { "fuse_gradients", "is_fuse_gradients" },
+      { "async_metric", "is_async_metric" },
+      { "enable_profiler", "is_enable_profiler" },
+      { "profiler", "is_enable_profiler" },
+      { "numa", "use_numa" },
+      { "numa_nodes", "num_numa_nodes" },
+      { "lazy_histogram", "use_lazy_histogram" },
+      { "compress_binary", "is_compress_binary_file" },
+      { "valid_cache", "use_valid_cache" },
+      { "compress_binary_file", "is_compress_binary_file" },
       { "early_stopping_rounds", "early_stopping_round"},
       { "early_stopping", "early_stopping_round"},
       { "verbosity", "verbose" },
@@ -361,6 +551,14 @@ struct ParameterAlias {
       { "blacklist", "ignore_column" },
       { "predict_raw_score", "is_predict_raw_score" },
       { "predict_leaf_index", "is_predict_leaf_index" }, 
+      { "predict_contrib", "is_predict_contrib" },
+      { "server_port", "serve_port" },
+      { "serve_batch_delay_ms", "serve_batch_delay" },
+      { "predict_on_bins", "is_predict_on_bins" },
+      { "predict_early_stop", "is_predict_early_stop" },
+      { "pred_early_stop", "is_predict_early_stop" },
+      { "pred_early_stop_freq", "predict_early_stop_freq" },
+      { "pred_early_stop_margin", "predict_early_stop_margin" },
       { "num_classes", "num_class" }
     });
     std::unordered_map<std::string, std::string> tmp_map;
@@ -7,7 +7,9 @@
 #include <LightGBM/meta.h>
 #include <LightGBM/config.h>
 #include <LightGBM/feature.h>
+#include <LightGBM/feature_bundle.h>
 
+#include <atomic>
 #include <vector>
 #include <utility>
 #include <functional>
@@ -18,6 +20,7 @@ namespace LightGBM {
 
 /*! \brief forward declaration */
 class DatasetLoader;
+class MappedFile;
 
 /*!
 * \brief This class is used to store some meta(non-feature) data for training data,
@@ -48,8 +51,9 @@ public:
   /*!
   * \brief Initial with binary memory
   * \param memory Pointer to memory
+  * \param num_class Number of classes, it is not in the binary memory and is needed by initial scores
   */
-  void LoadFromMemory(const void* memory);
+  void LoadFromMemory(const void* memory, int num_class);
   /*! \brief Destructor */
   ~Metadata();
 
@@ -89,6 +93,13 @@ public:
   */
   void SetInitScore(const float* init_score, data_size_t len);
 
+  /*!
+  * \brief Append metadata of other data after the data of this, both should have the same fields.
+  *        Query boundaries of other data are moved after the last query
+  * \param other Metadata of the appended data
+  */
+  void Append(const Metadata& other);
+
 
   /*!
   * \brief Save binary data to file
@@ -229,6 +240,21 @@ public:
   virtual void ParseOneLine(const char* str,
     std::vector<std::pair<int, double>>* out_features, double* out_label) const = 0;
 
+  /*!
+  * \brief Parse one line with label straight into a caller-provided buffer of feature values
+  * \param str One line record, string format, should end with '\0'
+  * \param num_features Number of values in out_values, columns out of them are ignored
+  * \param out_values Values of features, features not in the line are set to 0
+  * \param out_label Label will store to this if exists
+  */
+  virtual void ParseOneLine(const char* str, int num_features, double* out_values, double* out_label) const = 0;
+
+  /*!
+  * \brief True if every line has all columns, e.g. CSV and TSV, so parsing into a buffer of feature values
+  *        costs no more than parsing into (column_idx, values)
+  */
+  virtual bool IsDenseFormat() const = 0;
+
   /*!
   * \brief Create a object of parser, will auto choose the format depend on file
   * \param filename One Filename of data
@@ -237,6 +263,15 @@ public:
   * \return Object of parser
   */
   static Parser* CreateParser(const char* filename, bool has_header, int num_features, int label_idx);
+
+  /*!
+  * \brief Create a object of parser, will auto choose the format depend on one line of data
+  * \param line One line of data
+  * \param num_features Pass num_features of the data if you know, <=0 means don't know
+  * \param label_idx index of label column
+  * \return Object of parser
+  */
+  static Parser* CreateParserForLine(const char* line, int num_features, int label_idx);
 };
 
 /*! \brief The main class of data set,
@@ -246,6 +281,14 @@ class Dataset {
 public:
   friend DatasetLoader;
 
+  /*! \brief Token at the beginning of binary files, followed by the version of the binary format */
+  static const char* binary_file_token;
+  /*!
+  * \brief Version of the binary format, sections of features are aligned since version 2,
+  *        version 3 adds a flag after the version for LZ compressed sections of features
+  */
+  static const int kBinaryFileVersion = 3;
+
   Dataset();
 
   Dataset(data_size_t num_data, int num_class);
@@ -294,11 +337,38 @@ public:
 
   /*!
   * \brief Save current dataset into binary file, will save to "filename.bin"
+  * \param bin_filename Filename of the binary file, empty or nullptr means "filename.bin"
+  * \param is_compressed True if compress each section of features, they are decompressed in parallel when loading
   */
-  void SaveBinaryFile(const char* bin_filename);
+  void SaveBinaryFile(const char* bin_filename, bool is_compressed = false);
 
   void CopyFeatureMapperFrom(const Dataset* dataset, bool is_enable_sparse);
 
+  /*!
+  * \brief Hash of the bin mappers, used features and feature names,
+  *        equal for data created with CopyFeatureMapperFrom and the reference
+  */
+  uint64_t FeatureMapperFingerprint() const;
+
+  /*!
+  * \brief Append rows of other data after the rows of this data, bins of the new rows are pushed with the
+  *        bin mappers of this data and the old rows are kept. Metadata are appended too
+  * \param other Data created with this data as the reference, e.g. by CopyFeatureMapperFrom
+  */
+  void Append(const Dataset* other);
+
+  /*!
+  * \brief Count a booster that refers to this data as training or validation data. Boosters keep pointers to
+  *        the labels and the bins, which Append may reallocate, so data used by other boosters cannot be appended
+  */
+  inline void AddBooster() const { ++num_boosters_; }
+
+  /*! \brief Release a booster counted by AddBooster */
+  inline void RemoveBooster() const { --num_boosters_; }
+
+  /*! \brief Number of boosters that refer to this data */
+  inline int num_boosters() const { return num_boosters_.load(); }
+
   /*!
   * \brief Get a feature pointer for specific index
   * \param i Index for feature
@@ -306,6 +376,47 @@ public:
   */
   inline const Feature* FeatureAt(int i) const { return features_[i].get(); }
 
+  /*!
+  * \brief Greedily bundle sparse features which are (almost) never non-zero at the same time into dense bin columns,
+  *        tree learners construct histograms of the bundled features by the bundles instead of ordered bins.
+  *        Call it once after the data is loaded, the bundles are rebuilt after Append
+  * \param max_conflict_rate Max fraction of data on which features in one bundle can be non-zero at the same time
+  * \param min_non_zero_rate Bundles with fewer non-zero data than this fraction of data are not used
+  * \param max_search_bundles Number of latest bundles searched for a feature to join
+  */
+  void BundleSparseFeatures(double max_conflict_rate, double min_non_zero_rate, int max_search_bundles);
+
+  /*! \brief Get Number of bundles of sparse features */
+  inline int num_feature_bundles() const { return static_cast<int>(feature_bundles_.size()); }
+
+  /*!
+  * \brief Get a bundle of sparse features for specific index
+  * \param i Index for bundle
+  * \return Pointer of bundle
+  */
+  inline const FeatureBundle* FeatureBundleAt(int i) const { return feature_bundles_[i].get(); }
+
+  /*!
+  * \brief Shard features over NUMA nodes and reallocate their bin data by the threads of their nodes, the values
+  *        are not changed. Call it once after the data is loaded and before any tree learner refers to the bin data,
+  *        the bin data is placed again after Append
+  * \param num_nodes Number of nodes, <= 0 means all nodes of the machine
+  */
+  void PlaceFeaturesOnNumaNodes(int num_nodes);
+
+  /*! \brief Begin of the features of each NUMA node, see Numa::Shard. Empty means not placed on NUMA nodes */
+  inline const std::vector<int>& numa_feature_begin() const { return numa_feature_begin_; }
+
+  /*!
+  * \brief Merge bins of features into more compact bin types until the bins fit in max_size_in_byte,
+  *        features with the most bins are merged first. Should be called before any data is pushed
+  * \param max_size_in_byte Max sizes in byte of the bin data of all features
+  */
+  void CompactBins(double max_size_in_byte);
+
+  /*! \brief Sizes in byte of the bin data and bin mappers of all features, and the bundles of sparse features */
+  size_t FeaturesSizesInByte() const;
+
   /*!
   * \brief Get meta data pointer
   * \return Pointer of meta data
@@ -333,7 +444,17 @@ public:
   Dataset(const Dataset&) = delete;
 
 private:
+  /*!
+  * \brief Save token, version, compression flag and header of current dataset to binary file
+  * \param file File want to write
+  * \param is_compressed True if sections of features will be compressed
+  * \return Sizes in byte that are written
+  */
+  size_t SaveBinaryHeaderToFile(FILE* file, bool is_compressed = false) const;
+
   const char* data_filename_;
+  /*! \brief Mapped binary file that the bin data of features may refer to, should be released after features */
+  std::unique_ptr<MappedFile> mapped_file_;
   /*! \brief Store used features */
   std::vector<std::unique_ptr<Feature>> features_;
   /*! \brief Mapper from real feature index to used index*/
@@ -354,6 +475,16 @@ private:
   int label_idx_ = 0;
   /*! \brief store feature names */
   std::vector<std::string> feature_names_;
+  /*! \brief Dense bin columns of bundled sparse features */
+  std::vector<std::unique_ptr<FeatureBundle>> feature_bundles_;
+  /*! \brief Parameters of the last BundleSparseFeatures, used to rebuild the bundles after Append */
+  double max_conflict_rate_ = 0.0f;
+  double bundle_min_non_zero_rate_ = 0.0f;
+  int max_search_bundles_ = 0;
+  /*! \brief Begin of the features of each NUMA node, empty means not placed on NUMA nodes */
+  std::vector<int> numa_feature_begin_;
+  /*! \brief Number of boosters that refer to this data */
+  mutable std::atomic<int> num_boosters_{0};
 };
 
 }  // namespace LightGBM
@@ -22,10 +22,31 @@ public:
 
   Dataset* LoadFromFileAlignWithOtherDataset(const char* filename, const Dataset* train_data);
 
+  /*!
+  * \brief Load several files aligned with training data at the same time, threads are divided between the files
+  * \param filenames Filenames of the data, e.g. validation data
+  * \param train_data Training data, bin mappers of it are used
+  * \return Datasets in the order of filenames
+  */
+  std::vector<std::unique_ptr<Dataset>> LoadFromFilesAlignWithOtherDataset(const std::vector<std::string>& filenames,
+    const Dataset* train_data);
+
   Dataset* LoadFromBinFile(const char* bin_filename, int rank, int num_machines);
 
   Dataset* CostructFromSampleData(std::vector<std::vector<double>>& sample_values, size_t total_sample_size, data_size_t num_data);
 
+  /*!
+  * \brief Bundle sparse features of training data if enable_bundle, should be called once after all rows are pushed.
+  *        LoadFromFile calls it, since it always loads training data
+  */
+  void BundleSparseFeatures(Dataset* dataset) const;
+
+  /*!
+  * \brief Place bin data of training data on NUMA nodes if use_numa, should be called once after all rows are pushed,
+  *        before any booster is created on it. LoadFromFile calls it, since it always loads training data
+  */
+  void PlaceFeaturesOnNumaNodes(Dataset* dataset) const;
+
   /*! \brief Disable copy */
   DatasetLoader& operator=(const DatasetLoader&) = delete;
   /*! \brief Disable copy */
@@ -42,15 +63,63 @@ private:
 
   void ConstructBinMappersFromTextData(int rank, int num_machines, const std::vector<std::string>& sample_data, const Parser* parser, Dataset* dataset);
 
+  /*!
+  * \brief Merge bins of features of training data into more compact bin types if they don't fit in max_memory,
+  *        after the buffers of each data used by training. Bins of all machines must be the same, so only for one machine
+  */
+  void CompactBins(Dataset* dataset) const;
+
   /*! \brief Extract local features from memory */
   void ExtractFeaturesFromMemory(std::vector<std::string>& text_data, const Parser* parser, Dataset* dataset);
 
   /*! \brief Extract local features from file */
   void ExtractFeaturesFromFile(const char* filename, const Parser* parser, const std::vector<data_size_t>& used_data_indices, Dataset* dataset);
 
+  /*!
+  * \brief Stream local features of a text file into its binary file chunk by chunk,
+  *        then load the dataset from the binary file. Only bin mappers and meta data of the dataset are in memory
+  */
+  Dataset* StreamFeaturesToBinFile(const char* filename, const Parser* parser, const std::vector<data_size_t>& used_data_indices,
+    data_size_t num_global_data, Dataset* dataset);
+
   /*! \brief Check can load from binary file */
   bool CheckCanLoadFromBin(const char* filename);
 
+  /*! \brief Implementation of LoadFromFileAlignWithOtherDataset, can be called by several threads at the same time */
+  Dataset* LoadAlignedFile(const char* filename, const Dataset* train_data);
+
+  /*!
+  * \brief Key of the binary cache of data aligned with training data, from the bin mappers of training data,
+  *        the sizes and modification times of the file and its weight and query files, and the parsing options
+  * \return Key in hex, empty if the file cannot be found
+  */
+  std::string AlignedCacheKey(const char* filename, const Dataset* train_data) const;
+
+  /*!
+  * \brief Load the binary cache of data aligned with training data
+  * \return nullptr if there is no cache of the key or it doesn't match the training data
+  */
+  Dataset* LoadAlignedCache(const char* filename, const std::string& key, const Dataset* train_data);
+
+  /*! \brief Save the binary cache of data aligned with training data, only warn if it cannot be saved */
+  void SaveAlignedCache(const char* filename, const std::string& key, Dataset* dataset) const;
+
+  /*!
+  * \brief Find the local byte range of the data file when use_byte_range_partition.
+  *        With a query file, the range is moved to the beginnings of queries, a query belongs to the machine with its first line
+  */
+  void PartitionByteRange(const char* filename, const Metadata& metadata, int rank, int num_machines);
+
+  /*!
+  * \brief Gather the number of local lines of all data partitions
+  * \return Index of the first line of each partition, and the total number of lines at the end
+  */
+  std::vector<data_size_t> GatherLineStarts(int rank, int num_machines, data_size_t num_local_lines);
+
+  /*! \brief Global indices of the local lines, which are continuous when partitioned by byte ranges */
+  void SetByteRangeIndices(int rank, int num_machines, data_size_t num_local_lines,
+    int* num_global_data, std::vector<data_size_t>* used_data_indices);
+
   const IOConfig& io_config_;
   /*! \brief Random generator*/
   Random random_;
@@ -66,6 +135,12 @@ private:
   std::unordered_set<int> ignore_features_;
   /*! \brief store feature names */
   std::vector<std::string> feature_names_;
+  /*! \brief True if the data file is partitioned by byte ranges */
+  bool is_byte_range_partition_ = false;
+  /*! \brief Beginning of the local byte range */
+  size_t byte_range_start_ = 0;
+  /*! \brief End of the local byte range */
+  size_t byte_range_end_ = 0;
 
 };
 
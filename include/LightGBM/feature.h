@@ -2,11 +2,13 @@
 #define LIGHTGBM_FEATURE_H_
 
 #include <LightGBM/utils/random.h>
+#include <LightGBM/utils/common.h>
 
 #include <LightGBM/meta.h>
 #include <LightGBM/bin.h>
 
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -15,6 +17,12 @@ namespace LightGBM {
 /*! \brief Using to store data and providing some operations on one feature*/
 class Feature {
 public:
+  /*!
+  * \brief Alignment in byte of feature sections and bin data in binary files.
+  *        A section is the size of the feature in size_t followed by SaveBinaryToFile.
+  */
+  static const size_t kBinaryAlignment = 64;
+
   /*!
   * \brief Constructor
   * \param feature_idx Index of this feature
@@ -34,9 +42,12 @@ public:
   * \param memory Pointer of memory
   * \param num_all_data Number of global data
   * \param local_used_indices Local used indices, empty means using all data
+  * \param is_aligned True if the memory is in the aligned layout of SaveBinaryToFile, false for the old unpadded layout
+  * \param is_reference_memory True if bin data can use the memory directly, then the memory should be kept alive
   */
   Feature(const void* memory, data_size_t num_all_data,
-    const std::vector<data_size_t>& local_used_indices) {
+    const std::vector<data_size_t>& local_used_indices,
+    bool is_aligned = false, bool is_reference_memory = false) {
     const char* memory_ptr = reinterpret_cast<const char*>(memory);
     // get featuer index
     feature_index_ = *(reinterpret_cast<const int*>(memory_ptr));
@@ -47,6 +58,9 @@ public:
     // get bin mapper
     bin_mapper_.reset(new BinMapper(memory_ptr));
     memory_ptr += bin_mapper_->SizesInByte();
+    if (is_aligned) {
+      memory_ptr += PaddingSizeOfHeader();
+    }
     data_size_t num_data = num_all_data;
     if (local_used_indices.size() > 0) {
       num_data = static_cast<data_size_t>(local_used_indices.size());
@@ -54,10 +68,13 @@ public:
     if (is_sparse_) {
       bin_data_.reset(Bin::CreateSparseBin(num_data, bin_mapper_->num_bin(), bin_mapper_->ValueToBin(0)));
     } else {
-      bin_data_.reset(Bin::CreateDenseBin(num_data, bin_mapper_->num_bin(), bin_mapper_->ValueToBin(0)));
+      // features with at most 16 bins have one byte per row in the old layout
+      bin_data_.reset(Bin::CreateDenseBin(num_data, bin_mapper_->num_bin(), bin_mapper_->ValueToBin(0), is_aligned));
     }
     // get bin data
-    bin_data_->LoadFromMemory(memory_ptr, local_used_indices);
+    if (!is_reference_memory || local_used_indices.size() > 0 || !bin_data_->ReferenceMemory(memory_ptr)) {
+      bin_data_->LoadFromMemory(memory_ptr, local_used_indices);
+    }
   }
   /*! \brief Destructor */
   ~Feature() {
@@ -74,12 +91,57 @@ public:
     bin_data_->Push(tid, line_idx, bin);
   }
   inline void FinishLoad() { bin_data_->FinishLoad(); }
+  /*!
+  * \brief Append the bins of the same feature of other data after the rows of this feature,
+  *        only the new rows are pushed. Bin mappers of both features should be the same
+  * \param other Feature of the appended data
+  */
+  void AppendData(const Feature& other) {
+    const data_size_t num_old_data = bin_data_->num_data();
+    const data_size_t num_new_data = other.bin_data_->num_data();
+    bin_data_->Append(num_new_data, bin_mapper_->ValueToBin(0));
+    std::unique_ptr<BinIterator> iterator(other.bin_data_->GetIterator(0));
+    for (data_size_t i = 0; i < num_new_data; ++i) {
+      bin_data_->Push(0, num_old_data + i, iterator->Get(i));
+    }
+    bin_data_->FinishLoad();
+  }
+  /*!
+  * \brief Copy bin data to new memory allocated and initialized by the calling thread,
+  *        so it is placed on the NUMA node of this thread. The old bin data is released
+  */
+  void RelocateBinData() {
+    std::vector<char> buffer(bin_data_->SizesInByte());
+    bin_data_->CopyTo(buffer.data());
+    const data_size_t num_data = bin_data_->num_data();
+    if (is_sparse_) {
+      bin_data_.reset(Bin::CreateSparseBin(num_data, bin_mapper_->num_bin(), bin_mapper_->ValueToBin(0)));
+    } else {
+      bin_data_.reset(Bin::CreateDenseBin(num_data, bin_mapper_->num_bin(), bin_mapper_->ValueToBin(0)));
+    }
+    bin_data_->LoadFromMemory(buffer.data(), std::vector<data_size_t>());
+  }
+  /*!
+  * \brief Merge bins into at most max_bin bins to use a more compact bin type, should be called before any data is pushed
+  * \param max_bin Max number of bins
+  */
+  void CoarsenBins(int max_bin) {
+    const data_size_t num_data = bin_data_->num_data();
+    bin_mapper_->Coarsen(max_bin);
+    if (is_sparse_) {
+      bin_data_.reset(Bin::CreateSparseBin(num_data, bin_mapper_->num_bin(), bin_mapper_->ValueToBin(0)));
+    } else {
+      bin_data_.reset(Bin::CreateDenseBin(num_data, bin_mapper_->num_bin(), bin_mapper_->ValueToBin(0)));
+    }
+  }
   /*! \brief Index of this feature */
   inline int feature_index() const { return feature_index_; }
   /*! \brief Bin mapper that this feature used */
   inline const BinMapper* bin_mapper() const { return bin_mapper_.get(); }
   /*! \brief Number of bin of this feature */
   inline int num_bin() const { return bin_mapper_->num_bin(); }
+  /*! \brief True if bin data of this feature is sparse */
+  inline bool is_sparse() const { return is_sparse_; }
   /*! \brief Get bin data of this feature */
   inline const Bin* bin_data() const { return bin_data_.get(); }
   /*!
@@ -91,21 +153,65 @@ public:
     const { return bin_mapper_->BinToValue(bin); }
 
   /*!
-  * \brief Save binary data to file
+  * \brief Save binary data to file, bin data is padded to be aligned relative to the beginning of the section
   * \param file File want to write
   */
   void SaveBinaryToFile(FILE* file) const {
+    SaveBinaryHeaderToFile(file);
+    bin_data_->SaveBinaryToFile(file);
+    SaveBinaryTailToFile(file, bin_data_->SizesInByte());
+  }
+  /*!
+  * \brief Save the fields before the bin data to file, including the padding to align the bin data
+  * \param file File want to write
+  * \return Sizes in byte that are written
+  */
+  size_t SaveBinaryHeaderToFile(FILE* file) const {
     fwrite(&feature_index_, sizeof(feature_index_), 1, file);
     fwrite(&is_sparse_, sizeof(is_sparse_), 1, file);
     bin_mapper_->SaveBinaryToFile(file);
-    bin_data_->SaveBinaryToFile(file);
+    const std::vector<char> padding(static_cast<size_t>(kBinaryAlignment), 0);
+    fwrite(padding.data(), sizeof(char), PaddingSizeOfHeader(), file);
+    return SizesOfHeader() + PaddingSizeOfHeader();
+  }
+  /*!
+  * \brief Save the padding after the bin data to file
+  * \param file File want to write
+  * \param bin_size Sizes in byte of the bin data
+  */
+  void SaveBinaryTailToFile(FILE* file, size_t bin_size) const {
+    const std::vector<char> padding(static_cast<size_t>(kBinaryAlignment), 0);
+    fwrite(padding.data(), sizeof(char), SizesInByte(bin_size) - SizesOfHeader() - PaddingSizeOfHeader()
+      - bin_size, file);
+  }
+  /*!
+  * \brief Copy binary data to buffer, in the same layout as SaveBinaryToFile
+  * \param buffer The destination, should have SizesInByte() bytes
+  */
+  void CopyTo(char* buffer) const {
+    const size_t size = SizesInByte();
+    std::memset(buffer, 0, size);
+    std::memcpy(buffer, &feature_index_, sizeof(feature_index_));
+    buffer += sizeof(feature_index_);
+    std::memcpy(buffer, &is_sparse_, sizeof(is_sparse_));
+    buffer += sizeof(is_sparse_);
+    bin_mapper_->CopyTo(buffer);
+    buffer += bin_mapper_->SizesInByte() + PaddingSizeOfHeader();
+    bin_data_->CopyTo(buffer);
   }
   /*!
-  * \brief Get sizes in byte of this object
+  * \brief Get sizes in byte of this object, including the padding to align the next section
   */
   size_t SizesInByte() const {
-    return sizeof(feature_index_) + sizeof(is_sparse_) +
-      bin_mapper_->SizesInByte() + bin_data_->SizesInByte();
+    return SizesInByte(bin_data_->SizesInByte());
+  }
+  /*!
+  * \brief Get sizes in byte of this object if its bin data has bin_size bytes
+  * \param bin_size Sizes in byte of the bin data
+  */
+  size_t SizesInByte(size_t bin_size) const {
+    return Common::AlignUp(sizeof(size_t) + SizesOfHeader() + PaddingSizeOfHeader() + bin_size,
+      kBinaryAlignment) - sizeof(size_t);
   }
   /*! \brief Disable copy */
   Feature& operator=(const Feature&) = delete;
@@ -113,6 +219,16 @@ public:
   Feature(const Feature&) = delete;
 
 private:
+  /*! \brief Sizes in byte of the fields before the bin data */
+  size_t SizesOfHeader() const {
+    return sizeof(feature_index_) + sizeof(is_sparse_) + bin_mapper_->SizesInByte();
+  }
+  /*! \brief Sizes in byte of the padding before the bin data */
+  size_t PaddingSizeOfHeader() const {
+    const size_t offset = sizeof(size_t) + SizesOfHeader();
+    return Common::AlignUp(offset, kBinaryAlignment) - offset;
+  }
+
   /*! \brief Index of this feature */
   int feature_index_;
   /*! \brief Bin mapper that this feature used */
@@ -0,0 +1,125 @@
+#ifndef LIGHTGBM_FEATURE_BUNDLE_H_
+#define LIGHTGBM_FEATURE_BUNDLE_H_
+
+#include <LightGBM/meta.h>
+#include <LightGBM/bin.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace LightGBM {
+
+/*!
+* \brief Dense bin column shared by a bundle of sparse features, which are (almost) never non-zero on the same data.
+*        Each feature uses its own range of bins in the bundle, and bin 0 of the bundle means all features are zero.
+*        So the histograms of all features in the bundle are constructed by one pass over the rows of a leaf,
+*        and the histogram of each feature is the range of its bins in the histogram of the bundle.
+*        Bundles only hold bin data, so they are built once with the data and shared by all tree learners
+*/
+class FeatureBundle {
+public:
+  /*! \brief Max number of bins of a bundle */
+  static const int kMaxNumBin = 256;
+
+  /*!
+  * \brief Constructor
+  * \param num_data Number of data
+  * \param feature_indices Indices of the features in this bundle
+  * \param num_bins Number of bins of the features in this bundle
+  */
+  FeatureBundle(data_size_t num_data, const std::vector<int>& feature_indices, const std::vector<int>& num_bins)
+    :feature_indices_(feature_indices) {
+    num_features_ = static_cast<int>(feature_indices_.size());
+    // bins of the j-th feature start from bin_offsets_[j], its zero bin is never used by data
+    bin_offsets_.resize(num_features_);
+    num_bin_ = 1;
+    for (int j = 0; j < num_features_; ++j) {
+      bin_offsets_[j] = num_bin_;
+      num_bin_ += num_bins[j];
+    }
+    data_.resize(num_data, 0);
+  }
+
+  /*!
+  * \brief Put the non-zero data of one feature into this bundle, keep the bin of former pushed features when conflicting
+  * \param j Index of the feature in this bundle
+  * \param indices Data indices of the non-zero data
+  * \param bins Bins of the non-zero data
+  */
+  void Push(int j, const std::vector<data_size_t>& indices, const std::vector<uint32_t>& bins) {
+    const int offset = bin_offsets_[j];
+    for (size_t i = 0; i < indices.size(); ++i) {
+      if (data_[indices[i]] == 0) {
+        data_[indices[i]] = static_cast<uint8_t>(offset + bins[i]);
+      }
+    }
+  }
+
+  /*!
+  * \brief Construct the histogram of this bundle
+  * \param data_indices Used data indices in current leaf, nullptr means using all data
+  * \param num_data Number of used data
+  * \param ordered_gradients Pointer to gradients, the data_indices[i]-th data's gradient is ordered_gradients[i]
+  * \param ordered_hessians Pointer to hessians, the data_indices[i]-th data's hessian is ordered_hessians[i].
+  *        nullptr means all hessians are 1, then sum_hessians of the histogram are not filled
+  * \param out Output histogram of num_bin() entries, should be cleared before
+  */
+  void ConstructHistogram(const data_size_t* data_indices, data_size_t num_data,
+    const score_t* ordered_gradients, const score_t* ordered_hessians, HistogramBinEntry* out) const {
+    if (ordered_hessians == nullptr) {
+      ConstructHistogramInner<true>(data_indices, num_data, ordered_gradients, ordered_hessians, out);
+    } else {
+      ConstructHistogramInner<false>(data_indices, num_data, ordered_gradients, ordered_hessians, out);
+    }
+  }
+
+  /*! \brief Indices of the features in this bundle */
+  const std::vector<int>& feature_indices() const { return feature_indices_; }
+
+  /*! \brief Number of features in this bundle */
+  int num_features() const { return num_features_; }
+
+  /*! \brief Number of bins of this bundle */
+  int num_bin() const { return num_bin_; }
+
+  /*! \brief Bin i of the j-th feature is bin bin_offset(j) + i of the bundle */
+  int bin_offset(int j) const { return bin_offsets_[j]; }
+
+  /*! \brief Sizes in byte of the bundled bins */
+  size_t SizesInByte() const { return data_.size() * sizeof(uint8_t); }
+
+  /*! \brief Disable copy */
+  FeatureBundle& operator=(const FeatureBundle&) = delete;
+  /*! \brief Disable copy */
+  FeatureBundle(const FeatureBundle&) = delete;
+
+private:
+  template<bool IS_CONSTANT_HESSIAN>
+  void ConstructHistogramInner(const data_size_t* data_indices, data_size_t num_data,
+    const score_t* ordered_gradients, const score_t* ordered_hessians,
+    HistogramBinEntry* out) const {
+    for (data_size_t i = 0; i < num_data; ++i) {
+      const data_size_t idx = data_indices != nullptr ? data_indices[i] : i;
+      HistogramBinEntry& entry = out[data_[idx]];
+      entry.sum_gradients += ordered_gradients[i];
+      if (!IS_CONSTANT_HESSIAN) {
+        entry.sum_hessians += ordered_hessians[i];
+      }
+      ++entry.cnt;
+    }
+  }
+
+  /*! \brief Number of features in this bundle */
+  int num_features_;
+  /*! \brief Indices of the features in this bundle */
+  std::vector<int> feature_indices_;
+  /*! \brief Bin i of the j-th feature is bin bin_offsets_[j] + i of the bundle */
+  std::vector<int> bin_offsets_;
+  /*! \brief Number of bins of this bundle */
+  int num_bin_;
+  /*! \brief Bundled bin of each data */
+  std::vector<uint8_t> data_;
+};
+
+}  // namespace LightGBM
+#endif   // LIGHTGBM_FEATURE_BUNDLE_H_
@@ -21,6 +21,12 @@ const score_t kEpsilon = 1e-15f;
 
 using ReduceFunction = std::function<void(const char*, char*, int)>;
 
+/*! \brief Encode (input, input_size) into output and return the encoded size, which should be at most input_size + 1 */
+using EncodeFunction = std::function<int(const char*, int, char*)>;
+
+/*! \brief Reduce encoded (src, src_size) into dst, which has len bytes in the raw format */
+using DecodeReduceFunction = std::function<void(const char*, int, char*, int)>;
+
 using PredictFunction =
 std::function<std::vector<double>(const std::vector<std::pair<int, double>>&)>;
 
@@ -57,7 +57,7 @@ public:
 class DCGCalculator {
 public:
   /*!
-  * \brief Initial logic
+  * \brief Initial logic, only the first call takes effect, thread safe
   * \param label_gain Gain for labels, default is 2^i - 1
   */
   static void Init(std::vector<double> label_gain);
@@ -6,9 +6,11 @@
 #include <LightGBM/meta.h>
 #include <LightGBM/config.h>
 
+#include <cstdint>
 #include <functional>
 #include <vector>
 #include <memory>
+#include <string>
 
 namespace LightGBM {
 
@@ -83,6 +85,66 @@ public:
   static RecursiveHalvingMap Construct(int rank, int num_machines);
 };
 
+/*!
+* \brief Network structure for hierarchical collectives, machines with the same address are in the same host.
+*        Data are reduced to the leader of each host, then reduced among leaders, then sent back to the host
+*/
+class HierarchicalMap {
+public:
+  /*! \brief Rank of the leader of local host, which is the smallest rank in the host */
+  int leader;
+  /*! \brief Other ranks in local host, only used for leader */
+  std::vector<int> local_ranks;
+  /*! \brief Ranks of leaders of all hosts, in ascending order */
+  std::vector<int> leaders;
+  /*! \brief Index of local host in leaders */
+  int host_index;
+  /*! \brief Max number of machines in one host */
+  int max_local_machines;
+
+  HierarchicalMap();
+  /*!
+  * \brief Create the object of hierarchical map
+  * \param rank Rank of this machine
+  * \param hosts Hosts of all machines
+  * \return The object of hierarchical map
+  */
+  static HierarchicalMap Construct(int rank, const std::vector<std::string>& hosts);
+  /*! \brief Check if hierarchical collectives are useful, i.e. there are multiple hosts and a host has multiple machines */
+  inline bool IsHierarchical() const {
+    return leaders.size() > 1 && max_local_machines > 1;
+  }
+};
+
+/*! \brief Types of collective communications, used in statistics */
+enum NetworkCollectiveType {
+  kAllreduce = 0,
+  kReduceScatter,
+  kAllgather,
+  kNumCollectiveTypes
+};
+
+/*! \brief Phases of training, communications are counted in the current phase */
+enum NetworkPhase {
+  kOtherPhase = 0,
+  kHistogramPhase,  // reduce of histograms
+  kSplitPhase,  // sync of best splits
+  kGlobalSyncPhase,  // sync of global statistics, e.g. sums of gradients
+  kNumNetworkPhases
+};
+
+/*! \brief Statistics of communications */
+struct NetworkStats {
+  /*! \brief Number of calls */
+  int64_t calls = 0;
+  int64_t sent_bytes = 0;
+  int64_t recv_bytes = 0;
+  /*! \brief Wall time, in milliseconds */
+  double time_ms = 0.0;
+  /*! \brief Time blocked in receiving data from other machines, in milliseconds */
+  double wait_ms = 0.0;
+};
+
 /*! \brief A static class that contains some collective communication algorithm */
 class Network {
 public:
@@ -97,10 +159,32 @@ public:
   static inline int rank();
   /*! \brief Get total number of machines */
   static inline int num_machines();
+  /*!
+  * \brief Get number of columns of the machine grid,
+  *        machine i is in row i / num_grid_columns() and column i % num_grid_columns()
+  */
+  static inline int num_grid_columns();
+
+  /*!
+  * \brief Set the phase that following communications are counted in
+  * \param phase Phase of training
+  */
+  static inline void SetPhase(NetworkPhase phase);
+  /*!
+  * \brief Get statistics of collectives since Init, [phase * kNumCollectiveTypes + type] is of the collective type in the phase.
+  *        Collectives called by other collectives are counted in the outer ones
+  */
+  static inline const std::vector<NetworkStats>& stats();
+  /*! \brief Get statistics of communications with each machine since Init */
+  static const std::vector<NetworkStats>& PeerStats();
+  /*! \brief Log statistics since the last call, and the machine that was waited for most */
+  static void LogStats();
 
   /*!
   * \brief Perform all_reduce. if data size is small,
-           will perform AllreduceByAllGather, else with call ReduceScatter followed allgather
+           will perform AllreduceByAllGather, else with call ReduceScatter followed allgather.
+           Ring algorithms are used for large data when number of machines is not power of 2.
+           Hierarchical algorithm is used for large data when some hosts have multiple machines
   * \param input Input data
   * \param input_size The size of input data
   * \param type_size The size of one object in the reduce function
@@ -157,17 +241,106 @@ public:
     const int* block_start, const int* block_len, char* output,
     const ReduceFunction& reducer);
 
+  /*!
+  * \brief Perform reduce scatter by using recursive halving algorithm, data are encoded before sent.
+           Encoded sizes are sent in front of the data, so bytes on the wire depend on the encoded sizes
+  * \param input Input data
+  * \param input_size The size of input data
+  * \param block_start The block start for different machines
+  * \param block_len The block size for different machines
+  * \param output Output result
+  * \param encoder Encode function, called on ranges of whole blocks of input
+  * \param decode_reducer Reduce function of encoded data, always reduces into ranges of whole blocks of input
+  */
+  static void ReduceScatter(char* input, int input_size,
+    const int* block_start, const int* block_len, char* output,
+    const EncodeFunction& encoder, const DecodeReduceFunction& decode_reducer);
+
+  /*!
+  * \brief Perform all_reduce among the machines in the same grid column by ring, in place
+  * \param data Input data, and output result
+  * \param input_size The size of input data
+  * \param type_size The size of one object in the reduce function
+  * \param reducer Reduce function
+  */
+  static void AllreduceInColumn(char* data, int input_size, int type_size, const ReduceFunction& reducer);
+
+  /*!
+  * \brief Perform reduce scatter among the machines in the same grid column by ring, in place.
+  *        Block i is for the machine in row i, and is reduced in data after finished
+  * \param data Input data, and output result
+  * \param type_size The size of one object in the reduce function
+  * \param block_start The block start for machines in the column
+  * \param block_len The block size for machines in the column
+  * \param reducer Reduce function
+  */
+  static void ReduceScatterInColumn(char* data, int type_size, const int* block_start, const int* block_len,
+    const ReduceFunction& reducer);
+
 private:
+  /*! \brief Counts the outermost collective into stats_, by the differences of statistics of linkers */
+  class CollectiveScope;
+
+  /*!
+  * \brief Check whether to use ring algorithms, they send (n-1)/n of the data per machine,
+  *        which recursive halving can't reach when number of machines is not power of 2,
+  *        but they need O(n) communication times, so are only used for large data
+  * \param input_size The size of input data
+  */
+  static inline bool UseRing(int input_size);
+
+  /*! \brief Check whether to use the hierarchical all_reduce, it is only used for large data */
+  static inline bool UseHierarchy(int input_size);
+
+  /*!
+  * \brief Perform all_reduce in 3 levels: reduce to host leaders, ring all_reduce among leaders,
+  *        then send the result back to other machines in the hosts
+  * \param input Input data
+  * \param input_size The size of input data
+  * \param type_size The size of one object in the reduce function
+  * \param output Output result
+  * \param reducer Reduce function
+  */
+  static void AllreduceByHierarchy(char* input, int input_size, int type_size, char* output,
+    const ReduceFunction& reducer);
+
+  /*!
+  * \brief Run the n-1 steps of a ring algorithm in place, machine i sends to i+1 and receives from i-1.
+  *        Blocks are split into chunks and sent by another thread, so a chunk is sent as soon as
+  *        it is received and reduced, which pipelines receiving, reducing and sending.
+  *        At step s, block (rank - s + block_shift) is sent, and block (rank - s - 1 + block_shift) is received
+  * \param data Data of all blocks
+  * \param type_size The size of one object in the reduce function, chunks contain whole objects
+  * \param ring_size Number of machines in the ring
+  * \param ring_index Index of local machine in the ring
+  * \param next_rank Rank of the next machine in the ring
+  * \param prev_rank Rank of the previous machine in the ring
+  * \param block_start The block start for different machines in the ring
+  * \param block_len The block size for different machines in the ring
+  * \param block_shift Shift of the block index, -1 for reduce scatter and 0 for all_gather
+  * \param reducer Reduce function of received chunks, received chunks are copied to data if it is empty
+  */
+  static void RingPipeline(char* data, int type_size, int ring_size, int ring_index, int next_rank, int prev_rank,
+    const int* block_start, const int* block_len, int block_shift, const ReduceFunction& reducer);
+
+  /*! \brief Min block size per machine to use ring algorithms */
+  static const int kRingMinBlockSize = 64 * 1024;
+  /*! \brief Size of the chunks in ring algorithms */
+  static const int kRingChunkSize = 256 * 1024;
   /*! \brief Number of all machines */
   static int num_machines_;
   /*! \brief Rank of local machine */
   static int rank_;
+  /*! \brief Number of columns of the machine grid */
+  static int num_grid_columns_;
   /*! \brief The network interface, provide send/recv functions  */
   static std::unique_ptr<Linkers> linkers_;
   /*! \brief Bruck map for all gather algorithm*/
   static BruckMap bruck_map_;
   /*! \brief Recursive halving map for reduce scatter */
   static RecursiveHalvingMap recursive_halving_map_;
+  /*! \brief Hierarchical map for all reduce */
+  static HierarchicalMap hierarchical_map_;
   /*! \brief Buffer to store block start index */
   static std::vector<int> block_start_;
   /*! \brief Buffer to store block size */
@@ -176,16 +349,50 @@ private:
   static std::vector<char> buffer_;
   /*! \brief Size of buffer_ */
   static int buffer_size_;
+  /*! \brief Buffer to receive encoded data */
+  static std::vector<char> recv_buffer_;
+  /*! \brief Current phase of training */
+  static NetworkPhase phase_;
+  /*! \brief Depth of the running collectives */
+  static int collective_depth_;
+  /*! \brief Statistics of collectives */
+  static std::vector<NetworkStats> stats_;
+  /*! \brief Statistics of collectives at the last LogStats */
+  static std::vector<NetworkStats> logged_stats_;
+  /*! \brief Statistics of communications with each machine at the last LogStats */
+  static std::vector<NetworkStats> logged_peer_stats_;
 };
 
 inline int Network::rank() {
   return rank_;
 }
 
+inline bool Network::UseRing(int input_size) {
+  return (num_machines_ & (num_machines_ - 1)) != 0
+    && input_size / num_machines_ >= kRingMinBlockSize;
+}
+
+inline bool Network::UseHierarchy(int input_size) {
+  return hierarchical_map_.IsHierarchical()
+    && input_size / static_cast<int>(hierarchical_map_.leaders.size()) >= kRingMinBlockSize;
+}
+
 inline int Network::num_machines() {
   return num_machines_;
 }
 
+inline int Network::num_grid_columns() {
+  return num_grid_columns_;
+}
+
+inline void Network::SetPhase(NetworkPhase phase) {
+  phase_ = phase;
+}
+
+inline const std::vector<NetworkStats>& Network::stats() {
+  return stats_;
+}
+
 }  // namespace LightGBM
 
 #endif   // LightGBM_NETWORK_H_
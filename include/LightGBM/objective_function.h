@@ -4,6 +4,7 @@
 #include <LightGBM/meta.h>
 #include <LightGBM/config.h>
 #include <LightGBM/dataset.h>
+#include <LightGBM/utils/log.h>
 
 namespace LightGBM {
 
@@ -31,6 +32,32 @@ public:
   virtual void GetGradients(const score_t* score,
     score_t* gradients, score_t* hessians) const = 0;
 
+  /*!
+  * \brief True if all hessians are 1, then tree learners count sums of hessians from the number of data
+  *        instead of reading hessians
+  */
+  virtual bool IsConstantHessian() const { return false; }
+
+  /*!
+  * \brief True if AddScoreAndGetGradients is supported, which needs gradients of one data only depend on its own score
+  */
+  virtual bool IsFusedGradientsSupported() const { return false; }
+
+  /*!
+  * \brief Add output to scores of parts of data, then calculate their gradients with the new scores in the same pass.
+  *        Gradients are the same as GetGradients on the new scores
+  * \param output Output that is added to scores
+  * \param data_indices Indices of data
+  * \param num_data Number of data
+  * \param score Scores of all data, updated in place
+  * \param gradients Output gradients of all data
+  * \param hessians Output hessians of all data
+  */
+  virtual void AddScoreAndGetGradients(score_t, const data_size_t*, data_size_t,
+    score_t*, score_t*, score_t*) const {
+    Log::Fatal("Objective function %s doesn't support fused gradients", GetName());
+  }
+
   virtual const char* GetName() const = 0;
 
   ObjectiveFunction() = default;
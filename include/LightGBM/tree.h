@@ -5,6 +5,7 @@
 #include <LightGBM/feature.h>
 #include <LightGBM/dataset.h>
 
+#include <cstdio>
 #include <string>
 #include <vector>
 #include <memory>
@@ -29,6 +30,12 @@ public:
   */
   explicit Tree(const std::string& str);
 
+  /*!
+  * \brief Construtor, from memory in the layout of SaveBinaryToFile. The arrays are copied without parsing
+  * \param memory Pointer of memory
+  */
+  explicit Tree(const void* memory);
+
   ~Tree();
 
   /*!
@@ -40,16 +47,21 @@ public:
   * \param threshold_double Threshold on feature value
   * \param left_value Model Left child output
   * \param right_value Model Right child output
+  * \param left_cnt Number of data in the left child
+  * \param right_cnt Number of data in the right child
   * \param gain Split gain
   * \return The index of new leaf.
   */
   int Split(int leaf, int feature, unsigned int threshold, int real_feature,
     double threshold_double, double left_value,
-    double right_value, double gain);
+    double right_value, data_size_t left_cnt, data_size_t right_cnt, double gain);
 
   /*! \brief Get the output of one leave */
   inline double LeafOutput(int leaf) const { return leaf_value_[leaf]; }
 
+  /*! \brief Set the output of one leaf, e.g. when refitting the tree on new data */
+  inline void SetLeafOutput(int leaf, double output) { leaf_value_[leaf] = output; }
+
   /*!
   * \brief Adding prediction value of this tree model to scores
   * \param data The dataset
@@ -70,6 +82,22 @@ public:
                             const data_size_t* used_data_indices,
                             data_size_t num_data, score_t* score) const;
 
+  /*!
+  * \brief Get leaf index of all data, for trees with at most 256 leaves
+  * \param data The dataset
+  * \param num_data Number of total data
+  * \param out_leaf Output leaf index of each data
+  */
+  void GetLeafIndex(const Dataset* data, data_size_t num_data, uint8_t* out_leaf) const;
+
+  /*!
+  * \brief Get leaf index of all data, for trees with at most 65536 leaves
+  * \param data The dataset
+  * \param num_data Number of total data
+  * \param out_leaf Output leaf index of each data
+  */
+  void GetLeafIndex(const Dataset* data, data_size_t num_data, uint16_t* out_leaf) const;
+
   /*!
   * \brief Prediction on one record 
   * \param feature_values Feature value of this record
@@ -78,15 +106,35 @@ public:
   inline double Predict(const double* feature_values) const;
   inline int PredictLeafIndex(const double* feature_values) const;
 
+  /*!
+  * \brief Prediction on one record that is mapped to bins by the thresholds, needs FlattenBins
+  * \param bins Bin of each feature slot of this record
+  * \return Prediction result
+  */
+  inline double PredictByBins(const uint16_t* bins) const;
+  inline int PredictLeafIndexByBins(const uint16_t* bins) const;
+
   /*! \brief Get Number of leaves*/
   inline int num_leaves() const { return num_leaves_; }
 
+  /*! \brief Max number of splits from the root to a leaf */
+  inline int max_depth() const { return max_depth_; }
+
+  /*! \brief True if nodes have numbers of training data, which are needed by contributions. Old model files don't */
+  inline bool HasDataCounts() const { return num_leaves_ <= 1 || !internal_count_.empty(); }
+
+  /*! \brief True if splits have thresholds in bins, which are needed to traverse datasets. Trees loaded from model files don't */
+  inline bool HasBinThresholds() const { return num_leaves_ <= 1 || !threshold_in_bin_.empty(); }
+
   /*! \brief Get depth of specific leaf*/
   inline int leaf_depth(int leaf_idx) const { return leaf_depth_[leaf_idx]; }
 
   /*! \brief Get feature of specific split*/
   inline int split_feature_real(int split_idx) const { return split_feature_real_[split_idx]; }
 
+  /*! \brief Get threshold in feature value of specific split*/
+  inline double threshold(int split_idx) const { return threshold_[split_idx]; }
+
   /*!
   * \brief Shrinkage for the tree's output
   *        shrinkage rate (a.k.a learning rate) is used to tune the traning process
@@ -98,23 +146,116 @@ public:
     }
   }
 
+  /*!
+  * \brief Element of the paths of TreeSHAP, the features on the path from the root and their weights
+  */
+  struct PathElement {
+    /*! \brief Split feature, the original index, -1 for the root */
+    int feature_index;
+    /*! \brief Fraction of data going this way when the feature is unknown */
+    double zero_fraction;
+    /*! \brief 1 if the record goes this way when the feature is known, otherwise 0 */
+    double one_fraction;
+    /*! \brief Weight of the subsets of features of this size */
+    double pweight;
+  };
+
+  /*!
+  * \brief Number of path elements that TreeSHAP needs for trees of a max depth, every level of recursion
+  *        has its own copy of the path, so the buffer is reused by all trees and records
+  * \param max_depth Max number of splits from the root to a leaf
+  */
+  static size_t PathBufferSize(int max_depth) {
+    return static_cast<size_t>(max_depth + 1) * (max_depth + 2) / 2;
+  }
+
+  /*!
+  * \brief Add the contributions of features to the prediction of one record by TreeSHAP
+  *        (Lundberg et al., Consistent Individualized Feature Attribution for Tree Ensembles), in O(L * D^2)
+  *        for L leaves and depth D. Contributions weight the children of a split by their numbers of data,
+  *        they and the expected value of the tree sum to the prediction. Needs HasDataCounts
+  * \param feature_values Feature values of the record
+  * \param num_features Number of features, the expected value is added to output[num_features]
+  * \param path_buffer Buffer of at least PathBufferSize(max_depth()) elements
+  * \param output Contributions are added to it, num_features + 1 elements
+  */
+  void PredictContrib(const double* feature_values, int num_features, PathElement* path_buffer, double* output) const;
+
+  /*! \brief Mean output of the tree on the training data, weighted by the numbers of data of leaves */
+  double ExpectedValue() const;
+
   /*! \brief Serialize this object by string*/
   std::string ToString();
 
+  /*!
+  * \brief Save binary data to file, the fixed-layout arrays and the packed nodes of Flatten,
+  *        each array is aligned to 8 bytes relative to the beginning
+  * \param file File want to write
+  */
+  void SaveBinaryToFile(FILE* file) const;
+
+  /*! \brief Get sizes in byte of the binary data of this tree */
+  size_t SizesInByte() const { return SizesInByte(num_leaves_, !flat_nodes_.empty()); }
+
+  /*!
+  * \brief Get sizes in byte of the binary data of a tree
+  * \param num_leaves Number of leaves
+  * \param has_flat_nodes True if the packed nodes of Flatten are saved
+  */
+  static size_t SizesInByte(int num_leaves, bool has_flat_nodes);
+
+  /*!
+  * \brief Save the fields that are only used by training to file, after SaveBinaryToFile in checkpoints.
+  *        These are the split features and thresholds in bins and the depths of leaves, padded to be aligned
+  * \param file File want to write
+  */
+  void SaveTrainingFieldsToFile(FILE* file) const;
+
+  /*!
+  * \brief Load the fields that are only used by training, in the layout of SaveTrainingFieldsToFile
+  * \param memory Pointer of memory
+  */
+  void LoadTrainingFields(const void* memory);
+
+  /*!
+  * \brief Get sizes in byte of the fields that are only used by training of a tree
+  * \param num_leaves Number of leaves
+  */
+  static size_t SizesOfTrainingFields(int num_leaves);
+
+  /*!
+  * \brief Convert this tree to C++ functions of nested if-else with the thresholds as constants,
+  *        PredictTree<index> returns the output and PredictTree<index>Leaf returns the leaf index
+  * \param index Index of this tree in the model, used in the function names
+  */
+  std::string ToIfElse(int index) const;
+
+  /*!
+  * \brief Build the packed node layout used by prediction on feature values.
+  *        Should be called after the structure of this tree is final, Shrinkage doesn't change it.
+  *        Trees with more than 32767 leaves are not flattened and use the original layout
+  */
+  void Flatten();
+
+  /*!
+  * \brief Build the packed node layout used by prediction on bins, the nodes are in the same order as Flatten.
+  *        The bin of value v of a feature is the number of its thresholds that are less than v, and NaN is mapped
+  *        to the number of its thresholds. So v <= thresholds[k] if and only if the bin is <= k,
+  *        and the prediction on bins is exactly the same as on feature values
+  * \param feature_slots Slot of each feature in the bins of a record, the original index
+  * \param feature_thresholds Sorted distinct thresholds of each slot, should contain all thresholds of this tree
+  * \return False if this tree has more than 32767 leaves, then it cannot predict on bins
+  */
+  bool FlattenBins(const std::vector<int>& feature_slots, const std::vector<std::vector<double>>& feature_thresholds);
+
+  /*! \brief Alignment in byte of the arrays in binary data, the size of a tree is a multiple of it */
+  static const size_t kBinaryAlignment = 8;
+
   /*! \brief Disable copy */
   Tree& operator=(const Tree&) = delete;
   /*! \brief Disable copy */
   Tree(const Tree&) = delete;
 private:
-  /*!
-  * \brief Find leaf index of which record belongs by data
-  * \param data The dataset
-  * \param data_idx Index of record
-  * \return Leaf index
-  */
-  inline int GetLeaf(const std::vector<std::unique_ptr<BinIterator>>& iterators,
-                                           data_size_t data_idx) const;
-
   /*!
   * \brief Find leaf index of which record belongs by features
   * \param feature_values Feature value of this record
@@ -122,6 +263,111 @@ private:
   */
   inline int GetLeaf(const double* feature_values) const;
 
+  /*!
+  * \brief Convert the sub-tree of one node to if-else code
+  * \param node Index of the node, ~leaf for leaves
+  * \param depth Depth of the node, for indent
+  * \param is_leaf_index True if return leaf index instead of output
+  */
+  std::string NodeToIfElse(int node, int depth, bool is_leaf_index) const;
+
+  /*!
+  * \brief Packed node for prediction in 16 bytes, internal nodes are in breadth-first order,
+  *        so one visit touches one cache line and the top levels of the tree share a few lines
+  */
+  struct FlatNode {
+    /*! \brief Split threshold in feature value */
+    double threshold;
+    /*! \brief Split feature, the original index */
+    int feature;
+    /*! \brief Left child, ~leaf for leaves */
+    int16_t left_child;
+    /*! \brief Right child, ~leaf for leaves */
+    int16_t right_child;
+  };
+
+  /*! \brief Packed node for prediction on bins in 8 bytes */
+  struct BinNode {
+    /*! \brief Slot of split feature in the bins of a record */
+    uint16_t feature;
+    /*! \brief Split threshold in bin, the index of the threshold in the thresholds of the slot */
+    uint16_t threshold;
+    /*! \brief Left child, ~leaf for leaves */
+    int16_t left_child;
+    /*! \brief Right child, ~leaf for leaves */
+    int16_t right_child;
+  };
+
+  /*!
+  * \brief Breadth-first order of internal nodes for the packed layouts
+  * \return New index of each internal node
+  */
+  std::vector<int> BreadthFirstIndex() const;
+
+  /*! \brief Max number of splits from a node to its leaves, ~leaf for leaves */
+  int NodeDepth(int node) const;
+
+  /*! \brief Number of training data of a node, ~leaf for leaves */
+  inline double DataCount(int node) const {
+    return static_cast<double>(node >= 0 ? internal_count_[node] : leaf_count_[~node]);
+  }
+
+  /*! \brief Extend the path by a split of feature_index, the weights of all subset sizes are updated */
+  static void ExtendPath(PathElement* unique_path, int unique_depth, double zero_fraction,
+    double one_fraction, int feature_index);
+
+  /*! \brief Undo ExtendPath of the element at path_index */
+  static void UnwindPath(PathElement* unique_path, int unique_depth, int path_index);
+
+  /*! \brief Total weight of the path if the element at path_index is unwound, without changing the path */
+  static double UnwoundPathSum(const PathElement* unique_path, int unique_depth, int path_index);
+
+  /*!
+  * \brief Recursion of TreeSHAP, the path of this node is after the parent's path in the buffer
+  * \param feature_values Feature values of the record
+  * \param phi Output contributions
+  * \param node The node, ~leaf for leaves
+  * \param unique_depth Number of elements of the parent's path
+  * \param parent_unique_path Path of the parent
+  * \param parent_zero_fraction Zero fraction of the split that leads to this node
+  * \param parent_one_fraction One fraction of the split that leads to this node
+  * \param parent_feature_index Feature of the split that leads to this node
+  */
+  void TreeSHAP(const double* feature_values, double* phi, int node, int unique_depth,
+    PathElement* parent_unique_path, double parent_zero_fraction, double parent_one_fraction,
+    int parent_feature_index) const;
+
+  /*! \brief Get leaf index of all data in type T */
+  template<typename T>
+  void GetLeafIndexInType(const Dataset* data, data_size_t num_data, T* out_leaf) const;
+
+  /*!
+  * \brief Partition data into leaves by splitting index arrays with Bin::Split at each node, like DataPartition,
+  *        so there is one virtual call per node instead of one per data and node
+  * \param data The dataset
+  * \param indices Sorted indices of data, partitioned in place
+  * \param num_data Number of data
+  * \param buffer Buffer with num_data elements
+  * \param leaf_begin Output begin of each leaf in indices, with num_leaves_ elements
+  * \param leaf_count Output number of data of each leaf, with num_leaves_ elements
+  */
+  void PartitionByBins(const Dataset* data, data_size_t* indices, data_size_t num_data, data_size_t* buffer,
+    data_size_t* leaf_begin, data_size_t* leaf_count) const;
+
+  /*!
+  * \brief Call fun(leaf, data_idx) for all data, data are partitioned in blocks in parallel
+  * \param data The dataset
+  * \param used_data_indices Sorted indices of used data, nullptr means all data
+  * \param num_data Number of used data
+  * \param fun Function that is called for each data with its leaf
+  */
+  template<typename FUN>
+  void ForEachDataInLeaves(const Dataset* data, const data_size_t* used_data_indices, data_size_t num_data,
+    const FUN& fun) const;
+
+  /*! \brief Number of data in a block of ForEachDataInLeaves */
+  static const data_size_t kPartitionBlockSize = 16384;
+
   /*! \brief Number of max leaves*/
   int max_leaves_;
   /*! \brief Number of current levas*/
@@ -150,6 +396,16 @@ private:
   std::vector<double> internal_value_;
   /*! \brief Depth for leaves */
   std::vector<int> leaf_depth_;
+  /*! \brief Number of training data of leaves, empty if loaded from an old model file */
+  std::vector<data_size_t> leaf_count_;
+  /*! \brief Number of training data of internal nodes, empty if loaded from an old model file */
+  std::vector<data_size_t> internal_count_;
+  /*! \brief Max number of splits from the root to a leaf */
+  int max_depth_ = 0;
+  /*! \brief Packed nodes for prediction, empty if not flattened */
+  std::vector<FlatNode> flat_nodes_;
+  /*! \brief Packed nodes for prediction on bins, empty if not built */
+  std::vector<BinNode> bin_nodes_;
 };
 
 
@@ -163,20 +419,36 @@ inline int Tree::PredictLeafIndex(const double* feature_values) const {
   return leaf;
 }
 
-inline int Tree::GetLeaf(const std::vector<std::unique_ptr<BinIterator>>& iterators,
-                                       data_size_t data_idx) const {
-  int node = 0;
+inline double Tree::PredictByBins(const uint16_t* bins) const {
+  return LeafOutput(PredictLeafIndexByBins(bins));
+}
+
+inline int Tree::PredictLeafIndexByBins(const uint16_t* bins) const {
+  const BinNode* nodes = bin_nodes_.data();
+  int node = bin_nodes_.empty() ? ~0 : 0;
   while (node >= 0) {
-    if (iterators[split_feature_[node]]->Get(data_idx) <= threshold_in_bin_[node]) {
-      node = left_child_[node];
+    if (bins[nodes[node].feature] <= nodes[node].threshold) {
+      node = nodes[node].left_child;
     } else {
-      node = right_child_[node];
+      node = nodes[node].right_child;
     }
   }
   return ~node;
 }
 
 inline int Tree::GetLeaf(const double* feature_values) const {
+  if (!flat_nodes_.empty()) {
+    const FlatNode* nodes = flat_nodes_.data();
+    int node = 0;
+    while (node >= 0) {
+      if (feature_values[nodes[node].feature] <= nodes[node].threshold) {
+        node = nodes[node].left_child;
+      } else {
+        node = nodes[node].right_child;
+      }
+    }
+    return ~node;
+  }
   int node = 0;
   while (node >= 0) {
     if (feature_values[split_feature_real_[node]] <= threshold_[node]) {
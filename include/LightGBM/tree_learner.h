@@ -4,14 +4,17 @@
 
 #include <LightGBM/meta.h>
 #include <LightGBM/config.h>
+#include <LightGBM/utils/memory_usage.h>
 
 #include <vector>
+#include <string>
 
 namespace LightGBM {
 
 /*! \brief forward declaration */
 class Tree;
 class Dataset;
+class ObjectiveFunction;
 
 /*!
 * \brief Interface for tree learner
@@ -49,6 +52,49 @@ public:
   */
   virtual void AddPredictionToScore(score_t *out_score) const = 0;
 
+  /*!
+  * \brief Using last trained tree to predict score then adding to out_score,
+  *        and calculate gradients with the new scores in the same pass
+  * \param object_function Objective function, should support AddScoreAndGetGradients
+  * \param out_score output score
+  * \param gradients Output gradients
+  * \param hessians Output hessians
+  */
+  virtual void AddPredictionToScoreAndGetGradients(const ObjectiveFunction* object_function, score_t* out_score,
+    score_t* gradients, score_t* hessians) const = 0;
+
+  /*!
+  * \brief Get the state of random generators, saved in checkpoints
+  * \return State of random generators
+  */
+  virtual std::string GetRandomState() const = 0;
+
+  /*!
+  * \brief Restore the state of random generators from a checkpoint
+  * \param state State from GetRandomState
+  */
+  virtual void SetRandomState(const std::string& state) = 0;
+
+  /*!
+  * \brief Set the max memory used by this tree learner, takes effect in the next Init.
+  *        Histograms are cached within what is left after the other buffers
+  * \param max_memory_in_bytes Max memory in byte, negative means not limit
+  */
+  virtual void SetMemoryBudget(double max_memory_in_bytes) = 0;
+
+  /*!
+  * \brief Set whether all hessians of the next trees are 1, e.g. unweighted L2 regression.
+  *        Then histograms don't read hessians, their sums are counted from the number of data
+  * \param is_constant_hessian True if all hessians are 1
+  */
+  virtual void SetIsConstantHessian(bool is_constant_hessian) = 0;
+
+  /*!
+  * \brief Add the memory used by the buffers of this tree learner, training data is not included
+  * \param memory_usage Memory usage to add to
+  */
+  virtual void AddMemoryUsage(MemoryUsage* memory_usage) const = 0;
+
   TreeLearner() = default;
   /*! \brief Disable copy */
   TreeLearner& operator=(const TreeLearner&) = delete;
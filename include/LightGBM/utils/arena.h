@@ -0,0 +1,149 @@
+#ifndef LIGHTGBM_UTILS_ARENA_H_
+#define LIGHTGBM_UTILS_ARENA_H_
+
+#include <LightGBM/utils/log.h>
+#include <LightGBM/utils/common.h>
+
+#include <cstdlib>
+#include <cstddef>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace LightGBM {
+
+/*!
+* \brief An arena of buffers aligned to cache lines, so buffers used by different threads never share a cache line.
+*        Buffers are cut from large slabs and released together with the arena. Slabs of at least a huge page
+*        are aligned to huge pages and advised to use transparent huge pages on linux.
+*        Memory is not initialized, so pages are placed on the NUMA nodes of the threads that first touch them
+*/
+class Arena {
+public:
+  /*! \brief Alignment in byte of buffers */
+  static const size_t kAlignment = 64;
+  /*! \brief Size in byte of a huge page */
+  static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+  /*!
+  * \brief Constructor
+  * \param slab_size Size in byte of a slab, larger buffers have their own slabs
+  */
+  explicit Arena(size_t slab_size = 8 * kHugePageSize) : slab_size_(slab_size) {
+  }
+
+  /*! \brief Destructor, releases all buffers */
+  ~Arena() {
+    Clear();
+  }
+
+  /*!
+  * \brief Allocate an uninitialized buffer, valid until Clear or destruction
+  * \param num_element Number of elements, T should be trivially constructible
+  * \return Pointer of the buffer, aligned to kAlignment
+  */
+  template<typename T>
+  T* Alloc(size_t num_element) {
+    const size_t size = Common::AlignUp(std::max<size_t>(num_element * sizeof(T), 1), kAlignment);
+    if (size > remain_size_) {
+      NewSlab(size);
+    }
+    char* ret = cur_;
+    cur_ += size;
+    remain_size_ -= size;
+    used_size_ += size;
+    return reinterpret_cast<T*>(ret);
+  }
+
+  /*!
+  * \brief Make sure that the next buffers of total size in byte are cut from one slab
+  * \param size Total size in byte of the buffers, including the padding to kAlignment
+  */
+  void Reserve(size_t size) {
+    if (size > remain_size_) {
+      NewSlab(std::max(size, slab_size_));
+    }
+  }
+
+  /*! \brief Release all buffers */
+  void Clear() {
+    for (const auto& slab : slabs_) {
+#ifdef _MSC_VER
+      _aligned_free(slab.first);
+#else
+      free(slab.first);
+#endif
+    }
+    slabs_.clear();
+    cur_ = nullptr;
+    remain_size_ = 0;
+    used_size_ = 0;
+  }
+
+  /*! \brief Total size in byte of the slabs */
+  size_t SizesInByte() const {
+    size_t ret = 0;
+    for (const auto& slab : slabs_) {
+      ret += slab.second;
+    }
+    return ret;
+  }
+
+  /*! \brief Total size in byte of the allocated buffers, pages of the rest of slabs are not touched */
+  size_t UsedSizesInByte() const {
+    return used_size_;
+  }
+
+  /*! \brief Disable copy */
+  Arena& operator=(const Arena&) = delete;
+  /*! \brief Disable copy */
+  Arena(const Arena&) = delete;
+
+private:
+  void NewSlab(size_t min_size) {
+    size_t size = std::max(min_size, slab_size_);
+    const size_t alignment = size >= kHugePageSize ? kHugePageSize : kAlignment;
+    size = Common::AlignUp(size, alignment);
+    void* ptr = nullptr;
+#ifdef _MSC_VER
+    ptr = _aligned_malloc(size, alignment);
+#else
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+      ptr = nullptr;
+    }
+#endif
+    if (ptr == nullptr) {
+      Log::Fatal("Cannot allocate %f MB memory for arena", size / 1024.0 / 1024.0);
+    }
+#ifdef MADV_HUGEPAGE
+    if (alignment == kHugePageSize) {
+      madvise(ptr, size, MADV_HUGEPAGE);
+    }
+#endif
+    slabs_.emplace_back(reinterpret_cast<char*>(ptr), size);
+    cur_ = reinterpret_cast<char*>(ptr);
+    remain_size_ = size;
+  }
+
+  /*! \brief Size in byte of a slab */
+  size_t slab_size_;
+  /*! \brief Allocated slabs and their sizes */
+  std::vector<std::pair<char*, size_t>> slabs_;
+  /*! \brief Begin of the free memory of the current slab */
+  char* cur_ = nullptr;
+  /*! \brief Free size in byte of the current slab */
+  size_t remain_size_ = 0;
+  /*! \brief Total size in byte of the allocated buffers */
+  size_t used_size_ = 0;
+};
+
+}  // namespace LightGBM
+
+#endif   // LightGBM_UTILS_ARENA_H_
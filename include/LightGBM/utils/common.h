@@ -3,13 +3,19 @@
 
 #include <LightGBM/utils/log.h>
 
+#include <omp.h>
+
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <cstdint>
 #include <algorithm>
+#include <iterator>
 #include <cmath>
+#include <limits>
 #include <functional>
 #include <memory>
 
@@ -23,6 +29,11 @@ inline char tolower(char in) {
   return in;
 }
 
+/*! \brief Round size up to a multiple of alignment */
+inline static size_t AlignUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
 inline static std::string& Trim(std::string& str) {
   if (str.size() <= 0) {
     return str;
@@ -108,9 +119,57 @@ inline static const char* Atoi(const char* p, int* out) {
   return p;
 }
 
+/*!
+* \brief Correctly rounded mantissa * 10^exponent for mantissas of up to 64 bits, by one operation in x87 extended
+*        precision, whose 64-bit significand holds the mantissa and the power of 10 exactly. Rounding the result again
+*        to double is only wrong if it is exactly halfway between two doubles
+* \param mantissa Mantissa
+* \param exponent Power of 10, should be in [-22, 22]
+* \param out Result
+* \return False if the result is halfway between two doubles, or long double is not x87 extended precision
+*/
+inline static bool MulPow10Extended(uint64_t mantissa, int exponent, double* out) {
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_MSC_VER)
+  static const long double kExactPow10L[] = {
+    1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L,
+    1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L
+  };
+  if (std::numeric_limits<long double>::digits != 64) { return false; }
+  long double value = static_cast<long double>(mantissa);
+  value = exponent < 0 ? value / kExactPow10L[-exponent] : value * kExactPow10L[exponent];
+  // the low 11 bits of the significand are rounded off by double
+  uint64_t significand;
+  std::memcpy(&significand, &value, sizeof(significand));
+  if ((significand & 0x7ff) == 0x400) { return false; }
+  *out = static_cast<double>(value);
+  return true;
+#else
+  (void)mantissa; (void)exponent; (void)out;
+  return false;
+#endif
+}
+
+/*!
+* \brief Parse a float, correctly rounded. Up to 19 significant digits are accumulated in an integer,
+*        which is converted by one multiplication or division by an exact power of 10, in double if the integer
+*        is an exact double, otherwise in extended precision by MulPow10Extended. That covers almost all data,
+*        other numbers fall back to strtod, which assumes the "C" locale.
+*        "na" and "nan" are parsed to 0, infinities are clamped to 1e308
+* \param p Begin of the float, leading and trailing spaces are skipped
+* \param out Parsed value
+* \return End of the float
+*/
 inline static const char* Atof(const char* p, double* out) {
-  int frac;
-  double sign, value, scale;
+  // powers of 10 that are exact doubles
+  static const double kExactPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const int kMaxExactPow10 = 22;
+  // integers of up to 15 digits are exact doubles, and integers of up to 19 digits fit in uint64_t
+  const int kMaxExactDigits = 15;
+  const int kMaxDigits = 19;
+  double sign;
   *out = 0;
   // Skip leading white space, if any.
   while (*p == ' ') {
@@ -128,47 +187,65 @@ inline static const char* Atof(const char* p, double* out) {
 
   // is a number
   if ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E') {
+    const char* number_begin = p;
+    // digits are accumulated without checks, overflows are detected by the number of digits after all
+    uint64_t mantissa = 0;
     // Get digits before decimal point or exponent, if any.
-    for (value = 0.0; *p >= '0' && *p <= '9'; ++p) {
-      value = value * 10.0 + (*p - '0');
+    for (; *p >= '0' && *p <= '9'; ++p) {
+      mantissa = mantissa * 10 + (*p - '0');
     }
-
+    int num_digits = static_cast<int>(p - number_begin);
+    int exponent = 0;
     // Get digits after decimal point, if any.
     if (*p == '.') {
-      double pow10 = 10.0;
       ++p;
-      while (*p >= '0' && *p <= '9') {
-        value += (*p - '0') / pow10;
-        pow10 *= 10.0;
-        ++p;
+      const char* frac_begin = p;
+      for (; *p >= '0' && *p <= '9'; ++p) {
+        mantissa = mantissa * 10 + (*p - '0');
       }
+      exponent = -static_cast<int>(p - frac_begin);
+      num_digits -= exponent;
     }
-
     // Handle exponent, if any.
-    frac = 0;
-    scale = 1.0;
     if ((*p == 'e') || (*p == 'E')) {
-      unsigned int expon;
+      int exp_sign = 1;
+      int expon = 0;
       // Get sign of exponent, if any.
       ++p;
       if (*p == '-') {
-        frac = 1;
+        exp_sign = -1;
         ++p;
       } else if (*p == '+') {
         ++p;
       }
       // Get digits of exponent, if any.
-      for (expon = 0; *p >= '0' && *p <= '9'; ++p) {
-        expon = expon * 10 + (*p - '0');
+      for (; *p >= '0' && *p <= '9'; ++p) {
+        if (expon < 100000) {
+          expon = expon * 10 + (*p - '0');
+        }
       }
-      if (expon > 308) expon = 308;
-      // Calculate scaling factor.
-      while (expon >= 50) { scale *= 1E50; expon -= 50; }
-      while (expon >= 8) { scale *= 1E8;  expon -= 8; }
-      while (expon > 0) { scale *= 10.0; expon -= 1; }
+      exponent += exp_sign * expon;
     }
-    // Return signed and scaled floating point result.
-    *out = sign * (frac ? (value / scale) : (value * scale));
+    double value;
+    if (num_digits <= kMaxExactDigits && exponent >= -kMaxExactPow10 && exponent <= kMaxExactPow10) {
+      // both operands are exact doubles, so the only rounding is the one of the operation
+      value = static_cast<double>(static_cast<int64_t>(mantissa));
+      value = exponent < 0 ? value / kExactPow10[-exponent] : value * kExactPow10[exponent];
+    } else {
+      // leading zeros are not significant
+      for (const char* q = number_begin; (*q == '0' || *q == '.') && num_digits > 0; ++q) {
+        num_digits -= *q == '0';
+      }
+      const bool is_exact_pow10 = exponent >= -kMaxExactPow10 && exponent <= kMaxExactPow10;
+      if (num_digits <= kMaxDigits && mantissa == 0) {
+        value = 0.0;
+      } else if (num_digits > kMaxDigits || !is_exact_pow10 || !MulPow10Extended(mantissa, exponent, &value)) {
+        value = std::strtod(number_begin, nullptr);
+        if (value > 1e308) { value = 1e308; }
+      }
+    }
+    // Return signed result.
+    *out = sign * value;
   } else {
     size_t cnt = 0;
     while (*(p + cnt) != '\0' && *(p + cnt) != ' '
@@ -335,6 +412,22 @@ inline static std::string Join(const std::vector<T>& strs, size_t start, size_t
   return ss.str();
 }
 
+/*!
+* \brief 64-bit FNV-1a hash of bytes
+* \param data Begin of the bytes
+* \param size Number of bytes
+* \param seed Hash of the previous bytes, to hash several pieces as one
+*/
+inline static uint64_t Hash64(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
 static inline int64_t Pow2RoundUp(int64_t x) {
   int64_t t = 1;
   for (int i = 0; i < 64; ++i) {
@@ -366,6 +459,51 @@ inline void Softmax(std::vector<double>* p_rec) {
   }
 }
 
+/*!
+* \brief Sort in parallel, blocks are sorted by threads and then merged pairwise in parallel
+* \param first Begin of the range
+* \param last End of the range
+* \param comp Comparator
+*/
+template<typename RandomIt, typename Compare>
+inline static void ParallelSort(RandomIt first, RandomIt last, Compare comp) {
+  typedef typename std::iterator_traits<RandomIt>::value_type ValueType;
+  const size_t len = static_cast<size_t>(last - first);
+  const size_t kMinBlockSize = 1024;
+  int num_threads = 1;
+#pragma omp parallel
+#pragma omp master
+  {
+    num_threads = omp_get_num_threads();
+  }
+  const size_t block_size = std::max((len + num_threads - 1) / num_threads, kMinBlockSize);
+  if (block_size >= len) {
+    std::sort(first, last, comp);
+    return;
+  }
+  const int num_blocks = static_cast<int>((len + block_size - 1) / block_size);
+#pragma omp parallel for schedule(static, 1)
+  for (int i = 0; i < num_blocks; ++i) {
+    const size_t start = block_size * i;
+    const size_t end = std::min(start + block_size, len);
+    std::sort(first + start, first + end, comp);
+  }
+  // merge sorted blocks, the left half is copied out, then merged back into the range
+  std::vector<ValueType> buf(len);
+  for (size_t sorted_size = block_size; sorted_size < len; sorted_size *= 2) {
+    const int num_merges = static_cast<int>((len + 2 * sorted_size - 1) / (2 * sorted_size));
+#pragma omp parallel for schedule(static, 1)
+    for (int i = 0; i < num_merges; ++i) {
+      const size_t left = 2 * sorted_size * i;
+      const size_t mid = left + sorted_size;
+      const size_t right = std::min(mid + sorted_size, len);
+      if (mid >= right) { continue; }
+      std::copy(first + left, first + mid, buf.begin() + left);
+      std::merge(buf.begin() + left, buf.begin() + mid, first + mid, first + right, first + left, comp);
+    }
+  }
+}
+
 template<typename T>
 std::vector<const T*> ConstPtrInVectorWrapper(const std::vector<std::unique_ptr<T>>& input) {
   std::vector<const T*> ret;
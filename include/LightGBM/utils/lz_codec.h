@@ -0,0 +1,183 @@
+#ifndef LIGHTGBM_UTILS_LZ_CODEC_H_
+#define LIGHTGBM_UTILS_LZ_CODEC_H_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace LightGBM {
+
+/*!
+* \brief Fast LZ77 block codec, similar to the LZ4 block format, used to compress sections of binary files.
+*        A block is a sequence of (token, literals, offset, match) where the high 4 bits of the token
+*        are the literal length and the low 4 bits are the match length minus kMinMatch,
+*        value 15 means more length bytes follow. The last sequence has literals only.
+*/
+class LZCodec {
+public:
+  /*!
+  * \brief Max size in byte of the compressed block of size bytes
+  * \param size Size of the input
+  */
+  static size_t MaxCompressedSize(size_t size) {
+    return size + size / 255 + 16;
+  }
+
+  /*!
+  * \brief Compress a block
+  * \param src Input
+  * \param size Size of the input
+  * \param dst Output, should have MaxCompressedSize(size) bytes
+  * \return Size of the compressed block
+  */
+  static size_t Compress(const char* src, size_t size, char* dst) {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    uint8_t* op = out;
+    size_t anchor = 0;
+    size_t pos = 0;
+    if (size > kLastLiterals + kMinMatch) {
+      // last position of each hashed 4-byte sequence, plus 1; 0 means empty
+      std::vector<size_t> table(static_cast<size_t>(1) << kHashLog, 0);
+      const size_t match_limit = size - kLastLiterals;
+      while (pos + kMinMatch <= match_limit) {
+        const uint32_t sequence = Read32(in + pos);
+        const uint32_t hash = (sequence * 2654435761U) >> (32 - kHashLog);
+        const size_t candidate = table[hash];
+        table[hash] = pos + 1;
+        if (candidate == 0 || pos + 1 - candidate > kMaxOffset || Read32(in + candidate - 1) != sequence) {
+          ++pos;
+          continue;
+        }
+        const size_t match_pos = candidate - 1;
+        size_t match_len = kMinMatch;
+        while (pos + match_len < match_limit && in[pos + match_len] == in[match_pos + match_len]) {
+          ++match_len;
+        }
+        op = WriteSequence(in + anchor, pos - anchor, pos - match_pos, match_len, op);
+        pos += match_len;
+        anchor = pos;
+      }
+    }
+    // last literals
+    op = WriteLength(size - anchor, 0, op);
+    if (size > anchor) {
+      std::memcpy(op, in + anchor, size - anchor);
+      op += size - anchor;
+    }
+    return static_cast<size_t>(op - out);
+  }
+
+  /*!
+  * \brief Decompress a block
+  * \param src Compressed block
+  * \param compressed_size Size of the compressed block
+  * \param dst Output
+  * \param size Size of the output, should be the size of the original input
+  * \return False if the block is broken
+  */
+  static bool Decompress(const char* src, size_t compressed_size, char* dst, size_t size) {
+    const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+    const uint8_t* const in_end = ip + compressed_size;
+    uint8_t* const out = reinterpret_cast<uint8_t*>(dst);
+    size_t pos = 0;
+    while (ip < in_end) {
+      const uint8_t token = *ip++;
+      // literals
+      size_t literal_len = token >> 4;
+      if (!ReadLength(&ip, in_end, &literal_len)) { return false; }
+      if (literal_len > static_cast<size_t>(in_end - ip) || literal_len > size - pos) { return false; }
+      if (literal_len > 0) {
+        std::memcpy(out + pos, ip, literal_len);
+      }
+      ip += literal_len;
+      pos += literal_len;
+      if (ip >= in_end) { break; }
+      // match
+      if (in_end - ip < 2) { return false; }
+      const size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+      ip += 2;
+      size_t match_len = token & 0xf;
+      if (!ReadLength(&ip, in_end, &match_len)) { return false; }
+      match_len += kMinMatch;
+      if (offset == 0 || offset > pos || match_len > size - pos) { return false; }
+      const uint8_t* match = out + pos - offset;
+      if (offset >= match_len) {
+        std::memcpy(out + pos, match, match_len);
+      } else {
+        // overlapped copy, repeats the last offset bytes
+        for (size_t i = 0; i < match_len; ++i) {
+          out[pos + i] = match[i];
+        }
+      }
+      pos += match_len;
+    }
+    return pos == size;
+  }
+
+private:
+  /*! \brief Min length of a match */
+  static const size_t kMinMatch = 4;
+  /*! \brief Max distance of a match */
+  static const size_t kMaxOffset = 65535;
+  /*! \brief Number of bytes at the end that are always literals */
+  static const size_t kLastLiterals = 5;
+  /*! \brief Bits of the hash table */
+  static const int kHashLog = 16;
+
+  static inline uint32_t Read32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  /*! \brief Write the token with literal length len and low 4 bits low, and the extra bytes of len */
+  static inline uint8_t* WriteLength(size_t len, uint8_t low, uint8_t* op) {
+    if (len >= 15) {
+      *op++ = static_cast<uint8_t>((15 << 4) | low);
+      len -= 15;
+      while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+      }
+      *op++ = static_cast<uint8_t>(len);
+    } else {
+      *op++ = static_cast<uint8_t>((len << 4) | low);
+    }
+    return op;
+  }
+
+  static inline uint8_t* WriteSequence(const uint8_t* literals, size_t literal_len, size_t offset, size_t match_len,
+    uint8_t* op) {
+    const size_t extra_match_len = match_len - kMinMatch;
+    op = WriteLength(literal_len, static_cast<uint8_t>(extra_match_len >= 15 ? 15 : extra_match_len), op);
+    std::memcpy(op, literals, literal_len);
+    op += literal_len;
+    *op++ = static_cast<uint8_t>(offset & 0xff);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    if (extra_match_len >= 15) {
+      size_t len = extra_match_len - 15;
+      while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+      }
+      *op++ = static_cast<uint8_t>(len);
+    }
+    return op;
+  }
+
+  /*! \brief Add the extra bytes of a length if its 4 bits are 15 */
+  static inline bool ReadLength(const uint8_t** ip, const uint8_t* in_end, size_t* len) {
+    if (*len != 15) { return true; }
+    uint8_t byte = 255;
+    while (byte == 255) {
+      if (*ip >= in_end) { return false; }
+      byte = *(*ip)++;
+      *len += byte;
+    }
+    return true;
+  }
+};
+
+}  // namespace LightGBM
+#endif   // LightGBM_UTILS_LZ_CODEC_H_
@@ -0,0 +1,129 @@
+#ifndef LIGHTGBM_UTILS_MAPPED_FILE_H_
+#define LIGHTGBM_UTILS_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace LightGBM {
+
+/*!
+* \brief Read-only memory mapped file.
+*        Pages are loaded on demand and shared with other processes mapping the same file.
+*/
+class MappedFile {
+public:
+  /*! \brief Access pattern hints for a range of the mapped file */
+  enum class Advice {
+    kNormal,
+    kSequential,
+    kRandom,
+    kWillNeed
+  };
+
+  /*!
+  * \brief Constructor, map the whole file. Check is_open() for failures
+  * \param filename Filename of the file
+  */
+  explicit MappedFile(const char* filename) {
+#ifdef _MSC_VER
+    file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE) { return; }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart <= 0) { return; }
+    mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ == NULL) { return; }
+    void* data = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) { return; }
+    data_ = reinterpret_cast<const char*>(data);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+    fd_ = open(filename, O_RDONLY);
+    if (fd_ < 0) { return; }
+    struct stat file_stat;
+    if (fstat(fd_, &file_stat) != 0 || file_stat.st_size <= 0) { return; }
+    void* data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) { return; }
+    data_ = reinterpret_cast<const char*>(data);
+    size_ = static_cast<size_t>(file_stat.st_size);
+#endif
+  }
+
+  ~MappedFile() {
+#ifdef _MSC_VER
+    if (data_ != nullptr) { UnmapViewOfFile(data_); }
+    if (mapping_ != NULL) { CloseHandle(mapping_); }
+    if (file_ != INVALID_HANDLE_VALUE) { CloseHandle(file_); }
+#else
+    if (data_ != nullptr) { munmap(const_cast<char*>(data_), size_); }
+    if (fd_ >= 0) { close(fd_); }
+#endif
+  }
+
+  /*! \brief True if the file is mapped */
+  bool is_open() const { return data_ != nullptr; }
+
+  /*! \brief Pointer to the beginning of the file */
+  const char* data() const { return data_; }
+
+  /*! \brief Size in byte of the file */
+  size_t size() const { return size_; }
+
+  /*!
+  * \brief Give the access pattern of a range to the kernel, only a hint
+  * \param offset Offset of the range
+  * \param length Length of the range
+  * \param advice Access pattern
+  */
+  void Advise(size_t offset, size_t length, Advice advice) const {
+#ifdef _MSC_VER
+    (void)offset; (void)length; (void)advice;
+#else
+    if (data_ == nullptr || offset >= size_) { return; }
+    if (length > size_ - offset) { length = size_ - offset; }
+    // madvise needs the address aligned to pages
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t aligned_offset = offset / page_size * page_size;
+    int flag = MADV_NORMAL;
+    if (advice == Advice::kSequential) {
+      flag = MADV_SEQUENTIAL;
+    } else if (advice == Advice::kRandom) {
+      flag = MADV_RANDOM;
+    } else if (advice == Advice::kWillNeed) {
+      flag = MADV_WILLNEED;
+    }
+    madvise(const_cast<char*>(data_) + aligned_offset, length + offset - aligned_offset, flag);
+#endif
+  }
+
+  /*! \brief Disable copy */
+  MappedFile& operator=(const MappedFile&) = delete;
+  /*! \brief Disable copy */
+  MappedFile(const MappedFile&) = delete;
+
+private:
+  /*! \brief Beginning of the mapped file, nullptr if not mapped */
+  const char* data_ = nullptr;
+  /*! \brief Size in byte of the file */
+  size_t size_ = 0;
+#ifdef _MSC_VER
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = NULL;
+#else
+  int fd_ = -1;
+#endif
+};
+
+}  // namespace LightGBM
+#endif   // LightGBM_UTILS_MAPPED_FILE_H_
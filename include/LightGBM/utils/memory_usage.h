@@ -0,0 +1,81 @@
+#ifndef LIGHTGBM_UTILS_MEMORY_USAGE_H_
+#define LIGHTGBM_UTILS_MEMORY_USAGE_H_
+
+#include <cstddef>
+#include <cstdio>
+
+#include <string>
+
+namespace LightGBM {
+
+/*! \brief Components of memory accounted by MemoryUsage */
+enum MemoryComponent {
+  /*! \brief Bins of features of training data */
+  kFeaturesMemory = 0,
+  /*! \brief Labels, weights, queries and initial scores of training data */
+  kMetadataMemory = 1,
+  /*! \brief Bins and metadata of validation data */
+  kValidDataMemory = 2,
+  /*! \brief Gradients and hessians, including their copies in tree learners, and bagging indices */
+  kGradientsMemory = 3,
+  /*! \brief Scores of training and validation data */
+  kScoresMemory = 4,
+  /*! \brief Cached histograms of tree learners */
+  kHistogramsMemory = 5,
+  /*! \brief Other buffers of tree learners, e.g. data partitions, ordered bins and thread local buffers */
+  kTreeLearnerMemory = 6,
+  /*! \brief Trained trees */
+  kModelsMemory = 7,
+  kNumMemoryComponents = 8
+};
+
+/*!
+* \brief Memory in byte used by each component of training. Sizes are counted from the buffers,
+*        small objects and the overhead of allocators are not included
+*/
+struct MemoryUsage {
+public:
+  /*! \brief Bytes of each component */
+  size_t bytes[kNumMemoryComponents];
+
+  MemoryUsage() {
+    for (int i = 0; i < kNumMemoryComponents; ++i) {
+      bytes[i] = 0;
+    }
+  }
+
+  /*! \brief Add bytes to a component */
+  inline void Add(MemoryComponent component, size_t size) {
+    bytes[component] += size;
+  }
+
+  /*! \brief Total bytes of all components */
+  inline size_t Total() const {
+    size_t ret = 0;
+    for (int i = 0; i < kNumMemoryComponents; ++i) {
+      ret += bytes[i];
+    }
+    return ret;
+  }
+
+  /*! \brief Breakdown in MB for logs, e.g. "total 10.50 MB (features 8.00 MB, ...)", empty components are left out */
+  std::string ToString() const {
+    static const char* component_names[kNumMemoryComponents] = { "features", "metadata", "validation data",
+      "gradients", "scores", "histograms", "tree learner", "models" };
+    char buf[128];
+    snprintf(buf, sizeof(buf), "total %.2f MB (", Total() / 1024.0 / 1024.0);
+    std::string str(buf);
+    bool is_first = true;
+    for (int i = 0; i < kNumMemoryComponents; ++i) {
+      if (bytes[i] == 0) { continue; }
+      snprintf(buf, sizeof(buf), "%s%s %.2f MB", is_first ? "" : ", ", component_names[i], bytes[i] / 1024.0 / 1024.0);
+      str += buf;
+      is_first = false;
+    }
+    return str + ")";
+  }
+};
+
+}  // namespace LightGBM
+
+#endif   // LIGHTGBM_UTILS_MEMORY_USAGE_H_
@@ -0,0 +1,181 @@
+#ifndef LIGHTGBM_UTILS_NUMA_H_
+#define LIGHTGBM_UTILS_NUMA_H_
+
+#include <LightGBM/utils/common.h>
+
+#include <omp.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <cstdio>
+#include <cstdint>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace LightGBM {
+
+/*!
+* \brief NUMA topology, thread pinning and node-affine parallel loops.
+*        Threads of OpenMP are sharded to nodes in contiguous blocks of thread ids, and indices (e.g. features)
+*        in contiguous ranges. Linux places memory on the node of the thread that first touches it,
+*        so memory allocated and initialized in Numa::For is local to the threads that use it in later Numa::For.
+*        Topology is read from sysfs, only supported on Linux
+*/
+class Numa {
+public:
+  /*! \brief Number of online NUMA nodes of this machine, 1 if unknown */
+  static int NumNodes() {
+    const size_t num_nodes = OnlineNodes().size();
+    return num_nodes > 0 ? static_cast<int>(num_nodes) : 1;
+  }
+
+  /*!
+  * \brief CPUs of a node
+  * \param node Index of the node in the online nodes
+  * \return CPU ids, empty if unknown
+  */
+  static std::vector<int> NodeCpus(int node) {
+    const std::vector<int> nodes = OnlineNodes();
+    if (node < 0 || node >= static_cast<int>(nodes.size())) {
+      return std::vector<int>();
+    }
+    return ParseList(ReadLine("/sys/devices/system/node/node" + std::to_string(nodes[node]) + "/cpulist"));
+  }
+
+  /*! \brief Node of thread tid when num_threads threads are sharded to num_nodes nodes */
+  static inline int NodeOfThread(int tid, int num_threads, int num_nodes) {
+    return static_cast<int>(static_cast<int64_t>(tid) * num_nodes / num_threads);
+  }
+
+  /*!
+  * \brief Pin threads of OpenMP to the CPUs of their nodes, the same threads are reused by later parallel regions
+  *        of the same number of threads. If num_nodes is more than the nodes of this machine, nodes are reused in turn
+  * \param num_nodes Number of nodes to shard threads to
+  * \return False if pinning is not supported or failed
+  */
+  static bool PinThreads(int num_nodes) {
+#ifdef __linux__
+    const int num_machine_nodes = NumNodes();
+    std::vector<std::vector<int>> node_cpus(num_machine_nodes);
+    for (int i = 0; i < num_machine_nodes; ++i) {
+      node_cpus[i] = NodeCpus(i);
+      if (node_cpus[i].empty()) { return false; }
+    }
+    bool is_pinned = true;
+    #pragma omp parallel reduction(&&:is_pinned)
+    {
+      const int node = NodeOfThread(omp_get_thread_num(), omp_get_num_threads(), num_nodes) % num_machine_nodes;
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      for (int cpu : node_cpus[node]) {
+        if (cpu < CPU_SETSIZE) { CPU_SET(cpu, &cpu_set); }
+      }
+      is_pinned = sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+    }
+    return is_pinned;
+#else
+    (void)num_nodes;
+    return false;
+#endif
+  }
+
+  /*!
+  * \brief Shard indices to nodes in contiguous ranges of about equal total weight
+  * \param weights Weight of each index, e.g. its bytes of memory
+  * \param num_nodes Number of nodes
+  * \return Begin of the range of each node, with the end of the last node, so num_nodes + 1 values
+  */
+  static std::vector<int> Shard(const std::vector<size_t>& weights, int num_nodes) {
+    double total_weight = 0.0f;
+    for (size_t weight : weights) { total_weight += static_cast<double>(weight); }
+    std::vector<int> node_begin(num_nodes + 1, static_cast<int>(weights.size()));
+    node_begin[0] = 0;
+    double cur_weight = 0.0f;
+    int node = 1;
+    for (int i = 0; i < static_cast<int>(weights.size()) && node < num_nodes; ++i) {
+      while (node < num_nodes && cur_weight >= total_weight * node / num_nodes) {
+        node_begin[node++] = i;
+      }
+      cur_weight += static_cast<double>(weights[i]);
+    }
+    return node_begin;
+  }
+
+  /*!
+  * \brief Parallel loop of fun(i) for all indices of the nodes, indices of a node are taken by threads of that node
+  *        one by one, then threads help the other nodes when their node is done. So it works for any number of threads
+  * \param node_begin Ranges of indices of nodes, the output of Shard
+  * \param inner_fun Function of an index
+  */
+  static void For(const std::vector<int>& node_begin, const std::function<void(int)>& inner_fun) {
+    const int num_nodes = static_cast<int>(node_begin.size()) - 1;
+    std::unique_ptr<std::atomic<int>[]> next(new std::atomic<int>[num_nodes]);
+    for (int i = 0; i < num_nodes; ++i) {
+      next[i].store(node_begin[i]);
+    }
+    #pragma omp parallel
+    {
+      const int node = NodeOfThread(omp_get_thread_num(), omp_get_num_threads(), num_nodes);
+      for (int k = 0; k < num_nodes; ++k) {
+        const int cur_node = (node + k) % num_nodes;
+        for (int i = next[cur_node]++; i < node_begin[cur_node + 1]; i = next[cur_node]++) {
+          inner_fun(i);
+        }
+      }
+    }
+  }
+
+private:
+  /*! \brief Ids of online nodes */
+  static std::vector<int> OnlineNodes() {
+    return ParseList(ReadLine("/sys/devices/system/node/online"));
+  }
+
+  /*! \brief Parse a list in the format of sysfs, e.g. 0-3,8,10-11 */
+  static std::vector<int> ParseList(const std::string& str) {
+    std::vector<int> ret;
+    for (const std::string& range : Common::Split(str.c_str(), ',')) {
+      std::vector<std::string> bounds = Common::Split(range.c_str(), '-');
+      if (bounds[0].empty()) { continue; }
+      int begin = 0;
+      Common::Atoi(bounds[0].c_str(), &begin);
+      int end = begin;
+      if (bounds.size() > 1) {
+        Common::Atoi(bounds[1].c_str(), &end);
+      }
+      for (int i = begin; i <= end; ++i) {
+        ret.push_back(i);
+      }
+    }
+    return ret;
+  }
+
+  /*! \brief First line of a file, empty if failed */
+  static std::string ReadLine(const std::string& filename) {
+    std::string ret;
+    FILE* file = nullptr;
+#ifdef _MSC_VER
+    fopen_s(&file, filename.c_str(), "r");
+#else
+    file = fopen(filename.c_str(), "r");
+#endif
+    if (file == nullptr) { return ret; }
+    char buf[1024];
+    if (fgets(buf, sizeof(buf), file) != nullptr) {
+      ret = buf;
+      Common::Trim(ret);
+    }
+    fclose(file);
+    return ret;
+  }
+};
+
+}  // namespace LightGBM
+
+#endif   // LightGBM_UTILS_NUMA_H_
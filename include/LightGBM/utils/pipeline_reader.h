@@ -4,11 +4,14 @@
 #include <LightGBM/utils/log.h>
 
 #include <cstdio>
+#include <cstdint>
 
 #include <functional>
 #include <thread>
 #include <memory>
 #include <algorithm>
+#include <limits>
+#include <vector>
 
 namespace LightGBM{
 
@@ -20,9 +23,12 @@ public:
   /*!
   * \brief Read data from a file, use pipeline methods
   * \param filename Filename of data
-  * \process_fun Process function
+  * \param skip_bytes Number of bytes to skip at the beginning of the file
+  * \process_fun Process function, the block can be modified in place
+  * \param max_bytes Max number of bytes to read after the skipped bytes
   */
-  static size_t Read(const char* filename, int skip_bytes, const std::function<size_t (const char*, size_t)>& process_fun) {
+  static size_t Read(const char* filename, size_t skip_bytes, const std::function<size_t (char*, size_t)>& process_fun,
+    size_t max_bytes = std::numeric_limits<size_t>::max()) {
     FILE* file;
 
 #ifdef _MSC_VER
@@ -39,19 +45,20 @@ public:
     auto buffer_process = std::vector<char>(buffer_size);
     // buffer used for the file reading
     auto buffer_read = std::vector<char>(buffer_size);
-    size_t read_cnt = 0;
     if (skip_bytes > 0) {
       // skip first k bytes
-      read_cnt = fread(buffer_process.data(), 1, skip_bytes, file);
+      Seek(file, skip_bytes);
     }
+    size_t rest_bytes = max_bytes;
     // read first block
-    read_cnt = fread(buffer_process.data(), 1, buffer_size, file);
+    size_t read_cnt = fread(buffer_process.data(), 1, std::min(buffer_size, rest_bytes), file);
+    rest_bytes -= read_cnt;
     size_t last_read_cnt = 0;
     while (read_cnt > 0) {
       // strat read thread
       std::thread read_worker = std::thread(
-        [file, &buffer_read, buffer_size, &last_read_cnt] {
-        last_read_cnt = fread(buffer_read.data(), 1, buffer_size, file);
+        [file, &buffer_read, buffer_size, &last_read_cnt, rest_bytes] {
+        last_read_cnt = fread(buffer_read.data(), 1, std::min(buffer_size, rest_bytes), file);
       }
       );
       // start process
@@ -61,12 +68,52 @@ public:
       // exchange the buffer
       std::swap(buffer_process, buffer_read);
       read_cnt = last_read_cnt;
+      rest_bytes -= read_cnt;
     }
     // close file
     fclose(file);
     return cnt;
   }
 
+  /*!
+  * \brief Seek to an absolute position of a file, positions can be larger than 2GB
+  * \param file File
+  * \param pos Position
+  */
+  static void Seek(FILE* file, size_t pos) {
+#ifdef _MSC_VER
+    _fseeki64(file, static_cast<int64_t>(pos), SEEK_SET);
+#else
+    fseeko(file, static_cast<off_t>(pos), SEEK_SET);
+#endif
+  }
+
+  /*!
+  * \brief Get size in bytes of a file
+  * \param filename Filename
+  * \return Size of the file, 0 if the file cannot be opened
+  */
+  static size_t FileSize(const char* filename) {
+    FILE* file;
+#ifdef _MSC_VER
+    fopen_s(&file, filename, "rb");
+#else
+    file = fopen(filename, "rb");
+#endif
+    if (file == NULL) {
+      return 0;
+    }
+#ifdef _MSC_VER
+    _fseeki64(file, 0, SEEK_END);
+    const size_t size = static_cast<size_t>(_ftelli64(file));
+#else
+    fseeko(file, 0, SEEK_END);
+    const size_t size = static_cast<size_t>(ftello(file));
+#endif
+    fclose(file);
+    return size;
+  }
+
 };
 
 }  // namespace LightGBM
@@ -0,0 +1,87 @@
+#ifndef LIGHTGBM_UTILS_PIPELINE_WRITER_H_
+#define LIGHTGBM_UTILS_PIPELINE_WRITER_H_
+
+#include <cstdio>
+#include <cstring>
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace LightGBM {
+
+/*!
+* \brief A pipeline file writer, blocks are written by another thread while the next block is produced.
+*        Buffers are exchanged with the caller, so their memory is reused and writing doesn't allocate
+*/
+class PipelineWriter {
+public:
+  /*!
+  * \brief Constructor
+  * \param file File to write, should be kept open until this object is destroyed
+  */
+  explicit PipelineWriter(FILE* file) : file_(file) {
+  }
+
+  /*! \brief Destructor, waits for the last block */
+  ~PipelineWriter() {
+    Wait();
+  }
+
+  /*!
+  * \brief Write a block in background, buffers are written in order. Waits for the previous block first
+  * \param buffers Buffers of the block, exchanged with the buffers of the previous block,
+  *        which are cleared with their capacities kept, and resized to the same number of buffers
+  */
+  void Write(std::vector<std::vector<char>>* buffers) {
+    Wait();
+    const size_t num_buffers = buffers->size();
+    std::swap(buffers_, *buffers);
+    buffers->resize(num_buffers);
+    for (auto& buffer : *buffers) {
+      buffer.clear();
+    }
+    worker_ = std::thread([this] {
+      for (const auto& buffer : buffers_) {
+        if (!buffer.empty()) {
+          fwrite(buffer.data(), sizeof(char), buffer.size(), file_);
+        }
+      }
+    });
+  }
+
+  /*! \brief Wait for the block that is being written */
+  void Wait() {
+    if (worker_.joinable()) {
+      worker_.join();
+    }
+  }
+
+  /*!
+  * \brief Append a value to buffer, in the same format as std::ostream, which is "%g"
+  * \param value Value
+  * \param buffer Output buffer
+  */
+  static inline void AppendValue(double value, std::vector<char>* buffer) {
+    char str[32];
+    const int len = snprintf(str, sizeof(str), "%g", value);
+    buffer->insert(buffer->end(), str, str + std::max(len, 0));
+  }
+
+  /*! \brief Disable copy */
+  PipelineWriter& operator=(const PipelineWriter&) = delete;
+  /*! \brief Disable copy */
+  PipelineWriter(const PipelineWriter&) = delete;
+
+private:
+  /*! \brief File to write */
+  FILE* file_;
+  /*! \brief Buffers of the block that is being written */
+  std::vector<std::vector<char>> buffers_;
+  /*! \brief Thread that writes the block */
+  std::thread worker_;
+};
+
+}  // namespace LightGBM
+
+#endif   // LIGHTGBM_UTILS_PIPELINE_WRITER_H_
@@ -0,0 +1,169 @@
+#ifndef LIGHTGBM_UTILS_PROFILER_H_
+#define LIGHTGBM_UTILS_PROFILER_H_
+
+#include <LightGBM/utils/log.h>
+
+#include <omp.h>
+
+#include <cstdint>
+#include <cstdio>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace LightGBM {
+
+/*! \brief Phases of training measured by Profiler */
+enum ProfilePhase {
+  kBeforeTrainProfile = 0,
+  kConstructHistogramsProfile = 1,
+  kFindBestThresholdsProfile = 2,
+  kSplitProfile = 3,
+  kAddScoreProfile = 4,
+  kGetGradientsProfile = 5,
+  kBaggingProfile = 6,
+  kMetricProfile = 7,
+  kNumProfilePhases = 8
+};
+
+/*! \brief Accumulated statistics of a phase */
+struct ProfileStats {
+  /*! \brief Number of measured scopes */
+  int64_t calls = 0;
+  /*! \brief Time in ms */
+  double time_ms = 0.0;
+};
+
+/*!
+* \brief A static profiler of the hot paths of training, counts calls and time per phase.
+*        Times of scopes inside parallel regions are divided by the number of threads of the region,
+*        so they approximate their share of the wall time. Find best thresholds includes the histograms
+*        constructed feature by feature. Boosters of the process share the statistics, and scopes are measured
+*        while any booster enables the profiler, is_enable_profiler is on by default if built with USE_PROFILER
+*/
+class Profiler {
+public:
+  /*! \brief Whether scopes are measured */
+  static inline bool IsEnabled() {
+    return NumUsersRef().load(std::memory_order_relaxed) > 0;
+  }
+
+  /*! \brief Enable the profiler for one user (e.g. a booster) until it calls Disable, thread safe */
+  static void Enable() {
+    NumUsersRef().fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /*! \brief Release an Enable, the profiler is disabled when no user enables it, thread safe */
+  static void Disable() {
+    NumUsersRef().fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /*!
+  * \brief Add a measured scope to a phase, thread safe
+  * \param phase Phase of the scope
+  * \param ns Time in nanoseconds
+  */
+  static inline void Add(ProfilePhase phase, int64_t ns) {
+    Counters& counters = GetCounters();
+    counters.calls[phase].fetch_add(1, std::memory_order_relaxed);
+    counters.ns[phase].fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  /*! \brief Statistics of all phases since the process started or the last Reset */
+  static std::vector<ProfileStats> Stats() {
+    Counters& counters = GetCounters();
+    std::vector<ProfileStats> stats(kNumProfilePhases);
+    for (int i = 0; i < kNumProfilePhases; ++i) {
+      stats[i].calls = counters.calls[i].load(std::memory_order_relaxed);
+      stats[i].time_ms = counters.ns[i].load(std::memory_order_relaxed) * 1e-6;
+    }
+    return stats;
+  }
+
+  /*! \brief Clear statistics of all phases */
+  static void Reset() {
+    std::lock_guard<std::mutex> lock(GetLoggedStatsMutex());
+    Counters& counters = GetCounters();
+    for (int i = 0; i < kNumProfilePhases; ++i) {
+      counters.calls[i].store(0, std::memory_order_relaxed);
+      counters.ns[i].store(0, std::memory_order_relaxed);
+    }
+    GetLoggedStats().clear();
+  }
+
+  /*!
+  * \brief Log the statistics of the phases measured since the last call, one line per iteration. Thread safe,
+  *        but boosters trained at the same time share the statistics, so a line may include phases of others
+  * \param iter Finished iteration
+  */
+  static void LogStats(int iter) {
+    static const char* phase_names[kNumProfilePhases] = { "before train", "construct histograms",
+      "find best thresholds", "split", "add score", "get gradients", "bagging", "metric" };
+    std::lock_guard<std::mutex> lock(GetLoggedStatsMutex());
+    std::vector<ProfileStats> stats = Stats();
+    std::vector<ProfileStats>& logged_stats = GetLoggedStats();
+    logged_stats.resize(kNumProfilePhases);
+    std::string str;
+    char buf[128];
+    for (int i = 0; i < kNumProfilePhases; ++i) {
+      const int64_t calls = stats[i].calls - logged_stats[i].calls;
+      if (calls <= 0) { continue; }
+      snprintf(buf, sizeof(buf), "%s%s %.3f ms (%lld)", str.empty() ? "" : ", ", phase_names[i],
+               stats[i].time_ms - logged_stats[i].time_ms, static_cast<long long>(calls));
+      str += buf;
+    }
+    logged_stats = stats;
+    if (!str.empty()) {
+      Log::Info("Profile of iteration %d: %s", iter, str.c_str());
+    }
+  }
+
+private:
+  struct Counters {
+    std::atomic<int64_t> calls[kNumProfilePhases];
+    std::atomic<int64_t> ns[kNumProfilePhases];
+  };
+
+  // the same trick as Log to use static variables in header file
+  static std::atomic<int>& NumUsersRef() { static std::atomic<int> num_users(0); return num_users; }
+  static Counters& GetCounters() { static Counters counters; return counters; }
+  static std::vector<ProfileStats>& GetLoggedStats() { static std::vector<ProfileStats> stats; return stats; }
+  static std::mutex& GetLoggedStatsMutex() { static std::mutex mutex; return mutex; }
+};
+
+/*! \brief Measures the time from its construction to its destruction into a phase, if the profiler is enabled */
+class ProfileScope {
+public:
+  explicit ProfileScope(ProfilePhase phase) : phase_(phase), is_enabled_(Profiler::IsEnabled()) {
+    if (is_enabled_) {
+      start_time_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ProfileScope() {
+    if (!is_enabled_) { return; }
+    const auto end_time = std::chrono::steady_clock::now();
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time_).count();
+    if (omp_in_parallel()) {
+      ns /= omp_get_num_threads();
+    }
+    Profiler::Add(phase_, ns);
+  }
+
+  /*! \brief Disable copy */
+  ProfileScope& operator=(const ProfileScope&) = delete;
+  /*! \brief Disable copy */
+  ProfileScope(const ProfileScope&) = delete;
+
+private:
+  ProfilePhase phase_;
+  bool is_enabled_;
+  std::chrono::steady_clock::time_point start_time_;
+};
+
+}  // namespace LightGBM
+
+#endif   // LightGBM_UTILS_PROFILER_H_
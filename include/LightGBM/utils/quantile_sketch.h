@@ -0,0 +1,221 @@
+#ifndef LIGHTGBM_UTILS_QUANTILE_SKETCH_H_
+#define LIGHTGBM_UTILS_QUANTILE_SKETCH_H_
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace LightGBM {
+
+/*!
+* \brief Quantile sketch of a stream of values with bounded memory.
+*        Values are buffered, then kept as sorted summaries of (value, count) in levels,
+*        two summaries in the same level are merged and pruned into the next level.
+*        Pruning merges neighbouring values into groups of about 1 / sketch_size of the total count,
+*        values whose counts are larger than that are kept exactly. So the rank error is bounded by
+*        about log2(n / sketch_size) / sketch_size of the total count, and the summary is exact
+*        if there are no more than sketch_size distinct values.
+*        Pruned summaries have bounded sizes, so sketches can be serialized into fixed-size buffers and merged by reducers.
+*/
+class QuantileSketch {
+public:
+  /*! \brief Sorted (value, count) pairs with distinct values */
+  typedef std::vector<std::pair<double, int>> Summary;
+
+  /*!
+  * \brief Constructor
+  * \param sketch_size Number of values kept in a summary after pruning
+  */
+  explicit QuantileSketch(int sketch_size)
+    :sketch_size_(std::max(sketch_size, 2)) {
+  }
+
+  /*!
+  * \brief Push one value
+  * \param value Value
+  */
+  inline void Push(double value) {
+    buffer_.push_back(value);
+    if (static_cast<int>(buffer_.size()) >= sketch_size_) {
+      FlushBuffer();
+    }
+  }
+
+  /*!
+  * \brief Get the merged summary of all pushed values, values that are pruned together are represented by the largest one
+  * \param out Output summary
+  */
+  void GetSummary(Summary* out) const {
+    *out = SortBuffer();
+    for (const auto& summary : levels_) {
+      if (!summary.empty()) {
+        *out = Merge(*out, summary);
+      }
+    }
+  }
+
+  /*!
+  * \brief Sizes in byte of a serialized sketch, the same for sketches with the same sketch_size
+  * \param sketch_size Number of values kept in a summary after pruning
+  */
+  static int SizeForSpecificSize(int sketch_size) {
+    return static_cast<int>(sizeof(int) + MaxNumEntries(std::max(sketch_size, 2)) * (sizeof(double) + sizeof(int)));
+  }
+
+  /*!
+  * \brief Serialize the pruned summary of this sketch to buffer
+  * \param buffer The destination, should have SizeForSpecificSize(sketch_size) bytes
+  */
+  void CopyTo(char* buffer) const {
+    Summary summary;
+    GetSummary(&summary);
+    summary = Prune(summary);
+    const int num_entries = static_cast<int>(summary.size());
+    std::memcpy(buffer, &num_entries, sizeof(num_entries));
+    buffer += sizeof(num_entries);
+    for (const auto& entry : summary) {
+      std::memcpy(buffer, &entry.first, sizeof(entry.first));
+      buffer += sizeof(entry.first);
+      std::memcpy(buffer, &entry.second, sizeof(entry.second));
+      buffer += sizeof(entry.second);
+    }
+  }
+
+  /*!
+  * \brief Deserialize a summary from buffer, replacing the pushed values
+  * \param buffer The source
+  */
+  void CopyFrom(const char* buffer) {
+    buffer_.clear();
+    levels_.assign(1, ReadSummary(buffer));
+  }
+
+  /*!
+  * \brief Merge a serialized summary from buffer into this sketch
+  * \param buffer The source
+  */
+  void MergeFrom(const char* buffer) {
+    Summary summary;
+    GetSummary(&summary);
+    buffer_.clear();
+    levels_.assign(1, Merge(summary, ReadSummary(buffer)));
+  }
+
+private:
+  /*!
+  * \brief Max number of entries after pruning. Each entry is either a value or a group with at least
+  *        1 / sketch_size of the total count, or a smaller group closed before such a value or zero
+  */
+  static int MaxNumEntries(int sketch_size) {
+    return sketch_size * 2 + 2;
+  }
+
+  /*! \brief Read a serialized summary */
+  static Summary ReadSummary(const char* buffer) {
+    int num_entries = 0;
+    std::memcpy(&num_entries, buffer, sizeof(num_entries));
+    buffer += sizeof(num_entries);
+    Summary summary(num_entries);
+    for (int i = 0; i < num_entries; ++i) {
+      std::memcpy(&summary[i].first, buffer, sizeof(summary[i].first));
+      buffer += sizeof(summary[i].first);
+      std::memcpy(&summary[i].second, buffer, sizeof(summary[i].second));
+      buffer += sizeof(summary[i].second);
+    }
+    return summary;
+  }
+
+  /*! \brief Sort the buffer into a summary */
+  Summary SortBuffer() const {
+    std::vector<double> values(buffer_);
+    std::sort(values.begin(), values.end());
+    Summary out;
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (out.empty() || out.back().first != values[i]) {
+        out.emplace_back(values[i], 1);
+      } else {
+        ++out.back().second;
+      }
+    }
+    return out;
+  }
+
+  /*! \brief Move the buffer into levels, carrying merged summaries to the upper levels */
+  void FlushBuffer() {
+    Summary summary = SortBuffer();
+    buffer_.clear();
+    size_t level = 0;
+    while (level < levels_.size() && !levels_[level].empty()) {
+      summary = Prune(Merge(levels_[level], summary));
+      levels_[level].clear();
+      ++level;
+    }
+    if (level >= levels_.size()) {
+      levels_.emplace_back();
+    }
+    levels_[level] = std::move(summary);
+  }
+
+  /*! \brief Merge two summaries */
+  static Summary Merge(const Summary& a, const Summary& b) {
+    Summary out;
+    out.reserve(a.size() + b.size());
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+      if (j >= b.size() || (i < a.size() && a[i].first < b[j].first)) {
+        out.push_back(a[i++]);
+      } else if (i >= a.size() || b[j].first < a[i].first) {
+        out.push_back(b[j++]);
+      } else {
+        out.emplace_back(a[i].first, a[i].second + b[j].second);
+        ++i; ++j;
+      }
+    }
+    return out;
+  }
+
+  /*! \brief Prune a summary to about sketch_size_ groups, groups never cross zero */
+  Summary Prune(const Summary& summary) const {
+    if (static_cast<int>(summary.size()) <= sketch_size_) {
+      return summary;
+    }
+    double total_cnt = 0.0f;
+    for (const auto& entry : summary) {
+      total_cnt += entry.second;
+    }
+    const double group_cnt = total_cnt / sketch_size_;
+    Summary out;
+    std::pair<double, int> group(0.0f, 0);
+    for (const auto& entry : summary) {
+      if (group.second > 0 && (entry.second >= group_cnt || (group.first < 0.0f && entry.first > 0.0f))) {
+        out.push_back(group);
+        group.second = 0;
+      }
+      if (entry.second >= group_cnt) {
+        out.push_back(entry);
+        continue;
+      }
+      group.first = entry.first;
+      group.second += entry.second;
+      if (group.second >= group_cnt) {
+        out.push_back(group);
+        group.second = 0;
+      }
+    }
+    if (group.second > 0) {
+      out.push_back(group);
+    }
+    return out;
+  }
+
+  /*! \brief Number of values kept in a summary after pruning */
+  int sketch_size_;
+  /*! \brief Values not put into summaries yet */
+  std::vector<double> buffer_;
+  /*! \brief Summary of levels_[i] has about 2^i * sketch_size_ values, empty if not used */
+  std::vector<Summary> levels_;
+};
+
+}  // namespace LightGBM
+#endif   // LightGBM_UTILS_QUANTILE_SKETCH_H_
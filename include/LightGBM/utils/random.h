@@ -4,6 +4,8 @@
 #include <cstdint>
 
 #include <random>
+#include <sstream>
+#include <string>
 #include <vector>
 
 namespace LightGBM {
@@ -47,6 +49,13 @@ public:
     return distribution_zero_to_one_(generator_);
   }
   /*!
+  * \brief Generate raw random bits, cheaper than NextInt and NextDouble
+  * \return The random unsigned integer between [0, 2^32)
+  */
+  inline uint32_t NextUInt32() {
+    return static_cast<uint32_t>(generator_());
+  }
+  /*!
   * \brief Sample K data from {0,1,...,N-1}
   * \param N
   * \param K
@@ -65,6 +74,23 @@ public:
     }
     return ret;
   }
+  /*!
+  * \brief Get the state of the generator, in the text format of std::mt19937
+  * \return State of the generator
+  */
+  inline std::string GetState() const {
+    std::stringstream ss;
+    ss << generator_;
+    return ss.str();
+  }
+  /*!
+  * \brief Restore the state of the generator, the following numbers are the same as the generator that is saved
+  * \param state State from GetState
+  */
+  inline void SetState(const std::string& state) {
+    std::stringstream ss(state);
+    ss >> generator_;
+  }
 private:
   /*! \brief Random generator */
   std::mt19937 generator_;
@@ -4,13 +4,19 @@
 #include <LightGBM/utils/pipeline_reader.h>
 #include <LightGBM/utils/log.h>
 #include <LightGBM/utils/random.h>
+#include <LightGBM/utils/tokenizer.h>
+
+#include <omp.h>
 
 #include <cstdio>
+#include <cstring>
 #include <sstream>
 
 #include <vector>
 #include <string>
 #include <functional>
+#include <algorithm>
+#include <limits>
 
 namespace LightGBM {
 
@@ -81,6 +87,57 @@ public:
   inline std::string first_line() {
     return first_line_;
   }
+  /*!
+  * \brief Only read the lines that begin in bytes [start, end) of the file.
+  *        Both ends are moved forward to the beginnings of lines, so ranges that split a file are read by exactly one reader
+  * \param start Start position
+  * \param end End position, can be larger than the file size
+  */
+  void SetByteRange(size_t start, size_t end) {
+    const size_t file_size = PipelineReader::FileSize(filename_);
+    range_start_ = AlignToLine(start, file_size);
+    range_end_ = std::max(range_start_, AlignToLine(end, file_size));
+  }
+  /*! \brief Start position of the read bytes */
+  inline size_t range_start() const { return std::max(range_start_, static_cast<size_t>(skip_bytes_)); }
+  /*! \brief End position of the read bytes */
+  inline size_t range_end() const { return range_end_; }
+
+  /*!
+  * \brief Find the position after some lines
+  * \param start Beginning of the first line
+  * \param num_lines Number of lines to skip, empty lines are not counted
+  * \return Beginning of the line after the skipped lines, or the file size if there are not enough lines
+  */
+  size_t SkipLines(size_t start, INDEX_T num_lines) const {
+    FILE* file;
+#ifdef _MSC_VER
+    fopen_s(&file, filename_, "rb");
+#else
+    file = fopen(filename_, "rb");
+#endif
+    if (file == NULL) {
+      Log::Fatal("Could not open %s", filename_);
+    }
+    PipelineReader::Seek(file, start);
+    size_t pos = start;
+    bool is_in_line = false;
+    int read_c = fgetc(file);
+    while (read_c != EOF) {
+      const bool is_end_of_line = IsEndOfLine(static_cast<char>(read_c));
+      if (!is_end_of_line && !is_in_line) {
+        // beginning of a new line
+        if (num_lines <= 0) { break; }
+        --num_lines;
+      }
+      is_in_line = !is_end_of_line;
+      ++pos;
+      read_c = fgetc(file);
+    }
+    fclose(file);
+    return pos;
+  }
+
   /*!
   * \brief Get text data that read from file
   * \return Text data, store in std::vector by line
@@ -90,7 +147,7 @@ public:
   INDEX_T ReadAllAndProcess(const std::function<void(INDEX_T, const char*, size_t)>& process_fun) {
     last_line_ = "";
     INDEX_T total_cnt = 0;
-    PipelineReader::Read(filename_, skip_bytes_,
+    ReadRange(
       [this, &total_cnt, &process_fun]
     (const char* buffer_process, size_t read_cnt) {
       size_t cnt = 0;
@@ -119,7 +176,7 @@ public:
           last_i = i;
         }
         else {
-          ++i;
+          i = Tokenizer::FindEndOfLine(buffer_process + i, buffer_process + read_cnt) - buffer_process;
         }
       }
       if (last_i != read_cnt) {
@@ -214,64 +271,101 @@ public:
     });
   }
 
-  INDEX_T ReadAllAndProcessParallelWithFilter(const std::function<void(INDEX_T, const std::vector<std::string>&)>& process_fun, const std::function<bool(INDEX_T,INDEX_T)>& filter_fun) {
+  /*!
+  * \brief Read text data and process it block by block, lines are found by all threads and processed in place.
+  *        End of lines in the block are replaced by '\0', so lines can be parsed from the block without copy.
+  * \param process_fun Process function, called with the index of the first used line and the used lines of one block
+  * \param filter_fun Filter function, called with the number of used lines and the number of lines before current line
+  * \return Number of lines in the file
+  */
+  INDEX_T ReadAllAndProcessParallelWithFilter(const std::function<void(INDEX_T, const std::vector<const char*>&)>& process_fun,
+    const std::function<bool(INDEX_T, INDEX_T)>& filter_fun) {
     last_line_ = "";
     INDEX_T total_cnt = 0;
     INDEX_T used_cnt = 0;
-    PipelineReader::Read(filename_, skip_bytes_,
-      [this, &total_cnt, &process_fun,&used_cnt, &filter_fun]
-    (const char* buffer_process, size_t read_cnt) {
-      size_t cnt = 0;
-      size_t i = 0;
-      size_t last_i = 0;
-      INDEX_T start_idx = used_cnt;
-      // skip the break between \r and \n
-      if (last_line_.size() == 0 && buffer_process[0] == '\n') {
-        i = 1;
-        last_i = i;
+    const int num_threads = omp_get_max_threads();
+    std::vector<std::vector<const char*>> thread_lines(num_threads);
+    std::vector<const char*> lines;
+    // the line continued from the previous block
+    std::string head_line;
+    ReadRange(
+      [this, &total_cnt, &process_fun, &used_cnt, &filter_fun, num_threads, &thread_lines, &lines, &head_line]
+    (char* buffer_process, size_t read_cnt) -> size_t {
+      const size_t chunk_size = (read_cnt + num_threads - 1) / num_threads;
+      // the chars before chunks, read before the end of lines are replaced
+      std::vector<char> prev_chars(num_threads, '\n');
+      for (int tid = 1; tid < num_threads; ++tid) {
+        const size_t start = tid * chunk_size;
+        if (start < read_cnt) { prev_chars[tid] = buffer_process[start - 1]; }
       }
-      while (i < read_cnt) {
-        if (buffer_process[i] == '\n' || buffer_process[i] == '\r') {
-          if (last_line_.size() > 0) {
-            last_line_.append(buffer_process + last_i, i - last_i);
-            if (filter_fun(used_cnt, total_cnt)) {
-              lines_.push_back(last_line_);
-              ++used_cnt;
+      #pragma omp parallel for schedule(static, 1)
+      for (int tid = 0; tid < num_threads; ++tid) {
+        thread_lines[tid].clear();
+        const size_t start = std::min(tid * chunk_size, read_cnt);
+        const size_t end = std::min(start + chunk_size, read_cnt);
+        bool is_prev_end_of_line = IsEndOfLine(prev_chars[tid]);
+        size_t i = start;
+        while (i < end) {
+          if (is_prev_end_of_line) {
+            while (i < end && IsEndOfLine(buffer_process[i])) {
+              buffer_process[i] = '\0';
+              ++i;
             }
-            last_line_ = "";
+            if (i >= end) { break; }
+            thread_lines[tid].push_back(buffer_process + i);
           }
-          else {
-            if (filter_fun(used_cnt, total_cnt)) {
-              lines_.emplace_back(buffer_process + last_i, i - last_i);
-              ++used_cnt;
-            }
-          }
-          ++cnt;
-          ++i;
-          ++total_cnt;
-          // skip end of line
-          while ((buffer_process[i] == '\n' || buffer_process[i] == '\r') && i < read_cnt) { ++i; }
-          last_i = i;
+          // jump to the end of current line
+          i = Tokenizer::FindEndOfLine(buffer_process + i, buffer_process + end) - buffer_process;
+          is_prev_end_of_line = true;
         }
-        else {
-          ++i;
+      }
+      // lines in this block, include the one continued from the previous block
+      std::vector<const char*> all_lines;
+      for (int tid = 0; tid < num_threads; ++tid) {
+        all_lines.insert(all_lines.end(), thread_lines[tid].begin(), thread_lines[tid].end());
+      }
+      head_line.clear();
+      if (last_line_.size() > 0) {
+        const char* head_end = reinterpret_cast<const char*>(std::memchr(buffer_process, '\0', read_cnt));
+        if (head_end == nullptr) {
+          // the whole block is in the middle of one line
+          last_line_.append(buffer_process, read_cnt);
+          return 0;
+        }
+        last_line_.append(buffer_process, head_end - buffer_process);
+        std::swap(head_line, last_line_);
+        last_line_.clear();
+        if (!all_lines.empty() && all_lines[0] == buffer_process) {
+          all_lines[0] = head_line.c_str();
+        } else {
+          all_lines.insert(all_lines.begin(), head_line.c_str());
         }
       }
-      process_fun(start_idx, lines_);
-      lines_.clear();
-      if (last_i != read_cnt) {
-        last_line_ = std::string(buffer_process + last_i, read_cnt - last_i);
+      // the last line is not finished in this block
+      if (read_cnt > 0 && buffer_process[read_cnt - 1] != '\0' && !all_lines.empty()) {
+        last_line_ = std::string(all_lines.back(), buffer_process + read_cnt - all_lines.back());
+        all_lines.pop_back();
       }
-      return cnt;
+      const INDEX_T start_idx = used_cnt;
+      lines.clear();
+      for (const char* line : all_lines) {
+        if (filter_fun(used_cnt, total_cnt)) {
+          lines.push_back(line);
+          ++used_cnt;
+        }
+        ++total_cnt;
+      }
+      process_fun(start_idx, lines);
+      return all_lines.size();
     });
     // if last line of file doesn't contain end of line
     if (last_line_.size() > 0) {
       Log::Info("Warning: last line of %s has no end of line, still using this line", filename_);
+      lines.clear();
       if (filter_fun(used_cnt, total_cnt)) {
-        lines_.push_back(last_line_);
-        process_fun(used_cnt, lines_);
+        lines.push_back(last_line_.c_str());
+        process_fun(used_cnt, lines);
       }
-      lines_.clear();
       ++total_cnt;
       ++used_cnt;
       last_line_ = "";
@@ -279,11 +373,11 @@ public:
     return total_cnt;
   }
 
-  INDEX_T ReadAllAndProcessParallel(const std::function<void(INDEX_T, const std::vector<std::string>&)>& process_fun) {
+  INDEX_T ReadAllAndProcessParallel(const std::function<void(INDEX_T, const std::vector<const char*>&)>& process_fun) {
     return ReadAllAndProcessParallelWithFilter(process_fun, [](INDEX_T, INDEX_T) { return true; });
   }
 
-  INDEX_T ReadPartAndProcessParallel(const std::vector<INDEX_T>& used_data_indices, const std::function<void(INDEX_T, const std::vector<std::string>&)>& process_fun) {
+  INDEX_T ReadPartAndProcessParallel(const std::vector<INDEX_T>& used_data_indices, const std::function<void(INDEX_T, const std::vector<const char*>&)>& process_fun) {
     return ReadAllAndProcessParallelWithFilter(process_fun,
       [&used_data_indices](INDEX_T used_cnt ,INDEX_T total_cnt) {
       if (static_cast<size_t>(used_cnt) < used_data_indices.size() && total_cnt == used_data_indices[used_cnt]) {
@@ -296,6 +390,47 @@ public:
   }
 
 private:
+  /*! \brief Read the bytes in range by pipeline */
+  size_t ReadRange(const std::function<size_t(char*, size_t)>& process_fun) {
+    const size_t start = range_start();
+    if (range_end_ <= start) { return 0; }
+    return PipelineReader::Read(filename_, start, process_fun, range_end_ - start);
+  }
+
+  /*! \brief Move a position forward to the beginning of a line, the header is not a line */
+  size_t AlignToLine(size_t pos, size_t file_size) const {
+    if (pos <= static_cast<size_t>(skip_bytes_)) { return static_cast<size_t>(skip_bytes_); }
+    if (pos >= file_size) { return file_size; }
+    FILE* file;
+#ifdef _MSC_VER
+    fopen_s(&file, filename_, "rb");
+#else
+    file = fopen(filename_, "rb");
+#endif
+    if (file == NULL) {
+      Log::Fatal("Could not open %s", filename_);
+    }
+    // a line begins at pos if the previous char is an end of line
+    PipelineReader::Seek(file, pos - 1);
+    --pos;
+    int read_c = fgetc(file);
+    while (read_c != EOF && !IsEndOfLine(static_cast<char>(read_c))) {
+      ++pos;
+      read_c = fgetc(file);
+    }
+    while (read_c != EOF && IsEndOfLine(static_cast<char>(read_c))) {
+      ++pos;
+      read_c = fgetc(file);
+    }
+    fclose(file);
+    return pos;
+  }
+
+  /*! \brief True if the char is an end of line */
+  static inline bool IsEndOfLine(char c) {
+    return c == '\n' || c == '\r';
+  }
+
   /*! \brief Filename of text data */
   const char* filename_;
   /*! \brief Cache the read text data */
@@ -308,6 +443,10 @@ private:
   bool is_skip_first_line_ = false;
   /*! \brief is skip first line */
   int skip_bytes_ = 0;
+  /*! \brief Start position of the read bytes, the header is never read */
+  size_t range_start_ = 0;
+  /*! \brief End position of the read bytes */
+  size_t range_end_ = std::numeric_limits<size_t>::max();
 };
 
 }  // namespace LightGBM
@@ -0,0 +1,254 @@
+#ifndef LIGHTGBM_UTILS_THREAD_POOL_H_
+#define LIGHTGBM_UTILS_THREAD_POOL_H_
+
+#include <omp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LightGBM {
+
+/*!
+* \brief A persistent thread pool with work stealing. Each thread has a deque of tasks, it runs its own tasks
+*        from the back, and steals tasks of other threads from the front when its deque is empty.
+*        The thread calling For is one of the threads of the pool and runs tasks until the loop is done,
+*        so loops can be nested in tasks, e.g. histograms of features inside trees of classes.
+*        OpenMP regions inside tasks run in one thread, so a host process is not oversubscribed.
+*        Only one thread outside the pool should use it at a time
+*/
+class ThreadPool {
+public:
+  /*!
+  * \brief Constructor, starts num_threads - 1 threads, the last one is the calling thread
+  * \param num_threads Number of threads, <= 0 means the number of OpenMP threads
+  */
+  explicit ThreadPool(int num_threads) {
+    num_threads_ = num_threads > 0 ? num_threads : omp_get_max_threads();
+    num_threads_ = std::max(num_threads_, 1);
+    for (int i = 0; i < num_threads_; ++i) {
+      queues_.emplace_back(new Queue());
+    }
+    for (int i = 0; i < num_threads_ - 1; ++i) {
+      workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+  }
+
+  /*! \brief Destructor, stops the threads, should not be called when loops are running */
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      is_stopped_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  /*! \brief Number of threads, including the calling thread */
+  int num_threads() const { return num_threads_; }
+
+  /*!
+  * \brief Parallel loop of inner_fun(i) for i in [start, end). Indices are split into blocks of contiguous ranges,
+  *        blocks are taken dynamically by the threads. Exceptions of tasks are rethrown after the loop.
+  *        A task that uses buffers of its thread should not run nested loops, since the thread may run
+  *        other tasks of the same loop while waiting
+  * \param start Start index
+  * \param end End index
+  * \param inner_fun Function of an index
+  */
+  void For(int start, int end, const std::function<void(int)>& inner_fun) {
+    if (end <= start) { return; }
+    const int num_blocks = std::min(end - start, num_threads_ * kBlocksPerThread);
+    if (num_threads_ <= 1 || num_blocks <= 1) {
+      for (int i = start; i < end; ++i) {
+        inner_fun(i);
+      }
+      return;
+    }
+    LoopState state;
+    const int block_size = (end - start + num_blocks - 1) / num_blocks;
+    std::vector<std::function<void()>> tasks;
+    for (int block_start = start; block_start < end; block_start += block_size) {
+      const int block_end = std::min(block_start + block_size, end);
+      tasks.emplace_back([&state, &inner_fun, block_start, block_end]() {
+        try {
+          for (int i = block_start; i < block_end; ++i) {
+            inner_fun(i);
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(state.mutex);
+          if (state.exception == nullptr) {
+            state.exception = std::current_exception();
+          }
+        }
+        // the last access to the state
+        state.num_remaining_blocks.fetch_sub(1, std::memory_order_acq_rel);
+      });
+    }
+    state.num_remaining_blocks.store(static_cast<int>(tasks.size()));
+    Push(&tasks);
+    // OpenMP regions in tasks of this thread should not start threads either
+    const int num_omp_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    while (state.num_remaining_blocks.load(std::memory_order_acquire) > 0) {
+      if (!RunOneTask()) {
+        std::this_thread::yield();
+      }
+    }
+    omp_set_num_threads(num_omp_threads);
+    if (state.exception != nullptr) {
+      std::rethrow_exception(state.exception);
+    }
+  }
+
+  /*! \brief The thread pool of the calling thread, nullptr means using OpenMP */
+  static ThreadPool* Current() { return CurrentRef(); }
+
+  /*! \brief Id of the calling thread in [0, num_threads()), threads outside the pool use the last one */
+  int ThreadId() const {
+    const int id = WorkerIdRef();
+    return id >= 0 && CurrentRef() == this ? id : num_threads_ - 1;
+  }
+
+  /*!
+  * \brief Use a thread pool in the calling thread until this object is destroyed, OpenMP regions of the calling thread
+  *        also use the number of threads of the pool. Settings are per thread, so callers in different threads
+  *        can use different pools and numbers of threads at the same time
+  */
+  class Scope {
+  public:
+    /*!
+    * \brief Constructor
+    * \param pool The thread pool, nullptr means using OpenMP
+    * \param num_omp_threads Number of OpenMP threads when pool is nullptr, <= 0 means not changed
+    */
+    explicit Scope(ThreadPool* pool, int num_omp_threads = 0)
+      : last_pool_(CurrentRef()), num_omp_threads_(omp_get_max_threads()) {
+      CurrentRef() = pool;
+      if (pool != nullptr) {
+        omp_set_num_threads(pool->num_threads());
+      } else if (num_omp_threads > 0) {
+        omp_set_num_threads(num_omp_threads);
+      }
+    }
+
+    ~Scope() {
+      CurrentRef() = last_pool_;
+      omp_set_num_threads(num_omp_threads_);
+    }
+
+    /*! \brief Disable copy */
+    Scope& operator=(const Scope&) = delete;
+    /*! \brief Disable copy */
+    Scope(const Scope&) = delete;
+
+  private:
+    ThreadPool* last_pool_;
+    int num_omp_threads_;
+  };
+
+  /*! \brief Disable copy */
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  /*! \brief Disable copy */
+  ThreadPool(const ThreadPool&) = delete;
+
+private:
+  /*! \brief Number of blocks of each thread in For, more blocks balance better */
+  static const int kBlocksPerThread = 4;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  struct LoopState {
+    std::atomic<int> num_remaining_blocks;
+    std::mutex mutex;
+    std::exception_ptr exception;
+  };
+
+  /*! \brief Push tasks to the deque of the calling thread */
+  void Push(std::vector<std::function<void()>>* tasks) {
+    Queue* queue = queues_[ThreadId()].get();
+    {
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      for (auto& task : *tasks) {
+        queue->tasks.push_back(std::move(task));
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      num_pending_tasks_ += static_cast<int>(tasks->size());
+    }
+    sleep_cv_.notify_all();
+  }
+
+  /*! \brief Run one task of the calling thread, or steal one, return false if there are no tasks */
+  bool RunOneTask() {
+    const int self = ThreadId();
+    std::function<void()> task;
+    for (int k = 0; k < num_threads_ && !task; ++k) {
+      Queue* queue = queues_[(self + k) % num_threads_].get();
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      if (queue->tasks.empty()) { continue; }
+      if (k == 0) {
+        task = std::move(queue->tasks.back());
+        queue->tasks.pop_back();
+      } else {
+        task = std::move(queue->tasks.front());
+        queue->tasks.pop_front();
+      }
+    }
+    if (!task) { return false; }
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      --num_pending_tasks_;
+    }
+    task();
+    return true;
+  }
+
+  void WorkerLoop(int id) {
+    WorkerIdRef() = id;
+    CurrentRef() = this;
+    omp_set_num_threads(1);
+    while (true) {
+      if (RunOneTask()) { continue; }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      sleep_cv_.wait(lock, [this] { return is_stopped_ || num_pending_tasks_ > 0; });
+      if (is_stopped_ && num_pending_tasks_ <= 0) { return; }
+    }
+  }
+
+  // the same trick as Log to use static variables in header file
+  static ThreadPool*& CurrentRef() { static thread_local ThreadPool* pool = nullptr; return pool; }
+  static int& WorkerIdRef() { static thread_local int id = -1; return id; }
+
+  /*! \brief Number of threads, including the calling thread */
+  int num_threads_;
+  /*! \brief Deques of tasks of threads, the last one is for the calling thread */
+  std::vector<std::unique_ptr<Queue>> queues_;
+  /*! \brief Threads of the pool */
+  std::vector<std::thread> workers_;
+  /*! \brief Protects num_pending_tasks_ and is_stopped_ */
+  std::mutex sleep_mutex_;
+  /*! \brief Threads wait on it when there are no tasks */
+  std::condition_variable sleep_cv_;
+  /*! \brief Number of tasks in the deques */
+  int num_pending_tasks_ = 0;
+  /*! \brief True if the threads should exit */
+  bool is_stopped_ = false;
+};
+
+}  // namespace LightGBM
+
+#endif   // LightGBM_UTILS_THREAD_POOL_H_
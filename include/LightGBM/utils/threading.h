@@ -1,6 +1,8 @@
 #ifndef LIGHTGBM_UTILS_THREADING_H_
 #define LIGHTGBM_UTILS_THREADING_H_
 
+#include <LightGBM/utils/thread_pool.h>
+
 #include <omp.h>
 
 #include <vector>
@@ -8,27 +10,62 @@
 
 namespace LightGBM {
 
+/*!
+* \brief Parallel loops run by the thread pool of the calling thread (see ThreadPool::Scope) if any, otherwise by OpenMP
+*/
 class Threading {
 public:
+  /*! \brief Number of threads of parallel loops */
+  static inline int NumThreads() {
+    ThreadPool* pool = ThreadPool::Current();
+    return pool != nullptr ? pool->num_threads() : omp_get_max_threads();
+  }
+
+  /*! \brief Id of the calling thread in parallel loops, in [0, NumThreads()) */
+  static inline int ThreadId() {
+    ThreadPool* pool = ThreadPool::Current();
+    return pool != nullptr && !omp_in_parallel() ? pool->ThreadId() : omp_get_thread_num();
+  }
+
+  /*!
+  * \brief Parallel loop of inner_fun(i) for i in [start, end), indices are taken dynamically
+  * \param start Start index
+  * \param end End index
+  * \param inner_fun Function of an index
+  */
+  static void ParallelFor(int start, int end, const std::function<void(int)>& inner_fun) {
+    ThreadPool* pool = ThreadPool::Current();
+    if (pool != nullptr) {
+      pool->For(start, end, inner_fun);
+      return;
+    }
+    #pragma omp parallel for schedule(guided)
+    for (int i = start; i < end; ++i) {
+      inner_fun(i);
+    }
+  }
 
   template<typename INDEX_T>
   static inline void For(INDEX_T start, INDEX_T end, const std::function<void(int, INDEX_T, INDEX_T)>& inner_fun) {
-    int num_threads = 1;
-    #pragma omp parallel
-    #pragma omp master
-    {
-      num_threads = omp_get_num_threads();
-    }
+    const int num_threads = NumThreads();
     INDEX_T num_inner = (end - start + num_threads - 1) / num_threads;
     if (num_inner <= 0) { num_inner = 1; }
-    #pragma omp parallel for schedule(static,1)
-    for (int i = 0; i < num_threads; ++i) {
+    auto block_fun = [start, end, num_inner, &inner_fun](int i) {
       INDEX_T inner_start = start + num_inner * i;
       INDEX_T inner_end = inner_start + num_inner;
       if (inner_end > end) { inner_end = end; }
       if (inner_start < end) {
         inner_fun(i, inner_start, inner_end);
       }
+    };
+    ThreadPool* pool = ThreadPool::Current();
+    if (pool != nullptr) {
+      pool->For(0, num_threads, block_fun);
+      return;
+    }
+    #pragma omp parallel for schedule(static,1)
+    for (int i = 0; i < num_threads; ++i) {
+      block_fun(i);
     }
   }
 };
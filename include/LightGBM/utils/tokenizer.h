@@ -0,0 +1,99 @@
+#ifndef LIGHTGBM_UTILS_TOKENIZER_H_
+#define LIGHTGBM_UTILS_TOKENIZER_H_
+
+#include <cstddef>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define LIGHTGBM_TOKENIZER_SIMD
+#include <immintrin.h>
+#endif
+
+namespace LightGBM {
+
+/*!
+* \brief Scanners of text for delimiters and ends of lines. On x86-64, 32 chars are compared at once by AVX2
+*        if the running CPU supports it, otherwise 16 by SSE2, and the rest by the scalar loop
+*/
+class Tokenizer {
+public:
+  /*!
+  * \brief Find the first char that is c0 or c1
+  * \param begin Begin of the text
+  * \param end End of the text, the text doesn't need to end with '\0'
+  * \return Pointer of the first c0 or c1, end if not found
+  */
+  static inline const char* FindFirstOf(const char* begin, const char* end, char c0, char c1) {
+    const char* p = begin;
+#ifdef LIGHTGBM_TOKENIZER_SIMD
+    if (IsAVX2Supported()) {
+      p = FindFirstOfAVX2(p, end, c0, c1);
+    } else {
+      p = FindFirstOfSSE2(p, end, c0, c1);
+    }
+#endif
+    while (p < end && *p != c0 && *p != c1) {
+      ++p;
+    }
+    return p;
+  }
+
+  /*!
+  * \brief Find the first end of line, i.e. '\n' or '\r'
+  * \param begin Begin of the text
+  * \param end End of the text
+  * \return Pointer of the first end of line, end if not found
+  */
+  static inline const char* FindEndOfLine(const char* begin, const char* end) {
+    return FindFirstOf(begin, end, '\n', '\r');
+  }
+
+private:
+#ifdef LIGHTGBM_TOKENIZER_SIMD
+  /*! \brief Check once whether the running CPU supports AVX2 instructions */
+  static inline bool IsAVX2Supported() {
+    static const bool is_supported = __builtin_cpu_supports("avx2") != 0;
+    return is_supported;
+  }
+
+  /*!
+  * \brief Scan whole blocks of 32 chars
+  * \return Pointer of the first c0 or c1, or the begin of the last partial block if not found
+  */
+  __attribute__((target("avx2")))
+  static const char* FindFirstOfAVX2(const char* p, const char* end, char c0, char c1) {
+    const __m256i v0 = _mm256_set1_epi8(c0);
+    const __m256i v1 = _mm256_set1_epi8(c1);
+    for (; end - p >= 32; p += 32) {
+      const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+      const __m256i eq = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, v0), _mm256_cmpeq_epi8(chunk, v1));
+      const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(eq));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+    return p;
+  }
+
+  /*!
+  * \brief Scan whole blocks of 16 chars
+  * \return Pointer of the first c0 or c1, or the begin of the last partial block if not found
+  */
+  static const char* FindFirstOfSSE2(const char* p, const char* end, char c0, char c1) {
+    const __m128i v0 = _mm_set1_epi8(c0);
+    const __m128i v1 = _mm_set1_epi8(c1);
+    for (; end - p >= 16; p += 16) {
+      const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      const __m128i eq = _mm_or_si128(_mm_cmpeq_epi8(chunk, v0), _mm_cmpeq_epi8(chunk, v1));
+      const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(eq));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+    return p;
+  }
+#endif
+};
+
+}  // namespace LightGBM
+
+#endif   // LightGBM_UTILS_TOKENIZER_H_
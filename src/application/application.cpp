@@ -2,6 +2,7 @@
 
 #include <LightGBM/utils/common.h>
 #include <LightGBM/utils/text_reader.h>
+#include <LightGBM/utils/profiler.h>
 
 #include <LightGBM/network.h>
 #include <LightGBM/dataset.h>
@@ -11,6 +12,7 @@
 #include <LightGBM/metric.h>
 
 #include "predictor.hpp"
+#include "prediction_server.hpp"
 
 #include <omp.h>
 
@@ -32,7 +34,11 @@ Application::Application(int argc, char** argv) {
   if (config_.num_threads > 0) {
     omp_set_num_threads(config_.num_threads);
   }
-  if (config_.io_config.data_filename.size() == 0) {
+  if (config_.is_use_thread_pool) {
+    thread_pool_.reset(new ThreadPool(config_.num_threads));
+  }
+  if (config_.io_config.data_filename.size() == 0 && config_.task_type != TaskType::kConvertModel
+    && config_.task_type != TaskType::kServe) {
 	  Log::Fatal("No training/prediction data, application quit");
   }
 }
@@ -107,8 +113,8 @@ void Application::LoadData() {
   auto start_time = std::chrono::high_resolution_clock::now();
   // prediction is needed if using input initial model(continued train)
   PredictFunction predict_fun = nullptr;
-  // need to continue training
-  if (boosting_->NumberOfSubModels() > 0) {
+  // need to continue training, refitting starts from the initial scores of data instead
+  if (boosting_->NumberOfSubModels() > 0 && config_.task_type != TaskType::kRefitTree) {
     Predictor predictor(boosting_.get(), true, false);
     predict_fun = predictor.GetPredictFunction();
   }
@@ -123,16 +129,17 @@ void Application::LoadData() {
   dataset_loader.SetHeader(config_.io_config.data_filename.c_str());
   // load Training data
   if (config_.is_parallel_find_bin) {
-    // load data for parallel training
+    // load data for parallel training, machines in the same row of the machine grid load the same partition
+    const int num_grid_columns = Network::num_grid_columns();
     train_data_.reset(dataset_loader.LoadFromFile(config_.io_config.data_filename.c_str(),
-      Network::rank(), Network::num_machines()));
+      Network::rank() / num_grid_columns, Network::num_machines() / num_grid_columns));
   } else {
     // load data for single machine
     train_data_.reset(dataset_loader.LoadFromFile(config_.io_config.data_filename.c_str(), 0, 1));
   }
   // need save binary file
   if (config_.io_config.is_save_binary_file) {
-    train_data_->SaveBinaryFile(nullptr);
+    train_data_->SaveBinaryFile(nullptr, config_.io_config.is_compress_binary_file);
   }
   // create training metric
   if (config_.boosting_config.is_provide_training_metric) {
@@ -145,18 +152,15 @@ void Application::LoadData() {
     }
   }
   train_metric_.shrink_to_fit();
-  // Add validation data, if it exists
+  // Add validation data, if it exists. Files are loaded at the same time
+  auto new_datasets = dataset_loader.LoadFromFilesAlignWithOtherDataset(config_.io_config.valid_data_filenames,
+    train_data_.get());
   for (size_t i = 0; i < config_.io_config.valid_data_filenames.size(); ++i) {
     // add
-    auto new_dataset = std::unique_ptr<Dataset>(
-      dataset_loader.LoadFromFileAlignWithOtherDataset(
-        config_.io_config.valid_data_filenames[i].c_str(),
-        train_data_.get())
-      );
-    valid_datas_.push_back(std::move(new_dataset));
+    valid_datas_.push_back(std::move(new_datasets[i]));
     // need save binary file
     if (config_.io_config.is_save_binary_file) {
-      valid_datas_.back()->SaveBinaryFile(nullptr);
+      valid_datas_.back()->SaveBinaryFile(nullptr, config_.io_config.is_compress_binary_file);
     }
 
     // add metric for validation data
@@ -185,7 +189,8 @@ void Application::InitTrain() {
     Network::Init(config_.network_config);
     Log::Info("Finished initializing network");
     // sync global random seed for feature patition
-    if (config_.boosting_type == BoostingType::kGBDT || config_.boosting_type == BoostingType::kDART) {
+    if (config_.boosting_type == BoostingType::kGBDT || config_.boosting_type == BoostingType::kDART
+      || config_.boosting_type == BoostingType::kGOSS) {
       config_.boosting_config.tree_config.feature_fraction_seed =
         GlobalSyncUpByMin<int>(config_.boosting_config.tree_config.feature_fraction_seed);
       config_.boosting_config.tree_config.feature_fraction =
@@ -212,6 +217,12 @@ void Application::InitTrain() {
     boosting_->AddDataset(valid_datas_[i].get(),
       Common::ConstPtrInVectorWrapper<Metric>(valid_metrics_[i]));
   }
+  // resume from the checkpoint of the interrupted training
+  if (config_.task_type == TaskType::kTrain && !config_.io_config.checkpoint_file.empty()
+    && std::ifstream(config_.io_config.checkpoint_file.c_str(), std::ios::binary).good()) {
+    boosting_->LoadCheckpoint(config_.io_config.checkpoint_file.c_str());
+  }
+  Log::Info("Memory usage: %s", boosting_->GetMemoryUsage().ToString().c_str());
   Log::Info("Finished initializing training");
 }
 
@@ -221,29 +232,106 @@ void Application::Train() {
   bool is_finished = false;
   bool need_eval = true;
   auto start_time = std::chrono::high_resolution_clock::now();
-  for (int iter = 0; iter < total_iter && !is_finished; ++iter) {
+  // iterations before the checkpoint are done
+  for (int iter = boosting_->GetCurrentIteration(); iter < total_iter && !is_finished; ++iter) {
     is_finished = boosting_->TrainOneIter(nullptr, nullptr, need_eval);
     auto end_time = std::chrono::high_resolution_clock::now();
     // output used time per iteration
     Log::Info("%f seconds elapsed, finished iteration %d", std::chrono::duration<double,
       std::milli>(end_time - start_time) * 1e-3, iter + 1);
+    if (config_.is_parallel) {
+      Network::LogStats();
+    }
+    if (Profiler::IsEnabled()) {
+      Profiler::LogStats(iter + 1);
+    }
+    Log::Debug("Memory usage: %s", boosting_->GetMemoryUsage().ToString().c_str());
     boosting_->SaveModelToFile(NO_LIMIT, is_finished, config_.io_config.output_model.c_str());
+    if (!is_finished && !config_.io_config.checkpoint_file.empty()
+      && (iter + 1) % config_.io_config.checkpoint_freq == 0) {
+      boosting_->SaveCheckpoint(config_.io_config.checkpoint_file.c_str());
+    }
   }
   is_finished = true;
   // save model to file
   boosting_->SaveModelToFile(NO_LIMIT, is_finished, config_.io_config.output_model.c_str());
+  if (config_.io_config.is_save_binary_model) {
+    boosting_->SaveModelToBinaryFile(NO_LIMIT, (config_.io_config.output_model + ".bin").c_str());
+  }
   Log::Info("Finished training");
 }
 
+void Application::RefitTree() {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  const int num_models = boosting_->NumberOfSubModels();
+  if (num_models <= 0) {
+    Log::Fatal("No trees to refit, please set input_model");
+  }
+  boosting_->SetNumUsedModel(num_models);
+  // leaf index of each data in the existing trees, trees are refitted on them without traversing again
+  std::vector<int> leaf_preds;
+  data_size_t num_data = 0;
+  {
+    Predictor predictor(boosting_.get(), true, true);
+    num_data = predictor.PredictLeafIndex(config_.io_config.data_filename.c_str(),
+      config_.io_config.has_header, &leaf_preds);
+  }
+  if (num_data != train_data_->num_data()) {
+    Log::Fatal("Number of data in %s (%d) is different from the training data (%d)",
+      config_.io_config.data_filename.c_str(), num_data, train_data_->num_data());
+  }
+  boosting_->RefitTree(leaf_preds.data(), num_data, num_models);
+  boosting_->SaveModelToFile(NO_LIMIT, true, config_.io_config.output_model.c_str());
+  if (config_.io_config.is_save_binary_model) {
+    boosting_->SaveModelToBinaryFile(NO_LIMIT, (config_.io_config.output_model + ".bin").c_str());
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+  Log::Info("Finished refitting trees in %f seconds",
+    std::chrono::duration<double, std::milli>(end_time - start_time) * 1e-3);
+}
+
+void Application::SetPredictConfig() {
+  boosting_->SetNumUsedModel(config_.io_config.num_model_predict);
+  boosting_->SetPredictOnBins(config_.io_config.is_predict_on_bins);
+  if (config_.io_config.is_predict_early_stop) {
+    boosting_->SetPredictEarlyStop(config_.io_config.predict_early_stop_freq,
+      config_.io_config.predict_early_stop_margin);
+  }
+}
 
 void Application::Predict() {
-  boosting_->SetNumUsedModel(config_.io_config.num_model_predict);
+  auto start_time = std::chrono::high_resolution_clock::now();
+  SetPredictConfig();
   // create predictor
   Predictor predictor(boosting_.get(), config_.io_config.is_predict_raw_score,
-    config_.io_config.is_predict_leaf_index);
+    config_.io_config.is_predict_leaf_index, config_.io_config.is_predict_contrib);
   predictor.Predict(config_.io_config.data_filename.c_str(),
     config_.io_config.output_result.c_str(), config_.io_config.has_header);
-  Log::Info("Finished prediction");
+  auto end_time = std::chrono::high_resolution_clock::now();
+  Log::Info("Finished prediction in %f seconds",
+    std::chrono::duration<double, std::milli>(end_time - start_time) * 1e-3);
+}
+
+void Application::ConvertModel() {
+  // num_model_predict counts trees, while the code saves iterations
+  int num_used_model = config_.io_config.num_model_predict;
+  if (num_used_model != NO_LIMIT) {
+    num_used_model /= boosting_->NumberOfClasses();
+  }
+  boosting_->SaveModelToIfElse(num_used_model, config_.io_config.convert_model.c_str());
+  Log::Info("Finished converting model to %s", config_.io_config.convert_model.c_str());
+}
+
+void Application::Serve() {
+#ifdef USE_SOCKET
+  SetPredictConfig();
+  Predictor predictor(boosting_.get(), config_.io_config.is_predict_raw_score,
+    config_.io_config.is_predict_leaf_index, config_.io_config.is_predict_contrib);
+  PredictionServer server(boosting_.get(), &predictor, config_.io_config);
+  server.Run();
+#else
+  Log::Fatal("Serve task needs socket, please compile without USE_MPI");
+#endif
 }
 
 void Application::InitPredict() {
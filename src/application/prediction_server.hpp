@@ -0,0 +1,445 @@
+#ifndef LIGHTGBM_PREDICTION_SERVER_HPP_
+#define LIGHTGBM_PREDICTION_SERVER_HPP_
+#ifdef USE_SOCKET
+
+#include <LightGBM/meta.h>
+#include <LightGBM/config.h>
+#include <LightGBM/dataset.h>
+#include <LightGBM/utils/common.h>
+#include <LightGBM/utils/log.h>
+#include <LightGBM/utils/pipeline_writer.h>
+#include <LightGBM/utils/threading.h>
+
+#include "predictor.hpp"
+#include "../network/socket_wrapper.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace LightGBM {
+
+/*!
+* \brief Server of the serve task. Clients send rows as lines over TCP, in the formats of prediction data files,
+*        and get one line of results for each row in the same order, formatted as prediction result files.
+*        Rows of all connections are collected into micro-batches of at most serve_batch_size rows, a batch is
+*        predicted by the parallel batch path once it is full or its first row has waited serve_batch_delay ms.
+*        A row that cannot be parsed is answered by a line starting with "error:", and the line "stats" is
+*        answered by one line of counters: numbers of rows and batches, throughput and latency percentiles.
+*        Results are sent by a writer thread of each connection, so a slow client never blocks the batches.
+*        A client whose unsent results exceed kMaxSendBufferSize is dropped
+*/
+class PredictionServer {
+public:
+  /*!
+  * \brief Constructor
+  * \param boosting The model
+  * \param predictor Predictor of the model, only used by the thread calling Run
+  * \param io_config Config of the port, micro-batches and prediction
+  */
+  PredictionServer(const Boosting* boosting, Predictor* predictor, const IOConfig& io_config) {
+    predictor_ = predictor;
+    port_ = io_config.serve_port;
+    batch_size_ = io_config.serve_batch_size;
+    batch_delay_ = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::milli>(io_config.serve_batch_delay));
+    is_predict_leaf_index_ = io_config.is_predict_leaf_index;
+    num_features_ = boosting->MaxFeatureIdx() + 1;
+    label_idx_ = boosting->LabelIdx();
+    num_outputs_ = is_predict_leaf_index_ ? 0 : predictor_->NumRowOutputs();
+  }
+
+  /*! \brief Accept connections and serve their rows, never returns */
+  void Run() {
+    TcpSocket::Startup();
+    listener_.reset(new TcpSocket());
+    listener_->SetReuseAddress();
+    if (!listener_->Bind(port_)) {
+      Log::Fatal("Cannot bind port %d for serving", port_);
+    }
+    listener_->Listen();
+    Log::Info("Serving on port %d, micro-batches of at most %d rows or %f ms", port_, batch_size_,
+      std::chrono::duration<double, std::milli>(batch_delay_).count());
+    std::thread accept_thread([this]() { Accept(); });
+    accept_thread.detach();
+    start_time_ = Clock::now();
+    last_log_time_ = start_time_;
+    std::vector<Request> batch;
+    while (true) {
+      NextBatch(&batch);
+      PredictBatch(&batch);
+      if (Clock::now() - last_log_time_ >= std::chrono::seconds(static_cast<int>(kStatsLogPeriod))) {
+        last_log_time_ = Clock::now();
+        Log::Info("Serving stats: %s", StatsLine().c_str());
+      }
+    }
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  /*! \brief A client connection, shared by its receiving and writer threads and the batches of its rows */
+  struct Connection {
+    explicit Connection(const TcpSocket& client_socket) : socket(client_socket) {}
+    TcpSocket socket;
+    /*! \brief Guards the fields below */
+    std::mutex mutex;
+    /*! \brief Wakes up the writer thread */
+    std::condition_variable send_cv;
+    /*! \brief Parser chosen by the first row of the connection */
+    std::unique_ptr<Parser> parser;
+    /*! \brief Results waiting for the writer thread */
+    std::vector<char> send_buffer;
+    /*! \brief Number of received lines that are not answered yet */
+    int num_pending = 0;
+    /*! \brief True if the client stops sending, the socket is closed once all lines are answered */
+    bool is_eof = false;
+    /*! \brief True if sending failed or the client is too slow, the rest results are dropped */
+    bool is_broken = false;
+  };
+
+  /*! \brief A received line */
+  struct Request {
+    std::shared_ptr<Connection> connection;
+    std::string line;
+    Clock::time_point arrival_time;
+    /*! \brief True if the line asks for the counters */
+    bool is_stats = false;
+    /*! \brief Error of the line, empty if it can be predicted */
+    std::string error;
+  };
+
+  /*! \brief Accept connections, each one is received and written by its own threads */
+  void Accept() {
+    while (true) {
+      try {
+        std::shared_ptr<Connection> connection(new Connection(listener_->Accept()));
+        std::thread receive_thread([this, connection]() { Receive(connection); });
+        receive_thread.detach();
+        std::thread write_thread([this, connection]() { Write(connection); });
+        write_thread.detach();
+      } catch (std::exception& ex) {
+        Log::Warning("Cannot accept connection: %s", ex.what());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+    }
+  }
+
+  /*! \brief Split received data into lines and queue them, until the client stops sending */
+  void Receive(std::shared_ptr<Connection> connection) {
+    std::vector<char> buffer(kReceiveBufferSize);
+    std::string text;
+    std::vector<Request> requests;
+    try {
+      while (true) {
+        const int cnt = connection->socket.Recv(buffer.data(), kReceiveBufferSize);
+        if (cnt <= 0) { break; }
+        const Clock::time_point now = Clock::now();
+        text.append(buffer.data(), cnt);
+        size_t begin = 0;
+        size_t end = text.find('\n');
+        for (; end != std::string::npos; begin = end + 1, end = text.find('\n', begin)) {
+          Request request;
+          request.line = text.substr(begin, end - begin);
+          request.line = Common::Trim(request.line);
+          if (request.line.empty()) { continue; }
+          request.connection = connection;
+          request.arrival_time = now;
+          request.is_stats = request.line == "stats";
+          if (!request.is_stats && connection->parser == nullptr) {
+            try {
+              connection->parser.reset(Parser::CreateParserForLine(request.line.c_str(), num_features_, label_idx_));
+            } catch (std::exception& ex) {
+              request.error = ex.what();
+            }
+          }
+          requests.push_back(std::move(request));
+        }
+        text.erase(0, begin);
+        if (text.size() > kMaxLineSize) {
+          Log::Fatal("Line is longer than %d bytes", static_cast<int>(kMaxLineSize));
+        }
+        Push(connection.get(), &requests);
+      }
+    } catch (std::exception& ex) {
+      Log::Warning("Stop receiving from connection: %s", ex.what());
+    }
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->is_eof = true;
+    connection->send_cv.notify_one();
+  }
+
+  /*! \brief Queue requests of a connection, and wake up the batching thread */
+  void Push(Connection* connection, std::vector<Request>* requests) {
+    if (requests->empty()) { return; }
+    {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      connection->num_pending += static_cast<int>(requests->size());
+    }
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      for (auto& request : *requests) {
+        queue_.push_back(std::move(request));
+      }
+    }
+    requests->clear();
+    queue_cv_.notify_one();
+  }
+
+  /*! \brief Wait until batch_size_ requests are queued, or the first one has waited batch_delay_ */
+  void NextBatch(std::vector<Request>* batch) {
+    batch->clear();
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    queue_cv_.wait(lock, [this]() { return !queue_.empty(); });
+    const Clock::time_point deadline = queue_.front().arrival_time + batch_delay_;
+    queue_cv_.wait_until(lock, deadline, [this]() { return queue_.size() >= static_cast<size_t>(batch_size_); });
+    const size_t cnt = std::min(queue_.size(), static_cast<size_t>(batch_size_));
+    for (size_t i = 0; i < cnt; ++i) {
+      batch->push_back(std::move(queue_.front()));
+      queue_.pop_front();
+    }
+  }
+
+  /*! \brief Parse and predict rows of a batch in parallel, then send the results of each connection at once */
+  void PredictBatch(std::vector<Request>* batch) {
+    const Clock::time_point batch_start_time = Clock::now();
+    const int num_requests = static_cast<int>(batch->size());
+    std::vector<std::vector<std::pair<int, double>>> features(num_requests);
+    Threading::ParallelFor(0, num_requests, [batch, &features](int i) {
+      Request& request = (*batch)[i];
+      if (request.is_stats || !request.error.empty()) { return; }
+      try {
+        double label;
+        request.connection->parser->ParseOneLine(request.line.c_str(), &features[i], &label);
+      } catch (std::exception& ex) {
+        request.error = ex.what();
+      }
+    });
+    std::vector<int> rows;
+    for (int i = 0; i < num_requests; ++i) {
+      if (!(*batch)[i].is_stats && (*batch)[i].error.empty()) {
+        rows.push_back(i);
+      }
+    }
+    const int num_rows = static_cast<int>(rows.size());
+    std::vector<double> output;
+    std::vector<std::vector<double>> leaf_output;
+    if (is_predict_leaf_index_) {
+      leaf_output.resize(num_rows);
+      const PredictFunction& predict_fun = predictor_->GetPredictFunction();
+      Threading::ParallelFor(0, num_rows, [&predict_fun, &rows, &features, &leaf_output](int j) {
+        leaf_output[j] = predict_fun(features[rows[j]]);
+      });
+    } else if (num_rows > 0) {
+      output.resize(static_cast<size_t>(num_rows) * num_outputs_);
+      predictor_->PredictRows([&rows, &features](int j) {
+        return std::move(features[rows[j]]);
+      }, num_rows, output.data());
+    }
+    num_rows_ += num_rows;
+    ++num_batches_;
+    // results are appended to the buffers of connections in the order of requests
+    std::vector<std::shared_ptr<Connection>> connections;
+    std::vector<std::vector<char>> buffers;
+    std::vector<int> num_answered;
+    std::unordered_map<const Connection*, size_t> connection_idx;
+    int row = 0;
+    for (int i = 0; i < num_requests; ++i) {
+      const Request& request = (*batch)[i];
+      auto iter = connection_idx.find(request.connection.get());
+      if (iter == connection_idx.end()) {
+        iter = connection_idx.emplace(request.connection.get(), connections.size()).first;
+        connections.push_back(request.connection);
+        buffers.emplace_back();
+        num_answered.push_back(0);
+      }
+      std::vector<char>& buffer = buffers[iter->second];
+      ++num_answered[iter->second];
+      if (request.is_stats) {
+        const std::string stats = StatsLine();
+        buffer.insert(buffer.end(), stats.begin(), stats.end());
+      } else if (!request.error.empty()) {
+        const std::string error = "error: " + request.error;
+        buffer.insert(buffer.end(), error.begin(), error.end());
+      } else {
+        const double* values = is_predict_leaf_index_ ? leaf_output[row].data()
+          : output.data() + static_cast<size_t>(row) * num_outputs_;
+        const size_t num_values = is_predict_leaf_index_ ? leaf_output[row].size() : num_outputs_;
+        for (size_t j = 0; j < num_values; ++j) {
+          if (j > 0) { buffer.push_back('\t'); }
+          PipelineWriter::AppendValue(values[j], &buffer);
+        }
+        ++row;
+      }
+      buffer.push_back('\n');
+    }
+    for (size_t k = 0; k < connections.size(); ++k) {
+      Send(connections[k].get(), &buffers[k], num_answered[k]);
+    }
+    // latency is from receiving a row to handing its result to the writer thread
+    const Clock::time_point now = Clock::now();
+    for (int i : rows) {
+      AddLatency(std::chrono::duration<double, std::milli>(now - (*batch)[i].arrival_time).count());
+    }
+    busy_seconds_ += std::chrono::duration<double>(now - batch_start_time).count();
+  }
+
+  /*! \brief Queue results for the writer thread of a connection, drop the connection if too many are unsent */
+  void Send(Connection* connection, std::vector<char>* buffer, int num_answered) {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    if (!connection->is_broken) {
+      if (connection->send_buffer.size() + buffer->size() > kMaxSendBufferSize) {
+        Log::Warning("Client does not receive results in time, drop the connection");
+        Break(connection);
+      } else if (connection->send_buffer.empty()) {
+        connection->send_buffer.swap(*buffer);
+      } else {
+        connection->send_buffer.insert(connection->send_buffer.end(), buffer->begin(), buffer->end());
+      }
+    }
+    connection->num_pending -= num_answered;
+    connection->send_cv.notify_one();
+  }
+
+  /*!
+  * \brief Send queued results of a connection until all lines are answered after the client stops sending,
+  *        then close the socket. Only this thread closes it, after the receiving thread has stopped
+  */
+  void Write(std::shared_ptr<Connection> connection) {
+    std::vector<char> buffer;
+    std::unique_lock<std::mutex> lock(connection->mutex);
+    while (true) {
+      connection->send_cv.wait(lock, [&connection]() {
+        return (!connection->is_broken && !connection->send_buffer.empty())
+          || (connection->is_eof && (connection->is_broken || connection->num_pending == 0));
+      });
+      if (connection->is_broken || connection->send_buffer.empty()) { break; }
+      buffer.swap(connection->send_buffer);
+      lock.unlock();
+      bool is_sent = true;
+      try {
+        size_t sent = 0;
+        while (sent < buffer.size()) {
+          sent += connection->socket.Send(buffer.data() + sent,
+            static_cast<int>(std::min(buffer.size() - sent, static_cast<size_t>(kReceiveBufferSize))), kSendFlags);
+        }
+      } catch (std::exception& ex) {
+        Log::Warning("Cannot send results to connection: %s", ex.what());
+        is_sent = false;
+      }
+      buffer.clear();
+      lock.lock();
+      if (!is_sent) { Break(connection.get()); }
+    }
+    connection->socket.Close();
+  }
+
+  /*! \brief Drop the rest results of a connection, blocked sending and receiving of it return. Needs its mutex */
+  void Break(Connection* connection) {
+    connection->is_broken = true;
+    std::vector<char>().swap(connection->send_buffer);
+    connection->socket.Shutdown();
+  }
+
+  /*! \brief Keep the latency in the window of the latest kLatencyWindow rows */
+  void AddLatency(double latency) {
+    if (latencies_.size() < kLatencyWindow) {
+      latencies_.push_back(latency);
+    } else {
+      latencies_[latency_pos_] = latency;
+    }
+    latency_pos_ = (latency_pos_ + 1) % kLatencyWindow;
+  }
+
+  /*!
+  * \brief Counters of served rows. Throughput is over the time since start and over the time of predicting batches,
+  *        latency percentiles are of the latest kLatencyWindow rows
+  */
+  std::string StatsLine() const {
+    const double seconds = std::chrono::duration<double>(Clock::now() - start_time_).count();
+    std::vector<double> latencies(latencies_);
+    auto percentile = [&latencies](double p) {
+      if (latencies.empty()) { return 0.0; }
+      const size_t k = std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()));
+      std::nth_element(latencies.begin(), latencies.begin() + k, latencies.end());
+      return latencies[k];
+    };
+    const double p50 = percentile(0.5);
+    const double p90 = percentile(0.9);
+    const double p99 = percentile(0.99);
+    const double max_latency = latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end());
+    char str[512];
+    snprintf(str, sizeof(str), "rows=%lld batches=%lld mean_batch_rows=%.2f rows_per_second=%.1f "
+      "busy_rows_per_second=%.1f latency_ms_p50=%.3f latency_ms_p90=%.3f latency_ms_p99=%.3f latency_ms_max=%.3f",
+      static_cast<long long>(num_rows_), static_cast<long long>(num_batches_),
+      num_batches_ > 0 ? static_cast<double>(num_rows_) / num_batches_ : 0.0,
+      seconds > 0.0 ? num_rows_ / seconds : 0.0, busy_seconds_ > 0.0 ? num_rows_ / busy_seconds_ : 0.0,
+      p50, p90, p99, max_latency);
+    return std::string(str);
+  }
+
+  /*! \brief Size of the receiving buffer of a connection, also the max size of one send */
+  static const int kReceiveBufferSize = 64 * 1024;
+  /*! \brief Max size in byte of a line */
+  static const size_t kMaxLineSize = 64 * 1024 * 1024;
+  /*! \brief Max size in byte of the unsent results of a connection */
+  static const size_t kMaxSendBufferSize = 64 * 1024 * 1024;
+  /*! \brief Number of latest rows the latency percentiles are of */
+  static const size_t kLatencyWindow = 64 * 1024;
+  /*! \brief Period (unit:s) of logging the counters */
+  static const int kStatsLogPeriod = 60;
+#ifdef MSG_NOSIGNAL
+  /*! \brief Don't raise SIGPIPE when the client has closed the connection */
+  static const int kSendFlags = MSG_NOSIGNAL;
+#else
+  static const int kSendFlags = 0;
+#endif
+
+  /*! \brief Predictor of the model */
+  Predictor* predictor_;
+  /*! \brief Port to listen on */
+  int port_;
+  /*! \brief Max number of rows in a batch */
+  int batch_size_;
+  /*! \brief Max waiting time of the first row of a batch */
+  Clock::duration batch_delay_;
+  /*! \brief True if predict leaf index, rows are predicted one by one */
+  bool is_predict_leaf_index_;
+  /*! \brief Number of features of the model */
+  int num_features_;
+  /*! \brief Label column of the model, used when rows contain labels */
+  int label_idx_;
+  /*! \brief Number of outputs of a row of the batch path */
+  int num_outputs_;
+  /*! \brief Listening socket */
+  std::unique_ptr<TcpSocket> listener_;
+  /*! \brief Requests waiting for batches */
+  std::deque<Request> queue_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  /*! \brief Counters, only used by the batching thread */
+  int64_t num_rows_ = 0;
+  int64_t num_batches_ = 0;
+  double busy_seconds_ = 0.0f;
+  Clock::time_point start_time_;
+  Clock::time_point last_log_time_;
+  /*! \brief Latencies (unit:ms) of the latest rows, a ring buffer */
+  std::vector<double> latencies_;
+  size_t latency_pos_ = 0;
+};
+
+}  // namespace LightGBM
+
+#endif  // USE_SOCKET
+#endif   // LightGBM_PREDICTION_SERVER_HPP_
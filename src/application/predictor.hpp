@@ -4,12 +4,15 @@
 #include <LightGBM/meta.h>
 #include <LightGBM/boosting.h>
 #include <LightGBM/utils/text_reader.h>
+#include <LightGBM/utils/pipeline_writer.h>
+#include <LightGBM/utils/threading.h>
 #include <LightGBM/dataset.h>
 
 #include <omp.h>
 
 #include <cstring>
 #include <cstdio>
+#include <algorithm>
 #include <vector>
 #include <utility>
 #include <functional>
@@ -28,40 +31,51 @@ public:
   * \param boosting Input boosting model
   * \param is_raw_score True if need to predict result with raw score
   * \param predict_leaf_index True if output leaf index instead of prediction score
+  * \param is_predict_contrib True if output contributions of features by TreeSHAP instead of prediction score
   */
-  Predictor(const Boosting* boosting, bool is_raw_score, bool is_predict_leaf_index) {
+  Predictor(const Boosting* boosting, bool is_raw_score, bool is_predict_leaf_index, bool is_predict_contrib = false) {
     boosting_ = boosting;
+    is_raw_score_ = is_raw_score;
+    is_predict_contrib_ = is_predict_contrib;
     num_features_ = boosting_->MaxFeatureIdx() + 1;
-#pragma omp parallel
-#pragma omp master
-    {
-      num_threads_ = omp_get_num_threads();
-    }
+    num_threads_ = Threading::NumThreads();
     for (int i = 0; i < num_threads_; ++i) {
       features_.push_back(std::vector<double>(num_features_));
     }
     features_.shrink_to_fit();
     if (is_predict_leaf_index) {
-      predict_fun_ = [this](const std::vector<std::pair<int, double>>& features) {
-        const int tid = PutFeatureValuesToBuffer(features);
+      predict_values_fun_ = [this](const double* feature_values) {
         // get result for leaf index
-        auto result = boosting_->PredictLeafIndex(features_[tid].data());
+        auto result = boosting_->PredictLeafIndex(feature_values);
         return std::vector<double>(result.begin(), result.end());
       };
+    } else if (is_predict_contrib) {
+      if (!boosting_->CanPredictContrib()) {
+        Log::Fatal("Contributions need the numbers of data of tree nodes, which are not in old model files");
+      }
+      predict_values_fun_ = [this](const double* feature_values) {
+        std::vector<double> result(NumContribOutputs());
+        boosting_->PredictContribForRows(feature_values, 1, result.data());
+        return result;
+      };
     } else {
       if (is_raw_score) {
-        predict_fun_ = [this](const std::vector<std::pair<int, double>>& features) {
-          const int tid = PutFeatureValuesToBuffer(features);
+        predict_values_fun_ = [this](const double* feature_values) {
           // get result without sigmoid transformation
-          return boosting_->PredictRaw(features_[tid].data());
+          return boosting_->PredictRaw(feature_values);
         };
       } else {
-        predict_fun_ = [this](const std::vector<std::pair<int, double>>& features) {
-          const int tid = PutFeatureValuesToBuffer(features);
-          return boosting_->Predict(features_[tid].data());
+        predict_values_fun_ = [this](const double* feature_values) {
+          return boosting_->Predict(feature_values);
         };
       }
     }
+    predict_fun_ = [this](const std::vector<std::pair<int, double>>& features) {
+      const int tid = PutFeatureValuesToBuffer(features);
+      auto result = predict_values_fun_(features_[tid].data());
+      ClearBuffer(features_[tid].data(), features);
+      return result;
+    };
   }
   /*!
   * \brief Destructor
@@ -97,61 +111,241 @@ public:
       Log::Fatal("Could not recognize the data format of data file %s", data_filename);
     }
 
-    // function for parse data
-    std::function<void(const char*, std::vector<std::pair<int, double>>*)> parser_fun;
-    double tmp_label;
-    parser_fun = [this, &parser, &tmp_label]
-    (const char* buffer, std::vector<std::pair<int, double>>* feature) {
-      parser->ParseOneLine(buffer, feature, &tmp_label);
+    // lines of dense formats are parsed straight into buffers of all feature values, they are overwritten by each line
+    const bool is_dense_format = parser->IsDenseFormat();
+    // each thread formats a contiguous range of lines into its own buffer, the buffers are written in order
+    // by the writer thread while the next block is parsed and predicted
+    const int num_threads = Threading::NumThreads();
+    std::vector<std::vector<char>> thread_buffers(num_threads);
+    std::vector<std::vector<std::pair<int, double>>> thread_features(num_threads);
+    std::vector<std::vector<double>> thread_values(is_dense_format ? num_threads : 0, std::vector<double>(num_features_));
+    std::unique_ptr<PipelineWriter> writer(new PipelineWriter(result_file));
+    std::function<void(data_size_t, const std::vector<const char*>&)> process_fun =
+      [this, &parser, is_dense_format, num_threads, &thread_buffers, &thread_features, &thread_values, &writer]
+    (data_size_t, const std::vector<const char*>& lines) {
+      const data_size_t num_lines = static_cast<data_size_t>(lines.size());
+      Threading::For<data_size_t>(0, num_lines, [&](int tid, data_size_t start, data_size_t end) {
+        std::vector<char>& buffer = thread_buffers[tid];
+        std::vector<std::pair<int, double>>& oneline_features = thread_features[tid];
+        double tmp_label;
+        for (data_size_t i = start; i < end; ++i) {
+          std::vector<double> result;
+          if (is_dense_format) {
+            parser->ParseOneLine(lines[i], num_features_, thread_values[tid].data(), &tmp_label);
+            result = predict_values_fun_(thread_values[tid].data());
+          } else {
+            oneline_features.clear();
+            parser->ParseOneLine(lines[i], &oneline_features, &tmp_label);
+            result = predict_fun_(oneline_features);
+          }
+          for (size_t j = 0; j < result.size(); ++j) {
+            if (j > 0) { buffer.push_back('\t'); }
+            PipelineWriter::AppendValue(result[j], &buffer);
+          }
+          buffer.push_back('\n');
+        }
+      });
+      writer->Write(&thread_buffers);
     };
+    TextReader<data_size_t> predict_data_reader(data_filename, has_header);
+    predict_data_reader.ReadAllAndProcessParallel(process_fun);
+    // wait for the last block
+    writer.reset(nullptr);
 
-    std::function<void(data_size_t, const std::vector<std::string>&)> process_fun =
-      [this, &parser_fun, &result_file]
-    (data_size_t, const std::vector<std::string>& lines) {
-      std::vector<std::pair<int, double>> oneline_features;
-      std::vector<std::string> pred_result(lines.size(), "");
-#pragma omp parallel for schedule(static) private(oneline_features)
-      for (data_size_t i = 0; i < static_cast<data_size_t>(lines.size()); ++i) {
-        oneline_features.clear();
-        // parser
-        parser_fun(lines[i].c_str(), &oneline_features);
-        // predict
-        pred_result[i] = Common::Join<double>(predict_fun_(oneline_features), '\t');
-      }
+    fclose(result_file);
+  }
 
-      for (size_t i = 0; i < pred_result.size(); ++i) {
-        fprintf(result_file, "%s\n", pred_result[i].c_str());
-      }
+  /*!
+  * \brief Predict leaf index of all data of a file in each used tree into memory, e.g. for refitting trees
+  * \param data_filename Filename of data
+  * \param has_header True if data file has header
+  * \param out_leaf_preds Leaf index, row-major with one value per tree
+  * \return Number of data
+  */
+  data_size_t PredictLeafIndex(const char* data_filename, bool has_header, std::vector<int>* out_leaf_preds) {
+    auto parser = std::unique_ptr<Parser>(Parser::CreateParser(data_filename, has_header, num_features_, boosting_->LabelIdx()));
+    if (parser == nullptr) {
+      Log::Fatal("Could not recognize the data format of data file %s", data_filename);
+    }
+    // buffers of features are all zeros here
+    const size_t num_models = boosting_->PredictLeafIndex(features_[0].data()).size();
+    out_leaf_preds->clear();
+    std::vector<std::vector<std::pair<int, double>>> thread_features(num_threads_);
+    std::function<void(data_size_t, const std::vector<const char*>&)> process_fun =
+      [this, &parser, num_models, &thread_features, out_leaf_preds]
+    (data_size_t start_idx, const std::vector<const char*>& lines) {
+      const data_size_t num_lines = static_cast<data_size_t>(lines.size());
+      out_leaf_preds->resize((static_cast<size_t>(start_idx) + num_lines) * num_models);
+      int* leaf_preds = out_leaf_preds->data() + static_cast<size_t>(start_idx) * num_models;
+      Threading::For<data_size_t>(0, num_lines, [&](int tid, data_size_t start, data_size_t end) {
+        std::vector<std::pair<int, double>>& oneline_features = thread_features[tid];
+        double tmp_label;
+        for (data_size_t i = start; i < end; ++i) {
+          oneline_features.clear();
+          parser->ParseOneLine(lines[i], &oneline_features, &tmp_label);
+          const int buffer_tid = PutFeatureValuesToBuffer(oneline_features);
+          const std::vector<int> result = boosting_->PredictLeafIndex(features_[buffer_tid].data());
+          ClearBuffer(features_[buffer_tid].data(), oneline_features);
+          std::copy(result.begin(), result.end(), leaf_preds + static_cast<size_t>(i) * num_models);
+        }
+      });
     };
     TextReader<data_size_t> predict_data_reader(data_filename, has_header);
-    predict_data_reader.ReadAllAndProcessParallel(process_fun);
+    return predict_data_reader.ReadAllAndProcessParallel(process_fun);
+  }
 
-    fclose(result_file);
+  /*!
+  * \brief Predict scores of rows in blocks, the rows of a block are pushed through blocks of trees together.
+  *        Leaf index prediction is not supported, use GetPredictFunction for it
+  * \param get_row_fun Function to get the features of a row
+  * \param num_rows Number of rows
+  * \param output Prediction results, row-major with NumberOfClasses() columns, or NumContribOutputs() for contributions
+  */
+  void PredictRows(const std::function<std::vector<std::pair<int, double>>(int row_idx)>& get_row_fun,
+    int num_rows, double* output) {
+    if (is_predict_contrib_) {
+      PredictRowsInBlocks(get_row_fun, num_rows, NumContribOutputs(),
+        [this](const double* buffer, int cnt, double* block_output) {
+        boosting_->PredictContribForRows(buffer, cnt, block_output);
+      }, output);
+      return;
+    }
+    PredictRowsInBlocks(get_row_fun, num_rows, boosting_->NumberOfClasses(),
+      [this](const double* buffer, int cnt, double* block_output) {
+      if (is_raw_score_) {
+        boosting_->PredictRawForRows(buffer, cnt, block_output);
+      } else {
+        boosting_->PredictForRows(buffer, cnt, block_output);
+      }
+    }, output);
+  }
+
+  /*!
+  * \brief Predict scores of rows after every period iterations, trees are walked once per row
+  * \param get_row_fun Function to get the features of a row
+  * \param num_rows Number of rows
+  * \param period Number of iterations between stages
+  * \param output Prediction results, row-major with NumberOfPredictStages(period) * NumberOfClasses() columns,
+  *        the stages of a row are contiguous
+  */
+  void PredictRowsStaged(const std::function<std::vector<std::pair<int, double>>(int row_idx)>& get_row_fun,
+    int num_rows, int period, double* output) {
+    if (is_predict_contrib_) {
+      Log::Fatal("Staged prediction doesn't support contributions");
+    }
+    const int num_outputs = boosting_->NumberOfPredictStages(period) * boosting_->NumberOfClasses();
+    PredictRowsInBlocks(get_row_fun, num_rows, num_outputs,
+      [this, period](const double* buffer, int cnt, double* block_output) {
+      if (is_raw_score_) {
+        boosting_->PredictRawStagedForRows(buffer, cnt, period, block_output);
+      } else {
+        boosting_->PredictStagedForRows(buffer, cnt, period, block_output);
+      }
+    }, output);
+  }
+
+  /*! \brief Number of outputs of a row of PredictRows */
+  inline int NumRowOutputs() const {
+    return is_predict_contrib_ ? NumContribOutputs() : boosting_->NumberOfClasses();
+  }
+
+  /*! \brief Number of contributions of a row, each class has the features and its expected value */
+  inline int NumContribOutputs() const {
+    return (num_features_ + 1) * boosting_->NumberOfClasses();
   }
 
 private:
+  /*! \brief Max number of rows in a block of PredictRows */
+  static const int kMaxBlockRows = 64;
+  /*! \brief Max size in byte of the feature values of a block of PredictRows */
+  static const size_t kBlockBufferSize = 64 * 1024;
+
+  /*!
+  * \brief Put rows into dense buffers block by block in parallel, and predict each block by predict_block_fun
+  * \param get_row_fun Function to get the features of a row
+  * \param num_rows Number of rows
+  * \param num_outputs Number of outputs of a row
+  * \param predict_block_fun Function of feature values, number of rows and outputs of a block
+  * \param output Outputs, row-major with num_outputs columns
+  */
+  void PredictRowsInBlocks(const std::function<std::vector<std::pair<int, double>>(int row_idx)>& get_row_fun,
+    int num_rows, int num_outputs, const std::function<void(const double*, int, double*)>& predict_block_fun,
+    double* output) {
+    // feature values of a block are kept in cache, so blocks are smaller for more features
+    const int block_size = static_cast<int>(std::max(static_cast<size_t>(1),
+      std::min(static_cast<size_t>(kMaxBlockRows), kBlockBufferSize / (sizeof(double) * num_features_))));
+    const int num_blocks = (num_rows + block_size - 1) / block_size;
+    // buffers are all zeros between blocks, only the non-zero features of rows are written and reset
+    std::vector<std::vector<double>> block_buffers(num_threads_);
+    std::vector<std::vector<std::vector<std::pair<int, double>>>> block_rows(num_threads_);
+    Threading::ParallelFor(0, num_blocks, [&](int i) {
+      const int tid = Threading::ThreadId();
+      std::vector<std::vector<std::pair<int, double>>>& rows = block_rows[tid];
+      rows.resize(block_size);
+      // rows with many features are predicted one by one in the buffer for single rows
+      double* buffer = features_[tid].data();
+      if (block_size > 1) {
+        block_buffers[tid].resize(static_cast<size_t>(block_size) * num_features_, 0.0f);
+        buffer = block_buffers[tid].data();
+      }
+      const int start = i * block_size;
+      const int cnt = std::min(block_size, num_rows - start);
+      for (int j = 0; j < cnt; ++j) {
+        rows[j] = get_row_fun(start + j);
+        PutFeatureValues(buffer + static_cast<size_t>(j) * num_features_, rows[j]);
+      }
+      predict_block_fun(buffer, cnt, output + static_cast<size_t>(start) * num_outputs);
+      for (int j = 0; j < cnt; ++j) {
+        ClearBuffer(buffer + static_cast<size_t>(j) * num_features_, rows[j]);
+      }
+    });
+  }
+
+  /*!
+  * \brief Put feature values of a row into the buffer of current thread, which should be all zeros.
+  *        So the cost is about the number of non-zero features instead of all features
+  * \return Id of current thread
+  */
   int PutFeatureValuesToBuffer(const std::vector<std::pair<int, double>>& features) {
-    int tid = omp_get_thread_num();
-    // init feature value
-    std::memset(features_[tid].data(), 0, sizeof(double)*num_features_);
-    // put feature value
+    int tid = Threading::ThreadId();
+    PutFeatureValues(features_[tid].data(), features);
+    return tid;
+  }
+
+  /*! \brief Put feature values into buffer, features out of the model are ignored */
+  inline void PutFeatureValues(double* buffer, const std::vector<std::pair<int, double>>& features) const {
     for (const auto& p : features) {
       if (p.first < num_features_) {
-        features_[tid][p.first] = p.second;
+        buffer[p.first] = p.second;
       }
     }
-    return tid;
   }
+
+  /*! \brief Reset the entries of features in buffer to zeros */
+  inline void ClearBuffer(double* buffer, const std::vector<std::pair<int, double>>& features) const {
+    for (const auto& p : features) {
+      if (p.first < num_features_) {
+        buffer[p.first] = 0.0f;
+      }
+    }
+  }
+
   /*! \brief Boosting model */
   const Boosting* boosting_;
-  /*! \brief Buffer for feature values */
+  /*! \brief Buffer for feature values of each thread, all zeros between predictions */
   std::vector<std::vector<double>> features_;
   /*! \brief Number of features */
   int num_features_;
   /*! \brief Number of threads */
   int num_threads_;
+  /*! \brief True if predict raw scores */
+  bool is_raw_score_;
+  /*! \brief True if predict contributions of features */
+  bool is_predict_contrib_;
   /*! \brief function for prediction */
   PredictFunction predict_fun_;
+  /*! \brief function for prediction on a buffer of all feature values */
+  std::function<std::vector<double>(const double*)> predict_values_fun_;
 };
 
 }  // namespace LightGBM
@@ -0,0 +1,537 @@
+#include <LightGBM/utils/common.h>
+#include <LightGBM/utils/log.h>
+#include <LightGBM/utils/random.h>
+#include <LightGBM/utils/tokenizer.h>
+
+#include <LightGBM/bin.h>
+#include <LightGBM/config.h>
+#include <LightGBM/feature.h>
+#include <LightGBM/tree.h>
+
+#include "../io/parser.hpp"
+#include "../treelearner/feature_histogram.hpp"
+#include "../treelearner/split_info.hpp"
+
+#include <omp.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace LightGBM {
+
+/*! \brief Parameters of synthetic inputs */
+struct BenchConfig: public ConfigBase {
+public:
+  /*! \brief Number of rows */
+  int num_data = 1000000;
+  /*! \brief Number of features, histograms of features are constructed in parallel */
+  int num_feature = 8;
+  /*! \brief Number of bins of each feature */
+  int num_bin = 255;
+  /*! \brief Fraction of zero values */
+  double sparse_rate = 0.0;
+  /*! \brief Number of threads, <= 0 means the default of OpenMP */
+  int num_threads = 0;
+  /*! \brief Number of measured runs of each benchmark, after one warm up run */
+  int repeat = 10;
+  /*! \brief Number of leaves of the tree for prediction */
+  int num_leaves = 255;
+  /*! \brief Number of lines for parsers */
+  int num_lines = 100000;
+  int seed = 1;
+  /*! \brief Only run benchmarks whose names contain it */
+  std::string filter = "";
+
+  void Set(const std::unordered_map<std::string, std::string>& params) override {
+    GetInt(params, "num_data", &num_data);
+    CHECK(num_data > 0);
+    GetInt(params, "num_feature", &num_feature);
+    CHECK(num_feature > 0);
+    GetInt(params, "num_bin", &num_bin);
+    CHECK(num_bin >= 2 && num_bin <= 65536);
+    GetDouble(params, "sparse_rate", &sparse_rate);
+    CHECK(sparse_rate >= 0.0 && sparse_rate < 1.0);
+    GetInt(params, "num_threads", &num_threads);
+    GetInt(params, "repeat", &repeat);
+    CHECK(repeat > 0);
+    GetInt(params, "num_leaves", &num_leaves);
+    CHECK(num_leaves >= 2);
+    GetInt(params, "num_lines", &num_lines);
+    CHECK(num_lines > 0);
+    GetInt(params, "seed", &seed);
+    GetString(params, "filter", &filter);
+  }
+};
+
+/*!
+* \brief Microbenchmarks of the core kernels on synthetic data.
+*        Every benchmark prints its best and average time of the measured runs, and the processed items per second
+*/
+class MicroBenchmark {
+public:
+  explicit MicroBenchmark(const BenchConfig& config) : config_(config), random_(config.seed) {
+    if (config_.num_threads > 0) {
+      omp_set_num_threads(config_.num_threads);
+    }
+    #pragma omp parallel
+    #pragma omp master
+    {
+      num_threads_ = omp_get_num_threads();
+    }
+  }
+
+  void Run() {
+    printf("num_data=%d num_feature=%d num_bin=%d sparse_rate=%g num_threads=%d\n",
+           config_.num_data, config_.num_feature, config_.num_bin, config_.sparse_rate, num_threads_);
+    printf("%-32s %12s %12s %14s\n", "benchmark", "best ms", "avg ms", "M items/s");
+    GenerateData();
+    BenchBins();
+    BenchFeatureHistograms();
+    BenchTree();
+    BenchFindBin();
+    BenchParsers();
+    BenchReducers();
+  }
+
+private:
+  /*! \brief Random bins and gradients, all features have the same sparse rate */
+  void GenerateData() {
+    const data_size_t num_data = config_.num_data;
+    bins_.resize(config_.num_feature);
+    for (int j = 0; j < config_.num_feature; ++j) {
+      bins_[j].resize(num_data);
+      for (data_size_t i = 0; i < num_data; ++i) {
+        if (random_.NextDouble() < config_.sparse_rate) {
+          bins_[j][i] = 0;
+        } else {
+          bins_[j][i] = static_cast<uint32_t>(random_.NextInt(1, config_.num_bin));
+        }
+      }
+    }
+    gradients_.resize(num_data);
+    hessians_.resize(num_data);
+    for (data_size_t i = 0; i < num_data; ++i) {
+      gradients_[i] = static_cast<score_t>(random_.NextDouble() - 0.5);
+      hessians_[i] = static_cast<score_t>(random_.NextDouble() * 0.25);
+    }
+    // a random half of the data stands for a leaf, with gradients ordered by the leaf
+    for (data_size_t i = 0; i < num_data; ++i) {
+      if (random_.NextDouble() < 0.5) {
+        leaf_indices_.push_back(i);
+      }
+    }
+    ordered_gradients_.resize(leaf_indices_.size());
+    ordered_hessians_.resize(leaf_indices_.size());
+    for (size_t i = 0; i < leaf_indices_.size(); ++i) {
+      ordered_gradients_[i] = gradients_[leaf_indices_[i]];
+      ordered_hessians_[i] = hessians_[leaf_indices_[i]];
+    }
+  }
+
+  /*! \brief Create the bins of all features by the given creator */
+  std::vector<std::unique_ptr<Bin>> CreateBins(const std::function<Bin*(data_size_t, int, int)>& create_bin) {
+    std::vector<std::unique_ptr<Bin>> bins(config_.num_feature);
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < config_.num_feature; ++j) {
+      bins[j].reset(create_bin(config_.num_data, config_.num_bin, 0));
+      for (data_size_t i = 0; i < config_.num_data; ++i) {
+        if (bins_[j][i] != 0) {
+          bins[j]->Push(omp_get_thread_num(), i, bins_[j][i]);
+        }
+      }
+      bins[j]->FinishLoad();
+    }
+    return bins;
+  }
+
+  /*! \brief Histograms of sparse bins are only constructed by their ordered bins */
+  void BenchBin(const std::string& prefix, const std::vector<std::unique_ptr<Bin>>& bins, bool is_dense) {
+    const int num_feature = config_.num_feature;
+    const int num_bin = config_.num_bin;
+    const data_size_t num_data = config_.num_data;
+    const data_size_t num_leaf_data = static_cast<data_size_t>(leaf_indices_.size());
+    std::vector<std::vector<HistogramBinEntry>> out(num_feature, std::vector<HistogramBinEntry>(num_bin));
+    if (is_dense) {
+      Measure(prefix + "_histogram_all", static_cast<double>(num_data) * num_feature, [&]() {
+        #pragma omp parallel for schedule(guided)
+        for (int j = 0; j < num_feature; ++j) {
+          std::memset(static_cast<void*>(out[j].data()), 0, sizeof(HistogramBinEntry) * num_bin);
+          bins[j]->ConstructHistogram(nullptr, num_data, gradients_.data(), hessians_.data(), out[j].data());
+        }
+      });
+      Measure(prefix + "_histogram_leaf", static_cast<double>(num_leaf_data) * num_feature, [&]() {
+        #pragma omp parallel for schedule(guided)
+        for (int j = 0; j < num_feature; ++j) {
+          std::memset(static_cast<void*>(out[j].data()), 0, sizeof(HistogramBinEntry) * num_bin);
+          bins[j]->ConstructHistogram(leaf_indices_.data(), num_leaf_data, ordered_gradients_.data(),
+                                      ordered_hessians_.data(), out[j].data());
+        }
+      });
+      // quantized like the tree learner, gradients in [-8, 8] and hessians in [0, 16]
+      std::vector<int8_t> ordered_grad_hess(2 * static_cast<size_t>(num_leaf_data));
+      for (data_size_t i = 0; i < num_leaf_data; ++i) {
+        ordered_grad_hess[2 * i] = static_cast<int8_t>(ordered_gradients_[i] * 16.0f);
+        ordered_grad_hess[2 * i + 1] = static_cast<int8_t>(ordered_hessians_[i] * 64.0f);
+      }
+      std::vector<std::vector<IntHistogramBinEntry>> int_out(num_feature, std::vector<IntHistogramBinEntry>(num_bin));
+      Measure(prefix + "_int_histogram_leaf", static_cast<double>(num_leaf_data) * num_feature, [&]() {
+        #pragma omp parallel for schedule(guided)
+        for (int j = 0; j < num_feature; ++j) {
+          std::memset(int_out[j].data(), 0, sizeof(IntHistogramBinEntry) * num_bin);
+          bins[j]->ConstructIntHistogram(leaf_indices_.data(), num_leaf_data, ordered_grad_hess.data(), int_out[j].data());
+        }
+      });
+    }
+    std::vector<std::vector<data_size_t>> indices(num_feature, std::vector<data_size_t>(num_leaf_data));
+    std::vector<std::vector<data_size_t>> lte_indices(num_feature, std::vector<data_size_t>(num_leaf_data));
+    std::vector<std::vector<data_size_t>> gt_indices(num_feature, std::vector<data_size_t>(num_leaf_data));
+    Measure(prefix + "_split", static_cast<double>(num_leaf_data) * num_feature, [&]() {
+      #pragma omp parallel for schedule(guided)
+      for (int j = 0; j < num_feature; ++j) {
+        std::memcpy(indices[j].data(), leaf_indices_.data(), sizeof(data_size_t) * num_leaf_data);
+        bins[j]->Split(static_cast<unsigned int>(num_bin / 2), indices[j].data(), num_leaf_data,
+                       lte_indices[j].data(), gt_indices[j].data());
+      }
+    });
+    std::vector<std::unique_ptr<OrderedBin>> ordered_bins(num_feature);
+    for (int j = 0; j < num_feature; ++j) {
+      ordered_bins[j].reset(bins[j]->CreateOrderedBin());
+    }
+    if (ordered_bins[0] == nullptr) { return; }
+    Measure(prefix + "_ordered_init", static_cast<double>(num_data) * num_feature, [&]() {
+      #pragma omp parallel for schedule(guided)
+      for (int j = 0; j < num_feature; ++j) {
+        ordered_bins[j]->Init(nullptr, 1);
+      }
+    });
+    // the data of the leaf stand for a bag, which is cached for the trees of the same bag
+    std::vector<char> is_in_bag(num_data, 0);
+    for (data_size_t idx : leaf_indices_) {
+      is_in_bag[idx] = 1;
+    }
+    Measure(prefix + "_ordered_init_bag", static_cast<double>(num_data) * num_feature, [&]() {
+      #pragma omp parallel for schedule(guided)
+      for (int j = 0; j < num_feature; ++j) {
+        ordered_bins[j]->Init(is_in_bag.data(), 1);
+      }
+    });
+    for (int j = 0; j < num_feature; ++j) {
+      ordered_bins[j]->CacheUsedData();
+    }
+    Measure(prefix + "_ordered_init_cached", static_cast<double>(num_data) * num_feature, [&]() {
+      #pragma omp parallel for schedule(guided)
+      for (int j = 0; j < num_feature; ++j) {
+        ordered_bins[j]->InitFromCache(1);
+      }
+    });
+    for (int j = 0; j < num_feature; ++j) {
+      ordered_bins[j]->Init(nullptr, 1);
+    }
+    Measure(prefix + "_ordered_histogram", static_cast<double>(num_data) * num_feature, [&]() {
+      #pragma omp parallel for schedule(guided)
+      for (int j = 0; j < num_feature; ++j) {
+        std::memset(static_cast<void*>(out[j].data()), 0, sizeof(HistogramBinEntry) * num_bin);
+        ordered_bins[j]->ConstructHistogram(0, gradients_.data(), hessians_.data(), out[j].data());
+      }
+    });
+  }
+
+  void BenchBins() {
+    if (IsSelected({ "dense_histogram_all", "dense_histogram_leaf", "dense_int_histogram_leaf", "dense_split" })) {
+      BenchBin("dense", CreateBins([](data_size_t num_data, int num_bin, int default_bin) {
+        return Bin::CreateDenseBin(num_data, num_bin, default_bin);
+      }), true);
+    }
+    if (IsSelected({ "sparse_split", "sparse_ordered_init", "sparse_ordered_init_bag",
+                     "sparse_ordered_init_cached", "sparse_ordered_histogram" })) {
+      BenchBin("sparse", CreateBins(&Bin::CreateSparseBin), false);
+    }
+  }
+
+  void BenchFeatureHistograms() {
+    if (!IsSelected({ "feature_histogram_subtract", "feature_histogram_find_threshold" })) { return; }
+    // feature values are the bins, so every bin has its own value
+    std::vector<double> sample_values;
+    for (data_size_t i = 0; i < config_.num_data; ++i) {
+      if (bins_[0][i] != 0) {
+        sample_values.push_back(static_cast<double>(bins_[0][i]));
+      }
+    }
+    BinMapper* bin_mapper = new BinMapper();
+    bin_mapper->FindBin(&sample_values, config_.num_data, config_.num_bin);
+    Feature feature(0, bin_mapper, config_.num_data, false);
+    for (data_size_t i = 0; i < config_.num_data; ++i) {
+      feature.PushData(0, i, static_cast<double>(bins_[0][i]));
+    }
+    feature.FinishLoad();
+    const int num_histograms = 64;
+    std::vector<FeatureHistogram> parents(num_histograms);
+    std::vector<FeatureHistogram> children(num_histograms);
+    double sum_gradients = 0.0;
+    double sum_hessians = 0.0;
+    for (data_size_t i = 0; i < config_.num_data; ++i) {
+      sum_gradients += gradients_[i];
+      sum_hessians += hessians_[i];
+    }
+    for (int i = 0; i < num_histograms; ++i) {
+      parents[i].Init(&feature, 0, 20, 1e-3, 0.0, 0.0, 0.0);
+      children[i].Init(&feature, 0, 20, 1e-3, 0.0, 0.0, 0.0);
+      parents[i].Construct(nullptr, config_.num_data, sum_gradients, sum_hessians, gradients_.data(), hessians_.data());
+      children[i].Construct(nullptr, config_.num_data, sum_gradients, sum_hessians, gradients_.data(), hessians_.data());
+    }
+    const double num_items = static_cast<double>(feature.num_bin()) * num_histograms;
+    Measure("feature_histogram_subtract", num_items, [&]() {
+      #pragma omp parallel for schedule(static)
+      for (int i = 0; i < num_histograms; ++i) {
+        parents[i].Subtract(children[i]);
+      }
+    });
+    // subtracted histograms are meaningless, construct them again
+    for (int i = 0; i < num_histograms; ++i) {
+      parents[i].Construct(nullptr, config_.num_data, sum_gradients, sum_hessians, gradients_.data(), hessians_.data());
+    }
+    std::vector<SplitInfo> splits(num_histograms);
+    Measure("feature_histogram_find_threshold", num_items, [&]() {
+      #pragma omp parallel for schedule(static)
+      for (int i = 0; i < num_histograms; ++i) {
+        parents[i].FindBestThreshold(&splits[i]);
+      }
+    });
+  }
+
+  void BenchTree() {
+    if (!IsSelected({ "tree_predict_leaf_index" })) { return; }
+    const int num_feature = config_.num_feature;
+    // grow a random tree by splitting random leaves
+    Tree tree(config_.num_leaves);
+    for (int i = 1; i < config_.num_leaves; ++i) {
+      const int leaf = static_cast<int>(random_.NextInt(0, tree.num_leaves()));
+      const int feature = static_cast<int>(random_.NextInt(0, num_feature));
+      const unsigned int threshold = static_cast<unsigned int>(random_.NextInt(0, config_.num_bin));
+      tree.Split(leaf, feature, threshold, feature, threshold + 0.5, random_.NextDouble(), random_.NextDouble(), 1, 1, 1.0);
+    }
+    tree.Flatten();
+    const data_size_t num_data = config_.num_data;
+    std::vector<double> rows(static_cast<size_t>(num_data) * num_feature);
+    for (data_size_t i = 0; i < num_data; ++i) {
+      for (int j = 0; j < num_feature; ++j) {
+        rows[static_cast<size_t>(i) * num_feature + j] = bins_[j][i];
+      }
+    }
+    std::vector<int> leaves(num_data);
+    Measure("tree_predict_leaf_index", num_data, [&]() {
+      #pragma omp parallel for schedule(static)
+      for (data_size_t i = 0; i < num_data; ++i) {
+        leaves[i] = tree.PredictLeafIndex(rows.data() + static_cast<size_t>(i) * num_feature);
+      }
+    });
+  }
+
+  void BenchFindBin() {
+    if (!IsSelected({ "find_bin" })) { return; }
+    // continuous values, so most of them are distinct
+    const int kSampleCnt = std::min(config_.num_data, 50000);
+    std::vector<std::vector<double>> samples(config_.num_feature);
+    for (int j = 0; j < config_.num_feature; ++j) {
+      for (int i = 0; i < kSampleCnt; ++i) {
+        if (random_.NextDouble() >= config_.sparse_rate) {
+          samples[j].push_back(random_.NextDouble() * 100.0 - 50.0);
+        }
+      }
+    }
+    std::vector<BinMapper> bin_mappers(config_.num_feature);
+    Measure("find_bin", static_cast<double>(kSampleCnt) * config_.num_feature, [&]() {
+      #pragma omp parallel for schedule(guided)
+      for (int j = 0; j < config_.num_feature; ++j) {
+        // FindBin sorts the values, so copy them
+        std::vector<double> values = samples[j];
+        bin_mappers[j].FindBin(&values, kSampleCnt, config_.num_bin);
+      }
+    });
+  }
+
+  void BenchParser(const std::string& name, const Parser* parser, const std::vector<std::string>& lines) {
+    const int num_lines = static_cast<int>(lines.size());
+    Measure(name, num_lines, [&]() {
+      #pragma omp parallel for schedule(static)
+      for (int i = 0; i < num_lines; ++i) {
+        std::vector<std::pair<int, double>> features;
+        double label = 0.0;
+        parser->ParseOneLine(lines[i].c_str(), &features, &label);
+      }
+    });
+    // straight into a buffer of all feature values
+    Measure(name + "_values", num_lines, [&]() {
+      #pragma omp parallel
+      {
+        std::vector<double> values(config_.num_feature);
+        double label = 0.0;
+        #pragma omp for schedule(static)
+        for (int i = 0; i < num_lines; ++i) {
+          parser->ParseOneLine(lines[i].c_str(), config_.num_feature, values.data(), &label);
+        }
+      }
+    });
+  }
+
+  void BenchSplitLines(const std::vector<std::string>& lines) {
+    std::string text;
+    for (const auto& line : lines) {
+      text += line;
+      text += '\n';
+    }
+    const int num_lines = static_cast<int>(lines.size());
+    Measure("split_lines", num_lines, [&]() {
+      const char* end = text.data() + text.size();
+      int cnt = 0;
+      for (const char* p = text.data(); p < end; ++p) {
+        p = Tokenizer::FindEndOfLine(p, end);
+        ++cnt;
+      }
+      CHECK(cnt == num_lines);
+    });
+  }
+
+  void BenchParsers() {
+    if (!IsSelected({ "parse_csv", "parse_tsv", "parse_libsvm", "split_lines" })) { return; }
+    const int num_lines = std::min(config_.num_lines, config_.num_data);
+    std::vector<std::string> csv_lines(num_lines);
+    std::vector<std::string> tsv_lines(num_lines);
+    std::vector<std::string> libsvm_lines(num_lines);
+    char buf[64];
+    for (int i = 0; i < num_lines; ++i) {
+      const double label = static_cast<double>(i % 2);
+      snprintf(buf, sizeof(buf), "%g", label);
+      csv_lines[i] = tsv_lines[i] = libsvm_lines[i] = buf;
+      for (int j = 0; j < config_.num_feature; ++j) {
+        const double value = bins_[j][i] == 0 ? 0.0 : bins_[j][i] + random_.NextDouble();
+        snprintf(buf, sizeof(buf), "%.6g", value);
+        csv_lines[i] += ',';
+        csv_lines[i] += buf;
+        tsv_lines[i] += '\t';
+        tsv_lines[i] += buf;
+        if (value != 0.0) {
+          snprintf(buf, sizeof(buf), " %d:%.6g", j, value);
+          libsvm_lines[i] += buf;
+        }
+      }
+    }
+    CSVParser csv_parser(0);
+    TSVParser tsv_parser(0);
+    LibSVMParser libsvm_parser(0);
+    BenchParser("parse_csv", &csv_parser, csv_lines);
+    BenchParser("parse_tsv", &tsv_parser, tsv_lines);
+    BenchParser("parse_libsvm", &libsvm_parser, libsvm_lines);
+    BenchSplitLines(csv_lines);
+  }
+
+  void BenchReducers() {
+    if (!IsSelected({ "reduce_histogram_sum", "reduce_split_max" })) { return; }
+    // histograms of all features, as reduced by data parallel learning
+    const int num_entries = config_.num_feature * config_.num_bin;
+    std::vector<HistogramBinEntry> src(num_entries);
+    std::vector<HistogramBinEntry> dst(num_entries);
+    for (int i = 0; i < num_entries; ++i) {
+      src[i].sum_gradients = random_.NextDouble();
+      src[i].sum_hessians = random_.NextDouble();
+      src[i].cnt = static_cast<data_size_t>(random_.NextInt(0, 1000));
+    }
+    const int kNumReduce = 100;
+    const int hist_len = static_cast<int>(sizeof(HistogramBinEntry)) * num_entries;
+    Measure("reduce_histogram_sum", static_cast<double>(num_entries) * kNumReduce, [&]() {
+      for (int k = 0; k < kNumReduce; ++k) {
+        HistogramBinEntry::SumReducer(reinterpret_cast<const char*>(src.data()),
+                                      reinterpret_cast<char*>(dst.data()), hist_len);
+      }
+    });
+    const int kNumSplits = 1024;
+    std::vector<SplitInfo> src_splits(kNumSplits);
+    std::vector<SplitInfo> dst_splits(kNumSplits);
+    for (int i = 0; i < kNumSplits; ++i) {
+      src_splits[i].feature = i;
+      src_splits[i].gain = random_.NextDouble();
+      dst_splits[i].feature = i;
+      dst_splits[i].gain = random_.NextDouble();
+    }
+    const int split_len = static_cast<int>(sizeof(SplitInfo)) * kNumSplits;
+    Measure("reduce_split_max", static_cast<double>(kNumSplits) * kNumReduce, [&]() {
+      for (int k = 0; k < kNumReduce; ++k) {
+        SplitInfo::MaxReducer(reinterpret_cast<const char*>(src_splits.data()),
+                              reinterpret_cast<char*>(dst_splits.data()), split_len);
+      }
+    });
+  }
+
+  /*! \brief True if any of the benchmarks is selected by the filter, used to skip generating their inputs */
+  inline bool IsSelected(const std::vector<std::string>& names) const {
+    for (const auto& name : names) {
+      if (name.find(config_.filter) != std::string::npos) { return true; }
+    }
+    return false;
+  }
+
+  /*! \brief Run fun once to warm up, then measure config_.repeat runs */
+  void Measure(const std::string& name, double num_items, const std::function<void()>& fun) {
+    if (name.find(config_.filter) == std::string::npos) { return; }
+    fun();
+    double best_ms = 0.0;
+    double total_ms = 0.0;
+    for (int i = 0; i < config_.repeat; ++i) {
+      auto start_time = std::chrono::steady_clock::now();
+      fun();
+      auto end_time = std::chrono::steady_clock::now();
+      const double ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+      best_ms = (i == 0) ? ms : std::min(best_ms, ms);
+      total_ms += ms;
+    }
+    printf("%-32s %12.3f %12.3f %14.3f\n", name.c_str(), best_ms, total_ms / config_.repeat,
+           best_ms > 0.0 ? num_items / best_ms * 1e-3 : 0.0);
+    fflush(stdout);
+  }
+
+  BenchConfig config_;
+  Random random_;
+  int num_threads_;
+  /*! \brief Bins of each feature, 0 is the zero bin */
+  std::vector<std::vector<uint32_t>> bins_;
+  std::vector<score_t> gradients_;
+  std::vector<score_t> hessians_;
+  /*! \brief Data in the leaf for the benchmarks of part of data */
+  std::vector<data_size_t> leaf_indices_;
+  std::vector<score_t> ordered_gradients_;
+  std::vector<score_t> ordered_hessians_;
+};
+
+}  // namespace LightGBM
+
+int main(int argc, char** argv) {
+  try {
+    std::unordered_map<std::string, std::string> params;
+    for (int i = 1; i < argc; ++i) {
+      std::vector<std::string> tmp_strs = LightGBM::Common::Split(argv[i], '=');
+      if (tmp_strs.size() == 2) {
+        params[LightGBM::Common::Trim(tmp_strs[0])] = LightGBM::Common::Trim(tmp_strs[1]);
+      } else {
+        LightGBM::Log::Warning("Unknown parameter in command line: %s", argv[i]);
+      }
+    }
+    LightGBM::BenchConfig config;
+    config.Set(params);
+    LightGBM::MicroBenchmark bench(config);
+    bench.Run();
+  }
+  catch (const std::exception& ex) {
+    std::cerr << "Met Exceptions:" << std::endl;
+    std::cerr << ex.what() << std::endl;
+    exit(-1);
+  }
+}
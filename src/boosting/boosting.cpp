@@ -1,6 +1,12 @@
 #include <LightGBM/boosting.h>
 #include "gbdt.h"
 #include "dart.hpp"
+#include "goss.hpp"
+
+#include <LightGBM/utils/mapped_file.h>
+
+#include <cstring>
+#include <string>
 
 namespace LightGBM {
 
@@ -11,12 +17,27 @@ BoostingType GetBoostingTypeFromModelFile(const char* filename) {
     return BoostingType::kGBDT;
   } else if (type == std::string("dart")) {
     return BoostingType::kDART;
+  } else if (type == std::string("goss")) {
+    return BoostingType::kGOSS;
   }
   return BoostingType::kUnknow;
 }
 
+bool IsBinaryModelFile(const MappedFile& mapped_file) {
+  const std::string version_key = "binary_model_version=";
+  const char* ptr = reinterpret_cast<const char*>(std::memchr(mapped_file.data(), '\n', mapped_file.size()));
+  return ptr != nullptr && static_cast<size_t>(mapped_file.data() + mapped_file.size() - ptr - 1) >= version_key.size()
+    && std::strncmp(ptr + 1, version_key.c_str(), version_key.size()) == 0;
+}
+
 void LoadFileToBoosting(Boosting* boosting, const char* filename) {
   if (boosting != nullptr) {
+    // binary model files are read from the mapped file without parsing
+    MappedFile mapped_file(filename);
+    if (mapped_file.is_open() && IsBinaryModelFile(mapped_file)) {
+      boosting->LoadModelFromBinary(mapped_file.data(), mapped_file.size());
+      return;
+    }
     TextReader<size_t> model_reader(filename, true);
     model_reader.ReadAllLines();
     std::stringstream str_buf;
@@ -33,6 +54,8 @@ Boosting* Boosting::CreateBoosting(BoostingType type, const char* filename) {
       return new GBDT();
     } else if (type == BoostingType::kDART) {
       return new DART();
+    } else if (type == BoostingType::kGOSS) {
+      return new GOSS();
     } else {
       return nullptr;
     }
@@ -44,6 +67,8 @@ Boosting* Boosting::CreateBoosting(BoostingType type, const char* filename) {
         ret.reset(new GBDT());
       } else if (type == BoostingType::kDART) {
         ret.reset(new DART());
+      } else if (type == BoostingType::kGOSS) {
+        ret.reset(new GOSS());
       }
       LoadFileToBoosting(ret.get(), filename);
     } else {
@@ -60,6 +85,8 @@ Boosting* Boosting::CreateBoosting(const char* filename) {
     ret.reset(new GBDT());
   } else if (type == BoostingType::kDART) {
     ret.reset(new DART());
+  } else if (type == BoostingType::kGOSS) {
+    ret.reset(new GOSS());
   }
   LoadFileToBoosting(ret.get(), filename);
   return ret.release();
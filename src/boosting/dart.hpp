@@ -38,12 +38,28 @@ public:
     drop_rate_ = gbdt_config_->drop_rate;
     shrinkage_rate_ = 1.0;
     random_for_drop_ = Random(gbdt_config_->drop_seed);
+    // training scores are changed by dropping trees before calculating gradients
+    is_fuse_gradients_ = false;
+  }
+  /*! \brief Continue training after rows are appended to the training data */
+  void AppendTrainingData(const ObjectiveFunction* object_function,
+    const std::vector<const Metric*>& training_metrics, data_size_t num_old_data) override {
+    GBDT::AppendTrainingData(object_function, training_metrics, num_old_data);
+    // leaf index cached on the training data is cleared by appending
+    if (gbdt_config_->is_cache_dart_leaf_index) {
+      for (int i = 0; i < num_cached_models_; ++i) {
+        train_score_updater_->CacheLeafIndex(models_[i].get(), i);
+      }
+    }
   }
   /*!
   * \brief one training iteration
   */
   bool TrainOneIter(const score_t* gradient, const score_t* hessian, bool is_eval) override {
     GBDT::TrainOneIter(gradient, hessian, false);
+    if (gbdt_config_->is_cache_dart_leaf_index) {
+      CacheLeafIndexOfNewTrees();
+    }
     // normalize
     Normalize();
     if (is_eval) {
@@ -79,6 +95,25 @@ public:
   */
   const char* Name() const override { return "dart"; }
 
+protected:
+  /*!
+  * \brief Get the states of random generators for checkpoints
+  * \return States of GBDT and the generator for dropping trees
+  */
+  std::vector<std::string> GetRandomStates() const override {
+    std::vector<std::string> states = GBDT::GetRandomStates();
+    states.push_back(random_for_drop_.GetState());
+    return states;
+  }
+  /*!
+  * \brief Restore the states of random generators from a checkpoint
+  * \param states States from GetRandomStates
+  */
+  void SetRandomStates(const std::vector<std::string>& states) override {
+    GBDT::SetRandomStates(states);
+    random_for_drop_.SetState(states.back());
+  }
+
 private:
   /*!
   * \brief drop trees based on drop_rate
@@ -103,7 +138,7 @@ private:
       for (int curr_class = 0; curr_class < num_class_; ++curr_class) {
         auto curr_tree = i * num_class_ + curr_class;
         models_[curr_tree]->Shrinkage(-1.0);
-        train_score_updater_->AddScore(models_[curr_tree].get(), curr_class);
+        AddTreeScore(train_score_updater_.get(), curr_tree, curr_class);
       }
     }
     shrinkage_rate_ = 1.0 / (1.0 + drop_index_.size());
@@ -119,14 +154,42 @@ private:
         // update validation score
         models_[curr_tree]->Shrinkage(shrinkage_rate_);
         for (auto& score_updater : valid_score_updater_) {
-          score_updater->AddScore(models_[curr_tree].get(), curr_class);
+          AddTreeScore(score_updater.get(), curr_tree, curr_class);
         }
         // update training score
         models_[curr_tree]->Shrinkage(-k);
-        train_score_updater_->AddScore(models_[curr_tree].get(), curr_class);
+        AddTreeScore(train_score_updater_.get(), curr_tree, curr_class);
       }
     }
   }
+  /*!
+  * \brief Cache leaf index of trees added in this iteration on training and validation data,
+  *        the structure of a tree is fixed after it is added, only its leaf outputs are scaled
+  */
+  void CacheLeafIndexOfNewTrees() {
+    for (int i = num_cached_models_; i < static_cast<int>(models_.size()); ++i) {
+      train_score_updater_->CacheLeafIndex(models_[i].get(), i);
+      for (auto& score_updater : valid_score_updater_) {
+        score_updater->CacheLeafIndex(models_[i].get(), i);
+      }
+    }
+    num_cached_models_ = static_cast<int>(models_.size());
+  }
+  /*!
+  * \brief Add current outputs of a tree to scores, by the cached leaf index if enabled
+  * \param score_updater Scores to update
+  * \param tree_idx Index of the tree in models_
+  * \param curr_class Current class for multiclass training
+  */
+  void AddTreeScore(ScoreUpdater* score_updater, int tree_idx, int curr_class) {
+    if (gbdt_config_->is_cache_dart_leaf_index) {
+      score_updater->AddScoreByCachedLeafIndex(models_[tree_idx].get(), tree_idx, curr_class);
+    } else {
+      score_updater->AddScore(models_[tree_idx].get(), curr_class);
+    }
+  }
+  /*! \brief Number of trees whose leaf index is cached */
+  int num_cached_models_ = 0;
   /*! \brief The indexes of dropping trees */
   std::vector<int> drop_index_;
   /*! \brief Dropping rate */
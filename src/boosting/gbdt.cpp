@@ -1,14 +1,25 @@
 #include "gbdt.h"
 
 #include <LightGBM/utils/common.h>
+#include <LightGBM/utils/mapped_file.h>
+#include <LightGBM/utils/profiler.h>
+#include <LightGBM/utils/threading.h>
 
 #include <LightGBM/feature.h>
 #include <LightGBM/objective_function.h>
 #include <LightGBM/metric.h>
 
+#include <omp.h>
+
+#include <cmath>
 #include <ctime>
+#include <cstdio>
+#include <cstring>
 
 #include <sstream>
+#include <iomanip>
+#include <limits>
+#include <algorithm>
 #include <chrono>
 #include <string>
 #include <vector>
@@ -16,17 +27,34 @@
 
 namespace LightGBM {
 
-GBDT::GBDT() : saved_model_size_(-1), num_used_model_(0) {
+GBDT::GBDT() : train_data_(nullptr), saved_model_size_(-1), num_used_model_(0), is_profiler_enabled_(false),
+  is_predict_on_bins_(false), num_concurrent_classes_(1),
+  is_fuse_gradients_(false), is_gradients_updated_(false),
+  predict_early_stop_period_(0), predict_early_stop_margin_(0.0f) {
 
 }
 
 GBDT::~GBDT() {
-
+  if (async_metric_thread_.joinable()) {
+    async_metric_thread_.join();
+  }
+  if (is_profiler_enabled_) {
+    Profiler::Disable();
+  }
 }
 
 void GBDT::Init(const BoostingConfig* config, const Dataset* train_data, const ObjectiveFunction* object_function,
      const std::vector<const Metric*>& training_metrics) {
   gbdt_config_ = config;
+  // other boosters of the process may still use the profiler, so only release the enable of this one
+  if (gbdt_config_->is_enable_profiler != is_profiler_enabled_) {
+    if (gbdt_config_->is_enable_profiler) {
+      Profiler::Enable();
+    } else {
+      Profiler::Disable();
+    }
+    is_profiler_enabled_ = gbdt_config_->is_enable_profiler;
+  }
   iter_ = 0;
   saved_model_size_ = -1;
   num_used_model_ = 0;
@@ -35,14 +63,9 @@ void GBDT::Init(const BoostingConfig* config, const Dataset* train_data, const O
   shrinkage_rate_ = gbdt_config_->learning_rate;
   train_data_ = train_data;
   num_class_ = config->num_class;
-  // create tree learner
-  for (int i = 0; i < num_class_; ++i) {
-    auto new_tree_learner = std::unique_ptr<TreeLearner>(TreeLearner::CreateTreeLearner(gbdt_config_->tree_learner_type, gbdt_config_->tree_config));
-    new_tree_learner->Init(train_data_);
-    // init tree learner
-    tree_learner_.push_back(std::move(new_tree_learner));
-  }
-  tree_learner_.shrink_to_fit();
+  num_data_ = train_data_->num_data();
+  const bool is_bagging = gbdt_config_->bagging_fraction < 1.0 && gbdt_config_->bagging_freq > 0;
+  ResetTreeLearners(is_bagging);
   object_function_ = object_function;
   // push training metrics
   for (const auto& metric : training_metrics) {
@@ -51,7 +74,6 @@ void GBDT::Init(const BoostingConfig* config, const Dataset* train_data, const O
   training_metrics_.shrink_to_fit();
   // create score tracker
   train_score_updater_.reset(new ScoreUpdater(train_data_, num_class_));
-  num_data_ = train_data_->num_data();
   // create buffer for gradients and hessians
   if (object_function_ != nullptr) {
     gradients_ = std::vector<score_t>(num_data_ * num_class_);
@@ -68,7 +90,7 @@ void GBDT::Init(const BoostingConfig* config, const Dataset* train_data, const O
   // get label index
   label_idx_ = train_data_->label_idx();
   // if need bagging, create buffer
-  if (gbdt_config_->bagging_fraction < 1.0 && gbdt_config_->bagging_freq > 0) {
+  if (is_bagging) {
     out_of_bag_data_indices_ = std::vector<data_size_t>(num_data_);
     bag_data_indices_ = std::vector<data_size_t>(num_data_);
   } else {
@@ -79,7 +101,51 @@ void GBDT::Init(const BoostingConfig* config, const Dataset* train_data, const O
   }
   // initialize random generator
   random_ = Random(gbdt_config_->bagging_seed);
+  // scores of other classes are needed by gradients of multiclass objectives
+  is_fuse_gradients_ = gbdt_config_->is_fuse_gradients && object_function_ != nullptr && object_function_->IsFusedGradientsSupported()
+    && num_class_ == 1 && bag_data_indices_.empty();
+  is_gradients_updated_ = false;
+  async_metric_iter_ = -1;
+  is_async_metric_early_stopping_ = false;
+  num_concurrent_classes_ = std::min(gbdt_config_->num_concurrent_classes, num_class_);
+  if (num_concurrent_classes_ > 1
+    && (gbdt_config_->tree_learner_type != TreeLearnerType::kSerialTreeLearner || !bag_data_indices_.empty())) {
+    Log::Warning("Classes can be trained concurrently only with the serial tree learner without bagging");
+    num_concurrent_classes_ = 1;
+  }
+  CheckMemoryBudget();
+}
 
+void GBDT::ResetTreeLearners(bool is_bagging) {
+  // memory left to tree learners: the budget without data, gradients, hessians, scores and bagging indices
+  double learner_memory_budget = -1.0f;
+  if (gbdt_config_->max_memory > 0) {
+    learner_memory_budget = gbdt_config_->max_memory * 1024 * 1024
+      - static_cast<double>(train_data_->FeaturesSizesInByte() + train_data_->metadata().SizesInByte())
+      - 3.0f * num_data_ * num_class_ * sizeof(score_t);
+    if (is_bagging) {
+      learner_memory_budget -= 2.0f * num_data_ * sizeof(data_size_t);
+    }
+  }
+  // release the old tree learners first
+  tree_learner_.clear();
+  // create tree learner
+  for (int i = 0; i < num_class_; ++i) {
+    auto new_tree_learner = std::unique_ptr<TreeLearner>(TreeLearner::CreateTreeLearner(gbdt_config_->tree_learner_type, gbdt_config_->tree_config));
+    if (gbdt_config_->max_memory > 0) {
+      // learners of the rest classes share the budget left
+      new_tree_learner->SetMemoryBudget(std::max(learner_memory_budget / (num_class_ - i), 0.0));
+    }
+    new_tree_learner->Init(train_data_);
+    if (gbdt_config_->max_memory > 0) {
+      MemoryUsage learner_memory_usage;
+      new_tree_learner->AddMemoryUsage(&learner_memory_usage);
+      learner_memory_budget -= static_cast<double>(learner_memory_usage.Total());
+    }
+    // init tree learner
+    tree_learner_.push_back(std::move(new_tree_learner));
+  }
+  tree_learner_.shrink_to_fit();
 }
 
 void GBDT::AddDataset(const Dataset* valid_data,
@@ -103,6 +169,44 @@ void GBDT::AddDataset(const Dataset* valid_data,
     }
   }
   valid_metrics_.back().shrink_to_fit();
+  CheckMemoryBudget();
+}
+
+MemoryUsage GBDT::GetMemoryUsage() const {
+  MemoryUsage memory_usage;
+  // only models for loaded models
+  if (train_data_ != nullptr) {
+    memory_usage.Add(kFeaturesMemory, train_data_->FeaturesSizesInByte());
+    memory_usage.Add(kMetadataMemory, train_data_->metadata().SizesInByte());
+    memory_usage.Add(kScoresMemory, train_score_updater_->SizesInByte());
+  }
+  for (const auto& score_updater : valid_score_updater_) {
+    memory_usage.Add(kValidDataMemory, score_updater->data()->FeaturesSizesInByte()
+      + score_updater->data()->metadata().SizesInByte());
+    memory_usage.Add(kScoresMemory, score_updater->SizesInByte());
+  }
+  memory_usage.Add(kGradientsMemory, (gradients_.capacity() + hessians_.capacity()) * sizeof(score_t)
+    + (bag_data_indices_.capacity() + out_of_bag_data_indices_.capacity()) * sizeof(data_size_t));
+  memory_usage.Add(kScoresMemory, async_train_score_.capacity() * sizeof(score_t));
+  for (const auto& score : async_valid_scores_) {
+    memory_usage.Add(kScoresMemory, score.capacity() * sizeof(score_t));
+  }
+  for (const auto& tree : models_) {
+    memory_usage.Add(kModelsMemory, tree->SizesInByte());
+  }
+  for (const auto& tree_learner : tree_learner_) {
+    tree_learner->AddMemoryUsage(&memory_usage);
+  }
+  return memory_usage;
+}
+
+void GBDT::CheckMemoryBudget() const {
+  if (gbdt_config_->max_memory <= 0) { return; }
+  const MemoryUsage memory_usage = GetMemoryUsage();
+  if (memory_usage.Total() > gbdt_config_->max_memory * 1024 * 1024) {
+    Log::Warning("Memory usage is more than max_memory %f MB: %s", gbdt_config_->max_memory,
+      memory_usage.ToString().c_str());
+  }
 }
 
 
@@ -111,19 +215,36 @@ void GBDT::Bagging(int iter, const int curr_class) {
   if (out_of_bag_data_indices_.size() > 0 && iter % gbdt_config_->bagging_freq == 0) {
     // if doesn't have query data
     if (train_data_->metadata().query_boundaries() == nullptr) {
-      bag_data_cnt_ =
-        static_cast<data_size_t>(gbdt_config_->bagging_fraction * num_data_);
+      const double bagging_fraction = gbdt_config_->bagging_fraction;
+      bag_data_cnt_ = static_cast<data_size_t>(bagging_fraction * num_data_);
       out_of_bag_data_cnt_ = num_data_ - bag_data_cnt_;
-      data_size_t cur_left_cnt = 0;
-      data_size_t cur_right_cnt = 0;
-      // random bagging, minimal unit is one record
-      for (data_size_t i = 0; i < num_data_; ++i) {
-        double prob =
-          (bag_data_cnt_ - cur_left_cnt) / static_cast<double>(num_data_ - i);
-        if (random_.NextDouble() < prob) {
-          bag_data_indices_[cur_left_cnt++] = i;
-        } else {
-          out_of_bag_data_indices_[cur_right_cnt++] = i;
+      // random bagging, minimal unit is one record. Blocks are sampled in parallel with their own generators,
+      // each block takes a fixed number of data, so the output positions of blocks are known in advance
+      // and the result only depends on the seed
+      const data_size_t block_size = kBaggingBlockSize;
+      const int num_blocks = static_cast<int>((num_data_ + block_size - 1) / block_size);
+      const int seed = static_cast<int>(random_.NextInt(0, 1 << 30));
+      const double kInverseUInt32Range = 1.0f / 4294967296.0f;
+      #pragma omp parallel for schedule(static)
+      for (int block = 0; block < num_blocks; ++block) {
+        Random rand(seed + block);
+        const data_size_t begin = block * block_size;
+        const data_size_t end = std::min(begin + block_size, num_data_);
+        // the number of in-bag data before each block, they sum to bag_data_cnt_
+        const data_size_t left_begin = static_cast<data_size_t>(bagging_fraction * begin);
+        const data_size_t left_end = end == num_data_ ? bag_data_cnt_ : static_cast<data_size_t>(bagging_fraction * end);
+        data_size_t* left = bag_data_indices_.data() + left_begin;
+        data_size_t* right = out_of_bag_data_indices_.data() + (begin - left_begin);
+        const data_size_t left_cnt = left_end - left_begin;
+        data_size_t cur_left_cnt = 0;
+        data_size_t cur_right_cnt = 0;
+        for (data_size_t i = begin; i < end; ++i) {
+          double prob = (left_cnt - cur_left_cnt) / static_cast<double>(end - i);
+          if (rand.NextUInt32() * kInverseUInt32Range < prob) {
+            left[cur_left_cnt++] = i;
+          } else {
+            right[cur_right_cnt++] = i;
+          }
         }
       }
     } else {
@@ -159,6 +280,42 @@ void GBDT::Bagging(int iter, const int curr_class) {
   }
 }
 
+std::vector<std::unique_ptr<Tree>> GBDT::TrainClassesConcurrently(const score_t* gradient, const score_t* hessian) {
+  std::vector<std::unique_ptr<Tree>> new_trees;
+  // bagging data is shared by classes, and GOSS may enable it after Init
+  if (!bag_data_indices_.empty()) {
+    return new_trees;
+  }
+  const int num_threads = Threading::NumThreads();
+  const int num_groups = std::min(num_concurrent_classes_, num_threads);
+  if (num_groups <= 1) {
+    return new_trees;
+  }
+  if (ThreadPool::Current() != nullptr) {
+    // loops of the tree learners are nested in the loop of classes, idle threads steal their tasks
+    new_trees.resize(num_class_);
+    Threading::ParallelFor(0, num_class_, [&](int curr_class) {
+      new_trees[curr_class].reset(tree_learner_[curr_class]->Train(gradient + curr_class * num_data_,
+        hessian + curr_class * num_data_));
+    });
+    return new_trees;
+  }
+  // threads of each group
+  const int num_inner_threads = num_threads / num_groups;
+  new_trees.resize(num_class_);
+  const int is_nested = omp_get_nested();
+  omp_set_nested(num_inner_threads > 1);
+  #pragma omp parallel for schedule(dynamic) num_threads(num_groups)
+  for (int curr_class = 0; curr_class < num_class_; ++curr_class) {
+    // only affects the parallel regions in this thread
+    omp_set_num_threads(num_inner_threads);
+    new_trees[curr_class].reset(tree_learner_[curr_class]->Train(gradient + curr_class * num_data_,
+      hessian + curr_class * num_data_));
+  }
+  omp_set_nested(is_nested);
+  return new_trees;
+}
+
 void GBDT::UpdateScoreOutOfBag(const Tree* tree, const int curr_class) {
   // we need to predict out-of-bag socres of data for boosting
   if (out_of_bag_data_indices_.size() > 0) {
@@ -168,18 +325,42 @@ void GBDT::UpdateScoreOutOfBag(const Tree* tree, const int curr_class) {
 
 bool GBDT::TrainOneIter(const score_t* gradient, const score_t* hessian, bool is_eval) {
   // boosting first
-  if (gradient == nullptr || hessian == nullptr) {
-    Boosting();
+  // gradients may be calculated already when updating scores of the last iteration
+  const bool is_boosting = gradient == nullptr || hessian == nullptr;
+  if (is_boosting) {
+    if (!is_gradients_updated_) {
+      Boosting();
+    }
     gradient = gradients_.data();
     hessian = hessians_.data();
   }
+  is_gradients_updated_ = false;
+  // bagging buffers may be enabled after Init, like GOSS
+  const bool is_fuse_gradients = is_fuse_gradients_ && is_boosting && bag_data_indices_.empty();
+  // hessians given by the caller may be any values, e.g. re-weighted by GOSS
+  const bool is_constant_hessian = is_boosting && object_function_ != nullptr && object_function_->IsConstantHessian();
+  for (auto& tree_learner : tree_learner_) {
+    tree_learner->SetIsConstantHessian(is_constant_hessian);
+  }
 
+  std::vector<std::unique_ptr<Tree>> new_trees;
+  if (num_concurrent_classes_ > 1) {
+    new_trees = TrainClassesConcurrently(gradient, hessian);
+  }
   for (int curr_class = 0; curr_class < num_class_; ++curr_class) {
-    // bagging logic
-    Bagging(iter_, curr_class);
+    std::unique_ptr<Tree> new_tree;
+    if (new_trees.empty()) {
+      // bagging logic
+      {
+        ProfileScope profile_scope(kBaggingProfile);
+        Bagging(iter_, curr_class);
+      }
 
-    // train a new tree
-    std::unique_ptr<Tree> new_tree(tree_learner_[curr_class]->Train(gradient + curr_class * num_data_, hessian + curr_class * num_data_));
+      // train a new tree
+      new_tree.reset(tree_learner_[curr_class]->Train(gradient + curr_class * num_data_, hessian + curr_class * num_data_));
+    } else {
+      new_tree = std::move(new_trees[curr_class]);
+    }
     // if cannot learn a new tree, then stop
     if (new_tree->num_leaves() <= 1) {
       Log::Info("Stopped training because there are no more leafs that meet the split requirements.");
@@ -189,13 +370,28 @@ bool GBDT::TrainOneIter(const score_t* gradient, const score_t* hessian, bool is
     // shrinkage by learning rate
     new_tree->Shrinkage(shrinkage_rate_);
     // update score
-    UpdateScore(new_tree.get(), curr_class);
+    if (is_fuse_gradients) {
+      // calculate gradients of the next iteration in the same pass
+      train_score_updater_->AddScoreAndGetGradients(tree_learner_[curr_class].get(), object_function_,
+        gradients_.data(), hessians_.data());
+      for (auto& score_updater : valid_score_updater_) {
+        score_updater->AddScore(new_tree.get(), curr_class);
+      }
+      is_gradients_updated_ = true;
+    } else {
+      UpdateScore(new_tree.get(), curr_class);
+    }
     UpdateScoreOutOfBag(new_tree.get(), curr_class);
 
     // add model
+    new_tree->Flatten();
     models_.push_back(std::move(new_tree));
   }
   ++iter_;
+  if (is_predict_on_bins_) {
+    // new thresholds may change the bins of all trees
+    SetPredictOnBins(true);
+  }
   if (is_eval) {
     return EvalAndCheckEarlyStopping();
   } else {
@@ -204,21 +400,200 @@ bool GBDT::TrainOneIter(const score_t* gradient, const score_t* hessian, bool is
 
 }
 
+void GBDT::RefitTree(const int* leaf_preds, data_size_t num_data, int num_models) {
+  if (object_function_ == nullptr) {
+    Log::Fatal("No object function provided");
+  }
+  CHECK(num_data == num_data_);
+  CHECK(num_models == static_cast<int>(models_.size()));
+  CHECK(num_models % num_class_ == 0);
+  const double decay_rate = gbdt_config_->refit_decay_rate;
+  const double lambda_l1 = gbdt_config_->tree_config.lambda_l1;
+  const double lambda_l2 = gbdt_config_->tree_config.lambda_l2;
+  const int num_threads = Threading::NumThreads();
+  // start from the initial scores, each tree is refitted on the scores of the refitted trees before it
+  train_score_updater_.reset(new ScoreUpdater(train_data_, num_class_));
+  std::vector<score_t> score(train_score_updater_->score(), train_score_updater_->score() + num_data_ * num_class_);
+  std::vector<std::vector<double>> sum_gradients(num_threads);
+  std::vector<std::vector<double>> sum_hessians(num_threads);
+  std::vector<std::vector<data_size_t>> leaf_counts(num_threads);
+  std::vector<char> is_invalid(num_threads, 0);
+  for (int iter = 0; iter < num_models / num_class_; ++iter) {
+    object_function_->GetGradients(score.data(), gradients_.data(), hessians_.data());
+    for (int curr_class = 0; curr_class < num_class_; ++curr_class) {
+      const int model_index = iter * num_class_ + curr_class;
+      Tree* tree = models_[model_index].get();
+      const int num_leaves = tree->num_leaves();
+      const score_t* gradients = gradients_.data() + curr_class * num_data_;
+      const score_t* hessians = hessians_.data() + curr_class * num_data_;
+      // sums of gradients and hessians of each leaf, in thread local buffers
+      Threading::For<data_size_t>(0, num_data_, [&](int tid, data_size_t start, data_size_t end) {
+        sum_gradients[tid].assign(num_leaves, 0.0f);
+        sum_hessians[tid].assign(num_leaves, 0.0f);
+        leaf_counts[tid].assign(num_leaves, 0);
+        for (data_size_t i = start; i < end; ++i) {
+          const int leaf = leaf_preds[static_cast<size_t>(i) * num_models + model_index];
+          if (leaf < 0 || leaf >= num_leaves) {
+            is_invalid[tid] = 1;
+            continue;
+          }
+          sum_gradients[tid][leaf] += gradients[i];
+          sum_hessians[tid][leaf] += hessians[i];
+          ++leaf_counts[tid][leaf];
+        }
+      });
+      for (int tid = 0; tid < num_threads; ++tid) {
+        if (is_invalid[tid]) {
+          Log::Fatal("Leaf index out of range in tree %d", model_index);
+        }
+      }
+      for (int leaf = 0; leaf < num_leaves; ++leaf) {
+        double sum_gradient = 0.0f;
+        double sum_hessian = 0.0f;
+        data_size_t cnt = 0;
+        for (int tid = 0; tid < num_threads; ++tid) {
+          // blocks without data leave their buffers untouched
+          if (leaf_counts[tid].size() != static_cast<size_t>(num_leaves)) { continue; }
+          sum_gradient += sum_gradients[tid][leaf];
+          sum_hessian += sum_hessians[tid][leaf];
+          cnt += leaf_counts[tid][leaf];
+        }
+        // leaves without new data keep their outputs
+        if (cnt <= 0) { continue; }
+        double output = 0.0f;
+        if (std::fabs(sum_gradient) > lambda_l1) {
+          output = -std::copysign(std::fabs(sum_gradient) - lambda_l1, sum_gradient) / (sum_hessian + lambda_l2 + kEpsilon);
+        }
+        tree->SetLeafOutput(leaf, decay_rate * tree->LeafOutput(leaf) + (1.0f - decay_rate) * output * shrinkage_rate_);
+      }
+      for (auto& buf : leaf_counts) {
+        buf.clear();
+      }
+      score_t* class_score = score.data() + curr_class * num_data_;
+      #pragma omp parallel for schedule(static)
+      for (data_size_t i = 0; i < num_data_; ++i) {
+        class_score[i] += static_cast<score_t>(tree->LeafOutput(leaf_preds[static_cast<size_t>(i) * num_models + model_index]));
+      }
+    }
+  }
+  train_score_updater_->SetScore(score.data());
+  is_gradients_updated_ = false;
+  num_used_model_ = static_cast<int>(models_.size()) / num_class_;
+  Log::Info("Refitted %d trees on %d data", num_models, num_data_);
+}
+
+void GBDT::AppendTrainingData(const ObjectiveFunction* object_function,
+  const std::vector<const Metric*>& training_metrics, data_size_t num_old_data) {
+  CHECK(num_old_data == num_data_ && train_data_->num_data() >= num_data_);
+  // metrics of the last iteration refer to the old scores
+  int eval_iter = -1;
+  if (WaitForAsyncMetric(&eval_iter)) {
+    EarlyStop(eval_iter);
+  }
+  num_data_ = train_data_->num_data();
+  const bool is_bagging = gbdt_config_->bagging_fraction < 1.0 && gbdt_config_->bagging_freq > 0;
+  // tree learners are bound to the number of data
+  ResetTreeLearners(is_bagging);
+  object_function_ = object_function;
+  training_metrics_.clear();
+  for (const auto& metric : training_metrics) {
+    training_metrics_.push_back(metric);
+  }
+  training_metrics_.shrink_to_fit();
+  // only the new data are predicted, the trees are trained on the bins of this data
+  train_score_updater_->AppendData(num_old_data);
+  std::vector<data_size_t> new_data_indices(num_data_ - num_old_data);
+  for (data_size_t i = 0; i < num_data_ - num_old_data; ++i) {
+    new_data_indices[i] = num_old_data + i;
+  }
+  for (size_t i = 0; i < models_.size(); ++i) {
+    train_score_updater_->AddScore(models_[i].get(), new_data_indices.data(),
+      static_cast<data_size_t>(new_data_indices.size()), static_cast<int>(i % num_class_));
+  }
+  if (object_function_ != nullptr) {
+    gradients_.resize(static_cast<size_t>(num_data_) * num_class_);
+    hessians_.resize(static_cast<size_t>(num_data_) * num_class_);
+  }
+  if (is_bagging) {
+    out_of_bag_data_indices_.resize(num_data_);
+    bag_data_indices_.resize(num_data_);
+  } else {
+    bag_data_cnt_ = num_data_;
+  }
+  is_gradients_updated_ = false;
+  CheckMemoryBudget();
+  Log::Info("Appended %d data to %d training data", num_data_ - num_old_data, num_old_data);
+}
+
 bool GBDT::EvalAndCheckEarlyStopping() {
   bool is_met_early_stopping = false;
+  if (gbdt_config_->is_async_metric) {
+    // metrics of the last iteration were evaluated while training this iteration
+    int eval_iter = -1;
+    is_met_early_stopping = WaitForAsyncMetric(&eval_iter);
+    if (is_met_early_stopping) {
+      EarlyStop(eval_iter);
+    } else {
+      StartAsyncMetric();
+    }
+    return is_met_early_stopping;
+  }
+  std::vector<const score_t*> valid_scores;
+  for (const auto& score_updater : valid_score_updater_) {
+    valid_scores.push_back(score_updater->score());
+  }
   // print message for metric
-  is_met_early_stopping = OutputMetric(iter_);
+  is_met_early_stopping = OutputMetric(iter_, train_score_updater_->score(), valid_scores);
   if (is_met_early_stopping) {
-    Log::Info("Early stopping at iteration %d, the best iteration round is %d",
-      iter_, iter_ - early_stopping_round_);
-    // pop last early_stopping_round_ models
-    for (int i = 0; i < early_stopping_round_ * num_class_; ++i) {
-      models_.pop_back();
-    }
+    EarlyStop(iter_);
   }
   return is_met_early_stopping;
 }
 
+void GBDT::EarlyStop(int eval_iter) {
+  const int best_iter = eval_iter - early_stopping_round_;
+  Log::Info("Early stopping at iteration %d, the best iteration round is %d", eval_iter, best_iter);
+  // pop models after the best iteration
+  while (static_cast<int>(models_.size()) > best_iter * num_class_) {
+    models_.pop_back();
+  }
+}
+
+void GBDT::StartAsyncMetric() {
+  const int iter = iter_;
+  const bool is_output = (iter % gbdt_config_->output_freq) == 0;
+  // snapshot scores, the same buffers are reused by every iteration
+  if (is_output && !training_metrics_.empty()) {
+    async_train_score_.assign(train_score_updater_->score(),
+      train_score_updater_->score() + train_score_updater_->num_data() * num_class_);
+  }
+  if (is_output || early_stopping_round_ > 0) {
+    async_valid_scores_.resize(valid_score_updater_.size());
+    for (size_t i = 0; i < valid_score_updater_.size(); ++i) {
+      const score_t* score = valid_score_updater_[i]->score();
+      async_valid_scores_[i].assign(score, score + valid_score_updater_[i]->num_data() * num_class_);
+    }
+  }
+  async_metric_iter_ = iter;
+  async_metric_thread_ = std::thread([this, iter] {
+    std::vector<const score_t*> valid_scores;
+    for (const auto& score : async_valid_scores_) {
+      valid_scores.push_back(score.data());
+    }
+    is_async_metric_early_stopping_ = OutputMetric(iter, async_train_score_.data(), valid_scores);
+  });
+}
+
+bool GBDT::WaitForAsyncMetric(int* out_iter) {
+  // the thread may be joined by SaveCheckpoint already, the result is kept until it is taken here
+  if (async_metric_thread_.joinable()) {
+    async_metric_thread_.join();
+  }
+  *out_iter = async_metric_iter_;
+  async_metric_iter_ = -1;
+  return *out_iter >= 0 && is_async_metric_early_stopping_;
+}
+
 void GBDT::UpdateScore(const Tree* tree, const int curr_class) {
   // update training score
   train_score_updater_->AddScore(tree_learner_[curr_class].get(), curr_class);
@@ -228,13 +603,14 @@ void GBDT::UpdateScore(const Tree* tree, const int curr_class) {
   }
 }
 
-bool GBDT::OutputMetric(int iter) {
+bool GBDT::OutputMetric(int iter, const score_t* train_score, const std::vector<const score_t*>& valid_scores) {
+  ProfileScope profile_scope(kMetricProfile);
   bool ret = false;
   // print training metric
   if ((iter % gbdt_config_->output_freq) == 0) {
     for (auto& sub_metric : training_metrics_) {
       auto name = sub_metric->GetName();
-      auto scores = sub_metric->Eval(train_score_updater_->score());
+      auto scores = sub_metric->Eval(train_score);
       for (size_t k = 0; k < name.size(); ++k) {
         Log::Info("Iteration: %d, %s : %f", iter, name[k].c_str(), scores[k]);
       }
@@ -244,7 +620,7 @@ bool GBDT::OutputMetric(int iter) {
   if ((iter % gbdt_config_->output_freq) == 0 || early_stopping_round_ > 0) {
     for (size_t i = 0; i < valid_metrics_.size(); ++i) {
       for (size_t j = 0; j < valid_metrics_[i].size(); ++j) {
-        auto test_scores = valid_metrics_[i][j]->Eval(valid_score_updater_[i]->score());
+        auto test_scores = valid_metrics_[i][j]->Eval(valid_scores[i]);
         if ((iter % gbdt_config_->output_freq) == 0) {
           auto name = valid_metrics_[i][j]->GetName();
           for (size_t k = 0; k < name.size(); ++k) {
@@ -269,6 +645,7 @@ bool GBDT::OutputMetric(int iter) {
 /*! \brief Get eval result */
 std::vector<double> GBDT::GetEvalAt(int data_idx) const {
   CHECK(data_idx >= 0 && data_idx <= static_cast<int>(valid_metrics_.size()));
+  ProfileScope profile_scope(kMetricProfile);
   std::vector<double> ret;
   if (data_idx == 0) {
     for (auto& sub_metric : training_metrics_) {
@@ -343,12 +720,18 @@ void GBDT::Boosting() {
     Log::Fatal("No object function provided");
   }
   // objective function will calculate gradients and hessians
+  ProfileScope profile_scope(kGetGradientsProfile);
   int num_score = 0;
   object_function_->
     GetGradients(GetTrainingScore(&num_score), gradients_.data(), hessians_.data());
 }
 
 void GBDT::SaveModelToFile(int num_used_model, bool is_finish, const char* filename) {
+  // get the metrics of the last iteration
+  int eval_iter = -1;
+  if (is_finish && WaitForAsyncMetric(&eval_iter)) {
+    EarlyStop(eval_iter);
+  }
   // first time to this function, open file
   if (saved_model_size_ < 0) {
     model_output_file_.open(filename);
@@ -399,6 +782,101 @@ void GBDT::SaveModelToFile(int num_used_model, bool is_finish, const char* filen
   }
 }
 
+void GBDT::SaveModelToIfElse(int num_used_model, const char* filename) const {
+  if (num_used_model == NO_LIMIT) {
+    num_used_model = static_cast<int>(models_.size());
+  } else {
+    num_used_model = std::min(num_used_model * num_class_, static_cast<int>(models_.size()));
+  }
+  std::ofstream output_file(filename);
+  if (!output_file.is_open()) {
+    Log::Fatal("Cannot write model code to %s", filename);
+  }
+  std::stringstream ss;
+  ss << std::setprecision(std::numeric_limits<double>::digits10 + 2);
+  // the generated code only depends on the standard library
+  ss << "// Generated by LightGBM from a " << Name() << " model, gives the same predictions as the model" << std::endl;
+  ss << "// Entry points: PredictRaw(features, output), Predict(features, output) and PredictLeafIndex(features, output)," << std::endl;
+  ss << "// features have kMaxFeatureIdx + 1 values, output has kNumClass values, or kNumTrees for leaf index" << std::endl;
+  ss << "#include <cmath>" << std::endl << std::endl;
+  ss << "namespace LightGBMModel {" << std::endl << std::endl;
+  ss << "const int kNumClass = " << num_class_ << ";" << std::endl;
+  ss << "const int kNumTrees = " << num_used_model << ";" << std::endl;
+  ss << "const int kMaxFeatureIdx = " << max_feature_idx_ << ";" << std::endl << std::endl;
+  ss << "namespace {" << std::endl << std::endl;
+  for (int i = 0; i < num_used_model; ++i) {
+    ss << models_[i]->ToIfElse(i);
+  }
+  ss << "}  // namespace" << std::endl << std::endl;
+  // raw score, trees are added in the same order as GBDT::PredictRaw
+  ss << "void PredictRaw(const double* arr, double* output) {" << std::endl;
+  ss << "  for (int i = 0; i < kNumClass; ++i) {" << std::endl;
+  ss << "    output[i] = 0.0;" << std::endl;
+  ss << "  }" << std::endl;
+  for (int i = 0; i < num_used_model; ++i) {
+    ss << "  output[" << i % num_class_ << "] += PredictTree" << i << "(arr);" << std::endl;
+  }
+  ss << "}" << std::endl << std::endl;
+  // transformed score, the same as GBDT::Predict
+  ss << "void Predict(const double* arr, double* output) {" << std::endl;
+  ss << "  PredictRaw(arr, output);" << std::endl;
+  if (sigmoid_ > 0 && num_class_ == 1) {
+    ss << "  output[0] = 1.0 / (1.0 + std::exp(-2.0 * " << sigmoid_ << " * output[0]));" << std::endl;
+  } else if (num_class_ > 1) {
+    ss << "  double wmax = output[0];" << std::endl;
+    ss << "  for (int i = 1; i < kNumClass; ++i) {" << std::endl;
+    ss << "    wmax = output[i] < wmax ? wmax : output[i];" << std::endl;
+    ss << "  }" << std::endl;
+    ss << "  double wsum = 0.0;" << std::endl;
+    ss << "  for (int i = 0; i < kNumClass; ++i) {" << std::endl;
+    ss << "    output[i] = std::exp(output[i] - wmax);" << std::endl;
+    ss << "    wsum += output[i];" << std::endl;
+    ss << "  }" << std::endl;
+    ss << "  for (int i = 0; i < kNumClass; ++i) {" << std::endl;
+    ss << "    output[i] /= wsum;" << std::endl;
+    ss << "  }" << std::endl;
+  }
+  ss << "}" << std::endl << std::endl;
+  ss << "void PredictLeafIndex(const double* arr, int* output) {" << std::endl;
+  for (int i = 0; i < num_used_model; ++i) {
+    ss << "  output[" << i << "] = PredictTree" << i << "Leaf(arr);" << std::endl;
+  }
+  ss << "}" << std::endl << std::endl;
+  ss << "}  // namespace LightGBMModel" << std::endl;
+  output_file << ss.str();
+  output_file.close();
+}
+
+void GBDT::SaveModelToBinaryFile(int num_used_model, const char* filename) const {
+  if (num_used_model == NO_LIMIT) {
+    num_used_model = static_cast<int>(models_.size());
+  } else {
+    num_used_model = std::min(num_used_model * num_class_, static_cast<int>(models_.size()));
+  }
+  FILE* file;
+#ifdef _MSC_VER
+  fopen_s(&file, filename, "wb");
+#else
+  file = fopen(filename, "wb");
+#endif
+  if (file == NULL) {
+    Log::Fatal("Cannot write binary model to %s", filename);
+  }
+  // text lines for the type of the model, padded so the trees are aligned
+  std::string header = std::string(Name()) + "\nbinary_model_version=" + std::to_string(kBinaryModelVersion) + "\n";
+  header.resize(Common::AlignUp(header.size(), Tree::kBinaryAlignment), '\0');
+  fwrite(header.data(), sizeof(char), header.size(), file);
+  fwrite(&num_class_, sizeof(num_class_), 1, file);
+  fwrite(&label_idx_, sizeof(label_idx_), 1, file);
+  fwrite(&max_feature_idx_, sizeof(max_feature_idx_), 1, file);
+  fwrite(&num_used_model, sizeof(num_used_model), 1, file);
+  fwrite(&sigmoid_, sizeof(sigmoid_), 1, file);
+  for (int i = 0; i < num_used_model; ++i) {
+    models_[i]->SaveBinaryToFile(file);
+  }
+  fclose(file);
+}
+
 void GBDT::LoadModelFromString(const std::string& model_str) {
   // use serialized string to restore this object
   models_.clear();
@@ -446,6 +924,7 @@ void GBDT::LoadModelFromString(const std::string& model_str) {
       int end = static_cast<int>(i);
       std::string tree_str = Common::Join<std::string>(lines, start, end, '\n');
       auto new_tree = std::unique_ptr<Tree>(new Tree(tree_str));
+      new_tree->Flatten();
       models_.push_back(std::move(new_tree));
     } else {
       ++i;
@@ -453,6 +932,308 @@ void GBDT::LoadModelFromString(const std::string& model_str) {
   }
   Log::Info("Finished loading %d models", models_.size());
   num_used_model_ = static_cast<int>(models_.size()) / num_class_;
+  if (is_predict_on_bins_) {
+    SetPredictOnBins(true);
+  }
+}
+
+void GBDT::LoadModelFromBinary(const char* memory, size_t size) {
+  models_.clear();
+  const char* end = memory + size;
+  // skip the line of model type, then check the version line
+  const char* ptr = reinterpret_cast<const char*>(std::memchr(memory, '\n', size));
+  const std::string version_key = "binary_model_version=";
+  if (ptr == nullptr || static_cast<size_t>(end - ptr - 1) < version_key.size()
+    || std::strncmp(ptr + 1, version_key.c_str(), version_key.size()) != 0) {
+    Log::Fatal("Binary model file format error");
+  }
+  ptr += 1 + version_key.size();
+  const char* line_end = reinterpret_cast<const char*>(std::memchr(ptr, '\n', end - ptr));
+  if (line_end == nullptr) {
+    Log::Fatal("Binary model file format error");
+  }
+  int version = 0;
+  Common::Atoi(ptr, &version);
+  if (version != kBinaryModelVersion) {
+    Log::Fatal("Binary model file version %d is not supported", version);
+  }
+  size_t offset = Common::AlignUp(line_end + 1 - memory, Tree::kBinaryAlignment);
+  int num_models = 0;
+  const size_t header_size = sizeof(num_class_) + sizeof(label_idx_) + sizeof(max_feature_idx_)
+    + sizeof(num_models) + sizeof(sigmoid_);
+  if (offset + header_size > size) {
+    Log::Fatal("Binary model file format error");
+  }
+  auto read_value = [memory, &offset](size_t value_size, void* out) {
+    std::memcpy(out, memory + offset, value_size);
+    offset += value_size;
+  };
+  read_value(sizeof(num_class_), &num_class_);
+  read_value(sizeof(label_idx_), &label_idx_);
+  read_value(sizeof(max_feature_idx_), &max_feature_idx_);
+  read_value(sizeof(num_models), &num_models);
+  read_value(sizeof(sigmoid_), &sigmoid_);
+  // get tree models, the arrays are copied directly
+  for (int i = 0; i < num_models; ++i) {
+    int num_leaves = 0;
+    int has_flat_nodes = 0;
+    if (offset + sizeof(num_leaves) + sizeof(has_flat_nodes) > size) {
+      Log::Fatal("Binary model file format error");
+    }
+    std::memcpy(&num_leaves, memory + offset, sizeof(num_leaves));
+    std::memcpy(&has_flat_nodes, memory + offset + sizeof(num_leaves), sizeof(has_flat_nodes));
+    const size_t tree_size = Tree::SizesInByte(num_leaves, has_flat_nodes != 0);
+    if (num_leaves < 1 || offset + tree_size > size) {
+      Log::Fatal("Binary model file format error");
+    }
+    models_.emplace_back(new Tree(memory + offset));
+    offset += tree_size;
+  }
+  Log::Info("Finished loading %d models", models_.size());
+  num_used_model_ = static_cast<int>(models_.size()) / num_class_;
+  if (is_predict_on_bins_) {
+    SetPredictOnBins(true);
+  }
+}
+
+void GBDT::SaveCheckpoint(const char* filename) {
+  // metrics of the last iteration update best_iter_ and best_score_
+  if (async_metric_thread_.joinable()) {
+    async_metric_thread_.join();
+  }
+  // write to a temporary file first, so a preempted save doesn't break the last checkpoint
+  const std::string tmp_filename = std::string(filename) + ".tmp";
+  FILE* file;
+#ifdef _MSC_VER
+  fopen_s(&file, tmp_filename.c_str(), "wb");
+#else
+  file = fopen(tmp_filename.c_str(), "wb");
+#endif
+  if (file == NULL) {
+    Log::Fatal("Cannot write checkpoint to %s", tmp_filename.c_str());
+  }
+  std::string header = std::string(Name()) + "\ncheckpoint_version=" + std::to_string(kCheckpointVersion) + "\n";
+  header.resize(Common::AlignUp(header.size(), Tree::kBinaryAlignment), '\0');
+  fwrite(header.data(), sizeof(char), header.size(), file);
+  const int num_models = static_cast<int>(models_.size());
+  const int num_score_sets = static_cast<int>(valid_score_updater_.size()) + 1;
+  fwrite(&num_class_, sizeof(num_class_), 1, file);
+  fwrite(&iter_, sizeof(iter_), 1, file);
+  fwrite(&num_models, sizeof(num_models), 1, file);
+  fwrite(&num_score_sets, sizeof(num_score_sets), 1, file);
+  // trees with the fields for training, like updating scores on bins
+  for (int i = 0; i < num_models; ++i) {
+    models_[i]->SaveBinaryToFile(file);
+    models_[i]->SaveTrainingFieldsToFile(file);
+  }
+  // scores, so trees don't need to be replayed on the datasets
+  for (int i = 0; i < num_score_sets; ++i) {
+    const ScoreUpdater* score_updater = i == 0 ? train_score_updater_.get() : valid_score_updater_[i - 1].get();
+    const data_size_t num_data = score_updater->num_data();
+    fwrite(&num_data, sizeof(num_data), 1, file);
+    fwrite(score_updater->score(), sizeof(score_t), static_cast<size_t>(num_data) * num_class_, file);
+  }
+  // random generators
+  const std::vector<std::string> random_states = GetRandomStates();
+  const int num_random_states = static_cast<int>(random_states.size());
+  fwrite(&num_random_states, sizeof(num_random_states), 1, file);
+  for (const auto& state : random_states) {
+    const int state_size = static_cast<int>(state.size());
+    fwrite(&state_size, sizeof(state_size), 1, file);
+    fwrite(state.data(), sizeof(char), state.size(), file);
+  }
+  // bagging data, which is kept until the next re-bagging
+  const int is_bagging = bag_data_indices_.empty() ? 0 : 1;
+  fwrite(&is_bagging, sizeof(is_bagging), 1, file);
+  if (is_bagging) {
+    fwrite(&bag_data_cnt_, sizeof(bag_data_cnt_), 1, file);
+    fwrite(&out_of_bag_data_cnt_, sizeof(out_of_bag_data_cnt_), 1, file);
+    fwrite(bag_data_indices_.data(), sizeof(data_size_t), bag_data_cnt_, file);
+    fwrite(out_of_bag_data_indices_.data(), sizeof(data_size_t), out_of_bag_data_cnt_, file);
+  }
+  // early stopping
+  const int num_best_sets = static_cast<int>(best_iter_.size());
+  fwrite(&num_best_sets, sizeof(num_best_sets), 1, file);
+  for (int i = 0; i < num_best_sets; ++i) {
+    const int num_metrics = static_cast<int>(best_iter_[i].size());
+    fwrite(&num_metrics, sizeof(num_metrics), 1, file);
+    fwrite(best_iter_[i].data(), sizeof(int), num_metrics, file);
+    fwrite(best_score_[i].data(), sizeof(double), num_metrics, file);
+  }
+  const int is_async_metric_early_stopping = is_async_metric_early_stopping_ ? 1 : 0;
+  fwrite(&async_metric_iter_, sizeof(async_metric_iter_), 1, file);
+  fwrite(&is_async_metric_early_stopping, sizeof(is_async_metric_early_stopping), 1, file);
+  const bool is_ok = ferror(file) == 0;
+  if (fclose(file) != 0 || !is_ok) {
+    Log::Fatal("Cannot write checkpoint to %s", tmp_filename.c_str());
+  }
+#ifdef _MSC_VER
+  // rename doesn't replace existing files on Windows
+  std::remove(filename);
+#endif
+  if (std::rename(tmp_filename.c_str(), filename) != 0) {
+    Log::Fatal("Cannot rename checkpoint %s to %s", tmp_filename.c_str(), filename);
+  }
+  Log::Info("Saved checkpoint of iteration %d to %s", iter_, filename);
+}
+
+void GBDT::LoadCheckpoint(const char* filename) {
+  MappedFile mapped_file(filename);
+  if (!mapped_file.is_open()) {
+    Log::Fatal("Cannot read checkpoint %s", filename);
+  }
+  const char* memory = mapped_file.data();
+  const size_t size = mapped_file.size();
+  const std::string header = std::string(Name()) + "\ncheckpoint_version=" + std::to_string(kCheckpointVersion) + "\n";
+  if (size < header.size() || std::strncmp(memory, header.c_str(), header.size()) != 0) {
+    Log::Fatal("Checkpoint %s is not a %s checkpoint of version %d", filename, Name(), kCheckpointVersion);
+  }
+  size_t offset = Common::AlignUp(header.size(), Tree::kBinaryAlignment);
+  auto read_value = [memory, size, filename, &offset](size_t value_size, void* out) {
+    if (offset + value_size > size) {
+      Log::Fatal("Checkpoint %s is truncated", filename);
+    }
+    if (value_size > 0) {
+      std::memcpy(out, memory + offset, value_size);
+    }
+    offset += value_size;
+  };
+  int num_class = 0;
+  int iter = 0;
+  int num_models = 0;
+  int num_score_sets = 0;
+  read_value(sizeof(num_class), &num_class);
+  read_value(sizeof(iter), &iter);
+  read_value(sizeof(num_models), &num_models);
+  read_value(sizeof(num_score_sets), &num_score_sets);
+  if (num_class != num_class_ || num_score_sets != static_cast<int>(valid_score_updater_.size()) + 1) {
+    Log::Fatal("Checkpoint %s doesn't match the number of classes or validation datasets", filename);
+  }
+  // trees
+  std::vector<std::unique_ptr<Tree>> models;
+  for (int i = 0; i < num_models; ++i) {
+    int tree_header[2] = { 0, 0 };
+    if (offset + sizeof(tree_header) > size) {
+      Log::Fatal("Checkpoint %s is truncated", filename);
+    }
+    std::memcpy(tree_header, memory + offset, sizeof(tree_header));
+    const size_t tree_size = Tree::SizesInByte(tree_header[0], tree_header[1] != 0);
+    const size_t training_fields_size = Tree::SizesOfTrainingFields(tree_header[0]);
+    if (tree_header[0] < 1 || offset + tree_size + training_fields_size > size) {
+      Log::Fatal("Checkpoint %s is truncated", filename);
+    }
+    models.emplace_back(new Tree(memory + offset));
+    models.back()->LoadTrainingFields(memory + offset + tree_size);
+    offset += tree_size + training_fields_size;
+  }
+  // scores
+  std::vector<std::vector<score_t>> scores(num_score_sets);
+  for (int i = 0; i < num_score_sets; ++i) {
+    const ScoreUpdater* score_updater = i == 0 ? train_score_updater_.get() : valid_score_updater_[i - 1].get();
+    data_size_t num_data = 0;
+    read_value(sizeof(num_data), &num_data);
+    if (num_data != score_updater->num_data()) {
+      Log::Fatal("Checkpoint %s has %d data in dataset %d, but the dataset has %d data",
+        filename, num_data, i, score_updater->num_data());
+    }
+    scores[i].resize(static_cast<size_t>(num_data) * num_class_);
+    read_value(sizeof(score_t) * scores[i].size(), scores[i].data());
+  }
+  // random generators
+  int num_random_states = 0;
+  read_value(sizeof(num_random_states), &num_random_states);
+  if (num_random_states != static_cast<int>(GetRandomStates().size())) {
+    Log::Fatal("Checkpoint %s doesn't match the random generators", filename);
+  }
+  std::vector<std::string> random_states(num_random_states);
+  for (int i = 0; i < num_random_states; ++i) {
+    int state_size = 0;
+    read_value(sizeof(state_size), &state_size);
+    if (state_size < 0) {
+      Log::Fatal("Checkpoint %s is broken", filename);
+    }
+    random_states[i].resize(state_size);
+    read_value(state_size, &random_states[i][0]);
+  }
+  // bagging data
+  int is_bagging = 0;
+  data_size_t bag_data_cnt = num_data_;
+  data_size_t out_of_bag_data_cnt = 0;
+  read_value(sizeof(is_bagging), &is_bagging);
+  if (is_bagging != (bag_data_indices_.empty() ? 0 : 1)) {
+    Log::Fatal("Checkpoint %s doesn't match the bagging parameters", filename);
+  }
+  if (is_bagging) {
+    read_value(sizeof(bag_data_cnt), &bag_data_cnt);
+    read_value(sizeof(out_of_bag_data_cnt), &out_of_bag_data_cnt);
+    if (bag_data_cnt < 0 || out_of_bag_data_cnt < 0 || bag_data_cnt + out_of_bag_data_cnt > num_data_) {
+      Log::Fatal("Checkpoint %s is broken", filename);
+    }
+    read_value(sizeof(data_size_t) * bag_data_cnt, bag_data_indices_.data());
+    read_value(sizeof(data_size_t) * out_of_bag_data_cnt, out_of_bag_data_indices_.data());
+  }
+  // early stopping
+  int num_best_sets = 0;
+  read_value(sizeof(num_best_sets), &num_best_sets);
+  if (num_best_sets != static_cast<int>(best_iter_.size())) {
+    Log::Fatal("Checkpoint %s doesn't match the early stopping parameters", filename);
+  }
+  for (int i = 0; i < num_best_sets; ++i) {
+    int num_metrics = 0;
+    read_value(sizeof(num_metrics), &num_metrics);
+    if (num_metrics != static_cast<int>(best_iter_[i].size())) {
+      Log::Fatal("Checkpoint %s doesn't match the metrics of validation dataset %d", filename, i);
+    }
+    read_value(sizeof(int) * num_metrics, best_iter_[i].data());
+    read_value(sizeof(double) * num_metrics, best_score_[i].data());
+  }
+  int is_async_metric_early_stopping = 0;
+  read_value(sizeof(async_metric_iter_), &async_metric_iter_);
+  read_value(sizeof(is_async_metric_early_stopping), &is_async_metric_early_stopping);
+  is_async_metric_early_stopping_ = is_async_metric_early_stopping != 0;
+  // everything is read, restore the state
+  models_ = std::move(models);
+  iter_ = iter;
+  num_used_model_ = static_cast<int>(models_.size()) / num_class_;
+  saved_model_size_ = -1;
+  train_score_updater_->SetScore(scores[0].data());
+  for (int i = 1; i < num_score_sets; ++i) {
+    valid_score_updater_[i - 1]->SetScore(scores[i].data());
+  }
+  SetRandomStates(random_states);
+  if (is_bagging) {
+    bag_data_cnt_ = bag_data_cnt;
+    out_of_bag_data_cnt_ = out_of_bag_data_cnt;
+    for (auto& tree_learner : tree_learner_) {
+      if (bag_data_cnt_ < num_data_) {
+        tree_learner->SetBaggingData(bag_data_indices_.data(), bag_data_cnt_);
+      } else {
+        tree_learner->SetBaggingData(nullptr, num_data_);
+      }
+    }
+  }
+  // gradients are calculated again from the restored scores
+  is_gradients_updated_ = false;
+  if (is_predict_on_bins_) {
+    SetPredictOnBins(true);
+  }
+  Log::Info("Resumed training at iteration %d from checkpoint %s", iter_, filename);
+}
+
+std::vector<std::string> GBDT::GetRandomStates() const {
+  std::vector<std::string> states;
+  states.push_back(random_.GetState());
+  for (const auto& tree_learner : tree_learner_) {
+    states.push_back(tree_learner->GetRandomState());
+  }
+  return states;
+}
+
+void GBDT::SetRandomStates(const std::vector<std::string>& states) {
+  random_.SetState(states[0]);
+  for (size_t i = 0; i < tree_learner_.size(); ++i) {
+    tree_learner_[i]->SetRandomState(states[i + 1]);
+  }
 }
 
 std::string GBDT::FeatureImportance() const {
@@ -484,23 +1265,79 @@ std::string GBDT::FeatureImportance() const {
     return str_buf.str();
 }
 
+void GBDT::SetPredictOnBins(bool is_predict_on_bins) {
+  is_predict_on_bins_ = false;
+  bin_features_.clear();
+  bin_thresholds_.clear();
+  if (!is_predict_on_bins) { return; }
+  // the bin boundaries of each feature are its distinct thresholds in all trees
+  std::vector<std::vector<double>> thresholds(max_feature_idx_ + 1);
+  for (const auto& tree : models_) {
+    for (int split_idx = 0; split_idx < tree->num_leaves() - 1; ++split_idx) {
+      thresholds[tree->split_feature_real(split_idx)].push_back(tree->threshold(split_idx));
+    }
+  }
+  std::vector<int> feature_slots(max_feature_idx_ + 1, -1);
+  for (int i = 0; i <= max_feature_idx_; ++i) {
+    if (thresholds[i].empty()) { continue; }
+    std::sort(thresholds[i].begin(), thresholds[i].end());
+    thresholds[i].erase(std::unique(thresholds[i].begin(), thresholds[i].end()), thresholds[i].end());
+    if (thresholds[i].size() >= 65535 || bin_features_.size() >= 65535) {
+      Log::Warning("Too many thresholds or used features for prediction on bins, predict on feature values instead");
+      bin_features_.clear();
+      bin_thresholds_.clear();
+      return;
+    }
+    feature_slots[i] = static_cast<int>(bin_features_.size());
+    bin_features_.push_back(i);
+    bin_thresholds_.push_back(std::move(thresholds[i]));
+  }
+  for (auto& tree : models_) {
+    if (!tree->FlattenBins(feature_slots, bin_thresholds_)) {
+      Log::Warning("Too many leaves for prediction on bins, predict on feature values instead");
+      bin_features_.clear();
+      bin_thresholds_.clear();
+      return;
+    }
+  }
+  is_predict_on_bins_ = true;
+}
+
+void GBDT::SetPredictEarlyStop(int round_period, double margin_threshold) {
+  predict_early_stop_period_ = 0;
+  if (round_period <= 0) { return; }
+  if (num_class_ == 1 && sigmoid_ <= 0.0f) {
+    Log::Warning("Prediction early stopping is only for binary and multiclass classification, ignored");
+    return;
+  }
+  predict_early_stop_period_ = round_period;
+  predict_early_stop_margin_ = margin_threshold;
+}
+
 std::vector<double> GBDT::PredictRaw(const double* value) const {
   std::vector<double> ret(num_class_, 0.0f);
+  if (is_predict_on_bins_) {
+    std::vector<uint16_t> bins(bin_features_.size());
+    ValuesToBins(value, bins.data());
+    for (int i = 0; i < num_used_model_; ++i) {
+      for (int j = 0; j < num_class_; ++j) {
+        ret[j] += models_[i * num_class_ + j]->PredictByBins(bins.data());
+      }
+      if (IsPredictEarlyStop(i, ret.data())) { break; }
+    }
+    return ret;
+  }
   for (int i = 0; i < num_used_model_; ++i) {
     for (int j = 0; j < num_class_; ++j) {
       ret[j] += models_[i * num_class_ + j]->Predict(value);
     }
+    if (IsPredictEarlyStop(i, ret.data())) { break; }
   }
   return ret;
 }
 
 std::vector<double> GBDT::Predict(const double* value) const {
-  std::vector<double> ret(num_class_, 0.0f);
-  for (int i = 0; i < num_used_model_; ++i) {
-    for (int j = 0; j < num_class_; ++j) {
-      ret[j] += models_[i * num_class_ + j]->Predict(value);
-    }
-  }
+  std::vector<double> ret = PredictRaw(value);
   // if need sigmoid transform
   if (sigmoid_ > 0 && num_class_ == 1) {
     ret[0] = 1.0f / (1.0f + std::exp(- 2.0f * sigmoid_ * ret[0]));
@@ -510,8 +1347,214 @@ std::vector<double> GBDT::Predict(const double* value) const {
   return ret;
 }
 
+void GBDT::PredictRawForRows(const double* feature_values, int num_rows, double* output) const {
+  const size_t num_features = static_cast<size_t>(max_feature_idx_ + 1);
+  std::fill(output, output + static_cast<size_t>(num_rows) * num_class_, 0.0f);
+  // map all rows to bins once, they are reused by all blocks of trees
+  const size_t num_bin_features = bin_features_.size();
+  const std::vector<uint16_t> bins = RowsToBins(feature_values, num_rows);
+  const int num_models = num_used_model_ * num_class_;
+  // rows that met prediction early stopping skip the rest blocks
+  std::vector<char> is_stopped(predict_early_stop_period_ > 0 ? num_rows : 0, 0);
+  int start = 0;
+  while (start < num_models) {
+    // the next block of trees, which stays in cache while all rows are pushed through it
+    int end = start;
+    int num_leaves = 0;
+    while (end < num_models && (end == start || num_leaves + models_[end]->num_leaves() <= kPredictTreeBlockLeaves)) {
+      num_leaves += models_[end]->num_leaves();
+      ++end;
+    }
+    for (int i = 0; i < num_rows; ++i) {
+      double* ret = output + static_cast<size_t>(num_class_) * i;
+      if (predict_early_stop_period_ > 0) {
+        if (is_stopped[i]) { continue; }
+        // check at the same iterations as PredictRaw, so the results are the same
+        for (int k = start; k < end; ++k) {
+          if (is_predict_on_bins_) {
+            ret[k % num_class_] += models_[k]->PredictByBins(bins.data() + num_bin_features * i);
+          } else {
+            ret[k % num_class_] += models_[k]->Predict(feature_values + num_features * i);
+          }
+          if (k % num_class_ == num_class_ - 1 && IsPredictEarlyStop(k / num_class_, ret)) {
+            is_stopped[i] = 1;
+            break;
+          }
+        }
+      } else if (is_predict_on_bins_) {
+        const uint16_t* row_bins = bins.data() + num_bin_features * i;
+        for (int k = start; k < end; ++k) {
+          ret[k % num_class_] += models_[k]->PredictByBins(row_bins);
+        }
+      } else {
+        const double* value = feature_values + num_features * i;
+        for (int k = start; k < end; ++k) {
+          ret[k % num_class_] += models_[k]->Predict(value);
+        }
+      }
+    }
+    start = end;
+  }
+}
+
+void GBDT::PredictForRows(const double* feature_values, int num_rows, double* output) const {
+  PredictRawForRows(feature_values, num_rows, output);
+  ConvertOutputs(output, num_rows);
+}
+
+int GBDT::NumberOfPredictStages(int period) const {
+  if (period <= 0) {
+    Log::Fatal("Period of staged prediction should be positive, got %d", period);
+  }
+  return (num_used_model_ + period - 1) / period;
+}
+
+void GBDT::PredictRawStagedForRows(const double* feature_values, int num_rows, int period, double* output) const {
+  const int num_stages = NumberOfPredictStages(period);
+  const size_t num_features = static_cast<size_t>(max_feature_idx_ + 1);
+  const size_t num_bin_features = bin_features_.size();
+  const std::vector<uint16_t> bins = RowsToBins(feature_values, num_rows);
+  // running scores of rows, copied to the output at the end of each stage
+  std::vector<double> scores(static_cast<size_t>(num_rows) * num_class_, 0.0f);
+  const int num_models = num_used_model_ * num_class_;
+  const int num_stage_models = period * num_class_;
+  int start = 0;
+  while (start < num_models) {
+    // blocks of trees are the same as PredictRawForRows, but don't cross the end of a stage
+    const int stage_end = std::min(num_models, (start / num_stage_models + 1) * num_stage_models);
+    int end = start;
+    int num_leaves = 0;
+    while (end < stage_end && (end == start || num_leaves + models_[end]->num_leaves() <= kPredictTreeBlockLeaves)) {
+      num_leaves += models_[end]->num_leaves();
+      ++end;
+    }
+    for (int i = 0; i < num_rows; ++i) {
+      double* ret = scores.data() + static_cast<size_t>(num_class_) * i;
+      if (is_predict_on_bins_) {
+        const uint16_t* row_bins = bins.data() + num_bin_features * i;
+        for (int k = start; k < end; ++k) {
+          ret[k % num_class_] += models_[k]->PredictByBins(row_bins);
+        }
+      } else {
+        const double* value = feature_values + num_features * i;
+        for (int k = start; k < end; ++k) {
+          ret[k % num_class_] += models_[k]->Predict(value);
+        }
+      }
+    }
+    if (end == stage_end) {
+      const int stage = (end - 1) / num_stage_models;
+      for (int i = 0; i < num_rows; ++i) {
+        std::copy(scores.data() + static_cast<size_t>(num_class_) * i, scores.data() + static_cast<size_t>(num_class_) * (i + 1),
+          output + (static_cast<size_t>(num_stages) * i + stage) * num_class_);
+      }
+    }
+    start = end;
+  }
+}
+
+void GBDT::PredictStagedForRows(const double* feature_values, int num_rows, int period, double* output) const {
+  PredictRawStagedForRows(feature_values, num_rows, period, output);
+  ConvertOutputs(output, num_rows * NumberOfPredictStages(period));
+}
+
+std::vector<std::vector<double>> GBDT::EvalStaged(const Dataset* data,
+  const std::vector<const Metric*>& metrics, int period) const {
+  const int num_stages = NumberOfPredictStages(period);
+  for (int i = 0; i < num_used_model_ * num_class_; ++i) {
+    if (!models_[i]->HasBinThresholds()) {
+      Log::Fatal("Staged evaluation needs the thresholds in bins of trees, use staged prediction for loaded models");
+    }
+  }
+  // scores start from the initial scores of data, trees are added one by one
+  ScoreUpdater score_updater(data, num_class_);
+  std::vector<std::vector<double>> ret;
+  ret.reserve(num_stages);
+  for (int iter = 0; iter < num_used_model_; ++iter) {
+    for (int curr_class = 0; curr_class < num_class_; ++curr_class) {
+      score_updater.AddScore(models_[iter * num_class_ + curr_class].get(), curr_class);
+    }
+    if ((iter + 1) % period != 0 && iter + 1 != num_used_model_) { continue; }
+    ret.emplace_back();
+    for (const Metric* metric : metrics) {
+      const std::vector<double> results = metric->Eval(score_updater.score());
+      ret.back().insert(ret.back().end(), results.begin(), results.end());
+    }
+  }
+  return ret;
+}
+
+void GBDT::PredictContribForRows(const double* feature_values, int num_rows, double* output) const {
+  const int num_features = max_feature_idx_ + 1;
+  const size_t num_class_outputs = static_cast<size_t>(num_features) + 1;
+  std::fill(output, output + num_class_outputs * num_class_ * num_rows, 0.0f);
+  const int num_models = num_used_model_ * num_class_;
+  int max_depth = 0;
+  for (int k = 0; k < num_models; ++k) {
+    max_depth = std::max(max_depth, models_[k]->max_depth());
+  }
+  // one path buffer is reused by all trees and rows of the block
+  std::vector<Tree::PathElement> path_buffer(Tree::PathBufferSize(max_depth));
+  for (int i = 0; i < num_rows; ++i) {
+    const double* value = feature_values + static_cast<size_t>(num_features) * i;
+    double* ret = output + num_class_outputs * num_class_ * i;
+    for (int k = 0; k < num_models; ++k) {
+      models_[k]->PredictContrib(value, num_features, path_buffer.data(), ret + num_class_outputs * (k % num_class_));
+    }
+  }
+}
+
+bool GBDT::CanPredictContrib() const {
+  const int num_models = num_used_model_ * num_class_;
+  for (int k = 0; k < num_models; ++k) {
+    if (!models_[k]->HasDataCounts()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<uint16_t> GBDT::RowsToBins(const double* feature_values, int num_rows) const {
+  std::vector<uint16_t> bins;
+  if (!is_predict_on_bins_) { return bins; }
+  const size_t num_features = static_cast<size_t>(max_feature_idx_ + 1);
+  const size_t num_bin_features = bin_features_.size();
+  bins.resize(num_bin_features * num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    ValuesToBins(feature_values + num_features * i, bins.data() + num_bin_features * i);
+  }
+  return bins;
+}
+
+void GBDT::ConvertOutputs(double* output, int num_rows) const {
+  // if need sigmoid transform
+  if (sigmoid_ > 0 && num_class_ == 1) {
+    for (int i = 0; i < num_rows; ++i) {
+      output[i] = 1.0f / (1.0f + std::exp(- 2.0f * sigmoid_ * output[i]));
+    }
+  } else if (num_class_ > 1) {
+    std::vector<double> ret(num_class_);
+    for (int i = 0; i < num_rows; ++i) {
+      double* row_output = output + static_cast<size_t>(num_class_) * i;
+      std::copy(row_output, row_output + num_class_, ret.begin());
+      Common::Softmax(&ret);
+      std::copy(ret.begin(), ret.end(), row_output);
+    }
+  }
+}
+
 std::vector<int> GBDT::PredictLeafIndex(const double* value) const {
   std::vector<int> ret;
+  if (is_predict_on_bins_) {
+    std::vector<uint16_t> bins(bin_features_.size());
+    ValuesToBins(value, bins.data());
+    for (int i = 0; i < num_used_model_; ++i) {
+      for (int j = 0; j < num_class_; ++j) {
+        ret.push_back(models_[i * num_class_ + j]->PredictLeafIndexByBins(bins.data()));
+      }
+    }
+    return ret;
+  }
   for (int i = 0; i < num_used_model_; ++i) {
     for (int j = 0; j < num_class_; ++j) {
       ret.push_back(models_[i * num_class_ + j]->PredictLeafIndex(value));
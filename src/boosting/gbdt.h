@@ -5,10 +5,15 @@
 #include "score_updater.hpp"
 
 #include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <limits>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <memory>
+#include <thread>
 
 namespace LightGBM {
 /*!
@@ -53,6 +58,23 @@ public:
 
   bool EvalAndCheckEarlyStopping() override;
 
+  /*!
+  * \brief Refit the leaf outputs of existing trees on the training data
+  * \param leaf_preds Leaf index of each data in each tree, row-major with num_models values per data
+  * \param num_data Number of data
+  * \param num_models Number of trees
+  */
+  void RefitTree(const int* leaf_preds, data_size_t num_data, int num_models) override;
+
+  /*!
+  * \brief Continue training after rows are appended to the training data
+  * \param object_function Objective function initialized on the appended training data
+  * \param training_metrics Training metrics initialized on the appended training data
+  * \param num_old_data Number of training data before appending
+  */
+  void AppendTrainingData(const ObjectiveFunction* object_function,
+    const std::vector<const Metric*>& training_metrics, data_size_t num_old_data) override;
+
   /*!
   * \brief Get evaluation result at data_idx data
   * \param data_idx 0: training data, 1: 1st validation data
@@ -89,6 +111,69 @@ public:
   */
   std::vector<double> Predict(const double* feature_values) const override;
   
+  /*!
+  * \brief Predtion for a block of records without sigmoid transformation
+  * \param feature_values Feature values of the records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param output Prediction results, row-major with NumberOfClasses() columns
+  */
+  void PredictRawForRows(const double* feature_values, int num_rows, double* output) const override;
+
+  /*!
+  * \brief Predtion for a block of records with sigmoid transformation if enabled
+  * \param feature_values Feature values of the records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param output Prediction results, row-major with NumberOfClasses() columns
+  */
+  void PredictForRows(const double* feature_values, int num_rows, double* output) const override;
+
+  /*!
+  * \brief Staged predtion for a block of records without sigmoid transformation
+  * \param feature_values Feature values of the records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param period Number of iterations between stages
+  * \param output Prediction results, row-major with NumberOfPredictStages(period) * NumberOfClasses() columns
+  */
+  void PredictRawStagedForRows(const double* feature_values, int num_rows, int period, double* output) const override;
+
+  /*!
+  * \brief Staged predtion for a block of records with sigmoid transformation if enabled
+  * \param feature_values Feature values of the records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param period Number of iterations between stages
+  * \param output Prediction results, row-major with NumberOfPredictStages(period) * NumberOfClasses() columns
+  */
+  void PredictStagedForRows(const double* feature_values, int num_rows, int period, double* output) const override;
+
+  /*!
+  * \brief Get number of stages of staged prediction and evaluation
+  * \param period Number of iterations between stages
+  */
+  int NumberOfPredictStages(int period) const override;
+
+  /*!
+  * \brief Evaluate metrics on data after every period iterations
+  * \param data Data to evaluate on
+  * \param metrics Metrics initialized on data
+  * \param period Number of iterations between stages
+  * \return Results of all metrics at each stage
+  */
+  std::vector<std::vector<double>> EvalStaged(const Dataset* data,
+    const std::vector<const Metric*>& metrics, int period) const override;
+
+  /*!
+  * \brief Contributions of features to the raw scores of a block of records by TreeSHAP
+  * \param feature_values Feature values of the records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \param output Contributions, row-major with NumberOfClasses() * (MaxFeatureIdx() + 2) columns
+  */
+  void PredictContribForRows(const double* feature_values, int num_rows, double* output) const override;
+
+  /*!
+  * \brief Can PredictContribForRows be used, false if some used trees are loaded from old model files
+  */
+  bool CanPredictContrib() const override;
+
   /*!
   * \brief Predtion for one record with leaf index
   * \param feature_values Feature value on this record
@@ -104,10 +189,43 @@ public:
   */
   virtual void SaveModelToFile(int num_used_model, bool is_finish, const char* filename) override;
   /*!
+  * \brief Save model to C++ source code, trees are compiled into nested if-else
+  * \param num_used_model Number of iterations that want to save, -1 means save all
+  * \param filename Filename that want to save to
+  */
+  void SaveModelToIfElse(int num_used_model, const char* filename) const override;
+  /*!
+  * \brief Save model to binary file
+  * \param num_used_model Number of iterations that want to save, -1 means save all
+  * \param filename Filename that want to save to
+  */
+  void SaveModelToBinaryFile(int num_used_model, const char* filename) const override;
+  /*!
+  * \brief Restore from the memory of a binary model file
+  * \param memory Pointer of the memory
+  * \param size Sizes in byte of the memory
+  */
+  void LoadModelFromBinary(const char* memory, size_t size) override;
+  /*!
   * \brief Restore from a serialized string
   */
   void LoadModelFromString(const std::string& model_str) override;
   /*!
+  * \brief Save the state of training to a binary checkpoint
+  * \param filename Filename that want to save to
+  */
+  void SaveCheckpoint(const char* filename) override;
+  /*!
+  * \brief Resume training from a checkpoint, should be called after Init and AddDataset
+  * \param filename Filename of the checkpoint
+  */
+  void LoadCheckpoint(const char* filename) override;
+  /*!
+  * \brief Get number of finished training iterations
+  * \return Number of finished training iterations
+  */
+  inline int GetCurrentIteration() const override { return iter_; }
+  /*!
   * \brief Get max feature index of this model
   * \return Max feature index of this model
   */
@@ -140,18 +258,57 @@ public:
     }
   }
   
+  /*!
+  * \brief Set whether to predict on bins, falls back to feature values if the model is too large for 16-bit bins
+  * \param is_predict_on_bins True if predict on bins
+  */
+  void SetPredictOnBins(bool is_predict_on_bins) override;
+
+  /*!
+  * \brief Set early stopping of prediction, only for binary and multiclass classification
+  * \param round_period Number of iterations between checks, <= 0 means disable
+  * \param margin_threshold Threshold of the margin
+  */
+  void SetPredictEarlyStop(int round_period, double margin_threshold) override;
+
+  /*!
+  * \brief Get memory usage of training
+  * \return Bytes of each component
+  */
+  MemoryUsage GetMemoryUsage() const override;
+
   /*!
   * \brief Get Type name of this boosting object
   */
   virtual const char* Name() const override { return "gbdt"; }
 
 protected:
+  /*! \brief Max number of leaves in a block of trees for block prediction, the nodes of a block fit in L2 cache */
+  static const int kPredictTreeBlockLeaves = 4096;
+  /*! \brief Number of data in a block of bagging, blocks are sampled in parallel */
+  static const data_size_t kBaggingBlockSize = 16384;
   /*!
   * \brief Implement bagging logic
   * \param iter Current interation
   * \param curr_class Current class for multiclass training
   */
-  void Bagging(int iter, const int curr_class);
+  virtual void Bagging(int iter, const int curr_class);
+  /*!
+  * \brief Create and initialize tree learners of all classes on the training data, within max_memory
+  * \param is_bagging True if bagging buffers will be used
+  */
+  void ResetTreeLearners(bool is_bagging);
+  /*!
+  * \brief Warn if the memory usage of training is more than max_memory
+  */
+  void CheckMemoryBudget() const;
+  /*!
+  * \brief Train trees of all classes concurrently, each class on a subset of threads
+  * \param gradient Gradients of all classes
+  * \param hessian Hessians of all classes
+  * \return Trees of all classes, empty if classes cannot be trained concurrently
+  */
+  std::vector<std::unique_ptr<Tree>> TrainClassesConcurrently(const score_t* gradient, const score_t* hessian);
   /*!
   * \brief updating score for out-of-bag data.
   *        Data should be update since we may re-bagging data on training
@@ -172,13 +329,96 @@ protected:
   /*!
   * \brief Print metric result of current iteration
   * \param iter Current interation
+  * \param train_score Scores of training data
+  * \param valid_scores Scores of validation data
+  * \return True if early stopping is met
   */
-  bool OutputMetric(int iter);
+  bool OutputMetric(int iter, const score_t* train_score, const std::vector<const score_t*>& valid_scores);
+  /*!
+  * \brief Snapshot scores of current iteration and evaluate metrics on them in a background thread
+  */
+  void StartAsyncMetric();
+  /*!
+  * \brief Wait for the metrics evaluated in background
+  * \param out_iter Output the iteration that is evaluated, -1 if there is no evaluation
+  * \return True if early stopping is met
+  */
+  bool WaitForAsyncMetric(int* out_iter);
+  /*!
+  * \brief Remove models after the best iteration when early stopping is met
+  * \param eval_iter The iteration that meets early stopping
+  */
+  void EarlyStop(int eval_iter);
+  /*!
+  * \brief Get the states of random generators for checkpoints
+  * \return States of the bagging generator and the tree learners
+  */
+  virtual std::vector<std::string> GetRandomStates() const;
+  /*!
+  * \brief Restore the states of random generators from a checkpoint
+  * \param states States from GetRandomStates
+  */
+  virtual void SetRandomStates(const std::vector<std::string>& states);
   /*!
   * \brief Calculate feature importances
   * \param last_iter Last tree use to calculate
   */
   std::string FeatureImportance() const;
+  /*!
+  * \brief Check early stopping of prediction after one iteration
+  * \param iter Index of the iteration that is just added to score
+  * \param score Raw scores of the record, num_class_ values
+  * \return True if the rest trees can be skipped
+  */
+  inline bool IsPredictEarlyStop(int iter, const double* score) const {
+    if (predict_early_stop_period_ <= 0 || (iter + 1) % predict_early_stop_period_ != 0) { return false; }
+    double margin = 0.0f;
+    if (num_class_ == 1) {
+      margin = 2.0f * std::fabs(score[0]);
+    } else {
+      double top1 = score[0];
+      double top2 = -std::numeric_limits<double>::infinity();
+      for (int i = 1; i < num_class_; ++i) {
+        if (score[i] > top1) {
+          top2 = top1;
+          top1 = score[i];
+        } else if (score[i] > top2) {
+          top2 = score[i];
+        }
+      }
+      margin = top1 - top2;
+    }
+    return margin > predict_early_stop_margin_;
+  }
+  /*!
+  * \brief Map records to bins if predict on bins
+  * \param feature_values Feature values of records, row-major with MaxFeatureIdx() + 1 columns
+  * \param num_rows Number of records
+  * \return Bins of records, row-major with bin_features_.size() columns, empty if not predict on bins
+  */
+  std::vector<uint16_t> RowsToBins(const double* feature_values, int num_rows) const;
+  /*!
+  * \brief Sigmoid or softmax transformation of raw scores in place, if needed
+  * \param output Raw scores, row-major with num_class_ columns
+  * \param num_rows Number of rows of output
+  */
+  void ConvertOutputs(double* output, int num_rows) const;
+  /*!
+  * \brief Map one record to bins for prediction on bins
+  * \param feature_values Feature values of the record
+  * \param bins Output, bin of each slot in bin_features_
+  */
+  inline void ValuesToBins(const double* feature_values, uint16_t* bins) const {
+    for (size_t i = 0; i < bin_features_.size(); ++i) {
+      const double value = feature_values[bin_features_[i]];
+      const std::vector<double>& thresholds = bin_thresholds_[i];
+      if (std::isnan(value)) {
+        bins[i] = static_cast<uint16_t>(thresholds.size());
+      } else {
+        bins[i] = static_cast<uint16_t>(std::lower_bound(thresholds.begin(), thresholds.end(), value) - thresholds.begin());
+      }
+    }
+  }
   /*! \brief current iteration */
   int iter_;
   /*! \brief Pointer to training data */
@@ -202,6 +442,16 @@ protected:
   /*! \brief Best score(s) for early stopping */
   std::vector<std::vector<int>> best_iter_;
   std::vector<std::vector<double>> best_score_;
+  /*! \brief Thread that evaluates metrics in background */
+  std::thread async_metric_thread_;
+  /*! \brief Iteration evaluated by async_metric_thread_ */
+  int async_metric_iter_;
+  /*! \brief True if early stopping is met by async_metric_thread_ */
+  bool is_async_metric_early_stopping_;
+  /*! \brief Snapshot of training scores for async_metric_thread_ */
+  std::vector<score_t> async_train_score_;
+  /*! \brief Snapshot of validation scores for async_metric_thread_ */
+  std::vector<std::vector<score_t>> async_valid_scores_;
   /*! \brief Trained models(trees) */
   std::vector<std::unique_ptr<Tree>> models_;
   /*! \brief Max feature index of training data*/
@@ -239,6 +489,24 @@ protected:
   int num_used_model_;
   /*! \brief Shrinkage rate for one iteration */
   double shrinkage_rate_;
+  /*! \brief True if this booster enables the shared profiler */
+  bool is_profiler_enabled_;
+  /*! \brief True if predict on bins */
+  bool is_predict_on_bins_;
+  /*! \brief Number of classes whose trees are trained at the same time */
+  int num_concurrent_classes_;
+  /*! \brief True if gradients are calculated in the same pass of updating training scores */
+  bool is_fuse_gradients_;
+  /*! \brief True if gradients_ are already calculated from current training scores */
+  bool is_gradients_updated_;
+  /*! \brief Features used by the model, the original index of each slot in the bins of a record */
+  std::vector<int> bin_features_;
+  /*! \brief Sorted distinct thresholds of each slot, the bin boundaries */
+  std::vector<std::vector<double>> bin_thresholds_;
+  /*! \brief Number of iterations between checks of prediction early stopping, <= 0 means disable */
+  int predict_early_stop_period_;
+  /*! \brief Margin threshold of prediction early stopping */
+  double predict_early_stop_margin_;
 };
 
 }  // namespace LightGBM
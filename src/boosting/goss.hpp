@@ -0,0 +1,160 @@
+#ifndef LIGHTGBM_BOOSTING_GOSS_H_
+#define LIGHTGBM_BOOSTING_GOSS_H_
+
+#include <LightGBM/boosting.h>
+#include "score_updater.hpp"
+#include "gbdt.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace LightGBM {
+/*!
+* \brief Gradient-based One-Side Sampling.
+*        Keeps the data with large gradients, samples from the rest and re-weights the sampled ones.
+*/
+class GOSS: public GBDT {
+public:
+  /*!
+  * \brief Constructor
+  */
+  GOSS(): GBDT() { }
+  /*!
+  * \brief Destructor
+  */
+  ~GOSS() { }
+  /*!
+  * \brief Initialization logic
+  * \param config Config for boosting
+  * \param train_data Training data
+  * \param object_function Training objective function
+  * \param training_metrics Training metrics
+  */
+  void Init(const BoostingConfig* config, const Dataset* train_data, const ObjectiveFunction* object_function,
+    const std::vector<const Metric*>& training_metrics) override {
+    GBDT::Init(config, train_data, object_function, training_metrics);
+    if (gbdt_config_->bagging_fraction < 1.0 && gbdt_config_->bagging_freq > 0) {
+      Log::Warning("Bagging is replaced by gradient-based one-side sampling in goss");
+    }
+    top_rate_ = gbdt_config_->top_rate;
+    other_rate_ = gbdt_config_->other_rate;
+    // gradients will be re-weighted in place, so always keep own copy
+    gradients_.resize(num_data_ * num_class_);
+    hessians_.resize(num_data_ * num_class_);
+    out_of_bag_data_indices_.resize(num_data_);
+    bag_data_indices_.resize(num_data_);
+    tmp_abs_gradients_.resize(num_data_);
+  }
+  /*! \brief Continue training after rows are appended to the training data */
+  void AppendTrainingData(const ObjectiveFunction* object_function,
+    const std::vector<const Metric*>& training_metrics, data_size_t num_old_data) override {
+    GBDT::AppendTrainingData(object_function, training_metrics, num_old_data);
+    gradients_.resize(num_data_ * num_class_);
+    hessians_.resize(num_data_ * num_class_);
+    out_of_bag_data_indices_.resize(num_data_);
+    bag_data_indices_.resize(num_data_);
+    tmp_abs_gradients_.resize(num_data_);
+  }
+  /*!
+  * \brief one training iteration
+  */
+  bool TrainOneIter(const score_t* gradient, const score_t* hessian, bool is_eval) override {
+    if (gradient == nullptr || hessian == nullptr) {
+      Boosting();
+    } else {
+      std::memcpy(gradients_.data(), gradient, sizeof(score_t) * num_data_ * num_class_);
+      std::memcpy(hessians_.data(), hessian, sizeof(score_t) * num_data_ * num_class_);
+    }
+    return GBDT::TrainOneIter(gradients_.data(), hessians_.data(), is_eval);
+  }
+  /*!
+  * \brief Get Type name of this boosting object
+  */
+  const char* Name() const override { return "goss"; }
+
+  MemoryUsage GetMemoryUsage() const override {
+    MemoryUsage memory_usage = GBDT::GetMemoryUsage();
+    memory_usage.Add(kGradientsMemory, tmp_abs_gradients_.capacity() * sizeof(score_t));
+    return memory_usage;
+  }
+
+protected:
+  /*!
+  * \brief Sample data by gradients
+  * \param iter Current interation
+  * \param curr_class Current class for multiclass training
+  */
+  void Bagging(int iter, const int curr_class) override {
+    // gradients of the first iterations are not informative, use all data
+    if (iter < static_cast<int>(1.0f / gbdt_config_->learning_rate)) {
+      bag_data_cnt_ = num_data_;
+      out_of_bag_data_cnt_ = 0;
+      tree_learner_[curr_class]->SetBaggingData(nullptr, num_data_);
+      return;
+    }
+    score_t* gradients = gradients_.data() + curr_class * num_data_;
+    score_t* hessians = hessians_.data() + curr_class * num_data_;
+    const data_size_t top_k = static_cast<data_size_t>(top_rate_ * num_data_);
+    const data_size_t other_k = static_cast<data_size_t>(other_rate_ * num_data_);
+    // get threshold of large gradients
+    score_t threshold = std::numeric_limits<score_t>::infinity();
+    if (top_k > 0) {
+      #pragma omp parallel for schedule(static)
+      for (data_size_t i = 0; i < num_data_; ++i) {
+        tmp_abs_gradients_[i] = std::fabs(gradients[i]);
+      }
+      std::nth_element(tmp_abs_gradients_.begin(), tmp_abs_gradients_.begin() + top_k - 1,
+        tmp_abs_gradients_.end(), std::greater<score_t>());
+      threshold = tmp_abs_gradients_[top_k - 1];
+    }
+    data_size_t big_cnt = 0;
+    #pragma omp parallel for schedule(static) reduction(+:big_cnt)
+    for (data_size_t i = 0; i < num_data_; ++i) {
+      if (std::fabs(gradients[i]) >= threshold) { ++big_cnt; }
+    }
+    const data_size_t rest_cnt = num_data_ - big_cnt;
+    const data_size_t sample_cnt = std::min(other_k, rest_cnt);
+    // sampled small gradients stand for all small gradients
+    const score_t multiply = sample_cnt > 0 ? static_cast<score_t>(rest_cnt) / sample_cnt : 1.0f;
+    data_size_t cur_left_cnt = 0;
+    data_size_t cur_right_cnt = 0;
+    data_size_t cur_sampled_cnt = 0;
+    data_size_t cur_rest_cnt = 0;
+    for (data_size_t i = 0; i < num_data_; ++i) {
+      if (std::fabs(gradients[i]) >= threshold) {
+        bag_data_indices_[cur_left_cnt++] = i;
+        continue;
+      }
+      double prob = (sample_cnt - cur_sampled_cnt) / static_cast<double>(rest_cnt - cur_rest_cnt);
+      ++cur_rest_cnt;
+      if (random_.NextDouble() < prob) {
+        bag_data_indices_[cur_left_cnt++] = i;
+        ++cur_sampled_cnt;
+        gradients[i] *= multiply;
+        hessians[i] *= multiply;
+      } else {
+        out_of_bag_data_indices_[cur_right_cnt++] = i;
+      }
+    }
+    bag_data_cnt_ = cur_left_cnt;
+    out_of_bag_data_cnt_ = cur_right_cnt;
+    Log::Debug("Re-bagging, using %d data to train", bag_data_cnt_);
+    // set bagging data to tree learner
+    tree_learner_[curr_class]->SetBaggingData(bag_data_indices_.data(), bag_data_cnt_);
+  }
+
+private:
+  /*! \brief Fraction of data with large gradients that are always kept */
+  double top_rate_;
+  /*! \brief Fraction of data sampled from the data with small gradients */
+  double other_rate_;
+  /*! \brief Buffer for selecting the threshold of large gradients */
+  std::vector<score_t> tmp_abs_gradients_;
+};
+
+}  // namespace LightGBM
+#endif   // LightGBM_BOOSTING_GOSS_H_
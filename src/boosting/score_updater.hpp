@@ -5,8 +5,12 @@
 #include <LightGBM/dataset.h>
 #include <LightGBM/tree.h>
 #include <LightGBM/tree_learner.h>
+#include <LightGBM/objective_function.h>
+#include <LightGBM/utils/profiler.h>
 
 #include <cstring>
+#include <cstdint>
+#include <vector>
 
 namespace LightGBM {
 /*!
@@ -42,6 +46,7 @@ public:
   * \param curr_class Current class for multiclass training
   */
   inline void AddScore(const Tree* tree, int curr_class) {
+    ProfileScope profile_scope(kAddScoreProfile);
     tree->AddPredictionToScore(data_, num_data_, score_.data() + curr_class * num_data_);
   }
   /*!
@@ -52,9 +57,23 @@ public:
   * \param curr_class Current class for multiclass training
   */
   inline void AddScore(const TreeLearner* tree_learner, int curr_class) {
+    ProfileScope profile_scope(kAddScoreProfile);
     tree_learner->AddPredictionToScore(score_.data() + curr_class * num_data_);
   }
   /*!
+  * \brief Adding prediction score like AddScore(tree_learner, curr_class), and calculate gradients
+  *        of the new scores in the same pass, only used for training data of single class
+  * \param tree_learner
+  * \param object_function Objective function that supports fused gradients
+  * \param gradients Output gradients
+  * \param hessians Output hessians
+  */
+  inline void AddScoreAndGetGradients(const TreeLearner* tree_learner, const ObjectiveFunction* object_function,
+                                      score_t* gradients, score_t* hessians) {
+    ProfileScope profile_scope(kAddScoreProfile);
+    tree_learner->AddPredictionToScoreAndGetGradients(object_function, score_.data(), gradients, hessians);
+  }
+  /*!
   * \brief Using tree model to get prediction number, then adding to scores for parts of data
   *        Used for prediction of training out-of-bag data
   * \param tree Trained tree model
@@ -64,23 +83,123 @@ public:
   */
   inline void AddScore(const Tree* tree, const data_size_t* data_indices,
                                                   data_size_t data_cnt, int curr_class) {
+    ProfileScope profile_scope(kAddScoreProfile);
     tree->AddPredictionToScore(data_, data_indices, data_cnt, score_.data() + curr_class * num_data_);
   }
+  /*!
+  * \brief Store leaf index of each data in the tree, in 1 byte for trees with at most 256 leaves, otherwise 2 bytes.
+  *        Trees with more than 65536 leaves are not cached
+  * \param tree Tree model
+  * \param tree_idx Index of the tree in the model
+  */
+  void CacheLeafIndex(const Tree* tree, int tree_idx) {
+    if (static_cast<size_t>(tree_idx) >= leaf_index_cache_.size()) {
+      leaf_index_cache_.resize(tree_idx + 1);
+    }
+    LeafIndexCache& cache = leaf_index_cache_[tree_idx];
+    cache.leaf8.clear();
+    cache.leaf16.clear();
+    if (tree->num_leaves() <= 256) {
+      cache.leaf8.resize(num_data_);
+      tree->GetLeafIndex(data_, num_data_, cache.leaf8.data());
+    } else if (tree->num_leaves() <= 65536) {
+      cache.leaf16.resize(num_data_);
+      tree->GetLeafIndex(data_, num_data_, cache.leaf16.data());
+    }
+  }
+  /*!
+  * \brief Adding the current outputs of a tree to scores by the cached leaf index, gathering leaf outputs
+  *        instead of traversing the tree. The same as AddScore(tree, curr_class) if the structure isn't changed
+  * \param tree Tree model, its leaf outputs can be changed after CacheLeafIndex
+  * \param tree_idx Index of the tree in the model
+  * \param curr_class Current class for multiclass training
+  */
+  inline void AddScoreByCachedLeafIndex(const Tree* tree, int tree_idx, int curr_class) {
+    ProfileScope profile_scope(kAddScoreProfile);
+    score_t* score = score_.data() + curr_class * num_data_;
+    if (static_cast<size_t>(tree_idx) < leaf_index_cache_.size()) {
+      const LeafIndexCache& cache = leaf_index_cache_[tree_idx];
+      if (!cache.leaf8.empty()) {
+        AddScoreByLeafIndex(tree, cache.leaf8.data(), score);
+        return;
+      } else if (!cache.leaf16.empty()) {
+        AddScoreByLeafIndex(tree, cache.leaf16.data(), score);
+        return;
+      }
+    }
+    tree->AddPredictionToScore(data_, num_data_, score);
+  }
+  /*!
+  * \brief Extend scores to the rows appended to the bound data set, see Dataset::Append.
+  *        Scores of the old rows are kept, the new rows start from their initial scores. Cached leaf index is cleared
+  * \param num_old_data Number of data before appending
+  */
+  void AppendData(data_size_t num_old_data) {
+    CHECK(num_old_data == num_data_);
+    const size_t num_class = score_.size() / num_data_;
+    const data_size_t num_data = data_->num_data();
+    std::vector<score_t> score(static_cast<size_t>(num_data) * num_class, 0.0f);
+    const float* init_score = data_->metadata().init_score();
+    for (size_t k = 0; k < num_class; ++k) {
+      std::memcpy(score.data() + k * num_data, score_.data() + k * num_data_, sizeof(score_t) * num_data_);
+      if (init_score != nullptr) {
+        for (data_size_t i = num_data_; i < num_data; ++i) {
+          score[k * num_data + i] = init_score[k * num_data + i];
+        }
+      }
+    }
+    score_.swap(score);
+    num_data_ = num_data;
+    leaf_index_cache_.clear();
+  }
+  /*!
+  * \brief Replace all scores, used to restore scores from checkpoints
+  * \param score New scores, num_data * num_class values
+  */
+  inline void SetScore(const score_t* score) {
+    std::memcpy(score_.data(), score, sizeof(score_t) * score_.size());
+  }
   /*! \brief Pointer of score */
   inline const score_t* score() const { return score_.data(); }
   inline const data_size_t num_data() const { return num_data_; }
+  /*! \brief Bound data set */
+  inline const Dataset* data() const { return data_; }
+  /*! \brief Size in byte of scores and cached leaf index */
+  size_t SizesInByte() const {
+    size_t ret = score_.capacity() * sizeof(score_t);
+    for (const auto& cache : leaf_index_cache_) {
+      ret += cache.leaf8.capacity() * sizeof(uint8_t) + cache.leaf16.capacity() * sizeof(uint16_t);
+    }
+    return ret;
+  }
 
   /*! \brief Disable copy */
   ScoreUpdater& operator=(const ScoreUpdater&) = delete;
   /*! \brief Disable copy */
   ScoreUpdater(const ScoreUpdater&) = delete;
 private:
+  /*! \brief Leaf index of each data in one tree, only one of them is used */
+  struct LeafIndexCache {
+    std::vector<uint8_t> leaf8;
+    std::vector<uint16_t> leaf16;
+  };
+
+  template<typename T>
+  inline void AddScoreByLeafIndex(const Tree* tree, const T* leaf_index, score_t* score) const {
+    #pragma omp parallel for schedule(static)
+    for (data_size_t i = 0; i < num_data_; ++i) {
+      score[i] += static_cast<score_t>(tree->LeafOutput(leaf_index[i]));
+    }
+  }
+
   /*! \brief Number of total data */
   data_size_t num_data_;
   /*! \brief Pointer of data set */
   const Dataset* data_;
   /*! \brief Scores for data set */
   std::vector<score_t> score_;
+  /*! \brief Cached leaf index of each tree, only used by DART */
+  std::vector<LeafIndexCache> leaf_index_cache_;
 };
 
 }  // namespace LightGBM
@@ -2,6 +2,8 @@
 
 #include <LightGBM/utils/common.h>
 #include <LightGBM/utils/random.h>
+#include <LightGBM/utils/profiler.h>
+#include <LightGBM/utils/threading.h>
 #include <LightGBM/c_api.h>
 #include <LightGBM/dataset_loader.h>
 #include <LightGBM/dataset.h>
@@ -9,12 +11,17 @@
 #include <LightGBM/objective_function.h>
 #include <LightGBM/metric.h>
 #include <LightGBM/config.h>
+#include <LightGBM/network.h>
 
 #include <cstdio>
+#include <cmath>
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <stdexcept>
 
 #include "./application/predictor.hpp"
@@ -32,7 +39,16 @@ public:
     std::vector<std::string> valid_names,
     const char* parameters)
     :train_data_(train_data), valid_datas_(valid_data) {
+    train_data_->AddBooster();
+    for (auto valid_data : valid_datas_) {
+      valid_data->AddBooster();
+    }
     config_.LoadFromString(parameters);
+    num_threads_ = config_.num_threads;
+    if (config_.is_use_thread_pool) {
+      thread_pool_.reset(new ThreadPool(config_.num_threads));
+    }
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
     // create boosting
     if (config_.io_config.input_model.size() > 0) {
       Log::Warning("continued train from model is not support for c_api, \
@@ -46,15 +62,7 @@ public:
       Log::Warning("Using self-defined objective functions");
     }
     // create training metric
-    for (auto metric_type : config_.metric_types) {
-      auto metric = std::unique_ptr<Metric>(
-        Metric::CreateMetric(metric_type, config_.metric_config));
-      if (metric == nullptr) { continue; }
-      metric->Init("training", train_data_->metadata(),
-        train_data_->num_data());
-      train_metric_.push_back(std::move(metric));
-    }
-    train_metric_.shrink_to_fit();
+    CreateTrainingMetrics();
     // add metric for validation data
     for (size_t i = 0; i < valid_datas_.size(); ++i) {
       valid_metrics_.emplace_back();
@@ -81,21 +89,40 @@ public:
       boosting_->AddDataset(valid_datas_[i],
         Common::ConstPtrInVectorWrapper<Metric>(valid_metrics_[i]));
     }
+    Log::Info("Memory usage: %s", boosting_->GetMemoryUsage().ToString().c_str());
   }
 
   ~Booster() {
-
+    if (train_data_ != nullptr) {
+      train_data_->RemoveBooster();
+    }
+    for (auto valid_data : valid_datas_) {
+      valid_data->RemoveBooster();
+    }
   }
 
   bool TrainOneIter() {
-    return boosting_->TrainOneIter(nullptr, nullptr, false);
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    bool is_finished = boosting_->TrainOneIter(nullptr, nullptr, false);
+    if (config_.boosting_config.is_enable_profiler) {
+      Profiler::LogStats(boosting_->GetCurrentIteration());
+    }
+    return is_finished;
   }
 
   bool TrainOneIter(const float* gradients, const float* hessians) {
-    return boosting_->TrainOneIter(gradients, hessians, false);
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    bool is_finished = boosting_->TrainOneIter(gradients, hessians, false);
+    if (config_.boosting_config.is_enable_profiler) {
+      Profiler::LogStats(boosting_->GetCurrentIteration());
+    }
+    return is_finished;
   }
 
   void PrepareForPrediction(int num_used_model, int predict_type) {
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    num_used_model_ = num_used_model;
+    predict_type_ = predict_type;
     boosting_->SetNumUsedModel(num_used_model);
     bool is_predict_leaf = false;
     bool is_raw_score = false;
@@ -106,20 +133,202 @@ public:
     } else {
       is_raw_score = false;
     }
-    predictor_.reset(new Predictor(boosting_.get(), is_raw_score, is_predict_leaf));
+    predictor_.reset(new Predictor(boosting_.get(), is_raw_score, is_predict_leaf,
+      predict_type == C_API_PREDICT_CONTRIB));
+  }
+
+  void SetPredictOnBins(bool is_predict_on_bins) {
+    boosting_->SetPredictOnBins(is_predict_on_bins);
+  }
+
+  void SetPredictEarlyStop(int round_period, double margin_threshold) {
+    boosting_->SetPredictEarlyStop(round_period, margin_threshold);
   }
 
   std::vector<double> Predict(const std::vector<std::pair<int, double>>& features) {
     return predictor_->GetPredictFunction()(features);
   }
 
+  void PredictRows(const std::function<std::vector<std::pair<int, double>>(int row_idx)>& get_row_fun,
+    int num_rows, double* output) {
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    if (predict_type_ != C_API_PREDICT_LEAF_INDEX) {
+      predictor_->PredictRows(get_row_fun, num_rows, output);
+      return;
+    }
+    // one leaf index per used tree
+    Threading::ParallelFor(0, num_rows, [&](int i) {
+      auto one_row = get_row_fun(i);
+      auto predicton_result = Predict(one_row);
+      for (size_t j = 0; j < predicton_result.size(); ++j) {
+        output[static_cast<size_t>(i) * predicton_result.size() + j] = predicton_result[j];
+      }
+    });
+  }
+
+  /*!
+  * \brief Predict contributions of rows into sparse buffers of this booster, only the non-zero ones are kept
+  * \param get_row_fun Function to get the features of a row
+  * \param num_rows Number of rows
+  */
+  void PredictContribSparse(const std::function<std::vector<std::pair<int, double>>(int row_idx)>& get_row_fun,
+    int num_rows) {
+    if (predict_type_ != C_API_PREDICT_CONTRIB) {
+      Log::Fatal("Sparse prediction is only for contributions");
+    }
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    std::vector<std::vector<std::pair<int32_t, double>>> row_contribs(num_rows);
+    Threading::ParallelFor(0, num_rows, [&](int i) {
+      const std::vector<double> contribs = Predict(get_row_fun(i));
+      for (size_t j = 0; j < contribs.size(); ++j) {
+        if (contribs[j] != 0.0f) {
+          row_contribs[i].emplace_back(static_cast<int32_t>(j), contribs[j]);
+        }
+      }
+    });
+    sparse_indptr_.assign(num_rows + 1, 0);
+    for (int i = 0; i < num_rows; ++i) {
+      sparse_indptr_[i + 1] = sparse_indptr_[i] + static_cast<int64_t>(row_contribs[i].size());
+    }
+    sparse_indices_.resize(sparse_indptr_[num_rows]);
+    sparse_data_.resize(sparse_indptr_[num_rows]);
+    Threading::ParallelFor(0, num_rows, [&](int i) {
+      for (size_t j = 0; j < row_contribs[i].size(); ++j) {
+        sparse_indices_[sparse_indptr_[i] + j] = row_contribs[i][j].first;
+        sparse_data_[sparse_indptr_[i] + j] = row_contribs[i][j].second;
+      }
+    });
+  }
+
+  /*! \brief Row headers of the last sparse prediction */
+  const std::vector<int64_t>& sparse_indptr() const { return sparse_indptr_; }
+  /*! \brief Column indices of the last sparse prediction */
+  const std::vector<int32_t>& sparse_indices() const { return sparse_indices_; }
+  /*! \brief Values of the last sparse prediction */
+  const std::vector<double>& sparse_data() const { return sparse_data_; }
+
+  void PredictRowsStaged(const std::function<std::vector<std::pair<int, double>>(int row_idx)>& get_row_fun,
+    int num_rows, int period, double* output) {
+    if (predict_type_ == C_API_PREDICT_LEAF_INDEX || predict_type_ == C_API_PREDICT_CONTRIB) {
+      Log::Fatal("Staged prediction doesn't support leaf index or contributions");
+    }
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    predictor_->PredictRowsStaged(get_row_fun, num_rows, period, output);
+  }
+
+  /*!
+  * \brief Evaluate the metrics of parameters on data after every period iterations
+  * \param data Data constructed with the training data as the reference
+  * \param num_used_model Number of used trees, -1 means all
+  * \param period Number of iterations between stages
+  * \return Results of all metrics at each stage
+  */
+  std::vector<std::vector<double>> EvalStaged(const Dataset* data, int num_used_model, int period) {
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    std::vector<std::unique_ptr<Metric>> metrics;
+    for (auto metric_type : config_.metric_types) {
+      auto metric = std::unique_ptr<Metric>(Metric::CreateMetric(metric_type, config_.metric_config));
+      if (metric == nullptr) { continue; }
+      metric->Init("staged", data->metadata(), data->num_data());
+      metrics.push_back(std::move(metric));
+    }
+    boosting_->SetNumUsedModel(num_used_model < 0 ? boosting_->NumberOfSubModels() : num_used_model);
+    return boosting_->EvalStaged(data, Common::ConstPtrInVectorWrapper<Metric>(metrics), period);
+  }
+
   void PredictForFile(const char* data_filename, const char* result_filename, bool data_has_header) {
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
     predictor_->Predict(data_filename, result_filename, data_has_header);
   }
 
+  void SetNumThreads(int num_threads) {
+    num_threads_ = num_threads;
+    thread_pool_.reset(nullptr);
+    if (num_threads > 0) {
+      thread_pool_.reset(new ThreadPool(num_threads));
+    }
+    // buffers of the predictor are for the old number of threads
+    if (predictor_ != nullptr) {
+      PrepareForPrediction(num_used_model_, predict_type_);
+    }
+  }
+
+  void SetNumUsedModel(int num_used_model) {
+    boosting_->SetNumUsedModel(num_used_model);
+  }
+
   void SaveModelToFile(int num_used_model, const char* filename) {
     boosting_->SaveModelToFile(num_used_model, true, filename);
   }
+
+  /*!
+  * \brief Refit the leaf outputs of trees on the training data. A booster loaded from model file is
+  *        initialized on train_data with parameters first, otherwise train_data should be its training data
+  */
+  void Refit(const Dataset* train_data, const char* parameters, const int32_t* leaf_preds, int32_t nrow, int32_t ncol) {
+    if (train_data_ == nullptr) {
+      const int num_class = boosting_->NumberOfClasses();
+      config_.LoadFromString(parameters);
+      if (config_.boosting_config.num_class != num_class) {
+        Log::Fatal("num_class in parameters (%d) is different from the model (%d)",
+          config_.boosting_config.num_class, num_class);
+      }
+      num_threads_ = config_.num_threads;
+      if (config_.is_use_thread_pool) {
+        thread_pool_.reset(new ThreadPool(config_.num_threads));
+      }
+      ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+      train_data_ = train_data;
+      train_data_->AddBooster();
+      objective_fun_.reset(ObjectiveFunction::CreateObjectiveFunction(config_.objective_type,
+        config_.objective_config));
+      if (objective_fun_ == nullptr) {
+        Log::Fatal("Refitting trees needs an objective function");
+      }
+      objective_fun_->Init(train_data_->metadata(), train_data_->num_data());
+      boosting_->Init(&config_.boosting_config, train_data_, objective_fun_.get(), {});
+    } else if (train_data != train_data_) {
+      Log::Fatal("Booster with training data can only be refitted on its training data");
+    }
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    boosting_->RefitTree(leaf_preds, nrow, ncol);
+  }
+
+  /*!
+  * \brief Append rows of new data to the training data and continue training on all of them,
+  *        scores of the old rows are kept and only the new rows are predicted
+  * \param new_data Data created with the training data as the reference
+  */
+  void AppendTrainingData(const Dataset* new_data) {
+    if (train_data_ == nullptr) {
+      Log::Fatal("Booster without training data cannot append data");
+    }
+    // other boosters keep pointers to the labels and bins of the data, which appending may reallocate
+    if (train_data_->num_boosters() > 1) {
+      Log::Fatal("Cannot append to training data used by other boosters or as validation data");
+    }
+    ThreadPool::Scope thread_pool_scope(thread_pool_.get(), num_threads_);
+    const data_size_t num_old_data = train_data_->num_data();
+    // the training data is owned by the caller, who asks to append to it
+    const_cast<Dataset*>(train_data_)->Append(new_data);
+    // objective function and metrics refer to the labels of the training data
+    objective_fun_.reset(ObjectiveFunction::CreateObjectiveFunction(config_.objective_type,
+      config_.objective_config));
+    if (objective_fun_ != nullptr) {
+      objective_fun_->Init(train_data_->metadata(), train_data_->num_data());
+    }
+    CreateTrainingMetrics();
+    boosting_->AppendTrainingData(objective_fun_.get(),
+      Common::ConstPtrInVectorWrapper<Metric>(train_metric_), num_old_data);
+  }
+
+  void SaveCheckpoint(const char* filename) {
+    boosting_->SaveCheckpoint(filename);
+  }
+
+  void LoadCheckpoint(const char* filename) {
+    boosting_->LoadCheckpoint(filename);
+  }
   
   const Boosting* GetBoosting() const { return boosting_.get(); }
 
@@ -128,12 +337,25 @@ public:
   const inline int NumberOfClasses() const { return boosting_->NumberOfClasses(); }
 
 private:
+  /*! \brief Create training metrics of config_ on train_data_ */
+  void CreateTrainingMetrics() {
+    train_metric_.clear();
+    for (auto metric_type : config_.metric_types) {
+      auto metric = std::unique_ptr<Metric>(
+        Metric::CreateMetric(metric_type, config_.metric_config));
+      if (metric == nullptr) { continue; }
+      metric->Init("training", train_data_->metadata(),
+        train_data_->num_data());
+      train_metric_.push_back(std::move(metric));
+    }
+    train_metric_.shrink_to_fit();
+  }
 
   std::unique_ptr<Boosting> boosting_;
   /*! \brief All configs */
   OverallConfig config_;
-  /*! \brief Training data */
-  const Dataset* train_data_;
+  /*! \brief Training data, nullptr if loaded from model file */
+  const Dataset* train_data_ = nullptr;
   /*! \brief Validation data */
   std::vector<const Dataset*> valid_datas_;
   /*! \brief Metric for training data */
@@ -144,7 +366,168 @@ private:
   std::unique_ptr<ObjectiveFunction> objective_fun_;
   /*! \brief Using predictor for prediction task */
   std::unique_ptr<Predictor> predictor_;
+  /*! \brief Number of used models of the predictor */
+  int num_used_model_ = -1;
+  /*! \brief Prediction type of the predictor */
+  int predict_type_ = C_API_PREDICT_NORMAL;
+  /*! \brief Output of the last sparse prediction in CSR format */
+  std::vector<int64_t> sparse_indptr_;
+  std::vector<int32_t> sparse_indices_;
+  std::vector<double> sparse_data_;
+  /*! \brief Thread pool of all parallel loops of this booster, nullptr means using OpenMP */
+  std::unique_ptr<ThreadPool> thread_pool_;
+  /*! \brief Number of OpenMP threads of this booster when thread_pool_ is nullptr, <= 0 means the default */
+  int num_threads_ = 0;
+
+};
+
+/*!
+* \brief Caller-owned context for prediction on single rows.
+*        It owns the feature buffer, so predictions don't allocate the row and never enter OpenMP regions.
+*        Different contexts can be used by different threads at the same time, one context is for one thread
+*/
+class PredictContext {
+public:
+  PredictContext(const Boosting* boosting, int predict_type)
+    :boosting_(boosting), predict_type_(predict_type),
+    features_(boosting->MaxFeatureIdx() + 1, 0.0f) {
+    if (predict_type_ == C_API_PREDICT_CONTRIB && !boosting_->CanPredictContrib()) {
+      Log::Fatal("Contributions need the numbers of data of tree nodes, which are not in old model files");
+    }
+    touched_.reserve(features_.size());
+  }
+
+  /*!
+  * \brief Constructor for a shared model, this context keeps the model alive
+  * \param model Shared model, e.g. a version in ModelRegistry
+  * \param predict_type Type of prediction
+  */
+  PredictContext(std::shared_ptr<const Boosting> model, int predict_type)
+    :PredictContext(model.get(), predict_type) {
+    model_ = std::move(model);
+  }
+
+  template<typename T>
+  void PredictDense(const T* data, int32_t ncol, double* out_result) {
+    const int num_features = std::min(static_cast<int>(ncol), static_cast<int>(features_.size()));
+    for (int i = 0; i < num_features; ++i) {
+      const double value = static_cast<double>(data[i]);
+      // the same as the pairs of RowPairFunctionFromDenseMatric, NaN is skipped too
+      features_[i] = std::fabs(value) > 1e-15 ? value : 0.0f;
+    }
+    Predict(out_result);
+    std::fill(features_.begin(), features_.begin() + num_features, 0.0f);
+  }
+
+  template<typename T>
+  void PredictSparse(const int32_t* indices, const T* data, int32_t nelem, double* out_result) {
+    touched_.clear();
+    for (int32_t i = 0; i < nelem; ++i) {
+      if (indices[i] >= 0 && indices[i] < static_cast<int>(features_.size())) {
+        features_[indices[i]] = static_cast<double>(data[i]);
+        touched_.push_back(indices[i]);
+      }
+    }
+    Predict(out_result);
+    for (int idx : touched_) {
+      features_[idx] = 0.0f;
+    }
+  }
 
+private:
+  void Predict(double* out_result) const {
+    if (predict_type_ == C_API_PREDICT_LEAF_INDEX) {
+      auto leaf_index = boosting_->PredictLeafIndex(features_.data());
+      std::copy(leaf_index.begin(), leaf_index.end(), out_result);
+    } else if (predict_type_ == C_API_PREDICT_CONTRIB) {
+      boosting_->PredictContribForRows(features_.data(), 1, out_result);
+    } else if (predict_type_ == C_API_PREDICT_RAW_SCORE) {
+      boosting_->PredictRawForRows(features_.data(), 1, out_result);
+    } else {
+      boosting_->PredictForRows(features_.data(), 1, out_result);
+    }
+  }
+
+  /*! \brief Boosting of the booster, it should be alive while this context is used */
+  const Boosting* boosting_;
+  /*! \brief Owner of boosting_ if it is a shared model */
+  std::shared_ptr<const Boosting> model_;
+  int predict_type_;
+  /*! \brief Feature buffer, all zeros between predictions */
+  std::vector<double> features_;
+  /*! \brief Features set by the current sparse row */
+  std::vector<int> touched_;
+};
+
+/*!
+* \brief Named models shared by all users of the registry. A loaded model is immutable and reference-counted,
+*        users hold a version while predicting, so replacing a model never waits for or breaks in-flight predictions,
+*        and the old version is freed when its last user finishes
+*/
+class ModelRegistry {
+public:
+  /*!
+  * \brief Load a model and publish it under name, replacing the current version atomically
+  * \param name Name of the model
+  * \param filename Model file, text or binary
+  * \param parameters Prediction parameters that are fixed for this version, e.g. num_model_predict, predict_on_bins
+  */
+  void LoadModel(const std::string& name, const char* filename, const char* parameters) {
+    OverallConfig config;
+    config.LoadFromString(parameters);
+    // load outside of the lock, the model is immutable after it is published
+    std::unique_ptr<Boosting> boosting(Boosting::CreateBoosting(filename));
+    if (boosting == nullptr) {
+      throw std::runtime_error(std::string("cannot load model from ") + filename);
+    }
+    boosting->SetNumUsedModel(config.io_config.num_model_predict);
+    boosting->SetPredictOnBins(config.io_config.is_predict_on_bins);
+    if (config.io_config.is_predict_early_stop) {
+      boosting->SetPredictEarlyStop(config.io_config.predict_early_stop_freq,
+        config.io_config.predict_early_stop_margin);
+    }
+    std::shared_ptr<const Boosting> model(boosting.release());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::swap(models_[name], model);
+    }
+    // the old version is released here, out of the lock
+  }
+
+  /*!
+  * \brief Remove a model, in-flight predictions keep their version
+  * \param name Name of the model
+  */
+  void RemoveModel(const std::string& name) {
+    std::shared_ptr<const Boosting> model;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = models_.find(name);
+      if (it == models_.end()) { return; }
+      model = std::move(it->second);
+      models_.erase(it);
+    }
+  }
+
+  /*!
+  * \brief Get the current version of a model
+  * \param name Name of the model
+  * \return The model, kept alive while it is held
+  */
+  std::shared_ptr<const Boosting> GetModel(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = models_.find(name);
+    if (it == models_.end()) {
+      throw std::runtime_error("model " + name + " is not in the registry");
+    }
+    return it->second;
+  }
+
+private:
+  /*! \brief Current version of each model */
+  std::unordered_map<std::string, std::shared_ptr<const Boosting>> models_;
+  /*! \brief Protects models_, only held to find or replace a version */
+  mutable std::mutex mutex_;
 };
 
 }
@@ -226,6 +609,10 @@ DllExport int LGBM_CreateDatasetFromMat(const void* data,
     ret->PushOneRow(tid, i, one_row);
   }
   ret->FinishLoad();
+  if (reference == nullptr) {
+    loader.PlaceFeaturesOnNumaNodes(ret.get());
+    loader.BundleSparseFeatures(ret.get());
+  }
   *out = ret.release();
   API_END();
 }
@@ -287,6 +674,10 @@ DllExport int LGBM_CreateDatasetFromCSR(const void* indptr,
     ret->PushOneRow(tid, i, one_row);
   }
   ret->FinishLoad();
+  if (reference == nullptr) {
+    loader.PlaceFeaturesOnNumaNodes(ret.get());
+    loader.BundleSparseFeatures(ret.get());
+  }
   *out = ret.release();
   API_END();
 }
@@ -336,10 +727,94 @@ DllExport int LGBM_CreateDatasetFromCSC(const void* col_ptr,
     ret->PushOneColumn(tid, i, one_col);
   }
   ret->FinishLoad();
+  if (reference == nullptr) {
+    loader.PlaceFeaturesOnNumaNodes(ret.get());
+    loader.BundleSparseFeatures(ret.get());
+  }
+  *out = ret.release();
+  API_END();
+}
+
+DllExport int LGBM_CreateDatasetByReference(const DatesetHandle reference,
+  int64_t num_total_row,
+  const char* parameters,
+  DatesetHandle* out) {
+  API_BEGIN();
+  OverallConfig config;
+  config.LoadFromString(parameters);
+  std::unique_ptr<Dataset> ret;
+  ret.reset(new Dataset(static_cast<data_size_t>(num_total_row), config.io_config.num_class));
+  ret->CopyFeatureMapperFrom(
+    reinterpret_cast<const Dataset*>(reference),
+    config.io_config.is_enable_sparse);
   *out = ret.release();
   API_END();
 }
 
+DllExport int LGBM_DatasetPushRows(DatesetHandle dataset,
+  const void* data,
+  int data_type,
+  int32_t nrow,
+  int32_t ncol,
+  int32_t start_row) {
+  API_BEGIN();
+  auto p_dataset = reinterpret_cast<Dataset*>(dataset);
+  if (start_row < 0 || start_row + nrow > p_dataset->num_data()) {
+    throw std::runtime_error("Pushed rows exceed the range of dataset");
+  }
+  auto get_row_fun = RowFunctionFromDenseMatric(data, nrow, ncol, data_type, 1);
+#pragma omp parallel for schedule(guided)
+  for (int i = 0; i < nrow; ++i) {
+    const int tid = omp_get_thread_num();
+    auto one_row = get_row_fun(i);
+    p_dataset->PushOneRow(tid, start_row + i, one_row);
+  }
+  API_END();
+}
+
+DllExport int LGBM_DatasetPushRowsByCSR(DatesetHandle dataset,
+  const void* indptr,
+  int indptr_type,
+  const int32_t* indices,
+  const void* data,
+  int data_type,
+  int64_t nindptr,
+  int64_t nelem,
+  int64_t,
+  int64_t start_row) {
+  API_BEGIN();
+  auto p_dataset = reinterpret_cast<Dataset*>(dataset);
+  int32_t nrow = static_cast<int32_t>(nindptr - 1);
+  if (start_row < 0 || start_row + nrow > p_dataset->num_data()) {
+    throw std::runtime_error("Pushed rows exceed the range of dataset");
+  }
+  auto get_row_fun = RowFunctionFromCSR(indptr, indptr_type, indices, data, data_type, nindptr, nelem);
+#pragma omp parallel for schedule(guided)
+  for (int i = 0; i < nrow; ++i) {
+    const int tid = omp_get_thread_num();
+    auto one_row = get_row_fun(i);
+    p_dataset->PushOneRow(tid, static_cast<data_size_t>(start_row + i), one_row);
+  }
+  API_END();
+}
+
+DllExport int LGBM_DatasetFinishLoad(DatesetHandle dataset) {
+  API_BEGIN();
+  reinterpret_cast<Dataset*>(dataset)->FinishLoad();
+  API_END();
+}
+
+DllExport int LGBM_DatasetAppend(DatesetHandle dataset,
+  const DatesetHandle other) {
+  API_BEGIN();
+  Dataset* p_dataset = reinterpret_cast<Dataset*>(dataset);
+  if (p_dataset->num_boosters() > 0) {
+    Log::Fatal("Cannot append to data used by boosters, use LGBM_BoosterAppendTrainingData of its only booster");
+  }
+  p_dataset->Append(reinterpret_cast<const Dataset*>(other));
+  API_END();
+}
+
 DllExport int LGBM_DatasetFree(DatesetHandle handle) {
   API_BEGIN();
   delete reinterpret_cast<Dataset*>(handle);
@@ -505,6 +980,165 @@ DllExport int LGBM_BoosterGetPredict(BoosterHandle handle,
   API_END();
 }
 
+DllExport int LGBM_BoosterSetPredictOnBins(BoosterHandle handle,
+  int is_predict_on_bins) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->SetPredictOnBins(is_predict_on_bins > 0);
+  API_END();
+}
+
+DllExport int LGBM_BoosterSetPredictEarlyStop(BoosterHandle handle,
+  int round_period,
+  double margin_threshold) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->SetPredictEarlyStop(round_period, margin_threshold);
+  API_END();
+}
+
+DllExport int LGBM_BoosterSetNumThreads(BoosterHandle handle,
+  int num_threads) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->SetNumThreads(num_threads);
+  API_END();
+}
+
+DllExport int LGBM_BoosterGetMemoryUsage(BoosterHandle handle,
+  int64_t* out_len,
+  double* out_results) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  const MemoryUsage memory_usage = ref_booster->GetBoosting()->GetMemoryUsage();
+  *out_len = 0;
+  for (int i = 0; i < kNumMemoryComponents; ++i) {
+    out_results[(*out_len)++] = static_cast<double>(memory_usage.bytes[i]);
+  }
+  API_END();
+}
+
+DllExport int LGBM_BoosterCreatePredictContext(BoosterHandle handle,
+  int predict_type,
+  int64_t n_used_trees,
+  PredictContextHandle* out) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->SetNumUsedModel(static_cast<int>(n_used_trees));
+  *out = new PredictContext(ref_booster->GetBoosting(), predict_type);
+  API_END();
+}
+
+DllExport int LGBM_PredictContextFree(PredictContextHandle handle) {
+  API_BEGIN();
+  delete reinterpret_cast<PredictContext*>(handle);
+  API_END();
+}
+
+DllExport int LGBM_BoosterPredictForMatSingleRow(PredictContextHandle handle,
+  const void* data,
+  int data_type,
+  int32_t ncol,
+  double* out_result) {
+  API_BEGIN();
+  PredictContext* context = reinterpret_cast<PredictContext*>(handle);
+  if (data_type == C_API_DTYPE_FLOAT32) {
+    context->PredictDense(reinterpret_cast<const float*>(data), ncol, out_result);
+  } else if (data_type == C_API_DTYPE_FLOAT64) {
+    context->PredictDense(reinterpret_cast<const double*>(data), ncol, out_result);
+  } else {
+    throw std::runtime_error("unknown data type in LGBM_BoosterPredictForMatSingleRow");
+  }
+  API_END();
+}
+
+DllExport int LGBM_BoosterPredictForCSRSingleRow(PredictContextHandle handle,
+  const int32_t* indices,
+  const void* data,
+  int data_type,
+  int32_t nelem,
+  double* out_result) {
+  API_BEGIN();
+  PredictContext* context = reinterpret_cast<PredictContext*>(handle);
+  if (data_type == C_API_DTYPE_FLOAT32) {
+    context->PredictSparse(indices, reinterpret_cast<const float*>(data), nelem, out_result);
+  } else if (data_type == C_API_DTYPE_FLOAT64) {
+    context->PredictSparse(indices, reinterpret_cast<const double*>(data), nelem, out_result);
+  } else {
+    throw std::runtime_error("unknown data type in LGBM_BoosterPredictForCSRSingleRow");
+  }
+  API_END();
+}
+
+DllExport int LGBM_RegistryCreate(RegistryHandle* out) {
+  API_BEGIN();
+  *out = new ModelRegistry();
+  API_END();
+}
+
+DllExport int LGBM_RegistryFree(RegistryHandle handle) {
+  API_BEGIN();
+  delete reinterpret_cast<ModelRegistry*>(handle);
+  API_END();
+}
+
+DllExport int LGBM_RegistryLoadModel(RegistryHandle handle,
+  const char* name,
+  const char* filename,
+  const char* parameters) {
+  API_BEGIN();
+  reinterpret_cast<ModelRegistry*>(handle)->LoadModel(name, filename, parameters);
+  API_END();
+}
+
+DllExport int LGBM_RegistryRemoveModel(RegistryHandle handle,
+  const char* name) {
+  API_BEGIN();
+  reinterpret_cast<ModelRegistry*>(handle)->RemoveModel(name);
+  API_END();
+}
+
+DllExport int LGBM_RegistryCreatePredictContext(RegistryHandle handle,
+  const char* name,
+  int predict_type,
+  PredictContextHandle* out) {
+  API_BEGIN();
+  *out = new PredictContext(reinterpret_cast<ModelRegistry*>(handle)->GetModel(name), predict_type);
+  API_END();
+}
+
+DllExport int LGBM_RegistryPredictForMat(RegistryHandle handle,
+  const char* name,
+  const void* data,
+  int data_type,
+  int32_t nrow,
+  int32_t ncol,
+  int is_row_major,
+  int predict_type,
+  double* out_result) {
+  API_BEGIN();
+  // hold the current version until this prediction finishes
+  std::shared_ptr<const Boosting> model = reinterpret_cast<ModelRegistry*>(handle)->GetModel(name);
+  Predictor predictor(model.get(), predict_type == C_API_PREDICT_RAW_SCORE, predict_type == C_API_PREDICT_LEAF_INDEX,
+    predict_type == C_API_PREDICT_CONTRIB);
+  auto get_row_fun = RowPairFunctionFromDenseMatric(data, nrow, ncol, data_type, is_row_major);
+  int num_class = model->NumberOfClasses();
+  if (predict_type != C_API_PREDICT_LEAF_INDEX) {
+    predictor.PredictRows(get_row_fun, nrow, out_result);
+  } else {
+    auto predict_fun = predictor.GetPredictFunction();
+#pragma omp parallel for schedule(guided)
+    for (int i = 0; i < nrow; ++i) {
+      auto one_row = get_row_fun(i);
+      auto predicton_result = predict_fun(one_row);
+      for (int j = 0; j < num_class; ++j) {
+        out_result[i * num_class + j] = predicton_result[j];
+      }
+    }
+  }
+  API_END();
+}
+
 DllExport int LGBM_BoosterPredictForFile(BoosterHandle handle,
   int predict_type,
   int64_t n_used_trees,
@@ -536,16 +1170,33 @@ DllExport int LGBM_BoosterPredictForCSR(BoosterHandle handle,
   ref_booster->PrepareForPrediction(static_cast<int>(n_used_trees), predict_type);
 
   auto get_row_fun = RowFunctionFromCSR(indptr, indptr_type, indices, data, data_type, nindptr, nelem);
-  int num_class = ref_booster->NumberOfClasses();
   int nrow = static_cast<int>(nindptr - 1);
-#pragma omp parallel for schedule(guided)
-  for (int i = 0; i < nrow; ++i) {
-    auto one_row = get_row_fun(i);
-    auto predicton_result = ref_booster->Predict(one_row);
-    for (int j = 0; j < num_class; ++j) {
-      out_result[i * num_class + j] = predicton_result[j];
-    }
-  }
+  ref_booster->PredictRows(get_row_fun, nrow, out_result);
+  API_END();
+}
+
+DllExport int LGBM_BoosterPredictContribSparseForCSR(BoosterHandle handle,
+  const void* indptr,
+  int indptr_type,
+  const int32_t* indices,
+  const void* data,
+  int data_type,
+  int64_t nindptr,
+  int64_t nelem,
+  int64_t n_used_trees,
+  int64_t* out_nnz,
+  const int64_t** out_indptr,
+  const int32_t** out_indices,
+  const double** out_data) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->PrepareForPrediction(static_cast<int>(n_used_trees), C_API_PREDICT_CONTRIB);
+  auto get_row_fun = RowFunctionFromCSR(indptr, indptr_type, indices, data, data_type, nindptr, nelem);
+  ref_booster->PredictContribSparse(get_row_fun, static_cast<int>(nindptr - 1));
+  *out_nnz = static_cast<int64_t>(ref_booster->sparse_data().size());
+  *out_indptr = ref_booster->sparse_indptr().data();
+  *out_indices = ref_booster->sparse_indices().data();
+  *out_data = ref_booster->sparse_data().data();
   API_END();
 }
 
@@ -563,14 +1214,45 @@ DllExport int LGBM_BoosterPredictForMat(BoosterHandle handle,
   ref_booster->PrepareForPrediction(static_cast<int>(n_used_trees), predict_type);
 
   auto get_row_fun = RowPairFunctionFromDenseMatric(data, nrow, ncol, data_type, is_row_major);
-  int num_class = ref_booster->NumberOfClasses();
-#pragma omp parallel for schedule(guided)
-  for (int i = 0; i < nrow; ++i) {
-    auto one_row = get_row_fun(i);
-    auto predicton_result = ref_booster->Predict(one_row);
-    for (int j = 0; j < num_class; ++j) {
-      out_result[i * num_class + j] = predicton_result[j];
-    }
+  ref_booster->PredictRows(get_row_fun, nrow, out_result);
+  API_END();
+}
+
+DllExport int LGBM_BoosterPredictForMatStaged(BoosterHandle handle,
+  const void* data,
+  int data_type,
+  int32_t nrow,
+  int32_t ncol,
+  int is_row_major,
+  int predict_type,
+  int64_t n_used_trees,
+  int period,
+  int64_t* out_num_stages,
+  double* out_result) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->PrepareForPrediction(static_cast<int>(n_used_trees), predict_type);
+  *out_num_stages = ref_booster->GetBoosting()->NumberOfPredictStages(period);
+  auto get_row_fun = RowPairFunctionFromDenseMatric(data, nrow, ncol, data_type, is_row_major);
+  ref_booster->PredictRowsStaged(get_row_fun, nrow, period, out_result);
+  API_END();
+}
+
+DllExport int LGBM_BoosterEvalStaged(BoosterHandle handle,
+  const DatesetHandle data,
+  int64_t n_used_trees,
+  int period,
+  int64_t* out_num_stages,
+  int64_t* out_len,
+  double* out_results) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  auto results = ref_booster->EvalStaged(reinterpret_cast<const Dataset*>(data), static_cast<int>(n_used_trees), period);
+  *out_num_stages = static_cast<int64_t>(results.size());
+  *out_len = 0;
+  for (const auto& stage_results : results) {
+    std::copy(stage_results.begin(), stage_results.end(), out_results + *out_len);
+    *out_len += static_cast<int64_t>(stage_results.size());
   }
   API_END();
 }
@@ -584,6 +1266,102 @@ DllExport int LGBM_BoosterSaveModel(BoosterHandle handle,
   API_END();
 }
 
+DllExport int LGBM_BoosterSaveModelToBinary(BoosterHandle handle,
+  int num_used_model,
+  const char* filename) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->GetBoosting()->SaveModelToBinaryFile(num_used_model, filename);
+  API_END();
+}
+
+DllExport int LGBM_BoosterRefit(BoosterHandle handle,
+  const DatesetHandle train_data,
+  const char* parameters,
+  const int32_t* leaf_preds,
+  int32_t nrow,
+  int32_t ncol) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->Refit(reinterpret_cast<const Dataset*>(train_data), parameters, leaf_preds, nrow, ncol);
+  API_END();
+}
+
+DllExport int LGBM_BoosterAppendTrainingData(BoosterHandle handle,
+  const DatesetHandle new_data) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->AppendTrainingData(reinterpret_cast<const Dataset*>(new_data));
+  API_END();
+}
+
+DllExport int LGBM_BoosterSaveCheckpoint(BoosterHandle handle,
+  const char* filename) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->SaveCheckpoint(filename);
+  API_END();
+}
+
+DllExport int LGBM_BoosterLoadCheckpoint(BoosterHandle handle,
+  const char* filename) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->LoadCheckpoint(filename);
+  API_END();
+}
+
+DllExport int LGBM_BoosterSaveModelToIfElse(BoosterHandle handle,
+  int num_used_model,
+  const char* filename) {
+  API_BEGIN();
+  Booster* ref_booster = reinterpret_cast<Booster*>(handle);
+  ref_booster->GetBoosting()->SaveModelToIfElse(num_used_model, filename);
+  API_END();
+}
+
+static void CopyNetworkStats(const std::vector<NetworkStats>& stats, int64_t* out_len, double* out_results) {
+  *out_len = 0;
+  for (const auto& cur : stats) {
+    out_results[(*out_len)++] = static_cast<double>(cur.calls);
+    out_results[(*out_len)++] = static_cast<double>(cur.sent_bytes);
+    out_results[(*out_len)++] = static_cast<double>(cur.recv_bytes);
+    out_results[(*out_len)++] = cur.time_ms;
+    out_results[(*out_len)++] = cur.wait_ms;
+  }
+}
+
+DllExport int LGBM_NetworkGetStats(int64_t* out_len,
+  double* out_results) {
+  API_BEGIN();
+  CopyNetworkStats(Network::stats(), out_len, out_results);
+  API_END();
+}
+
+DllExport int LGBM_NetworkGetPeerStats(int64_t* out_len,
+  double* out_results) {
+  API_BEGIN();
+  CopyNetworkStats(Network::PeerStats(), out_len, out_results);
+  API_END();
+}
+
+DllExport int LGBM_ProfilerGetStats(int64_t* out_len,
+  double* out_results) {
+  API_BEGIN();
+  *out_len = 0;
+  for (const auto& cur : Profiler::Stats()) {
+    out_results[(*out_len)++] = static_cast<double>(cur.calls);
+    out_results[(*out_len)++] = cur.time_ms;
+  }
+  API_END();
+}
+
+DllExport int LGBM_ProfilerReset() {
+  API_BEGIN();
+  Profiler::Reset();
+  API_END();
+}
+
 // ---- start of some help functions
 
 std::function<std::vector<double>(int row_idx)>
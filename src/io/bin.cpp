@@ -2,6 +2,7 @@
 #include <LightGBM/bin.h>
 
 #include "dense_bin.hpp"
+#include "dense_nbits_bin.hpp"
 #include "sparse_bin.hpp"
 #include "ordered_sparse_bin.hpp"
 
@@ -39,42 +40,53 @@ BinMapper::~BinMapper() {
 
 void BinMapper::FindBin(std::vector<double>* values, size_t total_sample_cnt, int max_bin) {
   std::vector<double>& ref_values = (*values);
+  std::sort(ref_values.begin(), ref_values.end());
+  // count distinct values
+  std::vector<std::pair<double, int>> summary;
+  for (size_t i = 0; i < ref_values.size(); ++i) {
+    if (i == 0 || ref_values[i] != ref_values[i - 1]) {
+      summary.emplace_back(ref_values[i], 1);
+    } else {
+      ++summary.back().second;
+    }
+  }
+  FindBin(summary, total_sample_cnt, max_bin);
+}
+
+void BinMapper::FindBin(const std::vector<std::pair<double, int>>& summary, size_t total_sample_cnt, int max_bin) {
   size_t sample_size = total_sample_cnt;
-  int zero_cnt = static_cast<int>(total_sample_cnt - ref_values.size());
+  int zero_cnt = static_cast<int>(total_sample_cnt);
+  for (const auto& entry : summary) {
+    zero_cnt -= entry.second;
+  }
   // find distinct_values first
   std::vector<double> distinct_values;
   std::vector<int> counts;
 
-  std::sort(ref_values.begin(), ref_values.end());
-
   // push zero in the front
-  if (ref_values.size() == 0 || (ref_values[0] > 0.0f && zero_cnt > 0)) {
+  if (summary.size() == 0 || (summary[0].first > 0.0f && zero_cnt > 0)) {
     distinct_values.push_back(0);
     counts.push_back(zero_cnt);
   }
 
-  if (ref_values.size() > 0) {
-    distinct_values.push_back(ref_values[0]);
-    counts.push_back(1);
+  if (summary.size() > 0) {
+    distinct_values.push_back(summary[0].first);
+    counts.push_back(summary[0].second);
   }
 
-  for (size_t i = 1; i < ref_values.size(); ++i) {
-    if (ref_values[i] != ref_values[i - 1]) {
-      if (ref_values[i - 1] == 0.0f) {
-        counts.back() += zero_cnt;
-      } else if (ref_values[i - 1] < 0.0f && ref_values[i] > 0.0f) {
-        distinct_values.push_back(0);
-        counts.push_back(zero_cnt);
-      }
-      distinct_values.push_back(ref_values[i]);
-      counts.push_back(1);
-    } else {
-      ++counts.back();
+  for (size_t i = 1; i < summary.size(); ++i) {
+    if (summary[i - 1].first == 0.0f) {
+      counts.back() += zero_cnt;
+    } else if (summary[i - 1].first < 0.0f && summary[i].first > 0.0f) {
+      distinct_values.push_back(0);
+      counts.push_back(zero_cnt);
     }
+    distinct_values.push_back(summary[i].first);
+    counts.push_back(summary[i].second);
   }
 
   // push zero in the back
-  if (ref_values.size() > 0 && ref_values.back() < 0.0f && zero_cnt > 0) {
+  if (summary.size() > 0 && summary.back().first < 0.0f && zero_cnt > 0) {
     distinct_values.push_back(0);
     counts.push_back(zero_cnt);
   }
@@ -156,6 +168,18 @@ void BinMapper::FindBin(std::vector<double>* values, size_t total_sample_cnt, in
 }
 
 
+void BinMapper::Coarsen(int max_bin) {
+  if (num_bin_ <= max_bin) { return; }
+  std::vector<double> upper_bounds(max_bin);
+  for (int i = 0; i < max_bin; ++i) {
+    // the last one is infinity
+    const int last_bin = static_cast<int>(static_cast<int64_t>(i + 1) * num_bin_ / max_bin) - 1;
+    upper_bounds[i] = bin_upper_bound_[last_bin];
+  }
+  bin_upper_bound_ = upper_bounds;
+  num_bin_ = max_bin;
+}
+
 int BinMapper::SizeForSpecificBin(int bin) {
   int size = 0;
   size += sizeof(int);
@@ -165,7 +189,7 @@ int BinMapper::SizeForSpecificBin(int bin) {
   return size;
 }
 
-void BinMapper::CopyTo(char * buffer) {
+void BinMapper::CopyTo(char * buffer) const {
   std::memcpy(buffer, &num_bin_, sizeof(num_bin_));
   buffer += sizeof(num_bin_);
   std::memcpy(buffer, &is_trival_, sizeof(is_trival_));
@@ -222,16 +246,40 @@ Bin* Bin::CreateBin(data_size_t num_data, int num_bin, double sparse_rate, bool
   }
 }
 
-Bin* Bin::CreateDenseBin(data_size_t num_data, int num_bin, int default_bin) {
-  if (num_bin <= 256) {
-    return new DenseBin<uint8_t>(num_data, default_bin);
+Bin* Bin::CreateDenseBin(data_size_t num_data, int num_bin, int default_bin, bool is_enable_4bit) {
+  if (num_bin <= DenseBin4bit::kMaxNumBin && is_enable_4bit) {
+    return new DenseBin4bit(num_data, default_bin);
+  } else if (num_bin <= 256) {
+    return new DenseBin<uint8_t>(num_data, num_bin, default_bin);
   } else if (num_bin <= 65536) {
-    return new DenseBin<uint16_t>(num_data, default_bin);
+    return new DenseBin<uint16_t>(num_data, num_bin, default_bin);
   } else {
-    return new DenseBin<uint32_t>(num_data, default_bin);
+    return new DenseBin<uint32_t>(num_data, num_bin, default_bin);
   }
 }
 
+size_t Bin::EstimateSizesInByte(data_size_t num_data, int num_bin, double sparse_rate, bool is_sparse) {
+  size_t value_size = sizeof(uint8_t);
+  if (num_bin > 65536) {
+    value_size = sizeof(uint32_t);
+  } else if (num_bin > 256) {
+    value_size = sizeof(uint16_t);
+  }
+  if (!is_sparse) {
+    if (num_bin <= DenseBin4bit::kMaxNumBin) {
+      return (static_cast<size_t>(num_data) + 1) / 2;
+    }
+    return value_size * num_data;
+  }
+  // a delta and a value for each non-zero, long runs of zeros need extra pairs
+  const size_t num_vals = static_cast<size_t>((1.0 - sparse_rate) * num_data) + num_data / kMaxDelta;
+  return (sizeof(uint8_t) + value_size) * num_vals;
+}
+
+std::vector<int> Bin::DenseBinTypeMaxNumBins() {
+  return std::vector<int>({ DenseBin4bit::kMaxNumBin, 256, 65536 });
+}
+
 Bin* Bin::CreateSparseBin(data_size_t num_data, int num_bin, int default_bin) {
   if (num_bin <= 256) {
     return new SparseBin<uint8_t>(num_data, default_bin);
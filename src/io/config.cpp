@@ -33,6 +33,7 @@ void OverallConfig::LoadFromString(const char* str) {
 void OverallConfig::Set(const std::unordered_map<std::string, std::string>& params) {
   // load main config types
   GetInt(params, "num_threads", &num_threads);
+  GetBool(params, "is_use_thread_pool", &is_use_thread_pool);
   GetTaskType(params);
   GetBoostingType(params);
   GetObjectiveType(params);
@@ -71,6 +72,8 @@ void OverallConfig::GetBoostingType(const std::unordered_map<std::string, std::s
       boosting_type = BoostingType::kGBDT;
     } else if (value == std::string("dart")) {
       boosting_type = BoostingType::kDART;
+    } else if (value == std::string("goss")) {
+      boosting_type = BoostingType::kGOSS;
     } else {
       Log::Fatal("Unknown boosting type %s", value.c_str());
     }
@@ -120,6 +123,12 @@ void OverallConfig::GetTaskType(const std::unordered_map<std::string, std::strin
     } else if (value == std::string("predict") || value == std::string("prediction")
       || value == std::string("test")) {
       task_type = TaskType::kPredict;
+    } else if (value == std::string("convert_model")) {
+      task_type = TaskType::kConvertModel;
+    } else if (value == std::string("refit") || value == std::string("refit_tree")) {
+      task_type = TaskType::kRefitTree;
+    } else if (value == std::string("serve") || value == std::string("server")) {
+      task_type = TaskType::kServe;
     } else {
       Log::Fatal("Unknown task type %s", value.c_str());
     }
@@ -149,22 +158,46 @@ void OverallConfig::CheckParamConflict() {
         }
   }
 
+  if (boosting_config.tree_learner_type == TreeLearnerType::kGPUTreeLearner || task_type == TaskType::kRefitTree) {
+    // gpu tree learner and refitting run on single machine
+    network_config.num_machines = 1;
+  }
+
   if (network_config.num_machines > 1) {
     is_parallel = true;
   } else {
     is_parallel = false;
-    boosting_config.tree_learner_type = TreeLearnerType::kSerialTreeLearner;
+    if (boosting_config.tree_learner_type != TreeLearnerType::kGPUTreeLearner) {
+      boosting_config.tree_learner_type = TreeLearnerType::kSerialTreeLearner;
+    }
   }
 
-  if (boosting_config.tree_learner_type == TreeLearnerType::kSerialTreeLearner) {
+  if (boosting_config.tree_learner_type == TreeLearnerType::kSerialTreeLearner
+    || boosting_config.tree_learner_type == TreeLearnerType::kGPUTreeLearner) {
     is_parallel = false;
     network_config.num_machines = 1;
   }
+  if (boosting_config.tree_learner_type != TreeLearnerType::kSerialTreeLearner
+    && boosting_config.tree_config.leaf_batch_size > 1) {
+    Log::Warning("Batched leaf growing is only supported by serial tree learner, will disable it");
+    boosting_config.tree_config.leaf_batch_size = 1;
+  }
+
+  if (boosting_config.tree_learner_type != TreeLearnerType::kHybridParallelTreeLearner) {
+    // only hybrid tree learner uses the machine grid
+    network_config.num_grid_columns = 1;
+  } else if (network_config.num_machines % network_config.num_grid_columns != 0) {
+    Log::Fatal("Number of machines %d should be a multiple of num_grid_columns %d",
+               network_config.num_machines, network_config.num_grid_columns);
+  }
 
   if (boosting_config.tree_learner_type == TreeLearnerType::kSerialTreeLearner ||
-    boosting_config.tree_learner_type == TreeLearnerType::kFeatureParallelTreelearner) {
+    boosting_config.tree_learner_type == TreeLearnerType::kFeatureParallelTreelearner ||
+    boosting_config.tree_learner_type == TreeLearnerType::kGPUTreeLearner) {
     is_parallel_find_bin = false;
-  } else if (boosting_config.tree_learner_type == TreeLearnerType::kDataParallelTreeLearner) {
+  } else if (boosting_config.tree_learner_type == TreeLearnerType::kDataParallelTreeLearner
+    || boosting_config.tree_learner_type == TreeLearnerType::kVotingParallelTreeLearner
+    || boosting_config.tree_learner_type == TreeLearnerType::kHybridParallelTreeLearner) {
     is_parallel_find_bin = true;
     if (boosting_config.tree_config.histogram_pool_size >= 0) {
       Log::Warning("Histogram LRU queue was enabled (histogram_pool_size=%f). Will disable this to reduce communication costs"
@@ -185,15 +218,49 @@ void IOConfig::Set(const std::unordered_map<std::string, std::string>& params) {
   GetInt(params, "verbose", &verbosity);
   GetInt(params, "num_model_predict", &num_model_predict);
   GetInt(params, "bin_construct_sample_cnt", &bin_construct_sample_cnt);
+  GetBool(params, "use_quantile_sketch", &use_quantile_sketch);
+  GetInt(params, "quantile_sketch_size", &quantile_sketch_size);
+  CHECK(quantile_sketch_size > 1);
   GetBool(params, "is_pre_partition", &is_pre_partition);
+  GetBool(params, "use_byte_range_partition", &use_byte_range_partition);
   GetBool(params, "is_enable_sparse", &is_enable_sparse);
+  GetBool(params, "enable_bundle", &enable_bundle);
+  GetDouble(params, "max_conflict_rate", &max_conflict_rate);
+  CHECK(max_conflict_rate >= 0.0f && max_conflict_rate < 1.0f);
+  GetDouble(params, "bundle_min_non_zero_rate", &bundle_min_non_zero_rate);
+  CHECK(bundle_min_non_zero_rate >= 0.0f && bundle_min_non_zero_rate <= 1.0f);
+  GetInt(params, "max_search_bundles", &max_search_bundles);
+  CHECK(max_search_bundles > 0);
+  GetBool(params, "use_numa", &use_numa);
+  GetInt(params, "num_numa_nodes", &num_numa_nodes);
+  GetDouble(params, "max_memory", &max_memory);
   GetBool(params, "use_two_round_loading", &use_two_round_loading);
+  GetBool(params, "use_streaming_loading", &use_streaming_loading);
   GetBool(params, "is_save_binary_file", &is_save_binary_file);
+  GetBool(params, "is_save_binary_model", &is_save_binary_model);
+  GetBool(params, "is_compress_binary_file", &is_compress_binary_file);
+  GetBool(params, "use_valid_cache", &use_valid_cache);
   GetBool(params, "enable_load_from_binary_file", &enable_load_from_binary_file);
+  GetBool(params, "use_mmap", &use_mmap);
   GetBool(params, "is_predict_raw_score", &is_predict_raw_score);
   GetBool(params, "is_predict_leaf_index", &is_predict_leaf_index);
+  GetBool(params, "is_predict_contrib", &is_predict_contrib);
+  GetBool(params, "is_predict_on_bins", &is_predict_on_bins);
+  GetBool(params, "is_predict_early_stop", &is_predict_early_stop);
+  GetInt(params, "predict_early_stop_freq", &predict_early_stop_freq);
+  GetDouble(params, "predict_early_stop_margin", &predict_early_stop_margin);
+  GetInt(params, "serve_port", &serve_port);
+  CHECK(serve_port > 0 && serve_port < 65536);
+  GetInt(params, "serve_batch_size", &serve_batch_size);
+  CHECK(serve_batch_size > 0);
+  GetDouble(params, "serve_batch_delay", &serve_batch_delay);
+  CHECK(serve_batch_delay >= 0.0f);
   GetString(params, "output_model", &output_model);
   GetString(params, "input_model", &input_model);
+  GetString(params, "checkpoint_file", &checkpoint_file);
+  GetInt(params, "checkpoint_freq", &checkpoint_freq);
+  CHECK(checkpoint_freq > 0);
+  GetString(params, "convert_model", &convert_model);
   GetString(params, "output_result", &output_result);
   std::string tmp_str = "";
   if (GetString(params, "valid_data", &tmp_str)) {
@@ -212,6 +279,7 @@ void ObjectiveConfig::Set(const std::unordered_map<std::string, std::string>& pa
   GetDouble(params, "sigmoid", &sigmoid);
   GetInt(params, "max_position", &max_position);
   CHECK(max_position > 0);
+  GetInt(params, "lambdarank_truncation_level", &lambdarank_truncation_level);
   GetInt(params, "num_class", &num_class);
   CHECK(num_class >= 1);
   std::string tmp_str = "";
@@ -232,6 +300,7 @@ void ObjectiveConfig::Set(const std::unordered_map<std::string, std::string>& pa
 void MetricConfig::Set(const std::unordered_map<std::string, std::string>& params) {
   GetDouble(params, "sigmoid", &sigmoid);
   GetInt(params, "num_class", &num_class);
+  GetInt(params, "auc_num_bins", &auc_num_bins);
   std::string tmp_str = "";
   if (GetString(params, "label_gain", &tmp_str)) {
     label_gain = Common::StringToDoubleArray(tmp_str, ',');
@@ -278,6 +347,24 @@ void TreeConfig::Set(const std::unordered_map<std::string, std::string>& params)
   GetDouble(params, "histogram_pool_size", &histogram_pool_size);
   GetInt(params, "max_depth", &max_depth);
   CHECK(max_depth > 1 || max_depth < 0);
+  GetInt(params, "feature_group_size", &feature_group_size);
+  GetInt(params, "leaf_batch_size", &leaf_batch_size);
+  CHECK(leaf_batch_size >= 1 && leaf_batch_size <= 64);
+  GetBool(params, "use_lazy_histogram", &use_lazy_histogram);
+  GetDouble(params, "lazy_histogram_slack", &lazy_histogram_slack);
+  CHECK(lazy_histogram_slack > 0.0f);
+  GetBool(params, "use_quantized_grad", &use_quantized_grad);
+  GetInt(params, "num_grad_quant_bins", &num_grad_quant_bins);
+  CHECK(num_grad_quant_bins >= 2 && num_grad_quant_bins <= 126);
+  GetBool(params, "stochastic_rounding", &stochastic_rounding);
+  GetInt(params, "quantization_seed", &quantization_seed);
+  GetBool(params, "use_bf16_grad", &use_bf16_grad);
+  GetInt(params, "top_k", &top_k);
+  CHECK(top_k > 0);
+  GetInt(params, "histogram_pipeline_blocks", &histogram_pipeline_blocks);
+  CHECK(histogram_pipeline_blocks >= 1);
+  GetInt(params, "gpu_platform_id", &gpu_platform_id);
+  GetInt(params, "gpu_device_id", &gpu_device_id);
 }
 
 
@@ -290,6 +377,9 @@ void BoostingConfig::Set(const std::unordered_map<std::string, std::string>& par
   CHECK(bagging_freq >= 0);
   GetDouble(params, "bagging_fraction", &bagging_fraction);
   CHECK(bagging_fraction > 0.0f && bagging_fraction <= 1.0f);
+  GetDouble(params, "top_rate", &top_rate);
+  GetDouble(params, "other_rate", &other_rate);
+  CHECK(top_rate >= 0.0f && other_rate > 0.0f && top_rate + other_rate <= 1.0f);
   GetDouble(params, "learning_rate", &learning_rate);
   CHECK(learning_rate > 0.0f);
   GetInt(params, "early_stopping_round", &early_stopping_round);
@@ -300,6 +390,15 @@ void BoostingConfig::Set(const std::unordered_map<std::string, std::string>& par
   GetInt(params, "num_class", &num_class);
   GetInt(params, "drop_seed", &drop_seed);
   GetDouble(params, "drop_rate", &drop_rate);
+  GetBool(params, "is_cache_dart_leaf_index", &is_cache_dart_leaf_index);
+  GetInt(params, "num_concurrent_classes", &num_concurrent_classes);
+  CHECK(num_concurrent_classes >= 1);
+  GetBool(params, "is_fuse_gradients", &is_fuse_gradients);
+  GetBool(params, "is_async_metric", &is_async_metric);
+  GetDouble(params, "max_memory", &max_memory);
+  GetDouble(params, "refit_decay_rate", &refit_decay_rate);
+  CHECK(refit_decay_rate >= 0.0f && refit_decay_rate <= 1.0f);
+  GetBool(params, "is_enable_profiler", &is_enable_profiler);
   CHECK(drop_rate <= 1.0 && drop_rate >= 0.0);
   GetTreeLearnerType(params);
   tree_config.Set(params);
@@ -315,6 +414,12 @@ void BoostingConfig::GetTreeLearnerType(const std::unordered_map<std::string, st
       tree_learner_type = TreeLearnerType::kFeatureParallelTreelearner;
     } else if (value == std::string("data") || value == std::string("data_parallel")) {
       tree_learner_type = TreeLearnerType::kDataParallelTreeLearner;
+    } else if (value == std::string("voting") || value == std::string("voting_parallel")) {
+      tree_learner_type = TreeLearnerType::kVotingParallelTreeLearner;
+    } else if (value == std::string("hybrid") || value == std::string("hybrid_parallel")) {
+      tree_learner_type = TreeLearnerType::kHybridParallelTreeLearner;
+    } else if (value == std::string("gpu")) {
+      tree_learner_type = TreeLearnerType::kGPUTreeLearner;
     }
     else {
       Log::Fatal("Unknown tree learner type %s", value.c_str());
@@ -330,6 +435,13 @@ void NetworkConfig::Set(const std::unordered_map<std::string, std::string>& para
   GetInt(params, "time_out", &time_out);
   CHECK(time_out > 0);
   GetString(params, "machine_list_file", &machine_list_filename);
+  GetInt(params, "num_network_streams", &num_network_streams);
+  CHECK(num_network_streams >= 1);
+  GetInt(params, "socket_buffer_size", &socket_buffer_size);
+  CHECK(socket_buffer_size > 0);
+  GetInt(params, "num_grid_columns", &num_grid_columns);
+  CHECK(num_grid_columns >= 1);
+  GetBool(params, "use_shared_memory", &use_shared_memory);
 }
 
 }  // namespace LightGBM
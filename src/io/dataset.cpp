@@ -1,10 +1,15 @@
 #include <LightGBM/dataset.h>
 
 #include <LightGBM/feature.h>
+#include <LightGBM/utils/mapped_file.h>
+#include <LightGBM/utils/lz_codec.h>
+#include <LightGBM/utils/numa.h>
 
 #include <omp.h>
 
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <unordered_map>
 #include <limits>
 #include <vector>
@@ -14,6 +19,7 @@
 
 namespace LightGBM {
 
+const char* Dataset::binary_file_token = "______LightGBM_Binary_File_Token______\n";
 
 Dataset::Dataset() {
   num_class_ = 1;
@@ -58,6 +64,222 @@ void Dataset::CopyFeatureMapperFrom(const Dataset* dataset, bool is_enable_spars
   feature_names_ = dataset->feature_names_;
 }
 
+uint64_t Dataset::FeatureMapperFingerprint() const {
+  uint64_t hash = Common::Hash64(&num_class_, sizeof(num_class_));
+  hash = Common::Hash64(&num_total_features_, sizeof(num_total_features_), hash);
+  hash = Common::Hash64(used_feature_map_.data(), sizeof(int) * used_feature_map_.size(), hash);
+  for (const auto& name : feature_names_) {
+    hash = Common::Hash64(name.c_str(), name.size() + 1, hash);
+  }
+  std::vector<char> buffer;
+  for (const auto& feature : features_) {
+    const int feature_index = feature->feature_index();
+    hash = Common::Hash64(&feature_index, sizeof(feature_index), hash);
+    buffer.resize(feature->bin_mapper()->SizesInByte());
+    feature->bin_mapper()->CopyTo(buffer.data());
+    hash = Common::Hash64(buffer.data(), buffer.size(), hash);
+  }
+  return hash;
+}
+
+void Dataset::Append(const Dataset* other) {
+  if (other->num_features_ != num_features_ || other->num_total_features_ != num_total_features_
+    || other->num_class_ != num_class_) {
+    Log::Fatal("Cannot append data with different features, it should be created with this data as the reference");
+  }
+  for (int i = 0; i < num_features_; ++i) {
+    if (other->features_[i]->feature_index() != features_[i]->feature_index()
+      || other->features_[i]->num_bin() != features_[i]->num_bin()) {
+      Log::Fatal("Cannot append data with different bins of feature %d", features_[i]->feature_index());
+    }
+  }
+#pragma omp parallel for schedule(guided)
+  for (int i = 0; i < num_features_; ++i) {
+    features_[i]->AppendData(*other->features_[i]);
+  }
+  metadata_.Append(other->metadata_);
+  num_data_ += other->num_data_;
+  // appended bins are allocated by any thread
+  if (!numa_feature_begin_.empty()) {
+    Numa::For(numa_feature_begin_, [this](int i) {
+      features_[i]->RelocateBinData();
+    });
+  }
+  // bundles only cover the old rows
+  if (!feature_bundles_.empty()) {
+    BundleSparseFeatures(max_conflict_rate_, bundle_min_non_zero_rate_, max_search_bundles_);
+  }
+}
+
+void Dataset::BundleSparseFeatures(double max_conflict_rate, double min_non_zero_rate, int max_search_bundles) {
+  max_conflict_rate_ = max_conflict_rate;
+  bundle_min_non_zero_rate_ = min_non_zero_rate;
+  max_search_bundles_ = max_search_bundles;
+  feature_bundles_.clear();
+  const data_size_t max_conflict_cnt = static_cast<data_size_t>(max_conflict_rate * num_data_);
+  std::vector<int> sparse_features;
+  for (int i = 0; i < num_features_; ++i) {
+    if (features_[i]->is_sparse() && features_[i]->num_bin() < FeatureBundle::kMaxNumBin) {
+      sparse_features.push_back(i);
+    }
+  }
+  if (sparse_features.size() <= 1) { return; }
+  // get non-zero data of the sparse features
+  std::vector<std::vector<data_size_t>> non_zero_indices(sparse_features.size());
+  std::vector<std::vector<uint32_t>> non_zero_bins(sparse_features.size());
+#pragma omp parallel for schedule(guided)
+  for (int i = 0; i < static_cast<int>(sparse_features.size()); ++i) {
+    std::unique_ptr<OrderedBin> ordered_bin(features_[sparse_features[i]]->bin_data()->CreateOrderedBin());
+    ordered_bin->Init(nullptr, 1);
+    ordered_bin->GetLeafNonZeros(0, &non_zero_indices[i], &non_zero_bins[i]);
+  }
+  // greedily put features into bundles, features with more non-zero data first
+  std::vector<int> order(sparse_features.size());
+  for (size_t i = 0; i < order.size(); ++i) { order[i] = static_cast<int>(i); }
+  std::stable_sort(order.begin(), order.end(), [&non_zero_indices](int a, int b) {
+    return non_zero_indices[a].size() > non_zero_indices[b].size();
+  });
+  std::vector<std::vector<int>> bundles;
+  std::vector<int> bundle_num_bin;
+  std::vector<data_size_t> bundle_conflict_cnt;
+  std::vector<data_size_t> bundle_non_zero_cnt;
+  // is data non-zero in any feature of the bundle, one bit per data
+  std::vector<std::vector<uint64_t>> bundle_marks;
+  for (int i : order) {
+    const std::vector<data_size_t>& indices = non_zero_indices[i];
+    const int num_bin = features_[sparse_features[i]]->num_bin();
+    int best_bundle = -1;
+    // only search the latest bundles, to bound the time and the memory of conflict marks
+    const int first_bundle = std::max(0, static_cast<int>(bundles.size()) - max_search_bundles);
+    for (int b = first_bundle; b < static_cast<int>(bundles.size()); ++b) {
+      if (bundle_num_bin[b] + num_bin > FeatureBundle::kMaxNumBin) { continue; }
+      const std::vector<uint64_t>& marks = bundle_marks[b];
+      const data_size_t rest_conflict_cnt = max_conflict_cnt - bundle_conflict_cnt[b];
+      data_size_t conflict_cnt = 0;
+      for (size_t k = 0; k < indices.size() && conflict_cnt <= rest_conflict_cnt; ++k) {
+        conflict_cnt += static_cast<data_size_t>((marks[indices[k] >> 6] >> (indices[k] & 63)) & 1);
+      }
+      if (conflict_cnt <= rest_conflict_cnt) {
+        best_bundle = b;
+        bundle_conflict_cnt[b] += conflict_cnt;
+        break;
+      }
+    }
+    if (best_bundle < 0) {
+      best_bundle = static_cast<int>(bundles.size());
+      bundles.emplace_back();
+      bundle_num_bin.push_back(1);
+      bundle_conflict_cnt.push_back(0);
+      bundle_non_zero_cnt.push_back(0);
+      bundle_marks.emplace_back((num_data_ + 63) / 64, 0);
+      // release the marks of the bundle that will not be searched anymore
+      if (best_bundle >= max_search_bundles) {
+        std::vector<uint64_t>().swap(bundle_marks[best_bundle - max_search_bundles]);
+      }
+    }
+    bundles[best_bundle].push_back(i);
+    bundle_num_bin[best_bundle] += num_bin;
+    bundle_non_zero_cnt[best_bundle] += static_cast<data_size_t>(indices.size());
+    std::vector<uint64_t>& marks = bundle_marks[best_bundle];
+    for (data_size_t idx : indices) {
+      marks[idx >> 6] |= static_cast<uint64_t>(1) << (idx & 63);
+    }
+  }
+  bundle_marks.clear();
+  // dense bundles cost one pass over the leaf, so only use them when they are not too sparse
+  size_t bundle_size_in_byte = 0;
+  int num_bundled_features = 0;
+  std::vector<int> feature_indices;
+  std::vector<int> num_bins;
+  for (size_t b = 0; b < bundles.size(); ++b) {
+    if (bundles[b].size() <= 1 || bundle_non_zero_cnt[b] < min_non_zero_rate * num_data_) {
+      continue;
+    }
+    feature_indices.clear();
+    num_bins.clear();
+    for (int i : bundles[b]) {
+      feature_indices.push_back(sparse_features[i]);
+      num_bins.push_back(features_[sparse_features[i]]->num_bin());
+    }
+    feature_bundles_.emplace_back(new FeatureBundle(num_data_, feature_indices, num_bins));
+    for (size_t j = 0; j < bundles[b].size(); ++j) {
+      const int i = bundles[b][j];
+      feature_bundles_.back()->Push(static_cast<int>(j), non_zero_indices[i], non_zero_bins[i]);
+    }
+    bundle_size_in_byte += feature_bundles_.back()->SizesInByte();
+    num_bundled_features += static_cast<int>(bundles[b].size());
+  }
+  Log::Info("Bundled %d sparse features into %d bundles, extra memory cost: %f MB",
+    num_bundled_features, static_cast<int>(feature_bundles_.size()), bundle_size_in_byte / 1024.0 / 1024.0);
+}
+
+void Dataset::PlaceFeaturesOnNumaNodes(int num_nodes) {
+  numa_feature_begin_.clear();
+  num_nodes = std::min(num_nodes > 0 ? num_nodes : Numa::NumNodes(), omp_get_max_threads());
+  if (num_nodes <= 1) {
+    Log::Warning("Only one NUMA node can be used, use_numa is ignored");
+    return;
+  }
+  if (!Numa::PinThreads(num_nodes)) {
+    Log::Warning("Cannot pin threads to NUMA nodes, use_numa is ignored");
+    return;
+  }
+  std::vector<size_t> feature_sizes(num_features_);
+  for (int i = 0; i < num_features_; ++i) {
+    feature_sizes[i] = features_[i]->SizesInByte();
+  }
+  numa_feature_begin_ = Numa::Shard(feature_sizes, num_nodes);
+  Numa::For(numa_feature_begin_, [this](int i) {
+    features_[i]->RelocateBinData();
+  });
+  Log::Info("Sharded features over %d NUMA nodes", num_nodes);
+}
+
+void Dataset::CompactBins(double max_size_in_byte) {
+  auto bin_sizes = [this](const Feature* feature) {
+    return static_cast<double>(Bin::EstimateSizesInByte(num_data_, feature->num_bin(),
+      feature->bin_mapper()->sparse_rate(), feature->is_sparse()));
+  };
+  double origin_size = 0.0f;
+  for (int i = 0; i < num_features_; ++i) {
+    origin_size += bin_sizes(features_[i].get());
+  }
+  if (origin_size <= max_size_in_byte) { return; }
+  // merge bins into the next smaller bin type, one type at a time
+  std::vector<int> type_max_num_bins = Bin::DenseBinTypeMaxNumBins();
+  double cur_size = origin_size;
+  int num_coarsened = 0;
+  for (int k = static_cast<int>(type_max_num_bins.size()) - 2; k >= 0 && cur_size > max_size_in_byte; --k) {
+    for (int i = 0; i < num_features_ && cur_size > max_size_in_byte; ++i) {
+      Feature* feature = features_[i].get();
+      if (feature->num_bin() <= type_max_num_bins[k] || feature->num_bin() > type_max_num_bins[k + 1]) { continue; }
+      cur_size -= bin_sizes(feature);
+      feature->CoarsenBins(type_max_num_bins[k]);
+      cur_size += bin_sizes(feature);
+      ++num_coarsened;
+    }
+  }
+  if (num_coarsened > 0) {
+    Log::Info("Merged bins of %d features to reduce the memory of bins from %f MB to %f MB",
+      num_coarsened, origin_size / 1024.0 / 1024.0, cur_size / 1024.0 / 1024.0);
+  }
+  if (cur_size > max_size_in_byte) {
+    Log::Warning("Bins need %f MB, more than %f MB left by max_memory", cur_size / 1024.0 / 1024.0,
+      max_size_in_byte / 1024.0 / 1024.0);
+  }
+}
+
+size_t Dataset::FeaturesSizesInByte() const {
+  size_t ret = 0;
+  for (int i = 0; i < num_features_; ++i) {
+    ret += features_[i]->SizesInByte();
+  }
+  for (const auto& feature_bundle : feature_bundles_) {
+    ret += feature_bundle->SizesInByte();
+  }
+  return ret;
+}
+
 bool Dataset::SetFloatField(const char* field_name, const float* field_data, data_size_t num_element) {
   std::string name(field_name);
   name = Common::Trim(name);
@@ -114,7 +336,46 @@ bool Dataset::GetIntField(const char* field_name, int64_t* out_len, const int**
   return true;
 }
 
-void Dataset::SaveBinaryFile(const char* bin_filename) {
+size_t Dataset::SaveBinaryHeaderToFile(FILE* file, bool is_compressed) const {
+  size_t offset = 0;
+  // write token, version and compression flag
+  const size_t size_of_token = std::strlen(binary_file_token);
+  fwrite(binary_file_token, sizeof(char), size_of_token, file);
+  const int version = kBinaryFileVersion;
+  fwrite(&version, sizeof(version), 1, file);
+  const int compression = is_compressed ? 1 : 0;
+  fwrite(&compression, sizeof(compression), 1, file);
+  offset += size_of_token + sizeof(version) + sizeof(compression);
+
+  // get size of header
+  size_t size_of_header = sizeof(num_data_) + sizeof(num_class_) + sizeof(num_features_) + sizeof(num_total_features_) 
+    + sizeof(size_t) + sizeof(int) * used_feature_map_.size();
+  // size of feature names
+  for (int i = 0; i < num_total_features_; ++i) {
+    size_of_header += feature_names_[i].size() + sizeof(int);
+  }
+  fwrite(&size_of_header, sizeof(size_of_header), 1, file);
+  offset += sizeof(size_of_header) + size_of_header;
+  // write header
+  fwrite(&num_data_, sizeof(num_data_), 1, file);
+  fwrite(&num_class_, sizeof(num_class_), 1, file);
+  fwrite(&num_features_, sizeof(num_features_), 1, file);
+  fwrite(&num_total_features_, sizeof(num_features_), 1, file);
+  size_t num_used_feature_map = used_feature_map_.size();
+  fwrite(&num_used_feature_map, sizeof(num_used_feature_map), 1, file);
+  fwrite(used_feature_map_.data(), sizeof(int), num_used_feature_map, file);
+
+  // write feature names
+  for (int i = 0; i < num_total_features_; ++i) {
+    int str_len = static_cast<int>(feature_names_[i].size());
+    fwrite(&str_len, sizeof(int), 1, file);
+    const char* c_str = feature_names_[i].c_str();
+    fwrite(c_str, sizeof(char), str_len, file);
+  }
+  return offset;
+}
+
+void Dataset::SaveBinaryFile(const char* bin_filename, bool is_compressed) {
 
   if (!is_loading_from_binfile_) {
     std::string bin_filename_str(data_filename_);
@@ -133,45 +394,59 @@ void Dataset::SaveBinaryFile(const char* bin_filename) {
       Log::Fatal("Cannot write binary data to %s ", bin_filename);
     }
     Log::Info("Saving data to binary file %s", bin_filename);
-
-    // get size of header
-    size_t size_of_header = sizeof(num_data_) + sizeof(num_class_) + sizeof(num_features_) + sizeof(num_total_features_) 
-      + sizeof(size_t) + sizeof(int) * used_feature_map_.size();
-    // size of feature names
-    for (int i = 0; i < num_total_features_; ++i) {
-      size_of_header += feature_names_[i].size() + sizeof(int);
-    }
-    fwrite(&size_of_header, sizeof(size_of_header), 1, file);
-    // write header
-    fwrite(&num_data_, sizeof(num_data_), 1, file);
-    fwrite(&num_class_, sizeof(num_class_), 1, file);
-    fwrite(&num_features_, sizeof(num_features_), 1, file);
-    fwrite(&num_total_features_, sizeof(num_features_), 1, file);
-    size_t num_used_feature_map = used_feature_map_.size();
-    fwrite(&num_used_feature_map, sizeof(num_used_feature_map), 1, file);
-    fwrite(used_feature_map_.data(), sizeof(int), num_used_feature_map, file);
-
-    // write feature names
-    for (int i = 0; i < num_total_features_; ++i) {
-      int str_len = static_cast<int>(feature_names_[i].size());
-      fwrite(&str_len, sizeof(int), 1, file);
-      const char* c_str = feature_names_[i].c_str();
-      fwrite(c_str, sizeof(char), str_len, file);
-    }
+    size_t offset = SaveBinaryHeaderToFile(file, is_compressed);
 
     // get size of meta data
     size_t size_of_metadata = metadata_.SizesInByte();
     fwrite(&size_of_metadata, sizeof(size_of_metadata), 1, file);
     // write meta data
     metadata_.SaveBinaryToFile(file);
+    offset += sizeof(size_of_metadata) + size_of_metadata;
+    // align the sections of features
+    const std::vector<char> padding(static_cast<size_t>(Feature::kBinaryAlignment), 0);
+    fwrite(padding.data(), sizeof(char), Common::AlignUp(offset, Feature::kBinaryAlignment) - offset, file);
 
-    // write feature data
-    for (int i = 0; i < num_features_; ++i) {
-      // get size of feature
-      size_t size_of_feature = features_[i]->SizesInByte();
-      fwrite(&size_of_feature, sizeof(size_of_feature), 1, file);
-      // write feature
-      features_[i]->SaveBinaryToFile(file);
+    if (is_compressed) {
+      // compress sections of features in parallel
+      std::vector<std::vector<char>> compressed_features(num_features_);
+      std::vector<size_t> raw_sizes(num_features_);
+#pragma omp parallel for schedule(dynamic)
+      for (int i = 0; i < num_features_; ++i) {
+        raw_sizes[i] = features_[i]->SizesInByte();
+        std::vector<char> raw(raw_sizes[i]);
+        features_[i]->CopyTo(raw.data());
+        compressed_features[i].resize(LZCodec::MaxCompressedSize(raw_sizes[i]));
+        compressed_features[i].resize(LZCodec::Compress(raw.data(), raw_sizes[i], compressed_features[i].data()));
+        // store the section as is if it cannot be compressed, loaders know it by the equal sizes
+        if (compressed_features[i].size() >= raw_sizes[i]) {
+          compressed_features[i] = std::move(raw);
+        }
+      }
+      // write the table of (offset, compressed size, raw size) per feature, offsets are relative to the first section
+      size_t feature_offset = 0;
+      size_t total_raw_size = 0;
+      for (int i = 0; i < num_features_; ++i) {
+        const size_t compressed_size = compressed_features[i].size();
+        fwrite(&feature_offset, sizeof(feature_offset), 1, file);
+        fwrite(&compressed_size, sizeof(compressed_size), 1, file);
+        fwrite(&raw_sizes[i], sizeof(raw_sizes[i]), 1, file);
+        feature_offset += compressed_size;
+        total_raw_size += raw_sizes[i];
+      }
+      // write compressed sections
+      for (int i = 0; i < num_features_; ++i) {
+        fwrite(compressed_features[i].data(), sizeof(char), compressed_features[i].size(), file);
+      }
+      Log::Info("Compressed bin data from %.2f MB to %.2f MB", total_raw_size / 1048576.0, feature_offset / 1048576.0);
+    } else {
+      // write feature data
+      for (int i = 0; i < num_features_; ++i) {
+        // get size of feature
+        size_t size_of_feature = features_[i]->SizesInByte();
+        fwrite(&size_of_feature, sizeof(size_of_feature), 1, file);
+        // write feature
+        features_[i]->SaveBinaryToFile(file);
+      }
     }
     fclose(file);
   }
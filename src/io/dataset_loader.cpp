@@ -1,10 +1,24 @@
 #include <omp.h>
 
 #include <LightGBM/utils/log.h>
+#include <LightGBM/utils/mapped_file.h>
+#include <LightGBM/utils/lz_codec.h>
+#include <LightGBM/utils/quantile_sketch.h>
 #include <LightGBM/dataset_loader.h>
 #include <LightGBM/feature.h>
 #include <LightGBM/network.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <mutex>
+
 
 namespace LightGBM {
 
@@ -153,8 +167,13 @@ Dataset* DatasetLoader::LoadFromFile(const char* filename, int rank, int num_mac
   dataset->num_class_ = io_config_.num_class;
   dataset->metadata_.Init(filename, dataset->num_class_);
   bool is_loading_from_binfile = CheckCanLoadFromBin(filename);
+  is_byte_range_partition_ = !is_loading_from_binfile && num_machines > 1
+    && !io_config_.is_pre_partition && io_config_.use_byte_range_partition;
+  if (is_byte_range_partition_) {
+    PartitionByteRange(filename, dataset->metadata_, rank, num_machines);
+  }
   if (!is_loading_from_binfile) {
-    if (!io_config_.use_two_round_loading) {
+    if (!io_config_.use_two_round_loading && !io_config_.use_streaming_loading) {
       // read data to memory
       auto text_data = LoadTextDataToMemory(filename, dataset->metadata_, rank, num_machines,&num_global_data, &used_data_indices);
       dataset->num_data_ = static_cast<data_size_t>(text_data.size());
@@ -170,18 +189,26 @@ Dataset* DatasetLoader::LoadFromFile(const char* filename, int rank, int num_mac
     } else {
       // sample data from file
       auto sample_data = SampleTextDataFromFile(filename, dataset->metadata_, rank, num_machines, &num_global_data, &used_data_indices);
+      data_size_t num_local_data = num_global_data;
       if (used_data_indices.size() > 0) {
-        dataset->num_data_ = static_cast<data_size_t>(used_data_indices.size());
-      } else {
-        dataset->num_data_ = num_global_data;
+        num_local_data = static_cast<data_size_t>(used_data_indices.size());
       }
+      // bins are not kept in memory when streaming, so construct features without data
+      dataset->num_data_ = io_config_.use_streaming_loading ? 0 : num_local_data;
       // construct feature bin mappers
       ConstructBinMappersFromTextData(rank, num_machines, sample_data, parser.get(), dataset.get());
+      dataset->num_data_ = num_local_data;
       // initialize label
       dataset->metadata_.Init(dataset->num_data_, dataset->num_class_, weight_idx_, group_idx_);
 
-      // extract features
-      ExtractFeaturesFromFile(filename, parser.get(), used_data_indices, dataset.get());
+      if (io_config_.use_streaming_loading) {
+        dataset.reset(StreamFeaturesToBinFile(filename, parser.get(), used_data_indices, num_global_data, dataset.get()));
+        // streamed binary file only contains local data, and its meta data is already partitioned
+        used_data_indices.clear();
+      } else {
+        // extract features
+        ExtractFeaturesFromFile(filename, parser.get(), used_data_indices, dataset.get());
+      }
     }
   } else {
     // load data from binary file
@@ -193,12 +220,58 @@ Dataset* DatasetLoader::LoadFromFile(const char* filename, int rank, int num_mac
   dataset->metadata_.CheckOrPartition(num_global_data, used_data_indices);
   // need to check training data
   CheckDataset(dataset.get());
+  PlaceFeaturesOnNumaNodes(dataset.get());
+  BundleSparseFeatures(dataset.get());
   return dataset.release();
 }
 
 
 
 Dataset* DatasetLoader::LoadFromFileAlignWithOtherDataset(const char* filename, const Dataset* train_data) {
+  // validation data is not partitioned
+  is_byte_range_partition_ = false;
+  return LoadAlignedFile(filename, train_data);
+}
+
+std::vector<std::unique_ptr<Dataset>> DatasetLoader::LoadFromFilesAlignWithOtherDataset(
+  const std::vector<std::string>& filenames, const Dataset* train_data) {
+  // validation data is not partitioned
+  is_byte_range_partition_ = false;
+  const int num_files = static_cast<int>(filenames.size());
+  std::vector<std::unique_ptr<Dataset>> datasets(num_files);
+  const int num_threads = omp_get_max_threads();
+  const int num_groups = std::min(num_files, num_threads);
+  if (num_groups <= 1) {
+    for (int i = 0; i < num_files; ++i) {
+      datasets[i].reset(LoadAlignedFile(filenames[i].c_str(), train_data));
+    }
+    return datasets;
+  }
+  // threads of each group
+  const int num_inner_threads = num_threads / num_groups;
+  const int is_nested = omp_get_nested();
+  omp_set_nested(num_inner_threads > 1);
+  std::mutex exception_mutex;
+  std::exception_ptr exception;
+  #pragma omp parallel for schedule(dynamic) num_threads(num_groups)
+  for (int i = 0; i < num_files; ++i) {
+    // only affects the parallel regions in this thread
+    omp_set_num_threads(num_inner_threads);
+    try {
+      datasets[i].reset(LoadAlignedFile(filenames[i].c_str(), train_data));
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(exception_mutex);
+      if (!exception) { exception = std::current_exception(); }
+    }
+  }
+  omp_set_nested(is_nested);
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+  return datasets;
+}
+
+Dataset* DatasetLoader::LoadAlignedFile(const char* filename, const Dataset* train_data) {
   auto parser = std::unique_ptr<Parser>(Parser::CreateParser(filename, io_config_.has_header, 0, label_idx_));
   if (parser == nullptr) {
     Log::Fatal("Could not recognize data format of %s", filename);
@@ -210,7 +283,24 @@ Dataset* DatasetLoader::LoadFromFileAlignWithOtherDataset(const char* filename,
   dataset->num_class_ = io_config_.num_class;
   dataset->metadata_.Init(filename, dataset->num_class_);
   bool is_loading_from_binfile = CheckCanLoadFromBin(filename);
-  if (!is_loading_from_binfile) {
+  // init scores predicted by the input model are not cached
+  std::string cache_key;
+  if (!is_loading_from_binfile && io_config_.use_valid_cache && predict_fun_ == nullptr) {
+    cache_key = AlignedCacheKey(filename, train_data);
+  }
+  std::unique_ptr<Dataset> cached_dataset;
+  if (!cache_key.empty()) {
+    cached_dataset.reset(LoadAlignedCache(filename, cache_key, train_data));
+  }
+  if (cached_dataset != nullptr) {
+    cached_dataset->data_filename_ = dataset->data_filename_;
+    // initial scores are not saved in binary file
+    if (dataset->metadata_.init_score() != nullptr) {
+      cached_dataset->metadata_.SetInitScore(dataset->metadata_.init_score(),
+        cached_dataset->num_data_ * cached_dataset->num_class_);
+    }
+    dataset = std::move(cached_dataset);
+  } else if (!is_loading_from_binfile) {
     if (!io_config_.use_two_round_loading) {
       // read data in memory
       auto text_data = LoadTextDataToMemory(filename, dataset->metadata_, 0, 1, &num_global_data, &used_data_indices);
@@ -241,48 +331,101 @@ Dataset* DatasetLoader::LoadFromFileAlignWithOtherDataset(const char* filename,
   // not need to check validation data
   // check meta data
   dataset->metadata_.CheckOrPartition(num_global_data, used_data_indices);
+  if (!cache_key.empty() && !dataset->is_loading_from_binfile_) {
+    SaveAlignedCache(filename, cache_key, dataset.get());
+  }
   return dataset.release();
 }
 
 Dataset* DatasetLoader::LoadFromBinFile(const char* bin_filename, int rank, int num_machines) {
   auto dataset = std::unique_ptr<Dataset>(new Dataset());
-  FILE* file;
+  FILE* file = NULL;
+  std::unique_ptr<MappedFile> mapped_file;
+  if (io_config_.use_mmap) {
+    mapped_file.reset(new MappedFile(bin_filename));
+    if (!mapped_file->is_open()) {
+      Log::Fatal("Could not map binary data from %s", bin_filename);
+    }
+    // header and meta data are read once
+    mapped_file->Advise(0, mapped_file->size(), MappedFile::Advice::kSequential);
+  } else {
 #ifdef _MSC_VER
-  fopen_s(&file, bin_filename, "rb");
+    fopen_s(&file, bin_filename, "rb");
 #else
-  file = fopen(bin_filename, "rb");
+    file = fopen(bin_filename, "rb");
 #endif
-
-  if (file == NULL) {
-    Log::Fatal("Could not read binary data from %s", bin_filename);
+    if (file == NULL) {
+      Log::Fatal("Could not read binary data from %s", bin_filename);
+    }
   }
 
   // buffer to read binary file
-  size_t buffer_size = 16 * 1024 * 1024;
-  auto buffer = std::vector<char>(buffer_size);
-
-  // read size of header
-  size_t read_cnt = fread(buffer.data(), sizeof(size_t), 1, file);
+  auto buffer = std::vector<char>(16 * 1024 * 1024);
+  size_t offset = 0;
+  // read next size bytes, return nullptr if there is no enough data.
+  // the result points into the mapped file or into buffer, and is valid until the next read
+  auto read_bytes = [&](size_t size) -> const char* {
+    const char* result = nullptr;
+    if (mapped_file != nullptr) {
+      if (size > mapped_file->size() - offset) { return nullptr; }
+      result = mapped_file->data() + offset;
+    } else {
+      // re-allocate space if not enough
+      if (size > buffer.size()) {
+        buffer.resize(size);
+      }
+      if (fread(buffer.data(), 1, size, file) != size) { return nullptr; }
+      result = buffer.data();
+    }
+    offset += size;
+    return result;
+  };
 
-  if (read_cnt != 1) {
-    Log::Fatal("Binary file error: header has the wrong size");
+  // check token, files without token are in the old unpadded layout
+  bool is_aligned = false;
+  bool is_compressed = false;
+  const size_t size_of_token = std::strlen(Dataset::binary_file_token);
+  const char* token = read_bytes(size_of_token + sizeof(int));
+  if (token != nullptr && std::memcmp(token, Dataset::binary_file_token, size_of_token) == 0) {
+    const int version = *(reinterpret_cast<const int*>(token + size_of_token));
+    if (version > Dataset::kBinaryFileVersion) {
+      Log::Fatal("Binary file %s is in version %d, which is not supported", bin_filename, version);
+    }
+    is_aligned = true;
+    // compression flag since version 3
+    if (version >= 3) {
+      const char* compression_ptr = read_bytes(sizeof(int));
+      if (compression_ptr == nullptr) {
+        Log::Fatal("Binary file error: compression flag is incorrect");
+      }
+      const int compression = *(reinterpret_cast<const int*>(compression_ptr));
+      if (compression != 0 && compression != 1) {
+        Log::Fatal("Binary file %s uses unknown compression %d", bin_filename, compression);
+      }
+      is_compressed = compression == 1;
+    }
+  } else {
+    // seek back to the beginning
+    offset = 0;
+    if (file != NULL) { fseek(file, 0, SEEK_SET); }
+    if (mapped_file != nullptr) {
+      Log::Warning("Binary file %s is in the old layout, bin data will be copied. Save it again to use mapped memory directly",
+        bin_filename);
+    }
   }
 
-  size_t size_of_head = *(reinterpret_cast<size_t*>(buffer.data()));
-
-  // re-allocmate space if not enough
-  if (size_of_head > buffer_size) {
-    buffer_size = size_of_head;
-    buffer.resize(buffer_size);
+  // read size of header
+  const char* size_ptr = read_bytes(sizeof(size_t));
+  if (size_ptr == nullptr) {
+    Log::Fatal("Binary file error: header has the wrong size");
   }
+  size_t size_of_head = *(reinterpret_cast<const size_t*>(size_ptr));
   // read header
-  read_cnt = fread(buffer.data(), 1, size_of_head, file);
-
-  if (read_cnt != size_of_head) {
+  const char* mem_ptr = read_bytes(size_of_head);
+  if (mem_ptr == nullptr) {
     Log::Fatal("Binary file error: header is incorrect");
   }
   // get header
-  const char* mem_ptr = buffer.data();
   dataset->num_data_ = *(reinterpret_cast<const data_size_t*>(mem_ptr));
   mem_ptr += sizeof(dataset->num_data_);
   dataset->num_class_ = *(reinterpret_cast<const int*>(mem_ptr));
@@ -315,27 +458,18 @@ Dataset* DatasetLoader::LoadFromBinFile(const char* bin_filename, int rank, int
   }
 
   // read size of meta data
-  read_cnt = fread(buffer.data(), sizeof(size_t), 1, file);
-
-  if (read_cnt != 1) {
+  size_ptr = read_bytes(sizeof(size_t));
+  if (size_ptr == nullptr) {
     Log::Fatal("Binary file error: meta data has the wrong size");
   }
-
-  size_t size_of_metadata = *(reinterpret_cast<size_t*>(buffer.data()));
-
-  // re-allocate space if not enough
-  if (size_of_metadata > buffer_size) {
-    buffer_size = size_of_metadata;
-    buffer.resize(buffer_size);
-  }
+  size_t size_of_metadata = *(reinterpret_cast<const size_t*>(size_ptr));
   //  read meta data
-  read_cnt = fread(buffer.data(), 1, size_of_metadata, file);
-
-  if (read_cnt != size_of_metadata) {
+  mem_ptr = read_bytes(size_of_metadata);
+  if (mem_ptr == nullptr) {
     Log::Fatal("Binary file error: meta data is incorrect");
   }
   // load meta data
-  dataset->metadata_.LoadFromMemory(buffer.data());
+  dataset->metadata_.LoadFromMemory(mem_ptr, dataset->num_class_);
 
   std::vector<data_size_t> used_data_indices;
   data_size_t num_global_data = dataset->num_data_;
@@ -374,33 +508,80 @@ Dataset* DatasetLoader::LoadFromBinFile(const char* bin_filename, int rank, int
     dataset->num_data_ = static_cast<data_size_t>(used_data_indices.size());
   }
   dataset->metadata_.PartitionLabel(used_data_indices);
-  // read feature data
-  for (int i = 0; i < dataset->num_features_; ++i) {
-    // read feature size
-    read_cnt = fread(buffer.data(), sizeof(size_t), 1, file);
-    if (read_cnt != 1) {
-      Log::Fatal("Binary file error: feature %d has the wrong size", i);
+  // skip the padding before sections of features
+  if (is_aligned && read_bytes(Common::AlignUp(offset, Feature::kBinaryAlignment) - offset) == nullptr) {
+    Log::Fatal("Binary file error: padding of features is incorrect");
+  }
+  // start reading bin data in background
+  if (mapped_file != nullptr) {
+    mapped_file->Advise(offset, mapped_file->size() - offset, MappedFile::Advice::kWillNeed);
+  }
+  if (is_compressed) {
+    // read the table of (offset, compressed size, raw size) per feature
+    const size_t size_of_table = sizeof(size_t) * 3 * dataset->num_features_;
+    mem_ptr = read_bytes(size_of_table);
+    if (mem_ptr == nullptr) {
+      Log::Fatal("Binary file error: table of compressed features is incorrect");
     }
-    size_t size_of_feature = *(reinterpret_cast<size_t*>(buffer.data()));
-    // re-allocate space if not enough
-    if (size_of_feature > buffer_size) {
-      buffer_size = size_of_feature;
-      buffer.resize(buffer_size);
+    std::vector<size_t> table(3 * dataset->num_features_);
+    std::memcpy(table.data(), mem_ptr, size_of_table);
+    size_t size_of_features = 0;
+    for (int i = 0; i < dataset->num_features_; ++i) {
+      size_of_features = std::max(size_of_features, table[3 * i] + table[3 * i + 1]);
     }
-
-    read_cnt = fread(buffer.data(), 1, size_of_feature, file);
-
-    if (read_cnt != size_of_feature) {
-      Log::Fatal("Binary file error: feature %d is incorrect, read count: %d", i, read_cnt);
+    mem_ptr = read_bytes(size_of_features);
+    if (mem_ptr == nullptr) {
+      Log::Fatal("Binary file error: compressed features are incorrect");
+    }
+    // decompress and construct features in parallel, bin data is always copied out of the decompressed buffer
+    dataset->features_.resize(dataset->num_features_);
+    int broken_feature = -1;
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < dataset->num_features_; ++i) {
+      const char* section = mem_ptr + table[3 * i];
+      std::vector<char> raw;
+      // sections that cannot be compressed are stored as is
+      if (table[3 * i + 1] != table[3 * i + 2]) {
+        raw.resize(table[3 * i + 2]);
+        if (!LZCodec::Decompress(section, table[3 * i + 1], raw.data(), raw.size())) {
+#pragma omp critical
+          broken_feature = i;
+          continue;
+        }
+        section = raw.data();
+      }
+      dataset->features_[i].reset(new Feature(section, num_global_data, used_data_indices, true, false));
+    }
+    if (broken_feature >= 0) {
+      Log::Fatal("Binary file error: feature %d is incorrect", broken_feature);
+    }
+  } else {
+    // read feature data
+    for (int i = 0; i < dataset->num_features_; ++i) {
+      // read feature size
+      size_ptr = read_bytes(sizeof(size_t));
+      if (size_ptr == nullptr) {
+        Log::Fatal("Binary file error: feature %d has the wrong size", i);
+      }
+      size_t size_of_feature = *(reinterpret_cast<const size_t*>(size_ptr));
+      mem_ptr = read_bytes(size_of_feature);
+      if (mem_ptr == nullptr) {
+        Log::Fatal("Binary file error: feature %d is incorrect", i);
+      }
+      dataset->features_.emplace_back(std::unique_ptr<Feature>(
+        new Feature(mem_ptr,
+          num_global_data,
+          used_data_indices,
+          is_aligned,
+          mapped_file != nullptr && is_aligned)
+      ));
     }
-    dataset->features_.emplace_back(std::unique_ptr<Feature>(
-      new Feature(buffer.data(), 
-        num_global_data, 
-        used_data_indices)
-    ));
   }
   dataset->features_.shrink_to_fit();
-  fclose(file);
+  if (file != NULL) {
+    fclose(file);
+  }
+  dataset->mapped_file_ = std::move(mapped_file);
   dataset->is_loading_from_binfile_ = true;
   return dataset.release();
 }
@@ -448,13 +629,37 @@ Dataset* DatasetLoader::CostructFromSampleData(std::vector<std::vector<double>>&
   }
   dataset->feature_names_ = feature_names_;
   dataset->num_features_ = static_cast<int>(dataset->features_.size());
+  CompactBins(dataset.get());
   dataset->metadata_.Init(dataset->num_data_, dataset->num_class_, NO_SPECIFIC, NO_SPECIFIC);
   return dataset.release();
 }
 
 
+void DatasetLoader::BundleSparseFeatures(Dataset* dataset) const {
+  if (!io_config_.enable_bundle) { return; }
+  dataset->BundleSparseFeatures(io_config_.max_conflict_rate, io_config_.bundle_min_non_zero_rate,
+    io_config_.max_search_bundles);
+}
+
+void DatasetLoader::PlaceFeaturesOnNumaNodes(Dataset* dataset) const {
+  if (!io_config_.use_numa) { return; }
+  dataset->PlaceFeaturesOnNumaNodes(io_config_.num_numa_nodes);
+}
+
 // ---- private functions ----
 
+void DatasetLoader::CompactBins(Dataset* dataset) const {
+  if (io_config_.max_memory <= 0.0f || dataset->num_data_ <= 0) { return; }
+  if (Network::num_machines() > 1) {
+    Log::Warning("Bins are not merged for max_memory in distributed training");
+    return;
+  }
+  // label, and for each class the gradient, hessian, score, ordered gradient, ordered hessian and data partition
+  const double size_per_data = sizeof(float)
+    + static_cast<double>(io_config_.num_class) * (5 * sizeof(score_t) + 3 * sizeof(data_size_t));
+  dataset->CompactBins(io_config_.max_memory * 1024 * 1024 - size_per_data * dataset->num_data_);
+}
+
 void DatasetLoader::CheckDataset(const Dataset* dataset) {
   if (dataset->num_data_ <= 0) {
     Log::Fatal("Data file %s is empty", dataset->data_filename_);
@@ -472,6 +677,10 @@ std::vector<std::string> DatasetLoader::LoadTextDataToMemory(const char* filenam
   if (num_machines == 1 || io_config_.is_pre_partition) {
     // read all lines
     *num_global_data = text_reader.ReadAllLines();
+  } else if (is_byte_range_partition_) {
+    // read all lines in the local range
+    text_reader.SetByteRange(byte_range_start_, byte_range_end_);
+    SetByteRangeIndices(rank, num_machines, text_reader.ReadAllLines(), num_global_data, used_data_indices);
   } else {  // need partition data
             // get query data
     const data_size_t* query_boundaries = metadata.query_boundaries();
@@ -531,6 +740,11 @@ std::vector<std::string> DatasetLoader::SampleTextDataFromFile(const char* filen
   std::vector<std::string> out_data;
   if (num_machines == 1 || io_config_.is_pre_partition) {
     *num_global_data = static_cast<data_size_t>(text_reader.SampleFromFile(random_, sample_cnt, &out_data));
+  } else if (is_byte_range_partition_) {
+    // sample from the lines in the local range
+    text_reader.SetByteRange(byte_range_start_, byte_range_end_);
+    SetByteRangeIndices(rank, num_machines, text_reader.SampleFromFile(random_, sample_cnt, &out_data),
+                        num_global_data, used_data_indices);
   } else {  // need partition data
             // get query data
     const data_size_t* query_boundaries = metadata.query_boundaries();
@@ -572,8 +786,11 @@ std::vector<std::string> DatasetLoader::SampleTextDataFromFile(const char* filen
 }
 
 void DatasetLoader::ConstructBinMappersFromTextData(int rank, int num_machines, const std::vector<std::string>& sample_data, const Parser* parser, Dataset* dataset) {
+  auto start_time = std::chrono::high_resolution_clock::now();
   // sample_values[i][j], means the value of j-th sample on i-th feature
   std::vector<std::vector<double>> sample_values;
+  // sketches of sample values, used instead of sample_values if use_quantile_sketch
+  std::vector<QuantileSketch> sketches;
   // temp buffer for one line features and label
   std::vector<std::pair<int, double>> oneline_features;
   double label;
@@ -588,12 +805,75 @@ void DatasetLoader::ConstructBinMappersFromTextData(int rank, int num_machines,
           size_t need_size = inner_data.first - sample_values.size() + 1;
           for (size_t j = 0; j < need_size; ++j) {
             sample_values.emplace_back();
+            if (io_config_.use_quantile_sketch) {
+              sketches.emplace_back(io_config_.quantile_sketch_size);
+            }
           }
         }
-        sample_values[inner_data.first].push_back(inner_data.second);
+        if (io_config_.use_quantile_sketch) {
+          sketches[inner_data.first].Push(inner_data.second);
+        } else {
+          sample_values[inner_data.first].push_back(inner_data.second);
+        }
+      }
+    }
+  }
+  size_t total_sample_cnt = sample_data.size();
+  if (num_machines > 1 && io_config_.use_quantile_sketch) {
+    // merge sketches of all machines, then every machine finds the same bins from the global distribution
+    int local_num_feature = static_cast<int>(sample_values.size());
+    int total_num_feature = 0;
+    Network::Allreduce(reinterpret_cast<char*>(&local_num_feature), sizeof(int), sizeof(int),
+      reinterpret_cast<char*>(&total_num_feature), [](const char* src, char* dst, int len) {
+      for (int i = 0; i < len; i += static_cast<int>(sizeof(int))) {
+        int* p = reinterpret_cast<int*>(dst + i);
+        *p = std::max(*p, *reinterpret_cast<const int*>(src + i));
+      }
+    });
+    int local_sample_cnt = static_cast<int>(sample_data.size());
+    int global_sample_cnt = 0;
+    Network::Allreduce(reinterpret_cast<char*>(&local_sample_cnt), sizeof(int), sizeof(int),
+      reinterpret_cast<char*>(&global_sample_cnt), [](const char* src, char* dst, int len) {
+      for (int i = 0; i < len; i += static_cast<int>(sizeof(int))) {
+        *reinterpret_cast<int*>(dst + i) += *reinterpret_cast<const int*>(src + i);
+      }
+    });
+    total_sample_cnt = static_cast<size_t>(global_sample_cnt);
+    sample_values.resize(total_num_feature);
+    while (static_cast<int>(sketches.size()) < total_num_feature) {
+      sketches.emplace_back(io_config_.quantile_sketch_size);
+    }
+    const int sketch_size = io_config_.quantile_sketch_size;
+    const int type_size = QuantileSketch::SizeForSpecificSize(sketch_size);
+    auto input_buffer = std::vector<char>(static_cast<size_t>(type_size) * total_num_feature);
+    auto output_buffer = std::vector<char>(input_buffer.size());
+#pragma omp parallel for schedule(guided)
+    for (int i = 0; i < total_num_feature; ++i) {
+      sketches[i].CopyTo(input_buffer.data() + static_cast<size_t>(type_size) * i);
+    }
+    Network::Allreduce(input_buffer.data(), static_cast<int>(input_buffer.size()), type_size, output_buffer.data(),
+      [type_size, sketch_size](const char* src, char* dst, int len) {
+      for (int i = 0; i < len; i += type_size) {
+        QuantileSketch sketch(sketch_size);
+        sketch.CopyFrom(dst + i);
+        sketch.MergeFrom(src + i);
+        sketch.CopyTo(dst + i);
       }
+    });
+#pragma omp parallel for schedule(guided)
+    for (int i = 0; i < total_num_feature; ++i) {
+      sketches[i].CopyFrom(output_buffer.data() + static_cast<size_t>(type_size) * i);
     }
   }
+  auto find_bin = [this, &sample_values, &sketches, total_sample_cnt](int i, BinMapper* bin_mapper) {
+    if (io_config_.use_quantile_sketch) {
+      QuantileSketch::Summary summary;
+      sketches[i].GetSummary(&summary);
+      bin_mapper->FindBin(summary, total_sample_cnt, io_config_.max_bin);
+    } else {
+      bin_mapper->FindBin(&sample_values[i], total_sample_cnt, io_config_.max_bin);
+    }
+  };
 
   dataset->features_.clear();
 
@@ -616,9 +896,9 @@ void DatasetLoader::ConstructBinMappersFromTextData(int rank, int num_machines,
   }
   dataset->feature_names_ = feature_names_;
   // start find bins
-  if (num_machines == 1) {
+  if (num_machines == 1 || io_config_.use_quantile_sketch) {
     std::vector<std::unique_ptr<BinMapper>> bin_mappers(sample_values.size());
-    // if only one machine, find bin locally
+    // if only one machine or sketches are merged, find bin locally
 #pragma omp parallel for schedule(guided)
     for (int i = 0; i < static_cast<int>(sample_values.size()); ++i) {
       if (ignore_features_.count(i) > 0) {
@@ -626,7 +906,7 @@ void DatasetLoader::ConstructBinMappersFromTextData(int rank, int num_machines,
         continue;
       }
       bin_mappers[i].reset(new BinMapper());
-      bin_mappers[i]->FindBin(&sample_values[i], sample_data.size(), io_config_.max_bin);
+      find_bin(i, bin_mappers[i].get());
     }
 
     for (size_t i = 0; i < sample_values.size(); ++i) {
@@ -650,6 +930,9 @@ void DatasetLoader::ConstructBinMappersFromTextData(int rank, int num_machines,
   } else {
     // if have multi-machines, need find bin distributed
     // different machines will find bin for different features
+    // all machines share the work, there can be more machines than data partitions
+    rank = Network::rank();
+    num_machines = Network::num_machines();
 
     // start and len will store the process feature indices for different machines
     // machine i will find bins for features in [ strat[i], start[i] + len[i] )
@@ -676,7 +959,7 @@ void DatasetLoader::ConstructBinMappersFromTextData(int rank, int num_machines,
 #pragma omp parallel for schedule(guided)
     for (int i = 0; i < len[rank]; ++i) {
       BinMapper bin_mapper;
-      bin_mapper.FindBin(&sample_values[start[rank] + i], sample_data.size(), io_config_.max_bin);
+      find_bin(start[rank] + i, &bin_mapper);
       bin_mapper.CopyTo(input_buffer.data() + i * type_size);
     }
     // convert to binary size
@@ -709,6 +992,10 @@ void DatasetLoader::ConstructBinMappersFromTextData(int rank, int num_machines,
   }
   dataset->features_.shrink_to_fit();
   dataset->num_features_ = static_cast<int>(dataset->features_.size());
+  CompactBins(dataset);
+  auto end_time = std::chrono::high_resolution_clock::now();
+  Log::Info("Finished constructing bins in %f seconds",
+    std::chrono::duration<double, std::milli>(end_time - start_time) * 1e-3);
 }
 
 /*! \brief Extract local features from memory */
@@ -795,9 +1082,9 @@ void DatasetLoader::ExtractFeaturesFromFile(const char* filename, const Parser*
   if (predict_fun_ != nullptr) {
     init_score = std::vector<score_t>(dataset->num_data_ * dataset->num_class_);
   }
-  std::function<void(data_size_t, const std::vector<std::string>&)> process_fun =
+  std::function<void(data_size_t, const std::vector<const char*>&)> process_fun =
     [this, &init_score, &parser, &dataset]
-  (data_size_t start_idx, const std::vector<std::string>& lines) {
+  (data_size_t start_idx, const std::vector<const char*>& lines) {
     std::vector<std::pair<int, double>> oneline_features;
     double tmp_label = 0.0f;
 #pragma omp parallel for schedule(static) private(oneline_features) firstprivate(tmp_label)
@@ -805,7 +1092,7 @@ void DatasetLoader::ExtractFeaturesFromFile(const char* filename, const Parser*
       const int tid = omp_get_thread_num();
       oneline_features.clear();
       // parser
-      parser->ParseOneLine(lines[i].c_str(), &oneline_features, &tmp_label);
+      parser->ParseOneLine(lines[i], &oneline_features, &tmp_label);
       // set initial score
       if (init_score.size() > 0) {
         std::vector<double> oneline_init_score = predict_fun_(oneline_features);
@@ -833,7 +1120,11 @@ void DatasetLoader::ExtractFeaturesFromFile(const char* filename, const Parser*
     }
   };
   TextReader<data_size_t> text_reader(filename, io_config_.has_header);
-  if (used_data_indices.size() > 0) {
+  if (is_byte_range_partition_) {
+    // all lines in the local range are used
+    text_reader.SetByteRange(byte_range_start_, byte_range_end_);
+    text_reader.ReadAllAndProcessParallel(process_fun);
+  } else if (used_data_indices.size() > 0) {
     // only need part of data
     text_reader.ReadPartAndProcessParallel(used_data_indices, process_fun);
   } else {
@@ -848,6 +1139,349 @@ void DatasetLoader::ExtractFeaturesFromFile(const char* filename, const Parser*
   dataset->FinishLoad();
 }
 
+Dataset* DatasetLoader::StreamFeaturesToBinFile(const char* filename, const Parser* parser,
+  const std::vector<data_size_t>& used_data_indices, data_size_t num_global_data, Dataset* dataset) {
+  const data_size_t num_data = dataset->num_data_;
+  const int num_features = dataset->num_features_;
+  std::vector<score_t> init_score;
+  if (predict_fun_ != nullptr) {
+    init_score = std::vector<score_t>(num_data * dataset->num_class_);
+  }
+  // all features are stored densely, so the position of each chunk in the file is known in advance
+  std::vector<std::unique_ptr<Feature>> dense_features(num_features);
+  for (int i = 0; i < num_features; ++i) {
+    dense_features[i].reset(new Feature(dataset->features_[i]->feature_index(),
+      new BinMapper(*dataset->features_[i]->bin_mapper()), 0, false));
+  }
+  // bins of a chunk take about 64MB, and the chunk size is even to keep 4-bit bins of chunks byte aligned
+  const size_t kChunkSizeInByte = 64 * 1024 * 1024;
+  data_size_t chunk_size = static_cast<data_size_t>(kChunkSizeInByte / std::max(num_features, 1));
+  chunk_size = std::max<data_size_t>(chunk_size / 2 * 2, 2);
+  auto create_chunk_bin = [&dense_features](int i, data_size_t num_chunk_data) {
+    const BinMapper* bin_mapper = dense_features[i]->bin_mapper();
+    return Bin::CreateDenseBin(num_chunk_data, bin_mapper->num_bin(), bin_mapper->ValueToBin(0));
+  };
+  // sizes in byte of bin data of a full chunk and of all data
+  std::vector<size_t> chunk_bin_sizes(num_features);
+  std::vector<size_t> bin_sizes(num_features);
+  for (int i = 0; i < num_features; ++i) {
+    chunk_bin_sizes[i] = std::unique_ptr<Bin>(create_chunk_bin(i, chunk_size))->SizesInByte();
+    bin_sizes[i] = chunk_bin_sizes[i] * (num_data / chunk_size)
+      + std::unique_ptr<Bin>(create_chunk_bin(i, num_data % chunk_size))->SizesInByte();
+  }
+
+  // write to a temporary file, so an interrupted loading doesn't leave a broken binary file
+  std::string bin_filename(filename);
+  bin_filename.append(".bin");
+  std::string tmp_filename(bin_filename);
+  tmp_filename.append(".tmp");
+  FILE* file;
+#ifdef _MSC_VER
+  fopen_s(&file, tmp_filename.c_str(), "wb");
+#else
+  file = fopen(tmp_filename.c_str(), "wb");
+#endif
+  if (file == NULL) {
+    Log::Fatal("Cannot write binary data to %s ", tmp_filename.c_str());
+  }
+  Log::Info("Streaming data to binary file %s", bin_filename.c_str());
+  auto seek = [file](size_t pos) {
+#ifdef _MSC_VER
+    _fseeki64(file, static_cast<int64_t>(pos), SEEK_SET);
+#else
+    fseeko(file, static_cast<off_t>(pos), SEEK_SET);
+#endif
+  };
+  size_t offset = dataset->SaveBinaryHeaderToFile(file);
+  // meta data is written after all data are extracted, reserve space for it.
+  // it can only shrink after partition, except query boundaries from the query column
+  size_t size_of_metadata = dataset->metadata_.SizesInByte();
+  if (group_idx_ >= 0) {
+    size_of_metadata += sizeof(data_size_t) * (num_data + 1);
+  }
+  const size_t metadata_offset = offset;
+  offset = Common::AlignUp(offset + sizeof(size_of_metadata) + size_of_metadata, Feature::kBinaryAlignment);
+  // write parts of features except the bin data
+  std::vector<size_t> bin_offsets(num_features);
+  for (int i = 0; i < num_features; ++i) {
+    seek(offset);
+    size_t size_of_feature = dense_features[i]->SizesInByte(bin_sizes[i]);
+    fwrite(&size_of_feature, sizeof(size_of_feature), 1, file);
+    bin_offsets[i] = offset + sizeof(size_of_feature) + dense_features[i]->SaveBinaryHeaderToFile(file);
+    seek(bin_offsets[i] + bin_sizes[i]);
+    dense_features[i]->SaveBinaryTailToFile(file, bin_sizes[i]);
+    offset += sizeof(size_of_feature) + size_of_feature;
+  }
+
+  // bins of current chunk
+  std::vector<std::unique_ptr<Bin>> chunk_bins(num_features);
+  data_size_t chunk_start = 0;
+  data_size_t chunk_end = 0;
+  auto start_chunk = [&]() {
+    chunk_end = std::min(chunk_start + chunk_size, num_data);
+    for (int i = 0; i < num_features; ++i) {
+      chunk_bins[i].reset(create_chunk_bin(i, chunk_end - chunk_start));
+    }
+  };
+  auto finish_chunk = [&]() {
+#pragma omp parallel for schedule(guided)
+    for (int i = 0; i < num_features; ++i) {
+      chunk_bins[i]->FinishLoad();
+    }
+    const size_t chunk_idx = static_cast<size_t>(chunk_start / chunk_size);
+    for (int i = 0; i < num_features; ++i) {
+      seek(bin_offsets[i] + chunk_idx * chunk_bin_sizes[i]);
+      chunk_bins[i]->SaveBinaryToFile(file);
+    }
+    chunk_start = chunk_end;
+    if (chunk_start < num_data) {
+      start_chunk();
+    }
+  };
+  if (num_data > 0) {
+    start_chunk();
+  }
+  std::function<void(data_size_t, const std::vector<const char*>&)> process_fun =
+    [this, &init_score, &parser, &dataset, &chunk_bins, &chunk_start, &chunk_end, &finish_chunk, num_data]
+  (data_size_t start_idx, const std::vector<const char*>& lines) {
+    data_size_t cur = 0;
+    const data_size_t num_lines = static_cast<data_size_t>(lines.size());
+    while (cur < num_lines) {
+      if (start_idx + cur >= num_data) {
+        Log::Fatal("Number of lines of %s is changed while loading", dataset->data_filename_);
+      }
+      // lines in current chunk
+      const data_size_t end = std::min(num_lines, chunk_end - start_idx);
+      std::vector<std::pair<int, double>> oneline_features;
+      double tmp_label = 0.0f;
+#pragma omp parallel for schedule(static) private(oneline_features) firstprivate(tmp_label)
+      for (data_size_t i = cur; i < end; ++i) {
+        const int tid = omp_get_thread_num();
+        const data_size_t idx = start_idx + i;
+        oneline_features.clear();
+        // parser
+        parser->ParseOneLine(lines[i], &oneline_features, &tmp_label);
+        // set initial score
+        if (init_score.size() > 0) {
+          std::vector<double> oneline_init_score = predict_fun_(oneline_features);
+          for (int k = 0; k < dataset->num_class_; ++k) {
+            init_score[k * dataset->num_data_ + idx] = static_cast<float>(oneline_init_score[k]);
+          }
+        }
+        // set label
+        dataset->metadata_.SetLabelAt(idx, static_cast<float>(tmp_label));
+        // push data
+        for (auto& inner_data : oneline_features) {
+          if (inner_data.first >= dataset->num_total_features_) { continue; }
+          int feature_idx = dataset->used_feature_map_[inner_data.first];
+          if (feature_idx >= 0) {
+            // if is used feature
+            const unsigned int bin = dataset->features_[feature_idx]->bin_mapper()->ValueToBin(inner_data.second);
+            chunk_bins[feature_idx]->Push(tid, idx - chunk_start, bin);
+          } else {
+            if (inner_data.first == weight_idx_) {
+              dataset->metadata_.SetWeightAt(idx, static_cast<float>(inner_data.second));
+            } else if (inner_data.first == group_idx_) {
+              dataset->metadata_.SetQueryAt(idx, static_cast<data_size_t>(inner_data.second));
+            }
+          }
+        }
+      }
+      cur = end;
+      if (start_idx + cur == chunk_end) {
+        finish_chunk();
+      }
+    }
+  };
+  TextReader<data_size_t> text_reader(filename, io_config_.has_header);
+  if (is_byte_range_partition_) {
+    // all lines in the local range are used
+    text_reader.SetByteRange(byte_range_start_, byte_range_end_);
+    text_reader.ReadAllAndProcessParallel(process_fun);
+  } else if (used_data_indices.size() > 0) {
+    // only need part of data
+    text_reader.ReadPartAndProcessParallel(used_data_indices, process_fun);
+  } else {
+    // need full data
+    text_reader.ReadAllAndProcessParallel(process_fun);
+  }
+  if (chunk_start != num_data) {
+    Log::Fatal("Number of lines of %s is changed while loading", filename);
+  }
+
+  // metadata_ will manage space of init_score
+  if (init_score.size() > 0) {
+    dataset->metadata_.SetInitScore(init_score.data(), num_data * dataset->num_class_);
+  }
+  dataset->metadata_.CheckOrPartition(num_global_data, used_data_indices);
+  CHECK(dataset->metadata_.SizesInByte() <= size_of_metadata);
+  seek(metadata_offset);
+  fwrite(&size_of_metadata, sizeof(size_of_metadata), 1, file);
+  dataset->metadata_.SaveBinaryToFile(file);
+  fclose(file);
+  std::remove(bin_filename.c_str());
+  if (std::rename(tmp_filename.c_str(), bin_filename.c_str()) != 0) {
+    Log::Fatal("Cannot rename %s to %s", tmp_filename.c_str(), bin_filename.c_str());
+  }
+
+  auto out = std::unique_ptr<Dataset>(LoadFromBinFile(bin_filename.c_str(), 0, 1));
+  out->data_filename_ = dataset->data_filename_;
+  // initial scores are not saved in binary file
+  if (dataset->metadata_.init_score() != nullptr) {
+    out->metadata_.SetInitScore(dataset->metadata_.init_score(), out->num_data_ * out->num_class_);
+  }
+  return out.release();
+}
+
+/*! \brief Find the local byte range of the data file */
+void DatasetLoader::PartitionByteRange(const char* filename, const Metadata& metadata, int rank, int num_machines) {
+  if (Network::num_machines() < num_machines) {
+    Log::Fatal("Network should be initialized before loading data partitioned by byte ranges");
+  }
+  TextReader<data_size_t> text_reader(filename, io_config_.has_header);
+  // split the bytes after the header evenly
+  const size_t data_start = text_reader.range_start();
+  const size_t file_size = PipelineReader::FileSize(filename);
+  const size_t data_size = file_size > data_start ? file_size - data_start : 0;
+  text_reader.SetByteRange(data_start + data_size * rank / num_machines,
+                           data_start + data_size * (rank + 1) / num_machines);
+  byte_range_start_ = text_reader.range_start();
+  byte_range_end_ = text_reader.range_end();
+  const data_size_t* query_boundaries = metadata.query_boundaries();
+  if (query_boundaries != nullptr) {
+    // need line indices to find the beginnings of queries, so count the local lines first
+    std::vector<data_size_t> line_starts = GatherLineStarts(rank, num_machines, text_reader.CountLine());
+    const data_size_t num_queries = metadata.num_queries();
+    if (line_starts[num_machines] != query_boundaries[num_queries]) {
+      Log::Fatal("The number of lines of %s doesn't match the query file", filename);
+    }
+    const data_size_t* query_end = query_boundaries + num_queries + 1;
+    const data_size_t first_line = *std::lower_bound(query_boundaries, query_end, line_starts[rank]);
+    const data_size_t end_line = *std::lower_bound(query_boundaries, query_end, line_starts[rank + 1]);
+    // lines of the first query are moved to the previous machine, and the last query is completed from the next one
+    byte_range_start_ = text_reader.SkipLines(byte_range_start_, first_line - line_starts[rank]);
+    byte_range_end_ = text_reader.SkipLines(byte_range_end_, end_line - line_starts[rank + 1]);
+    byte_range_end_ = std::max(byte_range_start_, byte_range_end_);
+  }
+  Log::Info("Local byte range of %s is [%lld, %lld)", filename,
+            static_cast<long long>(byte_range_start_), static_cast<long long>(byte_range_end_));
+}
+
+/*! \brief Gather the number of local lines of all data partitions */
+std::vector<data_size_t> DatasetLoader::GatherLineStarts(int rank, int num_machines, data_size_t num_local_lines) {
+  // machines with the same partition have the same lines
+  data_size_t local[2] = { static_cast<data_size_t>(rank), num_local_lines };
+  std::vector<data_size_t> all(2 * Network::num_machines());
+  Network::Allgather(reinterpret_cast<char*>(local), sizeof(local), reinterpret_cast<char*>(all.data()));
+  std::vector<data_size_t> line_starts(num_machines + 1, 0);
+  for (int i = 0; i < Network::num_machines(); ++i) {
+    line_starts[all[2 * i] + 1] = all[2 * i + 1];
+  }
+  for (int i = 0; i < num_machines; ++i) {
+    line_starts[i + 1] += line_starts[i];
+  }
+  return line_starts;
+}
+
+/*! \brief Global indices of the local lines partitioned by byte ranges */
+void DatasetLoader::SetByteRangeIndices(int rank, int num_machines, data_size_t num_local_lines,
+  int* num_global_data, std::vector<data_size_t>* used_data_indices) {
+  std::vector<data_size_t> line_starts = GatherLineStarts(rank, num_machines, num_local_lines);
+  *num_global_data = line_starts.back();
+  const data_size_t first_line = line_starts[rank];
+  used_data_indices->resize(num_local_lines);
+  for (data_size_t i = 0; i < num_local_lines; ++i) {
+    (*used_data_indices)[i] = first_line + i;
+  }
+}
+
+std::string DatasetLoader::AlignedCacheKey(const char* filename, const Dataset* train_data) const {
+  struct stat file_stat;
+  if (stat(filename, &file_stat) != 0) {
+    return std::string();
+  }
+  const int version = Dataset::kBinaryFileVersion;
+  uint64_t hash = Common::Hash64(&version, sizeof(version));
+  const uint64_t fingerprint = train_data->FeatureMapperFingerprint();
+  hash = Common::Hash64(&fingerprint, sizeof(fingerprint), hash);
+  // the file and the additional files of meta data in the cache, missing ones are hashed as size -1.
+  // initial scores are not in binary files, they are always read from the init file
+  for (const char* suffix : { "", ".weight", ".query" }) {
+    std::string name(filename);
+    name.append(suffix);
+    int64_t identity[2] = { -1, 0 };
+    if (stat(name.c_str(), &file_stat) == 0) {
+      identity[0] = static_cast<int64_t>(file_stat.st_size);
+      identity[1] = static_cast<int64_t>(file_stat.st_mtime);
+    }
+    hash = Common::Hash64(identity, sizeof(identity), hash);
+  }
+  // options that change the parsed data
+  const int options[] = { io_config_.has_header, io_config_.is_enable_sparse, io_config_.num_class, label_idx_, weight_idx_, group_idx_ };
+  hash = Common::Hash64(options, sizeof(options), hash);
+  std::vector<int> ignore_features(ignore_features_.begin(), ignore_features_.end());
+  std::sort(ignore_features.begin(), ignore_features.end());
+  hash = Common::Hash64(ignore_features.data(), sizeof(int) * ignore_features.size(), hash);
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+  return std::string(buffer);
+}
+
+Dataset* DatasetLoader::LoadAlignedCache(const char* filename, const std::string& key, const Dataset* train_data) {
+  const std::string cache_filename = std::string(filename) + ".cache.bin";
+  const std::string key_filename = std::string(filename) + ".cache.key";
+  std::ifstream key_file(key_filename);
+  std::string cached_key;
+  if (!key_file.is_open() || !std::getline(key_file, cached_key) || cached_key != key) {
+    return nullptr;
+  }
+  FILE* file;
+#ifdef _MSC_VER
+  fopen_s(&file, cache_filename.c_str(), "rb");
+#else
+  file = fopen(cache_filename.c_str(), "rb");
+#endif
+  if (file == NULL) {
+    return nullptr;
+  }
+  fclose(file);
+  Log::Info("Loading %s from its binary cache %s", filename, cache_filename.c_str());
+  auto dataset = std::unique_ptr<Dataset>(LoadFromBinFile(cache_filename.c_str(), 0, 1));
+  if (dataset->FeatureMapperFingerprint() != train_data->FeatureMapperFingerprint()) {
+    Log::Warning("Binary cache %s doesn't match the training data, load %s again", cache_filename.c_str(), filename);
+    return nullptr;
+  }
+  return dataset.release();
+}
+
+void DatasetLoader::SaveAlignedCache(const char* filename, const std::string& key, Dataset* dataset) const {
+  const std::string cache_filename = std::string(filename) + ".cache.bin";
+  const std::string key_filename = std::string(filename) + ".cache.key";
+  const std::string tmp_filename = cache_filename + ".tmp";
+  // the old key is removed first, so the cache is never used with a key of other data
+  std::remove(key_filename.c_str());
+  FILE* file;
+#ifdef _MSC_VER
+  fopen_s(&file, tmp_filename.c_str(), "wb");
+#else
+  file = fopen(tmp_filename.c_str(), "wb");
+#endif
+  if (file == NULL) {
+    Log::Warning("Cannot write binary cache %s, %s will be loaded from text next time", cache_filename.c_str(), filename);
+    return;
+  }
+  fclose(file);
+  dataset->SaveBinaryFile(tmp_filename.c_str(), io_config_.is_compress_binary_file);
+  std::remove(cache_filename.c_str());
+  if (std::rename(tmp_filename.c_str(), cache_filename.c_str()) != 0) {
+    Log::Warning("Cannot rename %s to %s", tmp_filename.c_str(), cache_filename.c_str());
+    std::remove(tmp_filename.c_str());
+    return;
+  }
+  std::ofstream key_file(key_filename);
+  key_file << key << std::endl;
+}
+
 /*! \brief Check can load from binary file */
 bool DatasetLoader::CheckCanLoadFromBin(const char* filename) {
   std::string bin_filename(filename);
@@ -7,8 +7,112 @@
 #include <cstring>
 #include <cstdint>
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LIGHTGBM_HISTOGRAM_AVX2
+#include <immintrin.h>
+#endif
+
 namespace LightGBM {
 
+/*!
+* \brief Check once whether the running CPU supports AVX2 instructions
+* \return True if the AVX2 histogram kernel can be used
+*/
+inline bool IsAVX2Supported() {
+#ifdef LIGHTGBM_HISTOGRAM_AVX2
+  static const bool is_supported = __builtin_cpu_supports("avx2") != 0;
+  return is_supported;
+#else
+  return false;
+#endif
+}
+
+#ifdef LIGHTGBM_HISTOGRAM_AVX2
+/*!
+* \brief Private sub-histograms of the calling thread for the AVX2 kernels, reused by all bins and leaves.
+*        Kernels clear the entries they merge, so the buffer is always cleared between calls
+* \param num_entry Number of entries needed
+* \return Pointer to at least num_entry cleared entries
+*/
+template<typename ENTRY>
+inline ENTRY* ThreadLaneBuffer(size_t num_entry) {
+  static thread_local std::vector<ENTRY> buf;
+  if (buf.size() < num_entry) {
+    buf.resize(num_entry);
+  }
+  return buf.data();
+}
+
+/*!
+* \brief AVX2 version of Bin::ConstructIntHistogram, shared by dense bins of all widths.
+*        The quantized (gradient, hessian) of 8 rows are widened to packed sums at once, and each row is added
+*        to its bin together with its count by one 128-bit add. Like the float kernel of DenseBin, large leaves
+*        spread rows over 4 private sub-histograms (out itself is the first one), which are merged at the end
+* \param num_data Number of data in the leaf
+* \param num_bin Number of bins, or an upper bound of it
+* \param get_bin Function of i, returns the bin of the i-th data in the leaf
+* \param ordered_grad_hess Ordered quantized gradients and hessians, interleaved
+* \param out Output histogram, should be cleared
+*/
+template<typename GET_BIN>
+__attribute__((target("avx2")))
+inline void ConstructIntHistogramAVX2(data_size_t num_data, int num_bin, const GET_BIN& get_bin,
+  const int8_t* ordered_grad_hess, IntHistogramBinEntry* out) {
+  static_assert(sizeof(IntHistogramBinEntry) == 16, "an entry is added by one 128-bit add");
+  const int kNumLanes = 4;
+  const bool use_lanes = num_data >= 2048 && num_bin <= 1024;
+  IntHistogramBinEntry* lane_buf = use_lanes
+    ? ThreadLaneBuffer<IntHistogramBinEntry>(static_cast<size_t>(kNumLanes - 1) * num_bin) : nullptr;
+  IntHistogramBinEntry* lanes[kNumLanes];
+  lanes[0] = out;
+  for (int j = 1; j < kNumLanes; ++j) {
+    lanes[j] = use_lanes ? lane_buf + (j - 1) * num_bin : out;
+  }
+  // the count is in the low half of the second 64 bits
+  const __m128i one = _mm_set_epi64x(1, 1);
+  auto add_row = [one](IntHistogramBinEntry* entry, __m128i packed, bool is_high) {
+    __m128i* ptr = reinterpret_cast<__m128i*>(entry);
+    const __m128i row = is_high ? _mm_unpackhi_epi64(packed, one) : _mm_unpacklo_epi64(packed, one);
+    _mm_storeu_si128(ptr, _mm_add_epi64(_mm_loadu_si128(ptr), row));
+  };
+  data_size_t i = 0;
+  for (; i + 8 <= num_data; i += 8) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ordered_grad_hess + 2 * i));
+    // (g, h) of 4 rows to int32, then swap them to (h, g), which is Pack(g, h) in 64 bits since h >= 0
+    const __m256i rows0123 = _mm256_shuffle_epi32(_mm256_cvtepi8_epi32(bytes), _MM_SHUFFLE(2, 3, 0, 1));
+    const __m256i rows4567 = _mm256_shuffle_epi32(_mm256_cvtepi8_epi32(_mm_srli_si128(bytes, 8)),
+      _MM_SHUFFLE(2, 3, 0, 1));
+    const __m128i rows01 = _mm256_castsi256_si128(rows0123);
+    const __m128i rows23 = _mm256_extracti128_si256(rows0123, 1);
+    const __m128i rows45 = _mm256_castsi256_si128(rows4567);
+    const __m128i rows67 = _mm256_extracti128_si256(rows4567, 1);
+    add_row(lanes[0] + get_bin(i), rows01, false);
+    add_row(lanes[1] + get_bin(i + 1), rows01, true);
+    add_row(lanes[2] + get_bin(i + 2), rows23, false);
+    add_row(lanes[3] + get_bin(i + 3), rows23, true);
+    add_row(lanes[0] + get_bin(i + 4), rows45, false);
+    add_row(lanes[1] + get_bin(i + 5), rows45, true);
+    add_row(lanes[2] + get_bin(i + 6), rows67, false);
+    add_row(lanes[3] + get_bin(i + 7), rows67, true);
+  }
+  for (; i < num_data; ++i) {
+    const uint32_t bin = get_bin(i);
+    out[bin].sum_gradients_hessians += IntHistogramBinEntry::Pack(ordered_grad_hess[2 * i], ordered_grad_hess[2 * i + 1]);
+    ++out[bin].cnt;
+  }
+  if (!use_lanes) { return; }
+  // merge and clear sub-histograms, num_bin may be an upper bound of the bins of out, whose entries beyond are never filled
+  for (int j = 1; j < kNumLanes; ++j) {
+    for (int bin = 0; bin < num_bin; ++bin) {
+      if (lanes[j][bin].cnt == 0) { continue; }
+      out[bin].sum_gradients_hessians += lanes[j][bin].sum_gradients_hessians;
+      out[bin].cnt += lanes[j][bin].cnt;
+      lanes[j][bin] = IntHistogramBinEntry();
+    }
+  }
+}
+#endif
+
 /*!
 * \brief Used to store bins for dense feature
 * Use template to reduce memory cost
@@ -16,18 +120,19 @@ namespace LightGBM {
 template <typename VAL_T>
 class DenseBin: public Bin {
 public:
-  DenseBin(data_size_t num_data, int default_bin)
-    : num_data_(num_data) {
-    data_.resize(num_data_);
+  DenseBin(data_size_t num_data, int num_bin, int default_bin)
+    : num_data_(num_data), num_bin_(num_bin) {
+    data_buf_.resize(num_data_);
     VAL_T default_bin_T = static_cast<VAL_T>(default_bin);
-    std::fill(data_.begin(), data_.end(), default_bin_T);
+    std::fill(data_buf_.begin(), data_buf_.end(), default_bin_T);
+    data_ = data_buf_.data();
   }
 
   ~DenseBin() {
   }
 
   void Push(int, data_size_t idx, uint32_t value) override {
-    data_[idx] = static_cast<VAL_T>(value);
+    data_buf_[idx] = static_cast<VAL_T>(value);
   }
 
   inline uint32_t Get(data_size_t idx) const {
@@ -39,6 +144,31 @@ public:
   void ConstructHistogram(const data_size_t* data_indices, data_size_t num_data,
     const score_t* ordered_gradients, const score_t* ordered_hessians,
     HistogramBinEntry* out) const override {
+#ifdef LIGHTGBM_HISTOGRAM_AVX2
+    // private sub-histograms only pay off for large leaves and small histograms
+    if (num_data >= kMinDataForSIMD && num_bin_ <= kMaxBinForSIMD && IsAVX2Supported()) {
+      if (ordered_hessians == nullptr) {
+        ConstructHistogramAVX2<false, true>(data_indices, num_data, ordered_gradients, nullptr, nullptr, out);
+      } else {
+        ConstructHistogramAVX2<false, false>(data_indices, num_data, ordered_gradients, ordered_hessians, nullptr, out);
+      }
+      return;
+    }
+#endif
+    if (ordered_hessians == nullptr) {
+      ConstructHistogramInner<true>(data_indices, num_data, ordered_gradients, ordered_hessians, out);
+    } else {
+      ConstructHistogramInner<false>(data_indices, num_data, ordered_gradients, ordered_hessians, out);
+    }
+  }
+
+  /*!
+  * \brief Scalar version of ConstructHistogram, if IS_CONSTANT_HESSIAN, hessians are not read and sum_hessians are not filled
+  */
+  template<bool IS_CONSTANT_HESSIAN>
+  void ConstructHistogramInner(const data_size_t* data_indices, data_size_t num_data,
+    const score_t* ordered_gradients, const score_t* ordered_hessians,
+    HistogramBinEntry* out) const {
     // use 4-way unrolling, will be faster
     if (data_indices != nullptr) {  // if use part of data
       data_size_t rest = num_data % 4;
@@ -54,10 +184,12 @@ public:
         out[bin2].sum_gradients += ordered_gradients[i + 2];
         out[bin3].sum_gradients += ordered_gradients[i + 3];
 
-        out[bin0].sum_hessians += ordered_hessians[i];
-        out[bin1].sum_hessians += ordered_hessians[i + 1];
-        out[bin2].sum_hessians += ordered_hessians[i + 2];
-        out[bin3].sum_hessians += ordered_hessians[i + 3];
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin0].sum_hessians += ordered_hessians[i];
+          out[bin1].sum_hessians += ordered_hessians[i + 1];
+          out[bin2].sum_hessians += ordered_hessians[i + 2];
+          out[bin3].sum_hessians += ordered_hessians[i + 3];
+        }
 
         ++out[bin0].cnt;
         ++out[bin1].cnt;
@@ -67,7 +199,9 @@ public:
       for (; i < num_data; ++i) {
         VAL_T bin = data_[data_indices[i]];
         out[bin].sum_gradients += ordered_gradients[i];
-        out[bin].sum_hessians += ordered_hessians[i];
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin].sum_hessians += ordered_hessians[i];
+        }
         ++out[bin].cnt;
       }
     } else {  // use full data
@@ -84,10 +218,12 @@ public:
         out[bin2].sum_gradients += ordered_gradients[i + 2];
         out[bin3].sum_gradients += ordered_gradients[i + 3];
 
-        out[bin0].sum_hessians += ordered_hessians[i];
-        out[bin1].sum_hessians += ordered_hessians[i + 1];
-        out[bin2].sum_hessians += ordered_hessians[i + 2];
-        out[bin3].sum_hessians += ordered_hessians[i + 3];
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin0].sum_hessians += ordered_hessians[i];
+          out[bin1].sum_hessians += ordered_hessians[i + 1];
+          out[bin2].sum_hessians += ordered_hessians[i + 2];
+          out[bin3].sum_hessians += ordered_hessians[i + 3];
+        }
 
         ++out[bin0].cnt;
         ++out[bin1].cnt;
@@ -97,12 +233,182 @@ public:
       for (; i < num_data; ++i) {
         VAL_T bin = data_[i];
         out[bin].sum_gradients += ordered_gradients[i];
-        out[bin].sum_hessians += ordered_hessians[i];
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin].sum_hessians += ordered_hessians[i];
+        }
         ++out[bin].cnt;
       }
     }
   }
 
+#ifdef LIGHTGBM_HISTOGRAM_AVX2
+  /*! \brief Add a (gradient, hessian) pair to one histogram entry, sum_gradients and sum_hessians are adjacent */
+  __attribute__((target("avx2")))
+  static inline void AddPair(HistogramBinEntry* entry, __m128d pair) {
+    double* sums = &entry->sum_gradients;
+    _mm_storeu_pd(sums, _mm_add_pd(_mm_loadu_pd(sums), pair));
+    ++entry->cnt;
+  }
+
+  /*!
+  * \brief AVX2 version of ConstructHistogram.
+  *        Gradients and hessians of 8 rows are converted to (gradient, hessian) double pairs at once,
+  *        and each pair is added to its bin by one packed add. Rows are spread over kNumLanes
+  *        private sub-histograms (out itself is the first one), so consecutive rows in the same bin
+  *        don't wait on each other. Sub-histograms are merged into out at the end.
+  *        If IS_BF16, gradients and hessians are read from the packed values of BF16GradHess instead.
+  *        If IS_CONSTANT_HESSIAN, hessians are not read and sum_hessians are not filled
+  */
+  template<bool IS_BF16, bool IS_CONSTANT_HESSIAN>
+  __attribute__((target("avx2")))
+  void ConstructHistogramAVX2(const data_size_t* data_indices, data_size_t num_data,
+    const score_t* ordered_gradients, const score_t* ordered_hessians,
+    const uint32_t* ordered_grad_hess, HistogramBinEntry* out) const {
+    static_assert(kNumLanes == 4, "the unrolled loop below assumes 4 lanes");
+    HistogramBinEntry* lane_buf = ThreadLaneBuffer<HistogramBinEntry>(static_cast<size_t>(kNumLanes - 1) * num_bin_);
+    HistogramBinEntry* lanes[kNumLanes];
+    lanes[0] = out;
+    for (int j = 1; j < kNumLanes; ++j) {
+      lanes[j] = lane_buf + (j - 1) * num_bin_;
+    }
+    data_size_t i = 0;
+    for (; i + 8 <= num_data; i += 8) {
+      __m256 grad, hess;
+      if (IS_BF16) {
+        // bfloat16 to float is a shift for the low half and a mask for the high half
+        const __m256i packed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ordered_grad_hess + i));
+        grad = _mm256_castsi256_ps(_mm256_slli_epi32(packed, 16));
+        hess = _mm256_castsi256_ps(_mm256_and_si256(packed, _mm256_set1_epi32(static_cast<int>(0xffff0000u))));
+      } else {
+        grad = _mm256_loadu_ps(ordered_gradients + i);
+        hess = IS_CONSTANT_HESSIAN ? _mm256_setzero_ps() : _mm256_loadu_ps(ordered_hessians + i);
+      }
+      // (g0, h0, g1, h1 | g4, h4, g5, h5) and (g2, h2, g3, h3 | g6, h6, g7, h7)
+      const __m256 lo = _mm256_unpacklo_ps(grad, hess);
+      const __m256 hi = _mm256_unpackhi_ps(grad, hess);
+      const __m256d pair01 = _mm256_cvtps_pd(_mm256_castps256_ps128(lo));
+      const __m256d pair23 = _mm256_cvtps_pd(_mm256_castps256_ps128(hi));
+      const __m256d pair45 = _mm256_cvtps_pd(_mm256_extractf128_ps(lo, 1));
+      const __m256d pair67 = _mm256_cvtps_pd(_mm256_extractf128_ps(hi, 1));
+      if (data_indices != nullptr) {
+        const data_size_t* cur_indices = data_indices + i;
+        AddPair(lanes[0] + data_[cur_indices[0]], _mm256_castpd256_pd128(pair01));
+        AddPair(lanes[1] + data_[cur_indices[1]], _mm256_extractf128_pd(pair01, 1));
+        AddPair(lanes[2] + data_[cur_indices[2]], _mm256_castpd256_pd128(pair23));
+        AddPair(lanes[3] + data_[cur_indices[3]], _mm256_extractf128_pd(pair23, 1));
+        AddPair(lanes[0] + data_[cur_indices[4]], _mm256_castpd256_pd128(pair45));
+        AddPair(lanes[1] + data_[cur_indices[5]], _mm256_extractf128_pd(pair45, 1));
+        AddPair(lanes[2] + data_[cur_indices[6]], _mm256_castpd256_pd128(pair67));
+        AddPair(lanes[3] + data_[cur_indices[7]], _mm256_extractf128_pd(pair67, 1));
+      } else {
+        const VAL_T* cur_data = data_ + i;
+        AddPair(lanes[0] + cur_data[0], _mm256_castpd256_pd128(pair01));
+        AddPair(lanes[1] + cur_data[1], _mm256_extractf128_pd(pair01, 1));
+        AddPair(lanes[2] + cur_data[2], _mm256_castpd256_pd128(pair23));
+        AddPair(lanes[3] + cur_data[3], _mm256_extractf128_pd(pair23, 1));
+        AddPair(lanes[0] + cur_data[4], _mm256_castpd256_pd128(pair45));
+        AddPair(lanes[1] + cur_data[5], _mm256_extractf128_pd(pair45, 1));
+        AddPair(lanes[2] + cur_data[6], _mm256_castpd256_pd128(pair67));
+        AddPair(lanes[3] + cur_data[7], _mm256_extractf128_pd(pair67, 1));
+      }
+    }
+    for (; i < num_data; ++i) {
+      const VAL_T bin = data_indices != nullptr ? data_[data_indices[i]] : data_[i];
+      if (IS_BF16) {
+        out[bin].sum_gradients += BF16GradHess::Gradient(ordered_grad_hess[i]);
+        out[bin].sum_hessians += BF16GradHess::Hessian(ordered_grad_hess[i]);
+      } else {
+        out[bin].sum_gradients += ordered_gradients[i];
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin].sum_hessians += ordered_hessians[i];
+        }
+      }
+      ++out[bin].cnt;
+    }
+    // merge and clear sub-histograms
+    for (int j = 1; j < kNumLanes; ++j) {
+      for (int bin = 0; bin < num_bin_; ++bin) {
+        out[bin].sum_gradients += lanes[j][bin].sum_gradients;
+        out[bin].sum_hessians += lanes[j][bin].sum_hessians;
+        out[bin].cnt += lanes[j][bin].cnt;
+        lanes[j][bin] = HistogramBinEntry();
+      }
+    }
+  }
+#endif
+
+  void ConstructIntHistogram(const data_size_t* data_indices, data_size_t num_data,
+    const int8_t* ordered_grad_hess, IntHistogramBinEntry* out) const override {
+#ifdef LIGHTGBM_HISTOGRAM_AVX2
+    if (IsAVX2Supported()) {
+      const VAL_T* data = data_;
+      if (data_indices != nullptr) {
+        ConstructIntHistogramAVX2(num_data, num_bin_, [data, data_indices](data_size_t i) {
+          return static_cast<uint32_t>(data[data_indices[i]]);
+        }, ordered_grad_hess, out);
+      } else {
+        ConstructIntHistogramAVX2(num_data, num_bin_, [data](data_size_t i) {
+          return static_cast<uint32_t>(data[i]);
+        }, ordered_grad_hess, out);
+      }
+      return;
+    }
+#endif
+    if (data_indices != nullptr) {  // if use part of data
+      for (data_size_t i = 0; i < num_data; ++i) {
+        const uint32_t bin = data_[data_indices[i]];
+        out[bin].sum_gradients_hessians += IntHistogramBinEntry::Pack(ordered_grad_hess[2 * i], ordered_grad_hess[2 * i + 1]);
+        ++out[bin].cnt;
+      }
+    } else {  // use full data
+      for (data_size_t i = 0; i < num_data; ++i) {
+        const uint32_t bin = data_[i];
+        out[bin].sum_gradients_hessians += IntHistogramBinEntry::Pack(ordered_grad_hess[2 * i], ordered_grad_hess[2 * i + 1]);
+        ++out[bin].cnt;
+      }
+    }
+  }
+
+  void ConstructBF16Histogram(const data_size_t* data_indices, data_size_t num_data,
+    const uint32_t* ordered_grad_hess, HistogramBinEntry* out) const override {
+#ifdef LIGHTGBM_HISTOGRAM_AVX2
+    if (num_data >= kMinDataForSIMD && num_bin_ <= kMaxBinForSIMD && IsAVX2Supported()) {
+      ConstructHistogramAVX2<true, false>(data_indices, num_data, nullptr, nullptr, ordered_grad_hess, out);
+      return;
+    }
+#endif
+    if (data_indices != nullptr) {  // if use part of data
+      for (data_size_t i = 0; i < num_data; ++i) {
+        const VAL_T bin = data_[data_indices[i]];
+        out[bin].sum_gradients += BF16GradHess::Gradient(ordered_grad_hess[i]);
+        out[bin].sum_hessians += BF16GradHess::Hessian(ordered_grad_hess[i]);
+        ++out[bin].cnt;
+      }
+    } else {  // use full data
+      for (data_size_t i = 0; i < num_data; ++i) {
+        const VAL_T bin = data_[i];
+        out[bin].sum_gradients += BF16GradHess::Gradient(ordered_grad_hess[i]);
+        out[bin].sum_hessians += BF16GradHess::Hessian(ordered_grad_hess[i]);
+        ++out[bin].cnt;
+      }
+    }
+  }
+
+  void ConstructHistogramForLeaves(const int8_t* data_slot, data_size_t num_data,
+    const score_t* gradients, const score_t* hessians,
+    HistogramBinEntry** out) const override {
+    for (data_size_t i = 0; i < num_data; ++i) {
+      const int slot = data_slot[i];
+      if (slot < 0) { continue; }
+      HistogramBinEntry& entry = out[slot][data_[i]];
+      entry.sum_gradients += gradients[i];
+      if (hessians != nullptr) {
+        entry.sum_hessians += hessians[i];
+      }
+      ++entry.cnt;
+    }
+  }
+
   data_size_t Split(unsigned int threshold, data_size_t* data_indices, data_size_t num_data,
     data_size_t* lte_indices, data_size_t* gt_indices) const override {
     data_size_t lte_count = 0;
@@ -124,21 +430,45 @@ public:
 
   void FinishLoad() override {}
 
+  void Append(data_size_t num_new_data, uint32_t default_bin) override {
+    if (data_ != data_buf_.data()) {
+      // bins referenced from outside memory are copied before they are extended
+      data_buf_.assign(data_, data_ + num_data_);
+    }
+    num_data_ += num_new_data;
+    data_buf_.resize(num_data_, static_cast<VAL_T>(default_bin));
+    data_ = data_buf_.data();
+  }
+
   void LoadFromMemory(const void* memory, const std::vector<data_size_t>& local_used_indices) override {
     const VAL_T* mem_data = reinterpret_cast<const VAL_T*>(memory);
+    data_buf_.resize(num_data_);
+    data_ = data_buf_.data();
     if (local_used_indices.size() > 0) {
       for (int i = 0; i < num_data_; ++i) {
-        data_[i] = mem_data[local_used_indices[i]];
+        data_buf_[i] = mem_data[local_used_indices[i]];
       }
     } else {
       for (int i = 0; i < num_data_; ++i) {
-        data_[i] = mem_data[i];
+        data_buf_[i] = mem_data[i];
       }
     }
   }
 
+  bool ReferenceMemory(const void* memory) override {
+    if (reinterpret_cast<uintptr_t>(memory) % sizeof(VAL_T) != 0) { return false; }
+    data_buf_.clear();
+    data_buf_.shrink_to_fit();
+    data_ = reinterpret_cast<const VAL_T*>(memory);
+    return true;
+  }
+
   void SaveBinaryToFile(FILE* file) const override {
-    fwrite(data_.data(), sizeof(VAL_T), num_data_, file);
+    fwrite(data_, sizeof(VAL_T), num_data_, file);
+  }
+
+  void CopyTo(char* buffer) const override {
+    std::memcpy(buffer, data_, sizeof(VAL_T) * num_data_);
   }
 
   size_t SizesInByte() const override {
@@ -146,8 +476,19 @@ public:
   }
 
 private:
+  /*! \brief Number of private sub-histograms used by the SIMD kernel */
+  static const int kNumLanes = 4;
+  /*! \brief Use the SIMD kernel only when there is enough data to amortize the merge */
+  static const data_size_t kMinDataForSIMD = 2048;
+  /*! \brief Use the SIMD kernel only when the sub-histograms stay in cache */
+  static const int kMaxBinForSIMD = 1024;
+
   data_size_t num_data_;
-  std::vector<VAL_T> data_;
+  int num_bin_;
+  /*! \brief Owned bins, empty if the bins are referenced from outside memory */
+  std::vector<VAL_T> data_buf_;
+  /*! \brief Bins of all data */
+  const VAL_T* data_;
 };
 
 template <typename VAL_T>
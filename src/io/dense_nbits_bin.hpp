@@ -0,0 +1,300 @@
+#ifndef LIGHTGBM_IO_DENSE_NBITS_BIN_HPP_
+#define LIGHTGBM_IO_DENSE_NBITS_BIN_HPP_
+
+#include <LightGBM/bin.h>
+
+#include "dense_bin.hpp"
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+namespace LightGBM {
+
+/*!
+* \brief Used to store bins for dense feature with at most 16 bins.
+*        Two bins are packed into one byte, the lower 4 bits hold the even row.
+*/
+class DenseBin4bit: public Bin {
+public:
+  /*! \brief Max number of bins that can be stored in 4 bits */
+  static const int kMaxNumBin = 16;
+
+  DenseBin4bit(data_size_t num_data, int default_bin)
+    : num_data_(num_data) {
+    const uint8_t default_bin_T = static_cast<uint8_t>(default_bin);
+    data_buf_.resize((num_data_ + 1) / 2, static_cast<uint8_t>((default_bin_T << 4) | default_bin_T));
+    data_ = data_buf_.data();
+    // rows sharing one byte may be pushed by different threads, so use one byte per row until FinishLoad
+    buf_.resize(data_buf_.size() * 2, default_bin_T);
+  }
+
+  ~DenseBin4bit() {
+  }
+
+  void Push(int, data_size_t idx, uint32_t value) override {
+    buf_[idx] = static_cast<uint8_t>(value);
+  }
+
+  inline uint32_t Get(data_size_t idx) const {
+    return (data_[idx >> 1] >> ((idx & 1) << 2)) & 0xf;
+  }
+
+  BinIterator* GetIterator(data_size_t start_idx) const override;
+
+  void ConstructHistogram(const data_size_t* data_indices, data_size_t num_data,
+    const score_t* ordered_gradients, const score_t* ordered_hessians,
+    HistogramBinEntry* out) const override {
+    if (ordered_hessians == nullptr) {
+      ConstructHistogramInner<true>(data_indices, num_data, ordered_gradients, ordered_hessians, out);
+    } else {
+      ConstructHistogramInner<false>(data_indices, num_data, ordered_gradients, ordered_hessians, out);
+    }
+  }
+
+  /*!
+  * \brief Implementation of ConstructHistogram, if IS_CONSTANT_HESSIAN, hessians are not read and sum_hessians are not filled
+  */
+  template<bool IS_CONSTANT_HESSIAN>
+  void ConstructHistogramInner(const data_size_t* data_indices, data_size_t num_data,
+    const score_t* ordered_gradients, const score_t* ordered_hessians,
+    HistogramBinEntry* out) const {
+    if (data_indices != nullptr) {  // if use part of data
+      // use 4-way unrolling, will be faster
+      data_size_t rest = num_data % 4;
+      data_size_t i = 0;
+      for (; i < num_data - rest; i += 4) {
+        const uint32_t bin0 = Get(data_indices[i]);
+        const uint32_t bin1 = Get(data_indices[i + 1]);
+        const uint32_t bin2 = Get(data_indices[i + 2]);
+        const uint32_t bin3 = Get(data_indices[i + 3]);
+
+        out[bin0].sum_gradients += ordered_gradients[i];
+        out[bin1].sum_gradients += ordered_gradients[i + 1];
+        out[bin2].sum_gradients += ordered_gradients[i + 2];
+        out[bin3].sum_gradients += ordered_gradients[i + 3];
+
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin0].sum_hessians += ordered_hessians[i];
+          out[bin1].sum_hessians += ordered_hessians[i + 1];
+          out[bin2].sum_hessians += ordered_hessians[i + 2];
+          out[bin3].sum_hessians += ordered_hessians[i + 3];
+        }
+
+        ++out[bin0].cnt;
+        ++out[bin1].cnt;
+        ++out[bin2].cnt;
+        ++out[bin3].cnt;
+      }
+      for (; i < num_data; ++i) {
+        const uint32_t bin = Get(data_indices[i]);
+        out[bin].sum_gradients += ordered_gradients[i];
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin].sum_hessians += ordered_hessians[i];
+        }
+        ++out[bin].cnt;
+      }
+    } else {  // use full data, unpack two rows from each byte
+      data_size_t i = 0;
+      for (; i + 1 < num_data; i += 2) {
+        const uint8_t byte = data_[i >> 1];
+        const uint32_t bin0 = byte & 0xf;
+        const uint32_t bin1 = byte >> 4;
+
+        out[bin0].sum_gradients += ordered_gradients[i];
+        out[bin1].sum_gradients += ordered_gradients[i + 1];
+
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin0].sum_hessians += ordered_hessians[i];
+          out[bin1].sum_hessians += ordered_hessians[i + 1];
+        }
+
+        ++out[bin0].cnt;
+        ++out[bin1].cnt;
+      }
+      if (i < num_data) {
+        const uint32_t bin = Get(i);
+        out[bin].sum_gradients += ordered_gradients[i];
+        if (!IS_CONSTANT_HESSIAN) {
+          out[bin].sum_hessians += ordered_hessians[i];
+        }
+        ++out[bin].cnt;
+      }
+    }
+  }
+
+  void ConstructIntHistogram(const data_size_t* data_indices, data_size_t num_data,
+    const int8_t* ordered_grad_hess, IntHistogramBinEntry* out) const override {
+#ifdef LIGHTGBM_HISTOGRAM_AVX2
+    if (IsAVX2Supported()) {
+      if (data_indices != nullptr) {
+        ConstructIntHistogramAVX2(num_data, kMaxNumBin, [this, data_indices](data_size_t i) {
+          return Get(data_indices[i]);
+        }, ordered_grad_hess, out);
+      } else {
+        ConstructIntHistogramAVX2(num_data, kMaxNumBin, [this](data_size_t i) {
+          return Get(i);
+        }, ordered_grad_hess, out);
+      }
+      return;
+    }
+#endif
+    if (data_indices != nullptr) {  // if use part of data
+      for (data_size_t i = 0; i < num_data; ++i) {
+        const uint32_t bin = Get(data_indices[i]);
+        out[bin].sum_gradients_hessians += IntHistogramBinEntry::Pack(ordered_grad_hess[2 * i], ordered_grad_hess[2 * i + 1]);
+        ++out[bin].cnt;
+      }
+    } else {  // use full data
+      for (data_size_t i = 0; i < num_data; ++i) {
+        const uint32_t bin = Get(i);
+        out[bin].sum_gradients_hessians += IntHistogramBinEntry::Pack(ordered_grad_hess[2 * i], ordered_grad_hess[2 * i + 1]);
+        ++out[bin].cnt;
+      }
+    }
+  }
+
+  void ConstructBF16Histogram(const data_size_t* data_indices, data_size_t num_data,
+    const uint32_t* ordered_grad_hess, HistogramBinEntry* out) const override {
+    if (data_indices != nullptr) {  // if use part of data
+      for (data_size_t i = 0; i < num_data; ++i) {
+        const uint32_t bin = Get(data_indices[i]);
+        out[bin].sum_gradients += BF16GradHess::Gradient(ordered_grad_hess[i]);
+        out[bin].sum_hessians += BF16GradHess::Hessian(ordered_grad_hess[i]);
+        ++out[bin].cnt;
+      }
+    } else {  // use full data
+      for (data_size_t i = 0; i < num_data; ++i) {
+        const uint32_t bin = Get(i);
+        out[bin].sum_gradients += BF16GradHess::Gradient(ordered_grad_hess[i]);
+        out[bin].sum_hessians += BF16GradHess::Hessian(ordered_grad_hess[i]);
+        ++out[bin].cnt;
+      }
+    }
+  }
+
+  void ConstructHistogramForLeaves(const int8_t* data_slot, data_size_t num_data,
+    const score_t* gradients, const score_t* hessians,
+    HistogramBinEntry** out) const override {
+    for (data_size_t i = 0; i < num_data; ++i) {
+      const int slot = data_slot[i];
+      if (slot < 0) { continue; }
+      HistogramBinEntry& entry = out[slot][Get(i)];
+      entry.sum_gradients += gradients[i];
+      if (hessians != nullptr) {
+        entry.sum_hessians += hessians[i];
+      }
+      ++entry.cnt;
+    }
+  }
+
+  data_size_t Split(unsigned int threshold, data_size_t* data_indices, data_size_t num_data,
+    data_size_t* lte_indices, data_size_t* gt_indices) const override {
+    data_size_t lte_count = 0;
+    data_size_t gt_count = 0;
+    for (data_size_t i = 0; i < num_data; ++i) {
+      data_size_t idx = data_indices[i];
+      if (Get(idx) > threshold) {
+        gt_indices[gt_count++] = idx;
+      } else {
+        lte_indices[lte_count++] = idx;
+      }
+    }
+    return lte_count;
+  }
+  data_size_t num_data() const override { return num_data_; }
+
+  /*! \brief not ordered bin for dense feature */
+  OrderedBin* CreateOrderedBin() const override { return nullptr; }
+
+  void FinishLoad() override {
+    if (buf_.empty()) { return; }
+    const data_size_t num_bytes = static_cast<data_size_t>(data_buf_.size());
+    #pragma omp parallel for schedule(static)
+    for (data_size_t i = 0; i < num_bytes; ++i) {
+      data_buf_[i] = static_cast<uint8_t>((buf_[i * 2 + 1] << 4) | buf_[i * 2]);
+    }
+    buf_.clear();
+    buf_.shrink_to_fit();
+  }
+
+  void Append(data_size_t num_new_data, uint32_t default_bin) override {
+    // unpack the old rows, since the new rows may share the last byte with them
+    const data_size_t num_data = num_data_ + num_new_data;
+    std::vector<uint8_t> buf(static_cast<size_t>((num_data + 1) / 2) * 2, static_cast<uint8_t>(default_bin));
+    for (data_size_t i = 0; i < num_data_; ++i) {
+      buf[i] = static_cast<uint8_t>(Get(i));
+    }
+    data_buf_.resize((num_data + 1) / 2);
+    data_ = data_buf_.data();
+    buf_.swap(buf);
+    num_data_ = num_data;
+  }
+
+  void LoadFromMemory(const void* memory, const std::vector<data_size_t>& local_used_indices) override {
+    buf_.clear();
+    buf_.shrink_to_fit();
+    const uint8_t* mem_data = reinterpret_cast<const uint8_t*>(memory);
+    data_buf_.resize((num_data_ + 1) / 2);
+    data_ = data_buf_.data();
+    if (local_used_indices.size() > 0) {
+      std::fill(data_buf_.begin(), data_buf_.end(), static_cast<uint8_t>(0));
+      for (data_size_t i = 0; i < num_data_; ++i) {
+        const data_size_t j = local_used_indices[i];
+        const uint8_t bin = (mem_data[j >> 1] >> ((j & 1) << 2)) & 0xf;
+        data_buf_[i >> 1] |= static_cast<uint8_t>(bin << ((i & 1) << 2));
+      }
+    } else {
+      std::memcpy(data_buf_.data(), mem_data, data_buf_.size());
+    }
+  }
+
+  bool ReferenceMemory(const void* memory) override {
+    buf_.clear();
+    buf_.shrink_to_fit();
+    data_buf_.clear();
+    data_buf_.shrink_to_fit();
+    data_ = reinterpret_cast<const uint8_t*>(memory);
+    return true;
+  }
+
+  void SaveBinaryToFile(FILE* file) const override {
+    fwrite(data_, sizeof(uint8_t), (num_data_ + 1) / 2, file);
+  }
+
+  void CopyTo(char* buffer) const override {
+    std::memcpy(buffer, data_, sizeof(uint8_t) * ((num_data_ + 1) / 2));
+  }
+
+  size_t SizesInByte() const override {
+    return sizeof(uint8_t) * ((num_data_ + 1) / 2);
+  }
+
+private:
+  data_size_t num_data_;
+  /*! \brief Owned packed bins, empty if the bins are referenced from outside memory */
+  std::vector<uint8_t> data_buf_;
+  /*! \brief Packed bins, two rows per byte */
+  const uint8_t* data_;
+  /*! \brief One byte per row, only used while pushing data */
+  std::vector<uint8_t> buf_;
+};
+
+class DenseBin4bitIterator: public BinIterator {
+public:
+  explicit DenseBin4bitIterator(const DenseBin4bit* bin_data)
+    : bin_data_(bin_data) {
+  }
+  uint32_t Get(data_size_t idx) override {
+    return bin_data_->Get(idx);
+  }
+private:
+  const DenseBin4bit* bin_data_;
+};
+
+inline BinIterator* DenseBin4bit::GetIterator(data_size_t) const {
+  return new DenseBin4bitIterator(this);
+}
+
+}  // namespace LightGBM
+#endif   // LightGBM_IO_DENSE_NBITS_BIN_HPP_
@@ -2,6 +2,7 @@
 
 #include <LightGBM/utils/common.h>
 
+#include <algorithm>
 #include <vector>
 #include <string>
 
@@ -207,6 +208,41 @@ void Metadata::SetInitScore(const float* init_score, data_size_t len) {
   }
 }
 
+void Metadata::Append(const Metadata& other) {
+  if (weights_.empty() != other.weights_.empty() || query_boundaries_.empty() != other.query_boundaries_.empty()
+    || init_score_.empty() != other.init_score_.empty() || num_class_ != other.num_class_) {
+    Log::Fatal("Cannot append data with different weights, queries or initial scores");
+  }
+  const data_size_t num_data = num_data_ + other.num_data_;
+  label_.insert(label_.end(), other.label_.begin(), other.label_.end());
+  if (!weights_.empty()) {
+    weights_.insert(weights_.end(), other.weights_.begin(), other.weights_.end());
+    num_weights_ = num_data;
+  }
+  if (!query_boundaries_.empty()) {
+    for (data_size_t i = 1; i <= other.num_queries_; ++i) {
+      query_boundaries_.push_back(num_data_ + other.query_boundaries_[i]);
+    }
+    num_queries_ += other.num_queries_;
+  }
+  if (!init_score_.empty()) {
+    // scores are stored class by class
+    std::vector<float> init_score(static_cast<size_t>(num_data) * num_class_);
+    for (int k = 0; k < num_class_; ++k) {
+      std::copy(init_score_.begin() + static_cast<size_t>(k) * num_data_,
+        init_score_.begin() + static_cast<size_t>(k + 1) * num_data_,
+        init_score.begin() + static_cast<size_t>(k) * num_data);
+      std::copy(other.init_score_.begin() + static_cast<size_t>(k) * other.num_data_,
+        other.init_score_.begin() + static_cast<size_t>(k + 1) * other.num_data_,
+        init_score.begin() + static_cast<size_t>(k) * num_data + num_data_);
+    }
+    init_score_.swap(init_score);
+    num_init_score_ = num_data;
+  }
+  num_data_ = num_data;
+  LoadQueryWeights();
+}
+
 void Metadata::SetLabel(const float* label, data_size_t len) {
   if (num_data_ != len) {
     Log::Fatal("len of label is not same with #data");
@@ -342,8 +378,9 @@ void Metadata::LoadQueryWeights() {
   }
 }
 
-void Metadata::LoadFromMemory(const void* memory) {
+void Metadata::LoadFromMemory(const void* memory, int num_class) {
   const char* mem_ptr = reinterpret_cast<const char*>(memory);
+  num_class_ = num_class;
 
   num_data_ = *(reinterpret_cast<const data_size_t*>(mem_ptr));
   mem_ptr += sizeof(num_data_);
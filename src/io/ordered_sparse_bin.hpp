@@ -45,10 +45,18 @@ public:
   ~OrderedSparseBin() {
   }
 
+  size_t SizesInByte() const override {
+    return sizeof(SparsePair) * (ordered_pair_.capacity() + cached_pair_.capacity())
+      + sizeof(data_size_t) * (leaf_start_.capacity() + leaf_cnt_.capacity());
+  }
+
+  data_size_t NumNonZeros() const override {
+    return static_cast<data_size_t>(ordered_pair_.size());
+  }
+
   void Init(const char* used_idices, int num_leaves) override {
-    // initialize the leaf information
-    leaf_start_ = std::vector<data_size_t>(num_leaves, 0);
-    leaf_cnt_ = std::vector<data_size_t>(num_leaves, 0);
+    // initialize the leaf information, buffers are reused between trees
+    ResetLeaves(num_leaves);
     if (used_idices == nullptr) {
       // if using all data, copy all non-zero pair
       data_size_t j = 0;
@@ -66,18 +74,40 @@ public:
       data_size_t cur_pos = 0;
       data_size_t i_delta = -1;
       while (bin_data_->NextNonzero(&i_delta, &cur_pos)) {
-        if (used_idices[cur_pos]) {
-          ordered_pair_[j].ridx = cur_pos;
-          ordered_pair_[j].bin = bin_data_->vals_[i_delta];
-          ++j;
-        }
+        // always write and only keep the used ones, bags are random so a branch is mispredicted half the time
+        ordered_pair_[j].ridx = cur_pos;
+        ordered_pair_[j].bin = bin_data_->vals_[i_delta];
+        j += used_idices[cur_pos] != 0;
       }
       leaf_cnt_[0] = j;
     }
   }
 
+  void CacheUsedData() override {
+    cached_pair_.assign(ordered_pair_.begin(), ordered_pair_.begin() + leaf_cnt_[0]);
+  }
+
+  void InitFromCache(int num_leaves) override {
+    ResetLeaves(num_leaves);
+    std::copy(cached_pair_.begin(), cached_pair_.end(), ordered_pair_.begin());
+    leaf_cnt_[0] = static_cast<data_size_t>(cached_pair_.size());
+  }
+
   void ConstructHistogram(int leaf, const score_t* gradient, const score_t* hessian,
     HistogramBinEntry* out) const override {
+    if (hessian == nullptr) {
+      ConstructHistogramInner<true>(leaf, gradient, hessian, out);
+    } else {
+      ConstructHistogramInner<false>(leaf, gradient, hessian, out);
+    }
+  }
+
+  /*!
+  * \brief Implementation of ConstructHistogram, if IS_CONSTANT_HESSIAN, hessians are not read and sum_hessians are not filled
+  */
+  template<bool IS_CONSTANT_HESSIAN>
+  void ConstructHistogramInner(int leaf, const score_t* gradient, const score_t* hessian,
+    HistogramBinEntry* out) const {
     // get current leaf boundary
     const data_size_t start = leaf_start_[leaf];
     const data_size_t end = start + leaf_cnt_[leaf];
@@ -86,7 +116,9 @@ public:
       const VAL_T bin = ordered_pair_[i].bin;
       const data_size_t idx = ordered_pair_[i].ridx;
       out[bin].sum_gradients += gradient[idx];
-      out[bin].sum_hessians += hessian[idx];
+      if (!IS_CONSTANT_HESSIAN) {
+        out[bin].sum_hessians += hessian[idx];
+      }
       ++out[bin].cnt;
     }
   }
@@ -110,15 +142,35 @@ public:
     leaf_cnt_[right_leaf] = l_end - new_left_end;
   }
 
+  void GetLeafNonZeros(int leaf, std::vector<data_size_t>* out_indices,
+    std::vector<uint32_t>* out_bins) const override {
+    const data_size_t start = leaf_start_[leaf];
+    const data_size_t end = start + leaf_cnt_[leaf];
+    out_indices->resize(end - start);
+    out_bins->resize(end - start);
+    for (data_size_t i = start; i < end; ++i) {
+      (*out_indices)[i - start] = ordered_pair_[i].ridx;
+      (*out_bins)[i - start] = ordered_pair_[i].bin;
+    }
+  }
+
   /*! \brief Disable copy */
   OrderedSparseBin<VAL_T>& operator=(const OrderedSparseBin<VAL_T>&) = delete;
   /*! \brief Disable copy */
   OrderedSparseBin<VAL_T>(const OrderedSparseBin<VAL_T>&) = delete;
 
 private:
+  /*! \brief Put all data into leaf 0, without reallocation if the number of leaves is not changed */
+  void ResetLeaves(int num_leaves) {
+    leaf_start_.assign(num_leaves, 0);
+    leaf_cnt_.assign(num_leaves, 0);
+  }
+
   const SparseBin<VAL_T>* bin_data_;
   /*! \brief Store non-zero pair , group by leaf */
   std::vector<SparsePair> ordered_pair_;
+  /*! \brief Used non-zero pairs cached by CacheUsedData, in the order of data */
+  std::vector<SparsePair> cached_pair_;
   /*! \brief leaf_start_[i] means data in i-th leaf start from */
   std::vector<data_size_t> leaf_start_;
   /*! \brief leaf_cnt_[i] means number of data in i-th leaf */
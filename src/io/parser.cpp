@@ -69,29 +69,14 @@ enum DataType {
   LIBSVM
 };
 
-Parser* Parser::CreateParser(const char* filename, bool has_header, int num_features, int label_idx) {
-  std::ifstream tmp_file;
-  tmp_file.open(filename);
-  if (!tmp_file.is_open()) {
-    Log::Fatal("Data file %s doesn't exist'", filename);
-  }
-  std::string line1, line2;
-  if (has_header) {
-    if (!tmp_file.eof()) {
-      std::getline(tmp_file, line1);
-    }
-  }
-  if (!tmp_file.eof()) {
-    std::getline(tmp_file, line1);
-  } else {
-    Log::Fatal("Data file %s should have at least one line", filename);
-  }
-  if (!tmp_file.eof()) {
-    std::getline(tmp_file, line2);
-  } else {
-    Log::Warning("Data file %s only has one line", filename);
-  }
-  tmp_file.close();
+/*!
+* \brief Create a parser by the format of the first two lines of data
+* \param line1 First line
+* \param line2 Second line, empty if there is only one line
+* \param num_features Number of features, <= 0 means don't know
+* \param label_idx Index of label column, set to -1 if the lines don't contain a label column
+*/
+Parser* CreateParserByLines(std::string line1, const std::string& line2, int num_features, int* label_idx) {
   int comma_cnt = 0, comma_cnt2 = 0;
   int tab_cnt = 0, tab_cnt2 = 0;
   int colon_cnt = 0, colon_cnt2 = 0;
@@ -125,22 +110,53 @@ Parser* Parser::CreateParser(const char* filename, bool has_header, int num_feat
   }
   std::unique_ptr<Parser> ret;
   if (type == DataType::LIBSVM) {
-    label_idx = GetLabelIdxForLibsvm(line1, num_features, label_idx);
-    ret.reset(new LibSVMParser(label_idx));
+    *label_idx = GetLabelIdxForLibsvm(line1, num_features, *label_idx);
+    ret.reset(new LibSVMParser(*label_idx));
   }
   else if (type == DataType::TSV) {
-    label_idx = GetLabelIdxForTSV(line1, num_features, label_idx);
-    ret.reset(new TSVParser(label_idx));
+    *label_idx = GetLabelIdxForTSV(line1, num_features, *label_idx);
+    ret.reset(new TSVParser(*label_idx));
   }
   else if (type == DataType::CSV) {
-    label_idx = GetLabelIdxForCSV(line1, num_features, label_idx);
-    ret.reset(new CSVParser(label_idx));
+    *label_idx = GetLabelIdxForCSV(line1, num_features, *label_idx);
+    ret.reset(new CSVParser(*label_idx));
   }
 
+  return ret.release();
+}
+
+Parser* Parser::CreateParser(const char* filename, bool has_header, int num_features, int label_idx) {
+  std::ifstream tmp_file;
+  tmp_file.open(filename);
+  if (!tmp_file.is_open()) {
+    Log::Fatal("Data file %s doesn't exist'", filename);
+  }
+  std::string line1, line2;
+  if (has_header) {
+    if (!tmp_file.eof()) {
+      std::getline(tmp_file, line1);
+    }
+  }
+  if (!tmp_file.eof()) {
+    std::getline(tmp_file, line1);
+  } else {
+    Log::Fatal("Data file %s should have at least one line", filename);
+  }
+  if (!tmp_file.eof()) {
+    std::getline(tmp_file, line2);
+  } else {
+    Log::Warning("Data file %s only has one line", filename);
+  }
+  tmp_file.close();
+  std::unique_ptr<Parser> ret(CreateParserByLines(line1, line2, num_features, &label_idx));
   if (label_idx < 0) {
     Log::Info("Data file %s doesn't contain a label column", filename);
   }
   return ret.release();
 }
 
+Parser* Parser::CreateParserForLine(const char* line, int num_features, int label_idx) {
+  return CreateParserByLines(line, std::string(), num_features, &label_idx);
+}
+
 }  // namespace LightGBM
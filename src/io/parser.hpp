@@ -6,6 +6,7 @@
 
 #include <LightGBM/dataset.h>
 
+#include <algorithm>
 #include <unordered_map>
 #include <vector>
 #include <utility>
@@ -19,6 +20,30 @@ public:
   }
   inline void ParseOneLine(const char* str,
     std::vector<std::pair<int, double>>* out_features, double* out_label) const override {
+    ParseColumns(str, out_label, [out_features](int idx, double val) {
+      if (fabs(val) > 1e-10) {
+        out_features->emplace_back(idx, val);
+      }
+    });
+  }
+  inline void ParseOneLine(const char* str, int num_features, double* out_values, double* out_label) const override {
+    const int num_columns = ParseColumns(str, out_label, [num_features, out_values](int idx, double val) {
+      if (idx < num_features) {
+        out_values[idx] = fabs(val) > 1e-10 ? val : 0.0f;
+      }
+    });
+    if (num_columns < num_features) {
+      std::fill(out_values + num_columns, out_values + num_features, 0.0f);
+    }
+  }
+  inline bool IsDenseFormat() const override { return true; }
+private:
+  /*!
+  * \brief Parse the columns of one line, feature columns are passed to push_fun with their indices
+  * \return Number of feature columns
+  */
+  template<typename PUSH_FUN>
+  inline int ParseColumns(const char* str, double* out_label, const PUSH_FUN& push_fun) const {
     int idx = 0;
     double val = 0.0f;
     int bias = 0;
@@ -28,9 +53,8 @@ public:
       if (idx == label_idx_) {
         *out_label = val;
         bias = -1;
-      }
-      else if (fabs(val) > 1e-10) {
-        out_features->emplace_back(idx + bias, val);
+      } else {
+        push_fun(idx + bias, val);
       }
       ++idx;
       if (*str == ',') {
@@ -39,8 +63,9 @@ public:
         Log::Fatal("Input format error when parsing as CSV");
       }
     }
+    return idx + bias;
   }
-private:
+
   int label_idx_ = 0;
 };
 
@@ -51,6 +76,30 @@ public:
   }
   inline void ParseOneLine(const char* str,
     std::vector<std::pair<int, double>>* out_features, double* out_label) const override {
+    ParseColumns(str, out_label, [out_features](int idx, double val) {
+      if (fabs(val) > 1e-10) {
+        out_features->emplace_back(idx, val);
+      }
+    });
+  }
+  inline void ParseOneLine(const char* str, int num_features, double* out_values, double* out_label) const override {
+    const int num_columns = ParseColumns(str, out_label, [num_features, out_values](int idx, double val) {
+      if (idx < num_features) {
+        out_values[idx] = fabs(val) > 1e-10 ? val : 0.0f;
+      }
+    });
+    if (num_columns < num_features) {
+      std::fill(out_values + num_columns, out_values + num_features, 0.0f);
+    }
+  }
+  inline bool IsDenseFormat() const override { return true; }
+private:
+  /*!
+  * \brief Parse the columns of one line, feature columns are passed to push_fun with their indices
+  * \return Number of feature columns
+  */
+  template<typename PUSH_FUN>
+  inline int ParseColumns(const char* str, double* out_label, const PUSH_FUN& push_fun) const {
     int idx = 0;
     double val = 0.0f;
     int bias = 0;
@@ -59,8 +108,8 @@ public:
       if (idx == label_idx_) {
         *out_label = val;
         bias = -1;
-      } else if (fabs(val) > 1e-10) {
-        out_features->emplace_back(idx + bias, val);
+      } else {
+        push_fun(idx + bias, val);
       }
       ++idx;
       if (*str == '\t') {
@@ -69,8 +118,9 @@ public:
         Log::Fatal("Input format error when parsing as TSV");
       }
     }
+    return idx + bias;
   }
-private:
+
   int label_idx_ = 0;
 };
 
@@ -84,6 +134,23 @@ public:
   }
   inline void ParseOneLine(const char* str,
     std::vector<std::pair<int, double>>* out_features, double* out_label) const override {
+    ParseColumns(str, out_label, [out_features](int idx, double val) {
+      out_features->emplace_back(idx, val);
+    });
+  }
+  inline void ParseOneLine(const char* str, int num_features, double* out_values, double* out_label) const override {
+    std::fill(out_values, out_values + num_features, 0.0f);
+    ParseColumns(str, out_label, [num_features, out_values](int idx, double val) {
+      if (idx >= 0 && idx < num_features) {
+        out_values[idx] = val;
+      }
+    });
+  }
+  inline bool IsDenseFormat() const override { return false; }
+private:
+  /*! \brief Parse the (index, value) pairs of one line, they are passed to push_fun */
+  template<typename PUSH_FUN>
+  inline void ParseColumns(const char* str, double* out_label, const PUSH_FUN& push_fun) const {
     int idx = 0;
     double val = 0.0f;
     if (label_idx_ == 0) {
@@ -97,14 +164,14 @@ public:
       if (*str == ':') {
         ++str;
         str = Common::Atof(str, &val);
-        out_features->emplace_back(idx, val);
+        push_fun(idx, val);
       } else {
         Log::Fatal("Input format error when parsing as LibSVM");
       }
       str = Common::SkipSpaceAndTab(str);
     }
   }
-private:
+
   int label_idx_ = 0;
 };
 
@@ -11,6 +11,7 @@
 #include <cstdint>
 
 #include <vector>
+#include <algorithm>
 
 namespace LightGBM {
 
@@ -83,6 +84,24 @@ public:
     Log::Fatal("Using OrderedSparseBin->ConstructHistogram() instead");
   }
 
+  void ConstructIntHistogram(const data_size_t*, data_size_t, const int8_t*,
+    IntHistogramBinEntry*) const override {
+    // Will use OrderedSparseBin->ConstructHistogram() instead
+    Log::Fatal("Using OrderedSparseBin->ConstructHistogram() instead");
+  }
+
+  void ConstructBF16Histogram(const data_size_t*, data_size_t, const uint32_t*,
+    HistogramBinEntry*) const override {
+    // Will use OrderedSparseBin->ConstructHistogram() instead
+    Log::Fatal("Using OrderedSparseBin->ConstructHistogram() instead");
+  }
+
+  void ConstructHistogramForLeaves(const int8_t*, data_size_t, const score_t*,
+    const score_t*, HistogramBinEntry**) const override {
+    // Will use OrderedSparseBin->ConstructHistogram() instead
+    Log::Fatal("Using OrderedSparseBin->ConstructHistogram() instead");
+  }
+
   inline bool NextNonzero(data_size_t* i_delta,
     data_size_t* cur_pos) const {
     ++(*i_delta);
@@ -104,18 +123,46 @@ public:
     data_size_t* lte_indices, data_size_t* gt_indices) const override {
     // not need to split
     if (num_data <= 0) { return 0; }
-    SparseBinIterator<VAL_T> iterator(this, data_indices[0]);
     data_size_t lte_count = 0;
     data_size_t gt_count = 0;
-    for (data_size_t i = 0; i < num_data; ++i) {
-      const data_size_t idx = data_indices[i];
-      VAL_T bin = iterator.InnerGet(idx);
-      if (bin > threshold) {
-        gt_indices[gt_count++] = idx;
-      } else {
-        lte_indices[lte_count++] = idx;
+    data_size_t i = 0;
+    if (num_vals_ > 0) {
+      // merge the sorted data indices with the non-zero data, only non-zero positions need to be compared
+      const auto& start_pair = fast_index_[data_indices[0] >> fast_index_shift_];
+      data_size_t i_delta = start_pair.first;
+      data_size_t cur_pos = start_pair.second;
+      while (i < num_data) {
+        const data_size_t idx = data_indices[i];
+        if (cur_pos < idx) {
+          // jump to the block of idx if it is ahead
+          const auto& fast_pair = fast_index_[idx >> fast_index_shift_];
+          if (fast_pair.second > cur_pos) {
+            i_delta = fast_pair.first;
+            cur_pos = fast_pair.second;
+          }
+          bool has_next = true;
+          while (cur_pos < idx && (has_next = NextNonzero(&i_delta, &cur_pos))) {}
+          // no more non-zero data
+          if (!has_next || cur_pos < idx) { break; }
+        }
+        if (cur_pos == idx) {
+          if (vals_[i_delta] > threshold) {
+            gt_indices[gt_count++] = idx;
+          } else {
+            lte_indices[lte_count++] = idx;
+          }
+          ++i;
+        }
+        // data before next non-zero data are all zeros
+        while (i < num_data && data_indices[i] < cur_pos) {
+          lte_indices[lte_count++] = data_indices[i++];
+        }
       }
     }
+    // the rest are all zeros
+    for (; i < num_data; ++i) {
+      lte_indices[lte_count++] = data_indices[i];
+    }
     return lte_count;
   }
 
@@ -150,6 +197,18 @@ public:
     non_zero_pair_.shrink_to_fit();
   }
 
+  void Append(data_size_t num_new_data, uint32_t) override {
+    // the old non-zero data are merged with the new ones in FinishLoad
+    non_zero_pair_.clear();
+    data_size_t i_delta = -1;
+    data_size_t cur_pos = 0;
+    while (NextNonzero(&i_delta, &cur_pos)) {
+      non_zero_pair_.emplace_back(cur_pos, vals_[i_delta]);
+    }
+    num_data_ += num_new_data;
+    push_buffers_.resize(num_threads_);
+  }
+
   void LoadFromPair(const std::vector<std::pair<data_size_t, VAL_T>>& non_zero_pair) {
     deltas_.clear();
     vals_.clear();
@@ -195,7 +254,8 @@ public:
     data_size_t cur_pos = 0;
     data_size_t next_threshold = 0;
     while (NextNonzero(&i_delta, &cur_pos)) {
-      while (next_threshold < cur_pos) {
+      // first non-zero data not before next_threshold, so no data of the block is skipped
+      while (next_threshold <= cur_pos) {
         fast_index_.emplace_back(i_delta, cur_pos);
         next_threshold += pow2_mod_size;
       }
@@ -214,6 +274,14 @@ public:
     fwrite(vals_.data(), sizeof(VAL_T), num_vals_, file);
   }
 
+  void CopyTo(char* buffer) const override {
+    std::memcpy(buffer, &num_vals_, sizeof(num_vals_));
+    buffer += sizeof(num_vals_);
+    std::memcpy(buffer, deltas_.data(), sizeof(uint8_t) * (num_vals_ + 1));
+    buffer += sizeof(uint8_t) * (num_vals_ + 1);
+    std::memcpy(buffer, vals_.data(), sizeof(VAL_T) * num_vals_);
+  }
+
   size_t SizesInByte() const override {
     return sizeof(num_vals_) + sizeof(uint8_t) * (num_vals_ + 1)
       + sizeof(VAL_T) * num_vals_;
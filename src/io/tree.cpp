@@ -6,7 +6,11 @@
 #include <LightGBM/dataset.h>
 #include <LightGBM/feature.h>
 
+#include <cstring>
 #include <sstream>
+#include <algorithm>
+#include <iomanip>
+#include <limits>
 #include <unordered_map>
 #include <functional>
 #include <vector>
@@ -30,6 +34,8 @@ Tree::Tree(int max_leaves)
   leaf_value_ = std::vector<double>(max_leaves_);
   internal_value_ = std::vector<double>(max_leaves_ - 1);
   leaf_depth_ = std::vector<int>(max_leaves_);
+  leaf_count_ = std::vector<data_size_t>(max_leaves_);
+  internal_count_ = std::vector<data_size_t>(max_leaves_ - 1);
   // root is in the depth 1
   leaf_depth_[0] = 1;
   num_leaves_ = 1;
@@ -40,7 +46,7 @@ Tree::~Tree() {
 }
 
 int Tree::Split(int leaf, int feature, unsigned int threshold_bin, int real_feature,
-  double threshold, double left_value, double right_value, double gain) {
+  double threshold, double left_value, double right_value, data_size_t left_cnt, data_size_t right_cnt, double gain) {
   int new_node_idx = num_leaves_ - 1;
   // update parent info
   int parent = leaf_parent_[leaf];
@@ -68,38 +74,272 @@ int Tree::Split(int leaf, int feature, unsigned int threshold_bin, int real_feat
   internal_value_[new_node_idx] = leaf_value_[leaf];
   leaf_value_[leaf] = left_value;
   leaf_value_[num_leaves_] = right_value;
+  internal_count_[new_node_idx] = left_cnt + right_cnt;
+  leaf_count_[leaf] = left_cnt;
+  leaf_count_[num_leaves_] = right_cnt;
   // update leaf depth
   leaf_depth_[num_leaves_] = leaf_depth_[leaf] + 1;
   leaf_depth_[leaf]++;
+  max_depth_ = std::max(max_depth_, leaf_depth_[leaf] - 1);
 
   ++num_leaves_;
+  // structure is changed
+  flat_nodes_.clear();
+  bin_nodes_.clear();
   return num_leaves_ - 1;
 }
 
-void Tree::AddPredictionToScore(const Dataset* data, data_size_t num_data, score_t* score) const {
-  Threading::For<data_size_t>(0, num_data, [this, data, score](int, data_size_t start, data_size_t end) {
-    std::vector<std::unique_ptr<BinIterator>> iterators(data->num_features());
-    for (int i = 0; i < data->num_features(); ++i) {
-      iterators[i].reset(data->FeatureAt(i)->bin_data()->GetIterator(start));
+std::vector<int> Tree::BreadthFirstIndex() const {
+  // internal nodes of the original layout in breadth-first order
+  std::vector<int> queue(1, 0);
+  std::vector<int> new_index(num_leaves_ - 1);
+  queue.reserve(num_leaves_ - 1);
+  for (size_t i = 0; i < queue.size(); ++i) {
+    new_index[queue[i]] = static_cast<int>(i);
+    if (left_child_[queue[i]] >= 0) { queue.push_back(left_child_[queue[i]]); }
+    if (right_child_[queue[i]] >= 0) { queue.push_back(right_child_[queue[i]]); }
+  }
+  return new_index;
+}
+
+void Tree::Flatten() {
+  flat_nodes_.clear();
+  if (num_leaves_ <= 1 || num_leaves_ > 32767) { return; }
+  flat_nodes_.resize(num_leaves_ - 1);
+  const std::vector<int> new_index = BreadthFirstIndex();
+  for (int i = 0; i < num_leaves_ - 1; ++i) {
+    FlatNode& flat_node = flat_nodes_[new_index[i]];
+    flat_node.threshold = threshold_[i];
+    flat_node.feature = split_feature_real_[i];
+    flat_node.left_child = static_cast<int16_t>(left_child_[i] >= 0 ? new_index[left_child_[i]] : left_child_[i]);
+    flat_node.right_child = static_cast<int16_t>(right_child_[i] >= 0 ? new_index[right_child_[i]] : right_child_[i]);
+  }
+}
+
+bool Tree::FlattenBins(const std::vector<int>& feature_slots,
+  const std::vector<std::vector<double>>& feature_thresholds) {
+  bin_nodes_.clear();
+  if (num_leaves_ <= 1) { return true; }
+  if (num_leaves_ > 32767) { return false; }
+  bin_nodes_.resize(num_leaves_ - 1);
+  const std::vector<int> new_index = BreadthFirstIndex();
+  for (int i = 0; i < num_leaves_ - 1; ++i) {
+    BinNode& bin_node = bin_nodes_[new_index[i]];
+    const int slot = feature_slots[split_feature_real_[i]];
+    const std::vector<double>& thresholds = feature_thresholds[slot];
+    bin_node.feature = static_cast<uint16_t>(slot);
+    bin_node.threshold = static_cast<uint16_t>(
+      std::lower_bound(thresholds.begin(), thresholds.end(), threshold_[i]) - thresholds.begin());
+    bin_node.left_child = static_cast<int16_t>(left_child_[i] >= 0 ? new_index[left_child_[i]] : left_child_[i]);
+    bin_node.right_child = static_cast<int16_t>(right_child_[i] >= 0 ? new_index[right_child_[i]] : right_child_[i]);
+  }
+  return true;
+}
+
+void Tree::PartitionByBins(const Dataset* data, data_size_t* indices, data_size_t num_data, data_size_t* buffer,
+  data_size_t* leaf_begin, data_size_t* leaf_count) const {
+  if (num_leaves_ <= 1) {
+    leaf_begin[0] = 0;
+    leaf_count[0] = num_data;
+    return;
+  }
+  // (node, begin, count) of nodes that wait to be split
+  std::vector<std::pair<int, std::pair<data_size_t, data_size_t>>> stack;
+  stack.emplace_back(0, std::make_pair(0, num_data));
+  while (!stack.empty()) {
+    const int node = stack.back().first;
+    const data_size_t begin = stack.back().second.first;
+    const data_size_t cnt = stack.back().second.second;
+    stack.pop_back();
+    data_size_t left_cnt = 0;
+    if (cnt > 0) {
+      // Bin::Split never writes ahead of the position it reads, so left indices can be written in place
+      left_cnt = data->FeatureAt(split_feature_[node])->bin_data()->Split(threshold_in_bin_[node],
+        indices + begin, cnt, indices + begin, buffer);
+      if (cnt > left_cnt) {
+        std::memcpy(indices + begin + left_cnt, buffer, (cnt - left_cnt) * sizeof(data_size_t));
+      }
     }
-    for (data_size_t i = start; i < end; ++i) {
-      score[i] += static_cast<score_t>(leaf_value_[GetLeaf(iterators, i)]);
+    const int children[2] = { left_child_[node], right_child_[node] };
+    const data_size_t child_begin[2] = { begin, begin + left_cnt };
+    const data_size_t child_cnt[2] = { left_cnt, cnt - left_cnt };
+    for (int k = 0; k < 2; ++k) {
+      if (children[k] < 0) {
+        leaf_begin[~children[k]] = child_begin[k];
+        leaf_count[~children[k]] = child_cnt[k];
+      } else {
+        stack.emplace_back(children[k], std::make_pair(child_begin[k], child_cnt[k]));
+      }
     }
+  }
+}
+
+template<typename FUN>
+void Tree::ForEachDataInLeaves(const Dataset* data, const data_size_t* used_data_indices, data_size_t num_data,
+  const FUN& fun) const {
+  Threading::For<data_size_t>(0, num_data,
+      [this, data, used_data_indices, &fun](int, data_size_t start, data_size_t end) {
+    const data_size_t block_size = kPartitionBlockSize;
+    std::vector<data_size_t> indices(std::min(block_size, end - start));
+    std::vector<data_size_t> buffer(indices.size());
+    std::vector<data_size_t> leaf_begin(num_leaves_);
+    std::vector<data_size_t> leaf_count(num_leaves_);
+    for (data_size_t block_start = start; block_start < end; block_start += block_size) {
+      const data_size_t cnt = std::min(block_size, end - block_start);
+      for (data_size_t i = 0; i < cnt; ++i) {
+        indices[i] = used_data_indices == nullptr ? block_start + i : used_data_indices[block_start + i];
+      }
+      PartitionByBins(data, indices.data(), cnt, buffer.data(), leaf_begin.data(), leaf_count.data());
+      for (int leaf = 0; leaf < num_leaves_; ++leaf) {
+        const data_size_t* leaf_indices = indices.data() + leaf_begin[leaf];
+        for (data_size_t i = 0; i < leaf_count[leaf]; ++i) {
+          fun(leaf, leaf_indices[i]);
+        }
+      }
+    }
+  });
+}
+
+template<typename T>
+void Tree::GetLeafIndexInType(const Dataset* data, data_size_t num_data, T* out_leaf) const {
+  ForEachDataInLeaves(data, nullptr, num_data, [out_leaf](int leaf, data_size_t idx) {
+    out_leaf[idx] = static_cast<T>(leaf);
+  });
+}
+
+void Tree::GetLeafIndex(const Dataset* data, data_size_t num_data, uint8_t* out_leaf) const {
+  GetLeafIndexInType(data, num_data, out_leaf);
+}
+
+void Tree::GetLeafIndex(const Dataset* data, data_size_t num_data, uint16_t* out_leaf) const {
+  GetLeafIndexInType(data, num_data, out_leaf);
+}
+
+void Tree::AddPredictionToScore(const Dataset* data, data_size_t num_data, score_t* score) const {
+  ForEachDataInLeaves(data, nullptr, num_data, [this, score](int leaf, data_size_t idx) {
+    score[idx] += static_cast<score_t>(leaf_value_[leaf]);
   });
 }
 
 void Tree::AddPredictionToScore(const Dataset* data, const data_size_t* used_data_indices,
                                              data_size_t num_data, score_t* score) const {
-  Threading::For<data_size_t>(0, num_data,
-      [this, data, used_data_indices, score](int, data_size_t start, data_size_t end) {
-    std::vector<std::unique_ptr<BinIterator>> iterators(data->num_features());
-    for (int i = 0; i < data->num_features(); ++i) {
-      iterators[i].reset(data->FeatureAt(i)->bin_data()->GetIterator(used_data_indices[start]));
+  ForEachDataInLeaves(data, used_data_indices, num_data, [this, score](int leaf, data_size_t idx) {
+    score[idx] += static_cast<score_t>(leaf_value_[leaf]);
+  });
+}
+
+double Tree::ExpectedValue() const {
+  if (num_leaves_ <= 1) { return leaf_value_[0]; }
+  const double total_count = DataCount(0);
+  double ret = 0.0f;
+  for (int i = 0; i < num_leaves_; ++i) {
+    ret += leaf_value_[i] * leaf_count_[i] / total_count;
+  }
+  return ret;
+}
+
+void Tree::PredictContrib(const double* feature_values, int num_features, PathElement* path_buffer, double* output) const {
+  output[num_features] += ExpectedValue();
+  if (num_leaves_ > 1) {
+    TreeSHAP(feature_values, output, 0, 0, path_buffer, 1, 1, -1);
+  }
+}
+
+int Tree::NodeDepth(int node) const {
+  if (node < 0) { return 0; }
+  return 1 + std::max(NodeDepth(left_child_[node]), NodeDepth(right_child_[node]));
+}
+
+void Tree::ExtendPath(PathElement* unique_path, int unique_depth, double zero_fraction,
+  double one_fraction, int feature_index) {
+  unique_path[unique_depth].feature_index = feature_index;
+  unique_path[unique_depth].zero_fraction = zero_fraction;
+  unique_path[unique_depth].one_fraction = one_fraction;
+  unique_path[unique_depth].pweight = (unique_depth == 0 ? 1.0f : 0.0f);
+  for (int i = unique_depth - 1; i >= 0; --i) {
+    unique_path[i + 1].pweight += one_fraction * unique_path[i].pweight * (i + 1) / static_cast<double>(unique_depth + 1);
+    unique_path[i].pweight = zero_fraction * unique_path[i].pweight * (unique_depth - i) / static_cast<double>(unique_depth + 1);
+  }
+}
+
+void Tree::UnwindPath(PathElement* unique_path, int unique_depth, int path_index) {
+  const double one_fraction = unique_path[path_index].one_fraction;
+  const double zero_fraction = unique_path[path_index].zero_fraction;
+  double next_one_portion = unique_path[unique_depth].pweight;
+  for (int i = unique_depth - 1; i >= 0; --i) {
+    if (one_fraction != 0) {
+      const double tmp = unique_path[i].pweight;
+      unique_path[i].pweight = next_one_portion * (unique_depth + 1) / static_cast<double>((i + 1) * one_fraction);
+      next_one_portion = tmp - unique_path[i].pweight * zero_fraction * (unique_depth - i) / static_cast<double>(unique_depth + 1);
+    } else {
+      unique_path[i].pweight = unique_path[i].pweight * (unique_depth + 1) / static_cast<double>(zero_fraction * (unique_depth - i));
     }
-    for (data_size_t i = start; i < end; ++i) {
-      score[used_data_indices[i]] += static_cast<score_t>(leaf_value_[GetLeaf(iterators, used_data_indices[i])]);
+  }
+  for (int i = path_index; i < unique_depth; ++i) {
+    unique_path[i].feature_index = unique_path[i + 1].feature_index;
+    unique_path[i].zero_fraction = unique_path[i + 1].zero_fraction;
+    unique_path[i].one_fraction = unique_path[i + 1].one_fraction;
+  }
+}
+
+double Tree::UnwoundPathSum(const PathElement* unique_path, int unique_depth, int path_index) {
+  const double one_fraction = unique_path[path_index].one_fraction;
+  const double zero_fraction = unique_path[path_index].zero_fraction;
+  double next_one_portion = unique_path[unique_depth].pweight;
+  double total = 0.0f;
+  for (int i = unique_depth - 1; i >= 0; --i) {
+    if (one_fraction != 0) {
+      const double tmp = next_one_portion * (unique_depth + 1) / static_cast<double>((i + 1) * one_fraction);
+      total += tmp;
+      next_one_portion = unique_path[i].pweight - tmp * zero_fraction * (unique_depth - i) / static_cast<double>(unique_depth + 1);
+    } else {
+      total += unique_path[i].pweight / zero_fraction / ((unique_depth - i) / static_cast<double>(unique_depth + 1));
     }
-  });
+  }
+  return total;
+}
+
+void Tree::TreeSHAP(const double* feature_values, double* phi, int node, int unique_depth,
+  PathElement* parent_unique_path, double parent_zero_fraction, double parent_one_fraction,
+  int parent_feature_index) const {
+  // the path of this node is a copy of the parent's path extended by the split to this node
+  PathElement* unique_path = parent_unique_path + unique_depth;
+  if (unique_depth > 0) {
+    std::copy(parent_unique_path, parent_unique_path + unique_depth, unique_path);
+  }
+  ExtendPath(unique_path, unique_depth, parent_zero_fraction, parent_one_fraction, parent_feature_index);
+  if (node < 0) {
+    for (int i = 1; i <= unique_depth; ++i) {
+      const double w = UnwoundPathSum(unique_path, unique_depth, i);
+      const PathElement& el = unique_path[i];
+      phi[el.feature_index] += w * (el.one_fraction - el.zero_fraction) * leaf_value_[~node];
+    }
+    return;
+  }
+  const int feature = split_feature_real_[node];
+  // the same decision as GetLeaf, NaN goes to the right
+  const int hot_index = feature_values[feature] <= threshold_[node] ? left_child_[node] : right_child_[node];
+  const int cold_index = hot_index == left_child_[node] ? right_child_[node] : left_child_[node];
+  const double w = DataCount(node);
+  const double hot_zero_fraction = DataCount(hot_index) / w;
+  const double cold_zero_fraction = DataCount(cold_index) / w;
+  double incoming_zero_fraction = 1.0f;
+  double incoming_one_fraction = 1.0f;
+  // if the feature is already on the path, undo that split and redo it with this one
+  int path_index = 0;
+  for (; path_index <= unique_depth; ++path_index) {
+    if (unique_path[path_index].feature_index == feature) { break; }
+  }
+  if (path_index != unique_depth + 1) {
+    incoming_zero_fraction = unique_path[path_index].zero_fraction;
+    incoming_one_fraction = unique_path[path_index].one_fraction;
+    UnwindPath(unique_path, unique_depth, path_index);
+    unique_depth -= 1;
+  }
+  TreeSHAP(feature_values, phi, hot_index, unique_depth + 1, unique_path,
+    hot_zero_fraction * incoming_zero_fraction, incoming_one_fraction, feature);
+  TreeSHAP(feature_values, phi, cold_index, unique_depth + 1, unique_path,
+    cold_zero_fraction * incoming_zero_fraction, 0, feature);
 }
 
 std::string Tree::ToString() {
@@ -121,10 +361,48 @@ std::string Tree::ToString() {
     << Common::ArrayToString<double>(leaf_value_.data(), num_leaves_, ' ') << std::endl;
   ss << "internal_value="
     << Common::ArrayToString<double>(internal_value_.data(), num_leaves_ - 1, ' ') << std::endl;
+  if (HasDataCounts() && num_leaves_ > 1) {
+    ss << "leaf_count="
+      << Common::ArrayToString<data_size_t>(leaf_count_.data(), num_leaves_, ' ') << std::endl;
+    ss << "internal_count="
+      << Common::ArrayToString<data_size_t>(internal_count_.data(), num_leaves_ - 1, ' ') << std::endl;
+  }
   ss << std::endl;
   return ss.str();
 }
 
+std::string Tree::ToIfElse(int index) const {
+  std::stringstream ss;
+  ss << "double PredictTree" << index << "(const double* arr) {" << std::endl;
+  ss << NodeToIfElse(num_leaves_ > 1 ? 0 : ~0, 1, false);
+  ss << "}" << std::endl << std::endl;
+  ss << "int PredictTree" << index << "Leaf(const double* arr) {" << std::endl;
+  ss << NodeToIfElse(num_leaves_ > 1 ? 0 : ~0, 1, true);
+  ss << "}" << std::endl << std::endl;
+  return ss.str();
+}
+
+std::string Tree::NodeToIfElse(int node, int depth, bool is_leaf_index) const {
+  std::stringstream ss;
+  // enough digits to get the same double back
+  ss << std::setprecision(std::numeric_limits<double>::digits10 + 2);
+  const std::string indent(depth * 2, ' ');
+  if (node < 0) {
+    if (is_leaf_index) {
+      ss << indent << "return " << ~node << ";" << std::endl;
+    } else {
+      ss << indent << "return " << leaf_value_[~node] << ";" << std::endl;
+    }
+    return ss.str();
+  }
+  ss << indent << "if (arr[" << split_feature_real_[node] << "] <= " << threshold_[node] << ") {" << std::endl;
+  ss << NodeToIfElse(left_child_[node], depth + 1, is_leaf_index);
+  ss << indent << "} else {" << std::endl;
+  ss << NodeToIfElse(right_child_[node], depth + 1, is_leaf_index);
+  ss << indent << "}" << std::endl;
+  return ss.str();
+}
+
 Tree::Tree(const std::string& str) {
   std::vector<std::string> lines = Common::Split(str.c_str(), '\n');
   std::unordered_map<std::string, std::string> key_vals;
@@ -173,6 +451,136 @@ Tree::Tree(const std::string& str) {
                               num_leaves_ , leaf_value_.data());
   Common::StringToDoubleArray(key_vals["internal_value"], ' ',
                               num_leaves_ - 1 , internal_value_.data());
+  // numbers of data are not in old model files
+  if (key_vals.count("leaf_count") > 0 && key_vals.count("internal_count") > 0) {
+    leaf_count_ = std::vector<data_size_t>(num_leaves_);
+    internal_count_ = std::vector<data_size_t>(num_leaves_ - 1);
+    Common::StringToIntArray(key_vals["leaf_count"], ' ',
+                             num_leaves_, leaf_count_.data());
+    Common::StringToIntArray(key_vals["internal_count"], ' ',
+                             num_leaves_ - 1, internal_count_.data());
+  }
+  max_depth_ = num_leaves_ > 1 ? NodeDepth(0) : 0;
+}
+
+Tree::Tree(const void* memory) {
+  const char* memory_ptr = reinterpret_cast<const char*>(memory);
+  int has_flat_nodes = 0;
+  std::memcpy(&num_leaves_, memory_ptr, sizeof(num_leaves_));
+  std::memcpy(&has_flat_nodes, memory_ptr + sizeof(num_leaves_), sizeof(has_flat_nodes));
+  memory_ptr += sizeof(num_leaves_) + sizeof(has_flat_nodes);
+  const size_t num_nodes = static_cast<size_t>(std::max(num_leaves_ - 1, 0));
+  const size_t num_leaves = static_cast<size_t>(num_leaves_);
+  auto read_array = [&memory_ptr](size_t size, void* out) {
+    if (size > 0) { std::memcpy(out, memory_ptr, size); }
+    memory_ptr += size;
+  };
+  const char* int_begin = memory_ptr;
+  split_feature_real_ = std::vector<int>(num_nodes);
+  read_array(sizeof(int) * num_nodes, split_feature_real_.data());
+  left_child_ = std::vector<int>(num_nodes);
+  read_array(sizeof(int) * num_nodes, left_child_.data());
+  right_child_ = std::vector<int>(num_nodes);
+  read_array(sizeof(int) * num_nodes, right_child_.data());
+  leaf_parent_ = std::vector<int>(num_leaves);
+  read_array(sizeof(int) * num_leaves, leaf_parent_.data());
+  internal_count_ = std::vector<data_size_t>(num_nodes);
+  read_array(sizeof(data_size_t) * num_nodes, internal_count_.data());
+  leaf_count_ = std::vector<data_size_t>(num_leaves);
+  read_array(sizeof(data_size_t) * num_leaves, leaf_count_.data());
+  // zero numbers of data are written for trees without them
+  if (num_nodes > 0 && internal_count_[0] <= 0) {
+    internal_count_.clear();
+    leaf_count_.clear();
+  }
+  memory_ptr = int_begin + Common::AlignUp(memory_ptr - int_begin, kBinaryAlignment);
+  split_gain_ = std::vector<double>(num_nodes);
+  read_array(sizeof(double) * num_nodes, split_gain_.data());
+  threshold_ = std::vector<double>(num_nodes);
+  read_array(sizeof(double) * num_nodes, threshold_.data());
+  leaf_value_ = std::vector<double>(num_leaves);
+  read_array(sizeof(double) * num_leaves, leaf_value_.data());
+  internal_value_ = std::vector<double>(num_nodes);
+  read_array(sizeof(double) * num_nodes, internal_value_.data());
+  if (has_flat_nodes) {
+    flat_nodes_ = std::vector<FlatNode>(num_nodes);
+    read_array(sizeof(FlatNode) * num_nodes, flat_nodes_.data());
+  }
+  max_depth_ = num_leaves_ > 1 ? NodeDepth(0) : 0;
+}
+
+void Tree::SaveBinaryToFile(FILE* file) const {
+  const int has_flat_nodes = flat_nodes_.empty() ? 0 : 1;
+  const size_t num_nodes = static_cast<size_t>(std::max(num_leaves_ - 1, 0));
+  const size_t num_leaves = static_cast<size_t>(num_leaves_);
+  fwrite(&num_leaves_, sizeof(num_leaves_), 1, file);
+  fwrite(&has_flat_nodes, sizeof(has_flat_nodes), 1, file);
+  fwrite(split_feature_real_.data(), sizeof(int), num_nodes, file);
+  fwrite(left_child_.data(), sizeof(int), num_nodes, file);
+  fwrite(right_child_.data(), sizeof(int), num_nodes, file);
+  fwrite(leaf_parent_.data(), sizeof(int), num_leaves, file);
+  if (leaf_count_.size() >= num_leaves && internal_count_.size() >= num_nodes) {
+    fwrite(internal_count_.data(), sizeof(data_size_t), num_nodes, file);
+    fwrite(leaf_count_.data(), sizeof(data_size_t), num_leaves, file);
+  } else {
+    const std::vector<data_size_t> zeros(num_nodes + num_leaves, 0);
+    fwrite(zeros.data(), sizeof(data_size_t), zeros.size(), file);
+  }
+  const size_t int_size = sizeof(int) * (num_nodes * 3 + num_leaves) + sizeof(data_size_t) * (num_nodes + num_leaves);
+  const char padding[kBinaryAlignment] = { 0 };
+  fwrite(padding, sizeof(char), Common::AlignUp(int_size, kBinaryAlignment) - int_size, file);
+  fwrite(split_gain_.data(), sizeof(double), num_nodes, file);
+  fwrite(threshold_.data(), sizeof(double), num_nodes, file);
+  fwrite(leaf_value_.data(), sizeof(double), num_leaves, file);
+  fwrite(internal_value_.data(), sizeof(double), num_nodes, file);
+  if (has_flat_nodes) {
+    fwrite(flat_nodes_.data(), sizeof(FlatNode), num_nodes, file);
+  }
+}
+
+size_t Tree::SizesInByte(int num_leaves, bool has_flat_nodes) {
+  const size_t num_nodes = static_cast<size_t>(std::max(num_leaves - 1, 0));
+  const size_t int_size = sizeof(int) * (num_nodes * 3 + static_cast<size_t>(num_leaves))
+    + sizeof(data_size_t) * (num_nodes + static_cast<size_t>(num_leaves));
+  size_t size = sizeof(int) * 2 + Common::AlignUp(int_size, kBinaryAlignment)
+    + sizeof(double) * (num_nodes * 3 + static_cast<size_t>(num_leaves));
+  if (has_flat_nodes) {
+    size += sizeof(FlatNode) * num_nodes;
+  }
+  return size;
+}
+
+void Tree::SaveTrainingFieldsToFile(FILE* file) const {
+  const size_t num_nodes = static_cast<size_t>(std::max(num_leaves_ - 1, 0));
+  const size_t num_leaves = static_cast<size_t>(num_leaves_);
+  fwrite(split_feature_.data(), sizeof(int), num_nodes, file);
+  fwrite(threshold_in_bin_.data(), sizeof(unsigned int), num_nodes, file);
+  fwrite(leaf_depth_.data(), sizeof(int), num_leaves, file);
+  const size_t size = sizeof(int) * (num_nodes + num_leaves) + sizeof(unsigned int) * num_nodes;
+  const char padding[kBinaryAlignment] = { 0 };
+  fwrite(padding, sizeof(char), SizesOfTrainingFields(num_leaves_) - size, file);
+}
+
+void Tree::LoadTrainingFields(const void* memory) {
+  const char* memory_ptr = reinterpret_cast<const char*>(memory);
+  const size_t num_nodes = static_cast<size_t>(std::max(num_leaves_ - 1, 0));
+  const size_t num_leaves = static_cast<size_t>(num_leaves_);
+  auto read_array = [&memory_ptr](size_t size, void* out) {
+    if (size > 0) { std::memcpy(out, memory_ptr, size); }
+    memory_ptr += size;
+  };
+  split_feature_ = std::vector<int>(num_nodes);
+  read_array(sizeof(int) * num_nodes, split_feature_.data());
+  threshold_in_bin_ = std::vector<unsigned int>(num_nodes);
+  read_array(sizeof(unsigned int) * num_nodes, threshold_in_bin_.data());
+  leaf_depth_ = std::vector<int>(num_leaves);
+  read_array(sizeof(int) * num_leaves, leaf_depth_.data());
+}
+
+size_t Tree::SizesOfTrainingFields(int num_leaves) {
+  const size_t num_nodes = static_cast<size_t>(std::max(num_leaves - 1, 0));
+  return Common::AlignUp(sizeof(int) * (num_nodes + static_cast<size_t>(num_leaves))
+    + sizeof(unsigned int) * num_nodes, kBinaryAlignment);
 }
 
 }  // namespace LightGBM
@@ -1,10 +1,13 @@
 #ifndef LIGHTGBM_METRIC_BINARY_METRIC_HPP_
 #define LIGHTGBM_METRIC_BINARY_METRIC_HPP_
 
+#include <LightGBM/utils/common.h>
 #include <LightGBM/utils/log.h>
 
 #include <LightGBM/metric.h>
 
+#include <omp.h>
+
 #include <algorithm>
 #include <vector>
 #include <sstream>
@@ -147,8 +150,14 @@ public:
 */
 class AUCMetric: public Metric {
 public:
-  explicit AUCMetric(const MetricConfig&) {
-
+  explicit AUCMetric(const MetricConfig& config)
+    :num_bins_(config.auc_num_bins) {
+    // get number of threads
+#pragma omp parallel
+#pragma omp master
+    {
+      num_threads_ = omp_get_num_threads();
+    }
   }
 
   virtual ~AUCMetric() {
@@ -181,15 +190,44 @@ public:
         sum_weights_ += weights_[i];
       }
     }
+    if (num_bins_ > 0) {
+      bin_sum_pos_.resize(static_cast<size_t>(num_threads_) * num_bins_);
+      bin_sum_neg_.resize(static_cast<size_t>(num_threads_) * num_bins_);
+    } else {
+      sorted_idx_.resize(num_data_);
+    }
   }
 
   std::vector<double> Eval(const score_t* score) const override {
+    double sum_pos = 0.0f;
+    double accum = 0.0f;
+    if (num_bins_ > 0) {
+      AccumulateByBins(score, &sum_pos, &accum);
+    } else {
+      AccumulateBySort(score, &sum_pos, &accum);
+    }
+    double auc = 1.0f;
+    if (sum_pos > 0.0f && sum_pos != sum_weights_) {
+      auc = accum / (sum_pos *(sum_weights_ - sum_pos));
+    }
+    return std::vector<double>(1, auc);
+  }
+
+private:
+  /*!
+  * \brief Exact AUC, sort data by score in parallel and accumulate groups of the same score
+  * \param score Scores
+  * \param out_sum_pos Total sum of positive label
+  * \param out_accum Accumulate of auc
+  */
+  void AccumulateBySort(const score_t* score, double* out_sum_pos, double* out_accum) const {
     // get indices sorted by score, descent order
-    std::vector<data_size_t> sorted_idx;
+#pragma omp parallel for schedule(static)
     for (data_size_t i = 0; i < num_data_; ++i) {
-      sorted_idx.emplace_back(i);
+      sorted_idx_[i] = i;
     }
-    std::sort(sorted_idx.begin(), sorted_idx.end(), [score](data_size_t a, data_size_t b) {return score[a] > score[b]; });
+    Common::ParallelSort(sorted_idx_.begin(), sorted_idx_.end(),
+      [score](data_size_t a, data_size_t b) {return score[a] > score[b]; });
     // temp sum of postive label
     double cur_pos = 0.0f;
     // total sum of postive label
@@ -198,11 +236,11 @@ public:
     double accum = 0.0f;
     // temp sum of negative label
     double cur_neg = 0.0f;
-    score_t threshold = score[sorted_idx[0]];
+    score_t threshold = score[sorted_idx_[0]];
     if (weights_ == nullptr) {  // no weights
       for (data_size_t i = 0; i < num_data_; ++i) {
-        const float cur_label = label_[sorted_idx[i]];
-        const score_t cur_score = score[sorted_idx[i]];
+        const float cur_label = label_[sorted_idx_[i]];
+        const score_t cur_score = score[sorted_idx_[i]];
         // new threshold
         if (cur_score != threshold) {
           threshold = cur_score;
@@ -217,9 +255,9 @@ public:
       }
     } else {  // has weights
       for (data_size_t i = 0; i < num_data_; ++i) {
-        const float cur_label = label_[sorted_idx[i]];
-        const score_t cur_score = score[sorted_idx[i]];
-        const float cur_weight = weights_[sorted_idx[i]];
+        const float cur_label = label_[sorted_idx_[i]];
+        const score_t cur_score = score[sorted_idx_[i]];
+        const float cur_weight = weights_[sorted_idx_[i]];
         // new threshold
         if (cur_score != threshold) {
           threshold = cur_score;
@@ -235,14 +273,59 @@ public:
     }
     accum += cur_neg*(cur_pos * 0.5f + sum_pos);
     sum_pos += cur_pos;
-    double auc = 1.0f;
-    if (sum_pos > 0.0f && sum_pos != sum_weights_) {
-      auc = accum / (sum_pos *(sum_weights_ - sum_pos));
+    *out_sum_pos = sum_pos;
+    *out_accum = accum;
+  }
+
+  /*!
+  * \brief Approximate AUC in O(n), scores are bucketed into num_bins_ buckets of the same width in parallel,
+  *        and data in the same bucket are treated as the same score
+  * \param score Scores
+  * \param out_sum_pos Total sum of positive label
+  * \param out_accum Accumulate of auc
+  */
+  void AccumulateByBins(const score_t* score, double* out_sum_pos, double* out_accum) const {
+    // get range of score
+    std::vector<score_t> thread_min(num_threads_, score[0]);
+    std::vector<score_t> thread_max(num_threads_, score[0]);
+#pragma omp parallel for schedule(static)
+    for (data_size_t i = 0; i < num_data_; ++i) {
+      const int tid = omp_get_thread_num();
+      thread_min[tid] = std::min(thread_min[tid], score[i]);
+      thread_max[tid] = std::max(thread_max[tid], score[i]);
     }
-    return std::vector<double>(1, auc);
+    const double min_score = *std::min_element(thread_min.begin(), thread_min.end());
+    const double max_score = *std::max_element(thread_max.begin(), thread_max.end());
+    // bucket 0 has the largest scores
+    const double scale = max_score > min_score ? num_bins_ / (max_score - min_score) : 0.0f;
+    std::fill(bin_sum_pos_.begin(), bin_sum_pos_.end(), 0.0f);
+    std::fill(bin_sum_neg_.begin(), bin_sum_neg_.end(), 0.0f);
+#pragma omp parallel for schedule(static)
+    for (data_size_t i = 0; i < num_data_; ++i) {
+      const size_t offset = static_cast<size_t>(omp_get_thread_num()) * num_bins_;
+      const int bin = std::min(static_cast<int>((max_score - score[i]) * scale), num_bins_ - 1);
+      const double weight = weights_ == nullptr ? 1.0f : weights_[i];
+      bin_sum_pos_[offset + bin] += label_[i] * weight;
+      bin_sum_neg_[offset + bin] += (1.0f - label_[i]) * weight;
+    }
+    // merge buckets of threads
+#pragma omp parallel for schedule(static)
+    for (int bin = 0; bin < num_bins_; ++bin) {
+      for (int tid = 1; tid < num_threads_; ++tid) {
+        bin_sum_pos_[bin] += bin_sum_pos_[static_cast<size_t>(tid) * num_bins_ + bin];
+        bin_sum_neg_[bin] += bin_sum_neg_[static_cast<size_t>(tid) * num_bins_ + bin];
+      }
+    }
+    double sum_pos = 0.0f;
+    double accum = 0.0f;
+    for (int bin = 0; bin < num_bins_; ++bin) {
+      accum += bin_sum_neg_[bin] * (bin_sum_pos_[bin] * 0.5f + sum_pos);
+      sum_pos += bin_sum_pos_[bin];
+    }
+    *out_sum_pos = sum_pos;
+    *out_accum = accum;
   }
 
-private:
   /*! \brief Number of data */
   data_size_t num_data_;
   /*! \brief Pointer of label */
@@ -253,6 +336,16 @@ private:
   double sum_weights_;
   /*! \brief Name of test set */
   std::vector<std::string> name_;
+  /*! \brief Number of buckets of the approximate AUC, <= 0 means exact AUC */
+  int num_bins_;
+  /*! \brief Number of threads */
+  int num_threads_;
+  /*! \brief Buffer of indices sorted by score, reused by every evaluation */
+  mutable std::vector<data_size_t> sorted_idx_;
+  /*! \brief Sum of positive label of buckets for each thread */
+  mutable std::vector<double> bin_sum_pos_;
+  /*! \brief Sum of negative label of buckets for each thread */
+  mutable std::vector<double> bin_sum_neg_;
 };
 
 }  // namespace LightGBM
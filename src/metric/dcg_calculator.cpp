@@ -6,6 +6,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <mutex>
 
 namespace LightGBM {
 
@@ -16,7 +17,9 @@ std::vector<score_t> DCGCalculator::discount_;
 const data_size_t DCGCalculator::kMaxPosition = 10000;
 
 void DCGCalculator::Init(std::vector<double> input_label_gain) {
-  //  only inited one time
+  //  only inited one time, boosters of different threads may init at the same time
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
   if (is_inited_) { return; }
   label_gain_.clear();
   for(size_t i = 0;i < input_label_gain.size();++i){
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
 
 namespace LightGBM {
 
@@ -43,6 +44,43 @@ BruckMap BruckMap::Construct(int rank, int num_machines) {
 }
 
 
+HierarchicalMap::HierarchicalMap() {
+  leader = 0;
+  host_index = 0;
+  max_local_machines = 1;
+}
+
+HierarchicalMap HierarchicalMap::Construct(int rank, const std::vector<std::string>& hosts) {
+  HierarchicalMap hier_map;
+  // group machines by hosts, in order of the smallest ranks
+  std::unordered_map<std::string, int> host_to_leader;
+  std::unordered_map<int, int> local_cnt;
+  for (int i = 0; i < static_cast<int>(hosts.size()); ++i) {
+    if (host_to_leader.count(hosts[i]) == 0) {
+      host_to_leader[hosts[i]] = i;
+      hier_map.leaders.push_back(i);
+    }
+    const int cur_leader = host_to_leader[hosts[i]];
+    hier_map.max_local_machines = std::max(hier_map.max_local_machines, ++local_cnt[cur_leader]);
+    if (i == rank) {
+      hier_map.leader = cur_leader;
+    }
+  }
+  for (int i = 0; i < static_cast<int>(hier_map.leaders.size()); ++i) {
+    if (hier_map.leaders[i] == hier_map.leader) {
+      hier_map.host_index = i;
+    }
+  }
+  if (hier_map.leader == rank) {
+    for (int i = rank + 1; i < static_cast<int>(hosts.size()); ++i) {
+      if (hosts[i] == hosts[rank]) {
+        hier_map.local_ranks.push_back(i);
+      }
+    }
+  }
+  return hier_map;
+}
+
 RecursiveHalvingMap::RecursiveHalvingMap() {
   k = 0;
 }
@@ -8,9 +8,11 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #ifdef USE_SOCKET
 #include "socket_wrapper.hpp"
+#include "shm_wrapper.hpp"
 #include <LightGBM/utils/common.h>
 #include <thread>
 #include <vector>
@@ -56,6 +58,13 @@ public:
   */
   inline void Send(int rank, char* data, int len) const;
   /*!
+  * \brief Recv a message that starts with its total size as an int, blocking
+  * \param rank Which rank will send data to local machine
+  * \param data Pointer of receive data, should be large enough for the message
+  * \return Size of the received message, including its size field
+  */
+  inline int RecvSized(int rank, char* data) const;
+  /*!
   * \brief Send and Recv at same time, blocking
   * \param send_rank
   * \param send_data
@@ -67,6 +76,18 @@ public:
   inline void SendRecv(int send_rank, char* send_data, int send_len,
     int recv_rank, char* recv_data, int recv_len);
   /*!
+  * \brief Send and Recv at same time, blocking. Both messages start with their total size as an int,
+  *        so the receiver doesn't need to know the size in advance
+  * \param send_rank
+  * \param send_data Starts with send_len as an int
+  * \prama send_len
+  * \param recv_rank
+  * \param recv_data Should be large enough for the received message
+  * \return Size of the received message, including its size field
+  */
+  inline int SendRecvSized(int send_rank, char* send_data, int send_len,
+    int recv_rank, char* recv_data);
+  /*!
   * \brief Get rank of local machine
   */
   inline int rank();
@@ -82,6 +103,18 @@ public:
   * \brief Get Recursive Halving map of this network
   */
   inline const RecursiveHalvingMap& recursive_halving_map();
+  /*!
+  * \brief Get hierarchical map of this network
+  */
+  inline const HierarchicalMap& hierarchical_map();
+  /*!
+  * \brief Get number of columns of the machine grid
+  */
+  inline int num_grid_columns();
+  /*!
+  * \brief Get communication statistics with each machine, calls are the number of sends and receives
+  */
+  inline const std::vector<NetworkStats>& peer_stats() const;
 
   #ifdef USE_SOCKET
   /*!
@@ -92,9 +125,10 @@ public:
   /*!
   * \brief Set socket to rank
   * \param rank
+  * \param stream Index of the stream to rank
   * \param socket
   */
-  void SetLinker(int rank, const TcpSocket& socket);
+  void SetLinker(int rank, int stream, const TcpSocket& socket);
   /*!
   * \brief Thread for listening
   * \param incoming_cnt Number of incoming machines
@@ -105,6 +139,11 @@ public:
   */
   void Construct();
   /*!
+  * \brief Replace TCP by shared memory ring buffers for linked machines with the same ip,
+  *        names of the segments are exchanged by the TCP linkers
+  */
+  void LinkSharedMemory();
+  /*!
   * \brief Parser machines information from file
   * \param filename
   */
@@ -122,8 +161,37 @@ public:
 
   #endif  // USE_SOCKET
 
-
 private:
+  /*! \brief Add sent bytes to the statistics of rank */
+  inline void AddSentBytes(int rank, int len) const;
+  /*! \brief Add received bytes and the time waited since start_time to the statistics of rank */
+  inline void AddRecvBytes(int rank, int len, std::chrono::high_resolution_clock::time_point start_time) const;
+
+  #ifdef USE_SOCKET
+  /*!
+  * \brief Get number of streams used for data of size len, chunks are at least kMinStreamChunkSize
+  * \param len Data size
+  */
+  inline int NumStreamsOf(int len) const;
+  /*!
+  * \brief Get the chunk of data of size len sent on one stream
+  * \param len Data size
+  * \param num_streams Number of streams used for the data
+  * \param stream Index of the stream
+  * \param start Output start of the chunk
+  * \param size Output size of the chunk
+  */
+  inline static void GetStreamChunk(int len, int num_streams, int stream, int* start, int* size);
+  /*!
+  * \brief Recv data split to streams, blocking
+  * \param rank Which rank will send data to local machine
+  * \param data Pointer of receive data
+  * \param len Recv size
+  * \param received Size already received from the first stream
+  */
+  inline void RecvStreams(int rank, char* data, int len, int received) const;
+  #endif  // USE_SOCKET
+
   /*! \brief Rank of local machine */
   int rank_;
   /*! \brief Total number machines */
@@ -132,8 +200,14 @@ private:
   BruckMap bruck_map_;
   /*! \brief Recursive Halving map */
   RecursiveHalvingMap recursive_halving_map_;
+  /*! \brief Hierarchical map */
+  HierarchicalMap hierarchical_map_;
+  /*! \brief Number of columns of the machine grid */
+  int num_grid_columns_;
 
   std::chrono::duration<double, std::milli> network_time_;
+  /*! \brief Communication statistics with each machine, updated by const send and recv functions */
+  mutable std::vector<NetworkStats> peer_stats_;
 
   #ifdef USE_SOCKET
   /*! \brief use to store client ips */
@@ -144,8 +218,18 @@ private:
   int socket_timeout_;
   /*! \brief Local listen ports */
   int local_listen_port_;
-  /*! \brief Linkers */
-  std::vector<std::unique_ptr<TcpSocket>> linkers_;
+  /*! \brief Number of streams to each linked machine */
+  int num_streams_;
+  /*! \brief Size of the send and receive buffers of each socket */
+  int socket_buffer_size_;
+  /*! \brief Linkers, [i][j] is the stream j to rank i */
+  std::vector<std::vector<std::unique_ptr<TcpSocket>>> linkers_;
+  /*! \brief Use shared memory for machines with the same ip */
+  bool use_shared_memory_;
+  /*! \brief Shared memory ring buffers to send data to each machine, nullptr if TCP is used */
+  std::vector<std::unique_ptr<ShmRingBuffer>> shm_send_;
+  /*! \brief Shared memory ring buffers to receive data from each machine, nullptr if TCP is used */
+  std::vector<std::unique_ptr<ShmRingBuffer>> shm_recv_;
   /*! \brief Local socket listener */
   std::unique_ptr<TcpSocket> listener_;
   #endif  // USE_SOCKET
@@ -168,32 +252,145 @@ inline const RecursiveHalvingMap& Linkers::recursive_halving_map() {
   return recursive_halving_map_;
 }
 
+inline const HierarchicalMap& Linkers::hierarchical_map() {
+  return hierarchical_map_;
+}
+
+inline int Linkers::num_grid_columns() {
+  return num_grid_columns_;
+}
+
+inline const std::vector<NetworkStats>& Linkers::peer_stats() const {
+  return peer_stats_;
+}
+
+inline void Linkers::AddSentBytes(int rank, int len) const {
+  ++peer_stats_[rank].calls;
+  peer_stats_[rank].sent_bytes += len;
+}
+
+inline void Linkers::AddRecvBytes(int rank, int len, std::chrono::high_resolution_clock::time_point start_time) const {
+  auto end_time = std::chrono::high_resolution_clock::now();
+  ++peer_stats_[rank].calls;
+  peer_stats_[rank].recv_bytes += len;
+  peer_stats_[rank].wait_ms += std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
+
 #ifdef USE_SOCKET
 
-inline void Linkers::Recv(int rank, char* data, int len) const {
-  int recv_cnt = 0;
-  while (recv_cnt < len) {
-    recv_cnt += linkers_[rank]->Recv(data + recv_cnt,
+inline int Linkers::NumStreamsOf(int len) const {
+  return std::max(1, std::min(num_streams_, len / SocketConfig::kMinStreamChunkSize));
+}
+
+inline void Linkers::GetStreamChunk(int len, int num_streams, int stream, int* start, int* size) {
+  *start = static_cast<int>(static_cast<int64_t>(len) * stream / num_streams);
+  *size = static_cast<int>(static_cast<int64_t>(len) * (stream + 1) / num_streams) - *start;
+}
+
+inline void Linkers::RecvStreams(int rank, char* data, int len, int received) const {
+  const int num_streams = NumStreamsOf(len);
+  // receive chunks of other streams in other threads
+  std::vector<std::thread> recv_workers;
+  for (int i = 1; i < num_streams; ++i) {
+    int start = 0;
+    int size = 0;
+    GetStreamChunk(len, num_streams, i, &start, &size);
+    TcpSocket* socket = linkers_[rank][i].get();
+    recv_workers.emplace_back([socket, data, start, size]() {
+      int recv_cnt = 0;
+      while (recv_cnt < size) {
+        recv_cnt += socket->Recv(data + start + recv_cnt, std::min(size - recv_cnt, SocketConfig::kMaxReceiveSize));
+      }
+    });
+  }
+  int start = 0;
+  int size = 0;
+  GetStreamChunk(len, num_streams, 0, &start, &size);
+  int recv_cnt = received;
+  while (recv_cnt < size) {
+    recv_cnt += linkers_[rank][0]->Recv(data + recv_cnt,
       //len - recv_cnt
-      std::min(len - recv_cnt, SocketConfig::kMaxReceiveSize)
+      std::min(size - recv_cnt, SocketConfig::kMaxReceiveSize)
     );
   }
+  for (auto& worker : recv_workers) {
+    worker.join();
+  }
+}
+
+inline void Linkers::Recv(int rank, char* data, int len) const {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  if (shm_recv_[rank] != nullptr) {
+    shm_recv_[rank]->Recv(data, len);
+  } else {
+    RecvStreams(rank, data, len, 0);
+  }
+  AddRecvBytes(rank, len, start_time);
 }
 
 inline void Linkers::Send(int rank, char* data, int len) const {
   if (len <= 0) {
     return;
   }
+  if (shm_send_[rank] != nullptr) {
+    shm_send_[rank]->Send(data, len);
+    AddSentBytes(rank, len);
+    return;
+  }
+  const int num_streams = NumStreamsOf(len);
+  // send chunks of other streams in other threads
+  std::vector<std::thread> send_workers;
+  for (int i = 1; i < num_streams; ++i) {
+    int start = 0;
+    int size = 0;
+    GetStreamChunk(len, num_streams, i, &start, &size);
+    TcpSocket* socket = linkers_[rank][i].get();
+    send_workers.emplace_back([socket, data, start, size]() {
+      int send_cnt = 0;
+      while (send_cnt < size) {
+        send_cnt += socket->Send(data + start + send_cnt, size - send_cnt);
+      }
+    });
+  }
+  int start = 0;
+  int size = 0;
+  GetStreamChunk(len, num_streams, 0, &start, &size);
   int send_cnt = 0;
-  while (send_cnt < len) {
-    send_cnt += linkers_[rank]->Send(data + send_cnt, len - send_cnt);
+  while (send_cnt < size) {
+    send_cnt += linkers_[rank][0]->Send(data + send_cnt, size - send_cnt);
+  }
+  for (auto& worker : send_workers) {
+    worker.join();
   }
+  AddSentBytes(rank, len);
+}
+
+inline int Linkers::RecvSized(int rank, char* data) const {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  // the size is at the start of the first stream
+  const int header_size = static_cast<int>(sizeof(int));
+  int len = 0;
+  if (shm_recv_[rank] != nullptr) {
+    shm_recv_[rank]->Recv(data, header_size);
+    std::memcpy(&len, data, header_size);
+    shm_recv_[rank]->Recv(data + header_size, len - header_size);
+    AddRecvBytes(rank, len, start_time);
+    return len;
+  }
+  int recv_cnt = 0;
+  while (recv_cnt < header_size) {
+    recv_cnt += linkers_[rank][0]->Recv(data + recv_cnt, header_size - recv_cnt);
+  }
+  std::memcpy(&len, data, header_size);
+  RecvStreams(rank, data, len, header_size);
+  AddRecvBytes(rank, len, start_time);
+  return len;
 }
 
 inline void Linkers::SendRecv(int send_rank, char* send_data, int send_len,
   int recv_rank, char* recv_data, int recv_len) {
   auto start_time = std::chrono::high_resolution_clock::now();
-  if (send_len < SocketConfig::kSocketBufferSize) {
+  if (send_len < socket_buffer_size_) {
     // if buffer is enough, send will non-blocking
     Send(send_rank, send_data, send_len);
     Recv(recv_rank, recv_data, recv_len);
@@ -212,11 +409,34 @@ inline void Linkers::SendRecv(int send_rank, char* send_data, int send_len,
   network_time_ += std::chrono::duration<double, std::milli>(end_time - start_time);
 }
 
+inline int Linkers::SendRecvSized(int send_rank, char* send_data, int send_len,
+  int recv_rank, char* recv_data) {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  int recv_len = 0;
+  if (send_len < socket_buffer_size_) {
+    // if buffer is enough, send will non-blocking
+    Send(send_rank, send_data, send_len);
+    recv_len = RecvSized(recv_rank, recv_data);
+  } else {
+    // if buffer is not enough, use another thread to send, since send will be blocking
+    std::thread send_worker(
+      [this, send_rank, send_data, send_len]() {
+      Send(send_rank, send_data, send_len);
+    });
+    recv_len = RecvSized(recv_rank, recv_data);
+    send_worker.join();
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+  network_time_ += std::chrono::duration<double, std::milli>(end_time - start_time);
+  return recv_len;
+}
+
 #endif  // USE_SOCKET
 
 #ifdef USE_MPI
 
 inline void Linkers::Recv(int rank, char* data, int len) const {
+  auto start_time = std::chrono::high_resolution_clock::now();
   MPI_Status status;
   int read_cnt = 0;
   while (read_cnt < len) {
@@ -225,6 +445,7 @@ inline void Linkers::Recv(int rank, char* data, int len) const {
     MPI_SAFE_CALL(MPI_Get_count(&status, MPI_BYTE, &cur_cnt));
     read_cnt += cur_cnt;
   }
+  AddRecvBytes(rank, len, start_time);
 }
 
 inline void Linkers::Send(int rank, char* data, int len) const {
@@ -235,6 +456,19 @@ inline void Linkers::Send(int rank, char* data, int len) const {
   MPI_Request send_request;
   MPI_SAFE_CALL(MPI_Isend(data, len, MPI_BYTE, rank, 0, MPI_COMM_WORLD, &send_request));
   MPI_SAFE_CALL(MPI_Wait(&send_request, &status));
+  AddSentBytes(rank, len);
+}
+
+inline int Linkers::RecvSized(int rank, char* data) const {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  // the whole message is received at once, its size is got by probing
+  MPI_Status status;
+  int len = 0;
+  MPI_SAFE_CALL(MPI_Probe(rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status));
+  MPI_SAFE_CALL(MPI_Get_count(&status, MPI_BYTE, &len));
+  MPI_SAFE_CALL(MPI_Recv(data, len, MPI_BYTE, rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status));
+  AddRecvBytes(rank, len, start_time);
+  return len;
 }
 
 inline void Linkers::SendRecv(int send_rank, char* send_data, int send_len,
@@ -243,6 +477,7 @@ inline void Linkers::SendRecv(int send_rank, char* send_data, int send_len,
   // send first, non-blocking
   MPI_SAFE_CALL(MPI_Isend(send_data, send_len, MPI_BYTE, send_rank, 0, MPI_COMM_WORLD, &send_request));
   // then receive, blocking
+  auto start_time = std::chrono::high_resolution_clock::now();
   MPI_Status status;
   int read_cnt = 0;
   while (read_cnt < recv_len) {
@@ -251,8 +486,24 @@ inline void Linkers::SendRecv(int send_rank, char* send_data, int send_len,
     MPI_SAFE_CALL(MPI_Get_count(&status, MPI_BYTE, &cur_cnt));
     read_cnt += cur_cnt;
   }
+  AddRecvBytes(recv_rank, recv_len, start_time);
+  // wait for send complete
+  MPI_SAFE_CALL(MPI_Wait(&send_request, &status));
+  AddSentBytes(send_rank, send_len);
+}
+
+inline int Linkers::SendRecvSized(int send_rank, char* send_data, int send_len,
+  int recv_rank, char* recv_data) {
+  MPI_Request send_request;
+  // send first, non-blocking
+  MPI_SAFE_CALL(MPI_Isend(send_data, send_len, MPI_BYTE, send_rank, 0, MPI_COMM_WORLD, &send_request));
+  // then receive, blocking
+  int recv_len = RecvSized(recv_rank, recv_data);
   // wait for send complete
+  MPI_Status status;
   MPI_SAFE_CALL(MPI_Wait(&send_request, &status));
+  AddSentBytes(send_rank, send_len);
+  return recv_len;
 }
 
 #endif  // USE_MPI
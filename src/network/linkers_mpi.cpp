@@ -1,6 +1,9 @@
 #ifdef USE_MPI
 #include "linkers.h"
 
+#include <string>
+#include <vector>
+
 namespace LightGBM {
 
 Linkers::Linkers(NetworkConfig config) {
@@ -13,10 +16,28 @@ Linkers::Linkers(NetworkConfig config) {
   }
   MPI_SAFE_CALL(MPI_Comm_size(MPI_COMM_WORLD, &num_machines_));
   MPI_SAFE_CALL(MPI_Comm_rank(MPI_COMM_WORLD, &rank_));
+  peer_stats_.resize(num_machines_);
+  num_grid_columns_ = config.num_grid_columns;
+  if (num_machines_ % num_grid_columns_ != 0) {
+    Log::Fatal("Number of machines %d should be a multiple of num_grid_columns %d", num_machines_, num_grid_columns_);
+  }
   // wait for all client start up
   MPI_SAFE_CALL(MPI_Barrier(MPI_COMM_WORLD));
   bruck_map_ = BruckMap::Construct(rank_, num_machines_);
   recursive_halving_map_ = RecursiveHalvingMap::Construct(rank_, num_machines_);
+  // group machines by processor names
+  char processor_name[MPI_MAX_PROCESSOR_NAME] = { 0 };
+  int name_len = 0;
+  MPI_SAFE_CALL(MPI_Get_processor_name(processor_name, &name_len));
+  std::vector<char> all_names(static_cast<size_t>(MPI_MAX_PROCESSOR_NAME) * num_machines_);
+  MPI_SAFE_CALL(MPI_Allgather(processor_name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
+                              all_names.data(), MPI_MAX_PROCESSOR_NAME, MPI_CHAR, MPI_COMM_WORLD));
+  std::vector<std::string> hosts;
+  for (int i = 0; i < num_machines_; ++i) {
+    const char* name = all_names.data() + static_cast<size_t>(MPI_MAX_PROCESSOR_NAME) * i;
+    hosts.emplace_back(name, strnlen(name, MPI_MAX_PROCESSOR_NAME));
+  }
+  hierarchical_map_ = HierarchicalMap::Construct(rank_, hosts);
 }
 
 Linkers::~Linkers() {
@@ -24,9 +24,19 @@ Linkers::Linkers(NetworkConfig config) {
   num_machines_ = config.num_machines;
   local_listen_port_ = config.local_listen_port;
   socket_timeout_ = config.time_out;
+  num_streams_ = config.num_network_streams;
+  socket_buffer_size_ = config.socket_buffer_size;
+  use_shared_memory_ = config.use_shared_memory;
   rank_ = -1;
   // parser clients from file
   ParseMachineList(config.machine_list_filename.c_str());
+  peer_stats_.resize(num_machines_);
+  shm_send_.resize(num_machines_);
+  shm_recv_.resize(num_machines_);
+  num_grid_columns_ = config.num_grid_columns;
+  if (num_machines_ % num_grid_columns_ != 0) {
+    Log::Fatal("Number of machines %d should be a multiple of num_grid_columns %d", num_machines_, num_grid_columns_);
+  }
 
   if (num_machines_ <= 1) {
     return;
@@ -48,26 +58,35 @@ Linkers::Linkers(NetworkConfig config) {
   }
   // construct listener
   listener_ = std::unique_ptr<TcpSocket>(new TcpSocket());
+  // accepted sockets get the buffer sizes of the listener
+  listener_->SetBufferSize(socket_buffer_size_);
   TryBind(local_listen_port_);
 
+  linkers_.resize(num_machines_);
   for (int i = 0; i < num_machines_; ++i) {
-    linkers_.push_back(nullptr);
+    linkers_[i].resize(num_streams_);
   }
 
   // construct communication topo
   bruck_map_ = BruckMap::Construct(rank_, num_machines_);
   recursive_halving_map_ = RecursiveHalvingMap::Construct(rank_, num_machines_);
+  hierarchical_map_ = HierarchicalMap::Construct(rank_, client_ips_);
 
   // construct linkers
   Construct();
   // free listener
   listener_->Close();
+  if (use_shared_memory_) {
+    LinkSharedMemory();
+  }
 }
 
 Linkers::~Linkers() {
   for (size_t i = 0; i < linkers_.size(); ++i) {
-    if (linkers_[i] != nullptr) {
-      linkers_[i]->Close();
+    for (size_t j = 0; j < linkers_[i].size(); ++j) {
+      if (linkers_[i][j] != nullptr) {
+        linkers_[i][j]->Close();
+      }
     }
   }
   TcpSocket::Finalize();
@@ -116,10 +135,11 @@ void Linkers::TryBind(int port) {
   }
 }
 
-void Linkers::SetLinker(int rank, const TcpSocket& socket) {
-  linkers_[rank].reset(new TcpSocket(socket));
+void Linkers::SetLinker(int rank, int stream, const TcpSocket& socket) {
+  linkers_[rank][stream].reset(new TcpSocket(socket));
+  linkers_[rank][stream]->SetBufferSize(socket_buffer_size_);
   // set timeout
-  linkers_[rank]->SetTimeout(socket_timeout_ * 1000 * 60);
+  linkers_[rank][stream]->SetTimeout(socket_timeout_ * 1000 * 60);
 }
 
 void Linkers::ListenThread(int incoming_cnt) {
@@ -132,17 +152,22 @@ void Linkers::ListenThread(int incoming_cnt) {
     if (handler.IsClosed()) {
       continue;
     }
-    // receive rank
+    // receive rank and stream
     int read_cnt = 0;
-    int size_of_int = static_cast<int>(sizeof(int));
-    while (read_cnt < size_of_int) {
-      int cur_read_cnt = handler.Recv(buffer + read_cnt, size_of_int - read_cnt);
+    int size_of_header = static_cast<int>(sizeof(int) * 2);
+    while (read_cnt < size_of_header) {
+      int cur_read_cnt = handler.Recv(buffer + read_cnt, size_of_header - read_cnt);
       read_cnt += cur_read_cnt;
     }
     int* ptr_in_rank = reinterpret_cast<int*>(buffer);
-    int in_rank = *ptr_in_rank;
+    int in_rank = ptr_in_rank[0];
+    int in_stream = ptr_in_rank[1];
+    if (in_rank < 0 || in_rank >= num_machines_ || in_stream < 0 || in_stream >= num_streams_) {
+      Log::Fatal("Wrong linker from rank %d stream %d, num_network_streams should be the same on all machines",
+                 in_rank, in_stream);
+    }
     // add new socket
-    SetLinker(in_rank, handler);
+    SetLinker(in_rank, in_stream, handler);
     ++connected_cnt;
   }
 }
@@ -162,6 +187,28 @@ void Linkers::Construct() {
       need_connect[recursive_halving_map_.ranks[i]] = 1;
     }
   }
+  if (hierarchical_map_.IsHierarchical()) {
+    if (hierarchical_map_.leader == rank_) {
+      // other machines in local host, and neighbors in the ring of leaders
+      for (auto local_rank : hierarchical_map_.local_ranks) {
+        need_connect[local_rank] = 1;
+      }
+      const int num_hosts = static_cast<int>(hierarchical_map_.leaders.size());
+      need_connect[hierarchical_map_.leaders[(hierarchical_map_.host_index + 1) % num_hosts]] = 1;
+      need_connect[hierarchical_map_.leaders[(hierarchical_map_.host_index - 1 + num_hosts) % num_hosts]] = 1;
+    } else {
+      need_connect[hierarchical_map_.leader] = 1;
+    }
+  }
+
+  const int num_grid_rows = num_machines_ / num_grid_columns_;
+  if (num_grid_columns_ > 1 && num_grid_rows > 1) {
+    // neighbors in the ring of the grid column
+    const int row = rank_ / num_grid_columns_;
+    const int column = rank_ % num_grid_columns_;
+    need_connect[((row + 1) % num_grid_rows) * num_grid_columns_ + column] = 1;
+    need_connect[((row - 1 + num_grid_rows) % num_grid_rows) * num_grid_columns_ + column] = 1;
+  }
 
   int need_connect_cnt = 0;
   int incoming_cnt = 0;
@@ -176,8 +223,8 @@ void Linkers::Construct() {
   }
   // start listener
   listener_->SetTimeout(socket_timeout_);
-  listener_->Listen(incoming_cnt);
-  std::thread listen_thread(&Linkers::ListenThread, this, incoming_cnt);
+  listener_->Listen(incoming_cnt * num_streams_);
+  std::thread listen_thread(&Linkers::ListenThread, this, incoming_cnt * num_streams_);
   const int connect_fail_retry_cnt = 20;
   const int connect_fail_delay_time = 10 * 1000;  // 10s
   // start connect
@@ -185,18 +232,23 @@ void Linkers::Construct() {
     int out_rank = it->first;
     // let smaller rank connect to larger rank
     if (out_rank > rank_) {
-      TcpSocket cur_socket;
-      for (int i = 0; i < connect_fail_retry_cnt; ++i) {
-        if (cur_socket.Connect(client_ips_[out_rank].c_str(), client_ports_[out_rank])) {
-          break;
-        } else {
-          Log::Warning("Connecting to rank %d failed, waiting for %d milliseconds", out_rank, connect_fail_delay_time);
-          std::this_thread::sleep_for(std::chrono::milliseconds(connect_fail_delay_time));
+      for (int stream = 0; stream < num_streams_; ++stream) {
+        TcpSocket cur_socket;
+        // buffer sizes should be set before connecting
+        cur_socket.SetBufferSize(socket_buffer_size_);
+        for (int i = 0; i < connect_fail_retry_cnt; ++i) {
+          if (cur_socket.Connect(client_ips_[out_rank].c_str(), client_ports_[out_rank])) {
+            break;
+          } else {
+            Log::Warning("Connecting to rank %d failed, waiting for %d milliseconds", out_rank, connect_fail_delay_time);
+            std::this_thread::sleep_for(std::chrono::milliseconds(connect_fail_delay_time));
+          }
         }
+        // send local rank and stream
+        const int header[2] = { rank_, stream };
+        cur_socket.Send(reinterpret_cast<const char*>(header), sizeof(header));
+        SetLinker(out_rank, stream, cur_socket);
       }
-      // send local rank
-      cur_socket.Send(reinterpret_cast<const char*>(&rank_), sizeof(rank_));
-      SetLinker(out_rank, cur_socket);
     }
   }
   // wait for listener
@@ -205,9 +257,74 @@ void Linkers::Construct() {
   PrintLinkers();
 }
 
+void Linkers::LinkSharedMemory() {
+  std::vector<int> local_ranks;
+  for (int i = 0; i < num_machines_; ++i) {
+    if (i != rank_ && CheckLinker(i) && client_ips_[i] == client_ips_[rank_]) {
+      local_ranks.push_back(i);
+    }
+  }
+  if (local_ranks.empty()) {
+    return;
+  }
+  auto send_all = [this](int rank, const char* data, int len) {
+    int send_cnt = 0;
+    while (send_cnt < len) {
+      send_cnt += linkers_[rank][0]->Send(data + send_cnt, len - send_cnt);
+    }
+  };
+  auto recv_all = [this](int rank, char* data, int len) {
+    int recv_cnt = 0;
+    while (recv_cnt < len) {
+      recv_cnt += linkers_[rank][0]->Recv(data + recv_cnt, len - recv_cnt);
+    }
+  };
+  // create segments for sending, listen ports are unique on the host, so are the names.
+  // messages are small, so they are buffered by the sockets and the steps don't block each other
+  std::vector<std::string> names(num_machines_);
+  for (int rank : local_ranks) {
+    names[rank] = "/lightgbm_" + std::to_string(local_listen_port_) + "_" + std::to_string(rank);
+    // remove the segment left by a crashed process
+    ShmRingBuffer::Unlink(names[rank]);
+    shm_send_[rank] = ShmRingBuffer::Create(names[rank], socket_buffer_size_, socket_timeout_);
+    // send an empty name if failed
+    const int len = shm_send_[rank] == nullptr ? 0 : static_cast<int>(names[rank].size());
+    send_all(rank, reinterpret_cast<const char*>(&len), sizeof(len));
+    send_all(rank, names[rank].c_str(), len);
+  }
+  // open segments for receiving, and tell the senders whether they are opened
+  for (int rank : local_ranks) {
+    int len = 0;
+    recv_all(rank, reinterpret_cast<char*>(&len), sizeof(len));
+    std::string name(len, '\0');
+    recv_all(rank, &name[0], len);
+    if (len > 0) {
+      shm_recv_[rank] = ShmRingBuffer::Open(name, socket_timeout_);
+    }
+    const char is_opened = shm_recv_[rank] != nullptr ? 1 : 0;
+    send_all(rank, &is_opened, 1);
+  }
+  int num_linked = 0;
+  for (int rank : local_ranks) {
+    char is_opened = 0;
+    recv_all(rank, &is_opened, 1);
+    if (is_opened == 0) {
+      shm_send_[rank].reset(nullptr);
+    }
+    // both sides have mapped the segment, its name is not needed any more
+    ShmRingBuffer::Unlink(names[rank]);
+    if (shm_send_[rank] != nullptr && shm_recv_[rank] != nullptr) {
+      ++num_linked;
+    }
+  }
+  Log::Info("Linked %d machines on the local host by shared memory", num_linked);
+}
+
 bool Linkers::CheckLinker(int rank) {
-  if (linkers_[rank] == nullptr || linkers_[rank]->IsClosed()) {
-    return false;
+  for (const auto& linker : linkers_[rank]) {
+    if (linker == nullptr || linker->IsClosed()) {
+      return false;
+    }
   }
   return true;
 }
@@ -7,18 +7,71 @@
 #include <cstring>
 #include <cstdlib>
 
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
 namespace LightGBM {
 
 // static member definition
 int Network::num_machines_;
 int Network::rank_;
+int Network::num_grid_columns_ = 1;
 std::unique_ptr<Linkers> Network::linkers_;
 BruckMap Network::bruck_map_;
 RecursiveHalvingMap Network::recursive_halving_map_;
+HierarchicalMap Network::hierarchical_map_;
 std::vector<int> Network::block_start_;
 std::vector<int>  Network::block_len_;
 int Network::buffer_size_;
 std::vector<char> Network::buffer_;
+std::vector<char> Network::recv_buffer_;
+NetworkPhase Network::phase_ = kOtherPhase;
+int Network::collective_depth_ = 0;
+std::vector<NetworkStats> Network::stats_(kNumNetworkPhases * kNumCollectiveTypes);
+std::vector<NetworkStats> Network::logged_stats_(kNumNetworkPhases * kNumCollectiveTypes);
+std::vector<NetworkStats> Network::logged_peer_stats_;
+
+class Network::CollectiveScope {
+public:
+  explicit CollectiveScope(NetworkCollectiveType type) : type_(type) {
+    is_outermost_ = (collective_depth_++ == 0) && linkers_ != nullptr;
+    if (is_outermost_) {
+      start_time_ = std::chrono::high_resolution_clock::now();
+      start_ = SumOfPeers();
+    }
+  }
+
+  ~CollectiveScope() {
+    --collective_depth_;
+    if (!is_outermost_) { return; }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    NetworkStats end = SumOfPeers();
+    NetworkStats& stats = stats_[phase_ * kNumCollectiveTypes + type_];
+    ++stats.calls;
+    stats.sent_bytes += end.sent_bytes - start_.sent_bytes;
+    stats.recv_bytes += end.recv_bytes - start_.recv_bytes;
+    stats.time_ms += std::chrono::duration<double, std::milli>(end_time - start_time_).count();
+    stats.wait_ms += end.wait_ms - start_.wait_ms;
+  }
+
+private:
+  static NetworkStats SumOfPeers() {
+    NetworkStats sum;
+    for (const auto& peer : linkers_->peer_stats()) {
+      sum.sent_bytes += peer.sent_bytes;
+      sum.recv_bytes += peer.recv_bytes;
+      sum.wait_ms += peer.wait_ms;
+    }
+    return sum;
+  }
+
+  NetworkCollectiveType type_;
+  bool is_outermost_;
+  std::chrono::high_resolution_clock::time_point start_time_;
+  NetworkStats start_;
+};
 
 void Network::Init(NetworkConfig config) {
   linkers_.reset(new Linkers(config));
@@ -26,6 +79,8 @@ void Network::Init(NetworkConfig config) {
   num_machines_ = linkers_->num_machines();
   bruck_map_ = linkers_->bruck_map();
   recursive_halving_map_ = linkers_->recursive_halving_map();
+  hierarchical_map_ = linkers_->hierarchical_map();
+  num_grid_columns_ = linkers_->num_grid_columns();
   block_start_ = std::vector<int>(num_machines_);
   block_len_ = std::vector<int>(num_machines_);
   buffer_size_ = 1024 * 1024;
@@ -37,13 +92,60 @@ void Network::Dispose() {
 
 }
 
+const std::vector<NetworkStats>& Network::PeerStats() {
+  static const std::vector<NetworkStats> empty_stats;
+  return linkers_ == nullptr ? empty_stats : linkers_->peer_stats();
+}
+
+void Network::LogStats() {
+  static const char* phase_names[kNumNetworkPhases] = { "other", "histogram", "split", "global sync" };
+  static const char* type_names[kNumCollectiveTypes] = { "Allreduce", "ReduceScatter", "Allgather" };
+  const double mb = 1.0 / (1024.0 * 1024.0);
+  for (int i = 0; i < kNumNetworkPhases * kNumCollectiveTypes; ++i) {
+    const NetworkStats& cur = stats_[i];
+    const NetworkStats& last = logged_stats_[i];
+    if (cur.calls == last.calls) { continue; }
+    Log::Info("Network %s %s: %lld calls, sent %.3f MB, received %.3f MB in %.3f ms, waited %.3f ms",
+              phase_names[i / kNumCollectiveTypes], type_names[i % kNumCollectiveTypes],
+              static_cast<long long>(cur.calls - last.calls), (cur.sent_bytes - last.sent_bytes) * mb,
+              (cur.recv_bytes - last.recv_bytes) * mb, cur.time_ms - last.time_ms, cur.wait_ms - last.wait_ms);
+  }
+  logged_stats_ = stats_;
+  // the machine waited for most is likely the straggler
+  const std::vector<NetworkStats>& peer_stats = PeerStats();
+  logged_peer_stats_.resize(peer_stats.size());
+  int max_wait_rank = -1;
+  double max_wait_ms = 0.0;
+  for (size_t i = 0; i < peer_stats.size(); ++i) {
+    const double wait_ms = peer_stats[i].wait_ms - logged_peer_stats_[i].wait_ms;
+    if (peer_stats[i].calls != logged_peer_stats_[i].calls) {
+      Log::Debug("Network rank %d: sent %.3f MB, received %.3f MB, waited %.3f ms", static_cast<int>(i),
+                 (peer_stats[i].sent_bytes - logged_peer_stats_[i].sent_bytes) * mb,
+                 (peer_stats[i].recv_bytes - logged_peer_stats_[i].recv_bytes) * mb, wait_ms);
+    }
+    if (wait_ms > max_wait_ms) {
+      max_wait_ms = wait_ms;
+      max_wait_rank = static_cast<int>(i);
+    }
+  }
+  if (max_wait_rank >= 0) {
+    Log::Info("Network waited most for rank %d: %.3f ms", max_wait_rank, max_wait_ms);
+  }
+  logged_peer_stats_ = peer_stats;
+}
+
 void Network::Allreduce(char* input, int input_size, int type_size, char* output, const ReduceFunction& reducer) {
+  CollectiveScope scope(kAllreduce);
   int count = input_size / type_size;
   // if small package or small count , do it by all gather.(reduce the communication times.)
   if (count < num_machines_ || input_size < 4096) {
     AllreduceByAllGather(input, input_size, output, reducer);
     return;
   }
+  if (UseHierarchy(input_size)) {
+    AllreduceByHierarchy(input, input_size, type_size, output, reducer);
+    return;
+  }
   // assign the blocks to every rank.
   int step = (count + num_machines_ - 1) / num_machines_;
   if (step < 1) {
@@ -55,6 +157,19 @@ void Network::Allreduce(char* input, int input_size, int type_size, char* output
     block_start_[i + 1] = block_start_[i] + block_len_[i];
   }
   block_len_[num_machines_ - 1] = input_size - block_start_[num_machines_ - 1];
+  if (UseRing(input_size)) {
+    // reduce scatter and all gather in place on output
+    if (output != input) {
+      std::memcpy(output, input, input_size);
+    }
+    const int next_rank = (rank_ + 1) % num_machines_;
+    const int prev_rank = (rank_ - 1 + num_machines_) % num_machines_;
+    RingPipeline(output, type_size, num_machines_, rank_, next_rank, prev_rank,
+                 block_start_.data(), block_len_.data(), -1, reducer);
+    RingPipeline(output, type_size, num_machines_, rank_, next_rank, prev_rank,
+                 block_start_.data(), block_len_.data(), 0, nullptr);
+    return;
+  }
   // do reduce scatter
   ReduceScatter(input, input_size, block_start_.data(), block_len_.data(), output, reducer);
   // do all gather
@@ -62,6 +177,7 @@ void Network::Allreduce(char* input, int input_size, int type_size, char* output
 }
 
 void Network::AllreduceByAllGather(char* input, int input_size, char* output, const ReduceFunction& reducer) {
+  CollectiveScope scope(kAllreduce);
   // assign blocks
   int all_size = input_size * num_machines_;
   block_start_[0] = 0;
@@ -85,6 +201,7 @@ void Network::AllreduceByAllGather(char* input, int input_size, char* output, co
 }
 
 void Network::Allgather(char* input, int send_size, char* output) {
+  CollectiveScope scope(kAllgather);
   // assign blocks
   block_start_[0] = 0;
   block_len_[0] = send_size;
@@ -97,6 +214,7 @@ void Network::Allgather(char* input, int send_size, char* output) {
 }
 
 void Network::Allgather(char* input, int all_size, const int* block_start, const int* block_len, char* output) {
+  CollectiveScope scope(kAllgather);
   int write_pos = 0;
   // use output as receive buffer
   std::memcpy(output, input, block_len[rank_]);
@@ -131,6 +249,7 @@ void Network::Allgather(char* input, int all_size, const int* block_start, const
 }
 
 void Network::ReduceScatter(char* input, int input_size, const int* block_start, const int* block_len, char* output, const ReduceFunction& reducer) {
+  CollectiveScope scope(kReduceScatter);
   bool is_powerof_2 = (num_machines_ & (num_machines_ - 1)) == 0;
   if (!is_powerof_2) {
     if (recursive_halving_map_.type == RecursiveHalvingNodeType::Other) {
@@ -184,4 +303,209 @@ void Network::ReduceScatter(char* input, int input_size, const int* block_start,
   std::memcpy(output, input + block_start[rank_], block_len[rank_]);
 }
 
+void Network::ReduceScatter(char* input, int input_size, const int* block_start, const int* block_len, char* output,
+  const EncodeFunction& encoder, const DecodeReduceFunction& decode_reducer) {
+  CollectiveScope scope(kReduceScatter);
+  // encoded data has at most one more byte than the raw data, and is sent after its size
+  const int header_size = static_cast<int>(sizeof(int));
+  const int max_message_size = header_size + input_size + 1;
+  if (max_message_size > buffer_size_) {
+    buffer_size_ = max_message_size;
+    buffer_.resize(buffer_size_);
+  }
+  if (max_message_size > static_cast<int>(recv_buffer_.size())) {
+    recv_buffer_.resize(max_message_size);
+  }
+  bool is_powerof_2 = (num_machines_ & (num_machines_ - 1)) == 0;
+  if (!is_powerof_2) {
+    if (recursive_halving_map_.type == RecursiveHalvingNodeType::Other) {
+      // send local data to neighbor first
+      int send_size = header_size + encoder(input, input_size, buffer_.data() + header_size);
+      std::memcpy(buffer_.data(), &send_size, header_size);
+      linkers_->Send(recursive_halving_map_.neighbor, buffer_.data(), send_size);
+    } else if (recursive_halving_map_.type == RecursiveHalvingNodeType::GroupLeader) {
+      // receive neighbor data first
+      int need_recv_cnt = linkers_->RecvSized(recursive_halving_map_.neighbor, recv_buffer_.data());
+      // reduce
+      decode_reducer(recv_buffer_.data() + header_size, need_recv_cnt - header_size, input, input_size);
+    }
+  }
+  // start recursive halfing
+  if (recursive_halving_map_.type != RecursiveHalvingNodeType::Other) {
+    for (int i = 0; i < recursive_halving_map_.k; ++i) {
+      // get target
+      int target = recursive_halving_map_.ranks[i];
+      int send_block_start = recursive_halving_map_.send_block_start[i];
+      int recv_block_start = recursive_halving_map_.recv_block_start[i];
+      // get send information
+      int send_size = 0;
+      for (int j = 0; j < recursive_halving_map_.send_block_len[i]; ++j) {
+        send_size += block_len[send_block_start + j];
+      }
+      // get recv information
+      int recv_size = 0;
+      for (int j = 0; j < recursive_halving_map_.recv_block_len[i]; ++j) {
+        recv_size += block_len[recv_block_start + j];
+      }
+      // send and recv at same time, encoded sizes are sent in front of the data
+      int encoded_send_size = header_size
+        + encoder(input + block_start[send_block_start], send_size, buffer_.data() + header_size);
+      std::memcpy(buffer_.data(), &encoded_send_size, header_size);
+      int need_recv_cnt = linkers_->SendRecvSized(target, buffer_.data(), encoded_send_size,
+                                                  target, recv_buffer_.data());
+      // reduce
+      decode_reducer(recv_buffer_.data() + header_size, need_recv_cnt - header_size,
+                     input + block_start[recv_block_start], recv_size);
+    }
+  }
+  if (!is_powerof_2) {
+    if (recursive_halving_map_.type == RecursiveHalvingNodeType::GroupLeader) {
+      // send result to neighbor
+      linkers_->Send(recursive_halving_map_.neighbor,
+                     input + block_start[recursive_halving_map_.neighbor],
+                     block_len[recursive_halving_map_.neighbor]);
+    } else if (recursive_halving_map_.type == RecursiveHalvingNodeType::Other) {
+      // receive result from neighbor
+      int need_recv_cnt = block_len[rank_];
+      linkers_->Recv(recursive_halving_map_.neighbor, output, need_recv_cnt);
+      return;
+    }
+  }
+  // copy result
+  std::memcpy(output, input + block_start[rank_], block_len[rank_]);
+}
+
+void Network::AllreduceByHierarchy(char* input, int input_size, int type_size, char* output,
+  const ReduceFunction& reducer) {
+  if (hierarchical_map_.leader != rank_) {
+    // other machines only communicate with the leader of their host
+    linkers_->Send(hierarchical_map_.leader, input, input_size);
+    linkers_->Recv(hierarchical_map_.leader, output, input_size);
+    return;
+  }
+  if (output != input) {
+    std::memcpy(output, input, input_size);
+  }
+  // reduce data in local host
+  if (input_size > static_cast<int>(recv_buffer_.size())) {
+    recv_buffer_.resize(input_size);
+  }
+  for (auto local_rank : hierarchical_map_.local_ranks) {
+    linkers_->Recv(local_rank, recv_buffer_.data(), input_size);
+    reducer(recv_buffer_.data(), output, input_size);
+  }
+  // all reduce among leaders by ring
+  const int num_hosts = static_cast<int>(hierarchical_map_.leaders.size());
+  const int host_index = hierarchical_map_.host_index;
+  const int count = input_size / type_size;
+  const int step = (count + num_hosts - 1) / num_hosts;
+  block_start_[0] = 0;
+  for (int i = 0; i < num_hosts - 1; ++i) {
+    block_len_[i] = std::min(step * type_size, input_size - block_start_[i]);
+    block_start_[i + 1] = block_start_[i] + block_len_[i];
+  }
+  block_len_[num_hosts - 1] = input_size - block_start_[num_hosts - 1];
+  const int next_rank = hierarchical_map_.leaders[(host_index + 1) % num_hosts];
+  const int prev_rank = hierarchical_map_.leaders[(host_index - 1 + num_hosts) % num_hosts];
+  RingPipeline(output, type_size, num_hosts, host_index, next_rank, prev_rank,
+               block_start_.data(), block_len_.data(), -1, reducer);
+  RingPipeline(output, type_size, num_hosts, host_index, next_rank, prev_rank,
+               block_start_.data(), block_len_.data(), 0, nullptr);
+  // send result back to local host
+  for (auto local_rank : hierarchical_map_.local_ranks) {
+    linkers_->Send(local_rank, output, input_size);
+  }
+}
+
+void Network::AllreduceInColumn(char* data, int input_size, int type_size, const ReduceFunction& reducer) {
+  CollectiveScope scope(kAllreduce);
+  const int num_rows = num_machines_ / num_grid_columns_;
+  const int count = input_size / type_size;
+  const int step = (count + num_rows - 1) / num_rows;
+  block_start_[0] = 0;
+  for (int i = 0; i < num_rows - 1; ++i) {
+    block_len_[i] = std::min(step * type_size, input_size - block_start_[i]);
+    block_start_[i + 1] = block_start_[i] + block_len_[i];
+  }
+  block_len_[num_rows - 1] = input_size - block_start_[num_rows - 1];
+  ReduceScatterInColumn(data, type_size, block_start_.data(), block_len_.data(), reducer);
+  const int row = rank_ / num_grid_columns_;
+  const int column = rank_ % num_grid_columns_;
+  const int next_rank = ((row + 1) % num_rows) * num_grid_columns_ + column;
+  const int prev_rank = ((row - 1 + num_rows) % num_rows) * num_grid_columns_ + column;
+  RingPipeline(data, type_size, num_rows, row, next_rank, prev_rank,
+               block_start_.data(), block_len_.data(), 0, nullptr);
+}
+
+void Network::ReduceScatterInColumn(char* data, int type_size, const int* block_start, const int* block_len,
+  const ReduceFunction& reducer) {
+  CollectiveScope scope(kReduceScatter);
+  const int num_rows = num_machines_ / num_grid_columns_;
+  const int row = rank_ / num_grid_columns_;
+  const int column = rank_ % num_grid_columns_;
+  const int next_rank = ((row + 1) % num_rows) * num_grid_columns_ + column;
+  const int prev_rank = ((row - 1 + num_rows) % num_rows) * num_grid_columns_ + column;
+  RingPipeline(data, type_size, num_rows, row, next_rank, prev_rank, block_start, block_len, -1, reducer);
+}
+
+void Network::RingPipeline(char* data, int type_size, int ring_size, int ring_index, int next_rank, int prev_rank,
+  const int* block_start, const int* block_len, int block_shift, const ReduceFunction& reducer) {
+  // chunks should contain whole objects of the reduce function
+  const int chunk_size = std::max(1, kRingChunkSize / type_size) * type_size;
+  auto block_of_step = [ring_size, ring_index, block_shift](int step) {
+    return ((ring_index - step + block_shift) % ring_size + 2 * ring_size) % ring_size;
+  };
+  auto num_chunks_of_block = [block_len, chunk_size](int block) {
+    return (block_len[block] + chunk_size - 1) / chunk_size;
+  };
+  // the block sent at step s is the block received at step s-1, so its chunk c can be sent
+  // once recv_chunk_start[s - 1] + c + 1 chunks are received
+  const int num_steps = ring_size - 1;
+  std::vector<int> recv_chunk_start(num_steps + 1, 0);
+  for (int step = 0; step < num_steps; ++step) {
+    recv_chunk_start[step + 1] = recv_chunk_start[step] + num_chunks_of_block(block_of_step(step + 1));
+  }
+  if (reducer && chunk_size > static_cast<int>(recv_buffer_.size())) {
+    recv_buffer_.resize(chunk_size);
+  }
+  std::mutex mutex;
+  std::condition_variable received_cv;
+  int num_received_chunks = 0;
+  std::thread send_worker([&]() {
+    for (int step = 0; step < num_steps; ++step) {
+      const int block = block_of_step(step);
+      const int num_chunks = num_chunks_of_block(block);
+      for (int c = 0; c < num_chunks; ++c) {
+        if (step > 0) {
+          std::unique_lock<std::mutex> lock(mutex);
+          const int need_received_chunks = recv_chunk_start[step - 1] + c + 1;
+          received_cv.wait(lock, [&]() { return num_received_chunks >= need_received_chunks; });
+        }
+        const int start = block_start[block] + c * chunk_size;
+        linkers_->Send(next_rank, data + start, std::min(chunk_size, block_start[block] + block_len[block] - start));
+      }
+    }
+  });
+  for (int step = 0; step < num_steps; ++step) {
+    const int block = block_of_step(step + 1);
+    const int num_chunks = num_chunks_of_block(block);
+    for (int c = 0; c < num_chunks; ++c) {
+      const int start = block_start[block] + c * chunk_size;
+      const int len = std::min(chunk_size, block_start[block] + block_len[block] - start);
+      if (reducer) {
+        linkers_->Recv(prev_rank, recv_buffer_.data(), len);
+        reducer(recv_buffer_.data(), data + start, len);
+      } else {
+        linkers_->Recv(prev_rank, data + start, len);
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++num_received_chunks;
+      }
+      received_cv.notify_one();
+    }
+  }
+  send_worker.join();
+}
+
 }  // namespace LightGBM
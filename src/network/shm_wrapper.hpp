@@ -0,0 +1,236 @@
+#ifndef LIGHTGBM_NETWORK_SHM_WRAPPER_HPP_
+#define LIGHTGBM_NETWORK_SHM_WRAPPER_HPP_
+#ifdef USE_SOCKET
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <LightGBM/utils/log.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+namespace LightGBM {
+
+/*!
+* \brief One way ring buffer in a POSIX shared memory segment, from one sender process to one receiver process
+*        on the same host. Data is copied into and out of the segment without system calls,
+*        waiting sides spin for a while, then yield, then sleep. Not supported on Windows, where Create returns nullptr
+*/
+class ShmRingBuffer {
+public:
+  /*!
+  * \brief Create a segment, called by the sender
+  * \param name Name of the segment, should be unique on the host
+  * \param capacity Size of the ring buffer
+  * \param timeout Time out of waiting, in minutes
+  * \return The ring buffer, nullptr if failed
+  */
+  static std::unique_ptr<ShmRingBuffer> Create(const std::string& name, size_t capacity, int timeout) {
+#ifndef _WIN32
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      return nullptr;
+    }
+    const size_t size = sizeof(Header) + capacity;
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      close(fd);
+      shm_unlink(name.c_str());
+      return nullptr;
+    }
+    std::unique_ptr<ShmRingBuffer> ring(Map(fd, size, timeout));
+    if (ring == nullptr) {
+      shm_unlink(name.c_str());
+      return nullptr;
+    }
+    new (ring->header_) Header();
+    ring->header_->capacity = capacity;
+    return ring;
+#else
+    return nullptr;
+#endif
+  }
+
+  /*!
+  * \brief Open a segment created by the sender, called by the receiver
+  * \param name Name of the segment
+  * \param timeout Time out of waiting, in minutes
+  * \return The ring buffer, nullptr if failed
+  */
+  static std::unique_ptr<ShmRingBuffer> Open(const std::string& name, int timeout) {
+#ifndef _WIN32
+    const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) <= sizeof(Header)) {
+      close(fd);
+      return nullptr;
+    }
+    return std::unique_ptr<ShmRingBuffer>(Map(fd, static_cast<size_t>(st.st_size), timeout));
+#else
+    return nullptr;
+#endif
+  }
+
+  /*! \brief Remove the name of a segment, the memory is freed after both sides unmap it */
+  static void Unlink(const std::string& name) {
+#ifndef _WIN32
+    shm_unlink(name.c_str());
+#endif
+  }
+
+  ~ShmRingBuffer() {
+#ifndef _WIN32
+    munmap(header_, size_);
+#endif
+  }
+
+  /*!
+  * \brief Send data, blocking until all data is in the ring buffer
+  * \param data Data
+  * \param len Size of data
+  */
+  void Send(const char* data, int len) {
+    const uint64_t capacity = header_->capacity;
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    size_t sent = 0;
+    while (sent < static_cast<size_t>(len)) {
+      uint64_t tail = header_->tail.load(std::memory_order_acquire);
+      if (head - tail == capacity) {
+        Wait([this, &tail, head, capacity]() {
+          tail = header_->tail.load(std::memory_order_acquire);
+          return head - tail < capacity;
+        });
+      }
+      const size_t size = std::min(static_cast<size_t>(capacity - (head - tail)), static_cast<size_t>(len) - sent);
+      Copy(data + sent, size, head % capacity);
+      head += size;
+      sent += size;
+      header_->head.store(head, std::memory_order_release);
+    }
+  }
+
+  /*!
+  * \brief Recv data, blocking until len size of data is received
+  * \param data Pointer of receive data
+  * \param len Recv size
+  */
+  void Recv(char* data, int len) {
+    const uint64_t capacity = header_->capacity;
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    size_t received = 0;
+    while (received < static_cast<size_t>(len)) {
+      uint64_t head = header_->head.load(std::memory_order_acquire);
+      if (head == tail) {
+        Wait([this, &head, tail]() {
+          head = header_->head.load(std::memory_order_acquire);
+          return head != tail;
+        });
+      }
+      const size_t size = std::min(static_cast<size_t>(head - tail), static_cast<size_t>(len) - received);
+      const size_t pos = tail % capacity;
+      const size_t first = std::min(size, static_cast<size_t>(capacity) - pos);
+      std::memcpy(data + received, buffer_ + pos, first);
+      std::memcpy(data + received + first, buffer_, size - first);
+      tail += size;
+      received += size;
+      header_->tail.store(tail, std::memory_order_release);
+    }
+  }
+
+  /*! \brief Disable copy */
+  ShmRingBuffer& operator=(const ShmRingBuffer&) = delete;
+  /*! \brief Disable copy */
+  ShmRingBuffer(const ShmRingBuffer&) = delete;
+
+private:
+  /*! \brief Header of the segment, head and tail are in different cache lines */
+  struct Header {
+    /*! \brief Total number of bytes written by the sender */
+    std::atomic<uint64_t> head;
+    char head_padding[64 - sizeof(std::atomic<uint64_t>)];
+    /*! \brief Total number of bytes read by the receiver */
+    std::atomic<uint64_t> tail;
+    char tail_padding[64 - sizeof(std::atomic<uint64_t>)];
+    /*! \brief Size of the ring buffer */
+    uint64_t capacity;
+    char capacity_padding[64 - sizeof(uint64_t)];
+
+    Header() : head(0), tail(0), capacity(0) {}
+  };
+
+  ShmRingBuffer(Header* header, size_t size, int timeout)
+    : header_(header), buffer_(reinterpret_cast<char*>(header) + sizeof(Header)), size_(size), timeout_(timeout) {
+  }
+
+#ifndef _WIN32
+  /*! \brief Map the segment and close its file descriptor */
+  static ShmRingBuffer* Map(int fd, size_t size, int timeout) {
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      return nullptr;
+    }
+    return new ShmRingBuffer(reinterpret_cast<Header*>(addr), size, timeout);
+  }
+#endif
+
+  /*! \brief Copy data into the ring buffer at pos, wraps around at the end */
+  inline void Copy(const char* data, size_t size, size_t pos) {
+    const size_t first = std::min(size, static_cast<size_t>(header_->capacity) - pos);
+    std::memcpy(buffer_ + pos, data, first);
+    std::memcpy(buffer_, data + first, size - first);
+  }
+
+  /*! \brief Wait until is_ready returns true, spin first since the other side is usually running */
+  template<typename Func>
+  void Wait(const Func& is_ready) const {
+    const auto start_time = std::chrono::steady_clock::now();
+    for (int i = 0; !is_ready(); ++i) {
+      if (i < kSpinCount) {
+        continue;
+      } else if (i < kYieldCount) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(kSleepMicroseconds));
+        if (std::chrono::steady_clock::now() - start_time > std::chrono::minutes(timeout_)) {
+          Log::Fatal("Waiting for shared memory peer timed out");
+        }
+      }
+    }
+  }
+
+  /*! \brief Number of checks before yielding */
+  static const int kSpinCount = 256;
+  /*! \brief Number of checks before sleeping */
+  static const int kYieldCount = 4096;
+  /*! \brief Sleep time between checks after yielding */
+  static const int kSleepMicroseconds = 50;
+
+  /*! \brief Header at the beginning of the segment */
+  Header* header_;
+  /*! \brief Ring buffer after the header */
+  char* buffer_;
+  /*! \brief Size of the mapped segment */
+  size_t size_;
+  /*! \brief Time out of waiting, in minutes */
+  int timeout_;
+};
+
+}  // namespace LightGBM
+#endif  // USE_SOCKET
+#endif   // LightGBM_NETWORK_SHM_WRAPPER_HPP_
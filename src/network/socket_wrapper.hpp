@@ -83,6 +83,7 @@ inline int inet_pton(int af, const char *src, void *dst)
 namespace SocketConfig {
 const int kSocketBufferSize = 10 * 1024 * 1024;
 const int kMaxReceiveSize = 2 * 1024 * 1024;
+const int kMinStreamChunkSize = 256 * 1024;
 const bool kNoDelay = true;
 }
 
@@ -123,6 +124,14 @@ public:
     setsockopt(sockfd_, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&SocketConfig::kSocketBufferSize), sizeof(SocketConfig::kSocketBufferSize));
     setsockopt(sockfd_, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&SocketConfig::kNoDelay), sizeof(SocketConfig::kNoDelay));
   }
+  inline void SetReuseAddress() {
+    const int reuse = 1;
+    setsockopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+  }
+  inline void SetBufferSize(int size) {
+    setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&size), sizeof(size));
+    setsockopt(sockfd_, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&size), sizeof(size));
+  }
 
   inline static void Startup() {
 #if defined(_WIN32)
@@ -270,6 +279,16 @@ public:
     return cur_cnt;
   }
 
+  inline void Shutdown() {
+    if (!IsClosed()) {
+#if defined(_WIN32)
+      shutdown(sockfd_, SD_BOTH);
+#else
+      shutdown(sockfd_, SHUT_RDWR);
+#endif
+    }
+  }
+
   inline bool IsClosed() {
     return sockfd_ == INVALID_SOCKET;
   }
@@ -58,33 +58,47 @@ public:
   }
 
   void GetGradients(const score_t* score, score_t* gradients, score_t* hessians) const override {
+    #pragma omp parallel for schedule(static)
+    for (data_size_t i = 0; i < num_data_; ++i) {
+      GetGradientsForOneData(i, score[i], gradients, hessians);
+    }
+  }
+
+  bool IsFusedGradientsSupported() const override { return true; }
+
+  void AddScoreAndGetGradients(score_t output, const data_size_t* data_indices, data_size_t num_data,
+                               score_t* score, score_t* gradients, score_t* hessians) const override {
+    for (data_size_t j = 0; j < num_data; ++j) {
+      const data_size_t i = data_indices[j];
+      score[i] += output;
+      GetGradientsForOneData(i, score[i], gradients, hessians);
+    }
+  }
+
+  /*!
+  * \brief Calculate gradients and hessians of one data
+  * \param i Index of data
+  * \param score Score of this data
+  * \param gradients Output gradients of all data
+  * \param hessians Output hessians of all data
+  */
+  inline void GetGradientsForOneData(data_size_t i, score_t score, score_t* gradients, score_t* hessians) const {
+    // get label and label weights
+    const int label = label_val_[static_cast<int>(label_[i])];
+    const score_t label_weight = label_weights_[static_cast<int>(label_[i])];
+    // calculate gradients and hessians
+    const score_t response = -2.0f * label * sigmoid_ / (1.0f + std::exp(2.0f * label * sigmoid_ * score));
+    const score_t abs_response = fabs(response);
     if (weights_ == nullptr) {
-      #pragma omp parallel for schedule(static)
-      for (data_size_t i = 0; i < num_data_; ++i) {
-        // get label and label weights
-        const int label = label_val_[static_cast<int>(label_[i])];
-        const score_t label_weight = label_weights_[static_cast<int>(label_[i])];
-        // calculate gradients and hessians
-        const score_t response = -2.0f * label * sigmoid_ / (1.0f + std::exp(2.0f * label * sigmoid_ * score[i]));
-        const score_t abs_response = fabs(response);
-        gradients[i] = response * label_weight;
-        hessians[i] = abs_response * (2.0f * sigmoid_ - abs_response) * label_weight;
-      }
+      gradients[i] = response * label_weight;
+      hessians[i] = abs_response * (2.0f * sigmoid_ - abs_response) * label_weight;
     } else {
-      #pragma omp parallel for schedule(static)
-      for (data_size_t i = 0; i < num_data_; ++i) {
-        // get label and label weights
-        const int label = label_val_[static_cast<int>(label_[i])];
-        const score_t label_weight = label_weights_[static_cast<int>(label_[i])];
-        // calculate gradients and hessians
-        const score_t response = -2.0f * label * sigmoid_ / (1.0f + std::exp(2.0f * label * sigmoid_ * score[i]));
-        const score_t abs_response = fabs(response);
-        gradients[i] = response * label_weight  * weights_[i];
-        hessians[i] = abs_response * (2.0f * sigmoid_ - abs_response) * label_weight * weights_[i];
-      }
+      gradients[i] = response * label_weight  * weights_[i];
+      hessians[i] = abs_response * (2.0f * sigmoid_ - abs_response) * label_weight * weights_[i];
     }
   }
 
+
   const char* GetName() const override {
     return "binary";
   }
@@ -7,6 +7,7 @@
 #include <cstdio>
 #include <cstring>
 #include <cmath>
+#include <cstdint>
 
 #include <vector>
 #include <algorithm>
@@ -29,6 +30,7 @@ public:
     label_gain_.shrink_to_fit();
     // will optimize NDCG@optimize_pos_at_
     optimize_pos_at_ = config.max_position;
+    truncation_level_ = config.lambdarank_truncation_level;
     sigmoid_table_.clear();
     inverse_max_dcgs_.clear();
     if (sigmoid_ <= 0.0) {
@@ -63,26 +65,143 @@ public:
     }
     // construct sigmoid table to speed up sigmoid transform
     ConstructSigmoidTable();
+    sorted_idx_.resize(num_data_);
+    ConstructWorkItems();
   }
 
   void GetGradients(const score_t* score, score_t* gradients,
                     score_t* hessians) const override {
+    // sort data in each query by score, and initialize with zero
     #pragma omp parallel for schedule(guided)
     for (data_size_t i = 0; i < num_queries_; ++i) {
-      GetGradientsForOneQuery(score, gradients, hessians, i);
+      SortOneQuery(score, gradients, hessians, i);
+    }
+    // accumulate lambdas by pairs, long queries are split into several work items
+    const int num_work_items = static_cast<int>(work_items_.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_work_items; ++i) {
+      const WorkItem& item = work_items_[i];
+      const data_size_t start = query_boundaries_[item.query_id];
+      if (item.buffer_offset < 0) {
+        AccumulatePairs(score, gradients + start, hessians + start, item);
+      } else {
+        const data_size_t cnt = query_boundaries_[item.query_id + 1] - start;
+        score_t* lambdas = item_lambdas_.data() + item.buffer_offset;
+        score_t* item_hessians = item_hessians_.data() + item.buffer_offset;
+        std::fill(lambdas, lambdas + cnt, 0.0f);
+        std::fill(item_hessians, item_hessians + cnt, 0.0f);
+        AccumulatePairs(score, lambdas, item_hessians, item);
+      }
+    }
+    // merge split queries and apply weights
+    #pragma omp parallel for schedule(guided)
+    for (data_size_t i = 0; i < num_queries_; ++i) {
+      FinishOneQuery(gradients, hessians, i);
+    }
+  }
+
+  inline score_t GetSigmoid(score_t score) const {
+    if (score <= min_sigmoid_input_) {
+      // too small, use lower bound
+      return sigmoid_table_[0];
+    } else if (score >= max_sigmoid_input_) {
+      // too big, use upper bound
+      return sigmoid_table_[_sigmoid_bins - 1];
+    } else {
+      return sigmoid_table_[static_cast<size_t>((score - min_sigmoid_input_) * sigmoid_table_idx_factor_)];
     }
   }
 
-  inline void GetGradientsForOneQuery(const score_t* score,
-              score_t* lambdas, score_t* hessians, data_size_t query_id) const {
+  void ConstructSigmoidTable() {
+    // get boundary
+    min_sigmoid_input_ = min_sigmoid_input_ / sigmoid_ / 2;
+    max_sigmoid_input_ = -min_sigmoid_input_;
+    sigmoid_table_.resize(_sigmoid_bins);
+    // get score to bin factor
+    sigmoid_table_idx_factor_ =
+      _sigmoid_bins / (max_sigmoid_input_ - min_sigmoid_input_);
+    // cache
+    for (size_t i = 0; i < _sigmoid_bins; ++i) {
+      const score_t score = i / sigmoid_table_idx_factor_ + min_sigmoid_input_;
+      sigmoid_table_[i] = 2.0f / (1.0f + std::exp(2.0f * score * sigmoid_));
+    }
+  }
+
+  const char* GetName() const override {
+    return "lambdarank";
+  }
+
+private:
+  /*! \brief Pairs of a query whose higher ranked data is in sorted positions [begin, end) */
+  struct WorkItem {
+    data_size_t query_id;
+    data_size_t begin;
+    data_size_t end;
+    /*! \brief Offset of output buffers if the query is split, otherwise -1 and write to gradients directly */
+    int buffer_offset;
+  };
+
+  /*! \brief Truncation level of a query with cnt data */
+  inline data_size_t TruncationLevel(data_size_t cnt) const {
+    return truncation_level_ > 0 ? std::min(static_cast<data_size_t>(truncation_level_), cnt) : cnt;
+  }
+
+  /*!
+  * \brief Split queries into work items with about kPairsPerWorkItem pairs, so long queries are balanced across threads.
+  *        It doesn't depend on the number of threads, so gradients are the same for any number of threads
+  */
+  void ConstructWorkItems() {
+    // number of pairs of data at sorted position i
+    auto num_pairs = [this](data_size_t cnt, data_size_t i) {
+      const data_size_t truncation_level = TruncationLevel(cnt);
+      return static_cast<int64_t>(i < truncation_level ? cnt : truncation_level);
+    };
+    const int64_t pairs_per_item = kPairsPerWorkItem;
+    work_items_.clear();
+    query_work_items_.assign(1, 0);
+    int buffer_size = 0;
+    for (data_size_t q = 0; q < num_queries_; ++q) {
+      const data_size_t cnt = query_boundaries_[q + 1] - query_boundaries_[q];
+      const size_t first_item = work_items_.size();
+      WorkItem item = { q, 0, 0, -1 };
+      int64_t cur_pairs = 0;
+      for (data_size_t i = 0; i < cnt; ++i) {
+        cur_pairs += num_pairs(cnt, i);
+        if (cur_pairs >= pairs_per_item && i + 1 < cnt) {
+          item.end = i + 1;
+          work_items_.push_back(item);
+          item.begin = i + 1;
+          cur_pairs = 0;
+        }
+      }
+      item.end = cnt;
+      work_items_.push_back(item);
+      if (work_items_.size() - first_item > 1) {
+        for (size_t k = first_item; k < work_items_.size(); ++k) {
+          work_items_[k].buffer_offset = buffer_size;
+          buffer_size += cnt;
+        }
+      }
+      query_work_items_.push_back(static_cast<int>(work_items_.size()));
+    }
+    item_lambdas_.resize(buffer_size);
+    item_hessians_.resize(buffer_size);
+  }
+
+  /*!
+  * \brief Sort data of a query by score into sorted_idx_, and clear its gradients
+  * \param score Scores of all data
+  * \param lambdas Gradients of all data
+  * \param hessians Hessians of all data
+  * \param query_id Index of query
+  */
+  inline void SortOneQuery(const score_t* score, score_t* lambdas, score_t* hessians,
+                           data_size_t query_id) const {
     // get doc boundary for current query
     const data_size_t start = query_boundaries_[query_id];
     const data_size_t cnt =
       query_boundaries_[query_id + 1] - query_boundaries_[query_id];
-    // get max DCG on current query
-    const score_t inverse_max_dcg = inverse_max_dcgs_[query_id];
     // add pointers with offset
-    const float* label = label_ + start;
     score += start;
     lambdas += start;
     hessians += start;
@@ -92,12 +211,34 @@ public:
       hessians[i] = 0.0f;
     }
     // get sorted indices for scores
-    std::vector<data_size_t> sorted_idx;
+    data_size_t* sorted_idx = sorted_idx_.data() + start;
     for (data_size_t i = 0; i < cnt; ++i) {
-      sorted_idx.emplace_back(i);
+      sorted_idx[i] = i;
     }
-    std::sort(sorted_idx.begin(), sorted_idx.end(),
+    std::sort(sorted_idx, sorted_idx + cnt,
              [score](data_size_t a, data_size_t b) { return score[a] > score[b]; });
+  }
+
+  /*!
+  * \brief Accumulate lambdas of the pairs whose higher ranked data is in the range of a work item
+  * \param score Scores of all data
+  * \param lambdas Output gradients of the query
+  * \param hessians Output hessians of the query
+  * \param item Work item
+  */
+  inline void AccumulatePairs(const score_t* score, score_t* lambdas, score_t* hessians,
+                              const WorkItem& item) const {
+    const data_size_t start = query_boundaries_[item.query_id];
+    const data_size_t cnt =
+      query_boundaries_[item.query_id + 1] - query_boundaries_[item.query_id];
+    // get max DCG on current query
+    const score_t inverse_max_dcg = inverse_max_dcgs_[item.query_id];
+    // add pointers with offset
+    const float* label = label_ + start;
+    score += start;
+    const data_size_t* sorted_idx = sorted_idx_.data() + start;
+    // pairs that both data are after truncation level are skipped
+    const data_size_t truncation_level = TruncationLevel(cnt);
     // get best and worst score
     const score_t best_score = score[sorted_idx[0]];
     data_size_t worst_idx = cnt - 1;
@@ -106,7 +247,7 @@ public:
     }
     const score_t wrost_score = score[sorted_idx[worst_idx]];
     // start accmulate lambdas by pairs
-    for (data_size_t i = 0; i < cnt; ++i) {
+    for (data_size_t i = item.begin; i < item.end; ++i) {
       const data_size_t high = sorted_idx[i];
       const int high_label = static_cast<int>(label[high]);
       const score_t high_score = score[high];
@@ -115,7 +256,8 @@ public:
       const score_t high_discount = DCGCalculator::GetDiscount(i);
       score_t high_sum_lambda = 0.0;
       score_t high_sum_hessian = 0.0;
-      for (data_size_t j = 0; j < cnt; ++j) {
+      const data_size_t num_low = i < truncation_level ? cnt : truncation_level;
+      for (data_size_t j = 0; j < num_low; ++j) {
         // skip same data
         if (i == j) { continue; }
 
@@ -154,6 +296,28 @@ public:
       lambdas[high] += high_sum_lambda;
       hessians[high] += high_sum_hessian;
     }
+  }
+
+  /*!
+  * \brief Sum the outputs of the work items of a split query, and apply weights
+  * \param lambdas Gradients of all data
+  * \param hessians Hessians of all data
+  * \param query_id Index of query
+  */
+  inline void FinishOneQuery(score_t* lambdas, score_t* hessians, data_size_t query_id) const {
+    const data_size_t start = query_boundaries_[query_id];
+    const data_size_t cnt =
+      query_boundaries_[query_id + 1] - query_boundaries_[query_id];
+    lambdas += start;
+    hessians += start;
+    for (int k = query_work_items_[query_id]; k < query_work_items_[query_id + 1]; ++k) {
+      const int buffer_offset = work_items_[k].buffer_offset;
+      if (buffer_offset < 0) { break; }
+      for (data_size_t i = 0; i < cnt; ++i) {
+        lambdas[i] += item_lambdas_[buffer_offset + i];
+        hessians[i] += item_hessians_[buffer_offset + i];
+      }
+    }
     // if need weights
     if (weights_ != nullptr) {
       for (data_size_t i = 0; i < cnt; ++i) {
@@ -163,39 +327,6 @@ public:
     }
   }
 
-
-  inline score_t GetSigmoid(score_t score) const {
-    if (score <= min_sigmoid_input_) {
-      // too small, use lower bound
-      return sigmoid_table_[0];
-    } else if (score >= max_sigmoid_input_) {
-      // too big, use upper bound
-      return sigmoid_table_[_sigmoid_bins - 1];
-    } else {
-      return sigmoid_table_[static_cast<size_t>((score - min_sigmoid_input_) * sigmoid_table_idx_factor_)];
-    }
-  }
-
-  void ConstructSigmoidTable() {
-    // get boundary
-    min_sigmoid_input_ = min_sigmoid_input_ / sigmoid_ / 2;
-    max_sigmoid_input_ = -min_sigmoid_input_;
-    sigmoid_table_.resize(_sigmoid_bins);
-    // get score to bin factor
-    sigmoid_table_idx_factor_ =
-      _sigmoid_bins / (max_sigmoid_input_ - min_sigmoid_input_);
-    // cache
-    for (size_t i = 0; i < _sigmoid_bins; ++i) {
-      const score_t score = i / sigmoid_table_idx_factor_ + min_sigmoid_input_;
-      sigmoid_table_[i] = 2.0f / (1.0f + std::exp(2.0f * score * sigmoid_));
-    }
-  }
-
-  const char* GetName() const override {
-    return "lambdarank";
-  }
-
-private:
   /*! \brief Gains for labels */
   std::vector<score_t> label_gain_;
   /*! \brief Cache inverse max DCG, speed up calculation */
@@ -224,6 +355,20 @@ private:
   score_t max_sigmoid_input_ = 50;
   /*! \brief Factor that covert score to bin in sigmoid table */
   score_t sigmoid_table_idx_factor_;
+  /*! \brief Truncation level of pairs, <= 0 means all pairs */
+  int truncation_level_;
+  /*! \brief Buffer of indices of each query sorted by score, at the offset of the query */
+  mutable std::vector<data_size_t> sorted_idx_;
+  /*! \brief Work items of pairs, in the order of queries */
+  std::vector<WorkItem> work_items_;
+  /*! \brief Work items of query i are [query_work_items_[i], query_work_items_[i + 1]) */
+  std::vector<int> query_work_items_;
+  /*! \brief Output gradients of work items of split queries */
+  mutable std::vector<score_t> item_lambdas_;
+  /*! \brief Output hessians of work items of split queries */
+  mutable std::vector<score_t> item_hessians_;
+  /*! \brief Number of pairs in a work item, queries with less pairs are not split */
+  static const int64_t kPairsPerWorkItem = 1 << 18;
 };
 
 }  // namespace LightGBM
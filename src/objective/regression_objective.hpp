@@ -38,6 +38,29 @@ public:
     }
   }
 
+  bool IsConstantHessian() const override { return weights_ == nullptr; }
+
+  bool IsFusedGradientsSupported() const override { return true; }
+
+  void AddScoreAndGetGradients(score_t output, const data_size_t* data_indices, data_size_t num_data,
+                               score_t* score, score_t* gradients, score_t* hessians) const override {
+    if (weights_ == nullptr) {
+      for (data_size_t j = 0; j < num_data; ++j) {
+        const data_size_t i = data_indices[j];
+        score[i] += output;
+        gradients[i] = (score[i] - label_[i]);
+        hessians[i] = 1.0;
+      }
+    } else {
+      for (data_size_t j = 0; j < num_data; ++j) {
+        const data_size_t i = data_indices[j];
+        score[i] += output;
+        gradients[i] = (score[i] - label_[i]) * weights_[i];
+        hessians[i] = weights_[i];
+      }
+    }
+  }
+
   const char* GetName() const override {
     return "regression";
   }
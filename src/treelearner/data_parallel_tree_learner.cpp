@@ -4,11 +4,13 @@
 
 #include <tuple>
 #include <vector>
+#include <thread>
 
 namespace LightGBM {
 
 DataParallelTreeLearner::DataParallelTreeLearner(const TreeConfig& tree_config)
   :SerialTreeLearner(tree_config) {
+  num_pipeline_blocks_ = tree_config.histogram_pipeline_blocks;
 }
 
 DataParallelTreeLearner::~DataParallelTreeLearner() {
@@ -24,7 +26,7 @@ void DataParallelTreeLearner::Init(const Dataset* train_data) {
   // allocate buffer for communication
   size_t buffer_size = 0;
   for (int i = 0; i < num_features_; ++i) {
-    buffer_size += train_data_->FeatureAt(i)->num_bin() * sizeof(HistogramBinEntry);
+    buffer_size += HistogramSizeInByte(i);
   }
 
   input_buffer_.resize(buffer_size);
@@ -32,8 +34,13 @@ void DataParallelTreeLearner::Init(const Dataset* train_data) {
 
   is_feature_aggregated_.resize(num_features_);
 
-  block_start_.resize(num_machines_);
-  block_len_.resize(num_machines_);
+  block_start_.resize(num_pipeline_blocks_ * num_machines_);
+  block_len_.resize(num_pipeline_blocks_ * num_machines_);
+  pipeline_block_start_.resize(num_pipeline_blocks_);
+  pipeline_block_size_.resize(num_pipeline_blocks_);
+  pipeline_output_start_.resize(num_pipeline_blocks_);
+  pipeline_features_.resize(num_pipeline_blocks_);
+  pipeline_aggregated_features_.resize(num_pipeline_blocks_);
 
   buffer_write_start_pos_.resize(num_features_);
   buffer_read_start_pos_.resize(num_features_);
@@ -42,6 +49,12 @@ void DataParallelTreeLearner::Init(const Dataset* train_data) {
 
 
 
+void DataParallelTreeLearner::AddMemoryUsage(MemoryUsage* memory_usage) const {
+  SerialTreeLearner::AddMemoryUsage(memory_usage);
+  // buffers of network
+  memory_usage->Add(kTreeLearnerMemory, input_buffer_.capacity() + output_buffer_.capacity());
+}
+
 void DataParallelTreeLearner::BeforeTrain() {
   SerialTreeLearner::BeforeTrain();
   // generate feature partition for current tree
@@ -60,35 +73,44 @@ void DataParallelTreeLearner::BeforeTrain() {
     is_feature_aggregated_[fid] = true;
   }
 
-  // get block start and block len for reduce scatter
-  reduce_scatter_size_ = 0;
-  for (int i = 0; i < num_machines_; ++i) {
-    block_len_[i] = 0;
-    for (auto fid : feature_distribution[i]) {
-      block_len_[i] += train_data_->FeatureAt(fid)->num_bin() * sizeof(HistogramBinEntry);
-    }
-    reduce_scatter_size_ += block_len_[i];
-  }
-
-  block_start_[0] = 0;
-  for (int i = 1; i < num_machines_; ++i) {
-    block_start_[i] = block_start_[i - 1] + block_len_[i - 1];
-  }
-
-  // get buffer_write_start_pos_
+  // split features of each machine into pipeline blocks, the buffer is laid out block by block, then machine by machine
   int bin_size = 0;
-  for (int i = 0; i < num_machines_; ++i) {
-    for (auto fid : feature_distribution[i]) {
-      buffer_write_start_pos_[fid] = bin_size;
-      bin_size += train_data_->FeatureAt(fid)->num_bin() * sizeof(HistogramBinEntry);
+  int read_bin_size = 0;
+  for (int block = 0; block < num_pipeline_blocks_; ++block) {
+    pipeline_features_[block].clear();
+    pipeline_aggregated_features_[block].clear();
+    pipeline_block_start_[block] = bin_size;
+    pipeline_output_start_[block] = read_bin_size;
+    for (int i = 0; i < num_machines_; ++i) {
+      const int num_machine_features = static_cast<int>(feature_distribution[i].size());
+      block_start_[block * num_machines_ + i] = bin_size - pipeline_block_start_[block];
+      for (int j = 0; j < num_machine_features; ++j) {
+        if (static_cast<int64_t>(j) * num_pipeline_blocks_ / num_machine_features != block) { continue; }
+        const int fid = feature_distribution[i][j];
+        pipeline_features_[block].push_back(fid);
+        // get buffer_write_start_pos_
+        buffer_write_start_pos_[fid] = bin_size;
+        bin_size += HistogramSizeInByte(fid);
+        // get buffer_read_start_pos_
+        if (i == rank_) {
+          pipeline_aggregated_features_[block].push_back(fid);
+          buffer_read_start_pos_[fid] = read_bin_size;
+          read_bin_size += HistogramSizeInByte(fid);
+        }
+      }
+      block_len_[block * num_machines_ + i] = bin_size - pipeline_block_start_[block] - block_start_[block * num_machines_ + i];
     }
+    pipeline_block_size_[block] = bin_size - pipeline_block_start_[block];
   }
-
-  // get buffer_read_start_pos_
-  bin_size = 0;
-  for (auto fid : feature_distribution[rank_]) {
-    buffer_read_start_pos_[fid] = bin_size;
-    bin_size += train_data_->FeatureAt(fid)->num_bin() * sizeof(HistogramBinEntry);
+  // integer and real histograms are mixed in the buffer if gradients are quantized
+  if (use_quantized_grad_) {
+    histogram_layout_.Reset(input_buffer_.data());
+    for (int block = 0; block < num_pipeline_blocks_; ++block) {
+      for (int fid : pipeline_features_[block]) {
+        histogram_layout_.Add(buffer_write_start_pos_[fid], HistogramSizeInByte(fid), is_histogram_int_[fid]);
+      }
+    }
+    histogram_layout_.Finish();
   }
 
   // sync global data sumup info
@@ -97,6 +119,7 @@ void DataParallelTreeLearner::BeforeTrain() {
   int size = sizeof(data);
   std::memcpy(input_buffer_.data(), &data, size);
   // global sumup reduce
+  Network::SetPhase(kGlobalSyncPhase);
   Network::Allreduce(input_buffer_.data(), size, size, output_buffer_.data(), [](const char *src, char *dst, int len) {
     int used_size = 0;
     int type_size = sizeof(std::tuple<data_size_t, double, double>);
@@ -113,8 +136,9 @@ void DataParallelTreeLearner::BeforeTrain() {
       used_size += type_size;
     }
   });
+  Network::SetPhase(kOtherPhase);
   // copy back
-  std::memcpy(&data, output_buffer_.data(), size);
+  std::memcpy(static_cast<void*>(&data), output_buffer_.data(), size);
   // set global sumup info
   smaller_leaf_splits_->Init(std::get<1>(data), std::get<2>(data));
   // init global data count in leaf
@@ -123,43 +147,94 @@ void DataParallelTreeLearner::BeforeTrain() {
 
 void DataParallelTreeLearner::FindBestThresholds() {
   // construct local histograms
-  #pragma omp parallel for schedule(guided)
-  for (int feature_index = 0; feature_index < num_features_; ++feature_index) {
-    if ((is_feature_used_.size() > 0 && is_feature_used_[feature_index] == false)) continue;
-    // construct histograms for smaller leaf
-    if (ordered_bins_[feature_index] == nullptr) {
-      smaller_leaf_histogram_array_[feature_index].Construct(smaller_leaf_splits_->data_indices(),
-                                                             smaller_leaf_splits_->num_data_in_leaf(),
-                                                             smaller_leaf_splits_->sum_gradients(),
-                                                             smaller_leaf_splits_->sum_hessians(),
-                                                             ptr_to_ordered_gradients_smaller_leaf_,
-                                                             ptr_to_ordered_hessians_smaller_leaf_);
+  bool is_dense_constructed = ConstructRowParallelHistograms(smaller_leaf_splits_.get(),
+    ptr_to_ordered_gradients_smaller_leaf_, ptr_to_ordered_hessians_smaller_leaf_, smaller_leaf_histogram_array_);
+  if (!feature_groups_.empty() || train_data_->num_feature_bundles() > 0) {
+    ConstructGroupedHistograms(smaller_leaf_splits_.get(), ptr_to_ordered_gradients_smaller_leaf_,
+      ptr_to_ordered_hessians_smaller_leaf_, smaller_leaf_histogram_array_);
+  }
+  // the reduce of a block overlaps with constructing the next block and finding splits of the previous block
+  std::thread reduce_worker;
+  for (int block = 0; block < num_pipeline_blocks_; ++block) {
+    const std::vector<int>& features = pipeline_features_[block];
+    #pragma omp parallel for schedule(guided)
+    for (int i = 0; i < static_cast<int>(features.size()); ++i) {
+      const int feature_index = features[i];
+      // construct histograms for smaller leaf
+      if (is_feature_grouped_[feature_index]
+        || (is_dense_constructed && ordered_bins_[feature_index] == nullptr)) {
+        // already constructed
+      } else if (ordered_bins_[feature_index] == nullptr) {
+        ConstructDenseHistogram(feature_index, smaller_leaf_splits_.get(),
+                                ptr_to_ordered_gradients_smaller_leaf_,
+                                ptr_to_ordered_hessians_smaller_leaf_,
+                                ptr_to_ordered_grad_hess_smaller_leaf_,
+                                ptr_to_ordered_bf16_grad_hess_smaller_leaf_,
+                                smaller_leaf_histogram_array_);
+      } else {
+        smaller_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
+                                                               smaller_leaf_splits_->LeafIndex(),
+                                                               smaller_leaf_splits_->num_data_in_leaf(),
+                                                               smaller_leaf_splits_->sum_gradients(),
+                                                               smaller_leaf_splits_->sum_hessians(),
+                                                               gradients_,
+                                                               HistogramHessians());
+      }
+      // copy to buffer
+      std::memcpy(input_buffer_.data() + buffer_write_start_pos_[feature_index],
+                  smaller_leaf_histogram_array_[feature_index].HistogramData(),
+                  smaller_leaf_histogram_array_[feature_index].SizeOfHistgram());
+    }
+    // blocks share the network buffers, so only one reduce runs at a time
+    if (reduce_worker.joinable()) {
+      reduce_worker.join();
+    }
+    if (num_pipeline_blocks_ > 1) {
+      reduce_worker = std::thread([this, block] { ReducePipelineBlock(block); });
     } else {
-      smaller_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
-                                                             smaller_leaf_splits_->LeafIndex(),
-                                                             smaller_leaf_splits_->num_data_in_leaf(),
-                                                             smaller_leaf_splits_->sum_gradients(),
-                                                             smaller_leaf_splits_->sum_hessians(),
-                                                             gradients_,
-                                                             hessians_);
+      ReducePipelineBlock(block);
+    }
+    if (block > 0) {
+      FindBestThresholdsOfPipelineBlock(block - 1);
     }
-    // copy to buffer
-    std::memcpy(input_buffer_.data() + buffer_write_start_pos_[feature_index],
-                smaller_leaf_histogram_array_[feature_index].HistogramData(),
-                smaller_leaf_histogram_array_[feature_index].SizeOfHistgram());
   }
+  if (reduce_worker.joinable()) {
+    reduce_worker.join();
+  }
+  FindBestThresholdsOfPipelineBlock(num_pipeline_blocks_ - 1);
+}
 
-  // Reduce scatter for histogram
-  Network::ReduceScatter(input_buffer_.data(), reduce_scatter_size_, block_start_.data(),
-                         block_len_.data(), output_buffer_.data(), &HistogramBinEntry::SumReducer);
+void DataParallelTreeLearner::ReducePipelineBlock(int block) {
+  Network::SetPhase(kHistogramPhase);
+  // Reduce scatter for histogram, empty bins are not sent
+  if (use_quantized_grad_) {
+    const HistogramBufferLayout& layout = histogram_layout_;
+    Network::ReduceScatter(input_buffer_.data() + pipeline_block_start_[block], pipeline_block_size_[block],
+                           block_start_.data() + block * num_machines_, block_len_.data() + block * num_machines_,
+                           output_buffer_.data() + pipeline_output_start_[block],
+                           [&layout](const char* src, int len, char* dst) { return layout.Encode(src, len, dst); },
+                           [&layout](const char* src, int src_size, char* dst, int len) {
+                             layout.DecodeSumReducer(src, src_size, dst, len);
+                           });
+  } else {
+    Network::ReduceScatter(input_buffer_.data() + pipeline_block_start_[block], pipeline_block_size_[block],
+                           block_start_.data() + block * num_machines_, block_len_.data() + block * num_machines_,
+                           output_buffer_.data() + pipeline_output_start_[block], &HistogramBinEntry::Encode,
+                           &HistogramBinEntry::DecodeSumReducer);
+  }
+  Network::SetPhase(kOtherPhase);
+}
+
+void DataParallelTreeLearner::FindBestThresholdsOfPipelineBlock(int block) {
+  const std::vector<int>& features = pipeline_aggregated_features_[block];
   #pragma omp parallel for schedule(guided)
-  for (int feature_index = 0; feature_index < num_features_; ++feature_index) {
-    if (!is_feature_aggregated_[feature_index]) continue;
+  for (int i = 0; i < static_cast<int>(features.size()); ++i) {
+    const int feature_index = features[i];
     // copy global sumup info
     smaller_leaf_histogram_array_[feature_index].SetSumup(
         GetGlobalDataCountInLeaf(smaller_leaf_splits_->LeafIndex()),
                                 smaller_leaf_splits_->sum_gradients(), 
-                                smaller_leaf_splits_->sum_hessians());
+                                smaller_leaf_splits_->sum_hessians(), is_constant_hessian_);
 
     // restore global histograms from buffer
     smaller_leaf_histogram_array_[feature_index].FromMemory(
@@ -178,12 +253,24 @@ void DataParallelTreeLearner::FindBestThresholds() {
     // set sumup info for histogram
     larger_leaf_histogram_array_[feature_index].SetSumup(
         GetGlobalDataCountInLeaf(larger_leaf_splits_->LeafIndex()),
-                                                         larger_leaf_splits_->sum_gradients(), larger_leaf_splits_->sum_hessians());
+                                                         larger_leaf_splits_->sum_gradients(), larger_leaf_splits_->sum_hessians(), is_constant_hessian_);
     // find best threshold for larger child
     larger_leaf_histogram_array_[feature_index].FindBestThreshold(
         &larger_leaf_splits_->BestSplitPerFeature()[feature_index]);
   }
+}
+
+void DataParallelTreeLearner::SyncUpQuantizationRange(double* max_gradient, double* max_hessian) {
+  double range[2] = { *max_gradient, *max_hessian };
+  Network::SetPhase(kGlobalSyncPhase);
+  GlobalMax(range, 2);
+  Network::SetPhase(kOtherPhase);
+  *max_gradient = range[0];
+  *max_hessian = range[1];
+}
 
+int64_t DataParallelTreeLearner::NumDataOfHistograms() {
+  return GlobalSum(num_data_);
 }
 
 void DataParallelTreeLearner::FindBestSplitsForLeaves() {
@@ -210,8 +297,10 @@ void DataParallelTreeLearner::FindBestSplitsForLeaves() {
   std::memcpy(input_buffer_.data(), &smaller_best, sizeof(SplitInfo));
   std::memcpy(input_buffer_.data() + sizeof(SplitInfo), &larger_best, sizeof(SplitInfo));
 
+  Network::SetPhase(kSplitPhase);
   Network::Allreduce(input_buffer_.data(), sizeof(SplitInfo) * 2, sizeof(SplitInfo),
                      output_buffer_.data(), &SplitInfo::MaxReducer);
+  Network::SetPhase(kOtherPhase);
 
   std::memcpy(&smaller_best, output_buffer_.data(), sizeof(SplitInfo));
   std::memcpy(&larger_best, output_buffer_.data() + sizeof(SplitInfo), sizeof(SplitInfo));
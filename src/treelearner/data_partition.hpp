@@ -3,6 +3,7 @@
 
 #include <LightGBM/meta.h>
 #include <LightGBM/feature.h>
+#include <LightGBM/utils/arena.h>
 
 #include <omp.h>
 
@@ -16,13 +17,19 @@ namespace LightGBM {
 */
 class DataPartition {
 public:
-  DataPartition(data_size_t num_data, int num_leafs)
+  /*!
+  * \brief Constructor
+  * \param num_data Number of all data
+  * \param num_leafs Number of all leaves
+  * \param arena Arena of the buffers of indices, should be kept alive
+  */
+  DataPartition(data_size_t num_data, int num_leafs, Arena* arena)
     :num_data_(num_data), num_leaves_(num_leafs) {
     leaf_begin_.resize(num_leaves_);
     leaf_count_.resize(num_leaves_);
-    indices_.resize(num_data_);
-    temp_left_indices_.resize(num_data_);
-    temp_right_indices_.resize(num_data_);
+    indices_ = arena->Alloc<data_size_t>(num_data_);
+    temp_left_indices_ = arena->Alloc<data_size_t>(num_data_);
+    temp_right_indices_ = arena->Alloc<data_size_t>(num_data_);
     used_data_indices_ = nullptr;
 #pragma omp parallel
 #pragma omp master
@@ -57,7 +64,7 @@ public:
     } else {
       // if bagging
       leaf_count_[0] = used_data_count_;
-      std::memcpy(indices_.data(), used_data_indices_, used_data_count_ * sizeof(data_size_t));
+      std::memcpy(indices_, used_data_indices_, used_data_count_ * sizeof(data_size_t));
     }
   }
 
@@ -71,7 +78,7 @@ public:
     // copy reference, maybe unsafe, but faster
     data_size_t begin = leaf_begin_[leaf];
     *out_len = leaf_count_[leaf];
-    return indices_.data() + begin;
+    return indices_ + begin;
   }
 
   /*!
@@ -86,43 +93,51 @@ public:
     // get leaf boundary
     const data_size_t begin = leaf_begin_[leaf];
     const data_size_t cnt = leaf_count_[leaf];
-
-    data_size_t inner_size = (cnt + num_threads_ - 1) / num_threads_;
-    if (inner_size < min_inner_size) { inner_size = min_inner_size; }
-    // split data multi-threading
-#pragma omp parallel for schedule(static, 1)
-    for (int i = 0; i < num_threads_; ++i) {
-      left_cnts_buf_[i] = 0;
-      right_cnts_buf_[i] = 0;
-      data_size_t cur_start = i * inner_size;
-      if (cur_start > cnt) { continue; }
-      data_size_t cur_cnt = inner_size;
-      if (cur_start + cur_cnt > cnt) { cur_cnt = cnt - cur_start; }
-      // split data inner, reduce the times of function called
-      data_size_t cur_left_count = feature_bins->Split(threshold, indices_.data() + begin + cur_start, cur_cnt,
-        temp_left_indices_.data() + cur_start, temp_right_indices_.data() + cur_start);
-      offsets_buf_[i] = cur_start;
-      left_cnts_buf_[i] = cur_left_count;
-      right_cnts_buf_[i] = cur_cnt - cur_left_count;
-    }
+    data_size_t* left_start = indices_ + begin;
     data_size_t left_cnt = 0;
-    left_write_pos_buf_[0] = 0;
-    right_write_pos_buf_[0] = 0;
-    for (int i = 1; i < num_threads_; ++i) {
-      left_write_pos_buf_[i] = left_write_pos_buf_[i - 1] + left_cnts_buf_[i - 1];
-      right_write_pos_buf_[i] = right_write_pos_buf_[i - 1] + right_cnts_buf_[i - 1];
-    }
-    left_cnt = left_write_pos_buf_[num_threads_ - 1] + left_cnts_buf_[num_threads_ - 1];
-    // copy back indices of right leaf to indices_
+    if (num_threads_ <= 1 || cnt < 2 * min_inner_size) {
+      // small leaf, not worth to start threads.
+      // Bin::Split never writes ahead of the position it reads, so left indices can be written in place
+      left_cnt = feature_bins->Split(threshold, left_start, cnt, left_start, temp_right_indices_);
+      if (cnt > left_cnt) {
+        std::memcpy(left_start + left_cnt, temp_right_indices_, (cnt - left_cnt) * sizeof(data_size_t));
+      }
+    } else {
+      data_size_t inner_size = (cnt + num_threads_ - 1) / num_threads_;
+      if (inner_size < min_inner_size) { inner_size = min_inner_size; }
+      const int num_blocks = static_cast<int>((cnt + inner_size - 1) / inner_size);
+      // first pass: split each block into thread local buffers and count
 #pragma omp parallel for schedule(static, 1)
-    for (int i = 0; i < num_threads_; ++i) {
-      if (left_cnts_buf_[i] > 0) {
-        std::memcpy(indices_.data() + begin + left_write_pos_buf_[i], 
-          temp_left_indices_.data() + offsets_buf_[i], left_cnts_buf_[i] * sizeof(data_size_t));
+      for (int i = 0; i < num_blocks; ++i) {
+        const data_size_t cur_start = i * inner_size;
+        data_size_t cur_cnt = inner_size;
+        if (cur_start + cur_cnt > cnt) { cur_cnt = cnt - cur_start; }
+        // split data inner, reduce the times of function called
+        const data_size_t cur_left_count = feature_bins->Split(threshold, left_start + cur_start, cur_cnt,
+          temp_left_indices_ + cur_start, temp_right_indices_ + cur_start);
+        offsets_buf_[i] = cur_start;
+        left_cnts_buf_[i] = cur_left_count;
+        right_cnts_buf_[i] = cur_cnt - cur_left_count;
       }
-      if (right_cnts_buf_[i] > 0) {
-        std::memcpy(indices_.data() + begin + left_cnt + right_write_pos_buf_[i], 
-          temp_right_indices_.data() + offsets_buf_[i], right_cnts_buf_[i] * sizeof(data_size_t));
+      // exclusive prefix sum for the write positions
+      left_write_pos_buf_[0] = 0;
+      right_write_pos_buf_[0] = 0;
+      for (int i = 1; i < num_blocks; ++i) {
+        left_write_pos_buf_[i] = left_write_pos_buf_[i - 1] + left_cnts_buf_[i - 1];
+        right_write_pos_buf_[i] = right_write_pos_buf_[i - 1] + right_cnts_buf_[i - 1];
+      }
+      left_cnt = left_write_pos_buf_[num_blocks - 1] + left_cnts_buf_[num_blocks - 1];
+      // second pass: scatter back to indices_, blocks write to disjoint ranges
+#pragma omp parallel for schedule(static, 1)
+      for (int i = 0; i < num_blocks; ++i) {
+        if (left_cnts_buf_[i] > 0) {
+          std::memcpy(left_start + left_write_pos_buf_[i],
+            temp_left_indices_ + offsets_buf_[i], left_cnts_buf_[i] * sizeof(data_size_t));
+        }
+        if (right_cnts_buf_[i] > 0) {
+          std::memcpy(left_start + left_cnt + right_write_pos_buf_[i],
+            temp_right_indices_ + offsets_buf_[i], right_cnts_buf_[i] * sizeof(data_size_t));
+        }
       }
     }
     // update leaf boundary
@@ -155,7 +170,7 @@ public:
   */
   data_size_t leaf_begin(int leaf) const { return leaf_begin_[leaf]; }
 
-  const data_size_t* indices() const { return indices_.data(); }
+  const data_size_t* indices() const { return indices_; }
 
   /*! \brief Get number of leaves */
   int num_leaves() const { return num_leaves_; }
@@ -170,11 +185,11 @@ private:
   /*! \brief number of data on one leaf */
   std::vector<data_size_t> leaf_count_;
   /*! \brief Store all data's indices, order by leaf[data_in_leaf0,..,data_leaf1,..] */
-  std::vector<data_size_t> indices_;
+  data_size_t* indices_;
   /*! \brief team indices buffer for split */
-  std::vector<data_size_t> temp_left_indices_;
+  data_size_t* temp_left_indices_;
   /*! \brief team indices buffer for split */
-  std::vector<data_size_t> temp_right_indices_;
+  data_size_t* temp_right_indices_;
   /*! \brief used data indices, used for bagging */
   const data_size_t* used_data_indices_;
   /*! \brief used data count, used for bagging */
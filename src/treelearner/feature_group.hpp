@@ -0,0 +1,113 @@
+#ifndef LIGHTGBM_TREELEARNER_FEATURE_GROUP_HPP_
+#define LIGHTGBM_TREELEARNER_FEATURE_GROUP_HPP_
+
+#include <LightGBM/dataset.h>
+#include <LightGBM/feature.h>
+#include <LightGBM/bin.h>
+
+#include <LightGBM/utils/threading.h>
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+namespace LightGBM {
+
+/*!
+* \brief Row-major storage for the bins of a block of dense features.
+*        Bins of all features in the block are stored side by side for each row,
+*        so the histograms of the whole block can be constructed by one pass over the rows of a leaf.
+*/
+class FeatureGroup {
+public:
+  /*! \brief Max number of bins of a feature that can be put into a group */
+  static const int kMaxNumBin = 256;
+
+  /*!
+  * \brief Constructor, copy bins of the features from dataset
+  * \param train_data Training data
+  * \param feature_indices Indices of the features in this group, all of them should be dense
+  */
+  FeatureGroup(const Dataset* train_data, const std::vector<int>& feature_indices)
+    :feature_indices_(feature_indices) {
+    num_data_ = train_data->num_data();
+    num_features_ = static_cast<int>(feature_indices_.size());
+    data_.resize(static_cast<size_t>(num_data_) * num_features_);
+    Threading::For<data_size_t>(0, num_data_,
+      [this, train_data](int, data_size_t start, data_size_t end) {
+      for (int j = 0; j < num_features_; ++j) {
+        std::unique_ptr<BinIterator> iterator(
+          train_data->FeatureAt(feature_indices_[j])->bin_data()->GetIterator(start));
+        for (data_size_t i = start; i < end; ++i) {
+          data_[static_cast<size_t>(i) * num_features_ + j] = static_cast<uint8_t>(iterator->Get(i));
+        }
+      }
+    });
+  }
+
+  /*!
+  * \brief Construct histograms for all features in this group
+  * \param data_indices Used data indices in current leaf, nullptr means using all data
+  * \param num_data Number of used data
+  * \param ordered_gradients Pointer to gradients, the data_indices[i]-th data's gradient is ordered_gradients[i]
+  * \param ordered_hessians Pointer to hessians, the data_indices[i]-th data's hessian is ordered_hessians[i].
+  *        nullptr means all hessians are 1, then sum_hessians of out are not filled
+  * \param out Output histograms, out[j] is the histogram of the j-th feature in this group
+  */
+  void ConstructHistogram(const data_size_t* data_indices, data_size_t num_data,
+    const score_t* ordered_gradients, const score_t* ordered_hessians,
+    HistogramBinEntry** out) const {
+    if (ordered_hessians == nullptr) {
+      ConstructHistogramInner<true>(data_indices, num_data, ordered_gradients, ordered_hessians, out);
+    } else {
+      ConstructHistogramInner<false>(data_indices, num_data, ordered_gradients, ordered_hessians, out);
+    }
+  }
+
+  /*! \brief Indices of the features in this group */
+  const std::vector<int>& feature_indices() const { return feature_indices_; }
+
+  /*! \brief Number of features in this group */
+  int num_features() const { return num_features_; }
+
+  /*! \brief Sizes in byte of the row-major bins */
+  size_t SizesInByte() const { return data_.size() * sizeof(uint8_t); }
+
+  /*! \brief Disable copy */
+  FeatureGroup& operator=(const FeatureGroup&) = delete;
+  /*! \brief Disable copy */
+  FeatureGroup(const FeatureGroup&) = delete;
+
+private:
+  template<bool IS_CONSTANT_HESSIAN>
+  void ConstructHistogramInner(const data_size_t* data_indices, data_size_t num_data,
+    const score_t* ordered_gradients, const score_t* ordered_hessians,
+    HistogramBinEntry** out) const {
+    for (data_size_t i = 0; i < num_data; ++i) {
+      const data_size_t idx = data_indices != nullptr ? data_indices[i] : i;
+      const uint8_t* row = data_.data() + static_cast<size_t>(idx) * num_features_;
+      const double gradient = ordered_gradients[i];
+      const double hessian = IS_CONSTANT_HESSIAN ? 0.0f : ordered_hessians[i];
+      for (int j = 0; j < num_features_; ++j) {
+        HistogramBinEntry& entry = out[j][row[j]];
+        entry.sum_gradients += gradient;
+        if (!IS_CONSTANT_HESSIAN) {
+          entry.sum_hessians += hessian;
+        }
+        ++entry.cnt;
+      }
+    }
+  }
+
+  /*! \brief Number of data */
+  data_size_t num_data_;
+  /*! \brief Number of features in this group */
+  int num_features_;
+  /*! \brief Indices of the features in this group */
+  std::vector<int> feature_indices_;
+  /*! \brief Bins, the j-th feature of the i-th row is at data_[i * num_features_ + j] */
+  std::vector<uint8_t> data_;
+};
+
+}  // namespace LightGBM
+#endif   // LightGBM_TREELEARNER_FEATURE_GROUP_HPP_
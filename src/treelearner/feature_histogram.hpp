@@ -3,8 +3,17 @@
 
 #include "split_info.hpp"
 #include <LightGBM/feature.h>
+#include <LightGBM/utils/profiler.h>
 
 #include <cstring>
+#include <algorithm>
+#include <vector>
+#include <tuple>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LIGHTGBM_SPLIT_AVX2
+#include <immintrin.h>
+#endif
 
 namespace LightGBM {
 
@@ -27,9 +36,12 @@ public:
   * \brief Init the feature histogram
   * \param feature the feature data for this histogram
   * \param min_num_data_one_leaf minimal number of data in one leaf
+  * \param data Memory of num_bin entries for the histogram, should be kept alive. nullptr means allocated by this object
+  * \param is_int True if the entries are IntHistogramBinEntry of quantized gradients, otherwise HistogramBinEntry
   */
   void Init(const Feature* feature, int feature_idx, data_size_t min_num_data_one_leaf,
-    double min_sum_hessian_one_leaf, double lambda_l1, double lambda_l2, double min_gain_to_split) {
+    double min_sum_hessian_one_leaf, double lambda_l1, double lambda_l2, double min_gain_to_split,
+    void* data = nullptr, bool is_int = false) {
     feature_idx_ = feature_idx;
     min_num_data_one_leaf_ = min_num_data_one_leaf;
     min_sum_hessian_one_leaf_ = min_sum_hessian_one_leaf;
@@ -38,7 +50,22 @@ public:
     min_gain_to_split_ = min_gain_to_split;
     bin_data_ = feature->bin_data();
     num_bins_ = feature->num_bin();
-    data_.resize(num_bins_);
+    data_ = nullptr;
+    int_data_ = nullptr;
+    if (is_int) {
+      if (data == nullptr) {
+        int_data_buf_.resize(num_bins_);
+        data = int_data_buf_.data();
+      }
+      int_data_ = static_cast<IntHistogramBinEntry*>(data);
+    } else {
+      if (data == nullptr) {
+        data_buf_.resize(num_bins_);
+        data = data_buf_.data();
+      }
+      data_ = static_cast<HistogramBinEntry*>(data);
+    }
+    std::memset(data, 0, SizeOfHistgram());
   }
 
 
@@ -48,16 +75,59 @@ public:
   * \param sum_gradients sum of gradients of current leaf
   * \param sum_hessians sum of hessians of current leaf
   * \param ordered_gradients Orederd gradients
-  * \param ordered_hessians  Ordered hessians
+  * \param ordered_hessians  Ordered hessians, nullptr means all hessians are 1
   * \param data_indices data indices of current leaf
   */
   void Construct(const data_size_t* data_indices, data_size_t num_data, double sum_gradients,
     double sum_hessians, const score_t* ordered_gradients, const score_t* ordered_hessians) {
-    std::memset(data_.data(), 0, sizeof(HistogramBinEntry)* num_bins_);
+    ProfileScope profile_scope(kConstructHistogramsProfile);
+    std::memset(static_cast<void*>(data_), 0, sizeof(HistogramBinEntry) * num_bins_);
+    num_data_ = num_data;
+    sum_gradients_ = sum_gradients;
+    sum_hessians_ = sum_hessians + 2 * kEpsilon;
+    is_constant_hessian_ = ordered_hessians == nullptr;
+    bin_data_->ConstructHistogram(data_indices, num_data, ordered_gradients, ordered_hessians, data_);
+  }
+
+  /*!
+  * \brief Construct a histogram with quantized gradients and hessians
+  * \param data_indices data indices of current leaf
+  * \param num_data number of data in current leaf
+  * \param sum_gradients sum of gradients of current leaf
+  * \param sum_hessians sum of hessians of current leaf
+  * \param ordered_grad_hess Ordered quantized gradients and hessians, interleaved
+  * \param grad_scale Real value of one unit of quantized gradient
+  * \param hess_scale Real value of one unit of quantized hessian
+  */
+  void Construct(const data_size_t* data_indices, data_size_t num_data, double sum_gradients,
+    double sum_hessians, const int8_t* ordered_grad_hess, double grad_scale, double hess_scale) {
+    ProfileScope profile_scope(kConstructHistogramsProfile);
+    std::memset(int_data_, 0, sizeof(IntHistogramBinEntry) * num_bins_);
     num_data_ = num_data;
     sum_gradients_ = sum_gradients;
     sum_hessians_ = sum_hessians + 2 * kEpsilon;
-    bin_data_->ConstructHistogram(data_indices, num_data, ordered_gradients, ordered_hessians, data_.data());
+    is_constant_hessian_ = false;
+    SetScales(grad_scale, hess_scale);
+    bin_data_->ConstructIntHistogram(data_indices, num_data, ordered_grad_hess, int_data_);
+  }
+
+  /*!
+  * \brief Construct a histogram with gradients and hessians in bfloat16
+  * \param data_indices data indices of current leaf
+  * \param num_data number of data in current leaf
+  * \param sum_gradients sum of gradients of current leaf
+  * \param sum_hessians sum of hessians of current leaf
+  * \param ordered_grad_hess Ordered packed values of BF16GradHess
+  */
+  void Construct(const data_size_t* data_indices, data_size_t num_data, double sum_gradients,
+    double sum_hessians, const uint32_t* ordered_grad_hess) {
+    ProfileScope profile_scope(kConstructHistogramsProfile);
+    std::memset(static_cast<void*>(data_), 0, sizeof(HistogramBinEntry) * num_bins_);
+    num_data_ = num_data;
+    sum_gradients_ = sum_gradients;
+    sum_hessians_ = sum_hessians + 2 * kEpsilon;
+    is_constant_hessian_ = false;
+    bin_data_->ConstructBF16Histogram(data_indices, num_data, ordered_grad_hess, data_);
   }
 
   /*!
@@ -67,15 +137,33 @@ public:
   * \param sum_gradients sum of gradients of current leaf
   * \param sum_hessians sum of hessians of current leaf
   * \param gradients
-  * \param hessian
+  * \param hessian nullptr means all hessians are 1
   */
   void Construct(const OrderedBin* ordered_bin, int leaf, data_size_t num_data, double sum_gradients,
     double sum_hessians, const score_t* gradients, const score_t* hessians) {
-    std::memset(data_.data(), 0, sizeof(HistogramBinEntry)* num_bins_);
+    ProfileScope profile_scope(kConstructHistogramsProfile);
+    std::memset(static_cast<void*>(data_), 0, sizeof(HistogramBinEntry) * num_bins_);
     num_data_ = num_data;
     sum_gradients_ = sum_gradients;
     sum_hessians_ = sum_hessians + 2 * kEpsilon;
-    ordered_bin->ConstructHistogram(leaf, gradients, hessians, data_.data());
+    is_constant_hessian_ = hessians == nullptr;
+    ordered_bin->ConstructHistogram(leaf, gradients, hessians, data_);
+  }
+
+  /*!
+  * \brief Clear the histogram and set sumup information, used when entries are filled outside (e.g. by FeatureGroup).
+  *        Only for histograms that are not is_int()
+  * \param num_data number of data in current leaf
+  * \param sum_gradients sum of gradients of current leaf
+  * \param sum_hessians sum of hessians of current leaf
+  * \param is_constant_hessian True if all hessians are 1, then sum_hessians of entries are not filled
+  * \return Pointer to the histogram entries
+  */
+  HistogramBinEntry* ResetForConstruct(data_size_t num_data, double sum_gradients, double sum_hessians,
+    bool is_constant_hessian) {
+    std::memset(static_cast<void*>(data_), 0, sizeof(HistogramBinEntry) * num_bins_);
+    SetSumup(num_data, sum_gradients, sum_hessians, is_constant_hessian);
+    return data_;
   }
 
   /*!
@@ -83,21 +171,39 @@ public:
   * \param num_data number of data in current leaf
   * \param sum_gradients sum of gradients of current leaf
   * \param sum_hessians sum of hessians of current leaf
+  * \param is_constant_hessian True if all hessians are 1, then sum_hessians of entries are not filled
   */
-  void SetSumup(data_size_t num_data, double sum_gradients, double sum_hessians) {
+  void SetSumup(data_size_t num_data, double sum_gradients, double sum_hessians, bool is_constant_hessian) {
     num_data_ = num_data;
     sum_gradients_ = sum_gradients;
     sum_hessians_ = sum_hessians + 2 * kEpsilon;
+    is_constant_hessian_ = is_constant_hessian;
   }
 
   /*!
-  * \brief Subtract current histograms with other
+  * \brief Set real values of one unit of quantized gradient and hessian, used by integer histograms
+  *        that are filled outside (e.g. by network)
+  */
+  void SetScales(double grad_scale, double hess_scale) {
+    grad_scale_ = grad_scale;
+    hess_scale_ = hess_scale;
+  }
+
+  /*!
+  * \brief Subtract current histograms with other, integer histograms are subtracted exactly
   * \param other The histogram that want to subtract
   */
   void Subtract(const FeatureHistogram& other) {
     num_data_ -= other.num_data_;
     sum_gradients_ -= other.sum_gradients_;
     sum_hessians_ -= other.sum_hessians_;
+    if (int_data_ != nullptr) {
+      for (unsigned int i = 0; i < num_bins_; ++i) {
+        int_data_[i].cnt -= other.int_data_[i].cnt;
+        int_data_[i].sum_gradients_hessians -= other.int_data_[i].sum_gradients_hessians;
+      }
+      return;
+    }
     for (unsigned int i = 0; i < num_bins_; ++i) {
       data_[i].cnt -= other.data_[i].cnt;
       data_[i].sum_gradients -= other.data_[i].sum_gradients;
@@ -110,6 +216,84 @@ public:
   * \param output The best split result
   */
   void FindBestThreshold(SplitInfo* output) {
+    if (int_data_ != nullptr) {
+      FindBestThresholdInner<false, true>(output);
+    } else if (is_constant_hessian_) {
+      FindBestThresholdInner<true, false>(output);
+    } else {
+      FindBestThresholdInner<false, false>(output);
+    }
+  }
+
+  /*!
+  * \brief Binary size of this histogram
+  */
+  int SizeOfHistgram() const {
+    return num_bins_ * static_cast<int>(is_int() ? sizeof(IntHistogramBinEntry) : sizeof(HistogramBinEntry));
+  }
+
+  /*!
+  * \brief Memory pointer to histogram data, entries are IntHistogramBinEntry if is_int()
+  */
+  const void* HistogramData() const {
+    if (is_int()) {
+      return int_data_;
+    }
+    return data_;
+  }
+
+  /*!
+  * \brief Memory pointer to the entries of histograms that are not is_int()
+  */
+  HistogramBinEntry* RawData() { return data_; }
+
+  /*!
+  * \brief Restore histogram from memory
+  */
+  void FromMemory(char* memory_data)  {
+    if (is_int()) {
+      std::memcpy(int_data_, memory_data, SizeOfHistgram());
+    } else {
+      std::memcpy(static_cast<void*>(data_), memory_data, SizeOfHistgram());
+    }
+  }
+
+  /*!
+  * \brief True if the entries are IntHistogramBinEntry of quantized gradients
+  */
+  bool is_int() const { return int_data_ != nullptr; }
+
+  /*!
+  * \brief Set min number data in one leaf
+  */
+  void SetMinNumDataOneLeaf(data_size_t new_val) {
+    min_num_data_one_leaf_ = new_val;
+  }
+
+  /*!
+  * \brief Set min sum hessian in one leaf
+  */
+  void SetMinSumHessianOneLeaf(double new_val) {
+    min_sum_hessian_one_leaf_ = new_val;
+  }
+
+  /*!
+  * \brief True if this histogram can be splitted
+  */
+  bool is_splittable() { return is_splittable_; }
+
+  /*!
+  * \brief Set splittable to this histogram
+  */
+  void set_is_splittable(bool val) { is_splittable_ = val; }
+
+private:
+  /*!
+  * \brief Implementation of FindBestThreshold, if IS_CONSTANT_HESSIAN, sums of hessians are counted from the number of data.
+  *        If IS_INT, entries are integer sums, scaled to real values here
+  */
+  template<bool IS_CONSTANT_HESSIAN, bool IS_INT>
+  void FindBestThresholdInner(SplitInfo* output) {
     double best_sum_left_gradient = NAN;
     double best_sum_left_hessian = NAN;
     double best_gain = kMinScore;
@@ -121,11 +305,19 @@ public:
     double gain_shift = GetLeafSplitGain(sum_gradients_, sum_hessians_);
     double min_gain_shift = gain_shift + min_gain_to_split_;
     is_splittable_ = false;
+    // both sides need min_num_data_one_leaf_ data, the scan below cannot find any split
+    const bool is_too_small = num_data_ < 2 * static_cast<int64_t>(min_num_data_one_leaf_);
+    unsigned int t = is_too_small ? 0 : num_bins_ - 1;
+#ifdef LIGHTGBM_SPLIT_AVX2
+    if (t >= kMinBinsForSIMD && IsAVX2Supported()) {
+      ScanThresholdsAVX2<IS_CONSTANT_HESSIAN, IS_INT>(min_gain_shift, &best_gain, &best_sum_left_gradient,
+        &best_sum_left_hessian, &best_left_count, &best_threshold);
+      t = 0;
+    }
+#endif
     // from right to left, and we don't need data in bin0
-    for (unsigned int t = num_bins_ - 1; t > 0; --t) {
-      sum_right_gradient += data_[t].sum_gradients;
-      sum_right_hessian += data_[t].sum_hessians;
-      right_count += data_[t].cnt;
+    for (; t > 0; --t) {
+      AccumulateRight<IS_CONSTANT_HESSIAN, IS_INT>(t, &sum_right_gradient, &sum_right_hessian, &right_count);
       // if data not enough, or sum hessian too small
       if (right_count < min_num_data_one_leaf_ || sum_right_hessian < min_sum_hessian_one_leaf_) continue;
       data_size_t left_count = num_data_ - right_count;
@@ -170,51 +362,146 @@ public:
   }
 
   /*!
-  * \brief Binary size of this histogram
+  * \brief Add bin t to the sums of the right side, shared by all scans so the sums are exactly the same
   */
-  int SizeOfHistgram() const {
-    return num_bins_ * sizeof(HistogramBinEntry);
+  template<bool IS_CONSTANT_HESSIAN, bool IS_INT>
+  inline void AccumulateRight(unsigned int t, double* sum_right_gradient, double* sum_right_hessian,
+    data_size_t* right_count) const {
+    if (IS_INT) {
+      *sum_right_gradient += int_data_[t].sum_gradients() * grad_scale_;
+      *sum_right_hessian += int_data_[t].sum_hessians() * hess_scale_;
+      *right_count += int_data_[t].cnt;
+    } else {
+      *sum_right_gradient += data_[t].sum_gradients;
+      // sums of unit hessians are counted by the same additions, so they are exactly the same
+      *sum_right_hessian += IS_CONSTANT_HESSIAN ? static_cast<double>(data_[t].cnt) : data_[t].sum_hessians;
+      *right_count += data_[t].cnt;
+    }
   }
 
-  /*!
-  * \brief Memory pointer to histogram data
-  */
-  const HistogramBinEntry* HistogramData() const {
-    return data_.data();
-  }
+#ifdef LIGHTGBM_SPLIT_AVX2
+  /*! \brief Histograms with fewer bins are scanned by the scalar loop, the blocks don't pay off */
+  static const unsigned int kMinBinsForSIMD = 32;
+  /*! \brief Number of thresholds whose sums are buffered at once by the AVX2 scan */
+  static const int kScanBlockSize = 64;
 
-  /*!
-  * \brief Restore histogram from memory
-  */
-  void FromMemory(char* memory_data)  {
-    std::memcpy(data_.data(), memory_data, num_bins_ * sizeof(HistogramBinEntry));
+  /*! \brief Check once whether the running CPU supports AVX2 instructions */
+  static inline bool IsAVX2Supported() {
+    static const bool is_supported = __builtin_cpu_supports("avx2") != 0;
+    return is_supported;
   }
 
   /*!
-  * \brief Set min number data in one leaf
+  * \brief GetLeafSplitGain of 4 sides at once, by the same operations in the same order
   */
-  void SetMinNumDataOneLeaf(data_size_t new_val) {
-    min_num_data_one_leaf_ = new_val;
+  __attribute__((target("avx2")))
+  inline __m256d GetLeafSplitGainAVX2(__m256d sum_gradients, __m256d sum_hessians) const {
+    const __m256d l1 = _mm256_set1_pd(lambda_l1_);
+    const __m256d abs_sum_gradients = _mm256_andnot_pd(_mm256_set1_pd(-0.0), sum_gradients);
+    const __m256d reg_abs_sum_gradients = _mm256_sub_pd(abs_sum_gradients, l1);
+    const __m256d gain = _mm256_div_pd(_mm256_mul_pd(reg_abs_sum_gradients, reg_abs_sum_gradients),
+      _mm256_add_pd(sum_hessians, _mm256_set1_pd(lambda_l2_)));
+    return _mm256_and_pd(_mm256_cmp_pd(abs_sum_gradients, l1, _CMP_GT_OQ), gain);
   }
 
   /*!
-  * \brief Set min sum hessian in one leaf
+  * \brief AVX2 version of the threshold scan of FindBestThresholdInner, with exactly the same result.
+  *        The running sums depend on each other, so they are accumulated by the scalar additions into a block,
+  *        then the constraints and the gains of 4 thresholds are checked at once. The first threshold whose left side
+  *        breaks the constraints ends the scan, like the break of the scalar loop
   */
-  void SetMinSumHessianOneLeaf(double new_val) {
-    min_sum_hessian_one_leaf_ = new_val;
+  template<bool IS_CONSTANT_HESSIAN, bool IS_INT>
+  __attribute__((target("avx2")))
+  void ScanThresholdsAVX2(double min_gain_shift, double* best_gain, double* best_sum_left_gradient,
+    double* best_sum_left_hessian, data_size_t* best_left_count, unsigned int* best_threshold) {
+    alignas(32) double right_gradients[kScanBlockSize];
+    alignas(32) double right_hessians[kScanBlockSize];
+    alignas(32) double right_counts[kScanBlockSize];
+    alignas(32) double gains[4];
+    double sum_right_gradient = 0.0f;
+    double sum_right_hessian = kEpsilon;
+    data_size_t right_count = 0;
+    const __m256d min_num_data = _mm256_set1_pd(static_cast<double>(min_num_data_one_leaf_));
+    const __m256d min_sum_hessian = _mm256_set1_pd(min_sum_hessian_one_leaf_);
+    const __m256d num_data = _mm256_set1_pd(static_cast<double>(num_data_));
+    const __m256d sum_gradients = _mm256_set1_pd(sum_gradients_);
+    const __m256d sum_hessians = _mm256_set1_pd(sum_hessians_);
+    const __m256d gain_shift = _mm256_set1_pd(min_gain_shift);
+    // from right to left, and we don't need data in bin0
+    for (unsigned int t = num_bins_ - 1; t > 0;) {
+      const int block_size = static_cast<int>(std::min(t, static_cast<unsigned int>(kScanBlockSize)));
+      if (!IS_INT && !IS_CONSTANT_HESSIAN) {
+        // the sums of gradients and hessians are next to each other, they are added by one 128-bit add
+        __m128d sum_right = _mm_set_pd(sum_right_hessian, sum_right_gradient);
+        for (int k = 0; k < block_size; ++k) {
+          sum_right = _mm_add_pd(sum_right, _mm_loadu_pd(&data_[t - k].sum_gradients));
+          right_count += data_[t - k].cnt;
+          _mm_storel_pd(right_gradients + k, sum_right);
+          _mm_storeh_pd(right_hessians + k, sum_right);
+          right_counts[k] = static_cast<double>(right_count);
+        }
+        sum_right_gradient = right_gradients[block_size - 1];
+        sum_right_hessian = right_hessians[block_size - 1];
+      } else {
+        for (int k = 0; k < block_size; ++k) {
+          AccumulateRight<IS_CONSTANT_HESSIAN, IS_INT>(t - k, &sum_right_gradient, &sum_right_hessian, &right_count);
+          right_gradients[k] = sum_right_gradient;
+          right_hessians[k] = sum_right_hessian;
+          right_counts[k] = static_cast<double>(right_count);
+        }
+      }
+      // padded thresholds have no data on the right side, so they are skipped
+      for (int k = block_size; k % 4 != 0; ++k) {
+        right_gradients[k] = 0.0f;
+        right_hessians[k] = 0.0f;
+        right_counts[k] = -1.0f;
+      }
+      for (int k = 0; k < block_size; k += 4) {
+        const __m256d sum_right_gradients = _mm256_load_pd(right_gradients + k);
+        const __m256d sum_right_hessians = _mm256_load_pd(right_hessians + k);
+        const __m256d right_count_data = _mm256_load_pd(right_counts + k);
+        // skipped if data not enough, or sum hessian too small on the right side
+        const __m256d is_right_ok = _mm256_and_pd(_mm256_cmp_pd(right_count_data, min_num_data, _CMP_NLT_UQ),
+          _mm256_cmp_pd(sum_right_hessians, min_sum_hessian, _CMP_NLT_UQ));
+        // scan ends if data not enough, or sum hessian too small on the left side
+        const __m256d sum_left_hessians = _mm256_sub_pd(sum_hessians, sum_right_hessians);
+        const __m256d is_left_bad = _mm256_or_pd(
+          _mm256_cmp_pd(_mm256_sub_pd(num_data, right_count_data), min_num_data, _CMP_LT_OQ),
+          _mm256_cmp_pd(sum_left_hessians, min_sum_hessian, _CMP_LT_OQ));
+        const int stop_mask = _mm256_movemask_pd(_mm256_and_pd(is_right_ok, is_left_bad));
+        // only thresholds before the first stop are scanned
+        const int scan_mask = stop_mask == 0 ? 0xf : ((stop_mask & -stop_mask) - 1);
+        const __m256d sum_left_gradients = _mm256_sub_pd(sum_gradients, sum_right_gradients);
+        const __m256d current_gains = _mm256_add_pd(GetLeafSplitGainAVX2(sum_left_gradients, sum_left_hessians),
+          GetLeafSplitGainAVX2(sum_right_gradients, sum_right_hessians));
+        // gain with split is worse than without split
+        const __m256d is_better = _mm256_and_pd(is_right_ok, _mm256_cmp_pd(current_gains, gain_shift, _CMP_NLT_UQ));
+        const int gain_mask = _mm256_movemask_pd(is_better) & scan_mask;
+        if (gain_mask != 0) {
+          // mark to is splittable
+          is_splittable_ = true;
+          _mm256_store_pd(gains, current_gains);
+          for (int j = 0; j < 4; ++j) {
+            // better split point, same order as the scalar loop so ties keep the same one
+            if (((gain_mask >> j) & 1) != 0 && gains[j] > *best_gain) {
+              *best_left_count = num_data_ - static_cast<data_size_t>(right_counts[k + j]);
+              *best_sum_left_gradient = sum_gradients_ - right_gradients[k + j];
+              *best_sum_left_hessian = sum_hessians_ - right_hessians[k + j];
+              // left is <= threshold, right is > threshold.  so this is t-1
+              *best_threshold = t - k - j - 1;
+              *best_gain = gains[j];
+            }
+          }
+        }
+        if (stop_mask != 0) {
+          return;
+        }
+      }
+      t -= block_size;
+    }
   }
+#endif
 
-  /*!
-  * \brief True if this histogram can be splitted
-  */
-  bool is_splittable() { return is_splittable_; }
-
-  /*!
-  * \brief Set splittable to this histogram
-  */
-  void set_is_splittable(bool val) { is_splittable_ = val; }
-
-private:
   /*!
   * \brief Calculate the split gain based on regularized sum_gradients and sum_hessians
   * \param sum_gradients
@@ -260,7 +547,17 @@ private:
   /*! \brief number of bin of histogram */
   unsigned int num_bins_;
   /*! \brief sum of gradient of each bin */
-  std::vector<HistogramBinEntry> data_;
+  HistogramBinEntry* data_ = nullptr;
+  /*! \brief memory of data_ if it is allocated by this object */
+  std::vector<HistogramBinEntry> data_buf_;
+  /*! \brief integer sums of each bin, used instead of data_ for quantized gradients */
+  IntHistogramBinEntry* int_data_ = nullptr;
+  /*! \brief memory of int_data_ if it is allocated by this object */
+  std::vector<IntHistogramBinEntry> int_data_buf_;
+  /*! \brief real value of one unit of quantized gradient in int_data_ */
+  double grad_scale_ = 1.0;
+  /*! \brief real value of one unit of quantized hessian in int_data_ */
+  double hess_scale_ = 1.0;
   /*! \brief number of all data */
   data_size_t num_data_;
   /*! \brief sum of gradient of current leaf */
@@ -269,6 +566,151 @@ private:
   double sum_hessians_;
   /*! \brief False if this histogram cannot split */
   bool is_splittable_ = true;
+  /*! \brief True if all hessians are 1, then sum_hessians of entries are not filled */
+  bool is_constant_hessian_ = false;
+};
+
+
+/*!
+* \brief Layout of the histograms of many features in one network buffer. Integer histograms of quantized gradients
+*        and real histograms have different entries, so the layout tells the reducers which entries are where.
+*        Ranges passed to the reducers are located by their offsets from the start of the buffer,
+*        which holds for the network, it always reduces into the input buffer
+*/
+class HistogramBufferLayout {
+public:
+  /*!
+  * \brief Reset the layout
+  * \param buffer Start of the buffer
+  */
+  void Reset(const char* buffer) {
+    buffer_ = buffer;
+    segments_.clear();
+  }
+
+  /*!
+  * \brief Add the histogram of one feature, histograms can be added in any order but should not overlap
+  * \param start Offset in byte of the histogram in the buffer
+  * \param size Size in byte of the histogram
+  * \param is_int True if the entries are IntHistogramBinEntry
+  */
+  void Add(int start, int size, bool is_int) {
+    segments_.emplace_back(start, start + size, is_int);
+  }
+
+  /*! \brief Call after all histograms are added */
+  void Finish() {
+    std::sort(segments_.begin(), segments_.end());
+  }
+
+  /*!
+  * \brief Sum up (reducers) function for raw histograms of mixed types. Every 8 bytes of both entries are one field
+  *        that can be summed up alone, so len only needs to be a multiple of 8
+  */
+  void SumReducer(const char* src, char* dst, int len) const {
+    static_assert(sizeof(HistogramBinEntry) == 24 && sizeof(IntHistogramBinEntry) == 16, "entries are of 8-byte fields");
+    const int start = static_cast<int>(dst - buffer_);
+    const int end = start + len;
+    for (size_t seg = FindSegment(start); seg < segments_.size() && std::get<0>(segments_[seg]) < end; ++seg) {
+      const int seg_start = std::get<0>(segments_[seg]);
+      const int seg_end = std::min(end, std::get<1>(segments_[seg]));
+      const bool is_int = std::get<2>(segments_[seg]);
+      const int entry_size = static_cast<int>(is_int ? sizeof(IntHistogramBinEntry) : sizeof(HistogramBinEntry));
+      for (int pos = std::max(start, seg_start); pos < seg_end; pos += 8) {
+        const int field = (pos - seg_start) % entry_size;
+        const char* from = src + (pos - start);
+        char* to = dst + (pos - start);
+        // the count is the last field of both entries
+        if (field + 8 == entry_size) {
+          AddField<data_size_t>(from, to);
+        } else if (is_int) {
+          AddField<int64_t>(from, to);
+        } else {
+          AddField<double>(from, to);
+        }
+      }
+    }
+  }
+
+  /*!
+  * \brief Encode histograms of whole features in [src, src + len). If it is smaller, the encoded data is a header byte
+  *        of 1, then each histogram encoded by its entry type, otherwise a header byte of 0 followed by the raw data
+  */
+  int Encode(const char* src, int len, char* dst) const {
+    const int start = static_cast<int>(src - buffer_);
+    const int end = start + len;
+    const size_t first_seg = FindSegment(start);
+    size_t last_seg = first_seg;
+    int encoded_size = 1;
+    for (; last_seg < segments_.size() && std::get<0>(segments_[last_seg]) < end; ++last_seg) {
+      encoded_size += EncodedSize(last_seg);
+    }
+    if (encoded_size >= 1 + len) {
+      dst[0] = 0;
+      std::memcpy(dst + 1, src, len);
+      return 1 + len;
+    }
+    dst[0] = 1;
+    char* out = dst + 1;
+    for (size_t seg = first_seg; seg < last_seg; ++seg) {
+      const char* seg_src = buffer_ + std::get<0>(segments_[seg]);
+      const int seg_len = std::get<1>(segments_[seg]) - std::get<0>(segments_[seg]);
+      out += std::get<2>(segments_[seg]) ? IntHistogramBinEntry::Encode(seg_src, seg_len, out)
+        : HistogramBinEntry::Encode(seg_src, seg_len, out);
+    }
+    return encoded_size;
+  }
+
+  /*!
+  * \brief Sum up (reducers) function for histograms encoded by Encode
+  */
+  void DecodeSumReducer(const char* src, int src_size, char* dst, int len) const {
+    if (src[0] == 0) {
+      SumReducer(src + 1, dst, std::min(src_size - 1, len));
+      return;
+    }
+    const int start = static_cast<int>(dst - buffer_);
+    const int end = start + len;
+    const char* in = src + 1;
+    for (size_t seg = FindSegment(start); seg < segments_.size() && std::get<0>(segments_[seg]) < end; ++seg) {
+      char* seg_dst = dst + (std::get<0>(segments_[seg]) - start);
+      const int seg_len = std::get<1>(segments_[seg]) - std::get<0>(segments_[seg]);
+      const int seg_src_size = static_cast<int>(src + src_size - in);
+      in += std::get<2>(segments_[seg]) ? IntHistogramBinEntry::DecodeSumReducer(in, seg_src_size, seg_dst, seg_len)
+        : HistogramBinEntry::DecodeSumReducer(in, seg_src_size, seg_dst, seg_len);
+    }
+  }
+
+private:
+  /*! \brief Index of the first segment ending after pos */
+  size_t FindSegment(int pos) const {
+    // segments don't overlap, so they are sorted by end too
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), pos,
+      [](int value, const std::tuple<int, int, bool>& segment) { return value < std::get<1>(segment); });
+    return static_cast<size_t>(it - segments_.begin());
+  }
+
+  int EncodedSize(size_t seg) const {
+    const char* seg_src = buffer_ + std::get<0>(segments_[seg]);
+    const int seg_len = std::get<1>(segments_[seg]) - std::get<0>(segments_[seg]);
+    const int size = std::get<2>(segments_[seg]) ? IntHistogramBinEntry::EncodedSize(seg_src, seg_len)
+      : HistogramBinEntry::EncodedSize(seg_src, seg_len);
+    return std::min(size, 1 + seg_len);
+  }
+
+  template<typename T>
+  static void AddField(const char* src, char* dst) {
+    T a, b;
+    std::memcpy(&a, src, sizeof(T));
+    std::memcpy(&b, dst, sizeof(T));
+    b += a;
+    std::memcpy(dst, &b, sizeof(T));
+  }
+
+  /*! \brief Start of the buffer */
+  const char* buffer_ = nullptr;
+  /*! \brief (start, end, is_int) of the histograms, sorted by start */
+  std::vector<std::tuple<int, int, bool>> segments_;
 };
 
 
@@ -287,22 +729,30 @@ public:
   }
   /*!
   * \brief Reset pool size
-  * \param cache_size Max cache size
+  * \param cache_size_in_bytes Max memory used by cached histograms, negative means no limit
+  * \param histogram_size_in_bytes Memory used by the histograms of one leaf
   * \param total_size Total size will be used
   */
-  void ResetSize(int cache_size, int total_size) {
-    cache_size_ = cache_size;
-    // at least need 2 bucket to store smaller leaf and larger leaf
-    CHECK(cache_size_ >= 2);
+  void ResetSize(double cache_size_in_bytes, size_t histogram_size_in_bytes, int total_size) {
     total_size_ = total_size;
+    if (cache_size_in_bytes < 0 || histogram_size_in_bytes == 0) {
+      cache_size_ = total_size_;
+    } else {
+      cache_size_ = static_cast<int>(std::min(cache_size_in_bytes / histogram_size_in_bytes,
+        static_cast<double>(total_size_)));
+    }
+    // at least need 2 bucket to store smaller leaf and larger leaf
+    cache_size_ = std::max(2, cache_size_);
     if (cache_size_ > total_size_) {
       cache_size_ = total_size_;
     }
+    histogram_size_in_bytes_ = histogram_size_in_bytes;
     is_enough_ = (cache_size_ == total_size_);
     if (!is_enough_) {
       mapper_ = std::vector<int>(total_size_);
       inverse_mapper_ = std::vector<int>(cache_size_);
       last_used_time_ = std::vector<int>(cache_size_);
+      priority_ = std::vector<double>(cache_size_);
       ResetMap();
     }
   }
@@ -313,9 +763,11 @@ public:
   void ResetMap() {
     if (!is_enough_) {
       cur_time_ = 0;
+      inflation_ = 0.0f;
       std::fill(mapper_.begin(), mapper_.end(), -1);
       std::fill(inverse_mapper_.begin(), inverse_mapper_.end(), -1);
       std::fill(last_used_time_.begin(), last_used_time_.end(), 0);
+      std::fill(priority_.begin(), priority_.end(), 0.0f);
     }
   }
 
@@ -323,6 +775,11 @@ public:
   * \brief Fill the pool
   * \param obj_create_fun that used to generate object
   */
+  /*! \brief Sizes in byte of the histograms in the pool */
+  size_t SizesInByte() const {
+    return pool_.size() * histogram_size_in_bytes_;
+  }
+
   void Fill(std::function<FeatureHistogram*()> obj_create_fun) {
     pool_.clear();
     pool_.resize(cache_size_);
@@ -332,32 +789,47 @@ public:
   }
 
   /*!
-  * \brief Get data for the specific index
+  * \brief Get data for the specific index.
+  *        If the index is not in the pool, the slot that is cheapest to rebuild is evicted,
+  *        cost of a slot is the number of data of its leaf, aged by the cost of the last eviction (GreedyDual).
   * \param idx which index want to get
+  * \param num_data_in_leaf Number of data in this leaf, used as the cost to rebuild its histograms
   * \param out output data will store into this
   * \return True if this index is in the pool, False if this index is not in the pool
   */
-  bool Get(int idx, FeatureHistogram** out) {
+  bool Get(int idx, data_size_t num_data_in_leaf, FeatureHistogram** out) {
     if (is_enough_) {
       *out = pool_[idx].get();
       return true;
     } else if (mapper_[idx] >= 0) {
       int slot = mapper_[idx];
       *out = pool_[slot].get();
-      last_used_time_[slot] = ++cur_time_;
+      Touch(slot, num_data_in_leaf);
+      ++num_hits_;
       return true;
     } else {
-      // choose the least used slot 
-      int slot = static_cast<int>(ArrayArgs<int>::ArgMin(last_used_time_));
+      // choose the cheapest slot, except the one used just now, it is still used by the caller
+      int slot = -1;
+      for (int i = 0; i < cache_size_; ++i) {
+        if (cur_time_ > 0 && last_used_time_[i] == cur_time_) { continue; }
+        if (slot < 0 || priority_[i] < priority_[slot]
+          || (priority_[i] == priority_[slot] && last_used_time_[i] < last_used_time_[slot])) {
+          slot = i;
+        }
+      }
       *out = pool_[slot].get();
-      last_used_time_[slot] = ++cur_time_;
-
       // reset previous mapper
-      if (inverse_mapper_[slot] >= 0) mapper_[inverse_mapper_[slot]] = -1;
+      if (inverse_mapper_[slot] >= 0) {
+        mapper_[inverse_mapper_[slot]] = -1;
+        inflation_ = priority_[slot];
+        ++num_evictions_;
+      }
+      Touch(slot, num_data_in_leaf);
 
       // update current mapper
       mapper_[idx] = slot;
       inverse_mapper_[slot] = idx;
+      ++num_misses_;
       return false;
     }
   }
@@ -366,8 +838,9 @@ public:
   * \brief Move data from one index to another index
   * \param src_idx
   * \param dst_idx
+  * \param num_data_in_leaf Number of data in leaf dst_idx
   */
-  void Move(int src_idx, int dst_idx) {
+  void Move(int src_idx, int dst_idx, data_size_t num_data_in_leaf) {
     if (is_enough_) {
       std::swap(pool_[src_idx], pool_[dst_idx]);
       return;
@@ -382,10 +855,46 @@ public:
 
     // move to dst idx
     mapper_[dst_idx] = slot;
-    last_used_time_[slot] = ++cur_time_;
+    Touch(slot, num_data_in_leaf);
     inverse_mapper_[slot] = dst_idx;
   }
+
+  /*!
+  * \brief Release the data of one index, used when the index will not be used anymore
+  * \param idx
+  */
+  void Release(int idx) {
+    if (is_enough_ || mapper_[idx] < 0) {
+      return;
+    }
+    int slot = mapper_[idx];
+    mapper_[idx] = -1;
+    inverse_mapper_[slot] = -1;
+    priority_[slot] = 0.0f;
+  }
+
+  /*!
+  * \brief Log the hit, miss and eviction counters since last call, only when the pool cannot hold all leaves
+  */
+  void LogStatistics() {
+    if (is_enough_) { return; }
+    Log::Debug("Histogram pool (%d slots, %f MB): %d hits, %d misses, %d evictions",
+      cache_size_, cache_size_ * histogram_size_in_bytes_ / 1024.0f / 1024.0f,
+      num_hits_, num_misses_, num_evictions_);
+    num_hits_ = 0;
+    num_misses_ = 0;
+    num_evictions_ = 0;
+  }
+
+  /*! \brief True if the pool can hold histograms of all leaves */
+  bool is_enough() const { return is_enough_; }
+
 private:
+  /*! \brief Mark a slot as used, and reset its priority by the rebuild cost */
+  void Touch(int slot, data_size_t num_data_in_leaf) {
+    last_used_time_[slot] = ++cur_time_;
+    priority_[slot] = inflation_ + num_data_in_leaf;
+  }
 
   std::vector<std::unique_ptr<FeatureHistogram[]>> pool_;
   int cache_size_;
@@ -395,6 +904,18 @@ private:
   std::vector<int> inverse_mapper_;
   std::vector<int> last_used_time_;
   int cur_time_ = 0;
+  /*! \brief Memory used by the histograms of one leaf */
+  size_t histogram_size_in_bytes_ = 0;
+  /*! \brief Eviction priority of slots, lower will be evicted first */
+  std::vector<double> priority_;
+  /*! \brief Priority of the last evicted slot, added to new priorities so old slots age */
+  double inflation_ = 0.0f;
+  /*! \brief Number of hits since last LogStatistics */
+  int num_hits_ = 0;
+  /*! \brief Number of misses since last LogStatistics */
+  int num_misses_ = 0;
+  /*! \brief Number of evictions since last LogStatistics */
+  int num_evictions_ = 0;
 };
 
 
@@ -23,6 +23,12 @@ void FeatureParallelTreeLearner::Init(const Dataset* train_data) {
 
 
 
+void FeatureParallelTreeLearner::AddMemoryUsage(MemoryUsage* memory_usage) const {
+  SerialTreeLearner::AddMemoryUsage(memory_usage);
+  // buffers of network
+  memory_usage->Add(kTreeLearnerMemory, input_buffer_.capacity() + output_buffer_.capacity());
+}
+
 void FeatureParallelTreeLearner::BeforeTrain() {
   SerialTreeLearner::BeforeTrain();
   // get feature partition
@@ -65,8 +71,10 @@ void FeatureParallelTreeLearner::FindBestSplitsForLeaves() {
   std::memcpy(input_buffer_.data(), &smaller_best, sizeof(SplitInfo));
   std::memcpy(input_buffer_.data() + sizeof(SplitInfo), &larger_best, sizeof(SplitInfo));
 
+  Network::SetPhase(kSplitPhase);
   Network::Allreduce(input_buffer_.data(), sizeof(SplitInfo) * 2, sizeof(SplitInfo),
                      output_buffer_.data(), &SplitInfo::MaxReducer);
+  Network::SetPhase(kOtherPhase);
   // copy back
   std::memcpy(&smaller_best, output_buffer_.data(), sizeof(SplitInfo));
   std::memcpy(&larger_best, output_buffer_.data() + sizeof(SplitInfo), sizeof(SplitInfo));
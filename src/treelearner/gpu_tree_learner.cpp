@@ -0,0 +1,409 @@
+#ifdef USE_GPU
+
+#include "gpu_tree_learner.h"
+
+#include <LightGBM/utils/threading.h>
+#include <LightGBM/utils/profiler.h>
+
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace LightGBM {
+
+namespace {
+
+// one work group constructs the local histograms of a group of NUM_FEATURES_PER_GROUP features for one chunk of data.
+// bins of the features in a group are interleaved, so a work item reads the bins, gradient and hessian of a row once
+// for all of them. sums are added by compare-and-swap since OpenCL 1.2 has no atomic add of float, and neighbouring
+// work items start from different features, so the rows of a hot bin are spread over the histograms of the group
+const char* kHistogramKernelSource = R"(
+typedef struct {
+  float sum_gradients;
+  float sum_hessians;
+  uint cnt;
+} histogram_entry;
+
+inline void atomic_add_local_float(volatile __local float* addr, float val) {
+  union { uint u; float f; } old_val, new_val;
+  do {
+    old_val.f = *addr;
+    new_val.f = old_val.f + val;
+  } while (atomic_cmpxchg((volatile __local uint*)addr, old_val.u, new_val.u) != old_val.u);
+}
+
+__kernel void construct_histograms(__global const uchar* bins, const int num_data,
+  __global const int* used_groups, __global const int* data_indices, const int use_indices,
+  const int num_data_in_leaf, const int num_data_per_chunk,
+  __global const float* gradients, __global const float* hessians, const int is_constant_hessian,
+  __global histogram_entry* partial_histograms) {
+  __local float local_gradients[NUM_FEATURES_PER_GROUP * NUM_BIN];
+  __local float local_hessians[NUM_FEATURES_PER_GROUP * NUM_BIN];
+  __local uint local_cnt[NUM_FEATURES_PER_GROUP * NUM_BIN];
+  const int lid = get_local_id(0);
+  const int chunk = get_group_id(0);
+  const int group = get_global_id(1);
+  const int num_groups = get_global_size(1);
+  for (int k = 0; k < NUM_FEATURES_PER_GROUP; ++k) {
+    local_gradients[k * NUM_BIN + lid] = 0.0f;
+    local_hessians[k * NUM_BIN + lid] = 0.0f;
+    local_cnt[k * NUM_BIN + lid] = 0;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  __global const uchar* group_bins = bins + (size_t)used_groups[group] * num_data * NUM_FEATURES_PER_GROUP;
+  const int start = chunk * num_data_per_chunk;
+  const int end = min(start + num_data_per_chunk, num_data_in_leaf);
+  for (int i = start + lid; i < end; i += NUM_BIN) {
+    const int idx = use_indices ? data_indices[i] : i;
+    __global const uchar* row_bins = group_bins + (size_t)idx * NUM_FEATURES_PER_GROUP;
+    const float gradient = gradients[idx];
+    const float hessian = is_constant_hessian ? 0.0f : hessians[idx];
+    for (int k = 0; k < NUM_FEATURES_PER_GROUP; ++k) {
+      const int feature = (lid + k) % NUM_FEATURES_PER_GROUP;
+      const int pos = feature * NUM_BIN + row_bins[feature];
+      atomic_add_local_float(local_gradients + pos, gradient);
+      if (!is_constant_hessian) {
+        atomic_add_local_float(local_hessians + pos, hessian);
+      }
+      atomic_inc(local_cnt + pos);
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (int k = 0; k < NUM_FEATURES_PER_GROUP; ++k) {
+    __global histogram_entry* out = partial_histograms
+      + (((size_t)chunk * num_groups + group) * NUM_FEATURES_PER_GROUP + k) * NUM_BIN;
+    out[lid].sum_gradients = local_gradients[k * NUM_BIN + lid];
+    out[lid].sum_hessians = local_hessians[k * NUM_BIN + lid];
+    out[lid].cnt = local_cnt[k * NUM_BIN + lid];
+  }
+}
+
+__kernel void reduce_histograms(__global const histogram_entry* partial_histograms, const int num_chunks,
+  __global histogram_entry* histograms) {
+  const int bin = get_global_id(0);
+  const int column = get_global_id(1);
+  const int num_columns = get_global_size(1);
+  float sum_gradients = 0.0f;
+  float sum_hessians = 0.0f;
+  uint cnt = 0;
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    const histogram_entry entry = partial_histograms[((size_t)chunk * num_columns + column) * NUM_BIN + bin];
+    sum_gradients += entry.sum_gradients;
+    sum_hessians += entry.sum_hessians;
+    cnt += entry.cnt;
+  }
+  __global histogram_entry* out = histograms + (size_t)column * NUM_BIN + bin;
+  out->sum_gradients = sum_gradients;
+  out->sum_hessians = sum_hessians;
+  out->cnt = cnt;
+}
+)";
+
+inline void CheckCL(cl_int err, const char* what) {
+  if (err != CL_SUCCESS) {
+    Log::Fatal("OpenCL error %d in %s", static_cast<int>(err), what);
+  }
+}
+
+std::string DeviceInfoString(cl_device_id device, cl_device_info param) {
+  char buf[256];
+  if (clGetDeviceInfo(device, param, sizeof(buf), buf, nullptr) != CL_SUCCESS) {
+    return std::string();
+  }
+  buf[sizeof(buf) - 1] = '\0';
+  return std::string(buf);
+}
+
+}  // namespace
+
+GPUTreeLearner::GPUTreeLearner(const TreeConfig& tree_config)
+  :SerialTreeLearner(tree_config) {
+  Log::Warning("GPU tree learner is experimental, compare its models with tree_learner=serial on your device");
+  gpu_platform_id_ = tree_config.gpu_platform_id;
+  gpu_device_id_ = tree_config.gpu_device_id;
+  // the device reads float gradients and hessians
+  if (use_quantized_grad_ || use_bf16_grad_) {
+    Log::Warning("GPU tree learner uses float gradients, use_quantized_grad and use_bf16_grad are ignored");
+    use_quantized_grad_ = false;
+    use_bf16_grad_ = false;
+  }
+}
+
+GPUTreeLearner::~GPUTreeLearner() {
+  ReleaseDevice();
+}
+
+void GPUTreeLearner::Init(const Dataset* train_data) {
+  SerialTreeLearner::Init(train_data);
+  static_assert(sizeof(score_t) == sizeof(float), "gradients on the device are float");
+  static_assert(sizeof(data_size_t) == sizeof(cl_int), "data indices on the device are int");
+  static_assert(sizeof(GPUHistogramEntry) == 3 * sizeof(float), "layout of histogram entries on the device");
+  ReleaseDevice();
+  device_features_.clear();
+  for (int i = 0; i < num_features_; ++i) {
+    if (ordered_bins_[i] == nullptr && !is_feature_grouped_[i] && train_data_->FeatureAt(i)->num_bin() <= kNumBin) {
+      device_features_.push_back(i);
+    }
+  }
+  if (device_features_.empty()) {
+    Log::Warning("No dense features with at most %d bins, histograms are constructed on CPU", kNumBin);
+    return;
+  }
+  InitDevice();
+  InitDeviceFeatures();
+}
+
+void GPUTreeLearner::InitDevice() {
+  cl_int err = CL_SUCCESS;
+  cl_uint num_platforms = 0;
+  CheckCL(clGetPlatformIDs(0, nullptr, &num_platforms), "clGetPlatformIDs");
+  if (num_platforms == 0) {
+    Log::Fatal("No OpenCL platform is found");
+  }
+  std::vector<cl_platform_id> platforms(num_platforms);
+  CheckCL(clGetPlatformIDs(num_platforms, platforms.data(), nullptr), "clGetPlatformIDs");
+  if (gpu_platform_id_ >= static_cast<int>(num_platforms)) {
+    Log::Fatal("gpu_platform_id %d is out of range, there are %d OpenCL platforms", gpu_platform_id_, num_platforms);
+  }
+  // take the first platform with a GPU if the platform is not specified
+  cl_device_id device = nullptr;
+  for (int i = 0; i < static_cast<int>(num_platforms) && device == nullptr; ++i) {
+    if (gpu_platform_id_ >= 0 && i != gpu_platform_id_) { continue; }
+    cl_uint num_devices = 0;
+    if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 0, nullptr, &num_devices) != CL_SUCCESS || num_devices == 0) {
+      continue;
+    }
+    std::vector<cl_device_id> devices(num_devices);
+    CheckCL(clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, num_devices, devices.data(), nullptr), "clGetDeviceIDs");
+    if (gpu_device_id_ >= static_cast<int>(num_devices)) {
+      Log::Fatal("gpu_device_id %d is out of range, there are %d GPUs in OpenCL platform %d",
+        gpu_device_id_, num_devices, i);
+    }
+    device = devices[std::max(gpu_device_id_, 0)];
+  }
+  if (device == nullptr) {
+    Log::Fatal("No OpenCL GPU device is found");
+  }
+  size_t max_work_group_size = 0;
+  CheckCL(clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_work_group_size),
+    &max_work_group_size, nullptr), "clGetDeviceInfo");
+  if (max_work_group_size < static_cast<size_t>(kNumBin)) {
+    Log::Fatal("GPU tree learner needs work groups of %d items, the device only supports %d",
+      kNumBin, static_cast<int>(max_work_group_size));
+  }
+  cl_ulong local_mem_size = 0;
+  CheckCL(clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem_size), &local_mem_size, nullptr),
+    "clGetDeviceInfo");
+  const cl_ulong needed_local_mem_size = sizeof(GPUHistogramEntry) * kNumBin * kNumFeaturesPerGroup;
+  if (local_mem_size < needed_local_mem_size) {
+    Log::Fatal("GPU tree learner needs %d bytes of local memory, the device only has %d",
+      static_cast<int>(needed_local_mem_size), static_cast<int>(local_mem_size));
+  }
+  Log::Info("Using GPU device %s of %s", DeviceInfoString(device, CL_DEVICE_NAME).c_str(),
+    DeviceInfoString(device, CL_DEVICE_VENDOR).c_str());
+
+  context_ = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &err);
+  CheckCL(err, "clCreateContext");
+  queue_ = clCreateCommandQueue(context_, device, 0, &err);
+  CheckCL(err, "clCreateCommandQueue");
+  program_ = clCreateProgramWithSource(context_, 1, &kHistogramKernelSource, nullptr, &err);
+  CheckCL(err, "clCreateProgramWithSource");
+  const std::string options = "-D NUM_BIN=" + std::to_string(kNumBin)
+    + " -D NUM_FEATURES_PER_GROUP=" + std::to_string(kNumFeaturesPerGroup);
+  err = clBuildProgram(program_, 1, &device, options.c_str(), nullptr, nullptr);
+  if (err != CL_SUCCESS) {
+    size_t log_size = 0;
+    clGetProgramBuildInfo(program_, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
+    std::vector<char> build_log(log_size + 1, '\0');
+    clGetProgramBuildInfo(program_, device, CL_PROGRAM_BUILD_LOG, log_size, build_log.data(), nullptr);
+    Log::Fatal("Cannot build the GPU histogram kernels, OpenCL error %d:\n%s", static_cast<int>(err), build_log.data());
+  }
+  histogram_kernel_ = clCreateKernel(program_, "construct_histograms", &err);
+  CheckCL(err, "clCreateKernel");
+  reduce_kernel_ = clCreateKernel(program_, "reduce_histograms", &err);
+  CheckCL(err, "clCreateKernel");
+}
+
+void GPUTreeLearner::InitDeviceFeatures() {
+  cl_int err = CL_SUCCESS;
+  const int num_features = static_cast<int>(device_features_.size());
+  const int num_groups = (num_features + kNumFeaturesPerGroup - 1) / kNumFeaturesPerGroup;
+  // bins are copied group by group, so the host only holds a group at a time.
+  // bins of the features in a group are interleaved row by row, missing features of the last group are all 0
+  const size_t group_size = static_cast<size_t>(num_data_) * kNumFeaturesPerGroup;
+  device_bins_ = clCreateBuffer(context_, CL_MEM_READ_ONLY, group_size * num_groups, nullptr, &err);
+  CheckCL(err, "clCreateBuffer");
+  std::vector<uint8_t> group_bins(group_size);
+  for (int g = 0; g < num_groups; ++g) {
+    std::fill(group_bins.begin(), group_bins.end(), static_cast<uint8_t>(0));
+    for (int k = 0; k < kNumFeaturesPerGroup && g * kNumFeaturesPerGroup + k < num_features; ++k) {
+      const Bin* bin_data = train_data_->FeatureAt(device_features_[g * kNumFeaturesPerGroup + k])->bin_data();
+      Threading::For<data_size_t>(0, num_data_, [bin_data, k, &group_bins](int, data_size_t start, data_size_t end) {
+        std::unique_ptr<BinIterator> iterator(bin_data->GetIterator(start));
+        for (data_size_t i = start; i < end; ++i) {
+          group_bins[static_cast<size_t>(i) * kNumFeaturesPerGroup + k] = static_cast<uint8_t>(iterator->Get(i));
+        }
+      });
+    }
+    CheckCL(clEnqueueWriteBuffer(queue_, device_bins_, CL_TRUE, group_size * g, group_size, group_bins.data(),
+      0, nullptr, nullptr), "clEnqueueWriteBuffer");
+  }
+  const size_t gradients_size = sizeof(float) * num_data_;
+  const size_t histograms_size = sizeof(GPUHistogramEntry) * kNumBin * kNumFeaturesPerGroup * num_groups;
+  device_gradients_ = clCreateBuffer(context_, CL_MEM_READ_ONLY, gradients_size, nullptr, &err);
+  CheckCL(err, "clCreateBuffer");
+  device_hessians_ = clCreateBuffer(context_, CL_MEM_READ_ONLY, gradients_size, nullptr, &err);
+  CheckCL(err, "clCreateBuffer");
+  device_data_indices_ = clCreateBuffer(context_, CL_MEM_READ_ONLY, sizeof(cl_int) * num_data_, nullptr, &err);
+  CheckCL(err, "clCreateBuffer");
+  device_used_groups_ = clCreateBuffer(context_, CL_MEM_READ_ONLY, sizeof(cl_int) * num_groups, nullptr, &err);
+  CheckCL(err, "clCreateBuffer");
+  device_partial_histograms_ = clCreateBuffer(context_, CL_MEM_READ_WRITE, histograms_size * kMaxNumChunks, nullptr, &err);
+  CheckCL(err, "clCreateBuffer");
+  device_histograms_ = clCreateBuffer(context_, CL_MEM_WRITE_ONLY, histograms_size, nullptr, &err);
+  CheckCL(err, "clCreateBuffer");
+  device_size_in_byte_ = group_size * num_groups + 3 * gradients_size + sizeof(cl_int) * num_groups
+    + histograms_size * (kMaxNumChunks + 1);
+  host_histograms_.resize(static_cast<size_t>(kNumBin) * kNumFeaturesPerGroup * num_groups);
+  Log::Info("Constructing histograms of %d features in %d groups on GPU, device memory: %f MB",
+    num_features, num_groups, device_size_in_byte_ / 1024.0 / 1024.0);
+}
+
+void GPUTreeLearner::ReleaseDevice() {
+  cl_mem* buffers[] = { &device_bins_, &device_gradients_, &device_hessians_, &device_data_indices_,
+    &device_used_groups_, &device_partial_histograms_, &device_histograms_ };
+  for (cl_mem* buffer : buffers) {
+    if (*buffer != nullptr) {
+      clReleaseMemObject(*buffer);
+      *buffer = nullptr;
+    }
+  }
+  if (histogram_kernel_ != nullptr) { clReleaseKernel(histogram_kernel_); histogram_kernel_ = nullptr; }
+  if (reduce_kernel_ != nullptr) { clReleaseKernel(reduce_kernel_); reduce_kernel_ = nullptr; }
+  if (program_ != nullptr) { clReleaseProgram(program_); program_ = nullptr; }
+  if (queue_ != nullptr) { clReleaseCommandQueue(queue_); queue_ = nullptr; }
+  if (context_ != nullptr) { clReleaseContext(context_); context_ = nullptr; }
+  host_histograms_.clear();
+  device_size_in_byte_ = 0;
+}
+
+void GPUTreeLearner::AddMemoryUsage(MemoryUsage* memory_usage) const {
+  SerialTreeLearner::AddMemoryUsage(memory_usage);
+  // memory of the device is not counted
+  memory_usage->Add(kTreeLearnerMemory, sizeof(GPUHistogramEntry) * host_histograms_.capacity());
+}
+
+void GPUTreeLearner::BeforeTrain() {
+  SerialTreeLearner::BeforeTrain();
+  used_device_groups_.clear();
+  used_host_features_.clear();
+  std::vector<bool> is_on_device(num_features_, false);
+  for (int j = 0; j < static_cast<int>(device_features_.size()); ++j) {
+    is_on_device[device_features_[j]] = true;
+    // a group is used if any feature of it is used
+    const int group = j / kNumFeaturesPerGroup;
+    if (is_feature_used_[device_features_[j]]
+      && (used_device_groups_.empty() || used_device_groups_.back() != group)) {
+      used_device_groups_.push_back(group);
+    }
+  }
+  for (int i = 0; i < num_features_; ++i) {
+    if (is_feature_used_[i] && !is_on_device[i] && ordered_bins_[i] == nullptr && !is_feature_grouped_[i]) {
+      used_host_features_.push_back(i);
+    }
+  }
+  if (used_device_groups_.empty()) { return; }
+  // full gradients stay on the device for the whole tree, leaves only upload their data indices
+  CheckCL(clEnqueueWriteBuffer(queue_, device_used_groups_, CL_FALSE, 0, sizeof(cl_int) * used_device_groups_.size(),
+    used_device_groups_.data(), 0, nullptr, nullptr), "clEnqueueWriteBuffer");
+  CheckCL(clEnqueueWriteBuffer(queue_, device_gradients_, CL_FALSE, 0, sizeof(float) * num_data_,
+    gradients_, 0, nullptr, nullptr), "clEnqueueWriteBuffer");
+  if (!is_constant_hessian_) {
+    CheckCL(clEnqueueWriteBuffer(queue_, device_hessians_, CL_FALSE, 0, sizeof(float) * num_data_,
+      hessians_, 0, nullptr, nullptr), "clEnqueueWriteBuffer");
+  }
+  CheckCL(clFinish(queue_), "clFinish");
+}
+
+bool GPUTreeLearner::ConstructDenseHistograms(const LeafSplits* leaf_splits, const score_t* ordered_gradients,
+  const score_t* ordered_hessians, FeatureHistogram* histogram_array) {
+  const data_size_t num_data_in_leaf = leaf_splits->num_data_in_leaf();
+  if (used_device_groups_.empty() || num_data_in_leaf < kMinDataForGPU) {
+    return SerialTreeLearner::ConstructDenseHistograms(leaf_splits, ordered_gradients, ordered_hessians, histogram_array);
+  }
+  ProfileScope profile_scope(kConstructHistogramsProfile);
+  const cl_int num_groups = static_cast<cl_int>(used_device_groups_.size());
+  const cl_int num_columns = num_groups * kNumFeaturesPerGroup;
+  cl_int use_indices = num_data_in_leaf < num_data_ ? 1 : 0;
+  if (use_indices) {
+    data_size_t tmp_cnt = 0;
+    const data_size_t* data_indices = data_partition_->GetIndexOnLeaf(leaf_splits->LeafIndex(), &tmp_cnt);
+    CheckCL(clEnqueueWriteBuffer(queue_, device_data_indices_, CL_FALSE, 0, sizeof(cl_int) * num_data_in_leaf,
+      data_indices, 0, nullptr, nullptr), "clEnqueueWriteBuffer");
+  }
+  cl_int num_chunks = static_cast<cl_int>(std::min<data_size_t>(kMaxNumChunks,
+    (num_data_in_leaf + kMinDataPerChunk - 1) / kMinDataPerChunk));
+  cl_int num_data_per_chunk = (num_data_in_leaf + num_chunks - 1) / num_chunks;
+  cl_int num_data = num_data_;
+  cl_int num_data_in_leaf_arg = num_data_in_leaf;
+  cl_int is_constant_hessian = is_constant_hessian_ ? 1 : 0;
+  cl_uint arg = 0;
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_mem), &device_bins_), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_int), &num_data), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_mem), &device_used_groups_), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_mem), &device_data_indices_), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_int), &use_indices), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_int), &num_data_in_leaf_arg), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_int), &num_data_per_chunk), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_mem), &device_gradients_), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_mem), &device_hessians_), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_int), &is_constant_hessian), "clSetKernelArg");
+  CheckCL(clSetKernelArg(histogram_kernel_, arg++, sizeof(cl_mem), &device_partial_histograms_), "clSetKernelArg");
+  const size_t histogram_global_size[2] = { static_cast<size_t>(kNumBin) * num_chunks, static_cast<size_t>(num_groups) };
+  const size_t local_size[2] = { static_cast<size_t>(kNumBin), 1 };
+  CheckCL(clEnqueueNDRangeKernel(queue_, histogram_kernel_, 2, nullptr, histogram_global_size, local_size,
+    0, nullptr, nullptr), "clEnqueueNDRangeKernel");
+  arg = 0;
+  CheckCL(clSetKernelArg(reduce_kernel_, arg++, sizeof(cl_mem), &device_partial_histograms_), "clSetKernelArg");
+  CheckCL(clSetKernelArg(reduce_kernel_, arg++, sizeof(cl_int), &num_chunks), "clSetKernelArg");
+  CheckCL(clSetKernelArg(reduce_kernel_, arg++, sizeof(cl_mem), &device_histograms_), "clSetKernelArg");
+  const size_t reduce_global_size[2] = { static_cast<size_t>(kNumBin), static_cast<size_t>(num_columns) };
+  CheckCL(clEnqueueNDRangeKernel(queue_, reduce_kernel_, 2, nullptr, reduce_global_size, local_size,
+    0, nullptr, nullptr), "clEnqueueNDRangeKernel");
+  CheckCL(clEnqueueReadBuffer(queue_, device_histograms_, CL_FALSE, 0,
+    sizeof(GPUHistogramEntry) * kNumBin * num_columns, host_histograms_.data(), 0, nullptr, nullptr),
+    "clEnqueueReadBuffer");
+  CheckCL(clFlush(queue_), "clFlush");
+  // the rest of dense features are constructed on CPU while the device is running
+  Threading::ParallelFor(0, static_cast<int>(used_host_features_.size()), [&](int i) {
+    ConstructDenseHistogram(used_host_features_[i], leaf_splits, ordered_gradients, ordered_hessians,
+      nullptr, nullptr, histogram_array);
+  });
+  CheckCL(clFinish(queue_), "clFinish");
+  // histograms of used groups are read back in the order of used_device_groups_, kNumFeaturesPerGroup per group
+  Threading::ParallelFor(0, num_columns, [&](int j) {
+    const int device_index = used_device_groups_[j / kNumFeaturesPerGroup] * kNumFeaturesPerGroup + j % kNumFeaturesPerGroup;
+    if (device_index >= static_cast<int>(device_features_.size())
+      || !is_feature_used_[device_features_[device_index]]) {
+      return;
+    }
+    const int feature_index = device_features_[device_index];
+    const int num_bin = train_data_->FeatureAt(feature_index)->num_bin();
+    HistogramBinEntry* out = histogram_array[feature_index].ResetForConstruct(num_data_in_leaf,
+      leaf_splits->sum_gradients(), leaf_splits->sum_hessians(), is_constant_hessian_);
+    const GPUHistogramEntry* entries = host_histograms_.data() + static_cast<size_t>(j) * kNumBin;
+    for (int k = 0; k < num_bin; ++k) {
+      out[k].sum_gradients = entries[k].sum_gradients;
+      out[k].sum_hessians = entries[k].sum_hessians;
+      out[k].cnt = static_cast<data_size_t>(entries[k].cnt);
+    }
+  });
+  return true;
+}
+
+}  // namespace LightGBM
+
+#endif  // USE_GPU
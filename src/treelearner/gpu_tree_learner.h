@@ -0,0 +1,106 @@
+#ifndef LIGHTGBM_TREELEARNER_GPU_TREE_LEARNER_H_
+#define LIGHTGBM_TREELEARNER_GPU_TREE_LEARNER_H_
+
+#ifdef USE_GPU
+
+#include "serial_tree_learner.h"
+
+#define CL_TARGET_OPENCL_VERSION 120
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <cstdint>
+
+#include <vector>
+
+namespace LightGBM {
+
+/*!
+* \brief Tree learner that constructs histograms of dense features on an OpenCL device.
+*        Bins of dense features with at most kNumBin bins stay on the device for the whole training, interleaved in
+*        groups of kNumFeaturesPerGroup features, which share the reads of rows and spread the updates of hot bins.
+*        Gradients and hessians are uploaded once per tree, and data indices of a leaf once per leaf.
+*        Histograms are read back into FeatureHistogram, so finding splits and the subtraction of
+*        larger leaves run on CPU as in serial tree learner. Sums are in float on the device
+*/
+class GPUTreeLearner: public SerialTreeLearner {
+public:
+  explicit GPUTreeLearner(const TreeConfig& tree_config);
+  ~GPUTreeLearner();
+  void Init(const Dataset* train_data) override;
+  void AddMemoryUsage(MemoryUsage* memory_usage) const override;
+
+protected:
+  void BeforeTrain() override;
+  bool ConstructDenseHistograms(const LeafSplits* leaf_splits, const score_t* ordered_gradients,
+    const score_t* ordered_hessians, FeatureHistogram* histogram_array) override;
+
+private:
+  /*! \brief Histogram entry on the device */
+  struct GPUHistogramEntry {
+    float sum_gradients;
+    float sum_hessians;
+    uint32_t cnt;
+  };
+
+  /*! \brief Max number of bins of a feature on the device, also the size of work groups */
+  static const int kNumBin = 256;
+  /*! \brief Number of features whose histograms are constructed by one work group */
+  static const int kNumFeaturesPerGroup = 4;
+  /*! \brief Max number of chunks of data of a leaf, each chunk is processed by one work group per group of features */
+  static const int kMaxNumChunks = 64;
+  /*! \brief Min number of data of a chunk */
+  static const data_size_t kMinDataPerChunk = 4096;
+  /*! \brief Use the device only when a leaf has at least this many data, smaller leaves are cheaper on CPU */
+  static const data_size_t kMinDataForGPU = 16384;
+
+  /*! \brief Select platform and device, then create the context, queue and kernels */
+  void InitDevice();
+
+  /*! \brief Copy bins of the device features to the device, group by group */
+  void InitDeviceFeatures();
+
+  /*! \brief Release all OpenCL objects */
+  void ReleaseDevice();
+
+  /*! \brief OpenCL platform to use, -1 means the first one with a GPU */
+  int gpu_platform_id_;
+  /*! \brief OpenCL device to use, -1 means the first GPU of the platform */
+  int gpu_device_id_;
+  /*! \brief Features whose histograms are constructed on the device, the j-th is in group j / kNumFeaturesPerGroup */
+  std::vector<int> device_features_;
+  /*! \brief Groups of device_features_ that have features used by current tree */
+  std::vector<int> used_device_groups_;
+  /*! \brief Used dense features that are not on the device, e.g. have more than kNumBin bins */
+  std::vector<int> used_host_features_;
+  /*! \brief Histograms read back from the device, kNumBin entries for each feature of used groups */
+  std::vector<GPUHistogramEntry> host_histograms_;
+  /*! \brief Size in byte of the buffers on the device */
+  size_t device_size_in_byte_ = 0;
+
+  cl_context context_ = nullptr;
+  cl_command_queue queue_ = nullptr;
+  cl_program program_ = nullptr;
+  cl_kernel histogram_kernel_ = nullptr;
+  cl_kernel reduce_kernel_ = nullptr;
+  /*! \brief Bins of device features, group by group, kNumFeaturesPerGroup bytes per row in a group */
+  cl_mem device_bins_ = nullptr;
+  cl_mem device_gradients_ = nullptr;
+  cl_mem device_hessians_ = nullptr;
+  cl_mem device_data_indices_ = nullptr;
+  /*! \brief Groups used by current tree */
+  cl_mem device_used_groups_ = nullptr;
+  /*! \brief Histograms of each chunk, before they are reduced */
+  cl_mem device_partial_histograms_ = nullptr;
+  cl_mem device_histograms_ = nullptr;
+};
+
+}  // namespace LightGBM
+
+#endif  // USE_GPU
+
+#endif   // LightGBM_TREELEARNER_GPU_TREE_LEARNER_H_
@@ -0,0 +1,279 @@
+#include "parallel_tree_learner.h"
+
+#include <cstring>
+
+#include <tuple>
+#include <vector>
+
+namespace LightGBM {
+
+HybridParallelTreeLearner::HybridParallelTreeLearner(const TreeConfig& tree_config)
+  :SerialTreeLearner(tree_config) {
+}
+
+HybridParallelTreeLearner::~HybridParallelTreeLearner() {
+
+}
+
+void HybridParallelTreeLearner::Init(const Dataset* train_data) {
+  // initialize SerialTreeLearner
+  SerialTreeLearner::Init(train_data);
+  // Get local position in the machine grid
+  rank_ = Network::rank();
+  num_machines_ = Network::num_machines();
+  num_columns_ = Network::num_grid_columns();
+  num_rows_ = num_machines_ / num_columns_;
+  column_ = rank_ % num_columns_;
+  row_ = rank_ / num_columns_;
+  // allocate buffer for communication
+  size_t buffer_size = sizeof(SplitInfo) * 2;
+  for (int i = 0; i < num_features_; ++i) {
+    buffer_size += HistogramSizeInByte(i);
+  }
+
+  input_buffer_.resize(buffer_size);
+  output_buffer_.resize(sizeof(SplitInfo) * 2);
+
+  block_start_.resize(num_rows_);
+  block_len_.resize(num_rows_);
+  buffer_write_start_pos_.resize(num_features_);
+  global_data_count_in_leaf_.resize(num_leaves_);
+}
+
+void HybridParallelTreeLearner::AddMemoryUsage(MemoryUsage* memory_usage) const {
+  SerialTreeLearner::AddMemoryUsage(memory_usage);
+  // buffers of network
+  memory_usage->Add(kTreeLearnerMemory, input_buffer_.capacity() + output_buffer_.capacity());
+}
+
+void HybridParallelTreeLearner::BeforeTrain() {
+  SerialTreeLearner::BeforeTrain();
+  // split used features to columns, every machine gets the same partition
+  std::vector<std::vector<int>> column_distribution(num_columns_, std::vector<int>());
+  std::vector<int> column_num_bins(num_columns_, 0);
+  for (int i = 0; i < train_data_->num_features(); ++i) {
+    if (is_feature_used_[i]) {
+      int cur_min_column = static_cast<int>(ArrayArgs<int>::ArgMin(column_num_bins));
+      column_distribution[cur_min_column].push_back(i);
+      column_num_bins[cur_min_column] += train_data_->FeatureAt(i)->num_bin();
+      is_feature_used_[i] = false;
+    }
+  }
+  // only histograms of the features of local column are constructed
+  column_features_ = column_distribution[column_];
+  for (auto fid : column_features_) {
+    is_feature_used_[fid] = true;
+  }
+  // different rows in the column will aggregate histograms for different features
+  std::vector<std::vector<int>> row_distribution(num_rows_, std::vector<int>());
+  std::vector<int> row_num_bins(num_rows_, 0);
+  for (auto fid : column_features_) {
+    int cur_min_row = static_cast<int>(ArrayArgs<int>::ArgMin(row_num_bins));
+    row_distribution[cur_min_row].push_back(fid);
+    row_num_bins[cur_min_row] += train_data_->FeatureAt(fid)->num_bin();
+  }
+  aggregated_features_ = row_distribution[row_];
+  // the buffer is laid out row by row
+  int bin_size = 0;
+  for (int i = 0; i < num_rows_; ++i) {
+    block_start_[i] = bin_size;
+    for (auto fid : row_distribution[i]) {
+      buffer_write_start_pos_[fid] = bin_size;
+      bin_size += HistogramSizeInByte(fid);
+    }
+    block_len_[i] = bin_size - block_start_[i];
+  }
+  // integer and real histograms are mixed in the buffer if gradients are quantized
+  if (use_quantized_grad_) {
+    histogram_layout_.Reset(input_buffer_.data());
+    for (auto fid : column_features_) {
+      histogram_layout_.Add(buffer_write_start_pos_[fid], HistogramSizeInByte(fid), is_histogram_int_[fid]);
+    }
+    histogram_layout_.Finish();
+  }
+
+  // sync global data sumup info, machines in a column hold different data partitions
+  std::tuple<data_size_t, double, double> data(smaller_leaf_splits_->num_data_in_leaf(),
+             smaller_leaf_splits_->sum_gradients(), smaller_leaf_splits_->sum_hessians());
+  int size = sizeof(data);
+  std::memcpy(input_buffer_.data(), &data, size);
+  // global sumup reduce
+  Network::SetPhase(kGlobalSyncPhase);
+  Network::AllreduceInColumn(input_buffer_.data(), size, size, [](const char *src, char *dst, int len) {
+    int used_size = 0;
+    int type_size = sizeof(std::tuple<data_size_t, double, double>);
+    const std::tuple<data_size_t, double, double> *p1;
+    std::tuple<data_size_t, double, double> *p2;
+    while (used_size < len) {
+      p1 = reinterpret_cast<const std::tuple<data_size_t, double, double> *>(src);
+      p2 = reinterpret_cast<std::tuple<data_size_t, double, double> *>(dst);
+      std::get<0>(*p2) = std::get<0>(*p2) + std::get<0>(*p1);
+      std::get<1>(*p2) = std::get<1>(*p2) + std::get<1>(*p1);
+      std::get<2>(*p2) = std::get<2>(*p2) + std::get<2>(*p1);
+      src += type_size;
+      dst += type_size;
+      used_size += type_size;
+    }
+  });
+  Network::SetPhase(kOtherPhase);
+  // copy back
+  std::memcpy(static_cast<void*>(&data), input_buffer_.data(), size);
+  // set global sumup info
+  smaller_leaf_splits_->Init(std::get<1>(data), std::get<2>(data));
+  // init global data count in leaf
+  global_data_count_in_leaf_[0] = std::get<0>(data);
+}
+
+void HybridParallelTreeLearner::FindBestThresholds() {
+  // construct local histograms of the features of local column
+  bool is_dense_constructed = ConstructRowParallelHistograms(smaller_leaf_splits_.get(),
+    ptr_to_ordered_gradients_smaller_leaf_, ptr_to_ordered_hessians_smaller_leaf_, smaller_leaf_histogram_array_);
+  if (!feature_groups_.empty() || train_data_->num_feature_bundles() > 0) {
+    ConstructGroupedHistograms(smaller_leaf_splits_.get(), ptr_to_ordered_gradients_smaller_leaf_,
+      ptr_to_ordered_hessians_smaller_leaf_, smaller_leaf_histogram_array_);
+  }
+  #pragma omp parallel for schedule(guided)
+  for (int i = 0; i < static_cast<int>(column_features_.size()); ++i) {
+    const int feature_index = column_features_[i];
+    // construct histograms for smaller leaf
+    if (is_feature_grouped_[feature_index]
+      || (is_dense_constructed && ordered_bins_[feature_index] == nullptr)) {
+      // already constructed
+    } else if (ordered_bins_[feature_index] == nullptr) {
+      ConstructDenseHistogram(feature_index, smaller_leaf_splits_.get(),
+                              ptr_to_ordered_gradients_smaller_leaf_,
+                              ptr_to_ordered_hessians_smaller_leaf_,
+                              ptr_to_ordered_grad_hess_smaller_leaf_,
+                              ptr_to_ordered_bf16_grad_hess_smaller_leaf_,
+                              smaller_leaf_histogram_array_);
+    } else {
+      smaller_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
+                                                             smaller_leaf_splits_->LeafIndex(),
+                                                             smaller_leaf_splits_->num_data_in_leaf(),
+                                                             smaller_leaf_splits_->sum_gradients(),
+                                                             smaller_leaf_splits_->sum_hessians(),
+                                                             gradients_,
+                                                             HistogramHessians());
+    }
+    // copy to buffer
+    std::memcpy(input_buffer_.data() + buffer_write_start_pos_[feature_index],
+                smaller_leaf_histogram_array_[feature_index].HistogramData(),
+                smaller_leaf_histogram_array_[feature_index].SizeOfHistgram());
+  }
+  // Reduce scatter for histogram among the machines in local column
+  Network::SetPhase(kHistogramPhase);
+  if (use_quantized_grad_) {
+    // fields of both entries are of 8 bytes, so chunks of the ring are cut at multiples of 8
+    const HistogramBufferLayout& layout = histogram_layout_;
+    Network::ReduceScatterInColumn(input_buffer_.data(), 8, block_start_.data(), block_len_.data(),
+                                   [&layout](const char* src, char* dst, int len) { layout.SumReducer(src, dst, len); });
+  } else {
+    Network::ReduceScatterInColumn(input_buffer_.data(), sizeof(HistogramBinEntry),
+                                   block_start_.data(), block_len_.data(), &HistogramBinEntry::SumReducer);
+  }
+  Network::SetPhase(kOtherPhase);
+
+  #pragma omp parallel for schedule(guided)
+  for (int i = 0; i < static_cast<int>(aggregated_features_.size()); ++i) {
+    const int feature_index = aggregated_features_[i];
+    // copy global sumup info
+    smaller_leaf_histogram_array_[feature_index].SetSumup(
+        GetGlobalDataCountInLeaf(smaller_leaf_splits_->LeafIndex()),
+                                smaller_leaf_splits_->sum_gradients(),
+                                smaller_leaf_splits_->sum_hessians(), is_constant_hessian_);
+
+    // restore global histograms from buffer
+    smaller_leaf_histogram_array_[feature_index].FromMemory(
+        input_buffer_.data() + buffer_write_start_pos_[feature_index]);
+
+    // find best threshold for smaller child
+    smaller_leaf_histogram_array_[feature_index].FindBestThreshold(
+        &smaller_leaf_splits_->BestSplitPerFeature()[feature_index]);
+
+    // only root leaf
+    if (larger_leaf_splits_ == nullptr || larger_leaf_splits_->LeafIndex() < 0) continue;
+
+    // construct histgroms for large leaf, we init larger leaf as the parent, so we can just subtract the smaller leaf's histograms
+    larger_leaf_histogram_array_[feature_index].Subtract(
+        smaller_leaf_histogram_array_[feature_index]);
+    // set sumup info for histogram
+    larger_leaf_histogram_array_[feature_index].SetSumup(
+        GetGlobalDataCountInLeaf(larger_leaf_splits_->LeafIndex()),
+                                 larger_leaf_splits_->sum_gradients(), larger_leaf_splits_->sum_hessians(), is_constant_hessian_);
+    // find best threshold for larger child
+    larger_leaf_histogram_array_[feature_index].FindBestThreshold(
+        &larger_leaf_splits_->BestSplitPerFeature()[feature_index]);
+  }
+}
+
+void HybridParallelTreeLearner::SyncUpQuantizationRange(double* max_gradient, double* max_hessian) {
+  double range[2] = { *max_gradient, *max_hessian };
+  Network::SetPhase(kGlobalSyncPhase);
+  GlobalMax(range, 2);
+  Network::SetPhase(kOtherPhase);
+  *max_gradient = range[0];
+  *max_hessian = range[1];
+}
+
+int64_t HybridParallelTreeLearner::NumDataOfHistograms() {
+  // machines in a row hold the same data, histograms are only summed up in the column
+  int64_t num_data = num_data_;
+  Network::AllreduceInColumn(reinterpret_cast<char*>(&num_data), sizeof(num_data), sizeof(num_data),
+    [](const char* src, char* dst, int) {
+    int64_t a, b;
+    std::memcpy(&a, src, sizeof(int64_t));
+    std::memcpy(&b, dst, sizeof(int64_t));
+    b += a;
+    std::memcpy(dst, &b, sizeof(int64_t));
+  });
+  return num_data;
+}
+
+void HybridParallelTreeLearner::FindBestSplitsForLeaves() {
+  int smaller_best_feature = -1, larger_best_feature = -1;
+  SplitInfo smaller_best, larger_best;
+  std::vector<double> gains;
+  // find local best split for smaller leaf
+  for (size_t i = 0; i < smaller_leaf_splits_->BestSplitPerFeature().size(); ++i) {
+    gains.push_back(smaller_leaf_splits_->BestSplitPerFeature()[i].gain);
+  }
+  smaller_best_feature = static_cast<int>(ArrayArgs<double>::ArgMax(gains));
+  smaller_best = smaller_leaf_splits_->BestSplitPerFeature()[smaller_best_feature];
+  // find local best split for larger leaf
+  if (larger_leaf_splits_->LeafIndex() >= 0) {
+    gains.clear();
+    for (size_t i = 0; i < larger_leaf_splits_->BestSplitPerFeature().size(); ++i) {
+      gains.push_back(larger_leaf_splits_->BestSplitPerFeature()[i].gain);
+    }
+    larger_best_feature = static_cast<int>(ArrayArgs<double>::ArgMax(gains));
+    larger_best = larger_leaf_splits_->BestSplitPerFeature()[larger_best_feature];
+  }
+
+  // sync global best info among all machines of the grid
+  std::memcpy(input_buffer_.data(), &smaller_best, sizeof(SplitInfo));
+  std::memcpy(input_buffer_.data() + sizeof(SplitInfo), &larger_best, sizeof(SplitInfo));
+
+  Network::SetPhase(kSplitPhase);
+  Network::Allreduce(input_buffer_.data(), sizeof(SplitInfo) * 2, sizeof(SplitInfo),
+                     output_buffer_.data(), &SplitInfo::MaxReducer);
+  Network::SetPhase(kOtherPhase);
+
+  std::memcpy(&smaller_best, output_buffer_.data(), sizeof(SplitInfo));
+  std::memcpy(&larger_best, output_buffer_.data() + sizeof(SplitInfo), sizeof(SplitInfo));
+
+  // set best split
+  best_split_per_leaf_[smaller_leaf_splits_->LeafIndex()] = smaller_best;
+  if (larger_leaf_splits_->LeafIndex() >= 0) {
+    best_split_per_leaf_[larger_leaf_splits_->LeafIndex()] = larger_best;
+  }
+}
+
+void HybridParallelTreeLearner::Split(Tree* tree, int best_Leaf, int* left_leaf, int* right_leaf) {
+  SerialTreeLearner::Split(tree, best_Leaf, left_leaf, right_leaf);
+  const SplitInfo& best_split_info = best_split_per_leaf_[best_Leaf];
+  // need update global number of data in leaf
+  global_data_count_in_leaf_[*left_leaf] = best_split_info.left_count;
+  global_data_count_in_leaf_[*right_leaf] = best_split_info.right_count;
+}
+
+}  // namespace LightGBM
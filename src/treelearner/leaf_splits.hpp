@@ -46,7 +46,7 @@ public:
   /*!
   * \brief Init splits on current leaf, it will traverse all data to sum up the results
   * \param gradients
-  * \param hessians
+  * \param hessians nullptr means all hessians are 1
   */
   void Init(const score_t* gradients, const score_t* hessians) {
     num_data_in_leaf_ = num_data_;
@@ -54,10 +54,18 @@ public:
     data_indices_ = nullptr;
     double tmp_sum_gradients = 0.0f;
     double tmp_sum_hessians = 0.0f;
+    if (hessians == nullptr) {
+#pragma omp parallel for schedule(static) reduction(+:tmp_sum_gradients)
+      for (data_size_t i = 0; i < num_data_in_leaf_; ++i) {
+        tmp_sum_gradients += gradients[i];
+      }
+      tmp_sum_hessians = static_cast<double>(num_data_in_leaf_);
+    } else {
 #pragma omp parallel for schedule(static) reduction(+:tmp_sum_gradients, tmp_sum_hessians)
-    for (data_size_t i = 0; i < num_data_in_leaf_; ++i) {
-      tmp_sum_gradients += gradients[i];
-      tmp_sum_hessians += hessians[i];
+      for (data_size_t i = 0; i < num_data_in_leaf_; ++i) {
+        tmp_sum_gradients += gradients[i];
+        tmp_sum_hessians += hessians[i];
+      }
     }
     sum_gradients_ = tmp_sum_gradients;
     sum_hessians_ = tmp_sum_hessians;
@@ -71,18 +79,26 @@ public:
   * \param leaf Index of current leaf
   * \param data_partition current data partition
   * \param gradients
-  * \param hessians
+  * \param hessians nullptr means all hessians are 1
   */
   void Init(int leaf, const DataPartition* data_partition, const score_t* gradients, const score_t* hessians) {
     leaf_index_ = leaf;
     data_indices_ = data_partition->GetIndexOnLeaf(leaf, &num_data_in_leaf_);
     double tmp_sum_gradients = 0.0f;
     double tmp_sum_hessians = 0.0f;
+    if (hessians == nullptr) {
+#pragma omp parallel for schedule(static) reduction(+:tmp_sum_gradients)
+      for (data_size_t i = 0; i < num_data_in_leaf_; ++i) {
+        tmp_sum_gradients += gradients[data_indices_[i]];
+      }
+      tmp_sum_hessians = static_cast<double>(num_data_in_leaf_);
+    } else {
 #pragma omp parallel for schedule(static) reduction(+:tmp_sum_gradients, tmp_sum_hessians)
-    for (data_size_t i = 0; i < num_data_in_leaf_; ++i) {
-      data_size_t idx = data_indices_[i];
-      tmp_sum_gradients += gradients[idx];
-      tmp_sum_hessians += hessians[idx];
+      for (data_size_t i = 0; i < num_data_in_leaf_; ++i) {
+        data_size_t idx = data_indices_[i];
+        tmp_sum_gradients += gradients[idx];
+        tmp_sum_hessians += hessians[idx];
+      }
     }
     sum_gradients_ = tmp_sum_gradients;
     sum_hessians_ = tmp_sum_hessians;
@@ -118,6 +134,7 @@ public:
 
   /*! \brief Get best splits on all features */
   std::vector<SplitInfo>& BestSplitPerFeature() { return best_split_per_feature_;}
+  const std::vector<SplitInfo>& BestSplitPerFeature() const { return best_split_per_feature_; }
 
   /*! \brief Get current leaf index */
   int LeafIndex() const { return leaf_index_; }
@@ -10,9 +10,48 @@
 
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 namespace LightGBM {
 
+/*!
+* \brief Max of the values over all machines, used to quantize gradients by the same scales
+* \param values Local values, replaced by the max values
+* \param num Number of values
+*/
+inline void GlobalMax(double* values, int num) {
+  std::vector<char> output(sizeof(double) * num);
+  Network::Allreduce(reinterpret_cast<char*>(values), static_cast<int>(sizeof(double)) * num, sizeof(double),
+    output.data(), [](const char* src, char* dst, int len) {
+    for (int i = 0; i < len; i += static_cast<int>(sizeof(double))) {
+      double a, b;
+      std::memcpy(&a, src + i, sizeof(double));
+      std::memcpy(&b, dst + i, sizeof(double));
+      b = std::max(a, b);
+      std::memcpy(dst + i, &b, sizeof(double));
+    }
+  });
+  std::memcpy(values, output.data(), sizeof(double) * num);
+}
+
+/*!
+* \brief Sum of the value over all machines
+*/
+inline int64_t GlobalSum(int64_t value) {
+  int64_t output = 0;
+  Network::Allreduce(reinterpret_cast<char*>(&value), sizeof(int64_t), sizeof(int64_t),
+    reinterpret_cast<char*>(&output), [](const char* src, char* dst, int len) {
+    for (int i = 0; i < len; i += static_cast<int>(sizeof(int64_t))) {
+      int64_t a, b;
+      std::memcpy(&a, src + i, sizeof(int64_t));
+      std::memcpy(&b, dst + i, sizeof(int64_t));
+      b += a;
+      std::memcpy(dst + i, &b, sizeof(int64_t));
+    }
+  });
+  return output;
+}
+
 /*!
 * \brief Feature parallel learning algorithm.
 *        Different machine will find best split on different features, then sync global best split
@@ -23,6 +62,7 @@ public:
   explicit FeatureParallelTreeLearner(const TreeConfig& tree_config);
   ~FeatureParallelTreeLearner();
   virtual void Init(const Dataset* train_data);
+  void AddMemoryUsage(MemoryUsage* memory_usage) const override;
 
 protected:
   void BeforeTrain() override;
@@ -48,11 +88,14 @@ public:
   explicit DataParallelTreeLearner(const TreeConfig& tree_config);
   ~DataParallelTreeLearner();
   void Init(const Dataset* train_data) override;
+  void AddMemoryUsage(MemoryUsage* memory_usage) const override;
 protected:
   void BeforeTrain() override;
   void FindBestThresholds() override;
   void FindBestSplitsForLeaves() override;
   void Split(Tree* tree, int best_Leaf, int* left_leaf, int* right_leaf) override;
+  void SyncUpQuantizationRange(double* max_gradient, double* max_hessian) override;
+  int64_t NumDataOfHistograms() override;
 
   inline data_size_t GetGlobalDataCountInLeaf(int leaf_idx) const override {
     if (leaf_idx >= 0) {
@@ -62,7 +105,21 @@ protected:
     }
   }
 
+  /*!
+  * \brief Reduce scatter the histograms of one pipeline block
+  * \param block Index of the pipeline block
+  */
+  void ReducePipelineBlock(int block);
+
+  /*!
+  * \brief Find best thresholds of the local aggregated features in one reduced pipeline block
+  * \param block Index of the pipeline block
+  */
+  void FindBestThresholdsOfPipelineBlock(int block);
+
 private:
+  /*! \brief Layout of the histograms in input_buffer_, only used if gradients are quantized */
+  HistogramBufferLayout histogram_layout_;
   /*! \brief Rank of local machine */
   int rank_;
   /*! \brief Number of machines of this parallel task */
@@ -74,20 +131,159 @@ private:
   /*! \brief different machines will aggregate histograms for different features,
        use this to mark local aggregate features*/
   std::vector<bool> is_feature_aggregated_;
-  /*! \brief Block start index for reduce scatter */
+  /*! \brief Number of pipeline blocks, the features of each machine are split into these blocks */
+  int num_pipeline_blocks_;
+  /*! \brief Block start index for reduce scatter, [i * num_machines_ + j] is of machine j in pipeline block i,
+       relative to the start of the pipeline block */
   std::vector<int> block_start_;
-  /*! \brief Block size for reduce scatter */
+  /*! \brief Block size for reduce scatter, indexed like block_start_ */
   std::vector<int> block_len_;
+  /*! \brief Start of each pipeline block in input_buffer_ */
+  std::vector<int> pipeline_block_start_;
+  /*! \brief Size of each pipeline block in input_buffer_ */
+  std::vector<int> pipeline_block_size_;
+  /*! \brief Start of the local reduced data of each pipeline block in output_buffer_ */
+  std::vector<int> pipeline_output_start_;
+  /*! \brief Used features of each pipeline block */
+  std::vector<std::vector<int>> pipeline_features_;
+  /*! \brief Local aggregated features of each pipeline block */
+  std::vector<std::vector<int>> pipeline_aggregated_features_;
   /*! \brief Write positions for feature histograms */
   std::vector<int> buffer_write_start_pos_;
   /*! \brief Read positions for local feature histograms */
   std::vector<int> buffer_read_start_pos_;
-  /*! \brief Size for reduce scatter */
-  int reduce_scatter_size_;
   /*! \brief Store global number of data in leaves  */
   std::vector<data_size_t> global_data_count_in_leaf_;
 };
 
+/*!
+* \brief Voting parallel learning algorithm.
+*        Workers find the local top_k features of each leaf on local data, then vote for global candidates,
+*        only histograms of the voted features are synced up, so communication does not grow with #feature.
+*        It is recommonded used when #data is large and #feature is large
+*/
+class VotingParallelTreeLearner: public SerialTreeLearner {
+public:
+  explicit VotingParallelTreeLearner(const TreeConfig& tree_config);
+  ~VotingParallelTreeLearner();
+  void Init(const Dataset* train_data) override;
+  void AddMemoryUsage(MemoryUsage* memory_usage) const override;
+protected:
+  void BeforeTrain() override;
+  void FindBestThresholds() override;
+  void FindBestSplitsForLeaves() override;
+  void Split(Tree* tree, int best_Leaf, int* left_leaf, int* right_leaf) override;
+
+  inline data_size_t GetGlobalDataCountInLeaf(int leaf_idx) const override {
+    if (leaf_idx >= 0) {
+      return global_data_count_in_leaf_[leaf_idx];
+    } else {
+      return 0;
+    }
+  }
+
+  /*!
+  * \brief Construct local histograms of all used features for smaller and larger leaves,
+  *        and find their local best splits. Unlike the serial learner, histograms of all used features are kept valid,
+  *        since any of them may be voted by other machines
+  */
+  void FindLocalBestThresholds();
+
+  /*!
+  * \brief Pick global candidate features of one leaf from local top features of all machines.
+  *        Features with more votes go first, ties are broken by the sum of local gains
+  * \param local_splits Local top splits of all machines for this leaf, feature < 0 means empty
+  * \param out Indices of candidate features, at most 2 * top_k_
+  */
+  void GlobalVoting(const std::vector<SplitInfo>& local_splits, std::vector<int>* out) const;
+
+  void SyncUpQuantizationRange(double* max_gradient, double* max_hessian) override;
+  int64_t NumDataOfHistograms() override;
+
+private:
+  /*! \brief Number of local top features each machine votes for */
+  int top_k_;
+  /*! \brief Rank of local machine */
+  int rank_;
+  /*! \brief Number of machines of this parallel task */
+  int num_machines_;
+  /*! \brief Buffer for network send */
+  std::vector<char> input_buffer_;
+  /*! \brief Buffer for network receive */
+  std::vector<char> output_buffer_;
+  /*! \brief Global sums and best splits of voted features for smaller leaf, smaller_leaf_splits_ keeps local sums */
+  std::unique_ptr<LeafSplits> smaller_leaf_splits_global_;
+  /*! \brief Global sums and best splits of voted features for larger leaf, larger_leaf_splits_ keeps local sums */
+  std::unique_ptr<LeafSplits> larger_leaf_splits_global_;
+  /*! \brief Global histograms of voted features for smaller leaf */
+  std::unique_ptr<FeatureHistogram[]> smaller_leaf_histogram_array_global_;
+  /*! \brief Global histograms of voted features for larger leaf */
+  std::unique_ptr<FeatureHistogram[]> larger_leaf_histogram_array_global_;
+  /*! \brief Store global number of data in leaves  */
+  std::vector<data_size_t> global_data_count_in_leaf_;
+};
+
+/*!
+* \brief Hybrid parallel learning algorithm.
+*        Machines are in a grid of Network::num_grid_columns() columns, machines in a row hold the same data partition,
+*        and features are split between columns. Histograms of the features of a column are only reduced among
+*        the machines in the column, then global best splits are synced up among all machines.
+*        It is recommonded used when #data is large and #feature is large
+*/
+class HybridParallelTreeLearner: public SerialTreeLearner {
+public:
+  explicit HybridParallelTreeLearner(const TreeConfig& tree_config);
+  ~HybridParallelTreeLearner();
+  void Init(const Dataset* train_data) override;
+  void AddMemoryUsage(MemoryUsage* memory_usage) const override;
+protected:
+  void BeforeTrain() override;
+  void FindBestThresholds() override;
+  void FindBestSplitsForLeaves() override;
+  void Split(Tree* tree, int best_Leaf, int* left_leaf, int* right_leaf) override;
+  void SyncUpQuantizationRange(double* max_gradient, double* max_hessian) override;
+  int64_t NumDataOfHistograms() override;
+
+  inline data_size_t GetGlobalDataCountInLeaf(int leaf_idx) const override {
+    if (leaf_idx >= 0) {
+      return global_data_count_in_leaf_[leaf_idx];
+    } else {
+      return 0;
+    }
+  }
+
+private:
+  /*! \brief Layout of the histograms in input_buffer_, only used if gradients are quantized */
+  HistogramBufferLayout histogram_layout_;
+  /*! \brief Rank of local machine */
+  int rank_;
+  /*! \brief Number of machines of this parallel task */
+  int num_machines_;
+  /*! \brief Number of columns of the machine grid */
+  int num_columns_;
+  /*! \brief Number of rows of the machine grid */
+  int num_rows_;
+  /*! \brief Column of local machine */
+  int column_;
+  /*! \brief Row of local machine */
+  int row_;
+  /*! \brief Buffer for network send, histograms are reduced in place */
+  std::vector<char> input_buffer_;
+  /*! \brief Buffer for network receive */
+  std::vector<char> output_buffer_;
+  /*! \brief Used features of local column, their histograms are constructed */
+  std::vector<int> column_features_;
+  /*! \brief Features of local column that are aggregated by local machine */
+  std::vector<int> aggregated_features_;
+  /*! \brief Block start index for reduce scatter, indexed by row */
+  std::vector<int> block_start_;
+  /*! \brief Block size for reduce scatter, indexed by row */
+  std::vector<int> block_len_;
+  /*! \brief Write positions for feature histograms */
+  std::vector<int> buffer_write_start_pos_;
+  /*! \brief Store global number of data in leaves  */
+  std::vector<data_size_t> global_data_count_in_leaf_;
+};
 
 }  // namespace LightGBM
 #endif   // LightGBM_TREELEARNER_PARALLEL_TREE_LEARNER_H_
@@ -2,6 +2,13 @@
 
 #include <LightGBM/utils/array_args.h>
 
+#include <LightGBM/utils/threading.h>
+#include <LightGBM/utils/profiler.h>
+#include <LightGBM/utils/numa.h>
+
+#include <omp.h>
+
+#include <cmath>
 #include <algorithm>
 #include <vector>
 
@@ -17,8 +24,32 @@ SerialTreeLearner::SerialTreeLearner(const TreeConfig& tree_config) {
   min_gain_to_split_ = tree_config.min_gain_to_split;
   feature_fraction_ = tree_config.feature_fraction;
   random_ = Random(tree_config.feature_fraction_seed);
+  quantize_random_ = Random(tree_config.quantization_seed);
   histogram_pool_size_ = tree_config.histogram_pool_size;
   max_depth_ = tree_config.max_depth;
+  feature_group_size_ = tree_config.feature_group_size;
+  leaf_batch_size_ = tree_config.leaf_batch_size;
+  use_quantized_grad_ = tree_config.use_quantized_grad;
+  num_grad_quant_bins_ = tree_config.num_grad_quant_bins;
+  stochastic_rounding_ = tree_config.stochastic_rounding;
+  // batched leaves construct histograms of real values
+  if (use_quantized_grad_ && leaf_batch_size_ > 1) {
+    Log::Warning("Gradients are quantized, leaf_batch_size is ignored");
+    leaf_batch_size_ = 1;
+  }
+  use_bf16_grad_ = tree_config.use_bf16_grad;
+  if (use_quantized_grad_ && use_bf16_grad_) {
+    Log::Warning("Gradients are quantized, use_bf16_grad is ignored");
+    use_bf16_grad_ = false;
+  }
+  use_lazy_histogram_ = tree_config.use_lazy_histogram;
+  lazy_histogram_slack_ = tree_config.lazy_histogram_slack;
+  if (use_lazy_histogram_ && leaf_batch_size_ > 1) {
+    Log::Warning("Leaves are split in batches, use_lazy_histogram is ignored");
+    use_lazy_histogram_ = false;
+  }
+  memory_budget_in_bytes_ = -1.0f;
+  is_constant_hessian_ = false;
 }
 
 SerialTreeLearner::~SerialTreeLearner() {
@@ -29,82 +60,257 @@ void SerialTreeLearner::Init(const Dataset* train_data) {
   train_data_ = train_data;
   num_data_ = train_data_->num_data();
   num_features_ = train_data_->num_features();
-  int max_cache_size = 0;
-  // Get the max size of pool
-  if (histogram_pool_size_ < 0) {
-    max_cache_size = num_leaves_;
-  } else {
-    size_t total_histogram_size = 0;
-    for (int i = 0; i < train_data_->num_features(); ++i) {
-      total_histogram_size += sizeof(HistogramBinEntry) * train_data_->FeatureAt(i)->num_bin();
-    }
-    max_cache_size = static_cast<int>(histogram_pool_size_ * 1024 * 1024 / total_histogram_size);
+  num_threads_ = Threading::NumThreads();
+  // follow the NUMA nodes the bin data of features is placed on when the data was loaded
+  numa_feature_begin_ = train_data_->numa_feature_begin();
+  if (!numa_feature_begin_.empty() && !Numa::PinThreads(static_cast<int>(numa_feature_begin_.size()) - 1)) {
+    Log::Warning("Cannot pin threads to NUMA nodes, use_numa is ignored");
+    numa_feature_begin_.clear();
   }
-  // at least need 2 leaves
-  max_cache_size = std::max(2, max_cache_size);
-  max_cache_size = std::min(max_cache_size, num_leaves_);
-  histogram_pool_.ResetSize(max_cache_size, num_leaves_);
-
-  auto histogram_create_function = [this]() {
-    auto tmp_histogram_array = std::unique_ptr<FeatureHistogram[]>(new FeatureHistogram[train_data_->num_features()]);
-    for (int j = 0; j < train_data_->num_features(); ++j) {
-      tmp_histogram_array[j].Init(train_data_->FeatureAt(j),
-        j, min_num_data_one_leaf_,
-        min_sum_hessian_one_leaf_,
-        lambda_l1_,
-        lambda_l2_,
-        min_gain_to_split_);
-    }
-    return tmp_histogram_array.release();
-  };
-  histogram_pool_.Fill(histogram_create_function);
 
+  // buffers of the learner are cut from one arena
+  arena_.Clear();
   // push split information for all leaves
   best_split_per_leaf_.resize(num_leaves_);
+  // states of lazy histograms of all leaves
+  if (use_lazy_histogram_) {
+    gain_densities_.assign(static_cast<size_t>(num_leaves_) * num_features_, 0.0f);
+    is_histogram_constructed_.assign(static_cast<size_t>(num_leaves_) * num_features_, 0);
+  }
+  // histograms of bundled sparse features are constructed by the bundles of the data
+  is_feature_grouped_ = std::vector<bool>(num_features_, false);
+  feature_bundle_index_.assign(num_features_, -1);
+  for (int bundle = 0; bundle < train_data_->num_feature_bundles(); ++bundle) {
+    for (int fidx : train_data_->FeatureBundleAt(bundle)->feature_indices()) {
+      is_feature_grouped_[fidx] = true;
+      feature_bundle_index_[fidx] = bundle;
+    }
+  }
   // initialize ordered_bins_ with nullptr
   ordered_bins_.resize(num_features_);
 
-  // get ordered bin
-  #pragma omp parallel for schedule(guided)
-  for (int i = 0; i < num_features_; ++i) {
-    ordered_bins_[i].reset(train_data_->FeatureAt(i)->bin_data()->CreateOrderedBin());
-  }
+  // get ordered bin, bundled features don't need it
+  ParallelForFeatures([this](int i) {
+    ordered_bins_[i].reset(is_feature_grouped_[i] ? nullptr : train_data_->FeatureAt(i)->bin_data()->CreateOrderedBin());
+  });
 
   // check existing for ordered bin
+  has_ordered_bin_ = false;
   for (int i = 0; i < num_features_; ++i) {
     if (ordered_bins_[i] != nullptr) {
       has_ordered_bin_ = true;
       break;
     }
   }
+  // put dense features into row-major feature groups
+  feature_groups_.clear();
+  if (feature_group_size_ > 1) {
+    std::vector<int> group_features;
+    size_t group_size_in_byte = 0;
+    for (int i = 0; i <= num_features_; ++i) {
+      if (i < num_features_) {
+        if (ordered_bins_[i] != nullptr || is_feature_grouped_[i]
+          || train_data_->FeatureAt(i)->num_bin() > FeatureGroup::kMaxNumBin) {
+          continue;
+        }
+        group_features.push_back(i);
+      }
+      if (group_features.size() >= static_cast<size_t>(feature_group_size_)
+        || (i == num_features_ && group_features.size() > 1)) {
+        feature_groups_.emplace_back(new FeatureGroup(train_data_, group_features));
+        group_size_in_byte += feature_groups_.back()->SizesInByte();
+        for (int fidx : group_features) {
+          is_feature_grouped_[fidx] = true;
+        }
+        group_features.clear();
+      }
+    }
+    Log::Info("Using %d feature groups, extra memory cost: %f MB",
+      static_cast<int>(feature_groups_.size()), group_size_in_byte / 1024.0 / 1024.0);
+  }
+  InitOrderedBinBatches();
+  // packed sums of quantized hessians have 32 bits, they should hold the sum of all data
+  if (use_quantized_grad_ && NumDataOfHistograms() * num_grad_quant_bins_ > static_cast<int64_t>(0xffffffff)) {
+    Log::Warning("Too many data for the sums of quantized gradients, use_quantized_grad is ignored");
+    use_quantized_grad_ = false;
+  }
+  // histograms of dense features not grouped are integers if gradients are quantized
+  is_histogram_int_.assign(num_features_, false);
+  if (use_quantized_grad_) {
+    for (int i = 0; i < num_features_; ++i) {
+      is_histogram_int_[i] = ordered_bins_[i] == nullptr && !is_feature_grouped_[i];
+    }
+  }
+  is_bag_changed_ = true;
+  is_bag_cached_ = false;
   // initialize splits for leaf
   smaller_leaf_splits_.reset(new LeafSplits(train_data_->num_features(), train_data_->num_data()));
   larger_leaf_splits_.reset(new LeafSplits(train_data_->num_features(), train_data_->num_data()));
 
   // initialize data partition
-  data_partition_.reset(new DataPartition(num_data_, num_leaves_));
+  data_partition_.reset(new DataPartition(num_data_, num_leaves_, &arena_));
 
   is_feature_used_.resize(num_features_);
 
   // initialize ordered gradients and hessians
-  ordered_gradients_.resize(num_data_);
-  ordered_hessians_.resize(num_data_);
+  ordered_gradients_ = arena_.Alloc<score_t>(num_data_);
+  ordered_hessians_ = arena_.Alloc<score_t>(num_data_);
   // if has ordered bin, need to allocate a buffer to fast split
   if (has_ordered_bin_) {
-    is_data_in_leaf_.resize(num_data_);
+    is_data_in_leaf_.assign(num_data_, 0);
+  }
+  if (use_quantized_grad_) {
+    quantized_grad_hess_.resize(static_cast<size_t>(num_data_) * 2);
+    ordered_quantized_grad_hess_.resize(static_cast<size_t>(num_data_) * 2);
+    dequantized_gradients_.resize(num_data_);
+    dequantized_hessians_.resize(num_data_);
+  }
+  if (use_bf16_grad_) {
+    bf16_grad_hess_.resize(num_data_);
+    ordered_bf16_grad_hess_.resize(num_data_);
+    dequantized_gradients_.resize(num_data_);
+    dequantized_hessians_.resize(num_data_);
   }
+  ResetThreadBuffers();
+  // Get the max size of pool, histograms of bundled features are ranges of the histograms of their bundles
+  size_t total_histogram_size = 0;
+  // histograms of a leaf are contiguous in one slab
+  size_t histogram_array_size = 0;
+  for (int i = 0; i < num_features_; ++i) {
+    if (feature_bundle_index_[i] >= 0) { continue; }
+    total_histogram_size += HistogramSizeInByte(i);
+    histogram_array_size += Common::AlignUp(HistogramSizeInByte(i), Arena::kAlignment);
+  }
+  for (int bundle = 0; bundle < train_data_->num_feature_bundles(); ++bundle) {
+    const size_t bundle_histogram_size = sizeof(HistogramBinEntry) * train_data_->FeatureBundleAt(bundle)->num_bin();
+    total_histogram_size += bundle_histogram_size;
+    histogram_array_size += Common::AlignUp(bundle_histogram_size, Arena::kAlignment);
+  }
+  // histograms are cached within the memory budget left by the other buffers
+  double cache_size_in_bytes = histogram_pool_size_ * 1024 * 1024;
+  if (memory_budget_in_bytes_ >= 0.0f) {
+    MemoryUsage memory_usage;
+    AddMemoryUsage(&memory_usage);
+    const double left_size = std::max(0.0, memory_budget_in_bytes_ - static_cast<double>(memory_usage.Total()));
+    if (cache_size_in_bytes < 0.0f || left_size < cache_size_in_bytes) {
+      cache_size_in_bytes = left_size;
+      Log::Info("Cache size of histograms is limited to %f MB by max_memory", left_size / 1024.0 / 1024.0);
+    }
+  }
+  histogram_pool_.ResetSize(cache_size_in_bytes, total_histogram_size, num_leaves_);
+
+  auto histogram_create_function = [this, histogram_array_size]() {
+    auto tmp_histogram_array = std::unique_ptr<FeatureHistogram[]>(new FeatureHistogram[train_data_->num_features()]);
+    std::vector<void*> histogram_data(num_features_);
+    arena_.Reserve(histogram_array_size);
+    for (int bundle = 0; bundle < train_data_->num_feature_bundles(); ++bundle) {
+      const FeatureBundle* feature_bundle = train_data_->FeatureBundleAt(bundle);
+      HistogramBinEntry* bundle_data = arena_.Alloc<HistogramBinEntry>(feature_bundle->num_bin());
+      for (int k = 0; k < feature_bundle->num_features(); ++k) {
+        histogram_data[feature_bundle->feature_indices()[k]] = bundle_data + feature_bundle->bin_offset(k);
+      }
+    }
+    for (int j = 0; j < num_features_; ++j) {
+      if (feature_bundle_index_[j] >= 0) {
+        continue;
+      } else if (is_histogram_int_[j]) {
+        histogram_data[j] = arena_.Alloc<IntHistogramBinEntry>(train_data_->FeatureAt(j)->num_bin());
+      } else {
+        histogram_data[j] = arena_.Alloc<HistogramBinEntry>(train_data_->FeatureAt(j)->num_bin());
+      }
+    }
+    // histograms are initialized by the threads that construct them
+    ParallelForFeatures([this, &tmp_histogram_array, &histogram_data](int j) {
+      tmp_histogram_array[j].Init(train_data_->FeatureAt(j),
+        j, min_num_data_one_leaf_,
+        min_sum_hessian_one_leaf_,
+        lambda_l1_,
+        lambda_l2_,
+        min_gain_to_split_,
+        histogram_data[j],
+        is_histogram_int_[j]);
+    });
+    return tmp_histogram_array.release();
+  };
+  histogram_pool_.Fill(histogram_create_function);
   Log::Info("Number of data: %d, number of features: %d", num_data_, num_features_);
 }
 
+void SerialTreeLearner::AddMemoryUsage(MemoryUsage* memory_usage) const {
+  const size_t histograms_size = histogram_pool_.SizesInByte();
+  size_t gradients_size = 2 * sizeof(score_t) * (data_partition_ != nullptr ? num_data_ : 0)
+    + sizeof(int8_t) * (quantized_grad_hess_.capacity() + ordered_quantized_grad_hess_.capacity())
+    + sizeof(uint32_t) * (bf16_grad_hess_.capacity() + ordered_bf16_grad_hess_.capacity())
+    + sizeof(score_t) * (dequantized_gradients_.capacity() + dequantized_hessians_.capacity());
+  // the arena holds histograms, ordered gradients and hessians and the data partition
+  size_t learner_size = arena_.UsedSizesInByte();
+  learner_size -= std::min(learner_size, histograms_size + 2 * sizeof(score_t) * (data_partition_ != nullptr ? num_data_ : 0));
+  for (const auto& ordered_bin : ordered_bins_) {
+    if (ordered_bin != nullptr) {
+      learner_size += ordered_bin->SizesInByte();
+    }
+  }
+  for (const auto& feature_group : feature_groups_) {
+    learner_size += feature_group->SizesInByte();
+  }
+  learner_size += sizeof(char) * is_data_in_leaf_.capacity();
+  for (const auto& buf : row_parallel_hist_buf_) {
+    learner_size += sizeof(HistogramBinEntry) * buf.capacity();
+  }
+  memory_usage->Add(kHistogramsMemory, histograms_size);
+  memory_usage->Add(kGradientsMemory, gradients_size);
+  memory_usage->Add(kTreeLearnerMemory, learner_size);
+}
+
+void SerialTreeLearner::ResetThreadBuffers() {
+  // allocate thread local histograms if too few features to keep all threads busy
+  row_parallel_hist_offset_.clear();
+  row_parallel_hist_buf_.clear();
+  // histograms of dense features are integers if gradients are quantized, which are not row-parallel
+  if (num_threads_ > 1 && num_features_ < num_threads_ * kMinFeaturesPerThread && !use_quantized_grad_) {
+    size_t total_num_bin = 0;
+    row_parallel_hist_offset_.resize(num_features_);
+    for (int i = 0; i < num_features_; ++i) {
+      row_parallel_hist_offset_[i] = total_num_bin;
+      total_num_bin += train_data_->FeatureAt(i)->num_bin();
+    }
+    // each buffer is allocated by its thread, so it is on the NUMA node of the thread
+    row_parallel_hist_buf_.resize(num_threads_);
+    #pragma omp parallel for schedule(static, 1)
+    for (int tid = 0; tid < num_threads_; ++tid) {
+      row_parallel_hist_buf_[tid].resize(total_num_bin);
+    }
+  }
+}
+
 
 Tree* SerialTreeLearner::Train(const score_t* gradients, const score_t *hessians) {
   gradients_ = gradients;
   hessians_ = hessians;
+  // the number of threads may be changed between trees, e.g. by the thread pool of a booster
+  if (Threading::NumThreads() != num_threads_) {
+    num_threads_ = Threading::NumThreads();
+    ResetThreadBuffers();
+    InitOrderedBinBatches();
+  }
+  if (use_quantized_grad_) {
+    QuantizeGradients();
+  } else if (use_bf16_grad_) {
+    ConvertGradientsToBF16();
+  }
   // some initial works before training
-  BeforeTrain();
+  {
+    ProfileScope profile_scope(kBeforeTrainProfile);
+    BeforeTrain();
+  }
   auto tree = std::unique_ptr<Tree>(new Tree(num_leaves_));
   // save pointer to last trained tree
   last_trained_tree_ = tree.get();
+  // batched growing needs the histograms of all leaves in the pool
+  if (leaf_batch_size_ > 1 && histogram_pool_.is_enough()) {
+    TrainLeafBatches(tree.get());
+    return tree.release();
+  }
   // root leaf
   int left_leaf = 0;
   // only root leaf can be splitted on first time
@@ -113,10 +319,18 @@ Tree* SerialTreeLearner::Train(const score_t* gradients, const score_t *hessians
     // some initial works before finding best split
     if (BeforeFindBestSplit(left_leaf, right_leaf)) {
       // find best threshold for every feature
-      FindBestThresholds();
+      {
+        ProfileScope profile_scope(kFindBestThresholdsProfile);
+        FindBestThresholds();
+      }
       // find best split from all features
       FindBestSplitsForLeaves();
     }
+    // leaves without positive gain will never be split, their histograms are not needed anymore
+    if (!histogram_pool_.is_enough()) {
+      if (best_split_per_leaf_[left_leaf].gain <= 0.0) { histogram_pool_.Release(left_leaf); }
+      if (right_leaf >= 0 && best_split_per_leaf_[right_leaf].gain <= 0.0) { histogram_pool_.Release(right_leaf); }
+    }
     // Get a leaf with max split gain
     int best_leaf = static_cast<int>(ArrayArgs<SplitInfo>::ArgMax(best_split_per_leaf_));
     // Get split information for best leaf
@@ -128,11 +342,197 @@ Tree* SerialTreeLearner::Train(const score_t* gradients, const score_t *hessians
       break;
     }
     // split tree with best leaf
+    ProfileScope profile_scope(kSplitProfile);
     Split(tree.get(), best_leaf, &left_leaf, &right_leaf);
   }
+  histogram_pool_.LogStatistics();
+  if (use_lazy_histogram_ && num_lazy_candidates_ > 0) {
+    Log::Debug("Lazy histograms: constructed %lld of %lld candidate histograms",
+      static_cast<long long>(num_lazy_constructed_), static_cast<long long>(num_lazy_candidates_));
+  }
+  num_lazy_candidates_ = 0;
+  num_lazy_constructed_ = 0;
   return tree.release();
 }
 
+void SerialTreeLearner::TrainLeafBatches(Tree* tree) {
+  std::vector<SplitInfo> split_infos;
+  std::vector<int> left_leaves;
+  std::vector<int> right_leaves;
+  std::vector<int> candidates;
+  // root leaf
+  if (BeforeFindBestSplit(0, -1)) {
+    {
+      ProfileScope profile_scope(kFindBestThresholdsProfile);
+      FindBestThresholds();
+    }
+    FindBestSplitsForLeaves();
+  }
+  int num_splits = 0;
+  while (num_splits < num_leaves_ - 1) {
+    // get leaves with max split gains
+    candidates.clear();
+    for (int i = 0; i < tree->num_leaves(); ++i) {
+      if (best_split_per_leaf_[i].gain > 0.0) { candidates.push_back(i); }
+    }
+    if (candidates.empty()) {
+      Log::Info("No further splits with positive gain, leaves: %d", tree->num_leaves());
+      break;
+    }
+    const int batch_size = std::min(std::min(leaf_batch_size_, num_leaves_ - 1 - num_splits),
+      static_cast<int>(candidates.size()));
+    std::partial_sort(candidates.begin(), candidates.begin() + batch_size, candidates.end(),
+      [this](int a, int b) { return best_split_per_leaf_[a] > best_split_per_leaf_[b]; });
+    split_infos.resize(batch_size);
+    left_leaves.resize(batch_size);
+    right_leaves.resize(batch_size);
+    for (int i = 0; i < batch_size; ++i) {
+      // copy, split information of the left child will be written to the same leaf
+      split_infos[i] = best_split_per_leaf_[candidates[i]];
+      ProfileScope profile_scope(kSplitProfile);
+      Split(tree, candidates[i], &left_leaves[i], &right_leaves[i]);
+    }
+    num_splits += batch_size;
+    const bool is_batch_constructed = ConstructLeafBatchHistograms(split_infos, left_leaves, right_leaves);
+    for (int i = 0; i < batch_size; ++i) {
+      InitLeafSplits(split_infos[i], left_leaves[i], right_leaves[i]);
+      if (BeforeFindBestSplit(left_leaves[i], right_leaves[i])) {
+        is_smaller_batch_constructed_ = is_batch_constructed;
+        {
+          ProfileScope profile_scope(kFindBestThresholdsProfile);
+          FindBestThresholds();
+        }
+        FindBestSplitsForLeaves();
+        is_smaller_batch_constructed_ = false;
+      }
+    }
+  }
+}
+
+bool SerialTreeLearner::ConstructLeafBatchHistograms(const std::vector<SplitInfo>& split_infos,
+  const std::vector<int>& left_leaves, const std::vector<int>& right_leaves) {
+  // one pass over all data is only worth when the smaller children cover enough data
+  const data_size_t kMinDataRatio = 2;
+  const int batch_size = static_cast<int>(split_infos.size());
+  data_size_t total_cnt = 0;
+  for (int i = 0; i < batch_size; ++i) {
+    total_cnt += std::min(split_infos[i].left_count, split_infos[i].right_count);
+  }
+  if (batch_size <= 1 || total_cnt * kMinDataRatio < num_data_) {
+    return false;
+  }
+  ProfileScope profile_scope(kConstructHistogramsProfile);
+  if (batch_data_slot_.empty()) {
+    batch_data_slot_.resize(num_data_);
+  }
+  std::fill(batch_data_slot_.begin(), batch_data_slot_.end(), static_cast<int8_t>(-1));
+  std::vector<FeatureHistogram*> smaller_histogram_arrays(batch_size);
+  std::vector<FeatureHistogram*> parent_histogram_arrays(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    const SplitInfo& split_info = split_infos[i];
+    const int smaller_leaf = split_info.left_count < split_info.right_count ? left_leaves[i] : right_leaves[i];
+    data_size_t cnt = 0;
+    const data_size_t* indices = data_partition_->GetIndexOnLeaf(smaller_leaf, &cnt);
+    #pragma omp parallel for schedule(static)
+    for (data_size_t j = 0; j < cnt; ++j) {
+      batch_data_slot_[indices[j]] = static_cast<int8_t>(i);
+    }
+    // before BeforeFindBestSplit, left child holds the parent, and right child is free
+    histogram_pool_.Get(left_leaves[i], split_info.left_count + split_info.right_count, &parent_histogram_arrays[i]);
+    histogram_pool_.Get(right_leaves[i], cnt, &smaller_histogram_arrays[i]);
+  }
+  #pragma omp parallel for schedule(guided)
+  for (int feature_index = 0; feature_index < num_features_; ++feature_index) {
+    if ((is_feature_used_.size() > 0 && is_feature_used_[feature_index] == false)
+      || is_feature_grouped_[feature_index] || ordered_bins_[feature_index] != nullptr) {
+      continue;
+    }
+    std::vector<HistogramBinEntry*> out(batch_size, nullptr);
+    bool is_any_splittable = false;
+    for (int i = 0; i < batch_size; ++i) {
+      const SplitInfo& split_info = split_infos[i];
+      if (split_info.left_count < split_info.right_count) {
+        out[i] = smaller_histogram_arrays[i][feature_index].ResetForConstruct(split_info.left_count,
+          split_info.left_sum_gradient, split_info.left_sum_hessian, is_constant_hessian_);
+      } else {
+        out[i] = smaller_histogram_arrays[i][feature_index].ResetForConstruct(split_info.right_count,
+          split_info.right_sum_gradient, split_info.right_sum_hessian, is_constant_hessian_);
+      }
+      is_any_splittable |= parent_histogram_arrays[i][feature_index].is_splittable();
+    }
+    if (!is_any_splittable) { continue; }
+    train_data_->FeatureAt(feature_index)->bin_data()->ConstructHistogramForLeaves(batch_data_slot_.data(),
+      num_data_, gradients_, HistogramHessians(), out.data());
+  }
+  return true;
+}
+
+void SerialTreeLearner::QuantizeGradients() {
+  // get max absolute value of gradients and hessians
+  std::vector<double> max_gradients(num_threads_, 0.0f);
+  std::vector<double> max_hessians(num_threads_, 0.0f);
+  Threading::For<data_size_t>(0, num_data_, [this, &max_gradients, &max_hessians]
+  (int tid, data_size_t start, data_size_t end) {
+    for (data_size_t i = start; i < end; ++i) {
+      max_gradients[tid] = std::max(max_gradients[tid], static_cast<double>(std::fabs(gradients_[i])));
+      max_hessians[tid] = std::max(max_hessians[tid], static_cast<double>(std::fabs(hessians_[i])));
+    }
+  });
+  double max_gradient = *std::max_element(max_gradients.begin(), max_gradients.end());
+  double max_hessian = *std::max_element(max_hessians.begin(), max_hessians.end());
+  SyncUpQuantizationRange(&max_gradient, &max_hessian);
+  // gradients use [-num_grad_quant_bins / 2, num_grad_quant_bins / 2], hessians use [0, num_grad_quant_bins]
+  const int max_quantized_gradient = num_grad_quant_bins_ / 2;
+  const int max_quantized_hessian = num_grad_quant_bins_;
+  grad_scale_ = max_gradient > 0.0f ? max_gradient / max_quantized_gradient : 1.0f;
+  hess_scale_ = max_hessian > 0.0f ? max_hessian / max_quantized_hessian : 1.0f;
+  const double inverse_grad_scale = 1.0f / grad_scale_;
+  const double inverse_hess_scale = 1.0f / hess_scale_;
+  // blocks of fixed size have their own generators, so the rounding only depends on the seed, not the number of threads
+  const int seed = static_cast<int>(quantize_random_.NextInt(0, 1 << 30));
+  const int num_blocks = static_cast<int>((num_data_ + kQuantizeBlockSize - 1) / kQuantizeBlockSize);
+  const double kInverseUInt16Range = 1.0f / 65536.0f;
+  Threading::ParallelFor(0, num_blocks, [this, seed, kInverseUInt16Range, max_quantized_gradient, max_quantized_hessian,
+    inverse_grad_scale, inverse_hess_scale]
+  (int block) {
+    Random rand(seed + block);
+    const data_size_t start = block * kQuantizeBlockSize;
+    const data_size_t end = std::min(start + kQuantizeBlockSize, num_data_);
+    for (data_size_t i = start; i < end; ++i) {
+      double gradient_offset = 0.5f;
+      double hessian_offset = 0.5f;
+      if (stochastic_rounding_) {
+        // split one random number into two offsets in [0, 1), 16 bits are enough for the rounding
+        const uint32_t bits = rand.NextUInt32();
+        gradient_offset = (bits & 0xffff) * kInverseUInt16Range;
+        hessian_offset = (bits >> 16) * kInverseUInt16Range;
+      }
+      int gradient = static_cast<int>(std::floor(gradients_[i] * inverse_grad_scale + gradient_offset));
+      int hessian = static_cast<int>(std::floor(hessians_[i] * inverse_hess_scale + hessian_offset));
+      gradient = std::max(-max_quantized_gradient, std::min(max_quantized_gradient, gradient));
+      hessian = std::max(0, std::min(max_quantized_hessian, hessian));
+      quantized_grad_hess_[2 * i] = static_cast<int8_t>(gradient);
+      quantized_grad_hess_[2 * i + 1] = static_cast<int8_t>(hessian);
+      dequantized_gradients_[i] = static_cast<score_t>(gradient * grad_scale_);
+      dequantized_hessians_[i] = static_cast<score_t>(hessian * hess_scale_);
+    }
+  });
+  gradients_ = dequantized_gradients_.data();
+  hessians_ = dequantized_hessians_.data();
+}
+
+void SerialTreeLearner::ConvertGradientsToBF16() {
+  #pragma omp parallel for schedule(static)
+  for (data_size_t i = 0; i < num_data_; ++i) {
+    const uint32_t packed = BF16GradHess::Pack(gradients_[i], hessians_[i]);
+    bf16_grad_hess_[i] = packed;
+    dequantized_gradients_[i] = BF16GradHess::Gradient(packed);
+    dequantized_hessians_[i] = BF16GradHess::Hessian(packed);
+  }
+  gradients_ = dequantized_gradients_.data();
+  hessians_ = dequantized_hessians_.data();
+}
+
 void SerialTreeLearner::BeforeTrain() {
   // reset histogram pool
   histogram_pool_.ResetMap();
@@ -158,24 +558,29 @@ void SerialTreeLearner::BeforeTrain() {
   // Sumup for root
   if (data_partition_->leaf_count(0) == num_data_) {
     // use all data
-    smaller_leaf_splits_->Init(gradients_, hessians_);
+    smaller_leaf_splits_->Init(gradients_, HistogramHessians());
     // point to gradients, avoid copy
     ptr_to_ordered_gradients_smaller_leaf_ = gradients_;
-    ptr_to_ordered_hessians_smaller_leaf_  = hessians_;
+    ptr_to_ordered_hessians_smaller_leaf_  = HistogramHessians();
+    ptr_to_ordered_grad_hess_smaller_leaf_ = quantized_grad_hess_.data();
+    ptr_to_ordered_bf16_grad_hess_smaller_leaf_ = bf16_grad_hess_.data();
   } else {
     // use bagging, only use part of data
-    smaller_leaf_splits_->Init(0, data_partition_.get(), gradients_, hessians_);
+    smaller_leaf_splits_->Init(0, data_partition_.get(), gradients_, HistogramHessians());
     // copy used gradients and hessians to ordered buffer
     const data_size_t* indices = data_partition_->indices();
     data_size_t cnt = data_partition_->leaf_count(0);
-    #pragma omp parallel for schedule(static)
-    for (data_size_t i = 0; i < cnt; ++i) {
-      ordered_gradients_[i] = gradients_[indices[i]];
-      ordered_hessians_[i] = hessians_[indices[i]];
-    }
+    CopyOrderedGradients(indices, cnt, 0);
     // point to ordered_gradients_ and ordered_hessians_
-    ptr_to_ordered_gradients_smaller_leaf_ = ordered_gradients_.data();
-    ptr_to_ordered_hessians_smaller_leaf_ = ordered_hessians_.data();
+    ptr_to_ordered_gradients_smaller_leaf_ = ordered_gradients_;
+    ptr_to_ordered_hessians_smaller_leaf_ = is_constant_hessian_ ? nullptr : ordered_hessians_;
+    if (use_quantized_grad_) {
+      CopyOrderedQuantizedGradients(indices, cnt, ordered_quantized_grad_hess_.data());
+      ptr_to_ordered_grad_hess_smaller_leaf_ = ordered_quantized_grad_hess_.data();
+    } else if (use_bf16_grad_) {
+      CopyOrderedBF16Gradients(indices, cnt, ordered_bf16_grad_hess_.data());
+      ptr_to_ordered_bf16_grad_hess_smaller_leaf_ = ordered_bf16_grad_hess_.data();
+    }
   }
 
   ptr_to_ordered_gradients_larger_leaf_ = nullptr;
@@ -187,33 +592,31 @@ void SerialTreeLearner::BeforeTrain() {
   if (has_ordered_bin_) {
     if (data_partition_->leaf_count(0) == num_data_) {
       // use all data, pass nullptr
-      #pragma omp parallel for schedule(guided)
-      for (int i = 0; i < num_features_; ++i) {
-        if (ordered_bins_[i] != nullptr) {
-          ordered_bins_[i]->Init(nullptr, num_leaves_);
-        }
-      }
+      ParallelForOrderedBins([this](int i) {
+        ordered_bins_[i]->Init(nullptr, num_leaves_);
+      });
+      is_bag_cached_ = false;
+    } else if (!is_bag_changed_ && is_bag_cached_) {
+      // bagging with the same used data as the last tree, copy the cached data
+      ParallelForOrderedBins([this](int i) {
+        ordered_bins_[i]->InitFromCache(num_leaves_);
+      });
     } else {
       // bagging, only use part of data
-
-      // mark used data
-      std::memset(is_data_in_leaf_.data(), 0, sizeof(char)*num_data_);
-      const data_size_t* indices = data_partition_->indices();
-      data_size_t begin = data_partition_->leaf_begin(0);
-      data_size_t end = begin + data_partition_->leaf_count(0);
-      #pragma omp parallel for schedule(static)
-      for (data_size_t i = begin; i < end; ++i) {
-        is_data_in_leaf_[indices[i]] = 1;
-      }
-      // initialize ordered bin
-      #pragma omp parallel for schedule(guided)
-      for (int i = 0; i < num_features_; ++i) {
-        if (ordered_bins_[i] != nullptr) {
-          ordered_bins_[i]->Init(is_data_in_leaf_.data(), num_leaves_);
+      MarkDataInLeaf(0, 1);
+      // initialize ordered bin, the used data are cached when they are used by a second tree
+      const bool is_cache = !is_bag_changed_;
+      ParallelForOrderedBins([this, is_cache](int i) {
+        ordered_bins_[i]->Init(is_data_in_leaf_.data(), num_leaves_);
+        if (is_cache) {
+          ordered_bins_[i]->CacheUsedData();
         }
-      }
+      });
+      is_bag_cached_ = is_cache;
+      MarkDataInLeaf(0, 0);
     }
   }
+  is_bag_changed_ = false;
 }
 
 bool SerialTreeLearner::BeforeFindBestSplit(int left_leaf, int right_leaf) {
@@ -244,23 +647,24 @@ bool SerialTreeLearner::BeforeFindBestSplit(int left_leaf, int right_leaf) {
   int smaller_leaf = -1;
   int larger_leaf = -1;
   // only have root
+  const data_size_t num_data_in_parent = num_data_in_left_child + num_data_in_right_child;
   if (right_leaf < 0) {
-    histogram_pool_.Get(left_leaf, &smaller_leaf_histogram_array_);
+    histogram_pool_.Get(left_leaf, num_data_in_left_child, &smaller_leaf_histogram_array_);
     larger_leaf_histogram_array_ = nullptr;
 
   } else if (num_data_in_left_child < num_data_in_right_child) {
     smaller_leaf = left_leaf;
     larger_leaf = right_leaf;
     // put parent(left) leaf's histograms into larger leaf's histograms
-    if (histogram_pool_.Get(left_leaf, &larger_leaf_histogram_array_)) { parent_leaf_histogram_array_ = larger_leaf_histogram_array_; }
-    histogram_pool_.Move(left_leaf, right_leaf);
-    histogram_pool_.Get(left_leaf, &smaller_leaf_histogram_array_);
+    if (histogram_pool_.Get(left_leaf, num_data_in_parent, &larger_leaf_histogram_array_)) { parent_leaf_histogram_array_ = larger_leaf_histogram_array_; }
+    histogram_pool_.Move(left_leaf, right_leaf, num_data_in_right_child);
+    histogram_pool_.Get(left_leaf, num_data_in_left_child, &smaller_leaf_histogram_array_);
   } else {
     smaller_leaf = right_leaf;
     larger_leaf = left_leaf;
     // put parent(left) leaf's histograms to larger leaf's histograms
-    if (histogram_pool_.Get(left_leaf, &larger_leaf_histogram_array_)) { parent_leaf_histogram_array_ = larger_leaf_histogram_array_; }
-    histogram_pool_.Get(right_leaf, &smaller_leaf_histogram_array_);
+    if (histogram_pool_.Get(left_leaf, num_data_in_parent, &larger_leaf_histogram_array_)) { parent_leaf_histogram_array_ = larger_leaf_histogram_array_; }
+    histogram_pool_.Get(right_leaf, num_data_in_right_child, &smaller_leaf_histogram_array_);
   }
 
   // init for the ordered gradients, only initialize when have 2 leaves
@@ -272,120 +676,441 @@ bool SerialTreeLearner::BeforeFindBestSplit(int left_leaf, int right_leaf) {
     data_size_t begin = data_partition_->leaf_begin(smaller_leaf);
     data_size_t end = begin + data_partition_->leaf_count(smaller_leaf);
     // copy
-    #pragma omp parallel for schedule(static)
-    for (data_size_t i = begin; i < end; ++i) {
-      ordered_gradients_[i - begin] = gradients_[indices[i]];
-      ordered_hessians_[i - begin] = hessians_[indices[i]];
-    }
+    CopyOrderedGradients(indices + begin, end - begin, 0);
     // assign pointer
-    ptr_to_ordered_gradients_smaller_leaf_ = ordered_gradients_.data();
-    ptr_to_ordered_hessians_smaller_leaf_ = ordered_hessians_.data();
+    ptr_to_ordered_gradients_smaller_leaf_ = ordered_gradients_;
+    ptr_to_ordered_hessians_smaller_leaf_ = is_constant_hessian_ ? nullptr : ordered_hessians_;
+    if (use_quantized_grad_) {
+      CopyOrderedQuantizedGradients(indices + begin, end - begin, ordered_quantized_grad_hess_.data());
+      ptr_to_ordered_grad_hess_smaller_leaf_ = ordered_quantized_grad_hess_.data();
+    } else if (use_bf16_grad_) {
+      CopyOrderedBF16Gradients(indices + begin, end - begin, ordered_bf16_grad_hess_.data());
+      ptr_to_ordered_bf16_grad_hess_smaller_leaf_ = ordered_bf16_grad_hess_.data();
+    }
 
+    is_larger_ordered_gradients_copied_ = false;
     if (parent_leaf_histogram_array_ == nullptr) {
       // need order gradient for larger leaf
-      data_size_t smaller_size = end - begin;
-      data_size_t larger_begin = data_partition_->leaf_begin(larger_leaf);
-      data_size_t larger_end = larger_begin + data_partition_->leaf_count(larger_leaf);
-      // copy
-      #pragma omp parallel for schedule(static)
-      for (data_size_t i = larger_begin; i < larger_end; ++i) {
-        ordered_gradients_[smaller_size + i - larger_begin] = gradients_[indices[i]];
-        ordered_hessians_[smaller_size + i - larger_begin] = hessians_[indices[i]];
-      }
-      ptr_to_ordered_gradients_larger_leaf_ = ordered_gradients_.data() + smaller_size;
-      ptr_to_ordered_hessians_larger_leaf_ = ordered_hessians_.data() + smaller_size;
+      CopyLargerLeafOrderedGradients(smaller_leaf, larger_leaf);
     }
   }
 
   // split for the ordered bin
   if (has_ordered_bin_ && right_leaf >= 0) {
     // mark data that at left-leaf
-    std::memset(is_data_in_leaf_.data(), 0, sizeof(char)*num_data_);
-    const data_size_t* indices = data_partition_->indices();
-    data_size_t begin = data_partition_->leaf_begin(left_leaf);
-    data_size_t end = begin + data_partition_->leaf_count(left_leaf);
-    #pragma omp parallel for schedule(static)
-    for (data_size_t i = begin; i < end; ++i) {
-      is_data_in_leaf_[indices[i]] = 1;
-    }
+    MarkDataInLeaf(left_leaf, 1);
     // split the ordered bin
-    #pragma omp parallel for schedule(guided)
-    for (int i = 0; i < num_features_; ++i) {
-      if (ordered_bins_[i] != nullptr) {
-        ordered_bins_[i]->Split(left_leaf, right_leaf, is_data_in_leaf_.data());
-      }
-    }
+    ParallelForOrderedBins([this, left_leaf, right_leaf](int i) {
+      ordered_bins_[i]->Split(left_leaf, right_leaf, is_data_in_leaf_.data());
+    });
+    MarkDataInLeaf(left_leaf, 0);
   }
   return true;
 }
 
 
-void SerialTreeLearner::FindBestThresholds() {
+void SerialTreeLearner::CopyLargerLeafOrderedGradients(int smaller_leaf, int larger_leaf) {
+  const data_size_t* indices = data_partition_->indices();
+  data_size_t smaller_size = data_partition_->leaf_count(smaller_leaf);
+  data_size_t larger_begin = data_partition_->leaf_begin(larger_leaf);
+  data_size_t larger_end = larger_begin + data_partition_->leaf_count(larger_leaf);
+  // copy
+  CopyOrderedGradients(indices + larger_begin, larger_end - larger_begin, smaller_size);
+  ptr_to_ordered_gradients_larger_leaf_ = ordered_gradients_ + smaller_size;
+  ptr_to_ordered_hessians_larger_leaf_ = is_constant_hessian_ ? nullptr : ordered_hessians_ + smaller_size;
+  if (use_quantized_grad_) {
+    int8_t* larger_grad_hess = ordered_quantized_grad_hess_.data() + 2 * static_cast<size_t>(smaller_size);
+    CopyOrderedQuantizedGradients(indices + larger_begin, larger_end - larger_begin, larger_grad_hess);
+    ptr_to_ordered_grad_hess_larger_leaf_ = larger_grad_hess;
+  } else if (use_bf16_grad_) {
+    uint32_t* larger_grad_hess = ordered_bf16_grad_hess_.data() + smaller_size;
+    CopyOrderedBF16Gradients(indices + larger_begin, larger_end - larger_begin, larger_grad_hess);
+    ptr_to_ordered_bf16_grad_hess_larger_leaf_ = larger_grad_hess;
+  }
+  is_larger_ordered_gradients_copied_ = true;
+}
+
+void SerialTreeLearner::ConstructGroupedHistograms(const LeafSplits* leaf_splits, const score_t* ordered_gradients,
+  const score_t* ordered_hessians, FeatureHistogram* histogram_array) {
+  ProfileScope profile_scope(kConstructHistogramsProfile);
+  #pragma omp parallel for schedule(guided)
+  for (int group = 0; group < static_cast<int>(feature_groups_.size()); ++group) {
+    const FeatureGroup* feature_group = feature_groups_[group].get();
+    bool is_group_used = false;
+    std::vector<HistogramBinEntry*> out(feature_group->num_features());
+    for (int j = 0; j < feature_group->num_features(); ++j) {
+      const int feature_index = feature_group->feature_indices()[j];
+      if (is_feature_used_.empty() || is_feature_used_[feature_index]) { is_group_used = true; }
+      out[j] = histogram_array[feature_index].ResetForConstruct(leaf_splits->num_data_in_leaf(),
+        leaf_splits->sum_gradients(), leaf_splits->sum_hessians(), ordered_hessians == nullptr);
+    }
+    if (!is_group_used) { continue; }
+    feature_group->ConstructHistogram(leaf_splits->data_indices(), leaf_splits->num_data_in_leaf(),
+      ordered_gradients, ordered_hessians, out.data());
+  }
   #pragma omp parallel for schedule(guided)
-  for (int feature_index = 0; feature_index < num_features_; feature_index++) {
+  for (int bundle = 0; bundle < train_data_->num_feature_bundles(); ++bundle) {
+    const FeatureBundle* feature_bundle = train_data_->FeatureBundleAt(bundle);
+    bool is_bundle_used = false;
+    for (int feature_index : feature_bundle->feature_indices()) {
+      if (is_feature_used_.empty() || is_feature_used_[feature_index]) { is_bundle_used = true; }
+      histogram_array[feature_index].SetSumup(leaf_splits->num_data_in_leaf(),
+        leaf_splits->sum_gradients(), leaf_splits->sum_hessians(), ordered_hessians == nullptr);
+    }
+    if (!is_bundle_used) { continue; }
+    // histograms of the features are ranges of the histogram of the bundle, see histogram_create_function in Init
+    HistogramBinEntry* out = histogram_array[feature_bundle->feature_indices()[0]].RawData() - feature_bundle->bin_offset(0);
+    std::memset(static_cast<void*>(out), 0, sizeof(HistogramBinEntry) * feature_bundle->num_bin());
+    feature_bundle->ConstructHistogram(leaf_splits->data_indices(), leaf_splits->num_data_in_leaf(),
+      ordered_gradients, ordered_hessians, out);
+  }
+}
+
+bool SerialTreeLearner::ConstructRowParallelHistograms(const LeafSplits* leaf_splits, const score_t* ordered_gradients,
+  const score_t* ordered_hessians, FeatureHistogram* histogram_array) {
+  const data_size_t num_data_in_leaf = leaf_splits->num_data_in_leaf();
+  if (row_parallel_hist_buf_.empty() || num_data_in_leaf < num_threads_ * kMinDataPerThread) {
+    return false;
+  }
+  std::vector<int> used_features;
+  for (int i = 0; i < num_features_; ++i) {
+    if (is_feature_used_[i] && !is_feature_grouped_[i] && ordered_bins_[i] == nullptr) {
+      used_features.push_back(i);
+    }
+  }
+  // enough features for feature parallel
+  if (used_features.size() >= static_cast<size_t>(num_threads_ * kMinFeaturesPerThread)) {
+    return false;
+  }
+  ProfileScope profile_scope(kConstructHistogramsProfile);
+  // always use data indices, since each thread only processes part of the leaf
+  data_size_t tmp_cnt = 0;
+  const data_size_t* data_indices = data_partition_->GetIndexOnLeaf(leaf_splits->LeafIndex(), &tmp_cnt);
+  const data_size_t inner_size = (num_data_in_leaf + num_threads_ - 1) / num_threads_;
+  Threading::ParallelFor(0, num_threads_, [&](int tid) {
+    const data_size_t start = tid * inner_size;
+    const data_size_t end = std::min(start + inner_size, num_data_in_leaf);
+    HistogramBinEntry* buf = row_parallel_hist_buf_[tid].data();
+    for (int feature_index : used_features) {
+      HistogramBinEntry* out = buf + row_parallel_hist_offset_[feature_index];
+      std::memset(static_cast<void*>(out), 0, sizeof(HistogramBinEntry) * train_data_->FeatureAt(feature_index)->num_bin());
+      if (start < end) {
+        train_data_->FeatureAt(feature_index)->bin_data()->ConstructHistogram(data_indices + start, end - start,
+          ordered_gradients + start, ordered_hessians + start, out);
+      }
+    }
+  });
+  // reduce thread local histograms
+  Threading::ParallelFor(0, static_cast<int>(used_features.size()), [&](int i) {
+    const int feature_index = used_features[i];
+    const int num_bin = train_data_->FeatureAt(feature_index)->num_bin();
+    HistogramBinEntry* out = histogram_array[feature_index].ResetForConstruct(num_data_in_leaf,
+      leaf_splits->sum_gradients(), leaf_splits->sum_hessians(), ordered_hessians == nullptr);
+    for (int tid = 0; tid < num_threads_; ++tid) {
+      const HistogramBinEntry* buf = row_parallel_hist_buf_[tid].data() + row_parallel_hist_offset_[feature_index];
+      for (int j = 0; j < num_bin; ++j) {
+        out[j].sum_gradients += buf[j].sum_gradients;
+        out[j].sum_hessians += buf[j].sum_hessians;
+        out[j].cnt += buf[j].cnt;
+      }
+    }
+  });
+  return true;
+}
+
+void SerialTreeLearner::FindBestThresholds() {
+  // construct histograms by other strategies first, then the rest are constructed feature by feature
+  bool is_smaller_dense_constructed = is_smaller_batch_constructed_ || ConstructDenseHistograms(smaller_leaf_splits_.get(),
+    ptr_to_ordered_gradients_smaller_leaf_, ptr_to_ordered_hessians_smaller_leaf_, smaller_leaf_histogram_array_);
+  bool is_larger_dense_constructed = false;
+  if (parent_leaf_histogram_array_ == nullptr
+    && larger_leaf_splits_ != nullptr && larger_leaf_splits_->LeafIndex() >= 0) {
+    is_larger_dense_constructed = ConstructDenseHistograms(larger_leaf_splits_.get(),
+      ptr_to_ordered_gradients_larger_leaf_, ptr_to_ordered_hessians_larger_leaf_, larger_leaf_histogram_array_);
+  }
+  if (!feature_groups_.empty() || train_data_->num_feature_bundles() > 0) {
+    ConstructGroupedHistograms(smaller_leaf_splits_.get(), ptr_to_ordered_gradients_smaller_leaf_,
+      ptr_to_ordered_hessians_smaller_leaf_, smaller_leaf_histogram_array_);
+    if (parent_leaf_histogram_array_ == nullptr
+      && larger_leaf_splits_ != nullptr && larger_leaf_splits_->LeafIndex() >= 0) {
+      ConstructGroupedHistograms(larger_leaf_splits_.get(), ptr_to_ordered_gradients_larger_leaf_,
+        ptr_to_ordered_hessians_larger_leaf_, larger_leaf_histogram_array_);
+    }
+  }
+  if (use_lazy_histogram_ && larger_leaf_splits_ != nullptr && larger_leaf_splits_->LeafIndex() >= 0) {
+    FindBestThresholdsLazily(is_smaller_dense_constructed, is_larger_dense_constructed);
+    return;
+  }
+  ParallelForFeatures([this, is_smaller_dense_constructed, is_larger_dense_constructed](int feature_index) {
     // feature is not used
-    if ((is_feature_used_.size() > 0 && is_feature_used_[feature_index] == false)) continue;
-    // if parent(larger) leaf cannot split at current feature
-    if (parent_leaf_histogram_array_ != nullptr && !parent_leaf_histogram_array_[feature_index].is_splittable()) {
-      smaller_leaf_histogram_array_[feature_index].set_is_splittable(false);
-      continue;
+    if ((is_feature_used_.size() > 0 && is_feature_used_[feature_index] == false)) return;
+    FindBestThresholdsForFeature(feature_index, is_smaller_dense_constructed, is_larger_dense_constructed,
+      parent_leaf_histogram_array_ != nullptr);
+  });
+  if (use_lazy_histogram_) {
+    // only has root leaf, histograms of all used features are constructed
+    const size_t offset = static_cast<size_t>(smaller_leaf_splits_->LeafIndex()) * num_features_;
+    for (int i = 0; i < num_features_; ++i) {
+      const bool is_used = is_feature_used_.empty() || is_feature_used_[i];
+      is_histogram_constructed_[offset + i] = is_used ? 1 : 0;
+      gain_densities_[offset + i] = is_used ? GainDensity(smaller_leaf_splits_.get(), i) : 0.0f;
+    }
+  }
+}
+
+double SerialTreeLearner::GainDensity(const LeafSplits* leaf_splits, int feature_index) const {
+  const double gain = leaf_splits->BestSplitPerFeature()[feature_index].gain;
+  if (!(gain > 0.0f) || !(leaf_splits->sum_hessians() > 0.0f)) {
+    return 0.0f;
+  }
+  return gain / leaf_splits->sum_hessians();
+}
+
+void SerialTreeLearner::FindBestThresholdsLazily(bool is_smaller_dense_constructed, bool is_larger_dense_constructed) {
+  const int smaller_leaf = smaller_leaf_splits_->LeafIndex();
+  const int larger_leaf = larger_leaf_splits_->LeafIndex();
+  // parent is the left leaf, the new right leaf always has the larger index
+  const size_t parent_offset = static_cast<size_t>(std::min(smaller_leaf, larger_leaf)) * num_features_;
+  const size_t smaller_offset = static_cast<size_t>(smaller_leaf) * num_features_;
+  const size_t larger_offset = static_cast<size_t>(larger_leaf) * num_features_;
+  // states of parent are overwritten by its children
+  const std::vector<double> parent_densities(gain_densities_.begin() + parent_offset,
+    gain_densities_.begin() + parent_offset + num_features_);
+  std::vector<char> is_parent_constructed(num_features_, 0);
+  if (parent_leaf_histogram_array_ != nullptr) {
+    std::copy(is_histogram_constructed_.begin() + parent_offset,
+      is_histogram_constructed_.begin() + parent_offset + num_features_, is_parent_constructed.begin());
+  }
+  // 0: not used or cannot split, 1: evaluated, 2: deferred candidate
+  std::vector<char> feature_state(num_features_, 0);
+  std::vector<int> eager_features;
+  std::vector<int> candidates;
+  for (int i = 0; i < num_features_; ++i) {
+    if (!is_feature_used_.empty() && !is_feature_used_[i]) { continue; }
+    if (parent_leaf_histogram_array_ != nullptr && !parent_leaf_histogram_array_[i].is_splittable()) {
+      // if parent(larger) leaf cannot split at current feature
+      smaller_leaf_histogram_array_[i].set_is_splittable(false);
+    } else if (!is_feature_grouped_[i]
+      && (ordered_bins_[i] != nullptr || (!is_smaller_dense_constructed && !is_larger_dense_constructed))) {
+      // histograms of the feature are constructed by itself
+      feature_state[i] = 2;
+      candidates.push_back(i);
+    } else {
+      // histograms are constructed by other strategies anyway
+      eager_features.push_back(i);
+    }
+  }
+  double best_gain_smaller = kMinScore;
+  double best_gain_larger = kMinScore;
+  auto evaluate = [&](const int* features, int num_feature) {
+    if (!is_larger_ordered_gradients_copied_) {
+      for (int j = 0; j < num_feature; ++j) {
+        const int i = features[j];
+        if (!is_parent_constructed[i] && !is_feature_grouped_[i] && ordered_bins_[i] == nullptr) {
+          CopyLargerLeafOrderedGradients(smaller_leaf, larger_leaf);
+          break;
+        }
+      }
+    }
+    Threading::ParallelFor(0, num_feature, [&](int j) {
+      FindBestThresholdsForFeature(features[j], is_smaller_dense_constructed, is_larger_dense_constructed,
+        is_parent_constructed[features[j]] != 0);
+    });
+    for (int j = 0; j < num_feature; ++j) {
+      const int i = features[j];
+      feature_state[i] = 1;
+      best_gain_smaller = std::max(best_gain_smaller, smaller_leaf_splits_->BestSplitPerFeature()[i].gain);
+      best_gain_larger = std::max(best_gain_larger, larger_leaf_splits_->BestSplitPerFeature()[i].gain);
+    }
+  };
+  evaluate(eager_features.data(), static_cast<int>(eager_features.size()));
+  // candidates with higher bounds first, evaluated in growing chunks until the bounds cannot beat the best gains
+  std::stable_sort(candidates.begin(), candidates.end(), [&parent_densities](int a, int b) {
+    return parent_densities[a] > parent_densities[b];
+  });
+  const double bound_smaller = lazy_histogram_slack_ * smaller_leaf_splits_->sum_hessians();
+  const double bound_larger = lazy_histogram_slack_ * larger_leaf_splits_->sum_hessians();
+  size_t chunk_size = static_cast<size_t>(std::max(num_threads_, 1)) * kLazyFeaturesPerThread;
+  size_t pos = 0;
+  while (pos < candidates.size()) {
+    size_t end = pos;
+    while (end < candidates.size() && end - pos < chunk_size) {
+      const double density = parent_densities[candidates[end]];
+      if (!(density * bound_smaller > best_gain_smaller || density * bound_larger > best_gain_larger)) { break; }
+      ++end;
     }
+    if (end == pos) { break; }
+    evaluate(candidates.data() + pos, static_cast<int>(end - pos));
+    pos = end;
+    chunk_size *= 2;
+  }
+  num_lazy_candidates_ += static_cast<int64_t>(candidates.size());
+  num_lazy_constructed_ += static_cast<int64_t>(pos);
+  // update states of children
+  for (int i = 0; i < num_features_; ++i) {
+    if (feature_state[i] == 1) {
+      is_histogram_constructed_[smaller_offset + i] = 1;
+      is_histogram_constructed_[larger_offset + i] = 1;
+      gain_densities_[smaller_offset + i] = GainDensity(smaller_leaf_splits_.get(), i);
+      gain_densities_[larger_offset + i] = GainDensity(larger_leaf_splits_.get(), i);
+    } else {
+      is_histogram_constructed_[smaller_offset + i] = 0;
+      is_histogram_constructed_[larger_offset + i] = 0;
+      // estimates get staler as a feature is deferred deeper, so they are inflated to be evaluated again later
+      gain_densities_[smaller_offset + i] = parent_densities[i] * lazy_histogram_slack_;
+      gain_densities_[larger_offset + i] = parent_densities[i] * lazy_histogram_slack_;
+      if (feature_state[i] == 2) {
+        // deferred, children can still be split by it
+        smaller_leaf_histogram_array_[i].set_is_splittable(true);
+        larger_leaf_histogram_array_[i].set_is_splittable(true);
+      }
+    }
+  }
+}
 
-    // construct histograms for smaller leaf
+void SerialTreeLearner::FindBestThresholdsForFeature(int feature_index, bool is_smaller_dense_constructed,
+  bool is_larger_dense_constructed, bool is_parent_constructed) {
+  // if parent(larger) leaf cannot split at current feature
+  if (parent_leaf_histogram_array_ != nullptr && !parent_leaf_histogram_array_[feature_index].is_splittable()) {
+    smaller_leaf_histogram_array_[feature_index].set_is_splittable(false);
+    return;
+  }
+
+  // construct histograms for smaller leaf
+  if (is_feature_grouped_[feature_index]
+    || (is_smaller_dense_constructed && ordered_bins_[feature_index] == nullptr)) {
+    // already constructed
+  } else if (ordered_bins_[feature_index] == nullptr) {
+    // if not use ordered bin
+    ConstructDenseHistogram(feature_index, smaller_leaf_splits_.get(),
+      ptr_to_ordered_gradients_smaller_leaf_,
+      ptr_to_ordered_hessians_smaller_leaf_,
+      ptr_to_ordered_grad_hess_smaller_leaf_,
+      ptr_to_ordered_bf16_grad_hess_smaller_leaf_,
+      smaller_leaf_histogram_array_);
+  } else {
+    // used ordered bin
+    smaller_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
+      smaller_leaf_splits_->LeafIndex(),
+      smaller_leaf_splits_->num_data_in_leaf(),
+      smaller_leaf_splits_->sum_gradients(),
+      smaller_leaf_splits_->sum_hessians(),
+      gradients_,
+      HistogramHessians());
+  }
+  // find best threshold for smaller child
+  smaller_leaf_histogram_array_[feature_index].FindBestThreshold(&smaller_leaf_splits_->BestSplitPerFeature()[feature_index]);
+
+  // only has root leaf
+  if (larger_leaf_splits_ == nullptr || larger_leaf_splits_->LeafIndex() < 0) return;
+
+  if (is_parent_constructed) {
+    // construct histgroms for large leaf, we initialize larger leaf as the parent,
+    // so we can just subtract the smaller leaf's histograms
+    larger_leaf_histogram_array_[feature_index].Subtract(smaller_leaf_histogram_array_[feature_index]);
+  } else if (!is_feature_grouped_[feature_index]
+    && !(is_larger_dense_constructed && ordered_bins_[feature_index] == nullptr)) {
     if (ordered_bins_[feature_index] == nullptr) {
       // if not use ordered bin
-      smaller_leaf_histogram_array_[feature_index].Construct(smaller_leaf_splits_->data_indices(),
-        smaller_leaf_splits_->num_data_in_leaf(),
-        smaller_leaf_splits_->sum_gradients(),
-        smaller_leaf_splits_->sum_hessians(),
-        ptr_to_ordered_gradients_smaller_leaf_,
-        ptr_to_ordered_hessians_smaller_leaf_);
+      ConstructDenseHistogram(feature_index, larger_leaf_splits_.get(),
+        ptr_to_ordered_gradients_larger_leaf_,
+        ptr_to_ordered_hessians_larger_leaf_,
+        ptr_to_ordered_grad_hess_larger_leaf_,
+        ptr_to_ordered_bf16_grad_hess_larger_leaf_,
+        larger_leaf_histogram_array_);
     } else {
       // used ordered bin
-      smaller_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
-        smaller_leaf_splits_->LeafIndex(),
-        smaller_leaf_splits_->num_data_in_leaf(),
-        smaller_leaf_splits_->sum_gradients(),
-        smaller_leaf_splits_->sum_hessians(),
+      larger_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
+        larger_leaf_splits_->LeafIndex(),
+        larger_leaf_splits_->num_data_in_leaf(),
+        larger_leaf_splits_->sum_gradients(),
+        larger_leaf_splits_->sum_hessians(),
         gradients_,
-        hessians_);
+        HistogramHessians());
     }
-    // find best threshold for smaller child
-    smaller_leaf_histogram_array_[feature_index].FindBestThreshold(&smaller_leaf_splits_->BestSplitPerFeature()[feature_index]);
+  }
 
-    // only has root leaf
-    if (larger_leaf_splits_ == nullptr || larger_leaf_splits_->LeafIndex() < 0) continue;
+  // find best threshold for larger child
+  larger_leaf_histogram_array_[feature_index].FindBestThreshold(&larger_leaf_splits_->BestSplitPerFeature()[feature_index]);
+}
 
-    if (parent_leaf_histogram_array_ != nullptr) {
-      // construct histgroms for large leaf, we initialize larger leaf as the parent,
-      // so we can just subtract the smaller leaf's histograms
-      larger_leaf_histogram_array_[feature_index].Subtract(smaller_leaf_histogram_array_[feature_index]);
-    } else {
-      if (ordered_bins_[feature_index] == nullptr) {
-        // if not use ordered bin
-        larger_leaf_histogram_array_[feature_index].Construct(larger_leaf_splits_->data_indices(),
-          larger_leaf_splits_->num_data_in_leaf(),
-          larger_leaf_splits_->sum_gradients(),
-          larger_leaf_splits_->sum_hessians(),
-          ptr_to_ordered_gradients_larger_leaf_,
-          ptr_to_ordered_hessians_larger_leaf_);
-      } else {
-        // used ordered bin
-        larger_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
-          larger_leaf_splits_->LeafIndex(),
-          larger_leaf_splits_->num_data_in_leaf(),
-          larger_leaf_splits_->sum_gradients(),
-          larger_leaf_splits_->sum_hessians(),
-          gradients_,
-          hessians_);
-      }
+void SerialTreeLearner::ParallelForFeatures(const std::function<void(int)>& inner_fun) const {
+  if (ThreadPool::Current() != nullptr) {
+    Threading::ParallelFor(0, num_features_, inner_fun);
+    return;
+  }
+  if (!numa_feature_begin_.empty()) {
+    Numa::For(numa_feature_begin_, inner_fun);
+    return;
+  }
+  #pragma omp parallel for schedule(guided)
+  for (int i = 0; i < num_features_; ++i) {
+    inner_fun(i);
+  }
+}
+
+void SerialTreeLearner::InitOrderedBinBatches() {
+  ordered_bin_features_.clear();
+  ordered_bin_batch_begin_.clear();
+  size_t total_cost = 0;
+  for (int i = 0; i < num_features_; ++i) {
+    if (ordered_bins_[i] != nullptr) {
+      ordered_bin_features_.push_back(i);
+      // one more for the fixed cost of a feature
+      total_cost += ordered_bins_[i]->NumNonZeros() + 1;
+    }
+  }
+  has_ordered_bin_ = !ordered_bin_features_.empty();
+  const size_t num_batches = static_cast<size_t>(num_threads_) * kOrderedBinBatchesPerThread;
+  const size_t batch_cost = std::max<size_t>((total_cost + num_batches - 1) / num_batches, 1);
+  size_t cur_cost = 0;
+  for (size_t j = 0; j < ordered_bin_features_.size(); ++j) {
+    if (cur_cost == 0) {
+      ordered_bin_batch_begin_.push_back(static_cast<int>(j));
+    }
+    cur_cost += ordered_bins_[ordered_bin_features_[j]]->NumNonZeros() + 1;
+    if (cur_cost >= batch_cost) {
+      cur_cost = 0;
     }
+  }
+  ordered_bin_batch_begin_.push_back(static_cast<int>(ordered_bin_features_.size()));
+}
 
-    // find best threshold for larger child
-    larger_leaf_histogram_array_[feature_index].FindBestThreshold(&larger_leaf_splits_->BestSplitPerFeature()[feature_index]);
+void SerialTreeLearner::ParallelForOrderedBins(const std::function<void(int)>& inner_fun) const {
+  if (!numa_feature_begin_.empty() && ThreadPool::Current() == nullptr) {
+    // keep the features on the threads of their nodes
+    ParallelForFeatures([this, &inner_fun](int i) {
+      if (ordered_bins_[i] != nullptr) {
+        inner_fun(i);
+      }
+    });
+    return;
+  }
+  const int num_batches = static_cast<int>(ordered_bin_batch_begin_.size()) - 1;
+  auto batch_fun = [this, &inner_fun](int batch) {
+    for (int j = ordered_bin_batch_begin_[batch]; j < ordered_bin_batch_begin_[batch + 1]; ++j) {
+      inner_fun(ordered_bin_features_[j]);
+    }
+  };
+  if (ThreadPool::Current() != nullptr) {
+    Threading::ParallelFor(0, num_batches, batch_fun);
+    return;
+  }
+  #pragma omp parallel for schedule(dynamic, 1)
+  for (int batch = 0; batch < num_batches; ++batch) {
+    batch_fun(batch);
   }
 }
 
+void SerialTreeLearner::MarkDataInLeaf(int leaf, char mark) {
+  const data_size_t* indices = data_partition_->indices();
+  const data_size_t begin = data_partition_->leaf_begin(leaf);
+  const data_size_t end = begin + data_partition_->leaf_count(leaf);
+  #pragma omp parallel for schedule(static)
+  for (data_size_t i = begin; i < end; ++i) {
+    is_data_in_leaf_[indices[i]] = mark;
+  }
+}
 
 void SerialTreeLearner::Split(Tree* tree, int best_Leaf, int* left_leaf, int* right_leaf) {
   const SplitInfo& best_split_info = best_split_per_leaf_[best_Leaf];
@@ -398,6 +1123,7 @@ void SerialTreeLearner::Split(Tree* tree, int best_Leaf, int* left_leaf, int* ri
     train_data_->FeatureAt(best_split_info.feature)->BinToValue(best_split_info.threshold),
     static_cast<double>(best_split_info.left_output),
     static_cast<double>(best_split_info.right_output),
+    best_split_info.left_count, best_split_info.right_count,
     static_cast<double>(best_split_info.gain));
 
   // split data partition
@@ -405,16 +1131,20 @@ void SerialTreeLearner::Split(Tree* tree, int best_Leaf, int* left_leaf, int* ri
                          best_split_info.threshold, *right_leaf);
 
   // init the leaves that used on next iteration
-  if (best_split_info.left_count < best_split_info.right_count) {
-    smaller_leaf_splits_->Init(*left_leaf, data_partition_.get(),
-                               best_split_info.left_sum_gradient,
-                               best_split_info.left_sum_hessian);
-    larger_leaf_splits_->Init(*right_leaf, data_partition_.get(),
-                               best_split_info.right_sum_gradient,
-                               best_split_info.right_sum_hessian);
+  InitLeafSplits(best_split_info, *left_leaf, *right_leaf);
+}
+
+void SerialTreeLearner::InitLeafSplits(const SplitInfo& split_info, int left_leaf, int right_leaf) {
+  if (split_info.left_count < split_info.right_count) {
+    smaller_leaf_splits_->Init(left_leaf, data_partition_.get(),
+                               split_info.left_sum_gradient,
+                               split_info.left_sum_hessian);
+    larger_leaf_splits_->Init(right_leaf, data_partition_.get(),
+                               split_info.right_sum_gradient,
+                               split_info.right_sum_hessian);
   } else {
-    smaller_leaf_splits_->Init(*right_leaf, data_partition_.get(), best_split_info.right_sum_gradient, best_split_info.right_sum_hessian);
-    larger_leaf_splits_->Init(*left_leaf, data_partition_.get(), best_split_info.left_sum_gradient, best_split_info.left_sum_hessian);
+    smaller_leaf_splits_->Init(right_leaf, data_partition_.get(), split_info.right_sum_gradient, split_info.right_sum_hessian);
+    larger_leaf_splits_->Init(left_leaf, data_partition_.get(), split_info.left_sum_gradient, split_info.left_sum_hessian);
   }
 }
 
@@ -3,21 +3,29 @@
 
 #include <LightGBM/utils/random.h>
 #include <LightGBM/utils/array_args.h>
+#include <LightGBM/utils/arena.h>
+#include <LightGBM/utils/threading.h>
 
 #include <LightGBM/tree_learner.h>
 #include <LightGBM/dataset.h>
 #include <LightGBM/tree.h>
 #include <LightGBM/feature.h>
+#include <LightGBM/objective_function.h>
 #include "feature_histogram.hpp"
+#include "feature_group.hpp"
 #include "data_partition.hpp"
 #include "split_info.hpp"
 #include "leaf_splits.hpp"
 
+#include <omp.h>
+
 #include <cstdio>
 #include <vector>
+#include <functional>
 #include <random>
 #include <cmath>
 #include <memory>
+#include <algorithm>
 
 namespace LightGBM {
 
@@ -36,8 +44,34 @@ public:
 
   void SetBaggingData(const data_size_t* used_indices, data_size_t num_data) override {
     data_partition_->SetUsedDataIndices(used_indices, num_data);
+    is_bag_changed_ = true;
+  }
+
+  std::string GetRandomState() const override {
+    // states of mt19937 have no line breaks
+    return random_.GetState() + "\n" + quantize_random_.GetState();
   }
 
+  void SetRandomState(const std::string& state) override {
+    // states saved before quantize_random_ only have random_
+    const size_t pos = state.find('\n');
+    random_.SetState(state.substr(0, pos));
+    if (pos != std::string::npos) {
+      quantize_random_.SetState(state.substr(pos + 1));
+    }
+  }
+
+  void SetMemoryBudget(double max_memory_in_bytes) override {
+    memory_budget_in_bytes_ = max_memory_in_bytes;
+  }
+
+  void SetIsConstantHessian(bool is_constant_hessian) override {
+    // quantized and bfloat16 histograms always pack hessians
+    is_constant_hessian_ = is_constant_hessian && !use_quantized_grad_ && !use_bf16_grad_;
+  }
+
+  void AddMemoryUsage(MemoryUsage* memory_usage) const override;
+
   void AddPredictionToScore(score_t* out_score) const override {
     #pragma omp parallel for schedule(guided)
     for (int i = 0; i < data_partition_->num_leaves(); ++i) {
@@ -50,6 +84,29 @@ public:
     }
   }
 
+  void AddPredictionToScoreAndGetGradients(const ObjectiveFunction* object_function, score_t* out_score,
+    score_t* gradients, score_t* hessians) const override {
+    // data of leaves are interleaved, so process blocks of data that fit in cache, with all leaves in each block.
+    // Indices on leaves are sorted, so data of a leaf in a block are found by binary search
+    const int num_blocks = static_cast<int>((num_data_ + kFusedBlockSize - 1) / kFusedBlockSize);
+    #pragma omp parallel for schedule(static)
+    for (int block = 0; block < num_blocks; ++block) {
+      const data_size_t block_start = block * kFusedBlockSize;
+      const data_size_t block_end = std::min(block_start + kFusedBlockSize, num_data_);
+      for (int i = 0; i < data_partition_->num_leaves(); ++i) {
+        score_t output = static_cast<score_t>(last_trained_tree_->LeafOutput(i));
+        data_size_t cnt_leaf_data = 0;
+        auto tmp_idx = data_partition_->GetIndexOnLeaf(i, &cnt_leaf_data);
+        const data_size_t* start = std::lower_bound(tmp_idx, tmp_idx + cnt_leaf_data, block_start);
+        const data_size_t* end = std::lower_bound(start, tmp_idx + cnt_leaf_data, block_end);
+        if (start < end) {
+          object_function->AddScoreAndGetGradients(output, start, static_cast<data_size_t>(end - start),
+            out_score, gradients, hessians);
+        }
+      }
+    }
+  }
+
 protected:
   /*!
   * \brief Some initial works before training
@@ -69,6 +126,233 @@ protected:
   */
   virtual void FindBestThresholds();
 
+  /*!
+  * \brief Construct histograms of one feature for smaller and larger leaves and find their best thresholds
+  * \param feature_index Index of the feature
+  * \param is_smaller_dense_constructed True if dense histograms of smaller leaf are already constructed
+  * \param is_larger_dense_constructed True if dense histograms of larger leaf are already constructed
+  * \param is_parent_constructed True if histogram of the parent is valid, then larger leaf's one is got by subtraction
+  */
+  void FindBestThresholdsForFeature(int feature_index, bool is_smaller_dense_constructed,
+    bool is_larger_dense_constructed, bool is_parent_constructed);
+
+  /*!
+  * \brief Find best thresholds with lazy histograms. Features whose histograms are constructed feature by feature
+  *        are visited in descending order of their estimated gain bounds, and the rest are deferred once their bounds
+  *        cannot beat the best gains found. Bound of a feature is lazy_histogram_slack * (best gain / sum of hessians)
+  *        at the last leaf it is evaluated * sum of hessians of the child, and it is multiplied by the slack again
+  *        each time the feature is deferred. It is an estimate instead of a proof, so trees may differ from the exact ones
+  * \param is_smaller_dense_constructed True if dense histograms of smaller leaf are already constructed
+  * \param is_larger_dense_constructed True if dense histograms of larger leaf are already constructed
+  */
+  void FindBestThresholdsLazily(bool is_smaller_dense_constructed, bool is_larger_dense_constructed);
+
+  /*!
+  * \brief Best gain of a feature at a leaf per its sum of hessians, 0 if the feature cannot split the leaf
+  * \param leaf_splits The leaf
+  * \param feature_index Index of the feature
+  */
+  double GainDensity(const LeafSplits* leaf_splits, int feature_index) const;
+
+  /*!
+  * \brief Copy ordered gradients and hessians of larger leaf after the ones of smaller leaf
+  * \param smaller_leaf Index of smaller leaf
+  * \param larger_leaf Index of larger leaf
+  */
+  void CopyLargerLeafOrderedGradients(int smaller_leaf, int larger_leaf);
+
+  /*!
+  * \brief Parallel loop over features. Run by the thread pool of the calling thread if any. Otherwise if NUMA is used,
+  *        features are taken by threads of their nodes first, or by guided schedule
+  * \param inner_fun Function of a feature index
+  */
+  void ParallelForFeatures(const std::function<void(int)>& inner_fun) const;
+
+  /*!
+  * \brief Parallel loop over the features that have ordered bins. Features are taken in batches of about the same
+  *        number of non-zero data, so many small sparse features don't cost one task each
+  * \param inner_fun Function of a feature index, ordered_bins_ of it is not nullptr
+  */
+  void ParallelForOrderedBins(const std::function<void(int)>& inner_fun) const;
+
+  /*! \brief Collect the features that have ordered bins and cut them into batches, after the bundling */
+  void InitOrderedBinBatches();
+
+  /*!
+  * \brief Mark or unmark data of one leaf in is_data_in_leaf_. It is all zeros between the uses,
+  *        so it is unmarked after every use instead of being cleared by a pass over all data
+  */
+  void MarkDataInLeaf(int leaf, char mark);
+
+  /*! \brief Allocate the thread local buffers for num_threads_ threads */
+  void ResetThreadBuffers();
+
+  /*!
+  * \brief Construct histograms of grouped and bundled features for one leaf, one pass over the leaf's data for each group or bundle.
+  * \param leaf_splits The leaf
+  * \param ordered_gradients Ordered gradients of the leaf
+  * \param ordered_hessians Ordered hessians of the leaf
+  * \param histogram_array Output histograms of the leaf
+  */
+  void ConstructGroupedHistograms(const LeafSplits* leaf_splits, const score_t* ordered_gradients,
+    const score_t* ordered_hessians, FeatureHistogram* histogram_array);
+
+  /*!
+  * \brief Construct histograms of dense (not grouped) features for one leaf by splitting its data into chunks,
+  *        each thread constructs local histograms for one chunk, then they are reduced.
+  *        Only used when the leaf is large and there are too few features to keep all threads busy.
+  * \param leaf_splits The leaf
+  * \param ordered_gradients Ordered gradients of the leaf
+  * \param ordered_hessians Ordered hessians of the leaf
+  * \param histogram_array Output histograms of the leaf
+  * \return True if histograms are constructed, false means they should be constructed feature by feature
+  */
+  bool ConstructRowParallelHistograms(const LeafSplits* leaf_splits, const score_t* ordered_gradients,
+    const score_t* ordered_hessians, FeatureHistogram* histogram_array);
+
+  /*!
+  * \brief Construct histograms of all used dense (not grouped) features for one leaf before the loop over features,
+  *        by default they are constructed row-parallel if there are too few features. Overridden by the GPU tree learner
+  * \param leaf_splits The leaf
+  * \param ordered_gradients Ordered gradients of the leaf
+  * \param ordered_hessians Ordered hessians of the leaf
+  * \param histogram_array Output histograms of the leaf
+  * \return True if histograms are constructed, false means they should be constructed feature by feature
+  */
+  virtual bool ConstructDenseHistograms(const LeafSplits* leaf_splits, const score_t* ordered_gradients,
+    const score_t* ordered_hessians, FeatureHistogram* histogram_array) {
+    return ConstructRowParallelHistograms(leaf_splits, ordered_gradients, ordered_hessians, histogram_array);
+  }
+
+  /*!
+  * \brief Construct histogram of one dense feature for one leaf, use quantized or bfloat16 gradients if enabled
+  * \param feature_index Index of the feature
+  * \param leaf_splits The leaf
+  * \param ordered_gradients Ordered gradients of the leaf
+  * \param ordered_hessians Ordered hessians of the leaf
+  * \param ordered_grad_hess Ordered quantized gradients and hessians of the leaf
+  * \param ordered_bf16_grad_hess Ordered bfloat16 gradients and hessians of the leaf
+  * \param histogram_array Output histograms of the leaf
+  */
+  inline void ConstructDenseHistogram(int feature_index, const LeafSplits* leaf_splits,
+    const score_t* ordered_gradients, const score_t* ordered_hessians,
+    const int8_t* ordered_grad_hess, const uint32_t* ordered_bf16_grad_hess, FeatureHistogram* histogram_array);
+
+  /*!
+  * \brief Grow the tree by splitting the best leaf_batch_size_ leaves at once
+  * \param tree The tree to grow, only has the root leaf
+  */
+  void TrainLeafBatches(Tree* tree);
+
+  /*!
+  * \brief Construct histograms of the smaller children of a batch of splits by one pass over data.
+  *        Only used features that are dense and not grouped are constructed,
+  *        they are written into the pool slots of the right children, which hold the smaller children after BeforeFindBestSplit.
+  * \param split_infos Split information of the split leaves
+  * \param left_leaves Left children
+  * \param right_leaves Right children
+  * \return True if the histograms are constructed, false if the smaller children cover too few data to sweep all data
+  */
+  bool ConstructLeafBatchHistograms(const std::vector<SplitInfo>& split_infos,
+    const std::vector<int>& left_leaves, const std::vector<int>& right_leaves);
+
+  /*!
+  * \brief Init smaller_leaf_splits_ and larger_leaf_splits_ for the children of one split
+  * \param split_info Split information of the parent
+  * \param left_leaf Left child
+  * \param right_leaf Right child
+  */
+  void InitLeafSplits(const SplitInfo& split_info, int left_leaf, int right_leaf);
+
+  /*!
+  * \brief Quantize gradients and hessians of current iteration, the quantized values are stored in quantized_grad_hess_,
+  *        and gradients_ / hessians_ will point to the dequantized values, so all features see the same gradients.
+  */
+  void QuantizeGradients();
+
+  /*!
+  * \brief Sync up the max absolute values of gradients and hessians used to quantize them. Parallel learners
+  *        take the max over machines, so all machines quantize by the same scales and integer histograms can be summed up
+  * \param max_gradient Max absolute value of local gradients, replaced by the synced value
+  * \param max_hessian Max absolute value of local hessians, replaced by the synced value
+  */
+  virtual void SyncUpQuantizationRange(double* /*max_gradient*/, double* /*max_hessian*/) {}
+
+  /*!
+  * \brief Number of data summed up into the histograms, it is the number of data over machines for parallel learners
+  */
+  virtual int64_t NumDataOfHistograms() { return num_data_; }
+
+  /*!
+  * \brief Size in byte of the histogram of one feature, histograms of dense features not grouped are integers
+  *        if gradients are quantized
+  */
+  int HistogramSizeInByte(int feature_index) const {
+    return train_data_->FeatureAt(feature_index)->num_bin()
+      * static_cast<int>(is_histogram_int_[feature_index] ? sizeof(IntHistogramBinEntry) : sizeof(HistogramBinEntry));
+  }
+
+  /*!
+  * \brief Round gradients and hessians of current iteration to bfloat16, the packed values are stored in bf16_grad_hess_,
+  *        and gradients_ / hessians_ will point to the rounded values, so all features see the same gradients.
+  */
+  void ConvertGradientsToBF16();
+
+  /*!
+  * \brief Copy bfloat16 gradients and hessians of some data into ordered buffer
+  * \param indices Data indices
+  * \param cnt Number of data
+  * \param out Output buffer, size should be at least cnt
+  */
+  void CopyOrderedBF16Gradients(const data_size_t* indices, data_size_t cnt, uint32_t* out) const {
+    #pragma omp parallel for schedule(static)
+    for (data_size_t i = 0; i < cnt; ++i) {
+      out[i] = bf16_grad_hess_[indices[i]];
+    }
+  }
+
+  /*! \brief Hessians read by histograms, nullptr if all hessians are 1 */
+  inline const score_t* HistogramHessians() const {
+    return is_constant_hessian_ ? nullptr : hessians_;
+  }
+
+  /*!
+  * \brief Copy gradients and hessians of some data into ordered buffers, hessians are not copied if all of them are 1
+  * \param indices Data indices
+  * \param cnt Number of data
+  * \param offset Offset of the output in ordered_gradients_ and ordered_hessians_
+  */
+  void CopyOrderedGradients(const data_size_t* indices, data_size_t cnt, data_size_t offset) {
+    score_t* ordered_gradients = ordered_gradients_ + offset;
+    score_t* ordered_hessians = ordered_hessians_ + offset;
+    if (is_constant_hessian_) {
+      #pragma omp parallel for schedule(static)
+      for (data_size_t i = 0; i < cnt; ++i) {
+        ordered_gradients[i] = gradients_[indices[i]];
+      }
+    } else {
+      #pragma omp parallel for schedule(static)
+      for (data_size_t i = 0; i < cnt; ++i) {
+        ordered_gradients[i] = gradients_[indices[i]];
+        ordered_hessians[i] = hessians_[indices[i]];
+      }
+    }
+  }
+
+  /*!
+  * \brief Copy quantized gradients and hessians of some data into ordered buffer
+  * \param indices Data indices
+  * \param cnt Number of data
+  * \param out Output buffer, size should be at least 2 * cnt
+  */
+  void CopyOrderedQuantizedGradients(const data_size_t* indices, data_size_t cnt, int8_t* out) const {
+    #pragma omp parallel for schedule(static)
+    for (data_size_t i = 0; i < cnt; ++i) {
+      out[2 * i] = quantized_grad_hess_[2 * indices[i]];
+      out[2 * i + 1] = quantized_grad_hess_[2 * indices[i] + 1];
+    }
+  }
+
   /*!
   * \brief Find best features for leaves from smaller_leaf_splits_ and larger_leaf_splits_.
   *  This function will be called after FindBestThresholds.
@@ -101,6 +385,8 @@ protected:
   const Tree* last_trained_tree_;
   /*! \brief number of data */
   data_size_t num_data_;
+  /*! \brief Number of data in a block of AddPredictionToScoreAndGetGradients */
+  static const data_size_t kFusedBlockSize = 8192;
   /*! \brief number of features */
   int num_features_;
   /*! \brief training data */
@@ -123,10 +409,14 @@ protected:
   double min_gain_to_split_;
   /*! \brief sub-feature fraction rate */
   double feature_fraction_;
+  /*! \brief arena of histograms, ordered gradients and data partition, declared before its users */
+  Arena arena_;
   /*! \brief training data partition on leaves */
   std::unique_ptr<DataPartition> data_partition_;
   /*! \brief used for generate used features */
   Random random_;
+  /*! \brief used for stochastic rounding of gradients, apart from random_ so sampled features don't depend on it */
+  Random quantize_random_;
   /*! \brief used for sub feature training, is_feature_used_[i] = false means don't used feature i */
   std::vector<bool> is_feature_used_;
   /*! \brief pointer to histograms array of parent of current leaves */
@@ -145,9 +435,9 @@ protected:
   std::unique_ptr<LeafSplits> larger_leaf_splits_;
 
   /*! \brief gradients of current iteration, ordered for cache optimized */
-  std::vector<score_t> ordered_gradients_;
+  score_t* ordered_gradients_ = nullptr;
   /*! \brief hessians of current iteration, ordered for cache optimized */
-  std::vector<score_t> ordered_hessians_;
+  score_t* ordered_hessians_ = nullptr;
 
   /*! \brief Pointer to ordered_gradients_, use this to avoid copy at BeforeTrain */
   const score_t* ptr_to_ordered_gradients_smaller_leaf_;
@@ -165,12 +455,103 @@ protected:
   bool has_ordered_bin_ = false;
   /*! \brief  is_data_in_leaf_[i] != 0 means i-th data is marked */
   std::vector<char> is_data_in_leaf_;
+  /*! \brief features that have ordered bins */
+  std::vector<int> ordered_bin_features_;
+  /*! \brief batch i of ordered bins is ordered_bin_features_[ordered_bin_batch_begin_[i], ordered_bin_batch_begin_[i + 1]) */
+  std::vector<int> ordered_bin_batch_begin_;
+  /*! \brief number of batches of ordered bins for each thread, more batches balance the load better */
+  static const int kOrderedBinBatchesPerThread = 4;
+  /*! \brief true if used data are changed by SetBaggingData since the last tree */
+  bool is_bag_changed_ = true;
+  /*! \brief true if ordered bins have cached the used data of current bag */
+  bool is_bag_cached_ = false;
   /*! \brief  max cache size(unit:GB) for historical histogram. < 0 means not limit */
   double histogram_pool_size_;
   /*! \brief used to cache historical histogram to speed up*/
   HistogramPool histogram_pool_;
+  /*! \brief max memory in byte of this learner, < 0 means not limit */
+  double memory_budget_in_bytes_;
+  /*! \brief True if all hessians are 1, then hessians are not read by histograms */
+  bool is_constant_hessian_;
   /*! \brief  max depth of tree model */
   int max_depth_;
+  /*! \brief max number of features in one feature group, <= 1 means not use feature groups */
+  int feature_group_size_;
+  /*! \brief row-major bins of dense features, histograms of them are constructed group by group */
+  std::vector<std::unique_ptr<FeatureGroup>> feature_groups_;
+  /*! \brief index of the bundle of training data each feature is in, -1 means not bundled */
+  std::vector<int> feature_bundle_index_;
+  /*! \brief is_feature_grouped_[i] = true means histograms of feature i are constructed by its feature group or bundle */
+  std::vector<bool> is_feature_grouped_;
+  /*! \brief use row-parallel histograms only when number of used features < num_threads_ * kMinFeaturesPerThread */
+  static const int kMinFeaturesPerThread = 2;
+  /*! \brief use row-parallel histograms only when each thread has at least this many data in the leaf */
+  static const data_size_t kMinDataPerThread = 4096;
+  /*! \brief number of threads */
+  int num_threads_;
+  /*! \brief offset of each feature in the thread local histogram buffers */
+  std::vector<size_t> row_parallel_hist_offset_;
+  /*! \brief thread local histogram buffers for row-parallel construction, empty means disable */
+  std::vector<std::vector<HistogramBinEntry>> row_parallel_hist_buf_;
+  /*! \brief begin of the features of each NUMA node, see Numa::Shard. empty means not use NUMA */
+  std::vector<int> numa_feature_begin_;
+  /*! \brief Number of leaves split at once */
+  int leaf_batch_size_;
+  /*! \brief Histogram slot of each data for batched construction, -1 means the data is not in any smaller child */
+  std::vector<int8_t> batch_data_slot_;
+  /*! \brief True if the dense histograms of smaller leaf are already constructed by ConstructLeafBatchHistograms */
+  bool is_smaller_batch_constructed_ = false;
+  /*! \brief True if construct histograms lazily by estimated gain bounds */
+  bool use_lazy_histogram_;
+  /*! \brief Multiplier of the estimated gain bounds, larger is closer to constructing all histograms */
+  double lazy_histogram_slack_;
+  /*! \brief Number of candidate features of the first chunk for each thread, the next chunks double in size */
+  static const int kLazyFeaturesPerThread = 2;
+  /*! \brief gain_densities_[leaf * num_features_ + i] is best gain per sum of hessians of feature i at the last evaluated ancestor of leaf */
+  std::vector<double> gain_densities_;
+  /*! \brief is_histogram_constructed_[leaf * num_features_ + i] != 0 means histogram of feature i of leaf in the pool is valid */
+  std::vector<char> is_histogram_constructed_;
+  /*! \brief True if ordered gradients of larger leaf are copied for current leaves */
+  bool is_larger_ordered_gradients_copied_ = false;
+  /*! \brief Number of candidate histograms of current tree, and the ones constructed, for statistics */
+  int64_t num_lazy_candidates_ = 0;
+  int64_t num_lazy_constructed_ = 0;
+  /*! \brief True if quantize gradients and hessians */
+  bool use_quantized_grad_;
+  /*! \brief Number of levels of quantized gradients and hessians */
+  int num_grad_quant_bins_;
+  /*! \brief True if use stochastic rounding */
+  bool stochastic_rounding_;
+  /*! \brief Number of data in a block of stochastic rounding, each block has its own generator */
+  static const data_size_t kQuantizeBlockSize = 16384;
+  /*! \brief Real value of one unit of quantized gradient */
+  double grad_scale_;
+  /*! \brief Real value of one unit of quantized hessian */
+  double hess_scale_;
+  /*! \brief Quantized gradients and hessians of current iteration, interleaved */
+  std::vector<int8_t> quantized_grad_hess_;
+  /*! \brief Quantized gradients and hessians, ordered for cache optimized */
+  std::vector<int8_t> ordered_quantized_grad_hess_;
+  /*! \brief Pointer to ordered quantized gradients and hessians of smaller leaf */
+  const int8_t* ptr_to_ordered_grad_hess_smaller_leaf_ = nullptr;
+  /*! \brief Pointer to ordered quantized gradients and hessians of larger leaf */
+  const int8_t* ptr_to_ordered_grad_hess_larger_leaf_ = nullptr;
+  /*! \brief True if store gradients and hessians in bfloat16 for dense histograms */
+  bool use_bf16_grad_;
+  /*! \brief Gradients and hessians of current iteration in bfloat16, packed by BF16GradHess */
+  std::vector<uint32_t> bf16_grad_hess_;
+  /*! \brief bfloat16 gradients and hessians, ordered for cache optimized */
+  std::vector<uint32_t> ordered_bf16_grad_hess_;
+  /*! \brief Pointer to ordered bfloat16 gradients and hessians of smaller leaf */
+  const uint32_t* ptr_to_ordered_bf16_grad_hess_smaller_leaf_ = nullptr;
+  /*! \brief Pointer to ordered bfloat16 gradients and hessians of larger leaf */
+  const uint32_t* ptr_to_ordered_bf16_grad_hess_larger_leaf_ = nullptr;
+  /*! \brief Dequantized (or rounded to bfloat16) gradients of current iteration */
+  std::vector<score_t> dequantized_gradients_;
+  /*! \brief Dequantized (or rounded to bfloat16) hessians of current iteration */
+  std::vector<score_t> dequantized_hessians_;
+  /*! \brief is_histogram_int_[i] is true if histograms of feature i are IntHistogramBinEntry of quantized gradients */
+  std::vector<bool> is_histogram_int_;
 };
 
 
@@ -188,6 +569,31 @@ inline data_size_t SerialTreeLearner::GetGlobalDataCountInLeaf(int leafIdx) cons
   }
 }
 
+inline void SerialTreeLearner::ConstructDenseHistogram(int feature_index, const LeafSplits* leaf_splits,
+  const score_t* ordered_gradients, const score_t* ordered_hessians,
+  const int8_t* ordered_grad_hess, const uint32_t* ordered_bf16_grad_hess, FeatureHistogram* histogram_array) {
+  if (histogram_array[feature_index].is_int()) {
+    histogram_array[feature_index].Construct(leaf_splits->data_indices(),
+      leaf_splits->num_data_in_leaf(),
+      leaf_splits->sum_gradients(),
+      leaf_splits->sum_hessians(),
+      ordered_grad_hess, grad_scale_, hess_scale_);
+  } else if (use_bf16_grad_) {
+    histogram_array[feature_index].Construct(leaf_splits->data_indices(),
+      leaf_splits->num_data_in_leaf(),
+      leaf_splits->sum_gradients(),
+      leaf_splits->sum_hessians(),
+      ordered_bf16_grad_hess);
+  } else {
+    histogram_array[feature_index].Construct(leaf_splits->data_indices(),
+      leaf_splits->num_data_in_leaf(),
+      leaf_splits->sum_gradients(),
+      leaf_splits->sum_hessians(),
+      ordered_gradients,
+      ordered_hessians);
+  }
+}
+
 inline void SerialTreeLearner::FindBestSplitForLeaf(LeafSplits* leaf_splits) {
   if (leaf_splits == nullptr || leaf_splits->LeafIndex() < 0) {
     return;
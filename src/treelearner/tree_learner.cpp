@@ -2,6 +2,7 @@
 
 #include "serial_tree_learner.h"
 #include "parallel_tree_learner.h"
+#include "gpu_tree_learner.h"
 
 namespace LightGBM {
 
@@ -12,6 +13,16 @@ TreeLearner* TreeLearner::CreateTreeLearner(TreeLearnerType type, const TreeConf
     return new FeatureParallelTreeLearner(tree_config);
   } else if (type == TreeLearnerType::kDataParallelTreeLearner) {
     return new DataParallelTreeLearner(tree_config);
+  } else if (type == TreeLearnerType::kVotingParallelTreeLearner) {
+    return new VotingParallelTreeLearner(tree_config);
+  } else if (type == TreeLearnerType::kHybridParallelTreeLearner) {
+    return new HybridParallelTreeLearner(tree_config);
+  } else if (type == TreeLearnerType::kGPUTreeLearner) {
+#ifdef USE_GPU
+    return new GPUTreeLearner(tree_config);
+#else
+    Log::Fatal("GPU tree learner is not enabled, please build with -DUSE_GPU=ON");
+#endif
   }
   return nullptr;
 }
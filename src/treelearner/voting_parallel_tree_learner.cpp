@@ -0,0 +1,375 @@
+#include "parallel_tree_learner.h"
+
+#include <cstring>
+
+#include <tuple>
+#include <vector>
+#include <algorithm>
+
+namespace LightGBM {
+
+VotingParallelTreeLearner::VotingParallelTreeLearner(const TreeConfig& tree_config)
+  :SerialTreeLearner(tree_config) {
+  top_k_ = tree_config.top_k;
+}
+
+VotingParallelTreeLearner::~VotingParallelTreeLearner() {
+
+}
+
+void VotingParallelTreeLearner::Init(const Dataset* train_data) {
+  // Get local rank and global machine size
+  rank_ = Network::rank();
+  num_machines_ = Network::num_machines();
+  // local histograms only have about 1 / num_machines of data, so scale down the constraints when finding local splits
+  const data_size_t min_num_data_one_leaf = min_num_data_one_leaf_;
+  const double min_sum_hessian_one_leaf = min_sum_hessian_one_leaf_;
+  min_num_data_one_leaf_ /= num_machines_;
+  min_sum_hessian_one_leaf_ /= num_machines_;
+  // initialize SerialTreeLearner
+  SerialTreeLearner::Init(train_data);
+  min_num_data_one_leaf_ = min_num_data_one_leaf;
+  min_sum_hessian_one_leaf_ = min_sum_hessian_one_leaf;
+
+  // global histograms use the original constraints
+  smaller_leaf_histogram_array_global_.reset(new FeatureHistogram[num_features_]);
+  larger_leaf_histogram_array_global_.reset(new FeatureHistogram[num_features_]);
+  size_t histogram_size = 0;
+  for (int i = 0; i < num_features_; ++i) {
+    smaller_leaf_histogram_array_global_[i].Init(train_data_->FeatureAt(i), i, min_num_data_one_leaf_,
+      min_sum_hessian_one_leaf_, lambda_l1_, lambda_l2_, min_gain_to_split_, nullptr, is_histogram_int_[i]);
+    larger_leaf_histogram_array_global_[i].Init(train_data_->FeatureAt(i), i, min_num_data_one_leaf_,
+      min_sum_hessian_one_leaf_, lambda_l1_, lambda_l2_, min_gain_to_split_, nullptr, is_histogram_int_[i]);
+    histogram_size += HistogramSizeInByte(i);
+  }
+  smaller_leaf_splits_global_.reset(new LeafSplits(num_features_, num_data_));
+  larger_leaf_splits_global_.reset(new LeafSplits(num_features_, num_data_));
+
+  // allocate buffer for communication, big enough for the histograms of both leaves and the votes of all machines
+  size_t buffer_size = std::max(histogram_size * 2,
+    sizeof(SplitInfo) * 2 * top_k_ * static_cast<size_t>(num_machines_));
+  input_buffer_.resize(buffer_size);
+  output_buffer_.resize(buffer_size);
+
+  global_data_count_in_leaf_.resize(num_leaves_);
+}
+
+void VotingParallelTreeLearner::AddMemoryUsage(MemoryUsage* memory_usage) const {
+  SerialTreeLearner::AddMemoryUsage(memory_usage);
+  // buffers of network
+  memory_usage->Add(kTreeLearnerMemory, input_buffer_.capacity() + output_buffer_.capacity());
+}
+
+void VotingParallelTreeLearner::BeforeTrain() {
+  SerialTreeLearner::BeforeTrain();
+  // sync global data sumup info
+  std::tuple<data_size_t, double, double> data(smaller_leaf_splits_->num_data_in_leaf(),
+             smaller_leaf_splits_->sum_gradients(), smaller_leaf_splits_->sum_hessians());
+  int size = sizeof(data);
+  std::memcpy(input_buffer_.data(), &data, size);
+  // global sumup reduce
+  Network::SetPhase(kGlobalSyncPhase);
+  Network::Allreduce(input_buffer_.data(), size, size, output_buffer_.data(), [](const char *src, char *dst, int len) {
+    int used_size = 0;
+    int type_size = sizeof(std::tuple<data_size_t, double, double>);
+    const std::tuple<data_size_t, double, double> *p1;
+    std::tuple<data_size_t, double, double> *p2;
+    while (used_size < len) {
+      p1 = reinterpret_cast<const std::tuple<data_size_t, double, double> *>(src);
+      p2 = reinterpret_cast<std::tuple<data_size_t, double, double> *>(dst);
+      std::get<0>(*p2) = std::get<0>(*p2) + std::get<0>(*p1);
+      std::get<1>(*p2) = std::get<1>(*p2) + std::get<1>(*p1);
+      std::get<2>(*p2) = std::get<2>(*p2) + std::get<2>(*p1);
+      src += type_size;
+      dst += type_size;
+      used_size += type_size;
+    }
+  });
+  Network::SetPhase(kOtherPhase);
+  // copy back
+  std::memcpy(static_cast<void*>(&data), output_buffer_.data(), size);
+  // set global sumup info, local leaf splits keep the local sums
+  smaller_leaf_splits_global_->Init(std::get<1>(data), std::get<2>(data));
+  larger_leaf_splits_global_->Init();
+  // init global data count in leaf
+  global_data_count_in_leaf_[0] = std::get<0>(data);
+}
+
+void VotingParallelTreeLearner::SyncUpQuantizationRange(double* max_gradient, double* max_hessian) {
+  double range[2] = { *max_gradient, *max_hessian };
+  Network::SetPhase(kGlobalSyncPhase);
+  GlobalMax(range, 2);
+  Network::SetPhase(kOtherPhase);
+  *max_gradient = range[0];
+  *max_hessian = range[1];
+}
+
+int64_t VotingParallelTreeLearner::NumDataOfHistograms() {
+  return GlobalSum(num_data_);
+}
+
+void VotingParallelTreeLearner::FindLocalBestThresholds() {
+  const bool has_larger_leaf = larger_leaf_splits_ != nullptr && larger_leaf_splits_->LeafIndex() >= 0;
+  // construct histograms by other strategies first, then the rest are constructed feature by feature
+  bool is_smaller_dense_constructed = ConstructRowParallelHistograms(smaller_leaf_splits_.get(),
+    ptr_to_ordered_gradients_smaller_leaf_, ptr_to_ordered_hessians_smaller_leaf_, smaller_leaf_histogram_array_);
+  bool is_larger_dense_constructed = false;
+  if (parent_leaf_histogram_array_ == nullptr && has_larger_leaf) {
+    is_larger_dense_constructed = ConstructRowParallelHistograms(larger_leaf_splits_.get(),
+      ptr_to_ordered_gradients_larger_leaf_, ptr_to_ordered_hessians_larger_leaf_, larger_leaf_histogram_array_);
+  }
+  if (!feature_groups_.empty() || train_data_->num_feature_bundles() > 0) {
+    ConstructGroupedHistograms(smaller_leaf_splits_.get(), ptr_to_ordered_gradients_smaller_leaf_,
+      ptr_to_ordered_hessians_smaller_leaf_, smaller_leaf_histogram_array_);
+    if (parent_leaf_histogram_array_ == nullptr && has_larger_leaf) {
+      ConstructGroupedHistograms(larger_leaf_splits_.get(), ptr_to_ordered_gradients_larger_leaf_,
+        ptr_to_ordered_hessians_larger_leaf_, larger_leaf_histogram_array_);
+    }
+  }
+  #pragma omp parallel for schedule(guided)
+  for (int feature_index = 0; feature_index < num_features_; ++feature_index) {
+    if ((is_feature_used_.size() > 0 && is_feature_used_[feature_index] == false)) continue;
+    // construct histograms for smaller leaf
+    if (is_feature_grouped_[feature_index]
+      || (is_smaller_dense_constructed && ordered_bins_[feature_index] == nullptr)) {
+      // already constructed
+    } else if (ordered_bins_[feature_index] == nullptr) {
+      ConstructDenseHistogram(feature_index, smaller_leaf_splits_.get(),
+        ptr_to_ordered_gradients_smaller_leaf_,
+        ptr_to_ordered_hessians_smaller_leaf_,
+        ptr_to_ordered_grad_hess_smaller_leaf_,
+        ptr_to_ordered_bf16_grad_hess_smaller_leaf_,
+        smaller_leaf_histogram_array_);
+    } else {
+      smaller_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
+        smaller_leaf_splits_->LeafIndex(),
+        smaller_leaf_splits_->num_data_in_leaf(),
+        smaller_leaf_splits_->sum_gradients(),
+        smaller_leaf_splits_->sum_hessians(),
+        gradients_,
+        HistogramHessians());
+    }
+    // find local best threshold for smaller child
+    smaller_leaf_histogram_array_[feature_index].FindBestThreshold(&smaller_leaf_splits_->BestSplitPerFeature()[feature_index]);
+
+    // only has root leaf
+    if (!has_larger_leaf) continue;
+
+    if (parent_leaf_histogram_array_ != nullptr) {
+      // we initialize larger leaf as the parent, so we can just subtract the smaller leaf's histograms
+      larger_leaf_histogram_array_[feature_index].Subtract(smaller_leaf_histogram_array_[feature_index]);
+    } else if (!is_feature_grouped_[feature_index]
+      && !(is_larger_dense_constructed && ordered_bins_[feature_index] == nullptr)) {
+      if (ordered_bins_[feature_index] == nullptr) {
+        ConstructDenseHistogram(feature_index, larger_leaf_splits_.get(),
+          ptr_to_ordered_gradients_larger_leaf_,
+          ptr_to_ordered_hessians_larger_leaf_,
+          ptr_to_ordered_grad_hess_larger_leaf_,
+          ptr_to_ordered_bf16_grad_hess_larger_leaf_,
+          larger_leaf_histogram_array_);
+      } else {
+        larger_leaf_histogram_array_[feature_index].Construct(ordered_bins_[feature_index].get(),
+          larger_leaf_splits_->LeafIndex(),
+          larger_leaf_splits_->num_data_in_leaf(),
+          larger_leaf_splits_->sum_gradients(),
+          larger_leaf_splits_->sum_hessians(),
+          gradients_,
+          HistogramHessians());
+      }
+    }
+    // find local best threshold for larger child
+    larger_leaf_histogram_array_[feature_index].FindBestThreshold(&larger_leaf_splits_->BestSplitPerFeature()[feature_index]);
+  }
+}
+
+void VotingParallelTreeLearner::GlobalVoting(const std::vector<SplitInfo>& local_splits, std::vector<int>* out) const {
+  std::vector<int> num_votes(num_features_, 0);
+  std::vector<double> sum_gains(num_features_, 0.0f);
+  for (const SplitInfo& split_info : local_splits) {
+    if (split_info.feature < 0 || !(split_info.gain > kMinScore)) { continue; }
+    ++num_votes[split_info.feature];
+    sum_gains[split_info.feature] += split_info.gain;
+  }
+  out->clear();
+  for (int i = 0; i < num_features_; ++i) {
+    if (num_votes[i] > 0) {
+      out->push_back(i);
+    }
+  }
+  std::sort(out->begin(), out->end(), [&num_votes, &sum_gains](int a, int b) {
+    if (num_votes[a] != num_votes[b]) { return num_votes[a] > num_votes[b]; }
+    if (sum_gains[a] != sum_gains[b]) { return sum_gains[a] > sum_gains[b]; }
+    return a < b;
+  });
+  if (out->size() > static_cast<size_t>(2 * top_k_)) {
+    out->resize(2 * top_k_);
+  }
+}
+
+void VotingParallelTreeLearner::FindBestThresholds() {
+  FindLocalBestThresholds();
+  const bool has_larger_leaf = larger_leaf_splits_global_->LeafIndex() >= 0;
+
+  // local top_k splits of both leaves, padded with empty splits
+  std::vector<SplitInfo> smaller_top_k, larger_top_k;
+  ArrayArgs<SplitInfo>::MaxK(smaller_leaf_splits_->BestSplitPerFeature(), top_k_, &smaller_top_k);
+  if (has_larger_leaf) {
+    ArrayArgs<SplitInfo>::MaxK(larger_leaf_splits_->BestSplitPerFeature(), top_k_, &larger_top_k);
+  }
+  smaller_top_k.resize(top_k_);
+  larger_top_k.resize(top_k_);
+  const int vote_size = static_cast<int>(sizeof(SplitInfo)) * top_k_;
+  std::memcpy(input_buffer_.data(), smaller_top_k.data(), vote_size);
+  std::memcpy(input_buffer_.data() + vote_size, larger_top_k.data(), vote_size);
+  // gather the votes of all machines
+  Network::SetPhase(kHistogramPhase);
+  Network::Allgather(input_buffer_.data(), vote_size * 2, output_buffer_.data());
+  Network::SetPhase(kOtherPhase);
+  std::vector<SplitInfo> smaller_votes(static_cast<size_t>(top_k_) * num_machines_);
+  std::vector<SplitInfo> larger_votes(static_cast<size_t>(top_k_) * num_machines_);
+  for (int i = 0; i < num_machines_; ++i) {
+    std::memcpy(smaller_votes.data() + static_cast<size_t>(i) * top_k_,
+      output_buffer_.data() + static_cast<size_t>(i) * vote_size * 2, vote_size);
+    std::memcpy(larger_votes.data() + static_cast<size_t>(i) * top_k_,
+      output_buffer_.data() + static_cast<size_t>(i) * vote_size * 2 + vote_size, vote_size);
+  }
+  // every machine gets the same candidates from the same votes
+  std::vector<int> smaller_candidates, larger_candidates;
+  GlobalVoting(smaller_votes, &smaller_candidates);
+  if (has_larger_leaf) {
+    GlobalVoting(larger_votes, &larger_candidates);
+  }
+
+  // histograms to reduce, smaller leaf's candidates first
+  std::vector<int> reduce_features(smaller_candidates);
+  reduce_features.insert(reduce_features.end(), larger_candidates.begin(), larger_candidates.end());
+  const int num_smaller_candidates = static_cast<int>(smaller_candidates.size());
+  const int num_reduce = static_cast<int>(reduce_features.size());
+  if (num_reduce == 0) { return; }
+
+  // distribute the histograms to machines by number of bins
+  std::vector<int> reduce_machine(num_reduce);
+  std::vector<int> num_bins_distributed(num_machines_, 0);
+  std::vector<int> block_len(num_machines_, 0);
+  for (int i = 0; i < num_reduce; ++i) {
+    const int machine = static_cast<int>(ArrayArgs<int>::ArgMin(num_bins_distributed));
+    reduce_machine[i] = machine;
+    num_bins_distributed[machine] += train_data_->FeatureAt(reduce_features[i])->num_bin();
+    block_len[machine] += HistogramSizeInByte(reduce_features[i]);
+  }
+  std::vector<int> block_start(num_machines_, 0);
+  for (int i = 0; i < num_machines_; ++i) {
+    if (i > 0) {
+      block_start[i] = block_start[i - 1] + block_len[i - 1];
+    }
+  }
+  const int reduce_scatter_size = block_start[num_machines_ - 1] + block_len[num_machines_ - 1];
+  std::vector<int> write_pos(num_reduce);
+  std::vector<int> machine_pos(block_start);
+  for (int i = 0; i < num_reduce; ++i) {
+    write_pos[i] = machine_pos[reduce_machine[i]];
+    machine_pos[reduce_machine[i]] += HistogramSizeInByte(reduce_features[i]);
+  }
+
+  // copy local histograms to buffer
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < num_reduce; ++i) {
+    const FeatureHistogram& histogram = i < num_smaller_candidates
+      ? smaller_leaf_histogram_array_[reduce_features[i]] : larger_leaf_histogram_array_[reduce_features[i]];
+    std::memcpy(input_buffer_.data() + write_pos[i], histogram.HistogramData(), histogram.SizeOfHistgram());
+  }
+
+  // Reduce scatter for histogram, empty bins are not sent
+  Network::SetPhase(kHistogramPhase);
+  if (use_quantized_grad_) {
+    // integer and real histograms are mixed in the buffer
+    HistogramBufferLayout layout;
+    layout.Reset(input_buffer_.data());
+    for (int i = 0; i < num_reduce; ++i) {
+      layout.Add(write_pos[i], HistogramSizeInByte(reduce_features[i]), is_histogram_int_[reduce_features[i]]);
+    }
+    layout.Finish();
+    Network::ReduceScatter(input_buffer_.data(), reduce_scatter_size, block_start.data(),
+                           block_len.data(), output_buffer_.data(),
+                           [&layout](const char* src, int len, char* dst) { return layout.Encode(src, len, dst); },
+                           [&layout](const char* src, int src_size, char* dst, int len) {
+                             layout.DecodeSumReducer(src, src_size, dst, len);
+                           });
+  } else {
+    Network::ReduceScatter(input_buffer_.data(), reduce_scatter_size, block_start.data(),
+                           block_len.data(), output_buffer_.data(), &HistogramBinEntry::Encode,
+                           &HistogramBinEntry::DecodeSumReducer);
+  }
+  Network::SetPhase(kOtherPhase);
+
+  // find global best thresholds of the histograms aggregated by local machine
+  #pragma omp parallel for schedule(guided)
+  for (int i = 0; i < num_reduce; ++i) {
+    if (reduce_machine[i] != rank_) { continue; }
+    const int feature_index = reduce_features[i];
+    const bool is_smaller = i < num_smaller_candidates;
+    FeatureHistogram& histogram = is_smaller
+      ? smaller_leaf_histogram_array_global_[feature_index] : larger_leaf_histogram_array_global_[feature_index];
+    LeafSplits* leaf_splits = is_smaller ? smaller_leaf_splits_global_.get() : larger_leaf_splits_global_.get();
+    // copy global sumup info
+    histogram.SetSumup(GetGlobalDataCountInLeaf(leaf_splits->LeafIndex()),
+                       leaf_splits->sum_gradients(), leaf_splits->sum_hessians(), is_constant_hessian_);
+    // restore global histograms from buffer, all machines quantize gradients by the same scales
+    histogram.SetScales(grad_scale_, hess_scale_);
+    histogram.FromMemory(output_buffer_.data() + write_pos[i] - block_start[rank_]);
+    histogram.FindBestThreshold(&leaf_splits->BestSplitPerFeature()[feature_index]);
+  }
+}
+
+void VotingParallelTreeLearner::FindBestSplitsForLeaves() {
+  SplitInfo smaller_best, larger_best;
+  // find local best split of the aggregated features
+  smaller_best = smaller_leaf_splits_global_->BestSplitPerFeature()[
+    ArrayArgs<SplitInfo>::ArgMax(smaller_leaf_splits_global_->BestSplitPerFeature())];
+  if (larger_leaf_splits_global_->LeafIndex() >= 0) {
+    larger_best = larger_leaf_splits_global_->BestSplitPerFeature()[
+      ArrayArgs<SplitInfo>::ArgMax(larger_leaf_splits_global_->BestSplitPerFeature())];
+  }
+
+  // sync global best info
+  std::memcpy(input_buffer_.data(), &smaller_best, sizeof(SplitInfo));
+  std::memcpy(input_buffer_.data() + sizeof(SplitInfo), &larger_best, sizeof(SplitInfo));
+
+  Network::SetPhase(kSplitPhase);
+  Network::Allreduce(input_buffer_.data(), sizeof(SplitInfo) * 2, sizeof(SplitInfo),
+                     output_buffer_.data(), &SplitInfo::MaxReducer);
+  Network::SetPhase(kOtherPhase);
+
+  std::memcpy(&smaller_best, output_buffer_.data(), sizeof(SplitInfo));
+  std::memcpy(&larger_best, output_buffer_.data() + sizeof(SplitInfo), sizeof(SplitInfo));
+
+  // set best split
+  best_split_per_leaf_[smaller_leaf_splits_global_->LeafIndex()] = smaller_best;
+  if (larger_leaf_splits_global_->LeafIndex() >= 0) {
+    best_split_per_leaf_[larger_leaf_splits_global_->LeafIndex()] = larger_best;
+  }
+}
+
+void VotingParallelTreeLearner::Split(Tree* tree, int best_Leaf, int* left_leaf, int* right_leaf) {
+  SerialTreeLearner::Split(tree, best_Leaf, left_leaf, right_leaf);
+  const SplitInfo& best_split_info = best_split_per_leaf_[best_Leaf];
+  // need update global number of data in leaf
+  global_data_count_in_leaf_[*left_leaf] = best_split_info.left_count;
+  global_data_count_in_leaf_[*right_leaf] = best_split_info.right_count;
+  // split info has the global sums, local leaf splits sum up local data instead
+  if (best_split_info.left_count < best_split_info.right_count) {
+    smaller_leaf_splits_global_->Init(*left_leaf, data_partition_.get(),
+      best_split_info.left_sum_gradient, best_split_info.left_sum_hessian);
+    larger_leaf_splits_global_->Init(*right_leaf, data_partition_.get(),
+      best_split_info.right_sum_gradient, best_split_info.right_sum_hessian);
+  } else {
+    smaller_leaf_splits_global_->Init(*right_leaf, data_partition_.get(),
+      best_split_info.right_sum_gradient, best_split_info.right_sum_hessian);
+    larger_leaf_splits_global_->Init(*left_leaf, data_partition_.get(),
+      best_split_info.left_sum_gradient, best_split_info.left_sum_hessian);
+  }
+  smaller_leaf_splits_->Init(smaller_leaf_splits_global_->LeafIndex(), data_partition_.get(), gradients_, HistogramHessians());
+  larger_leaf_splits_->Init(larger_leaf_splits_global_->LeafIndex(), data_partition_.get(), gradients_, HistogramHessians());
+}
+
+}  // namespace LightGBM
@@ -2,6 +2,7 @@ import sys
 import os
 import ctypes
 import collections
+import threading
 
 import numpy as np
 from scipy import sparse
@@ -157,6 +158,35 @@ def test_load_from_mat(filename, reference):
     LIB.LGBM_DatasetSetField(handle, c_str('label'), c_array(ctypes.c_float, label), len(label), 0)
     print ('#data:%d #feature:%d' %(num_data.value, num_feature.value) ) 
     return handle
+def test_push_rows(filename, reference):
+    data = []
+    label = []
+    inp = open(filename, 'r')
+    for line in inp.readlines():
+        data.append( [float(x) for x in line.split('\t')[1:]] )
+        label.append( float(line.split('\t')[0]) )
+    inp.close()
+    mat = np.array(data)
+    label = np.array(label, dtype=np.float32)
+    handle = ctypes.c_void_p()
+    LIB.LGBM_CreateDatasetByReference(reference, mat.shape[0], c_str('max_bin=15'), ctypes.byref(handle))
+    batch_size = 1000
+    for start in range(0, mat.shape[0], batch_size):
+        batch = np.array(mat[start:start + batch_size].reshape(-1), copy=True)
+        LIB.LGBM_DatasetPushRows(handle,
+            batch.ctypes.data_as(ctypes.POINTER(ctypes.c_void_p)),
+            dtype_float64,
+            batch.size // mat.shape[1],
+            mat.shape[1],
+            start)
+    LIB.LGBM_DatasetFinishLoad(handle)
+    num_data = ctypes.c_long()
+    LIB.LGBM_DatasetGetNumData(handle, ctypes.byref(num_data) )
+    num_feature = ctypes.c_long()
+    LIB.LGBM_DatasetGetNumFeature(handle, ctypes.byref(num_feature) )
+    LIB.LGBM_DatasetSetField(handle, c_str('label'), c_array(ctypes.c_float, label), len(label), 0)
+    print ('#data:%d #feature:%d' %(num_data.value, num_feature.value) ) 
+    return handle
 def test_free_dataset(handle):
     LIB.LGBM_DatasetFree(handle)
 
@@ -168,6 +198,8 @@ def test_dataset():
     test_free_dataset(test)
     test = test_load_from_csc('../../examples/binary_classification/binary.test', train)
     test_free_dataset(test)
+    test = test_push_rows('../../examples/binary_classification/binary.test', train)
+    test_free_dataset(test)
     test_save_to_binary(train, 'train.binary.bin')
     test_free_dataset(train)
     train  = test_load_from_binary('train.binary.bin')
@@ -186,8 +218,104 @@ def test_booster():
         out_len = ctypes.c_ulong(0)
         LIB.LGBM_BoosterEval(booster, 0, ctypes.byref(out_len), result.ctypes.data_as(ctypes.POINTER(ctypes.c_float)))
         print ('%d Iteration test AUC %f' %(i, result[0]))
+        if i == 49:
+            LIB.LGBM_BoosterSaveCheckpoint(booster, c_str('model.checkpoint'))
+    # test AUC after every 10 iterations in one pass over the trees
+    num_stages = ctypes.c_long(0)
+    staged_len = ctypes.c_long(0)
+    staged_result = np.zeros(10, dtype=np.float64)
+    LIB.LGBM_BoosterEvalStaged(booster, test[0], ctypes.c_long(-1), 10, ctypes.byref(num_stages),
+        ctypes.byref(staged_len), staged_result.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+    for i in range(num_stages.value):
+        print ('%d Iteration staged test AUC %f' %((i + 1) * 10 - 1, staged_result[i]))
     LIB.LGBM_BoosterSaveModel(booster, -1, c_str('model.txt'))
+    LIB.LGBM_BoosterSaveModelToIfElse(booster, -1, c_str('model.cpp'))
+    LIB.LGBM_BoosterSaveModelToBinary(booster, -1, c_str('model.bin'))
+    LIB.LGBM_BoosterFree(booster)
+    # resume from the checkpoint, the model should be the same
+    booster = ctypes.c_void_p()
+    LIB.LGBM_BoosterCreate(train, c_array(ctypes.c_void_p, test), c_array(ctypes.c_char_p, name), 
+        len(test), c_str("app=binary metric=auc num_leaves=31 verbose=0"), ctypes.byref(booster))
+    LIB.LGBM_BoosterLoadCheckpoint(booster, c_str('model.checkpoint'))
+    for i in range(50):
+        LIB.LGBM_BoosterUpdateOneIter(booster,ctypes.byref(is_finished))
+    LIB.LGBM_BoosterSaveModel(booster, -1, c_str('model_resumed.txt'))
     LIB.LGBM_BoosterFree(booster)
+    print(open('model.txt').read() == open('model_resumed.txt').read())
+    # refit the loaded model without decay, the leaf outputs are fitted again from the gradients of the data
+    def refit_max_diff(filename, refit_data):
+        mat = np.loadtxt(filename)[:, 1:]
+        data = np.array(mat.reshape(mat.size), copy=False)
+        num_trees = 100
+        def predict(handle, predict_type, out):
+            LIB.LGBM_BoosterPredictForMat(handle,
+                data.ctypes.data_as(ctypes.POINTER(ctypes.c_void_p)),
+                dtype_float64,
+                mat.shape[0],
+                mat.shape[1],
+                1,
+                predict_type,
+                num_trees,
+                out.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+        original = ctypes.c_void_p()
+        LIB.LGBM_BoosterLoadFromModelfile(c_str('model.txt'), ctypes.byref(original))
+        refitted = ctypes.c_void_p()
+        LIB.LGBM_BoosterLoadFromModelfile(c_str('model.txt'), ctypes.byref(refitted))
+        leaf_preds = np.zeros((mat.shape[0], num_trees), dtype=np.float64)
+        predict(refitted, 2, leaf_preds)
+        leaf_preds = np.array(leaf_preds, dtype=np.int32)
+        LIB.LGBM_BoosterRefit(refitted, refit_data, c_str("app=binary refit_decay_rate=0 verbose=0"),
+            leaf_preds.ctypes.data_as(ctypes.POINTER(ctypes.c_int32)), leaf_preds.shape[0], leaf_preds.shape[1])
+        original_scores = np.zeros(mat.shape[0], dtype=np.float64)
+        predict(original, 1, original_scores)
+        refitted_scores = np.zeros(mat.shape[0], dtype=np.float64)
+        predict(refitted, 1, refitted_scores)
+        LIB.LGBM_BoosterFree(original)
+        LIB.LGBM_BoosterFree(refitted)
+        return np.max(np.abs(original_scores - refitted_scores))
+    # on the training data without bagging, the refitted outputs are the trained ones
+    print(refit_max_diff('../../examples/binary_classification/binary.train', train) < 1e-5)
+    # on other data the outputs change
+    print(refit_max_diff('../../examples/binary_classification/binary.test', test[0]) > 1e-2)
+    # boosters of a parameter sweep share the training data and train in different threads
+    def train_sweep(num_leaves, filename):
+        sweep_booster = ctypes.c_void_p()
+        LIB.LGBM_BoosterCreate(train, None, None, 0,
+            c_str("app=binary num_leaves=%d num_threads=1 verbose=0" % num_leaves), ctypes.byref(sweep_booster))
+        sweep_finished = ctypes.c_int(0)
+        for i in range(10):
+            LIB.LGBM_BoosterUpdateOneIter(sweep_booster, ctypes.byref(sweep_finished))
+        LIB.LGBM_BoosterSaveModelToBinary(sweep_booster, -1, c_str(filename))
+        LIB.LGBM_BoosterFree(sweep_booster)
+    threads = [threading.Thread(target=train_sweep, args=(num_leaves, 'model_sweep_%d.bin' % num_leaves))
+        for num_leaves in [7, 15, 31]]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    train_sweep(15, 'model_sweep_serial.bin')
+    print(open('model_sweep_15.bin', 'rb').read() == open('model_sweep_serial.bin', 'rb').read())
+    # append new data to the training data and continue training without binning the old data again
+    booster = ctypes.c_void_p()
+    LIB.LGBM_BoosterCreate(train, c_array(ctypes.c_void_p, test), c_array(ctypes.c_char_p, name), 
+        len(test), c_str("app=binary metric=auc num_leaves=31 verbose=0"), ctypes.byref(booster))
+    for i in range(10):
+        LIB.LGBM_BoosterUpdateOneIter(booster,ctypes.byref(is_finished))
+    new_data = test_load_from_mat('../../examples/binary_classification/binary.test', train)
+    # data shared by other boosters cannot be appended, the others refer to its labels and bins
+    other_booster = ctypes.c_void_p()
+    LIB.LGBM_BoosterCreate(train, None, None, 0, c_str("app=binary verbose=0"), ctypes.byref(other_booster))
+    print('append shared data by booster:%d' % LIB.LGBM_BoosterAppendTrainingData(booster, new_data))
+    LIB.LGBM_BoosterFree(other_booster)
+    print('append data of booster:%d' % LIB.LGBM_DatasetAppend(train, new_data))
+    LIB.LGBM_BoosterAppendTrainingData(booster, new_data)
+    for i in range(10):
+        LIB.LGBM_BoosterUpdateOneIter(booster,ctypes.byref(is_finished))
+    num_data = ctypes.c_long()
+    LIB.LGBM_DatasetGetNumData(train, ctypes.byref(num_data))
+    print('#data after appending:%d' % num_data.value)
+    LIB.LGBM_BoosterFree(booster)
+    test_free_dataset(new_data)
     test_free_dataset(train)
     test_free_dataset(test[0])
     booster2 = ctypes.c_void_p()
@@ -210,8 +338,103 @@ def test_booster():
         50,
         preb.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
     LIB.LGBM_BoosterPredictForFile(booster2, 1, 50, 0, c_str('../../examples/binary_classification/binary.test'), c_str('preb.txt'))
+    LIB.LGBM_BoosterSetPredictOnBins(booster2, 1)
+    preb_bins = np.zeros(( mat.shape[0],1 ), dtype=np.float64)
+    LIB.LGBM_BoosterPredictForMat(booster2,
+        data.ctypes.data_as(ctypes.POINTER(ctypes.c_void_p)), 
+        dtype_float64,
+        mat.shape[0],
+        mat.shape[1],
+        1,
+        1,
+        50,
+        preb_bins.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+    print(np.array_equal(preb, preb_bins))
+    context = ctypes.c_void_p()
+    LIB.LGBM_BoosterCreatePredictContext(booster2, 1, 50, ctypes.byref(context))
+    row = np.array(mat[0], copy=True)
+    preb_row = np.zeros(1, dtype=np.float64)
+    LIB.LGBM_BoosterPredictForMatSingleRow(context,
+        row.ctypes.data_as(ctypes.POINTER(ctypes.c_void_p)),
+        dtype_float64,
+        row.shape[0],
+        preb_row.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+    print(preb_row[0] == preb_bins[0][0])
+    LIB.LGBM_PredictContextFree(context)
+    # contributions of features and the expected value sum to the raw score
+    contribs = np.zeros(( mat.shape[0], mat.shape[1] + 1 ), dtype=np.float64)
+    LIB.LGBM_BoosterPredictForMat(booster2,
+        data.ctypes.data_as(ctypes.POINTER(ctypes.c_void_p)),
+        dtype_float64,
+        mat.shape[0],
+        mat.shape[1],
+        1,
+        3,
+        50,
+        contribs.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+    print(np.allclose(contribs.sum(axis=1), preb[:, 0]))
+    registry = ctypes.c_void_p()
+    LIB.LGBM_RegistryCreate(ctypes.byref(registry))
+    LIB.LGBM_RegistryLoadModel(registry, c_str('binary'), c_str('model.txt'), c_str('num_model_predict=50'))
+    preb_registry = np.zeros(( mat.shape[0],1 ), dtype=np.float64)
+    LIB.LGBM_RegistryPredictForMat(registry, c_str('binary'),
+        data.ctypes.data_as(ctypes.POINTER(ctypes.c_void_p)),
+        dtype_float64,
+        mat.shape[0],
+        mat.shape[1],
+        1,
+        1,
+        preb_registry.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+    print(np.array_equal(preb, preb_registry))
+    LIB.LGBM_RegistryLoadModel(registry, c_str('binary'), c_str('model.bin'), c_str(''))
+    LIB.LGBM_RegistryRemoveModel(registry, c_str('binary'))
+    LIB.LGBM_RegistryFree(registry)
     LIB.LGBM_BoosterFree(booster2)
 
+def test_gpu():
+    # histograms constructed by the OpenCL kernels should give the trees of the serial tree learner,
+    # leaves need at least 16384 rows to be constructed on the device
+    rng = np.random.RandomState(7)
+    mat = np.hstack([rng.normal(size=(100000, 10)), rng.randint(0, 6, size=(100000, 3)).astype(np.float64)])
+    label = (mat[:, 0] * 1.5 - mat[:, 1] + 0.7 * mat[:, 2] * mat[:, 3] + 0.3 * mat[:, 10]
+        + rng.normal(size=100000) > 0).astype(np.float32)
+    data = np.array(mat.reshape(mat.size), copy=False)
+    train = ctypes.c_void_p()
+    LIB.LGBM_CreateDatasetFromMat(data.ctypes.data_as(ctypes.POINTER(ctypes.c_void_p)),
+        dtype_float64,
+        mat.shape[0],
+        mat.shape[1],
+        1,
+        c_str(''),
+        None,
+        ctypes.byref(train))
+    LIB.LGBM_DatasetSetField(train, c_str('label'), c_array(ctypes.c_float, label), len(label), 0)
+    def train_predict(tree_learner):
+        booster = ctypes.c_void_p()
+        LIB.LGBM_BoosterCreate(train, None, None, 0,
+            c_str("app=binary num_leaves=31 tree_learner=%s verbose=0" % tree_learner), ctypes.byref(booster))
+        is_finished = ctypes.c_int(0)
+        for i in range(20):
+            LIB.LGBM_BoosterUpdateOneIter(booster, ctypes.byref(is_finished))
+        preds = np.zeros(mat.shape[0], dtype=np.float64)
+        LIB.LGBM_BoosterPredictForMat(booster,
+            data.ctypes.data_as(ctypes.POINTER(ctypes.c_void_p)),
+            dtype_float64,
+            mat.shape[0],
+            mat.shape[1],
+            1,
+            1,
+            -1,
+            preds.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+        LIB.LGBM_BoosterFree(booster)
+        return preds
+    # sums of float histograms on the device differ from the host in rounding only
+    print(np.allclose(train_predict('serial'), train_predict('gpu'), atol=1e-3))
+    test_free_dataset(train)
+
 test_dataset()
 test_booster()
+# needs the library built with -DUSE_GPU=ON and an OpenCL device, e.g. PoCL on CPU
+if os.environ.get('LIGHTGBM_TEST_GPU') == '1':
+    test_gpu()
 